@@ -18,19 +18,1551 @@
 //	H E A D E R S.
 /////////////////////////////////////////////////////////////////////
 #include <Windows.h>
+#include <winioctl.h>
 #include <tchar.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "6fingsioctl.h"
+#include "transport.h"
+#include "loadgen.h"
+#include "shmring.h"
+#include "6fingstrace.h"
+#include "tracedecode.h"
+#include "lzbench.h"
+#include "strscanbench.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static const DWORD g_dwMessageSizes[] =
+{
+	16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+#define MESSAGE_SIZE_COUNT	(sizeof(g_dwMessageSizes) / sizeof(g_dwMessageSizes[0]))
+
+//
+//	IRP_MJ_* names, indexed by major function.
+//
+static const char* g_pszMajorNames[FINGS_STATS_MAJOR_COUNT] =
+{
+	"CREATE", "CREATE_NAMED_PIPE", "CLOSE", "READ", "WRITE", "QUERY_INFORMATION",
+	"SET_INFORMATION", "QUERY_EA", "SET_EA", "FLUSH_BUFFERS", "QUERY_VOLUME_INFORMATION",
+	"SET_VOLUME_INFORMATION", "DIRECTORY_CONTROL", "FILE_SYSTEM_CONTROL", "DEVICE_CONTROL",
+	"INTERNAL_DEVICE_CONTROL", "SHUTDOWN", "LOCK_CONTROL", "CLEANUP", "CREATE_MAILSLOT",
+	"QUERY_SECURITY", "SET_SECURITY", "POWER", "SYSTEM_CONTROL", "DEVICE_CHANGE",
+	"QUERY_QUOTA", "SET_QUOTA", "PNP"
+};
+
+//
+//	Every measurement moves about this many bytes, bounded by the iteration limits.
+//
+#define BENCH_BYTES_PER_RUN		(64 * 1024 * 1024)
+#define BENCH_MIN_ITERATIONS	64
+#define BENCH_MAX_ITERATIONS	100000
+
+//
+//	Reads the listener keeps in flight, and the size of each read buffer.
+//
+#define LISTEN_DEFAULT_READS	32
+#define LISTEN_MAX_READS		1024
+#define LISTEN_BUFFER_SIZE		(64 * 1024)
+
+//
+//	Defaults of the shared ring commands. The receiver gives up once the
+//	ring stays empty this long.
+//
+#define RING_DEFAULT_MESSAGES	1000000
+#define RING_DEFAULT_SIZE		64
+#define RING_IDLE_TIMEOUT		5000
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	One outstanding overlapped read. The OVERLAPPED comes back from the
+//	completion port and leads to the buffer it belongs to.
+//
+typedef struct _LISTEN_READ
+{
+	OVERLAPPED Overlapped;
+	char Buffer[LISTEN_BUFFER_SIZE];
+
+} LISTEN_READ;
 
 
 /////////////////////////////////////////////////////////////////////
 //	F U N C T I O N  D E F I N I T I O N S.
 /////////////////////////////////////////////////////////////////////
-int _cdecl main(void)
+
+
+//***********************************************************************************
+//	Function:
+//		PrintReadRecords
+//
+//	Parameters:
+//		[IN]  const char* pBuffer
+//		Buffer filled by a read.
+//
+//		[IN]  DWORD dwBytes
+//		Number of bytes the read returned.
+//
+//	Routine Description:
+//		Prints every FINGS_READ_RECORD packed in the buffer, one line each.
+//
+//	Return Value:
+//		DWORD.
+//		Number of messages printed.
+//
+//***********************************************************************************
+static DWORD
+PrintReadRecords(
+	const char* pBuffer,
+	DWORD dwBytes
+)
+{
+	const FINGS_READ_RECORD* pRecord;
+	DWORD dwOffset = 0, dwCount = 0;
+
+	while (dwBytes - dwOffset >= FIELD_OFFSET(FINGS_READ_RECORD, Data))
+	{
+		pRecord = (const FINGS_READ_RECORD*)(pBuffer + dwOffset);
+
+		if (pRecord->ulLength > dwBytes - dwOffset - FIELD_OFFSET(FINGS_READ_RECORD, Data))
+			break;
+
+		printf("%.*s\n", (int)pRecord->ulLength, pRecord->Data);
+		dwCount++;
+
+		//
+		//	The last record is not padded, the offset may pass the end.
+		//
+		dwOffset += FINGS_READ_RECORD_SIZE(pRecord->ulLength);
+
+		if (dwOffset >= dwBytes)
+			break;
+	}
+
+	return dwCount;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunModeBenchmark
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//	Routine Description:
+//		Measures a write followed by a read of the same message for every
+//		transfer method and message size, then prints the cheapest method
+//		per size so the buffered/direct crossover is measured, not guessed.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if a transfer failed.
+//
+//***********************************************************************************
+static int
+RunModeBenchmark(
+	HANDLE hDevice
+)
+{
+	LARGE_INTEGER liFrequency, liStart, liEnd;
+	double dMicroseconds[MESSAGE_SIZE_COUNT][IO_METHOD_COUNT];
+	DWORD dwSize, dwIterations, dwIndex, dwMethod, dwBest, dwSizeIndex, dwBufferSize;
+	char* pMessage;
+	char* pBuffer;
+
+	dwSize = g_dwMessageSizes[MESSAGE_SIZE_COUNT - 1];
+	dwBufferSize = FINGS_READ_RECORD_SIZE(dwSize);
+	pMessage = (char*)VirtualAlloc(NULL, dwSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	pBuffer = (char*)VirtualAlloc(NULL, dwBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	if (!pMessage || !pBuffer)
+	{
+		printf("Out of memory\n");
+		return 1;
+	}
+
+	QueryPerformanceFrequency(&liFrequency);
+
+	//
+	//	Start from an empty device so every read returns the message just written.
+	//
+	while (ReceiveFromDevice(hDevice, &g_IoMethods[0], pBuffer, dwBufferSize))
+		;
+
+	printf("%10s", "Size");
+	for (dwMethod = 0; dwMethod < IO_METHOD_COUNT; dwMethod++)
+		printf("%12s", g_IoMethods[dwMethod].pszName);
+	printf("%12s\n", "Best");
+
+	for (dwSizeIndex = 0; dwSizeIndex < MESSAGE_SIZE_COUNT; dwSizeIndex++)
+	{
+		dwSize = g_dwMessageSizes[dwSizeIndex];
+		dwIterations = BENCH_BYTES_PER_RUN / dwSize;
+
+		if (dwIterations < BENCH_MIN_ITERATIONS)
+			dwIterations = BENCH_MIN_ITERATIONS;
+		if (dwIterations > BENCH_MAX_ITERATIONS)
+			dwIterations = BENCH_MAX_ITERATIONS;
+
+		memset(pMessage, 'a', dwSize - 1);
+		pMessage[dwSize - 1] = '\0';
+
+		printf("%10lu", dwSize);
+
+		for (dwMethod = 0; dwMethod < IO_METHOD_COUNT; dwMethod++)
+		{
+			QueryPerformanceCounter(&liStart);
+
+			for (dwIndex = 0; dwIndex < dwIterations; dwIndex++)
+			{
+				if (!SendToDevice(hDevice, &g_IoMethods[dwMethod], pMessage, dwSize) ||
+					ReceiveFromDevice(hDevice, &g_IoMethods[dwMethod], pBuffer, dwBufferSize) != FIELD_OFFSET(FINGS_READ_RECORD, Data) + dwSize)
+				{
+					printf("\n%s transfer of %lu bytes failed (%lu)\n", g_IoMethods[dwMethod].pszName, dwSize, GetLastError());
+					return 1;
+				}
+			}
+
+			QueryPerformanceCounter(&liEnd);
+
+			dMicroseconds[dwSizeIndex][dwMethod] =
+				(double)(liEnd.QuadPart - liStart.QuadPart) * 1000000.0 / (double)liFrequency.QuadPart / dwIterations;
+
+			printf("%10.2fus", dMicroseconds[dwSizeIndex][dwMethod]);
+		}
+
+		dwBest = 0;
+		for (dwMethod = 1; dwMethod < IO_METHOD_COUNT; dwMethod++)
+		{
+			if (dMicroseconds[dwSizeIndex][dwMethod] < dMicroseconds[dwSizeIndex][dwBest])
+				dwBest = dwMethod;
+		}
+
+		printf("%12s\n", g_IoMethods[dwBest].pszName);
+	}
+
+	//
+	//	The crossover is the first size where direct beats buffered.
+	//
+	for (dwSizeIndex = 0; dwSizeIndex < MESSAGE_SIZE_COUNT; dwSizeIndex++)
+	{
+		if (dMicroseconds[dwSizeIndex][2] < dMicroseconds[dwSizeIndex][1])
+		{
+			printf("Direct I/O is cheaper than buffered I/O from %lu bytes.\n", g_dwMessageSizes[dwSizeIndex]);
+			break;
+		}
+	}
+
+	if (dwSizeIndex == MESSAGE_SIZE_COUNT)
+		printf("Buffered I/O is cheaper than direct I/O for every size measured.\n");
+
+	VirtualFree(pMessage, 0, MEM_RELEASE);
+	VirtualFree(pBuffer, 0, MEM_RELEASE);
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		PostListenRead
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device, opened for overlapped I/O.
+//
+//		[IN]  LISTEN_READ* pRead
+//		Read to send.
+//
+//	Routine Description:
+//		Sends one overlapped read. The driver holds it until a message is
+//		written, the result then arrives on the completion port.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE if the read is in flight.
+//
+//***********************************************************************************
+static BOOL
+PostListenRead(
+	HANDLE hDevice,
+	LISTEN_READ* pRead
+)
+{
+	ZeroMemory(&pRead->Overlapped, sizeof(pRead->Overlapped));
+
+	if (ReadFile(hDevice, pRead->Buffer, LISTEN_BUFFER_SIZE, NULL, &pRead->Overlapped))
+		return TRUE;
+
+	return GetLastError() == ERROR_IO_PENDING;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunListener
+//
+//	Parameters:
+//		[IN]  DWORD dwReads
+//		Number of reads to keep in flight.
+//
+//		[IN]  DWORD dwMessages
+//		Number of messages to receive before returning, 0 for no limit.
+//
+//	Routine Description:
+//		Opens the device for overlapped I/O and keeps dwReads reads pending
+//		in the driver from a single thread, printing every message as its
+//		read completes and sending a new read in its place.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the device could not be used.
+//
+//***********************************************************************************
+static int
+RunListener(
+	DWORD dwReads,
+	DWORD dwMessages
+)
+{
+	HANDLE hDevice, hPort;
+	LISTEN_READ* pReads;
+	LISTEN_READ* pRead;
+	LPOVERLAPPED pOverlapped;
+	ULONG_PTR ulpKey;
+	DWORD dwIndex, dwBytes, dwOutstanding = 0, dwReceived = 0;
+	BOOL bRet, bStopping = FALSE;
+	int iRet = 0;
+
+	hDevice = CreateFile(
+				_T("\\\\.\\6FingsUsr"),
+				GENERIC_READ | GENERIC_WRITE,
+				FILE_SHARE_READ | FILE_SHARE_WRITE,
+				NULL,
+				OPEN_EXISTING,
+				FILE_FLAG_OVERLAPPED,
+				NULL
+			);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+	{
+		printf("CreateFile Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	hPort = CreateIoCompletionPort(hDevice, NULL, 0, 1);
+	pReads = (LISTEN_READ*)VirtualAlloc(NULL, sizeof(LISTEN_READ) * dwReads, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	if (!hPort || !pReads)
+	{
+		printf("Could not set up the listener (%lu)\n", GetLastError());
+
+		if (hPort)
+			CloseHandle(hPort);
+
+		CloseHandle(hDevice);
+		return 1;
+	}
+
+	for (dwIndex = 0; dwIndex < dwReads; dwIndex++)
+	{
+		if (!PostListenRead(hDevice, &pReads[dwIndex]))
+		{
+			printf("ReadFile Failed! (%lu)\n", GetLastError());
+			iRet = 1;
+			break;
+		}
+
+		dwOutstanding++;
+	}
+
+	printf("Listening with %lu reads in flight.\n", dwOutstanding);
+
+	if (iRet)
+	{
+		bStopping = TRUE;
+		CancelIoEx(hDevice, NULL);
+	}
+
+	//
+	//	Every read sent has to come back before its buffer can be freed,
+	//	including the ones cancelled once the listener stops.
+	//
+	while (dwOutstanding)
+	{
+		bRet = GetQueuedCompletionStatus(hPort, &dwBytes, &ulpKey, &pOverlapped, INFINITE);
+
+		if (!pOverlapped)
+			break;
+
+		dwOutstanding--;
+		pRead = CONTAINING_RECORD(pOverlapped, LISTEN_READ, Overlapped);
+
+		if (bRet && dwBytes)
+		{
+			dwReceived += PrintReadRecords(pRead->Buffer, dwBytes);
+		}
+		else if (!bRet && GetLastError() != ERROR_OPERATION_ABORTED)
+		{
+			printf("Read Failed! (%lu)\n", GetLastError());
+		}
+
+		if (bStopping)
+			continue;
+
+		if (dwMessages && dwReceived >= dwMessages)
+		{
+			bStopping = TRUE;
+			CancelIoEx(hDevice, NULL);
+			continue;
+		}
+
+		if (PostListenRead(hDevice, pRead))
+			dwOutstanding++;
+	}
+
+	printf("Received %lu message(s).\n", dwReceived);
+
+	VirtualFree(pReads, 0, MEM_RELEASE);
+	CloseHandle(hPort);
+	CloseHandle(hDevice);
+
+	return iRet;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunRingSender
+//
+//	Parameters:
+//		[IN]  DWORD dwMessages
+//		Number of messages to send.
+//
+//		[IN]  DWORD dwSize
+//		Size of every message.
+//
+//	Routine Description:
+//		Maps the shared ring and produces dwMessages messages into it as fast
+//		as the receiver takes them, then prints the rate.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the ring could not be used.
+//
+//***********************************************************************************
+static int
+RunRingSender(
+	DWORD dwMessages,
+	DWORD dwSize
+)
+{
+	SHM_RING ShmRing;
+	LARGE_INTEGER liFrequency, liStart, liEnd;
+	DWORD dwIndex;
+	double dSeconds;
+	char* pMessage;
+
+	if (!ShmRingOpen(&ShmRing))
+	{
+		printf("Could not map the shared ring (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	pMessage = (char*)malloc(dwSize);
+
+	if (!pMessage)
+	{
+		printf("Out of memory\n");
+		ShmRingClose(&ShmRing);
+		return 1;
+	}
+
+	memset(pMessage, 'a', dwSize);
+
+	QueryPerformanceFrequency(&liFrequency);
+	QueryPerformanceCounter(&liStart);
+
+	for (dwIndex = 0; dwIndex < dwMessages; dwIndex++)
+	{
+		//
+		//	Number the messages so the receiver can tell one was lost.
+		//
+		if (dwSize >= sizeof(dwIndex))
+			memcpy(pMessage, &dwIndex, sizeof(dwIndex));
+
+		if (!ShmRingSend(&ShmRing, pMessage, dwSize))
+		{
+			printf("Send Failed! (%lu)\n", GetLastError());
+			break;
+		}
+	}
+
+	QueryPerformanceCounter(&liEnd);
+	dSeconds = (double)(liEnd.QuadPart - liStart.QuadPart) / (double)liFrequency.QuadPart;
+
+	printf("Sent %lu message(s) of %lu bytes in %.3fs, %.0f msgs/s.\n",
+		dwIndex, dwSize, dSeconds, dSeconds > 0 ? dwIndex / dSeconds : 0.0);
+
+	free(pMessage);
+	ShmRingClose(&ShmRing);
+
+	return dwIndex == dwMessages ? 0 : 1;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunRingReceiver
+//
+//	Parameters:
+//		[IN]  DWORD dwMessages
+//		Number of messages to receive.
+//
+//	Routine Description:
+//		Maps the shared ring and consumes dwMessages messages from it, or
+//		until it stays empty for RING_IDLE_TIMEOUT, then prints the rate
+//		measured from the first message.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the ring could not be used.
+//
+//***********************************************************************************
+static int
+RunRingReceiver(
+	DWORD dwMessages
+)
+{
+	SHM_RING ShmRing;
+	LARGE_INTEGER liFrequency, liStart, liEnd;
+	DWORD dwReceived = 0, dwOutOfOrder = 0, dwNumber;
+	ULONG ulLength;
+	double dSeconds;
+	char* pBuffer;
+
+	if (!ShmRingOpen(&ShmRing))
+	{
+		printf("Could not map the shared ring (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	pBuffer = (char*)malloc(FINGS_SHARED_RING_MAX_MESSAGE);
+
+	if (!pBuffer)
+	{
+		printf("Out of memory\n");
+		ShmRingClose(&ShmRing);
+		return 1;
+	}
+
+	QueryPerformanceFrequency(&liFrequency);
+	QueryPerformanceCounter(&liStart);
+	liEnd = liStart;
+
+	while (dwReceived < dwMessages)
+	{
+		ulLength = ShmRingReceive(&ShmRing, pBuffer, FINGS_SHARED_RING_MAX_MESSAGE, RING_IDLE_TIMEOUT);
+
+		if (!ulLength)
+			break;
+
+		if (!dwReceived)
+			QueryPerformanceCounter(&liStart);
+
+		if (ulLength >= sizeof(dwNumber))
+		{
+			memcpy(&dwNumber, pBuffer, sizeof(dwNumber));
+
+			if (dwNumber != dwReceived)
+				dwOutOfOrder++;
+		}
+
+		dwReceived++;
+		QueryPerformanceCounter(&liEnd);
+	}
+
+	dSeconds = (double)(liEnd.QuadPart - liStart.QuadPart) / (double)liFrequency.QuadPart;
+
+	printf("Received %lu message(s) in %.3fs, %.0f msgs/s, %lu out of order.\n",
+		dwReceived, dSeconds, dSeconds > 0 ? dwReceived / dSeconds : 0.0, dwOutOfOrder);
+
+	free(pBuffer);
+	ShmRingClose(&ShmRing);
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LatencyPercentile
+//
+//	Parameters:
+//		[IN]  const FINGS_MAJOR_STATS* pMajor
+//		Counters of one major function.
+//
+//		[IN]  double dPercentile
+//		Percentile between 0 and 100.
+//
+//	Routine Description:
+//		Finds the latency bucket holding the given percentile of the requests.
+//
+//	Return Value:
+//		ULONG64.
+//		Upper end of the bucket in nanoseconds.
+//
+//***********************************************************************************
+static ULONG64
+LatencyPercentile(
+	const FINGS_MAJOR_STATS* pMajor,
+	double dPercentile
+)
+{
+	ULONG64 ullRank, ullSeen = 0;
+	DWORD dwBucket;
+
+	ullRank = (ULONG64)(dPercentile / 100.0 * (double)pMajor->ullRequests + 0.5);
+
+	if (ullRank < 1)
+		ullRank = 1;
+
+	for (dwBucket = 0; dwBucket < FINGS_STATS_LATENCY_BUCKETS - 1; dwBucket++)
+	{
+		ullSeen += pMajor->ullLatency[dwBucket];
+
+		if (ullSeen >= ullRank)
+			break;
+	}
+
+	return dwBucket ? ((ULONG64)1 << dwBucket) - 1 : 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunVectorWrite
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  int argc
+//		Number of parts.
+//
+//		[IN]  char* argv[]
+//		Parts of the message.
+//
+//	Routine Description:
+//		Writes the parts as one message with IOCTL_6FINGS_WRITE_VECTOR,
+//		each part a segment pointing at its argument. The last segment
+//		includes the NULL character of its argument, which ends the message.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the write failed.
+//
+//***********************************************************************************
+static int
+RunVectorWrite(
+	HANDLE hDevice,
+	int argc,
+	char* argv[]
+)
+{
+	FINGS_WRITE_SEGMENT Segments[FINGS_VECTOR_MAX_SEGMENTS];
+	DWORD dwReturn = 0;
+	int iIndex;
+
+	if (argc < 1 || argc > FINGS_VECTOR_MAX_SEGMENTS)
+	{
+		printf("Usage: Msg6Fings writev <part> [part ...], at most %u parts\n", FINGS_VECTOR_MAX_SEGMENTS);
+		return 1;
+	}
+
+	for (iIndex = 0; iIndex < argc; iIndex++)
+	{
+		Segments[iIndex].ullAddress = (ULONG64)(ULONG_PTR)argv[iIndex];
+		Segments[iIndex].ulLength = (ULONG)strlen(argv[iIndex]);
+		Segments[iIndex].ulReserved = 0;
+	}
+
+	Segments[argc - 1].ulLength++;
+
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_WRITE_VECTOR, Segments, argc * sizeof(FINGS_WRITE_SEGMENT), NULL, 0, &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	printf("Stored a message of %lu bytes\n", dwReturn);
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunStats
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//	Routine Description:
+//		Prints the driver's counters of every major function that has seen
+//		a request, with the failures by status and the latency percentiles.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the counters could not be read.
+//
+//***********************************************************************************
+static int
+RunStats(
+	HANDLE hDevice
+)
+{
+	FINGS_STATS* pStats;
+	FINGS_MAJOR_STATS* pMajor;
+	DWORD dwReturn, dwMajor, dwStatus;
+
+	pStats = (FINGS_STATS*)malloc(sizeof(FINGS_STATS));
+
+	if (!pStats)
+	{
+		printf("Out of memory\n");
+		return 1;
+	}
+
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_STATS, NULL, 0, pStats, sizeof(FINGS_STATS), &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		free(pStats);
+		return 1;
+	}
+
+	printf("%-16s%12s%12s%14s%14s%10s%10s%11s\n", "Major", "Requests", "Failures", "Bytes in", "Bytes out", "p50 ns", "p99 ns", "p99.9 ns");
+
+	for (dwMajor = 0; dwMajor < FINGS_STATS_MAJOR_COUNT; dwMajor++)
+	{
+		pMajor = &pStats->Major[dwMajor];
+
+		if (!pMajor->ullRequests)
+			continue;
+
+		printf("%-16s%12llu%12llu%14llu%14llu%10llu%10llu%11llu\n",
+			g_pszMajorNames[dwMajor],
+			pMajor->ullRequests,
+			pMajor->ullFailures,
+			pMajor->ullBytesIn,
+			pMajor->ullBytesOut,
+			LatencyPercentile(pMajor, 50.0),
+			LatencyPercentile(pMajor, 99.0),
+			LatencyPercentile(pMajor, 99.9));
+
+		for (dwStatus = 0; dwStatus < FINGS_STATS_STATUS_COUNT; dwStatus++)
+		{
+			if (!pMajor->ullFailuresByStatus[dwStatus])
+				continue;
+
+			if (dwStatus < FINGS_STATS_STATUS_COUNT - 1)
+				printf("    0x%08lX%16llu\n", (ULONG)pStats->lStatuses[dwStatus], pMajor->ullFailuresByStatus[dwStatus]);
+			else
+				printf("    %-10s%16llu\n", "other", pMajor->ullFailuresByStatus[dwStatus]);
+		}
+	}
+
+	printf("Message slab: %llu hits, %llu misses, %lld bytes outstanding.\n",
+		pStats->ullSlabHits, pStats->ullSlabMisses, pStats->llSlabBytes);
+
+	free(pStats);
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunTraceDump
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  const char* pszFile
+//		File receiving the binary dump, NULL to decode it to stdout instead.
+//
+//	Routine Description:
+//		Asks the driver how large its trace is, then dumps it.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the trace could not be dumped or saved.
+//
+//***********************************************************************************
+static int
+RunTraceDump(
+	HANDLE hDevice,
+	const char* pszFile
+)
+{
+	FINGS_TRACE_DUMP Header;
+	unsigned char* pDump;
+	HANDLE hFile;
+	DWORD dwReturn, dwWritten;
+	int iRet = 0;
+
+	//
+	//	A buffer holding only the header fails with ERROR_MORE_DATA but fills it in.
+	//
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_DUMP_TRACE, NULL, 0, &Header, sizeof(Header), &dwReturn, NULL) &&
+		GetLastError() != ERROR_MORE_DATA)
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	pDump = (unsigned char*)malloc(Header.ulRequiredLength);
+
+	if (!pDump)
+	{
+		printf("Out of memory\n");
+		return 1;
+	}
+
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_DUMP_TRACE, NULL, 0, pDump, Header.ulRequiredLength, &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		free(pDump);
+		return 1;
+	}
+
+	if (!pszFile)
+	{
+		iRet = DecodeTrace(pDump, dwReturn, stdout);
+		free(pDump);
+		return iRet;
+	}
+
+	hFile = CreateFileA(pszFile, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printf("CreateFile Failed! (%lu)\n", GetLastError());
+		free(pDump);
+		return 1;
+	}
+
+	if (!WriteFile(hFile, pDump, dwReturn, &dwWritten, NULL) || dwWritten != dwReturn)
+	{
+		printf("WriteFile Failed! (%lu)\n", GetLastError());
+		iRet = 1;
+	}
+	else
+	{
+		printf("%lu bytes of trace saved to %s\n", dwReturn, pszFile);
+	}
+
+	CloseHandle(hFile);
+	free(pDump);
+
+	return iRet;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		OpenChannelHandle
+//
+//	Parameters:
+//		[IN]  const char* pszName
+//		Name of the channel, at most FINGS_CHANNEL_MAX_NAME characters.
+//
+//		[IN]  DWORD dwFlags
+//		Flags for CreateFile, FILE_FLAG_OVERLAPPED for reads that wait.
+//
+//	Routine Description:
+//		Opens a handle on the named channel, the driver creates it on its
+//		first open.
+//
+//	Return Value:
+//		HANDLE.
+//		The handle, or INVALID_HANDLE_VALUE after printing the error.
+//
+//***********************************************************************************
+static HANDLE
+OpenChannelHandle(
+	const char* pszName,
+	DWORD dwFlags
+)
+{
+	char szPath[32 + FINGS_CHANNEL_MAX_NAME];
+	HANDLE hDevice;
+
+	sprintf_s(szPath, sizeof(szPath), "\\\\.\\6FingsUsr\\%s", pszName);
+
+	hDevice = CreateFileA(szPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, dwFlags, NULL);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+		printf("CreateFile Failed! (%lu)\n", GetLastError());
+
+	return hDevice;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunChannel
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Name of the channel, then optionally its limits, the length
+//		from which it compresses messages, the TTL of its messages and
+//		whether they are evicted when memory runs low.
+//
+//	Routine Description:
+//		Opens the channel, sets its limits when they are given, and
+//		prints its limits and counters. The channel only lasts while a
+//		handle is open on it, limits set on a channel nobody else has
+//		open go when this one is closed.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the channel could not be opened or queried.
+//
+//***********************************************************************************
+static int
+RunChannel(
+	int argc,
+	char* argv[]
+)
+{
+	FINGS_CHANNEL_LIMITS Limits;
+	FINGS_CHANNEL_INFO Info;
+	HANDLE hDevice;
+	DWORD dwReturn;
+
+	if (argc < 1 || argc == 2 || strlen(argv[0]) > FINGS_CHANNEL_MAX_NAME)
+	{
+		printf("Usage: Msg6Fings channel <name> [max messages] [max message length] [compress from length] [ttl ms] [low]\n");
+		return 1;
+	}
+
+	hDevice = OpenChannelHandle(argv[0], 0);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+		return 1;
+
+	if (argc > 2)
+	{
+		memset(&Limits, 0, sizeof(Limits));
+		Limits.ulMaxMessages = strtoul(argv[1], NULL, 10);
+		Limits.ulMaxMessageLength = strtoul(argv[2], NULL, 10);
+
+		if (argc > 3)
+			Limits.ulCompressMinLength = strtoul(argv[3], NULL, 10);
+
+		if (argc > 4)
+			Limits.ulMessageTtl = strtoul(argv[4], NULL, 10);
+
+		if (argc > 5 && _stricmp(argv[5], "low") == 0)
+			Limits.ulPriority = FINGS_CHANNEL_PRIORITY_LOW;
+
+		if (!DeviceIoControl(hDevice, IOCTL_6FINGS_SET_CHANNEL, &Limits, sizeof(Limits), NULL, 0, &dwReturn, NULL))
+		{
+			printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+			CloseHandle(hDevice);
+			return 1;
+		}
+	}
+
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_CHANNEL, NULL, 0, &Info, sizeof(Info), &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		CloseHandle(hDevice);
+		return 1;
+	}
+
+	printf("Channel %s: %lu messages waiting, %lu handles open, %lu of them subscribed.\n",
+		argv[0], Info.ulMessages, Info.ulHandles, Info.ulSubscribers);
+	printf("Limits: %lu messages, %lu bytes per message, 0 is no limit.\n", Info.Limits.ulMaxMessages, Info.Limits.ulMaxMessageLength);
+	printf("Compresses messages from %lu bytes, 0 is never.\n", Info.Limits.ulCompressMinLength);
+	printf("Messages expire after %lu ms, 0 is never, %s priority.\n",
+		Info.Limits.ulMessageTtl, Info.Limits.ulPriority == FINGS_CHANNEL_PRIORITY_LOW ? "low" : "normal");
+	printf("Written %llu messages (%llu bytes, %llu stored), read %llu messages (%llu bytes), rejected %llu.\n",
+		Info.ullMessagesWritten, Info.ullBytesWritten, Info.ullBytesStored, Info.ullMessagesRead, Info.ullBytesRead, Info.ullMessagesRejected);
+	printf("Dropped unread: %llu expired, %llu evicted while memory was low.\n", Info.ullMessagesExpired, Info.ullMessagesEvicted);
+	printf("Last message written is number %llu.\n", Info.ullLastSequence);
+
+	CloseHandle(hDevice);
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunRange
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Name of the channel, then optionally the first and last sequence
+//		numbers and how many seconds back the messages may be.
+//
+//	Routine Description:
+//		Prints the messages waiting in the channel that fall in the range,
+//		with their sequence number, time and writer, querying again from
+//		the last one printed until the range is done. The messages stay
+//		queued.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the channel could not be opened or queried.
+//
+//***********************************************************************************
+static int
+RunRange(
+	int argc,
+	char* argv[]
+)
+{
+	FINGS_RANGE_QUERY Query;
+	const FINGS_MESSAGE_RECORD* pRecord;
+	ULARGE_INTEGER Now;
+	FILETIME Time;
+	SYSTEMTIME SystemTime;
+	HANDLE hDevice;
+	DWORD dwBytes, dwOffset, dwCount = 0;
+	char* pBuffer;
+	int iRet = 0;
+
+	if (argc < 1 || strlen(argv[0]) > FINGS_CHANNEL_MAX_NAME)
+	{
+		printf("Usage: Msg6Fings range <channel> [first sequence] [last sequence] [seconds back]\n");
+		return 1;
+	}
+
+	memset(&Query, 0, sizeof(Query));
+	Query.ullFirstSequence = argc > 1 ? strtoull(argv[1], NULL, 10) : 0;
+	Query.ullLastSequence = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+
+	if (argc > 3)
+	{
+		GetSystemTimePreciseAsFileTime(&Time);
+		Now.LowPart = Time.dwLowDateTime;
+		Now.HighPart = Time.dwHighDateTime;
+		Query.ullFirstTime = Now.QuadPart - strtoull(argv[3], NULL, 10) * 10000000;
+	}
+
+	hDevice = OpenChannelHandle(argv[0], 0);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+		return 1;
+
+	pBuffer = (char*)VirtualAlloc(NULL, LISTEN_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	if (!pBuffer)
+	{
+		printf("VirtualAlloc Failed! (%lu)\n", GetLastError());
+		CloseHandle(hDevice);
+		return 1;
+	}
+
+	for (;;)
+	{
+		if (!DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_RANGE, &Query, sizeof(Query), pBuffer, LISTEN_BUFFER_SIZE, &dwBytes, NULL))
+		{
+			printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+			iRet = 1;
+			break;
+		}
+
+		if (!dwBytes)
+			break;
+
+		for (dwOffset = 0; dwBytes - dwOffset >= FIELD_OFFSET(FINGS_MESSAGE_RECORD, Data); )
+		{
+			pRecord = (const FINGS_MESSAGE_RECORD*)(pBuffer + dwOffset);
+
+			if (pRecord->ulLength > dwBytes - dwOffset - FIELD_OFFSET(FINGS_MESSAGE_RECORD, Data))
+				break;
+
+			Time.dwLowDateTime = (DWORD)pRecord->ullTime;
+			Time.dwHighDateTime = (DWORD)(pRecord->ullTime >> 32);
+			FileTimeToSystemTime(&Time, &SystemTime);
+
+			printf("%llu %02u:%02u:%02u.%03u UTC %lu:%lu %.*s\n",
+				pRecord->ullSequence, SystemTime.wHour, SystemTime.wMinute, SystemTime.wSecond, SystemTime.wMilliseconds,
+				pRecord->ulProcessId, pRecord->ulThreadId, (int)pRecord->ulLength, pRecord->Data);
+
+			Query.ullFirstSequence = pRecord->ullSequence + 1;
+			dwCount++;
+
+			//
+			//	The last record is not padded, the offset may pass the end.
+			//
+			dwOffset += FINGS_MESSAGE_RECORD_SIZE(pRecord->ulLength);
+
+			if (dwOffset >= dwBytes)
+				break;
+		}
+
+		if (Query.ullLastSequence && Query.ullFirstSequence > Query.ullLastSequence)
+			break;
+	}
+
+	printf("%lu message(s) in range.\n", dwCount);
+
+	VirtualFree(pBuffer, 0, MEM_RELEASE);
+	CloseHandle(hDevice);
+
+	return iRet;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunSubscriber
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Name of the channel, then optionally the number of messages.
+//
+//	Routine Description:
+//		Subscribes a handle to the channel and prints the messages
+//		published on it, one wait at a time, until the given number of
+//		messages arrived or forever.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the channel could not be subscribed or read.
+//
+//***********************************************************************************
+static int
+RunSubscriber(
+	int argc,
+	char* argv[]
+)
+{
+	FINGS_HANDLE_INFO Info;
+	OVERLAPPED Overlapped;
+	HANDLE hDevice;
+	DWORD dwMessages, dwBytes, dwReturn, dwReceived = 0;
+	char* pBuffer;
+	int iRet = 0;
+
+	if (argc < 1 || strlen(argv[0]) > FINGS_CHANNEL_MAX_NAME)
+	{
+		printf("Usage: Msg6Fings subscribe <channel> [messages]\n");
+		return 1;
+	}
+
+	dwMessages = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+
+	//
+	//	Overlapped, so that a read of an empty subscription waits for the
+	//	next publish instead of returning nothing.
+	//
+	hDevice = OpenChannelHandle(argv[0], FILE_FLAG_OVERLAPPED);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+		return 1;
+
+	pBuffer = (char*)VirtualAlloc(NULL, LISTEN_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	ZeroMemory(&Overlapped, sizeof(Overlapped));
+	Overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!pBuffer || !Overlapped.hEvent ||
+		(!DeviceIoControl(hDevice, IOCTL_6FINGS_SUBSCRIBE, NULL, 0, NULL, 0, NULL, &Overlapped) && GetLastError() != ERROR_IO_PENDING) ||
+		!GetOverlappedResult(hDevice, &Overlapped, &dwReturn, TRUE))
+	{
+		printf("Could not subscribe (%lu)\n", GetLastError());
+		iRet = 1;
+	}
+	else
+	{
+		printf("Subscribed to %s.\n", argv[0]);
+	}
+
+	while (!iRet && (!dwMessages || dwReceived < dwMessages))
+	{
+		if (!ReadFile(hDevice, pBuffer, LISTEN_BUFFER_SIZE, NULL, &Overlapped) && GetLastError() != ERROR_IO_PENDING)
+		{
+			printf("ReadFile Failed! (%lu)\n", GetLastError());
+			iRet = 1;
+			break;
+		}
+
+		if (!GetOverlappedResult(hDevice, &Overlapped, &dwBytes, TRUE))
+		{
+			printf("Read Failed! (%lu)\n", GetLastError());
+			iRet = 1;
+			break;
+		}
+
+		dwReceived += PrintReadRecords(pBuffer, dwBytes);
+	}
+
+	if (!iRet &&
+		(DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_HANDLE, NULL, 0, &Info, sizeof(Info), NULL, &Overlapped) || GetLastError() == ERROR_IO_PENDING) &&
+		GetOverlappedResult(hDevice, &Overlapped, &dwReturn, TRUE))
+		printf("Received %lu message(s), missed %llu.\n", dwReceived, Info.ullMessagesMissed);
+
+	if (Overlapped.hEvent)
+		CloseHandle(Overlapped.hEvent);
+
+	if (pBuffer)
+		VirtualFree(pBuffer, 0, MEM_RELEASE);
+
+	CloseHandle(hDevice);
+
+	return iRet;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunPublisher
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Name of the channel, then the message.
+//
+//	Routine Description:
+//		Publishes the message on the channel and prints how many
+//		subscribers it was queued for.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the message could not be published.
+//
+//***********************************************************************************
+static int
+RunPublisher(
+	int argc,
+	char* argv[]
+)
+{
+	HANDLE hDevice;
+	DWORD dwReturn;
+	int iRet = 0;
+
+	if (argc < 2 || strlen(argv[0]) > FINGS_CHANNEL_MAX_NAME)
+	{
+		printf("Usage: Msg6Fings publish <channel> <message>\n");
+		return 1;
+	}
+
+	hDevice = OpenChannelHandle(argv[0], 0);
+
+	if (hDevice == INVALID_HANDLE_VALUE)
+		return 1;
+
+	//
+	//	The subscriber count comes back as the returned length.
+	//
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_PUBLISH, argv[1], (DWORD)strlen(argv[1]) + 1, NULL, 0, &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		iRet = 1;
+	}
+	else
+	{
+		printf("Published to %lu subscriber(s).\n", dwReturn);
+	}
+
+	CloseHandle(hDevice);
+
+	return iRet;
+}
+
+
+//
+//	Enables SeIncreaseQuotaPrivilege in the process token, which the
+//	driver checks before it changes the quota of a process.
+//
+static BOOL
+EnableQuotaPrivilege(
+	void
+)
+{
+	TOKEN_PRIVILEGES Privileges;
+	HANDLE hToken;
+	BOOL bRet;
+
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &hToken))
+		return FALSE;
+
+	Privileges.PrivilegeCount = 1;
+	Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	bRet = LookupPrivilegeValue(NULL, SE_INCREASE_QUOTA_NAME, &Privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(hToken, FALSE, &Privileges, sizeof(Privileges), NULL, NULL) &&
+		GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(hToken);
+
+	return bRet;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunQuota
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Optionally the process ID, 0 for the default quota, then
+//		optionally its limits.
+//
+//	Routine Description:
+//		Sets the quota of the process when limits are given, then prints
+//		its limits and usage. Without a process ID it prints the quota of
+//		this process.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the quota could not be set or queried.
+//
+//***********************************************************************************
+static int
+RunQuota(
+	HANDLE hDevice,
+	int argc,
+	char* argv[]
+)
+{
+	FINGS_PROCESS_QUOTA Quota;
+	FINGS_PROCESS_QUOTA_INFO Info;
+	ULONG ulProcessId;
+	DWORD dwReturn;
+
+	if (argc > 5)
+	{
+		printf("Usage: Msg6Fings quota [pid] [max messages] [max bytes] [messages/s] [bytes/s]\n");
+		return 1;
+	}
+
+	ulProcessId = argc > 0 ? strtoul(argv[0], NULL, 10) : 0;
+
+	if (argc > 1)
+	{
+		if (!EnableQuotaPrivilege())
+			printf("Could not enable SeIncreaseQuotaPrivilege (%lu)\n", GetLastError());
+
+		memset(&Quota, 0, sizeof(Quota));
+		Quota.ulProcessId = ulProcessId;
+		Quota.Quota.ulMaxMessages = strtoul(argv[1], NULL, 10);
+
+		if (argc > 2)
+			Quota.Quota.ulMaxBytes = strtoul(argv[2], NULL, 10);
+
+		if (argc > 3)
+			Quota.Quota.ulMessagesPerSecond = strtoul(argv[3], NULL, 10);
+
+		if (argc > 4)
+			Quota.Quota.ulBytesPerSecond = strtoul(argv[4], NULL, 10);
+
+		if (!DeviceIoControl(hDevice, IOCTL_6FINGS_SET_PROCESS_QUOTA, &Quota, sizeof(Quota), NULL, 0, &dwReturn, NULL))
+		{
+			printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+			return 1;
+		}
+	}
+
+	//
+	//	No input asks for the quota of this process.
+	//
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_PROCESS_QUOTA, &ulProcessId, argc > 0 ? sizeof(ulProcessId) : 0,
+		&Info, sizeof(Info), &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	if (argc > 0 && !ulProcessId)
+		printf("Default quota of new processes:\n");
+	else
+		printf("Process %lu, %lu handles open:\n", Info.ulProcessId, Info.ulHandles);
+
+	printf("Limits: %lu messages, %lu bytes, %lu messages/s, %lu bytes/s, 0 is no limit.\n",
+		Info.Quota.ulMaxMessages, Info.Quota.ulMaxBytes, Info.Quota.ulMessagesPerSecond, Info.Quota.ulBytesPerSecond);
+
+	if (argc == 0 || ulProcessId)
+	{
+		printf("Charged %llu messages (%llu bytes). Writes throttled %llu, rejected %llu, blocked %llu, messages dropped %llu.\n",
+			Info.Usage.ullMessages, Info.Usage.ullBytes, Info.Usage.ullWritesThrottled,
+			Info.Usage.ullWritesRejected, Info.Usage.ullWritesBlocked, Info.Usage.ullMessagesDropped);
+	}
+
+	return 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		PrintHandleInfo
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//	Routine Description:
+//		Prints what the driver counted on this handle since it was opened.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE if the counters could be read.
+//
+//***********************************************************************************
+static BOOL
+PrintHandleInfo(
+	HANDLE hDevice
+)
+{
+	FINGS_HANDLE_INFO Info;
+	DWORD dwReturn;
+
+	if (!DeviceIoControl(hDevice, IOCTL_6FINGS_QUERY_HANDLE, NULL, 0, &Info, sizeof(Info), &dwReturn, NULL))
+	{
+		printf("DeviceIoControl Failed! (%lu)\n", GetLastError());
+		return FALSE;
+	}
+
+	printf("This handle wrote %llu messages (%llu bytes) and read %llu bytes in %llu reads, %llu of them pended.\n",
+		Info.ullMessagesWritten, Info.ullBytesWritten, Info.ullBytesRead, Info.ullReads, Info.ullReadsPended);
+	printf("Its quota has %llu messages (%llu bytes) charged. Writes throttled %llu, rejected %llu, blocked %llu, messages dropped %llu.\n",
+		Info.Usage.ullMessages, Info.Usage.ullBytes, Info.Usage.ullWritesThrottled,
+		Info.Usage.ullWritesRejected, Info.Usage.ullWritesBlocked, Info.Usage.ullMessagesDropped);
+
+	return TRUE;
+}
+
+
+int _cdecl main(int argc, char* argv[])
 {
 	HANDLE hFile;
 	DWORD dwReturn;
 	char szTemp[256] = { 0 };
 	BOOL bRet;
+	int iRet = 0;
+
+	//
+	//	"Msg6Fings load [options]" opens its own connections.
+	//
+	if (argc > 1 && _stricmp(argv[1], "load") == 0)
+		return RunLoadGenerator(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings listen [reads] [messages]" waits for messages with overlapped reads.
+	//
+	if (argc > 1 && _stricmp(argv[1], "listen") == 0)
+	{
+		DWORD dwReads = argc > 2 ? strtoul(argv[2], NULL, 10) : LISTEN_DEFAULT_READS;
+		DWORD dwMessages = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+
+		if (dwReads < 1 || dwReads > LISTEN_MAX_READS)
+		{
+			printf("Usage: Msg6Fings listen [reads 1-%u] [messages]\n", LISTEN_MAX_READS);
+			return 1;
+		}
+
+		return RunListener(dwReads, dwMessages);
+	}
+
+	//
+	//	"Msg6Fings ring-send [messages] [size]" and "Msg6Fings ring-recv [messages]"
+	//	exchange messages through the shared ring, run one of each.
+	//
+	if (argc > 1 && _stricmp(argv[1], "ring-send") == 0)
+	{
+		DWORD dwMessages = argc > 2 ? strtoul(argv[2], NULL, 10) : RING_DEFAULT_MESSAGES;
+		DWORD dwSize = argc > 3 ? strtoul(argv[3], NULL, 10) : RING_DEFAULT_SIZE;
+
+		if (dwSize < 1 || dwSize > FINGS_SHARED_RING_MAX_MESSAGE)
+		{
+			printf("Usage: Msg6Fings ring-send [messages] [size 1-%u]\n", FINGS_SHARED_RING_MAX_MESSAGE);
+			return 1;
+		}
+
+		return RunRingSender(dwMessages, dwSize);
+	}
+
+	if (argc > 1 && _stricmp(argv[1], "ring-recv") == 0)
+		return RunRingReceiver(argc > 2 ? strtoul(argv[2], NULL, 10) : RING_DEFAULT_MESSAGES);
+
+	//
+	//	"Msg6Fings trace-decode <file>" decodes a trace saved by "Msg6Fings trace <file>".
+	//
+	if (argc > 1 && _stricmp(argv[1], "trace-decode") == 0)
+		return RunTraceDecoder(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings lz-bench [file]" measures what compressing the messages
+	//	of a channel saves and costs, on sample log lines or on a file.
+	//
+	if (argc > 1 && _stricmp(argv[1], "lz-bench") == 0)
+		return RunCompressionBenchmark(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings scan-bench" measures the search for the NULL character
+	//	that validates every message, against the byte loop it replaced.
+	//
+	if (argc > 1 && _stricmp(argv[1], "scan-bench") == 0)
+		return RunScanBenchmark(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings channel <name> [max messages] [max length] [compress from] [ttl ms] [low]"
+	//	shows a named channel, setting its limits first when they are given.
+	//
+	if (argc > 1 && _stricmp(argv[1], "channel") == 0)
+		return RunChannel(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings range <channel> [first sequence] [last sequence] [seconds back]"
+	//	prints the messages waiting in the channel without reading them.
+	//
+	if (argc > 1 && _stricmp(argv[1], "range") == 0)
+		return RunRange(argc - 2, argv + 2);
+
+	//
+	//	"Msg6Fings subscribe <channel> [messages]" prints what is published on
+	//	the channel, "Msg6Fings publish <channel> <message>" publishes.
+	//
+	if (argc > 1 && _stricmp(argv[1], "subscribe") == 0)
+		return RunSubscriber(argc - 2, argv + 2);
+
+	if (argc > 1 && _stricmp(argv[1], "publish") == 0)
+		return RunPublisher(argc - 2, argv + 2);
 
 	hFile = CreateFile(
 				_T("\\\\.\\6FingsUsr"),
@@ -42,33 +1574,89 @@ int _cdecl main(void)
 				NULL
 			);
 
-	if (hFile)
-	{
-		WriteFile(
-			hFile,
-			"Hello from user mode!",
-			sizeof("Hello from user mode!"),
-			&dwReturn,
-			NULL
-		);
-
-		bRet = ReadFile(
-			hFile,
-			&szTemp,
-			256,
-			&dwReturn,
-			NULL
-		);
-
-		if (!bRet)
-			printf("ReadFile Failed!");
-		else
-			printf(szTemp);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printf("CreateFile Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
 
+	//
+	//	"Msg6Fings stats" prints the driver's request counters.
+	//
+	if (argc > 1 && _stricmp(argv[1], "stats") == 0)
+	{
+		iRet = RunStats(hFile);
 		CloseHandle(hFile);
+		return iRet;
+	}
 
-		getchar();
+	//
+	//	"Msg6Fings trace [file]" dumps the driver's trace, to the file or decoded.
+	//
+	if (argc > 1 && _stricmp(argv[1], "trace") == 0)
+	{
+		iRet = RunTraceDump(hFile, argc > 2 ? argv[2] : NULL);
+		CloseHandle(hFile);
+		return iRet;
 	}
 
-	return 0;
-}
\ No newline at end of file
+	//
+	//	"Msg6Fings quota [pid] [limits]" shows the quota of a process, setting
+	//	its limits first when they are given. Process ID 0 is the default quota.
+	//
+	if (argc > 1 && _stricmp(argv[1], "quota") == 0)
+	{
+		iRet = RunQuota(hFile, argc - 2, argv + 2);
+		CloseHandle(hFile);
+		return iRet;
+	}
+
+	//
+	//	"Msg6Fings writev <part> [part ...]" writes the parts as one message.
+	//
+	if (argc > 1 && _stricmp(argv[1], "writev") == 0)
+	{
+		iRet = RunVectorWrite(hFile, argc - 2, argv + 2);
+		CloseHandle(hFile);
+		return iRet;
+	}
+
+	//
+	//	"Msg6Fings bench" compares the transfer methods across message sizes.
+	//
+	if (argc > 1 && _stricmp(argv[1], "bench") == 0)
+	{
+		iRet = RunModeBenchmark(hFile);
+		CloseHandle(hFile);
+		return iRet;
+	}
+
+	WriteFile(
+		hFile,
+		"Hello from user mode!",
+		sizeof("Hello from user mode!"),
+		&dwReturn,
+		NULL
+	);
+
+	bRet = ReadFile(
+		hFile,
+		&szTemp,
+		256,
+		&dwReturn,
+		NULL
+	);
+
+	if (!bRet)
+		printf("ReadFile Failed!");
+	else
+		PrintReadRecords(szTemp, dwReturn);
+
+	PrintHandleInfo(hFile);
+
+	CloseHandle(hFile);
+
+	getchar();
+
+	return iRet;
+}
@@ -0,0 +1,175 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	histogram.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the log-linear latency histogram.						*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <string.h>
+#include "histogram.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Index of the most significant set bit, ullValue must not be 0.
+//
+static unsigned int
+HighestBit(
+	uint64_t ullValue
+)
+{
+#ifdef _MSC_VER
+	unsigned long ulIndex;
+
+	_BitScanReverse64(&ulIndex, ullValue);
+
+	return ulIndex;
+#else
+	return 63 - __builtin_clzll(ullValue);
+#endif
+}
+
+
+//
+//	Below HISTOGRAM_SUB_BUCKETS a value is its own bucket. Above that the
+//	bucket is picked by the highest bit (which power of two) and the next
+//	HISTOGRAM_SUB_BUCKET_BITS bits (where within it).
+//
+static unsigned int
+BucketIndex(
+	uint64_t ullValue
+)
+{
+	unsigned int uiShift;
+
+	if (ullValue < HISTOGRAM_SUB_BUCKETS)
+		return (unsigned int)ullValue;
+
+	uiShift = HighestBit(ullValue) - HISTOGRAM_SUB_BUCKET_BITS;
+
+	return (uiShift + 1) * HISTOGRAM_SUB_BUCKETS + (unsigned int)((ullValue >> uiShift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+
+//
+//	Largest value that falls into the bucket.
+//
+static uint64_t
+BucketHighestValue(
+	unsigned int uiIndex
+)
+{
+	unsigned int uiShift;
+	uint64_t ullLowest;
+
+	if (uiIndex < HISTOGRAM_SUB_BUCKETS)
+		return uiIndex;
+
+	uiShift = uiIndex / HISTOGRAM_SUB_BUCKETS - 1;
+	ullLowest = (uint64_t)(HISTOGRAM_SUB_BUCKETS + uiIndex % HISTOGRAM_SUB_BUCKETS) << uiShift;
+
+	return ullLowest + ((uint64_t)1 << uiShift) - 1;
+}
+
+
+void
+HistogramReset(
+	HISTOGRAM* pHistogram
+)
+{
+	memset(pHistogram, 0, sizeof(*pHistogram));
+	pHistogram->ullMin = UINT64_MAX;
+}
+
+
+void
+HistogramRecord(
+	HISTOGRAM* pHistogram,
+	uint64_t ullValue
+)
+{
+	pHistogram->ullBuckets[BucketIndex(ullValue)]++;
+	pHistogram->ullCount++;
+	pHistogram->ullSum += ullValue;
+
+	if (ullValue < pHistogram->ullMin)
+		pHistogram->ullMin = ullValue;
+	if (ullValue > pHistogram->ullMax)
+		pHistogram->ullMax = ullValue;
+}
+
+
+void
+HistogramMerge(
+	HISTOGRAM* pTarget,
+	const HISTOGRAM* pSource
+)
+{
+	unsigned int uiIndex;
+
+	for (uiIndex = 0; uiIndex < HISTOGRAM_BUCKETS; uiIndex++)
+		pTarget->ullBuckets[uiIndex] += pSource->ullBuckets[uiIndex];
+
+	pTarget->ullCount += pSource->ullCount;
+	pTarget->ullSum += pSource->ullSum;
+
+	if (pSource->ullMin < pTarget->ullMin)
+		pTarget->ullMin = pSource->ullMin;
+	if (pSource->ullMax > pTarget->ullMax)
+		pTarget->ullMax = pSource->ullMax;
+}
+
+
+uint64_t
+HistogramPercentile(
+	const HISTOGRAM* pHistogram,
+	double dPercentile
+)
+{
+	uint64_t ullRank, ullSeen = 0;
+	unsigned int uiIndex;
+
+	if (!pHistogram->ullCount)
+		return 0;
+
+	ullRank = (uint64_t)(dPercentile / 100.0 * (double)pHistogram->ullCount + 0.5);
+
+	if (ullRank < 1)
+		ullRank = 1;
+	if (ullRank > pHistogram->ullCount)
+		ullRank = pHistogram->ullCount;
+
+	for (uiIndex = 0; uiIndex < HISTOGRAM_BUCKETS; uiIndex++)
+	{
+		ullSeen += pHistogram->ullBuckets[uiIndex];
+
+		if (ullSeen >= ullRank)
+			break;
+	}
+
+	//
+	//	The bucket bound can overshoot what was actually seen.
+	//
+	if (BucketHighestValue(uiIndex) > pHistogram->ullMax)
+		return pHistogram->ullMax;
+
+	return BucketHighestValue(uiIndex);
+}
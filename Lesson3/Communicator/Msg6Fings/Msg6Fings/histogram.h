@@ -0,0 +1,151 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	histogram.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares a log-linear latency histogram in the style of			*
+* 	HdrHistogram: every power of two is split into HISTOGRAM_SUB_BUCKETS		*
+* 	equal buckets, so any recorded value is known to within about 1.6%			*
+* 	while the whole 64-bit range fits in a few thousand counters.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define HISTOGRAM_SUB_BUCKET_BITS	6
+#define HISTOGRAM_SUB_BUCKETS		(1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+//
+//	Values below HISTOGRAM_SUB_BUCKETS are counted exactly, every power of two
+//	above that gets HISTOGRAM_SUB_BUCKETS buckets.
+//
+#define HISTOGRAM_BUCKETS			(HISTOGRAM_SUB_BUCKETS * (64 - HISTOGRAM_SUB_BUCKET_BITS + 1))
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef struct _HISTOGRAM
+{
+	uint64_t ullCount;
+	uint64_t ullSum;
+	uint64_t ullMin;
+	uint64_t ullMax;
+	uint64_t ullBuckets[HISTOGRAM_BUCKETS];
+
+} HISTOGRAM;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		HistogramReset
+//
+//	Parameters:
+//		[OUT]  HISTOGRAM* pHistogram
+//		Histogram to empty.
+//
+//	Routine Description:
+//		Forgets every recorded value.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+HistogramReset(
+	HISTOGRAM* pHistogram
+);
+
+//***********************************************************************************
+//	Function:
+//		HistogramRecord
+//
+//	Parameters:
+//		[IN OUT]  HISTOGRAM* pHistogram
+//		Histogram to record into.
+//
+//		[IN]  uint64_t ullValue
+//		Value to record.
+//
+//	Routine Description:
+//		Counts one value. Not thread safe, every thread records into its own
+//		histogram and the results are merged once the threads are done.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+HistogramRecord(
+	HISTOGRAM* pHistogram,
+	uint64_t ullValue
+);
+
+//***********************************************************************************
+//	Function:
+//		HistogramMerge
+//
+//	Parameters:
+//		[IN OUT]  HISTOGRAM* pTarget
+//		Histogram receiving the counts.
+//
+//		[IN]  const HISTOGRAM* pSource
+//		Histogram to add.
+//
+//	Routine Description:
+//		Adds every value recorded in pSource to pTarget.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+HistogramMerge(
+	HISTOGRAM* pTarget,
+	const HISTOGRAM* pSource
+);
+
+//***********************************************************************************
+//	Function:
+//		HistogramPercentile
+//
+//	Parameters:
+//		[IN]  const HISTOGRAM* pHistogram
+//		Histogram to query.
+//
+//		[IN]  double dPercentile
+//		Percentile between 0 and 100.
+//
+//	Routine Description:
+//		Finds the smallest value that at least dPercentile percent of the
+//		recorded values are less than or equal to. The answer is the upper
+//		end of the bucket holding that value, so it never under-reports.
+//
+//	Return Value:
+//		uint64_t.
+//		The value, 0 if nothing was recorded.
+//
+//***********************************************************************************
+uint64_t
+HistogramPercentile(
+	const HISTOGRAM* pHistogram,
+	double dPercentile
+);
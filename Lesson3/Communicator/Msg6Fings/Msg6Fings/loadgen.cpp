@@ -0,0 +1,597 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	loadgen.cpp																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the load generator.									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "transport.h"
+#include "histogram.h"
+#include "loadgen.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define LOAD_MAX_THREADS		256
+#define LOAD_MAX_SIZE_RANGES	32
+#define LOAD_MAX_MESSAGE_SIZE	(16 * 1024 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef std::chrono::steady_clock LOAD_CLOCK;
+
+//
+//	Message sizes from ulMinimum to ulMaximum, picked with the given weight.
+//
+typedef struct _SIZE_RANGE
+{
+	uint32_t ulMinimum;
+	uint32_t ulMaximum;
+	uint32_t ulWeight;
+
+} SIZE_RANGE;
+
+typedef struct _LOAD_CONFIG
+{
+	const TRANSPORT* pTransport;
+	const char* pszTransportOption;
+	unsigned int uiThreads;
+	double dSeconds;
+	uint64_t ullOperations;
+	unsigned int uiReadPercent;
+	bool bJson;
+
+	unsigned int uiSizeRanges;
+	uint32_t ulTotalWeight;
+	uint32_t ulLargestSize;
+	SIZE_RANGE SizeRanges[LOAD_MAX_SIZE_RANGES];
+
+} LOAD_CONFIG;
+
+//
+//	What one thread did. Only the owning thread writes to it, the main
+//	thread merges them after every thread has been joined.
+//
+typedef struct _LOAD_THREAD
+{
+	const LOAD_CONFIG* pConfig;
+	void* pConnection;
+	uint64_t ullRandom;
+
+	uint64_t ullWrites;
+	uint64_t ullWriteBytes;
+	uint64_t ullWritesRejected;
+	uint64_t ullReads;
+	uint64_t ullReadBytes;
+	uint64_t ullReadsEmpty;
+
+	HISTOGRAM WriteLatency;
+	HISTOGRAM ReadLatency;
+
+} LOAD_THREAD;
+
+typedef struct _LOAD_CONTROL
+{
+	std::atomic<bool> bGo;
+	std::atomic<bool> bStop;
+	std::atomic<int64_t> llOperationsLeft;
+	LOAD_CLOCK::time_point Deadline;
+
+} LOAD_CONTROL;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static void
+PrintLoadUsage(
+	void
+)
+{
+	printf(
+		"Usage: Msg6Fings load [options]\n"
+		"  -T transport[:option]  device[:file|buffered|direct|neither] or loopback\n"
+		"  -t threads             Number of load threads (default 1)\n"
+		"  -d seconds             Run time (default 10 unless -n is given)\n"
+		"  -n operations          Stop after this many operations in total\n"
+		"  -r percent             Share of operations that are reads (default 50)\n"
+		"  -s sizes               Message sizes in bytes, e.g. 64 or 64-4096 or\n"
+		"                         64@70,1024@25,4096-65536@5 (range@weight)\n"
+		"  -j                     Print JSON instead of text\n"
+	);
+}
+
+
+//
+//	Parses "range@weight,range@weight,..." where a range is "size" or "minimum-maximum".
+//
+static bool
+ParseSizes(
+	const char* pszSizes,
+	LOAD_CONFIG* pConfig
+)
+{
+	const char* pszCursor = pszSizes;
+	char* pszEnd;
+	SIZE_RANGE* pRange;
+
+	pConfig->uiSizeRanges = 0;
+	pConfig->ulTotalWeight = 0;
+	pConfig->ulLargestSize = 0;
+
+	while (*pszCursor)
+	{
+		if (pConfig->uiSizeRanges == LOAD_MAX_SIZE_RANGES)
+			return false;
+
+		pRange = &pConfig->SizeRanges[pConfig->uiSizeRanges++];
+
+		pRange->ulMinimum = (uint32_t)strtoul(pszCursor, &pszEnd, 10);
+		pRange->ulMaximum = pRange->ulMinimum;
+		pRange->ulWeight = 1;
+
+		if (*pszEnd == '-')
+			pRange->ulMaximum = (uint32_t)strtoul(pszEnd + 1, &pszEnd, 10);
+
+		if (*pszEnd == '@')
+			pRange->ulWeight = (uint32_t)strtoul(pszEnd + 1, &pszEnd, 10);
+
+		if (pszEnd == pszCursor ||
+			pRange->ulMinimum < 1 ||
+			pRange->ulMaximum < pRange->ulMinimum ||
+			pRange->ulMaximum > LOAD_MAX_MESSAGE_SIZE ||
+			pRange->ulWeight < 1)
+		{
+			return false;
+		}
+
+		if (*pszEnd == ',')
+			pszEnd++;
+		else if (*pszEnd)
+			return false;
+
+		pConfig->ulTotalWeight += pRange->ulWeight;
+
+		if (pRange->ulMaximum > pConfig->ulLargestSize)
+			pConfig->ulLargestSize = pRange->ulMaximum;
+
+		pszCursor = pszEnd;
+	}
+
+	return pConfig->uiSizeRanges != 0;
+}
+
+
+static bool
+ParseLoadOptions(
+	int argc,
+	char* argv[],
+	LOAD_CONFIG* pConfig
+)
+{
+	static char szTransport[64];
+	char* pszColon;
+	const char* pszValue;
+	int iIndex;
+
+	pConfig->pTransport = FindTransport("loopback");
+	pConfig->pszTransportOption = NULL;
+	pConfig->uiThreads = 1;
+	pConfig->dSeconds = 0.0;
+	pConfig->ullOperations = 0;
+	pConfig->uiReadPercent = 50;
+	pConfig->bJson = false;
+
+#ifdef _WIN32
+	pConfig->pTransport = FindTransport("device");
+#endif
+
+	ParseSizes("64", pConfig);
+
+	for (iIndex = 0; iIndex < argc; iIndex++)
+	{
+		if (argv[iIndex][0] != '-' || !argv[iIndex][1] || argv[iIndex][2])
+			return false;
+
+		if (argv[iIndex][1] == 'j')
+		{
+			pConfig->bJson = true;
+			continue;
+		}
+
+		if (iIndex + 1 == argc)
+			return false;
+
+		pszValue = argv[++iIndex];
+
+		switch (argv[iIndex - 1][1])
+		{
+		case 'T':
+			snprintf(szTransport, sizeof(szTransport), "%s", pszValue);
+
+			pszColon = strchr(szTransport, ':');
+			if (pszColon)
+			{
+				*pszColon = '\0';
+				pConfig->pszTransportOption = pszColon + 1;
+			}
+
+			pConfig->pTransport = FindTransport(szTransport);
+			if (!pConfig->pTransport)
+				return false;
+			break;
+
+		case 't':
+			pConfig->uiThreads = (unsigned int)atoi(pszValue);
+			if (pConfig->uiThreads < 1 || pConfig->uiThreads > LOAD_MAX_THREADS)
+				return false;
+			break;
+
+		case 'd':
+			pConfig->dSeconds = atof(pszValue);
+			if (pConfig->dSeconds <= 0.0)
+				return false;
+			break;
+
+		case 'n':
+			pConfig->ullOperations = strtoull(pszValue, NULL, 10);
+			if (!pConfig->ullOperations)
+				return false;
+			break;
+
+		case 'r':
+			pConfig->uiReadPercent = (unsigned int)atoi(pszValue);
+			if (pConfig->uiReadPercent > 100)
+				return false;
+			break;
+
+		case 's':
+			if (!ParseSizes(pszValue, pConfig))
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	if (pConfig->dSeconds == 0.0 && !pConfig->ullOperations)
+		pConfig->dSeconds = 10.0;
+
+	return true;
+}
+
+
+//
+//	xorshift64*, cheap enough not to show up in the latencies.
+//
+static uint32_t
+NextRandom(
+	LOAD_THREAD* pThread
+)
+{
+	pThread->ullRandom ^= pThread->ullRandom >> 12;
+	pThread->ullRandom ^= pThread->ullRandom << 25;
+	pThread->ullRandom ^= pThread->ullRandom >> 27;
+
+	return (uint32_t)((pThread->ullRandom * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+static uint32_t
+PickMessageSize(
+	LOAD_THREAD* pThread
+)
+{
+	const LOAD_CONFIG* pConfig = pThread->pConfig;
+	const SIZE_RANGE* pRange = pConfig->SizeRanges;
+	uint32_t ulWeight = NextRandom(pThread) % pConfig->ulTotalWeight;
+
+	while (ulWeight >= pRange->ulWeight)
+	{
+		ulWeight -= pRange->ulWeight;
+		pRange++;
+	}
+
+	return pRange->ulMinimum + NextRandom(pThread) % (pRange->ulMaximum - pRange->ulMinimum + 1);
+}
+
+
+static void
+LoadThread(
+	LOAD_THREAD* pThread,
+	LOAD_CONTROL* pControl
+)
+{
+	const LOAD_CONFIG* pConfig = pThread->pConfig;
+	const TRANSPORT* pTransport = pConfig->pTransport;
+	std::vector<char> Message(pConfig->ulLargestSize, 'a');
+	std::vector<char> Buffer(pConfig->ulLargestSize);
+	LOAD_CLOCK::time_point Start, End;
+	uint64_t ullLatency;
+	uint32_t ulSize;
+	bool bAccepted;
+
+	while (!pControl->bGo.load(std::memory_order_acquire))
+		std::this_thread::yield();
+
+	while (!pControl->bStop.load(std::memory_order_relaxed))
+	{
+		if (pConfig->ullOperations &&
+			pControl->llOperationsLeft.fetch_sub(1, std::memory_order_relaxed) <= 0)
+		{
+			break;
+		}
+
+		if (NextRandom(pThread) % 100 < pConfig->uiReadPercent)
+		{
+			Start = LOAD_CLOCK::now();
+			ulSize = pTransport->Receive(pThread->pConnection, Buffer.data(), (uint32_t)Buffer.size());
+			End = LOAD_CLOCK::now();
+
+			ullLatency = std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count();
+
+			if (ulSize)
+			{
+				pThread->ullReads++;
+				pThread->ullReadBytes += ulSize;
+				HistogramRecord(&pThread->ReadLatency, ullLatency);
+			}
+			else
+			{
+				pThread->ullReadsEmpty++;
+			}
+		}
+		else
+		{
+			//
+			//	The driver only takes NULL terminated messages.
+			//
+			ulSize = PickMessageSize(pThread);
+			Message[ulSize - 1] = '\0';
+
+			Start = LOAD_CLOCK::now();
+			bAccepted = pTransport->Send(pThread->pConnection, Message.data(), ulSize);
+			End = LOAD_CLOCK::now();
+
+			Message[ulSize - 1] = 'a';
+
+			ullLatency = std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count();
+
+			if (bAccepted)
+			{
+				pThread->ullWrites++;
+				pThread->ullWriteBytes += ulSize;
+				HistogramRecord(&pThread->WriteLatency, ullLatency);
+			}
+			else
+			{
+				pThread->ullWritesRejected++;
+			}
+		}
+
+		if (End >= pControl->Deadline)
+			break;
+	}
+}
+
+
+static void
+PrintTextRow(
+	const char* pszName,
+	uint64_t ullOperations,
+	uint64_t ullBytes,
+	double dSeconds,
+	const HISTOGRAM* pLatency
+)
+{
+	printf(
+		"%-6s %12llu %12.0f %10.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+		pszName,
+		(unsigned long long)ullOperations,
+		ullOperations / dSeconds,
+		ullBytes / dSeconds / (1024.0 * 1024.0),
+		pLatency->ullCount ? pLatency->ullSum / 1000.0 / pLatency->ullCount : 0.0,
+		HistogramPercentile(pLatency, 50.0) / 1000.0,
+		HistogramPercentile(pLatency, 90.0) / 1000.0,
+		HistogramPercentile(pLatency, 99.0) / 1000.0,
+		HistogramPercentile(pLatency, 99.9) / 1000.0,
+		pLatency->ullMax / 1000.0
+	);
+}
+
+
+static void
+PrintJsonOperation(
+	const char* pszName,
+	uint64_t ullOperations,
+	uint64_t ullBytes,
+	const char* pszMissName,
+	uint64_t ullMisses,
+	double dSeconds,
+	const HISTOGRAM* pLatency
+)
+{
+	printf(
+		"  \"%s\": {\"ops\": %llu, \"bytes\": %llu, \"%s\": %llu, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+		"\"latency_us\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p99_9\": %.3f, \"max\": %.3f}}",
+		pszName,
+		(unsigned long long)ullOperations,
+		(unsigned long long)ullBytes,
+		pszMissName,
+		(unsigned long long)ullMisses,
+		ullOperations / dSeconds,
+		ullBytes / dSeconds / (1024.0 * 1024.0),
+		pLatency->ullCount ? pLatency->ullSum / 1000.0 / pLatency->ullCount : 0.0,
+		HistogramPercentile(pLatency, 50.0) / 1000.0,
+		HistogramPercentile(pLatency, 90.0) / 1000.0,
+		HistogramPercentile(pLatency, 99.0) / 1000.0,
+		HistogramPercentile(pLatency, 99.9) / 1000.0,
+		pLatency->ullMax / 1000.0
+	);
+}
+
+
+int
+RunLoadGenerator(
+	int argc,
+	char* argv[]
+)
+{
+	LOAD_CONFIG Config;
+	LOAD_CONTROL Control;
+	LOAD_THREAD Total;
+	std::vector<LOAD_THREAD*> Threads;
+	std::vector<std::thread> Workers;
+	LOAD_CLOCK::time_point Start;
+	double dSeconds;
+	unsigned int uiIndex;
+	int iRet = 0;
+
+	if (!ParseLoadOptions(argc, argv, &Config))
+	{
+		PrintLoadUsage();
+		return 1;
+	}
+
+	//
+	//	Open every connection up front so a missing device fails before any load.
+	//
+	for (uiIndex = 0; uiIndex < Config.uiThreads; uiIndex++)
+	{
+		LOAD_THREAD* pThread = new LOAD_THREAD;
+
+		memset(pThread, 0, sizeof(*pThread));
+		pThread->pConfig = &Config;
+		pThread->ullRandom = 0x9E3779B97F4A7C15ULL * (uiIndex + 1);
+		HistogramReset(&pThread->WriteLatency);
+		HistogramReset(&pThread->ReadLatency);
+
+		pThread->pConnection = Config.pTransport->Open(Config.pszTransportOption);
+		if (!pThread->pConnection)
+		{
+			printf("Could not open the %s transport\n", Config.pTransport->pszName);
+			delete pThread;
+			iRet = 1;
+			break;
+		}
+
+		Threads.push_back(pThread);
+	}
+
+	if (iRet == 0)
+	{
+		Control.bGo = false;
+		Control.bStop = false;
+		Control.llOperationsLeft = (int64_t)Config.ullOperations;
+
+		for (uiIndex = 0; uiIndex < Config.uiThreads; uiIndex++)
+			Workers.push_back(std::thread(LoadThread, Threads[uiIndex], &Control));
+
+		Start = LOAD_CLOCK::now();
+		Control.Deadline = LOAD_CLOCK::time_point::max();
+
+		if (Config.dSeconds > 0.0)
+			Control.Deadline = Start + std::chrono::duration_cast<LOAD_CLOCK::duration>(std::chrono::duration<double>(Config.dSeconds));
+
+		Control.bGo.store(true, std::memory_order_release);
+
+		for (uiIndex = 0; uiIndex < Config.uiThreads; uiIndex++)
+			Workers[uiIndex].join();
+
+		dSeconds = std::chrono::duration<double>(LOAD_CLOCK::now() - Start).count();
+
+		memset(&Total, 0, sizeof(Total));
+		HistogramReset(&Total.WriteLatency);
+		HistogramReset(&Total.ReadLatency);
+
+		for (uiIndex = 0; uiIndex < Config.uiThreads; uiIndex++)
+		{
+			Total.ullWrites += Threads[uiIndex]->ullWrites;
+			Total.ullWriteBytes += Threads[uiIndex]->ullWriteBytes;
+			Total.ullWritesRejected += Threads[uiIndex]->ullWritesRejected;
+			Total.ullReads += Threads[uiIndex]->ullReads;
+			Total.ullReadBytes += Threads[uiIndex]->ullReadBytes;
+			Total.ullReadsEmpty += Threads[uiIndex]->ullReadsEmpty;
+			HistogramMerge(&Total.WriteLatency, &Threads[uiIndex]->WriteLatency);
+			HistogramMerge(&Total.ReadLatency, &Threads[uiIndex]->ReadLatency);
+		}
+
+		if (Config.bJson)
+		{
+			printf("{\n  \"transport\": \"%s\", \"option\": \"%s\", \"threads\": %u, \"seconds\": %.3f, \"read_percent\": %u,\n",
+				Config.pTransport->pszName,
+				Config.pszTransportOption ? Config.pszTransportOption : "",
+				Config.uiThreads,
+				dSeconds,
+				Config.uiReadPercent);
+			PrintJsonOperation("write", Total.ullWrites, Total.ullWriteBytes, "rejected", Total.ullWritesRejected, dSeconds, &Total.WriteLatency);
+			printf(",\n");
+			PrintJsonOperation("read", Total.ullReads, Total.ullReadBytes, "empty", Total.ullReadsEmpty, dSeconds, &Total.ReadLatency);
+			printf("\n}\n");
+		}
+		else
+		{
+			printf("Transport %s%s%s, %u thread(s), %.2f s, %u%% reads\n",
+				Config.pTransport->pszName,
+				Config.pszTransportOption ? ":" : "",
+				Config.pszTransportOption ? Config.pszTransportOption : "",
+				Config.uiThreads,
+				dSeconds,
+				Config.uiReadPercent);
+			printf("%-6s %12s %12s %10s %9s %9s %9s %9s %9s %9s\n",
+				"", "ops", "ops/s", "MB/s", "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+			PrintTextRow("write", Total.ullWrites, Total.ullWriteBytes, dSeconds, &Total.WriteLatency);
+			PrintTextRow("read", Total.ullReads, Total.ullReadBytes, dSeconds, &Total.ReadLatency);
+			printf("%llu write(s) rejected because the store was full, %llu read(s) found nothing.\n",
+				(unsigned long long)Total.ullWritesRejected,
+				(unsigned long long)Total.ullReadsEmpty);
+		}
+	}
+
+	for (uiIndex = 0; uiIndex < Threads.size(); uiIndex++)
+	{
+		Config.pTransport->Close(Threads[uiIndex]->pConnection);
+		delete Threads[uiIndex];
+	}
+
+	return iRet;
+}
+
+
+#ifdef LOADGEN_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunLoadGenerator(argc - 1, argv + 1);
+}
+#endif
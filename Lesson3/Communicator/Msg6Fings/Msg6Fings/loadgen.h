@@ -0,0 +1,52 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	loadgen.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the load generator. It only depends on the C++			*
+* 	standard library and a TRANSPORT, so it runs against the driver				*
+* 	on Windows and against the loopback transport anywhere. On Linux			*
+* 	it builds on its own with the loopback transport:							*
+*																				*
+* 	g++ -O2 -pthread -DLOADGEN_MAIN loadgen.cpp transport.cpp					*
+* 		histogram.cpp -o 6fings-load											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		RunLoadGenerator
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of options.
+//
+//		[IN]  char* argv[]
+//		Options, without the program name or the "load" command.
+//
+//	Routine Description:
+//		Runs N threads that write and read messages through a transport for
+//		a fixed time or number of operations, then prints throughput and the
+//		latency percentiles of each operation as text or JSON.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 on bad options or if the transport could not be opened.
+//
+//***********************************************************************************
+int
+RunLoadGenerator(
+	int argc,
+	char* argv[]
+);
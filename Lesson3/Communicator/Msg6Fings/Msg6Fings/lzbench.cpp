@@ -0,0 +1,247 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	lzbench.cpp																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the benchmark of the LZ codec the driver				*
+* 	uses to keep queued messages compressed.									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "lz.h"
+#include "lzbench.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Every size is compressed and expanded until at least this many bytes
+//	went through, so small messages are timed over many calls.
+//
+#define LZBENCH_BYTES_PER_SIZE	(64 * 1024 * 1024)
+
+//
+//	Length of the generated sample.
+//
+#define LZBENCH_SAMPLE_SIZE		(4 * 1024 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static const size_t g_MessageSizes[] = { 64, 256, 1024, 4096, 16384, 65536 };
+
+static const char* const g_pszLevels[] = { "INFO ", "DEBUG", "WARN ", "ERROR" };
+static const char* const g_pszComponents[] = { "net.session", "store.slab", "io.dispatch", "auth.token", "sched.worker" };
+static const char* const g_pszEvents[] = { "sent", "received", "dropped", "queued", "retried" };
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Log lines like the ones clients write, from a fixed seed so runs
+//	compare.
+//
+static void
+GenerateSample(
+	std::vector<unsigned char>& Sample
+)
+{
+	unsigned int Seed = 0x6F1265;
+	unsigned int Second = 0;
+	char szLine[160];
+	int iLength;
+
+	while (Sample.size() < LZBENCH_SAMPLE_SIZE)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		Second += (Seed >> 16) % 3;
+
+		iLength = snprintf(szLine, sizeof(szLine),
+			"2026-10-17 %02u:%02u:%02u.%03u [%s] %s: client 10.0.%u.%u %s %u bytes in %u ms (id %06x)\n",
+			(Second / 3600) % 24, (Second / 60) % 60, Second % 60, (Seed >> 8) % 1000,
+			g_pszLevels[(Seed >> 20) % 4],
+			g_pszComponents[(Seed >> 12) % 5],
+			(Seed >> 4) % 8, (Seed >> 9) % 250,
+			g_pszEvents[(Seed >> 24) % 5],
+			(Seed >> 3) % 65536, (Seed >> 14) % 200,
+			Seed & 0xFFFFFF);
+
+		Sample.insert(Sample.end(), szLine, szLine + iLength);
+	}
+}
+
+
+//
+//	Reads the whole file named by pszFile into Sample.
+//
+static bool
+ReadSample(
+	const char* pszFile,
+	std::vector<unsigned char>& Sample
+)
+{
+	unsigned char Buffer[64 * 1024];
+	size_t cbRead;
+	FILE* pInput;
+
+#ifdef _WIN32
+	if (fopen_s(&pInput, pszFile, "rb"))
+		pInput = NULL;
+#else
+	pInput = fopen(pszFile, "rb");
+#endif
+
+	if (!pInput)
+		return false;
+
+	while ((cbRead = fread(Buffer, 1, sizeof(Buffer), pInput)) > 0)
+		Sample.insert(Sample.end(), Buffer, Buffer + cbRead);
+
+	fclose(pInput);
+
+	return !Sample.empty();
+}
+
+
+int
+RunCompressionBenchmark(
+	int argc,
+	char* argv[]
+)
+{
+	std::vector<unsigned char> Sample;
+	std::vector<unsigned char> Compressed;
+	std::vector<unsigned char> Expanded;
+	std::vector<size_t> CompressedLengths;
+	std::vector<unsigned int> Workspace(LZ_WORKSPACE_SIZE / sizeof(unsigned int));
+	std::chrono::steady_clock::time_point Start;
+	double dCompressSeconds, dExpandSeconds;
+	size_t SizeIndex, cbMessage, MessageCount, Index, cbKept, cbThrough;
+
+	if (argc > 0)
+	{
+		if (!ReadSample(argv[0], Sample))
+		{
+			fprintf(stderr, "Cannot read %s\n", argv[0]);
+			return 1;
+		}
+	}
+	else
+	{
+		GenerateSample(Sample);
+	}
+
+	printf("Sample of %zu bytes, messages compressed one at a time.\n", Sample.size());
+	printf("%10s%12s%14s%14s%10s%16s%16s\n", "Size", "Messages", "Written", "Kept", "Saved", "Compress", "Decompress");
+
+	for (SizeIndex = 0; SizeIndex < sizeof(g_MessageSizes) / sizeof(g_MessageSizes[0]); SizeIndex++)
+	{
+		cbMessage = g_MessageSizes[SizeIndex];
+		MessageCount = Sample.size() / cbMessage;
+
+		if (!MessageCount)
+			break;
+
+		//
+		//	The driver keeps a message compressed only when that is shorter,
+		//	so the block never needs more room than the message.
+		//
+		Compressed.resize(MessageCount * cbMessage);
+		Expanded.resize(cbMessage);
+		CompressedLengths.resize(MessageCount);
+
+		cbThrough = 0;
+		Start = std::chrono::steady_clock::now();
+
+		do
+		{
+			for (Index = 0; Index < MessageCount; Index++)
+			{
+				CompressedLengths[Index] = LzCompress(
+					&Sample[Index * cbMessage], cbMessage,
+					&Compressed[Index * cbMessage], cbMessage - 1,
+					Workspace.data());
+			}
+
+			cbThrough += MessageCount * cbMessage;
+
+		} while (cbThrough < LZBENCH_BYTES_PER_SIZE);
+
+		dCompressSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		cbKept = 0;
+
+		for (Index = 0; Index < MessageCount; Index++)
+		{
+			cbKept += CompressedLengths[Index] ? CompressedLengths[Index] : cbMessage;
+
+			if (CompressedLengths[Index] &&
+				(LzDecompress(&Compressed[Index * cbMessage], CompressedLengths[Index], Expanded.data(), cbMessage) != cbMessage ||
+				memcmp(Expanded.data(), &Sample[Index * cbMessage], cbMessage)))
+			{
+				fprintf(stderr, "Message %zu of %zu bytes did not come back unchanged\n", Index, cbMessage);
+				return 1;
+			}
+		}
+
+		cbThrough = 0;
+		Start = std::chrono::steady_clock::now();
+
+		do
+		{
+			for (Index = 0; Index < MessageCount; Index++)
+			{
+				if (CompressedLengths[Index])
+					LzDecompress(&Compressed[Index * cbMessage], CompressedLengths[Index], Expanded.data(), cbMessage);
+			}
+
+			cbThrough += MessageCount * cbMessage;
+
+		} while (cbThrough < LZBENCH_BYTES_PER_SIZE);
+
+		dExpandSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		printf("%10zu%12zu%14zu%14zu%9.1f%%%11.0f MB/s%11.0f MB/s\n",
+			cbMessage,
+			MessageCount,
+			MessageCount * cbMessage,
+			cbKept,
+			100.0 - 100.0 * (double)cbKept / (double)(MessageCount * cbMessage),
+			(double)cbThrough / dCompressSeconds / (1024 * 1024),
+			(double)cbThrough / dExpandSeconds / (1024 * 1024));
+	}
+
+	return 0;
+}
+
+
+#ifdef LZBENCH_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunCompressionBenchmark(argc - 1, argv + 1);
+}
+#endif
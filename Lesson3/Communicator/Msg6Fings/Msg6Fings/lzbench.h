@@ -0,0 +1,58 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	lzbench.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the benchmark of the LZ codec the driver uses			*
+* 	to keep queued messages compressed. It only depends on the C++				*
+* 	standard library and the driver's lz.c, on Linux it builds on				*
+* 	its own:																	*
+*																				*
+* 	g++ -O2 -DLZBENCH_MAIN -I../../../Driver/6Fings/6Fings						*
+* 		lzbench.cpp -x c ../../../Driver/6Fings/6Fings/lz.c						*
+* 		-o 6fings-lzbench														*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		RunCompressionBenchmark
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Arguments, without the program name or the "lz-bench" command.
+//		The optional first one names a file to take the messages from,
+//		else generated log lines are used.
+//
+//	Routine Description:
+//		Cuts the sample into messages of every size from 64 bytes to
+//		64 KB and compresses each one on its own, the way the driver
+//		stores them. Prints per size the bytes kept against the bytes
+//		written and the compression and decompression rates, after
+//		checking every message comes back unchanged.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the file could not be read or a message did
+//		not come back unchanged.
+//
+//***********************************************************************************
+int
+RunCompressionBenchmark(
+	int argc,
+	char* argv[]
+);
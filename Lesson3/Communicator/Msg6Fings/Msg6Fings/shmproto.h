@@ -0,0 +1,501 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	shmproto.h																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the protocol of the 6Fings shared ring, the			*
+* 	part both sides run in the shared pages. It only depends on the				*
+* 	C++ standard library, how a side sleeps and wakes the other is				*
+* 	passed in, so shmring.cpp drives it through the driver and					*
+* 	shmringtest.cpp between two Linux processes:								*
+*																				*
+* 	g++ -O2 -pthread -DSHMRINGTEST_MAIN shmringtest.cpp							*
+* 		-o 6fings-shmringtest													*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(_M_AMD64) || defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <intrin.h>
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Times a side polls the ring before asking to be put to sleep.
+//
+#define SHM_PROTO_SPIN_COUNT		4000
+
+//
+//	The same values as FINGS_RING_CONSUMER, FINGS_RING_PRODUCER and the
+//	FINGS_SHARED_RING_* record layout, shmring.cpp checks they agree.
+//
+#define SHM_PROTO_CONSUMER			0
+#define SHM_PROTO_PRODUCER			1
+#define SHM_PROTO_ALIGNMENT			8
+#define SHM_PROTO_WRAP				0xFFFFFFFF
+#define SHM_PROTO_WAIT_FOREVER		0xFFFFFFFF
+#define SHM_PROTO_RECORD_SIZE(length)	\
+	((sizeof(uint32_t) + (uint32_t)(length) + SHM_PROTO_ALIGNMENT - 1) & ~(uint32_t)(SHM_PROTO_ALIGNMENT - 1))
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	FINGS_SHARED_RING in fixed width types. llTail is only written by the
+//	producer and llHead only by the consumer, each on its own cache line,
+//	both count bytes since the ring was created. ulDataSize is a power of
+//	two, the data area starts ulDataOffset bytes after the header.
+//
+typedef struct _SHM_PROTO_HEADER
+{
+	int64_t llTail;
+	uint8_t Reserved1[56];
+
+	int64_t llHead;
+	uint8_t Reserved2[56];
+
+	int32_t lWaiting[2];
+	uint32_t ulDataSize;
+	uint32_t ulDataOffset;
+
+} SHM_PROTO_HEADER;
+
+//
+//	How a side sleeps until the other wakes it. pfnWait returns false on
+//	timeout or error, a wake that comes before the wait must end it.
+//
+typedef struct _SHM_PROTO_WAITER
+{
+	bool (*pfnWait)(void* pContext, uint32_t ulSide, uint32_t ulTimeout);
+	void (*pfnWake)(void* pContext, uint32_t ulSide);
+	void* pContext;
+
+} SHM_PROTO_WAITER;
+
+//
+//	One side's view of a mapped ring.
+//
+typedef struct _SHM_PROTO_RING
+{
+	SHM_PROTO_HEADER* pHeader;
+	uint8_t* pData;
+	uint32_t ulMask;
+	SHM_PROTO_WAITER Waiter;
+
+} SHM_PROTO_RING;
+
+
+static_assert(sizeof(SHM_PROTO_HEADER) == 144, "the header matches FINGS_SHARED_RING");
+static_assert(sizeof(std::atomic<int64_t>) == sizeof(int64_t) && ATOMIC_LLONG_LOCK_FREE == 2,
+	"the positions are accessed atomically in place, from two processes");
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t) && ATOMIC_INT_LOCK_FREE == 2,
+	"the flags are accessed atomically in place, from two processes");
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	The positions and flags live in memory shared with another process,
+//	they are accessed in place like spool.cpp does with its segments.
+//
+inline std::atomic<int64_t>*
+ShmProtoPosition(
+	int64_t* pllPosition
+)
+{
+	return (std::atomic<int64_t>*)pllPosition;
+}
+
+
+//
+//	Flag of the side ulSide.
+//
+inline std::atomic<int32_t>*
+ShmProtoWaiting(
+	SHM_PROTO_RING* pRing,
+	uint32_t ulSide
+)
+{
+	return (std::atomic<int32_t>*)&pRing->pHeader->lWaiting[ulSide];
+}
+
+
+//
+//	Lets the other hardware thread of the core run while polling.
+//
+inline void
+ShmProtoPause(
+	void
+)
+{
+#if defined(_M_AMD64) || defined(__x86_64__)
+	_mm_pause();
+#elif defined(_M_ARM64)
+	__yield();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShmProtoAttach
+//
+//	Parameters:
+//		[OUT]  SHM_PROTO_RING* pRing
+//		Receives the view of the ring.
+//
+//		[IN]  void* pMapping
+//		Start of the mapping, a header set up by the side that created it.
+//
+//		[IN]  const SHM_PROTO_WAITER* pWaiter
+//		How this side sleeps and wakes the other.
+//
+//	Routine Description:
+//		Sets up a side's view of a ring another side created.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+inline void
+ShmProtoAttach(
+	SHM_PROTO_RING* pRing,
+	void* pMapping,
+	const SHM_PROTO_WAITER* pWaiter
+)
+{
+	pRing->pHeader = (SHM_PROTO_HEADER*)pMapping;
+	pRing->pData = (uint8_t*)pMapping + pRing->pHeader->ulDataOffset;
+	pRing->ulMask = pRing->pHeader->ulDataSize - 1;
+	pRing->Waiter = *pWaiter;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShmProtoTryProduce
+//
+//	Parameters:
+//		[IN]  SHM_PROTO_RING* pRing
+//		Ring to produce into.
+//
+//		[IN]  const void* pMessage
+//		Message to copy.
+//
+//		[IN]  uint32_t ulLength
+//		Length of the message, its record fits in the data area.
+//
+//	Routine Description:
+//		Copies the message into the ring if there is room for it. A
+//		message never wraps, the rest of the data area is skipped instead.
+//		The consumer sees the message and the wrap marker no sooner than
+//		the new tail.
+//
+//	Return Value:
+//		bool.
+//		true if the message is in the ring, false if it is full.
+//
+//***********************************************************************************
+inline bool
+ShmProtoTryProduce(
+	SHM_PROTO_RING* pRing,
+	const void* pMessage,
+	uint32_t ulLength
+)
+{
+	SHM_PROTO_HEADER* pHeader = pRing->pHeader;
+	int64_t llTail = ShmProtoPosition(&pHeader->llTail)->load(std::memory_order_relaxed);
+	int64_t llHead = ShmProtoPosition(&pHeader->llHead)->load(std::memory_order_acquire);
+	uint32_t ulRecord = SHM_PROTO_RECORD_SIZE(ulLength);
+	uint32_t ulOffset = (uint32_t)llTail & pRing->ulMask;
+	uint32_t ulContiguous = pHeader->ulDataSize - ulOffset;
+	uint32_t ulSkip = 0;
+	uint32_t ulMarker;
+
+	if (ulRecord > ulContiguous)
+		ulSkip = ulContiguous;
+
+	if ((uint64_t)(llTail - llHead) + ulSkip + ulRecord > pHeader->ulDataSize)
+		return false;
+
+	if (ulSkip)
+	{
+		ulMarker = SHM_PROTO_WRAP;
+		memcpy(pRing->pData + ulOffset, &ulMarker, sizeof(ulMarker));
+		ulOffset = 0;
+	}
+
+	memcpy(pRing->pData + ulOffset, &ulLength, sizeof(ulLength));
+	memcpy(pRing->pData + ulOffset + sizeof(ulLength), pMessage, ulLength);
+
+	ShmProtoPosition(&pHeader->llTail)->store(llTail + ulSkip + ulRecord, std::memory_order_release);
+
+	return true;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShmProtoTryConsume
+//
+//	Parameters:
+//		[IN]  SHM_PROTO_RING* pRing
+//		Ring to consume from.
+//
+//		[OUT]  void* pBuffer
+//		Receives the message, cut to ulLength bytes if longer.
+//
+//		[IN]  uint32_t ulLength
+//		Size of pBuffer.
+//
+//		[OUT]  uint32_t* pulMessageLength
+//		Receives the length of the message.
+//
+//	Routine Description:
+//		Takes the oldest message out of the ring. The producer may reuse
+//		its space no sooner than the copy is done.
+//
+//	Return Value:
+//		bool.
+//		true if a message was taken, false if the ring is empty.
+//
+//***********************************************************************************
+inline bool
+ShmProtoTryConsume(
+	SHM_PROTO_RING* pRing,
+	void* pBuffer,
+	uint32_t ulLength,
+	uint32_t* pulMessageLength
+)
+{
+	SHM_PROTO_HEADER* pHeader = pRing->pHeader;
+	int64_t llHead = ShmProtoPosition(&pHeader->llHead)->load(std::memory_order_relaxed);
+	int64_t llTail = ShmProtoPosition(&pHeader->llTail)->load(std::memory_order_acquire);
+	uint32_t ulOffset, ulMessageLength;
+
+	for (;;)
+	{
+		if (llHead == llTail)
+			return false;
+
+		ulOffset = (uint32_t)llHead & pRing->ulMask;
+		memcpy(&ulMessageLength, pRing->pData + ulOffset, sizeof(ulMessageLength));
+
+		if (ulMessageLength != SHM_PROTO_WRAP)
+			break;
+
+		llHead += pHeader->ulDataSize - ulOffset;
+	}
+
+	*pulMessageLength = ulMessageLength;
+	memcpy(pBuffer, pRing->pData + ulOffset + sizeof(ulMessageLength), ulLength < ulMessageLength ? ulLength : ulMessageLength);
+
+	ShmProtoPosition(&pHeader->llHead)->store(llHead + SHM_PROTO_RECORD_SIZE(ulMessageLength), std::memory_order_release);
+
+	return true;
+}
+
+
+//
+//	Wakes the other side if it said it was going to sleep. The caller just
+//	published, the fence orders that before reading the flag. Clearing
+//	the flag here keeps the messages sent before the sleeper gets to run
+//	from waking it again.
+//
+inline void
+ShmProtoWakeIfWaiting(
+	SHM_PROTO_RING* pRing,
+	uint32_t ulSide
+)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!ShmProtoWaiting(pRing, ulSide)->load(std::memory_order_relaxed) ||
+		!ShmProtoWaiting(pRing, ulSide)->exchange(0))
+		return;
+
+	pRing->Waiter.pfnWake(pRing->Waiter.pContext, ulSide);
+}
+
+
+//
+//	Raises or lowers the flag telling the other side ulSide is about to
+//	sleep. Raising it is ordered before the last look at the ring.
+//
+inline void
+ShmProtoSetWaiting(
+	SHM_PROTO_RING* pRing,
+	uint32_t ulSide,
+	bool bWaiting
+)
+{
+	ShmProtoWaiting(pRing, ulSide)->exchange(bWaiting ? 1 : 0);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShmProtoSend
+//
+//	Parameters:
+//		[IN]  SHM_PROTO_RING* pRing
+//		Ring to produce into.
+//
+//		[IN]  const void* pMessage
+//		Message to send.
+//
+//		[IN]  uint32_t ulLength
+//		Length of the message, its record fits in the data area.
+//
+//	Routine Description:
+//		Copies the message into the ring, polling and then sleeping while
+//		the ring is full, and wakes the consumer if it went to sleep. The
+//		flag goes up before the last look at the ring, so a consumer that
+//		made room after that look sees it and wakes the producer. Only one
+//		thread may produce into the ring.
+//
+//	Return Value:
+//		bool.
+//		true once the message is in the ring, false if the wait failed.
+//
+//***********************************************************************************
+inline bool
+ShmProtoSend(
+	SHM_PROTO_RING* pRing,
+	const void* pMessage,
+	uint32_t ulLength
+)
+{
+	uint32_t ulSpin;
+	bool bSent;
+
+	for (;;)
+	{
+		for (ulSpin = 0; ulSpin < SHM_PROTO_SPIN_COUNT; ulSpin++)
+		{
+			if (ShmProtoTryProduce(pRing, pMessage, ulLength))
+			{
+				ShmProtoWakeIfWaiting(pRing, SHM_PROTO_CONSUMER);
+				return true;
+			}
+
+			ShmProtoPause();
+		}
+
+		ShmProtoSetWaiting(pRing, SHM_PROTO_PRODUCER, true);
+		bSent = ShmProtoTryProduce(pRing, pMessage, ulLength);
+
+		if (!bSent && !pRing->Waiter.pfnWait(pRing->Waiter.pContext, SHM_PROTO_PRODUCER, SHM_PROTO_WAIT_FOREVER))
+		{
+			ShmProtoSetWaiting(pRing, SHM_PROTO_PRODUCER, false);
+			return false;
+		}
+
+		ShmProtoSetWaiting(pRing, SHM_PROTO_PRODUCER, false);
+
+		if (bSent)
+		{
+			ShmProtoWakeIfWaiting(pRing, SHM_PROTO_CONSUMER);
+			return true;
+		}
+	}
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShmProtoReceive
+//
+//	Parameters:
+//		[IN]  SHM_PROTO_RING* pRing
+//		Ring to consume from.
+//
+//		[OUT]  void* pBuffer
+//		Receives the message, cut to ulLength bytes if longer.
+//
+//		[IN]  uint32_t ulLength
+//		Size of pBuffer.
+//
+//		[IN]  uint32_t ulTimeout
+//		Milliseconds to sleep for a message each time the ring runs dry,
+//		SHM_PROTO_WAIT_FOREVER to wait for one.
+//
+//	Routine Description:
+//		Takes the oldest message out of the ring, polling and then
+//		sleeping while the ring is empty, and wakes the producer if it
+//		went to sleep. Only one thread may consume from the ring.
+//
+//	Return Value:
+//		uint32_t.
+//		Length of the message, 0 on timeout or if the wait failed.
+//
+//***********************************************************************************
+inline uint32_t
+ShmProtoReceive(
+	SHM_PROTO_RING* pRing,
+	void* pBuffer,
+	uint32_t ulLength,
+	uint32_t ulTimeout
+)
+{
+	uint32_t ulSpin, ulMessageLength;
+	bool bReceived;
+
+	for (;;)
+	{
+		for (ulSpin = 0; ulSpin < SHM_PROTO_SPIN_COUNT; ulSpin++)
+		{
+			if (ShmProtoTryConsume(pRing, pBuffer, ulLength, &ulMessageLength))
+			{
+				ShmProtoWakeIfWaiting(pRing, SHM_PROTO_PRODUCER);
+				return ulMessageLength;
+			}
+
+			ShmProtoPause();
+		}
+
+		ShmProtoSetWaiting(pRing, SHM_PROTO_CONSUMER, true);
+		bReceived = ShmProtoTryConsume(pRing, pBuffer, ulLength, &ulMessageLength);
+
+		if (!bReceived && !pRing->Waiter.pfnWait(pRing->Waiter.pContext, SHM_PROTO_CONSUMER, ulTimeout))
+		{
+			ShmProtoSetWaiting(pRing, SHM_PROTO_CONSUMER, false);
+			return 0;
+		}
+
+		ShmProtoSetWaiting(pRing, SHM_PROTO_CONSUMER, false);
+
+		if (bReceived)
+		{
+			ShmProtoWakeIfWaiting(pRing, SHM_PROTO_PRODUCER);
+			return ulMessageLength;
+		}
+	}
+}
@@ -0,0 +1,165 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	shmring.cpp																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the user mode side of the 6Fings shared ring.			*
+* 	It maps the ring the driver allocated and runs the protocol of				*
+* 	shmproto.h on it, sleeping and waking in the driver.						*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <Windows.h>
+#include <winioctl.h>
+#include <tchar.h>
+#include <stddef.h>
+#include <string.h>
+#include "6fingsioctl.h"
+#include "shmring.h"
+
+
+//
+//	shmproto.h describes the ring the driver maps in its own types.
+//
+static_assert(sizeof(SHM_PROTO_HEADER) == sizeof(FINGS_SHARED_RING), "the headers agree");
+static_assert(offsetof(SHM_PROTO_HEADER, llHead) == offsetof(FINGS_SHARED_RING, llHead), "the headers agree");
+static_assert(offsetof(SHM_PROTO_HEADER, lWaiting) == offsetof(FINGS_SHARED_RING, lWaiting), "the headers agree");
+static_assert(offsetof(SHM_PROTO_HEADER, ulDataOffset) == offsetof(FINGS_SHARED_RING, ulDataOffset), "the headers agree");
+static_assert(SHM_PROTO_CONSUMER == FINGS_RING_CONSUMER && SHM_PROTO_PRODUCER == FINGS_RING_PRODUCER, "the sides agree");
+static_assert(SHM_PROTO_ALIGNMENT == FINGS_SHARED_RING_ALIGNMENT && SHM_PROTO_WRAP == FINGS_SHARED_RING_WRAP, "the records agree");
+static_assert(SHM_PROTO_WAIT_FOREVER == INFINITE, "the timeouts agree");
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Sleeps in the driver until the other side wakes ulSide. Returns false
+//	on timeout or error. A wait an APC ended early looks like a wake, the
+//	protocol checks the ring again anyway.
+//
+static bool
+WaitInDriver(
+	void* pContext,
+	uint32_t ulSide,
+	uint32_t ulTimeout
+)
+{
+	FINGS_RING_WAIT_INPUT Input = { ulSide, ulTimeout };
+	DWORD dwReturn;
+
+	if (DeviceIoControl((HANDLE)pContext, IOCTL_6FINGS_RING_WAIT, &Input, sizeof(Input), NULL, 0, &dwReturn, NULL))
+		return true;
+
+	return GetLastError() == ERROR_RETRY;
+}
+
+
+//
+//	Wakes ulSide through the driver.
+//
+static void
+WakeInDriver(
+	void* pContext,
+	uint32_t ulSide
+)
+{
+	FINGS_RING_WAKE_INPUT Input = { ulSide, 0 };
+	DWORD dwReturn;
+
+	DeviceIoControl((HANDLE)pContext, IOCTL_6FINGS_RING_WAKE, &Input, sizeof(Input), NULL, 0, &dwReturn, NULL);
+}
+
+
+BOOL
+ShmRingOpen(
+	SHM_RING* pShmRing
+)
+{
+	FINGS_MAP_RING_OUTPUT Output;
+	SHM_PROTO_WAITER Waiter;
+	DWORD dwReturn;
+
+	memset(pShmRing, 0, sizeof(*pShmRing));
+
+	pShmRing->hDevice = CreateFile(
+							_T("\\\\.\\6FingsUsr"),
+							GENERIC_READ | GENERIC_WRITE,
+							FILE_SHARE_READ | FILE_SHARE_WRITE,
+							NULL,
+							OPEN_EXISTING,
+							0,
+							NULL
+						);
+
+	if (pShmRing->hDevice == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	if (!DeviceIoControl(pShmRing->hDevice, IOCTL_6FINGS_MAP_RING, NULL, 0, &Output, sizeof(Output), &dwReturn, NULL))
+	{
+		CloseHandle(pShmRing->hDevice);
+		pShmRing->hDevice = INVALID_HANDLE_VALUE;
+		return FALSE;
+	}
+
+	Waiter.pfnWait = WaitInDriver;
+	Waiter.pfnWake = WakeInDriver;
+	Waiter.pContext = pShmRing->hDevice;
+
+	ShmProtoAttach(&pShmRing->Ring, (void*)(ULONG_PTR)Output.ullAddress, &Waiter);
+
+	return TRUE;
+}
+
+
+void
+ShmRingClose(
+	SHM_RING* pShmRing
+)
+{
+	if (pShmRing->hDevice != INVALID_HANDLE_VALUE)
+		CloseHandle(pShmRing->hDevice);
+
+	memset(pShmRing, 0, sizeof(*pShmRing));
+	pShmRing->hDevice = INVALID_HANDLE_VALUE;
+}
+
+
+BOOL
+ShmRingSend(
+	SHM_RING* pShmRing,
+	const void* pMessage,
+	ULONG ulLength
+)
+{
+	if (!ulLength || ulLength > FINGS_SHARED_RING_MAX_MESSAGE)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	return ShmProtoSend(&pShmRing->Ring, pMessage, ulLength);
+}
+
+
+ULONG
+ShmRingReceive(
+	SHM_RING* pShmRing,
+	void* pBuffer,
+	ULONG ulLength,
+	DWORD dwTimeout
+)
+{
+	return ShmProtoReceive(&pShmRing->Ring, pBuffer, ulLength, dwTimeout);
+}
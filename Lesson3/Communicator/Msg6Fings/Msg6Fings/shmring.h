@@ -0,0 +1,151 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	shmring.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the user mode side of the 6Fings shared ring.			*
+* 	One producer and one consumer, usually in different processes,				*
+* 	exchange messages through the pages the driver maps into both.				*
+* 	The driver is only called to map the ring and to sleep or wake,				*
+* 	the protocol itself is in shmproto.h.										*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+//
+//	Include <Windows.h> and "6fingsioctl.h" first.
+//
+#include "shmproto.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef struct _SHM_RING
+{
+	HANDLE hDevice;
+	SHM_PROTO_RING Ring;
+
+} SHM_RING;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		ShmRingOpen
+//
+//	Parameters:
+//		[OUT]  SHM_RING* pShmRing
+//		Receives the handle and the mapping.
+//
+//	Routine Description:
+//		Opens the device and maps the shared ring into the process.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE on success, else FALSE and GetLastError tells why.
+//
+//***********************************************************************************
+BOOL
+ShmRingOpen(
+	SHM_RING* pShmRing
+);
+
+//***********************************************************************************
+//	Function:
+//		ShmRingClose
+//
+//	Parameters:
+//		[IN OUT]  SHM_RING* pShmRing
+//		Ring opened by ShmRingOpen.
+//
+//	Routine Description:
+//		Closes the handle, which also unmaps the ring.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+ShmRingClose(
+	SHM_RING* pShmRing
+);
+
+//***********************************************************************************
+//	Function:
+//		ShmRingSend
+//
+//	Parameters:
+//		[IN]  SHM_RING* pShmRing
+//		Ring to produce into.
+//
+//		[IN]  const void* pMessage
+//		Message to send.
+//
+//		[IN]  ULONG ulLength
+//		Length of the message, 1 to FINGS_SHARED_RING_MAX_MESSAGE bytes.
+//
+//	Routine Description:
+//		Copies the message into the ring, sleeping while the ring is full,
+//		and wakes the consumer if it went to sleep. Only one thread may
+//		produce into the ring.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE once the message is in the ring, FALSE on error.
+//
+//***********************************************************************************
+BOOL
+ShmRingSend(
+	SHM_RING* pShmRing,
+	const void* pMessage,
+	ULONG ulLength
+);
+
+//***********************************************************************************
+//	Function:
+//		ShmRingReceive
+//
+//	Parameters:
+//		[IN]  SHM_RING* pShmRing
+//		Ring to consume from.
+//
+//		[OUT]  void* pBuffer
+//		Receives the message, cut to ulLength bytes if longer.
+//
+//		[IN]  ULONG ulLength
+//		Size of pBuffer.
+//
+//		[IN]  DWORD dwTimeout
+//		Milliseconds to sleep for a message each time the ring runs dry,
+//		INFINITE to wait for one.
+//
+//	Routine Description:
+//		Takes the oldest message out of the ring, sleeping while the ring
+//		is empty, and wakes the producer if it went to sleep. Only one
+//		thread may consume from the ring.
+//
+//	Return Value:
+//		ULONG.
+//		Length of the message, 0 on timeout or error.
+//
+//***********************************************************************************
+ULONG
+ShmRingReceive(
+	SHM_RING* pShmRing,
+	void* pBuffer,
+	ULONG ulLength,
+	DWORD dwTimeout
+);
@@ -0,0 +1,519 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	shmringtest.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the test of the shared ring protocol between			*
+* 	two Linux processes. A producer and a consumer forked from it map			*
+* 	the same POSIX shared memory object on their own and exchange				*
+* 	numbered messages of random lengths, the consumer checks every one.			*
+* 	Sleeping and waking go through process shared semaphores kept in			*
+* 	the header page, after the ring header.										*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <vector>
+#include "shmproto.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The data area starts a page after the header, like the driver's.
+//
+#define SHMRINGTEST_DATA_OFFSET		4096
+
+//
+//	Milliseconds the consumer waits for a message before it gives up on
+//	the producer.
+//
+#define SHMRINGTEST_IDLE_TIMEOUT	10000
+
+//
+//	Milliseconds between the producer's checks that the consumer still
+//	runs while it sleeps on a full ring.
+//
+#define SHMRINGTEST_PEER_CHECK		100
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The header page, the semaphores a side sleeps on follow the header.
+//
+typedef struct _SHMRINGTEST_PAGE
+{
+	SHM_PROTO_HEADER Header;
+	sem_t Wake[2];
+
+} SHMRINGTEST_PAGE;
+
+//
+//	Context of a side's waiter. The producer knows the consumer's process
+//	and stops waiting for room once it has exited, iPeerStatus then holds
+//	how it exited.
+//
+typedef struct _SHMRINGTEST_SIDE
+{
+	SHMRINGTEST_PAGE* pPage;
+	pid_t Peer;
+	bool bPeerExited;
+	int iPeerStatus;
+
+} SHMRINGTEST_SIDE;
+
+//
+//	One run: ulMessages messages of 1 to ulMaxLength bytes through a data
+//	area of ulDataSize bytes.
+//
+typedef struct _SHMRINGTEST_PASS
+{
+	const char* pszName;
+	uint32_t ulDataSize;
+	uint32_t ulMaxLength;
+	uint32_t ulMessages;
+
+} SHMRINGTEST_PASS;
+
+
+static_assert(sizeof(SHMRINGTEST_PAGE) <= SHMRINGTEST_DATA_OFFSET, "the semaphores fit in the header page");
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The ring of the driver with short messages, the same with messages up
+//	to the largest the driver takes, which wrap and fill the ring all the
+//	time, and a ring so small that both sides keep going to sleep.
+//
+static const SHMRINGTEST_PASS g_Passes[] =
+{
+	{ "Short messages",	1024 * 1024,	256,		4000000 },
+	{ "Long messages",	1024 * 1024,	64 * 1024,	20000 },
+	{ "Tiny ring",		4096,			64,			1000000 },
+};
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Waits up to ulTimeout milliseconds for the semaphore. Returns 0 once
+//	it was taken, else the error, ETIMEDOUT on timeout.
+//
+static int
+WaitOnSemaphoreFor(
+	sem_t* pSemaphore,
+	uint32_t ulTimeout
+)
+{
+	struct timespec Deadline;
+
+	clock_gettime(CLOCK_REALTIME, &Deadline);
+	Deadline.tv_sec += ulTimeout / 1000;
+	Deadline.tv_nsec += (long)(ulTimeout % 1000) * 1000000;
+
+	if (Deadline.tv_nsec >= 1000000000)
+	{
+		Deadline.tv_sec++;
+		Deadline.tv_nsec -= 1000000000;
+	}
+
+	while (sem_timedwait(pSemaphore, &Deadline))
+	{
+		if (errno != EINTR)
+			return errno;
+	}
+
+	return 0;
+}
+
+
+//
+//	Sleeps on the semaphore of ulSide. Returns false on timeout or error,
+//	or if the side waits forever and the other process has exited.
+//
+static bool
+WaitOnSemaphore(
+	void* pContext,
+	uint32_t ulSide,
+	uint32_t ulTimeout
+)
+{
+	SHMRINGTEST_SIDE* pSide = (SHMRINGTEST_SIDE*)pContext;
+	sem_t* pSemaphore = &pSide->pPage->Wake[ulSide];
+	int iError;
+
+	if (ulTimeout != SHM_PROTO_WAIT_FOREVER)
+		return !WaitOnSemaphoreFor(pSemaphore, ulTimeout);
+
+	for (;;)
+	{
+		iError = WaitOnSemaphoreFor(pSemaphore, SHMRINGTEST_PEER_CHECK);
+
+		if (iError != ETIMEDOUT)
+			return !iError;
+
+		if (pSide->Peer && waitpid(pSide->Peer, &pSide->iPeerStatus, WNOHANG) == pSide->Peer)
+		{
+			pSide->bPeerExited = true;
+			return false;
+		}
+	}
+}
+
+
+//
+//	Wakes ulSide, a post before it sleeps ends its next wait at once.
+//
+static void
+PostSemaphore(
+	void* pContext,
+	uint32_t ulSide
+)
+{
+	SHMRINGTEST_SIDE* pSide = (SHMRINGTEST_SIDE*)pContext;
+
+	sem_post(&pSide->pPage->Wake[ulSide]);
+}
+
+
+//
+//	Spreads the bits of the message number, the length and the content
+//	of a message follow from it.
+//
+static uint32_t
+MixNumber(
+	uint32_t ulNumber
+)
+{
+	ulNumber ^= ulNumber >> 16;
+	ulNumber *= 0x7FEB352D;
+	ulNumber ^= ulNumber >> 15;
+	ulNumber *= 0x846CA68B;
+	ulNumber ^= ulNumber >> 16;
+
+	return ulNumber;
+}
+
+
+//
+//	Length of message ulNumber of the pass.
+//
+static uint32_t
+MessageLength(
+	const SHMRINGTEST_PASS* pPass,
+	uint32_t ulNumber
+)
+{
+	return 1 + MixNumber(ulNumber) % pPass->ulMaxLength;
+}
+
+
+//
+//	Fills pMessage with message ulNumber, its number first if it fits.
+//
+static void
+FillMessage(
+	uint8_t* pMessage,
+	uint32_t ulLength,
+	uint32_t ulNumber
+)
+{
+	uint32_t ulSeed = MixNumber(ulNumber);
+	uint32_t ulIndex;
+
+	for (ulIndex = 0; ulIndex < ulLength; ulIndex++)
+		pMessage[ulIndex] = (uint8_t)(ulSeed >> (8 * (ulIndex & 3))) ^ (uint8_t)(ulIndex >> 2);
+
+	if (ulLength >= sizeof(ulNumber))
+		memcpy(pMessage, &ulNumber, sizeof(ulNumber));
+}
+
+
+//
+//	The consumer, in the child. Maps the object on its own and checks
+//	every message against the one the producer was to send.
+//
+static int
+RunConsumer(
+	const char* pszName,
+	const SHMRINGTEST_PASS* pPass
+)
+{
+	std::vector<uint8_t> Buffer(pPass->ulMaxLength);
+	std::vector<uint8_t> Expected(pPass->ulMaxLength);
+	SHMRINGTEST_SIDE Side = {};
+	SHM_PROTO_WAITER Waiter;
+	SHM_PROTO_RING Ring;
+	uint32_t ulNumber, ulLength;
+	void* pMapping;
+	int iFile;
+
+	iFile = shm_open(pszName, O_RDWR, 0);
+
+	if (iFile < 0)
+	{
+		perror("Consumer shm_open");
+		return 1;
+	}
+
+	pMapping = mmap(NULL, SHMRINGTEST_DATA_OFFSET + pPass->ulDataSize, PROT_READ | PROT_WRITE, MAP_SHARED, iFile, 0);
+	close(iFile);
+
+	if (pMapping == MAP_FAILED)
+	{
+		perror("Consumer mmap");
+		return 1;
+	}
+
+	Side.pPage = (SHMRINGTEST_PAGE*)pMapping;
+
+	Waiter.pfnWait = WaitOnSemaphore;
+	Waiter.pfnWake = PostSemaphore;
+	Waiter.pContext = &Side;
+
+	ShmProtoAttach(&Ring, pMapping, &Waiter);
+
+	for (ulNumber = 0; ulNumber < pPass->ulMessages; ulNumber++)
+	{
+		ulLength = ShmProtoReceive(&Ring, Buffer.data(), pPass->ulMaxLength, SHMRINGTEST_IDLE_TIMEOUT);
+
+		if (!ulLength)
+		{
+			fprintf(stderr, "%s: nothing came after %u message(s)\n", pPass->pszName, ulNumber);
+			return 1;
+		}
+
+		FillMessage(Expected.data(), MessageLength(pPass, ulNumber), ulNumber);
+
+		if (ulLength != MessageLength(pPass, ulNumber) || memcmp(Buffer.data(), Expected.data(), ulLength))
+		{
+			fprintf(stderr, "%s: message %u of %u bytes did not come through unchanged, %u bytes came\n",
+				pPass->pszName, ulNumber, MessageLength(pPass, ulNumber), ulLength);
+			return 1;
+		}
+	}
+
+	munmap(pMapping, SHMRINGTEST_DATA_OFFSET + pPass->ulDataSize);
+
+	return 0;
+}
+
+
+//
+//	Creates the object, forks the consumer and produces into the ring.
+//	Prints the rate measured until the consumer checked the last message.
+//
+static bool
+RunPass(
+	const SHMRINGTEST_PASS* pPass
+)
+{
+	std::vector<uint8_t> Message(pPass->ulMaxLength);
+	std::chrono::steady_clock::time_point Start;
+	SHMRINGTEST_SIDE Side = {};
+	SHMRINGTEST_PAGE* pPage;
+	SHM_PROTO_WAITER Waiter;
+	SHM_PROTO_RING Ring;
+	uint64_t ullBytes = 0;
+	uint32_t ulNumber, ulLength;
+	double dSeconds;
+	bool bSent = true;
+	char szName[64];
+	size_t cbMapping = SHMRINGTEST_DATA_OFFSET + pPass->ulDataSize;
+	pid_t Consumer;
+	int iFile;
+
+	snprintf(szName, sizeof(szName), "/6fings-shmringtest-%d", (int)getpid());
+
+	iFile = shm_open(szName, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (iFile < 0)
+	{
+		perror("shm_open");
+		return false;
+	}
+
+	if (ftruncate(iFile, (off_t)cbMapping))
+	{
+		perror("ftruncate");
+		close(iFile);
+		shm_unlink(szName);
+		return false;
+	}
+
+	pPage = (SHMRINGTEST_PAGE*)mmap(NULL, cbMapping, PROT_READ | PROT_WRITE, MAP_SHARED, iFile, 0);
+	close(iFile);
+
+	if (pPage == MAP_FAILED)
+	{
+		perror("mmap");
+		shm_unlink(szName);
+		return false;
+	}
+
+	//
+	//	The object starts out zero, the driver sets the same fields.
+	//
+	pPage->Header.ulDataSize = pPass->ulDataSize;
+	pPage->Header.ulDataOffset = SHMRINGTEST_DATA_OFFSET;
+	sem_init(&pPage->Wake[SHM_PROTO_CONSUMER], 1, 0);
+	sem_init(&pPage->Wake[SHM_PROTO_PRODUCER], 1, 0);
+
+	Start = std::chrono::steady_clock::now();
+
+	Consumer = fork();
+
+	if (Consumer < 0)
+	{
+		perror("fork");
+		bSent = false;
+	}
+	else if (!Consumer)
+	{
+		//
+		//	The consumer maps the object again rather than using the copy
+		//	of the parent's mapping, the way a second process would.
+		//
+		munmap(pPage, cbMapping);
+		_exit(RunConsumer(szName, pPass));
+	}
+	else
+	{
+		Side.pPage = pPage;
+		Side.Peer = Consumer;
+
+		Waiter.pfnWait = WaitOnSemaphore;
+		Waiter.pfnWake = PostSemaphore;
+		Waiter.pContext = &Side;
+
+		ShmProtoAttach(&Ring, pPage, &Waiter);
+
+		for (ulNumber = 0; ulNumber < pPass->ulMessages && bSent; ulNumber++)
+		{
+			ulLength = MessageLength(pPass, ulNumber);
+			FillMessage(Message.data(), ulLength, ulNumber);
+			bSent = ShmProtoSend(&Ring, Message.data(), ulLength);
+			ullBytes += ulLength;
+		}
+
+		//
+		//	A consumer that found a bad message has exited already.
+		//
+		if (!bSent && !Side.bPeerExited)
+		{
+			fprintf(stderr, "%s: sending message %u failed\n", pPass->pszName, ulNumber - 1);
+			kill(Consumer, SIGKILL);
+		}
+
+		while (!Side.bPeerExited && waitpid(Consumer, &Side.iPeerStatus, 0) < 0 && errno == EINTR)
+			;
+
+		bSent = bSent && WIFEXITED(Side.iPeerStatus) && !WEXITSTATUS(Side.iPeerStatus);
+	}
+
+	dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+	if (bSent)
+	{
+		printf("%-16s%10u%10u%12u%14.0f%10.0f MB/s\n",
+			pPass->pszName,
+			pPass->ulDataSize,
+			pPass->ulMaxLength,
+			pPass->ulMessages,
+			(double)pPass->ulMessages / dSeconds,
+			(double)ullBytes / dSeconds / (1024 * 1024));
+	}
+
+	sem_destroy(&pPage->Wake[SHM_PROTO_CONSUMER]);
+	sem_destroy(&pPage->Wake[SHM_PROTO_PRODUCER]);
+	munmap(pPage, cbMapping);
+	shm_unlink(szName);
+
+	return bSent;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunShmRingTest
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Arguments, without the program name. None are used.
+//
+//	Routine Description:
+//		Runs every pass of g_Passes, each between a new pair of processes
+//		over a new shared memory object, and prints their rates.
+//
+//	Return Value:
+//		int.
+//		0 if every message of every pass came through unchanged and in
+//		order, else 1.
+//
+//***********************************************************************************
+int
+RunShmRingTest(
+	int argc,
+	char* argv[]
+)
+{
+	size_t Pass;
+
+	(void)argc;
+	(void)argv;
+
+	printf("%-16s%10s%10s%12s%14s%15s\n", "Pass", "Ring", "Longest", "Messages", "Msgs/s", "Throughput");
+
+	for (Pass = 0; Pass < sizeof(g_Passes) / sizeof(g_Passes[0]); Pass++)
+	{
+		if (!RunPass(&g_Passes[Pass]))
+			return 1;
+	}
+
+	return 0;
+}
+
+
+#ifdef SHMRINGTEST_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunShmRingTest(argc - 1, argv + 1);
+}
+#endif
@@ -0,0 +1,232 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	strscanbench.cpp															*
+*																				*
+* Abstract:																		*
+* 	This file implements the benchmark of the search for the NULL				*
+* 	character the driver runs on every message written.							*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "strscan.h"
+#include "strscanbench.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Every size is scanned until at least this many bytes went through,
+//	so small buffers are timed over many calls.
+//
+#define SCANBENCH_BYTES_PER_SIZE	(256 * 1024 * 1024)
+
+//
+//	Sizes go from 16 bytes to 64 MB, four times larger each step.
+//
+#define SCANBENCH_FIRST_SIZE		16
+#define SCANBENCH_LAST_SIZE			(64 * 1024 * 1024)
+
+//
+//	Lengths and alignments every NULL position is checked at, the long
+//	buffer is large enough for the AVX2 loop.
+//
+#define SCANBENCH_CHECK_LENGTH		256
+#define SCANBENCH_CHECK_LONG		(2 * 16 * 1024 + 200)
+#define SCANBENCH_ALIGNMENT			64
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Results go here so the timed calls cannot be left out.
+//
+static volatile size_t g_Sink;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	The loop IsStringTerminated ran before FindNullCharacter, one byte
+//	and one branch at a time.
+//
+static size_t
+FindNullCharacterBytes(
+	const char* pString,
+	size_t Length
+)
+{
+	bool bFound = false;
+	size_t Index = 0;
+
+	while (Index < Length && !bFound)
+	{
+		if (pString[Index] == '\0')
+			bFound = true;
+		else
+			Index++;
+	}
+
+	return Index;
+}
+
+
+//
+//	Compares both searches with the NULL at every position of buffers of
+//	Length bytes starting at every alignment, and with no NULL at all.
+//	Past SCANBENCH_CHECK_LENGTH only the positions near either end and
+//	some in between are tried, the byte loop is slow.
+//
+static bool
+CheckLength(
+	char* pBuffer,
+	size_t Length
+)
+{
+	size_t Offset, Position;
+	char* pString;
+
+	for (Offset = 0; Offset < SCANBENCH_ALIGNMENT; Offset++)
+	{
+		pString = pBuffer + Offset;
+		memset(pString, 'x', Length);
+
+		for (Position = 0; Position <= Length; Position++)
+		{
+			if (Position > SCANBENCH_CHECK_LENGTH && Length - Position > SCANBENCH_CHECK_LENGTH && Position % 97)
+				continue;
+
+			if (Position < Length)
+				pString[Position] = '\0';
+
+			if (FindNullCharacter(pString, Length) != FindNullCharacterBytes(pString, Length))
+			{
+				fprintf(stderr, "Buffer of %zu bytes at offset %zu: NULL at %zu found at %zu\n",
+					Length, Offset, Position, FindNullCharacter(pString, Length));
+				return false;
+			}
+
+			if (Position < Length)
+				pString[Position] = 'x';
+		}
+	}
+
+	return true;
+}
+
+
+//
+//	Seconds the search takes to go through SCANBENCH_BYTES_PER_SIZE bytes
+//	in calls on Length bytes, also returns the bytes it went through.
+//
+static double
+TimeSearch(
+	size_t (*pfnSearch)(const char*, size_t),
+	const char* pString,
+	size_t Length,
+	size_t* pcbThrough
+)
+{
+	std::chrono::steady_clock::time_point Start;
+	size_t cbThrough = 0;
+
+	Start = std::chrono::steady_clock::now();
+
+	do
+	{
+		g_Sink = pfnSearch(pString, Length);
+		cbThrough += Length;
+
+	} while (cbThrough < SCANBENCH_BYTES_PER_SIZE);
+
+	*pcbThrough = cbThrough;
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+
+int
+RunScanBenchmark(
+	int argc,
+	char* argv[]
+)
+{
+	std::vector<char> Buffer(SCANBENCH_LAST_SIZE + SCANBENCH_ALIGNMENT);
+	double dBytesSeconds, dVectorSeconds;
+	size_t Length, cbBytes, cbVector;
+	char* pString;
+
+	(void)argc;
+	(void)argv;
+
+	//
+	//	Messages come at any alignment, the tests start at each one.
+	//
+	pString = Buffer.data() + (SCANBENCH_ALIGNMENT - (size_t)Buffer.data() % SCANBENCH_ALIGNMENT) % SCANBENCH_ALIGNMENT;
+
+	for (Length = 0; Length <= SCANBENCH_CHECK_LENGTH; Length++)
+	{
+		if (!CheckLength(pString, Length))
+			return 1;
+	}
+
+	if (!CheckLength(pString, SCANBENCH_CHECK_LONG))
+		return 1;
+
+	//
+	//	A message ends with its NULL, so the whole buffer is always searched.
+	//
+	memset(pString, 'x', SCANBENCH_LAST_SIZE);
+
+	printf("Buffers ending with the NULL character, %u MB searched per size.\n", SCANBENCH_BYTES_PER_SIZE / (1024 * 1024));
+	printf("%10s%16s%16s%10s\n", "Size", "Byte loop", "Vector", "Speedup");
+
+	for (Length = SCANBENCH_FIRST_SIZE; Length <= SCANBENCH_LAST_SIZE; Length *= 4)
+	{
+		pString[Length - 1] = '\0';
+
+		dBytesSeconds = TimeSearch(FindNullCharacterBytes, pString, Length, &cbBytes);
+		dVectorSeconds = TimeSearch(FindNullCharacter, pString, Length, &cbVector);
+
+		pString[Length - 1] = 'x';
+
+		printf("%10zu%11.2f GB/s%11.2f GB/s%9.1fx\n",
+			Length,
+			(double)cbBytes / dBytesSeconds / (1024 * 1024 * 1024),
+			(double)cbVector / dVectorSeconds / (1024 * 1024 * 1024),
+			((double)cbVector / dVectorSeconds) / ((double)cbBytes / dBytesSeconds));
+	}
+
+	return 0;
+}
+
+
+#ifdef STRSCANBENCH_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunScanBenchmark(argc - 1, argv + 1);
+}
+#endif
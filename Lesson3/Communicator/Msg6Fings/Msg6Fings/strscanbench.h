@@ -0,0 +1,56 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	strscanbench.h																*
+*																				*
+* Abstract:																		*
+* 	This file declares the benchmark of the search for the NULL					*
+* 	character the driver runs on every message written. It only					*
+* 	depends on the C++ standard library and the driver's strscan.c,				*
+* 	on Linux it builds on its own:												*
+*																				*
+* 	g++ -O2 -DSTRSCANBENCH_MAIN -I../../../Driver/6Fings/6Fings					*
+* 		strscanbench.cpp -x c ../../../Driver/6Fings/6Fings/strscan.c			*
+* 		-o 6fings-scanbench														*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		RunScanBenchmark
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Arguments, without the program name or the "scan-bench" command.
+//		None are used.
+//
+//	Routine Description:
+//		Times FindNullCharacter against the byte loop IsStringTerminated
+//		used before, on buffers of every size from 16 bytes to 64 MB
+//		ending with the NULL character, the case of every message. Checks
+//		first that both find the same NULL at every offset and alignment
+//		of a small buffer.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if FindNullCharacter and the byte loop disagreed.
+//
+//***********************************************************************************
+int
+RunScanBenchmark(
+	int argc,
+	char* argv[]
+);
@@ -0,0 +1,254 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	tracedecode.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the decoder of the driver's binary trace.				*
+* 	Dumps are little endian, as the driver wrote them.							*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <stdint.h>
+typedef uint16_t USHORT;
+typedef uint32_t ULONG;
+typedef uint64_t ULONG64;
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "6fingstrace.h"
+#include "tracedecode.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Expands FINGS_TRACE_FORMATS into the table below, indexed by format ID.
+//
+#define TRACE_FORMAT_STRING(Id, Format)	Format,
+#define TRACE_FORMAT_NAME(Id, Format)	#Id,
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef struct _DECODED_RECORD
+{
+	ULONG ulCpu;
+	FINGS_TRACE_RECORD Record;
+
+} DECODED_RECORD;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static const char* const g_pszTraceFormats[] = { FINGS_TRACE_FORMATS(TRACE_FORMAT_STRING) };
+static const char* const g_pszTraceNames[] = { FINGS_TRACE_FORMATS(TRACE_FORMAT_NAME) };
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static void
+PrintRecord(
+	const DECODED_RECORD* pDecoded,
+	FILE* pOutput
+)
+{
+	const FINGS_TRACE_RECORD* pRecord = &pDecoded->Record;
+	const ULONG* pulArguments = pRecord->ulArguments;
+
+	fprintf(pOutput, "%llu.%07llu [%u] ",
+		(unsigned long long)(pRecord->ullTime / 10000000),
+		(unsigned long long)(pRecord->ullTime % 10000000),
+		(unsigned int)pDecoded->ulCpu);
+
+	//
+	//	A newer driver may know formats this table does not.
+	//
+	if (pRecord->usFormat >= FINGS_TRACE_FORMAT_COUNT)
+	{
+		fprintf(pOutput, "unknown format %u (%u arguments)\n", pRecord->usFormat, pRecord->usArgumentCount);
+		return;
+	}
+
+	fprintf(pOutput, "%s: ", g_pszTraceNames[pRecord->usFormat]);
+	fprintf(pOutput, g_pszTraceFormats[pRecord->usFormat],
+		(unsigned int)pulArguments[0],
+		(unsigned int)pulArguments[1],
+		(unsigned int)pulArguments[2],
+		(unsigned int)pulArguments[3]);
+	fputc('\n', pOutput);
+}
+
+
+int
+DecodeTrace(
+	const unsigned char* pDump,
+	size_t cbDump,
+	FILE* pOutput
+)
+{
+	FINGS_TRACE_DUMP Dump;
+	FINGS_TRACE_CPU Cpu;
+	DECODED_RECORD Decoded;
+	std::vector<DECODED_RECORD> Records;
+	size_t cbOffset, cbEnd, cbRecord;
+	ULONG ulCpu;
+
+	if (cbDump < sizeof(Dump))
+	{
+		fprintf(stderr, "The dump is too short\n");
+		return 1;
+	}
+
+	memcpy(&Dump, pDump, sizeof(Dump));
+
+	if (Dump.ulMagic != FINGS_TRACE_MAGIC || Dump.ulVersion != FINGS_TRACE_VERSION)
+	{
+		fprintf(stderr, "Not a version %u trace dump\n", FINGS_TRACE_VERSION);
+		return 1;
+	}
+
+	if (Dump.ulFormatCount != FINGS_TRACE_FORMAT_COUNT)
+		fprintf(stderr, "The driver has %u trace formats, this decoder %u\n", (unsigned int)Dump.ulFormatCount, FINGS_TRACE_FORMAT_COUNT);
+
+	cbOffset = sizeof(Dump);
+
+	for (ulCpu = 0; ulCpu < Dump.ulCpuCount; ulCpu++)
+	{
+		if (cbDump - cbOffset < sizeof(Cpu))
+		{
+			fprintf(stderr, "The dump is cut short\n");
+			return 1;
+		}
+
+		memcpy(&Cpu, pDump + cbOffset, sizeof(Cpu));
+		cbOffset += sizeof(Cpu);
+
+		if (cbDump - cbOffset < Cpu.ulLength)
+		{
+			fprintf(stderr, "The dump is cut short\n");
+			return 1;
+		}
+
+		if (Cpu.ulOverwritten)
+			fprintf(pOutput, "# Processor %u overwrote %u records\n", (unsigned int)Cpu.ulCpu, (unsigned int)Cpu.ulOverwritten);
+
+		cbEnd = cbOffset + Cpu.ulLength;
+
+		while (cbOffset < cbEnd)
+		{
+			memset(&Decoded, 0, sizeof(Decoded));
+			Decoded.ulCpu = Cpu.ulCpu;
+
+			if (cbEnd - cbOffset < FINGS_TRACE_RECORD_LENGTH(0))
+				break;
+
+			memcpy(&Decoded.Record, pDump + cbOffset, FINGS_TRACE_RECORD_LENGTH(0));
+
+			if (Decoded.Record.usArgumentCount > FINGS_TRACE_MAX_ARGUMENTS)
+				break;
+
+			cbRecord = FINGS_TRACE_RECORD_LENGTH(Decoded.Record.usArgumentCount);
+
+			if (cbEnd - cbOffset < cbRecord)
+				break;
+
+			memcpy(&Decoded.Record, pDump + cbOffset, cbRecord);
+			cbOffset += cbRecord;
+
+			Records.push_back(Decoded);
+		}
+
+		if (cbOffset != cbEnd)
+		{
+			fprintf(stderr, "The records of processor %u are corrupt\n", (unsigned int)Cpu.ulCpu);
+			cbOffset = cbEnd;
+		}
+	}
+
+	//
+	//	Each processor's records are in order already, the merge keeps
+	//	that order for records with the same time.
+	//
+	std::stable_sort(Records.begin(), Records.end(),
+		[](const DECODED_RECORD& First, const DECODED_RECORD& Second)
+		{
+			return First.Record.ullTime < Second.Record.ullTime;
+		});
+
+	for (const DECODED_RECORD& Record : Records)
+		PrintRecord(&Record, pOutput);
+
+	return 0;
+}
+
+
+int
+RunTraceDecoder(
+	int argc,
+	char* argv[]
+)
+{
+	std::vector<unsigned char> Dump;
+	unsigned char Buffer[64 * 1024];
+	size_t cbRead;
+	FILE* pInput;
+
+	if (argc < 1)
+	{
+		fprintf(stderr, "Usage: trace-decode <dump file>\n");
+		return 1;
+	}
+
+#ifdef _WIN32
+	if (fopen_s(&pInput, argv[0], "rb"))
+		pInput = NULL;
+#else
+	pInput = fopen(argv[0], "rb");
+#endif
+
+	if (!pInput)
+	{
+		fprintf(stderr, "Cannot open %s\n", argv[0]);
+		return 1;
+	}
+
+	while ((cbRead = fread(Buffer, 1, sizeof(Buffer), pInput)) > 0)
+		Dump.insert(Dump.end(), Buffer, Buffer + cbRead);
+
+	fclose(pInput);
+
+	return DecodeTrace(Dump.data(), Dump.size(), stdout);
+}
+
+
+#ifdef TRACEDECODE_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunTraceDecoder(argc - 1, argv + 1);
+}
+#endif
@@ -0,0 +1,89 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	tracedecode.h																*
+*																				*
+* Abstract:																		*
+* 	This file declares the decoder of the driver's binary trace. It			*
+* 	only depends on the C++ standard library and 6fingstrace.h, so a			*
+* 	dump taken on Windows can be decoded anywhere. On Linux it builds			*
+* 	on its own:																	*
+*																				*
+* 	g++ -O2 -DTRACEDECODE_MAIN -I../../../Driver/6Fings/6Fings					*
+* 		tracedecode.cpp -o 6fings-tracedecode									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stddef.h>
+#include <stdio.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		DecodeTrace
+//
+//	Parameters:
+//		[IN]  const unsigned char* pDump
+//		Dump returned by IOCTL_6FINGS_DUMP_TRACE.
+//
+//		[IN]  size_t cbDump
+//		Length of the dump.
+//
+//		[IN]  FILE* pOutput
+//		Stream receiving the text.
+//
+//	Routine Description:
+//		Prints the records of every processor merged in time order, one
+//		line each, formatted with the format table of 6fingstrace.h.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the dump is not a trace dump or is cut short.
+//
+//***********************************************************************************
+int
+DecodeTrace(
+	const unsigned char* pDump,
+	size_t cbDump,
+	FILE* pOutput
+);
+
+
+//***********************************************************************************
+//	Function:
+//		RunTraceDecoder
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Arguments, without the program name or the "trace-decode" command.
+//
+//	Routine Description:
+//		Reads the dump saved in the file named by the first argument and
+//		decodes it to stdout.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the file could not be read or decoded.
+//
+//***********************************************************************************
+int
+RunTraceDecoder(
+	int argc,
+	char* argv[]
+);
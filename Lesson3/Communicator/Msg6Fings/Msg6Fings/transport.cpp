@@ -0,0 +1,404 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	transport.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the device and loopback transports.					*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+#include <tchar.h>
+#include "6fingsioctl.h"
+#else
+#include <strings.h>
+#endif
+#include <string.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "transport.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#ifndef _WIN32
+#define _stricmp	strcasecmp
+#endif
+
+//
+//	Same depth as the ring in the driver (RING_DEFAULT_CAPACITY).
+//
+#define LOOPBACK_CAPACITY	4096
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The one queue every loopback connection shares.
+//
+typedef struct _LOOPBACK_STORE
+{
+	std::mutex Lock;
+	std::deque<std::vector<char>> Messages;
+
+} LOOPBACK_STORE;
+
+#ifdef _WIN32
+
+typedef struct _DEVICE_CONNECTION
+{
+	HANDLE hDevice;
+	const IO_METHOD* pMethod;
+
+} DEVICE_CONNECTION;
+
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static LOOPBACK_STORE g_LoopbackStore;
+
+#ifdef _WIN32
+
+const IO_METHOD g_IoMethods[IO_METHOD_COUNT] =
+{
+	{ "File",		0,								0 },
+	{ "Buffered",	IOCTL_6FINGS_WRITE_BUFFERED,	IOCTL_6FINGS_READ_BUFFERED },
+	{ "Direct",		IOCTL_6FINGS_WRITE_DIRECT,		IOCTL_6FINGS_READ_DIRECT },
+	{ "Neither",	IOCTL_6FINGS_WRITE_NEITHER,		IOCTL_6FINGS_READ_NEITHER },
+};
+
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static void*
+LoopbackOpen(
+	const char* pszOptions
+)
+{
+	(void)pszOptions;
+
+	return &g_LoopbackStore;
+}
+
+
+static bool
+LoopbackSend(
+	void* pConnection,
+	const void* pMessage,
+	uint32_t ulLength
+)
+{
+	LOOPBACK_STORE* pStore = (LOOPBACK_STORE*)pConnection;
+	std::vector<char> Message((const char*)pMessage, (const char*)pMessage + ulLength);
+	std::lock_guard<std::mutex> Guard(pStore->Lock);
+
+	if (pStore->Messages.size() >= LOOPBACK_CAPACITY)
+		return false;
+
+	pStore->Messages.push_back(std::move(Message));
+
+	return true;
+}
+
+
+static uint32_t
+LoopbackReceive(
+	void* pConnection,
+	void* pBuffer,
+	uint32_t ulLength
+)
+{
+	LOOPBACK_STORE* pStore = (LOOPBACK_STORE*)pConnection;
+	std::vector<char> Message;
+
+	{
+		std::lock_guard<std::mutex> Guard(pStore->Lock);
+
+		//
+		//	Like the driver, a message that does not fit stays queued.
+		//
+		if (pStore->Messages.empty() || pStore->Messages.front().size() > ulLength)
+			return 0;
+
+		Message = std::move(pStore->Messages.front());
+		pStore->Messages.pop_front();
+	}
+
+	memcpy(pBuffer, Message.data(), Message.size());
+
+	return (uint32_t)Message.size();
+}
+
+
+static void
+LoopbackClose(
+	void* pConnection
+)
+{
+	(void)pConnection;
+}
+
+
+const TRANSPORT g_LoopbackTransport =
+{
+	"loopback",
+	LoopbackOpen,
+	LoopbackSend,
+	LoopbackReceive,
+	LoopbackClose,
+};
+
+
+#ifdef _WIN32
+
+//***********************************************************************************
+//	Function:
+//		SendToDevice
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  const IO_METHOD* pMethod
+//		Transfer method to use.
+//
+//		[IN]  PVOID pMessage
+//		NULL terminated message.
+//
+//		[IN]  DWORD dwLength
+//		Length of the message including NULL character.
+//
+//	Routine Description:
+//		Writes one message with the given method. METHOD_IN_DIRECT codes
+//		take the message as the output buffer so it is locked, not copied.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE if the driver accepted the message.
+//
+//***********************************************************************************
+BOOL
+SendToDevice(
+	HANDLE hDevice,
+	const IO_METHOD* pMethod,
+	PVOID pMessage,
+	DWORD dwLength
+)
+{
+	DWORD dwReturn;
+
+	if (!pMethod->dwWriteCode)
+		return WriteFile(hDevice, pMessage, dwLength, &dwReturn, NULL);
+
+	if (METHOD_FROM_CTL_CODE(pMethod->dwWriteCode) == METHOD_IN_DIRECT)
+		return DeviceIoControl(hDevice, pMethod->dwWriteCode, NULL, 0, pMessage, dwLength, &dwReturn, NULL);
+
+	return DeviceIoControl(hDevice, pMethod->dwWriteCode, pMessage, dwLength, NULL, 0, &dwReturn, NULL);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ReceiveFromDevice
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  const IO_METHOD* pMethod
+//		Transfer method to use.
+//
+//		[OUT]  PVOID pBuffer
+//		Buffer receiving the messages.
+//
+//		[IN]  DWORD dwLength
+//		Length of the buffer.
+//
+//	Routine Description:
+//		Reads the oldest messages with the given method, packed as
+//		FINGS_READ_RECORDs, as many as fit in the buffer.
+//
+//	Return Value:
+//		DWORD.
+//		Number of bytes read, 0 on failure or if there was no message.
+//
+//***********************************************************************************
+DWORD
+ReceiveFromDevice(
+	HANDLE hDevice,
+	const IO_METHOD* pMethod,
+	PVOID pBuffer,
+	DWORD dwLength
+)
+{
+	DWORD dwReturn = 0;
+	BOOL bRet;
+
+	if (!pMethod->dwReadCode)
+		bRet = ReadFile(hDevice, pBuffer, dwLength, &dwReturn, NULL);
+	else
+		bRet = DeviceIoControl(hDevice, pMethod->dwReadCode, NULL, 0, pBuffer, dwLength, &dwReturn, NULL);
+
+	return bRet ? dwReturn : 0;
+}
+
+
+static void*
+DeviceOpen(
+	const char* pszOptions
+)
+{
+	DEVICE_CONNECTION* pConnection;
+	const IO_METHOD* pMethod = &g_IoMethods[0];
+	unsigned int uiIndex;
+
+	if (pszOptions)
+	{
+		for (pMethod = NULL, uiIndex = 0; uiIndex < IO_METHOD_COUNT; uiIndex++)
+		{
+			if (_stricmp(pszOptions, g_IoMethods[uiIndex].pszName) == 0)
+				pMethod = &g_IoMethods[uiIndex];
+		}
+
+		if (!pMethod)
+			return NULL;
+	}
+
+	pConnection = new DEVICE_CONNECTION;
+	pConnection->pMethod = pMethod;
+
+	//
+	//	Every load thread opens its own handle, synchronous I/O on a shared
+	//	handle would be serialized by the I/O manager.
+	//
+	pConnection->hDevice = CreateFile(
+								_T("\\\\.\\6FingsUsr"),
+								GENERIC_READ | GENERIC_WRITE,
+								FILE_SHARE_READ | FILE_SHARE_WRITE,
+								NULL,
+								OPEN_EXISTING,
+								0,
+								NULL
+							);
+
+	if (pConnection->hDevice == INVALID_HANDLE_VALUE)
+	{
+		delete pConnection;
+		return NULL;
+	}
+
+	return pConnection;
+}
+
+
+static bool
+DeviceSend(
+	void* pConnection,
+	const void* pMessage,
+	uint32_t ulLength
+)
+{
+	DEVICE_CONNECTION* pDevice = (DEVICE_CONNECTION*)pConnection;
+
+	return SendToDevice(pDevice->hDevice, pDevice->pMethod, (PVOID)pMessage, ulLength) != FALSE;
+}
+
+
+static uint32_t
+DeviceReceive(
+	void* pConnection,
+	void* pBuffer,
+	uint32_t ulLength
+)
+{
+	DEVICE_CONNECTION* pDevice = (DEVICE_CONNECTION*)pConnection;
+
+	return ReceiveFromDevice(pDevice->hDevice, pDevice->pMethod, pBuffer, ulLength);
+}
+
+
+static void
+DeviceClose(
+	void* pConnection
+)
+{
+	DEVICE_CONNECTION* pDevice = (DEVICE_CONNECTION*)pConnection;
+
+	CloseHandle(pDevice->hDevice);
+	delete pDevice;
+}
+
+
+const TRANSPORT g_DeviceTransport =
+{
+	"device",
+	DeviceOpen,
+	DeviceSend,
+	DeviceReceive,
+	DeviceClose,
+};
+
+#endif
+
+
+//***********************************************************************************
+//	Function:
+//		FindTransport
+//
+//	Parameters:
+//		[IN]  const char* pszName
+//		Name of the transport.
+//
+//	Routine Description:
+//		Looks a transport up by name, ignoring case.
+//
+//	Return Value:
+//		const TRANSPORT*.
+//		The transport, NULL if there is none by that name.
+//
+//***********************************************************************************
+const TRANSPORT*
+FindTransport(
+	const char* pszName
+)
+{
+	static const TRANSPORT* Transports[] =
+	{
+#ifdef _WIN32
+		&g_DeviceTransport,
+#endif
+		&g_LoopbackTransport,
+	};
+	unsigned int uiIndex;
+
+	for (uiIndex = 0; uiIndex < sizeof(Transports) / sizeof(Transports[0]); uiIndex++)
+	{
+		if (_stricmp(pszName, Transports[uiIndex]->pszName) == 0)
+			return Transports[uiIndex];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,196 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	transport.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the transports the load generator can drive.				*
+* 	A transport moves one message to or from a message store, either			*
+* 	the 6Fings driver or an in-process stand-in for it.							*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+//
+//	On Windows, include <Windows.h> first, the device transport needs it.
+//
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Entry points of a transport. Open is called once per load thread and
+//	returns that thread's connection, the other routines are only ever
+//	called by the thread that opened the connection.
+//
+typedef struct _TRANSPORT
+{
+	const char* pszName;
+
+	//
+	//	pszOptions is transport specific, NULL selects the defaults.
+	//	Returns NULL on failure.
+	//
+	void* (*Open)(const char* pszOptions);
+
+	//
+	//	Returns true if the message store accepted the message.
+	//
+	bool (*Send)(void* pConnection, const void* pMessage, uint32_t ulLength);
+
+	//
+	//	Returns the number of bytes received, 0 if there was no message.
+	//
+	uint32_t (*Receive)(void* pConnection, void* pBuffer, uint32_t ulLength);
+
+	void (*Close)(void* pConnection);
+
+} TRANSPORT;
+
+#ifdef _WIN32
+
+//
+//	One way of moving a message to and from the driver.
+//	A control code of 0 means WriteFile/ReadFile.
+//
+typedef struct _IO_METHOD
+{
+	const char* pszName;
+	DWORD dwWriteCode;
+	DWORD dwReadCode;
+
+} IO_METHOD;
+
+#define IO_METHOD_COUNT		4
+
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Drives a queue inside this process that behaves like the driver:
+//	bounded, first in first out, writes fail when it is full.
+//
+extern const TRANSPORT g_LoopbackTransport;
+
+#ifdef _WIN32
+
+//
+//	Drives \\.\6FingsUsr. The option names the IO_METHOD to use.
+//
+extern const TRANSPORT g_DeviceTransport;
+
+extern const IO_METHOD g_IoMethods[IO_METHOD_COUNT];
+
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		FindTransport
+//
+//	Parameters:
+//		[IN]  const char* pszName
+//		Name of the transport.
+//
+//	Routine Description:
+//		Looks a transport up by name, ignoring case.
+//
+//	Return Value:
+//		const TRANSPORT*.
+//		The transport, NULL if there is none by that name.
+//
+//***********************************************************************************
+const TRANSPORT*
+FindTransport(
+	const char* pszName
+);
+
+#ifdef _WIN32
+
+//***********************************************************************************
+//	Function:
+//		SendToDevice
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  const IO_METHOD* pMethod
+//		Transfer method to use.
+//
+//		[IN]  PVOID pMessage
+//		NULL terminated message.
+//
+//		[IN]  DWORD dwLength
+//		Length of the message including NULL character.
+//
+//	Routine Description:
+//		Writes one message with the given method.
+//
+//	Return Value:
+//		BOOL.
+//		TRUE if the driver accepted the message.
+//
+//***********************************************************************************
+BOOL
+SendToDevice(
+	HANDLE hDevice,
+	const IO_METHOD* pMethod,
+	PVOID pMessage,
+	DWORD dwLength
+);
+
+//***********************************************************************************
+//	Function:
+//		ReceiveFromDevice
+//
+//	Parameters:
+//		[IN]  HANDLE hDevice
+//		Handle to the device.
+//
+//		[IN]  const IO_METHOD* pMethod
+//		Transfer method to use.
+//
+//		[OUT]  PVOID pBuffer
+//		Buffer receiving the messages.
+//
+//		[IN]  DWORD dwLength
+//		Length of the buffer.
+//
+//	Routine Description:
+//		Reads the oldest messages with the given method, packed as
+//		FINGS_READ_RECORDs, as many as fit in the buffer.
+//
+//	Return Value:
+//		DWORD.
+//		Number of bytes read, 0 on failure or if there was no message.
+//
+//***********************************************************************************
+DWORD
+ReceiveFromDevice(
+	HANDLE hDevice,
+	const IO_METHOD* pMethod,
+	PVOID pBuffer,
+	DWORD dwLength
+);
+
+#endif
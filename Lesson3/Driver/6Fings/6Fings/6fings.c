@@ -75,9 +75,17 @@ DriverEntry(
 	NTSTATUS NtStatus = STATUS_SUCCESS;
 	UINT uiIndex = 0;
 	PDEVICE_OBJECT pDeviceObject;
+	PDEVICE_EXTENSION pDeviceExtension;
 	UNICODE_STRING usDriverName, usDosDeviceName;
 
-	DbgPrint("DriverEntry Called! \r\n");
+	//
+	//	Without the log the driver still works, it just stays quiet.
+	//
+	LogInitialize();
+	TraceInitialize();
+
+	LOG_INFO("DriverEntry called");
+	TRACE0(TRACE_DRIVER_ENTRY);
 
 	RtlInitUnicodeString(
 		&usDriverName,
@@ -91,7 +99,7 @@ DriverEntry(
 
 	NtStatus = IoCreateDevice(
 		pDriverObject,
-		0,
+		sizeof(DEVICE_EXTENSION),
 		&usDriverName,
 		FILE_DEVICE_UNKNOWN,
 		FILE_DEVICE_SECURE_OPEN,
@@ -101,6 +109,44 @@ DriverEntry(
 
 	if (STATUS_SUCCESS == NtStatus)
 	{
+		//
+		//	The device owns the channels, writers append to them and readers drain them.
+		//
+		pDeviceExtension = pDeviceObject->DeviceExtension;
+
+		NtStatus = SlabInitialize(&pDeviceExtension->MessageSlab, FINGS_POOL_TAG);
+
+		if (NT_SUCCESS(NtStatus))
+		{
+			NtStatus = InitializeStats(pDeviceExtension);
+
+			if (NT_SUCCESS(NtStatus))
+			{
+				NtStatus = InitializeBlockedWrites(pDeviceObject);
+
+				if (!NT_SUCCESS(NtStatus))
+					FreeStats(pDeviceExtension);
+			}
+
+			if (!NT_SUCCESS(NtStatus))
+				SlabDelete(&pDeviceExtension->MessageSlab);
+		}
+
+		if (!NT_SUCCESS(NtStatus))
+		{
+			LOG_ERROR("Device state allocation failed with 0x%08X", NtStatus);
+			LogShutdown();
+			TraceShutdown();
+
+			IoDeleteDevice(pDeviceObject);
+			return NtStatus;
+		}
+
+		InitializeChannels(pDeviceExtension);
+		InitializeCompression(pDeviceExtension);
+		InitializeQuotas(pDeviceExtension);
+		InitializeExpiry(pDeviceExtension);
+
 		//
 		//	The "MajorFunction" is a list of function pointers for entry points into the driver.
 		// 
@@ -111,8 +157,15 @@ DriverEntry(
 		pDriverObject->MajorFunction[IRP_MJ_CLOSE] = DispatchClose;
 		pDriverObject->MajorFunction[IRP_MJ_CREATE] = DispatchCreate;
 		pDriverObject->MajorFunction[IRP_MJ_DEVICE_CONTROL] = DispatchIoControl;
-		pDriverObject->MajorFunction[IRP_MJ_READ] = USE_READ_FUNCTION;
-		pDriverObject->MajorFunction[IRP_MJ_WRITE] = USE_WRITE_FUNCTION;
+		pDriverObject->MajorFunction[IRP_MJ_READ] = DispatchReadDirectIO;
+		pDriverObject->MajorFunction[IRP_MJ_WRITE] = DispatchWriteDirectIO;
+
+		//
+		//	Small reads and writes by control code are served before the I/O
+		//	manager builds an IRP, the routines above handle whatever fast
+		//	I/O turns down.
+		//
+		InitializeFastIo(pDriverObject);
 
 		//
 		//	Required to unload the driver dynamically. 
@@ -167,7 +220,12 @@ DriverEntry(
 		//	The flags for Read/Write is:
 		//	DO_BUFFERED_IO, DO_DIRECT_IO, Specify neither flag for "Neither".
 		// 
-		pDeviceObject->Flags |= IO_TYPE;
+		//	ReadFile/WriteFile use Direct I/O. All three types stay available at run
+		//	time through the IOCTL_6FINGS_READ_* / IOCTL_6FINGS_WRITE_* control codes,
+		//	whose transfer method (METHOD_BUFFERED, METHOD_IN/OUT_DIRECT, METHOD_NEITHER)
+		//	plays the role of this flag, so a client can pick one per message.
+		// 
+		pDeviceObject->Flags |= DO_DIRECT_IO;
 
 		//
 		//	We are not required to clear this flag in the DriverEntry as the I/O Manager will
@@ -184,6 +242,12 @@ DriverEntry(
 			&usDriverName
 		);
 	}
+	else
+	{
+		LOG_ERROR("IoCreateDevice failed with 0x%08X", NtStatus);
+		LogShutdown();
+		TraceShutdown();
+	}
 
 	return NtStatus;
 }
@@ -213,8 +277,11 @@ DriverUnload(
 )
 {
 	UNICODE_STRING usDosDeviceName;
+	PDEVICE_EXTENSION pDeviceExtension = pDriverObject->DeviceObject->DeviceExtension;
+	SLAB_COUNTERS SlabCounters;
 
-	DbgPrint("DriverUnload Called! \r\n");
+	LOG_INFO("DriverUnload called");
+	TRACE0(TRACE_DRIVER_UNLOAD);
 
 	RtlInitUnicodeString(
 		&usDosDeviceName,
@@ -222,5 +289,33 @@ DriverUnload(
 	);
 
 	IoDeleteSymbolicLink(&usDosDeviceName);
+
+	//
+	//	The wheel stops first, its DPC walks the channels. Freeing the
+	//	messages releases the quotas they were charged to.
+	//
+	FreeExpiry(pDeviceExtension);
+	FreeChannels(pDeviceExtension);
+	FreeBlockedWrites(pDeviceExtension);
+
+	SlabQueryCounters(&pDeviceExtension->MessageSlab, &SlabCounters);
+	LOG_INFO(
+		"Message slab: %Id hits, %Id misses, %Id bytes outstanding",
+		SlabCounters.llHits,
+		SlabCounters.llMisses,
+		SlabCounters.llBytesOutstanding
+	);
+
+	SlabDelete(&pDeviceExtension->MessageSlab);
+	FreeStats(pDeviceExtension);
+	FreeCompression(pDeviceExtension);
+
 	IoDeleteDevice(pDriverObject->DeviceObject);
+
+	TraceShutdown();
+
+	//
+	//	Last, so that everything logged above is still printed.
+	//
+	LogShutdown();
 }
\ No newline at end of file
@@ -21,6 +21,18 @@
 #pragma once
 
 
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include "6fingsioctl.h"
+#include "log.h"
+#include "lz.h"
+#include "ring.h"
+#include "slab.h"
+#include "strscan.h"
+#include "trace.h"
+
+
 /////////////////////////////////////////////////////////////////////
 //	T Y P E D E F S.
 /////////////////////////////////////////////////////////////////////
@@ -28,29 +40,413 @@ typedef unsigned int UINT;
 typedef char* PCHAR;
 
 
+//
+//	A message accepted by one of the write routines. The message is
+//	ulLength bytes, the last one always being the NULL character. Data
+//	holds ulStoredLength bytes, the message itself or, when shorter, the
+//	LZ block it was compressed to. llStamp is the performance counter
+//	when the message was queued and ullSequence its number in the
+//	channel, both only grow along a ring. Messages are read in the order
+//	of their numbers. ulProcessId and ulThreadId are
+//	the writer's. lReferences counts the subscribers
+//	still to read a published message, it is not used for the messages
+//	of a channel queue which only have one reader. pQuota is the quota
+//	of the handle that wrote the message, charged until it is freed.
+//	pExpiry is set while the message waits with a TTL.
+//
+typedef struct _FINGS_MESSAGE
+{
+	LONG64 llStamp;
+	ULONG64 ullSequence;
+	ULONG ulProcessId;
+	ULONG ulThreadId;
+	struct _QUOTA* pQuota;
+	struct _EXPIRY* pExpiry;
+	ULONG ulLength;
+	ULONG ulStoredLength;
+	volatile LONG lReferences;
+	CHAR Data[ANYSIZE_ARRAY];
+
+} FINGS_MESSAGE, *PFINGS_MESSAGE;
+
+
+//
+//	Entry of a message with a TTL in the timing wheel of the device,
+//	allocated from the message slab and freed with the message. It sits
+//	in WheelEntry until ullTick comes, then bExpired is set and the entry
+//	points to itself. Both are guarded by WheelLock. pChannel is the
+//	channel the message waits in.
+//
+typedef struct _EXPIRY
+{
+	LIST_ENTRY WheelEntry;
+	ULONG64 ullTick;
+	struct _CHANNEL* pChannel;
+	volatile BOOLEAN bExpired;
+
+} EXPIRY, *PEXPIRY;
+
+
+//
+//	Quota of a handle, or of a process when pProcess is NULL. Lock guards
+//	the limits, the buckets and the charged messages and bytes. The
+//	buckets hold tokens in units of 1/FINGS_QUOTA_TOKEN, refilled from
+//	the interrupt time. A handle quota is referenced by its handle and by
+//	every message charged to it, and references its process quota. A
+//	process quota is on the ProcessQuotas list of the device, its
+//	references and ulHandles are guarded by ProcessQuotaLock. bLimited is
+//	set while any limit applies, writes whose handle and process quotas
+//	both have none are not charged and take neither lock.
+//
+typedef struct _QUOTA
+{
+	KSPIN_LOCK Lock;
+	FINGS_QUOTA Limits;
+	ULONG64 ullMessageTokens;
+	ULONG64 ullByteTokens;
+	ULONG64 ullRefillTime;
+	LONG64 llMessages;
+	LONG64 llBytes;
+
+	volatile LONG64 llWritesThrottled;
+	volatile LONG64 llWritesRejected;
+	volatile LONG64 llWritesBlocked;
+	volatile LONG64 llMessagesDropped;
+
+	volatile LONG lReferences;
+	struct _QUOTA* pProcess;
+	volatile BOOLEAN bLimited;
+
+	LIST_ENTRY ProcessEntry;
+	HANDLE hProcessId;
+	LONG64 llProcessCreateTime;
+	ULONG ulHandles;
+
+} QUOTA, *PQUOTA;
+
+
+#pragma warning(push)
+#pragma warning(disable : 4324)	// structure was padded due to alignment specifier
+
+//
+//	Request counters of one processor, on cache lines of their own.
+//
+typedef struct _STATS_CPU
+{
+	DECLSPEC_CACHEALIGN FINGS_MAJOR_STATS Major[FINGS_STATS_MAJOR_COUNT];
+
+} STATS_CPU, *PSTATS_CPU;
+
+
+//
+//	What the writers running on one processor stored in a channel, on a
+//	cache line of its own. Only changed at DISPATCH_LEVEL on that processor.
+//	llQueuing is 0 unless a message is being queued, then it is no higher
+//	than the sequence number of that message.
+//
+typedef struct _CHANNEL_CPU
+{
+	DECLSPEC_CACHEALIGN ULONG64 ullMessagesWritten;
+	ULONG64 ullBytesWritten;
+	ULONG64 ullBytesStored;
+	volatile LONG64 llQueuing;
+
+} CHANNEL_CPU, *PCHANNEL_CPU;
+
+
+//
+//	Compression workspace of one processor. lBusy is set while a writer
+//	uses Table and Output, which only ever hold scratch data.
+//
+typedef struct _COMPRESS_CPU
+{
+	DECLSPEC_CACHEALIGN volatile LONG lBusy;
+	ULONG Table[LZ_WORKSPACE_SIZE / sizeof(ULONG)];
+	UCHAR Output[FINGS_COMPRESS_MAX_LENGTH];
+
+} COMPRESS_CPU, *PCOMPRESS_CPU;
+
+
+//
+//	Queue of a handle subscribed to its channel. Ring only holds pointers
+//	to the published messages, shared with the other subscribers, the
+//	cells follow the structure. ReadLock serializes the readers of the
+//	handle like the ReadLock of the channel. SubscriberEntry links it in
+//	the Subscribers list of the channel.
+//
+typedef struct _SUBSCRIPTION
+{
+	LIST_ENTRY SubscriberEntry;
+	struct _CHANNEL* pChannel;
+	PFILE_OBJECT pFileObject;
+	KSPIN_LOCK ReadLock;
+	volatile LONG64 llMessagesMissed;
+
+	MESSAGE_RING Ring;
+
+} SUBSCRIPTION, *PSUBSCRIPTION;
+
+
+//
+//	A queue of messages, the default one or one opened by name. Writers
+//	append without locking to the ring of the processor they run on, one
+//	of the ulShardCount rings in pShards, and count what they stored in
+//	the matching entry of pShardCounters. ReadLock serializes the readers
+//	so they can find the oldest message across the rings before taking
+//	it out, it also guards the read counters. Reads that found every ring
+//	empty wait in PendingReads, a cancel-safe queue over the handles in
+//	WaitingHandles guarded by PendingLock, each handle holding its own
+//	reads. Published messages go to the ulSubscriberCount subscriptions
+//	on Subscribers instead, publishers walk the list holding SubscriberLock
+//	shared. Channels are found through HashEntry in the ChannelBuckets
+//	of the device, usName.Buffer points right after the structure.
+//	ulHandles counts the handles open on the channel, guarded by the
+//	ChannelLock of the device, the last one closed frees it with the
+//	messages nobody read. TrimEntry queues the channel for the removal
+//	of its expired messages, only touched by the expiry DPC, and
+//	bTrimQueued stays set until the DPC is done with the channel.
+//	EvictEntry links a low priority channel in EvictableChannels, while
+//	bEvictable is set, guarded by EvictLock. pSharedRingMdl describes
+//	the pages of the shared ring of the channel once it has been mapped,
+//	the two events put its consumer and producer to sleep. Every process
+//	with a handle on the channel can map the ring and write its header,
+//	so they trust each other, as they already do reading and writing the
+//	channel's messages. llSequence is the number given to the last
+//	message queued, the first one gets 1. It is the one line every
+//	writer of the channel touches, kept on its own so that the counters
+//	and lists around it do not bounce with it. One counter gives
+//	the messages of all processors a single order that reads and range
+//	queries follow, numbers handed out in blocks per processor would not.
+//	The price is that writers on different processors still share one
+//	interlocked increment per message, which the rings themselves avoid.
+//
+typedef struct _CHANNEL
+{
+	LIST_ENTRY HashEntry;
+	ULONG ulHash;
+	UNICODE_STRING usName;
+	struct _DEVICE_EXTENSION* pDeviceExtension;
+
+	PMESSAGE_RING pShards;
+	PCHANNEL_CPU pShardCounters;
+	ULONG ulShardCount;
+
+	KSPIN_LOCK ReadLock;
+	ULONG64 ullMessagesRead;
+	ULONG64 ullBytesRead;
+
+	IO_CSQ PendingReads;
+	LIST_ENTRY WaitingHandles;
+	KSPIN_LOCK PendingLock;
+
+	LIST_ENTRY Subscribers;
+	ULONG ulSubscriberCount;
+	EX_SPIN_LOCK SubscriberLock;
+
+	FINGS_CHANNEL_LIMITS Limits;
+	ULONG ulHandles;
+	volatile LONG64 llMessagesRejected;
+	volatile LONG64 llMessagesExpired;
+	volatile LONG64 llMessagesEvicted;
+
+	LIST_ENTRY TrimEntry;
+	BOOLEAN bTrimQueued;
+	LIST_ENTRY EvictEntry;
+	BOOLEAN bEvictable;
+
+	PMDL volatile pSharedRingMdl;
+	KEVENT SharedRingEvents[2];
+
+	DECLSPEC_CACHEALIGN volatile LONG64 llSequence;
+
+} CHANNEL, *PCHANNEL;
+
+
+//
+//	State of one handle, in FsContext of its file object from create to
+//	close. pChannel is the channel the handle was opened on. Reads
+//	waiting for a message are queued on PendingList, and while there are
+//	any the handle is on the WaitingHandles list of the channel through
+//	WaitingEntry, both guarded by the PendingLock of the channel. A
+//	subscribed handle reads from pSubscription and its reads never wait
+//	in WaitingHandles, they are completed by the publishers.
+//	pRingMapping is the handle's view of the shared ring. The counters
+//	are FINGS_HANDLE_INFO's. pQuota is charged for the writes of the
+//	handle. lBlockedWrites counts its writes waiting for the quota,
+//	queued on the device, until they complete. pRetryThread is the
+//	thread retrying them and bClosing keeps new ones out once cleanup
+//	started, guarded by BlockedLock. ulStalledPass is the last retry pass
+//	a write of the handle still did not fit in.
+//
+typedef struct _HANDLE_CONTEXT
+{
+	PCHANNEL pChannel;
+	PSUBSCRIPTION volatile pSubscription;
+
+	LIST_ENTRY PendingList;
+	LIST_ENTRY WaitingEntry;
+	ULONG ulPendingReads;
+
+	FINGS_HANDLE_SETTINGS Settings;
+	PVOID volatile pRingMapping;
+
+	PQUOTA pQuota;
+	volatile LONG lBlockedWrites;
+	PKTHREAD pRetryThread;
+	BOOLEAN bClosing;
+	ULONG ulStalledPass;
+
+	DECLSPEC_CACHEALIGN volatile LONG64 llMessagesWritten;
+	volatile LONG64 llBytesWritten;
+	volatile LONG64 llReads;
+	volatile LONG64 llBytesRead;
+	volatile LONG64 llReadsPended;
+
+} HANDLE_CONTEXT, *PHANDLE_CONTEXT;
+
+#pragma warning(pop)
+
+
+//
+//	Number of lists in the channel hash table, a power of two.
+//
+#define FINGS_CHANNEL_BUCKETS	64
+
+
+//
+//	The timing wheel has FINGS_WHEEL_LEVELS levels of FINGS_WHEEL_SLOTS
+//	lists, each slot of a level spanning a whole turn of the level below.
+//
+#define FINGS_WHEEL_BITS		6
+#define FINGS_WHEEL_SLOTS		(1 << FINGS_WHEEL_BITS)
+#define FINGS_WHEEL_LEVELS		4
+
+
+//
+//	Per device state. Messages of every channel are allocated from
+//	MessageSlab. The ulChannelCount channels with handles open are
+//	chained in ChannelBuckets by the hash of their name, ChannelLock
+//	guards the table while a create looks a channel up or adds one and
+//	while a close takes one out. pStats holds the request counters of
+//	each of the ulStatsCpuCount processors.
+//	llClockBase is the system time when the performance counter read
+//	llCounterBase, together they turn message stamps into times.
+//	pCompressCpus holds a compression workspace for each of the
+//	ulCompressCpuCount processors, once a channel turned compression on.
+//	ProcessQuotas lists the quota of every process with handles or
+//	messages, new ones get DefaultQuota. Writes waiting for their quota
+//	are queued in BlockedWrites, on BlockedList guarded by BlockedLock.
+//	While there are any RetryTimer fires, its DPC queues pRetryWorkItem
+//	which retries them at PASSIVE_LEVEL, lRetryScheduled keeps it to one
+//	retry at a time. A scheduled retry holds RetryRundown until its work
+//	item is done, so the work item is only freed after. Messages with a
+//	TTL wait in Wheel until their tick, the wheel and ulWheelEntries are
+//	guarded by WheelLock. WheelTimer
+//	runs once lWheelStarted is set, its DPC turns the wheel up to the
+//	ticks of interrupt time since ullWheelStart, ullWheelTick being the
+//	next one, and evicts from the channels on EvictableChannels while
+//	pLowMemoryEvent is signaled. lWheelBusy keeps it to one processor.
+//
+typedef struct _DEVICE_EXTENSION
+{
+	SLAB_ALLOCATOR MessageSlab;
+
+	LIST_ENTRY ChannelBuckets[FINGS_CHANNEL_BUCKETS];
+	ULONG ulChannelCount;
+	FAST_MUTEX ChannelLock;
+
+	PSTATS_CPU pStats;
+	ULONG ulStatsCpuCount;
+	LONG64 llCounterFrequency;
+	LONG64 llCounterBase;
+	LONG64 llClockBase;
+
+	PCOMPRESS_CPU volatile pCompressCpus;
+	ULONG ulCompressCpuCount;
+
+	LIST_ENTRY ProcessQuotas;
+	KSPIN_LOCK ProcessQuotaLock;
+	FINGS_QUOTA DefaultQuota;
+
+	IO_CSQ BlockedWrites;
+	LIST_ENTRY BlockedList;
+	KSPIN_LOCK BlockedLock;
+	KTIMER RetryTimer;
+	KDPC RetryDpc;
+	PIO_WORKITEM pRetryWorkItem;
+	EX_RUNDOWN_REF RetryRundown;
+	volatile LONG lRetryScheduled;
+	ULONG ulRetryPass;
+
+	LIST_ENTRY Wheel[FINGS_WHEEL_LEVELS][FINGS_WHEEL_SLOTS];
+	KSPIN_LOCK WheelLock;
+	ULONG ulWheelEntries;
+	ULONG64 ullWheelTick;
+	ULONG64 ullWheelStart;
+	KTIMER WheelTimer;
+	KDPC WheelDpc;
+	volatile LONG lWheelStarted;
+	volatile LONG lWheelBusy;
+
+	LIST_ENTRY EvictableChannels;
+	KSPIN_LOCK EvictLock;
+	PKEVENT pLowMemoryEvent;
+	HANDLE hLowMemoryEvent;
+
+} DEVICE_EXTENSION, *PDEVICE_EXTENSION;
+
+
 /////////////////////////////////////////////////////////////////////
 //	M A C R O S.
 /////////////////////////////////////////////////////////////////////
-#define __USE_DIRECT__ 
-//#define __USE_BUFFERED__
+#define FINGS_POOL_TAG	'gnF6'
+
+//
+//	Tokens of a quota bucket are counted in units of 100 ns worth of a
+//	rate of one per second, the unit of the interrupt time.
+//
+#define FINGS_QUOTA_TOKEN	10000000ULL
+
+//
+//	How often writes waiting for their quota are retried, in 100 ns units.
+//
+#define FINGS_QUOTA_RETRY_INTERVAL	(10 * 10000)
+
+//
+//	Bytes allocated for a message of length bytes.
+//
+#define FINGS_MESSAGE_SIZE(length)	(FIELD_OFFSET(FINGS_MESSAGE, Data) + (SIZE_T)(length))
 
-#ifdef __USE_DIRECT__
-#define IO_TYPE DO_DIRECT_IO
-#define USE_WRITE_FUNCTION  DispatchWriteDirectIO
-#define USE_READ_FUNCTION   DispatchReadDirectIO
-#endif
+//
+//	Largest transfer served by the fast I/O routines, longer ones take the
+//	IRP path so the transfer method the client picked still applies.
+//
+#define FINGS_FAST_IO_MAX_LENGTH	PAGE_SIZE
+
+
+//
+//	Control codes writing one message, IoStatus.Information is then what
+//	they took from the caller like for IRP_MJ_WRITE.
+//
+#define FINGS_IOCTL_WRITES_MESSAGE(code)	\
+	((code) == IOCTL_6FINGS_WRITE_BUFFERED || (code) == IOCTL_6FINGS_WRITE_DIRECT ||	\
+	 (code) == IOCTL_6FINGS_WRITE_NEITHER || (code) == IOCTL_6FINGS_WRITE_VECTOR)
+
+//
+//	Channel of the handle a file object stands for.
+//
+#define FINGS_FILE_CHANNEL(pFileObject)	(((PHANDLE_CONTEXT)(pFileObject)->FsContext)->pChannel)
 
-#ifdef __USE_BUFFERED__
-#define IO_TYPE DO_BUFFERED_IO
-#define USE_WRITE_FUNCTION  DispatchWriteBufferedIO
-#define USE_READ_FUNCTION   DispatchReadBufferedIO
-#endif
+//
+//	Length of a tick of the timing wheel, in 100 ns units.
+//
+#define FINGS_EXPIRY_TICK	((ULONG64)FINGS_EXPIRY_TICK_MS * 10000)
 
-#ifndef IO_TYPE
-#define IO_TYPE 0
-#define USE_WRITE_FUNCTION  DispatchWriteNeither
-#define USE_READ_FUNCTION   DispatchReadNeither
-#endif
+//
+//	Whether a queued message outlived its TTL. Only the reader that takes
+//	the message out of its ring may look, the entry goes with it.
+//
+#define FINGS_MESSAGE_EXPIRED(pMessage)	((pMessage)->pExpiry && (pMessage)->pExpiry->bExpired)
 
 
 /////////////////////////////////////////////////////////////////////
@@ -70,11 +466,16 @@ typedef char* PCHAR;
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Create dispatch routine. All the requests are completed
-//		successfuly.
+//		Create dispatch routine. Opens the channel named by the rest of
+//		the path, or the default one, gives the new handle its context on
+//		that channel.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		NTSTATUS
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_OBJECT_NAME_INVALID if the channel name is not valid.
+//		STATUS_QUOTA_EXCEEDED if there are too many channels.
+//		Else the return value is some error status.
 //
 //***********************************************************************************
 NTSTATUS
@@ -96,7 +497,9 @@ DispatchCreate(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Cleanup dispatch routine. All the requests are completed
+//		Cleanup dispatch routine. Cancels the reads still pending and the
+//		writes still blocked on the handle, ends its subscription and
+//		unmaps its view of the shared ring, all the requests are completed
 //		successfuly.
 //
 //	Return Value:
@@ -122,8 +525,8 @@ DispatchCleanup(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Close dispatch routine. All the requests are completed
-//		successfuly.
+//		Close dispatch routine. Frees the handle context, all the
+//		requests are completed successfuly.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -148,8 +551,8 @@ DispatchClose(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		IO Control dispatch routine. All the requests are completed
-//		successfuly.
+//		IO Control dispatch routine. Hands the request to the handler of
+//		its control code, unknown codes fail with STATUS_INVALID_DEVICE_REQUEST.
 //
 //	Return Value:
 //		NTSTATUS
@@ -176,11 +579,12 @@ DispatchIoControl(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write Direct I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write Direct I/O dispatch routine. Validated messages are appended
+//		to the device ring. A write over the quota of a handle set to
+//		FINGS_QUOTA_BLOCK pends until the quota has room.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -202,11 +606,12 @@ DispatchWriteDirectIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write buffered I/O dispatch routine. Validated messages are appended
+//		to the device ring. A write over the quota of a handle set to
+//		FINGS_QUOTA_BLOCK pends until the quota has room.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -228,8 +633,8 @@ DispatchWriteBufferedIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write neither direct nor buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write neither direct nor buffered I/O dispatch routine. Validated messages
+//		are appended to the device ring.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -254,11 +659,13 @@ DispatchWriteNeither(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read Direct I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Read Direct I/O dispatch routine. Returns the oldest messages
+//		written to the device, as many as fit. If there is none the read
+//		completes with no data, or pends until a write on handles opened
+//		for overlapped I/O.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS 
@@ -280,11 +687,13 @@ DispatchReadDirectIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read Buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Read Buffered I/O dispatch routine. Returns the oldest messages
+//		written to the device, as many as fit. If there is none the read
+//		completes with no data, or pends until a write on handles opened
+//		for overlapped I/O.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -306,8 +715,9 @@ DispatchReadBufferedIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read Neither direct nor buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Read Neither direct nor buffered I/O dispatch routine. Returns the oldest
+//		messages written to the device, as many as fit, or no data if there is none.
+//		It never pends, the user buffer is only valid in the context of the caller.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -377,6 +787,2146 @@ IsStringTerminated(
 );
 
 
+//***********************************************************************************
+//	Function:
+//		GetTransferLength
+//
+//	Parameters:
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Stack location of a read, write or IOCTL_6FINGS_READ_* / WRITE_* request.
+// 
+//	Routine Description:
+//		Returns the length of the buffer carrying the message, which depends
+//		on the major function and, for control codes, on the transfer method.
+//		Resident, pending reads are completed with it at DISPATCH_LEVEL.
+//
+//	Return Value:
+//		ULONG.
+//		Length of the message buffer in bytes.
+//
+//***********************************************************************************
+ULONG
+GetTransferLength(
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		AllocateMessage
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  UINT uiLength
+//		Length of the message including NULL character.
+//
+//	Routine Description:
+//		Allocates a message from the message slab and sets its length,
+//		the message is stored as written until CompressMessage says otherwise.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The message, or NULL if there is not enough memory.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+AllocateMessage(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  UINT uiLength
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeMessage
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message returned by AllocateMessage.
+//
+//	Routine Description:
+//		Gives the message back to the message slab and takes it off the
+//		quota it was charged to.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeMessage(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PFINGS_MESSAGE pMessage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StoreMessage
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//	   
+//		[IN]  PCHAR pData
+//		Message validated by IsStringTerminated, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the message including NULL character.
+// 
+//		[IN]  BOOLEAN bCanWait
+//		TRUE if the caller pends the write with BlockWrite on STATUS_RETRY.
+// 
+//		[IN]  HANDLE hProcessId
+//		Process that wrote the message.
+// 
+//		[IN]  HANDLE hThreadId
+//		Thread that wrote the message.
+// 
+//	Routine Description:
+//		Charges the message to the quota of the handle, copies it into a
+//		block of the message slab and appends it to the ring of the current
+//		processor of the handle's channel. The ids are given by the caller
+//		since a blocked write is retried from a worker thread.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the ring is full, the channel at its limit or the quota used up, the return value is STATUS_DEVICE_BUSY.
+//		If the quota is used up and the write has to wait, the return value is STATUS_RETRY.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+StoreMessage(
+	IN  PFILE_OBJECT pFileObject,
+	IN  PCHAR pData,
+	IN  UINT uiLength,
+	IN  BOOLEAN bCanWait,
+	IN  HANDLE hProcessId,
+	IN  HANDLE hThreadId
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StoreSegments
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//	   
+//		[IN]  FINGS_WRITE_SEGMENT* pSegments
+//		Segments of the message, captured by the caller.
+// 
+//		[IN]  ULONG ulCount
+//		Number of segments.
+// 
+//		[IN]  KPROCESSOR_MODE RequestorMode
+//		Mode of the caller, user mode segments are probed.
+// 
+//		[OUT]  UINT* pdwDataWritten
+//		Length of the message stored including NULL character.
+// 
+//	Routine Description:
+//		Gathers the segments up to the first NULL character straight into
+//		a block of the message slab and appends it to the ring of the
+//		current processor. Runs in the context of the caller, a write over
+//		its quota fails rather than waits.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If there is no NULL character, the return value is STATUS_INVALID_PARAMETER.
+//		If the ring is full, the channel at its limit or the quota used up, the return value is STATUS_DEVICE_BUSY.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+StoreSegments(
+	IN  PFILE_OBJECT pFileObject,
+	IN  CONST FINGS_WRITE_SEGMENT* pSegments,
+	IN  ULONG ulCount,
+	IN  KPROCESSOR_MODE RequestorMode,
+	OUT  UINT* pdwDataWritten
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FetchMessages
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the messages are read on.
+//	   
+//		[OUT]  PCHAR pBuffer
+//		Buffer receiving the messages, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the buffer.
+// 
+//		[OUT]	UINT* pdwDataRead
+//		Number of bytes used in the buffer, 0 if there was no message.
+// 
+//	Routine Description:
+//		Takes the oldest messages out of the rings of the handle's channel,
+//		as many whole ones as fit, and packs them into the buffer as
+//		FINGS_READ_RECORDs. The first message that does not fit is left in
+//		its ring. A subscribed handle reads its subscription instead.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If not even the oldest message fits, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+FetchMessages(
+	IN  PFILE_OBJECT pFileObject,
+	OUT  PCHAR pBuffer,
+	IN  UINT uiLength,
+	OUT  UINT* pdwDataRead
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSubmitBatch
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the request was sent on.
+//	   
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SUBMIT_BATCH request.
+// 
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+// 
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of accepted messages.
+//
+//	Routine Description:
+//		Walks the packed records once, validating and storing every message.
+//		The status of each record is written back into the record.
+//
+//	Return Value:
+//		NTSTATUS.
+//		STATUS_SUCCESS if every record was walked, check each lStatus.
+//		STATUS_INVALID_PARAMETER if the header or a record is malformed.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSubmitBatch(
+	IN  PCHANNEL pChannel,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlWriteVector
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the request was sent on.
+//	   
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_WRITE_VECTOR request.
+// 
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+// 
+//		[OUT]  ULONG_PTR* pInformation
+//		Length of the message stored.
+//
+//	Routine Description:
+//		Stores one message gathered from the segments in the input buffer.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_INVALID_PARAMETER if the segment array is malformed.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlWriteVector(
+	IN  PCHANNEL pChannel,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializePendingReads
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Prepares the empty queue of pending reads.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializePendingReads(
+	IN OUT  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		PendRead
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the read was sent on.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Buffered or direct read that found the ring empty.
+//
+//	Routine Description:
+//		Queues the read on its handle until a message arrives or it is
+//		cancelled.
+//
+//	Return Value:
+//		STATUS_PENDING, or STATUS_DEVICE_BUSY if the handle already has
+//		as many reads waiting as its settings allow.
+//
+//***********************************************************************************
+NTSTATUS
+PendRead(
+	IN  PCHANNEL pChannel,
+	IN OUT  PIRP pIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CompletePendingReads
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel that was written to.
+//
+//	Routine Description:
+//		Hands messages from the ring to the pending reads, one handle
+//		after the other, until either of them runs out. Called after
+//		every write.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CompletePendingReads(
+	IN  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CompleteSubscriberReads
+//
+//	Parameters:
+//		[IN]  SUBSCRIPTION* pSubscription
+//		Subscription that was published to.
+//
+//	Routine Description:
+//		Hands messages from the subscription to the pending reads of its
+//		handle, oldest read first, until either of them runs out. Called
+//		by publishers at DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CompleteSubscriberReads(
+	IN  PSUBSCRIPTION pSubscription
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CancelPendingReads
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Completes every read still pending on the handle with STATUS_CANCELLED.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CancelPendingReads(
+	IN  PCHANNEL pChannel,
+	IN  PFILE_OBJECT pFileObject
+);
+
+//***********************************************************************************
+//	Function:
+//		InitializeShards
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Allocates an empty message ring and counters for every processor.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeShards(
+	IN OUT  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeShards
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being freed.
+//
+//	Routine Description:
+//		Frees the rings and the counters. The messages nobody has read
+//		have been freed already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeShards(
+	IN OUT  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ShardEnqueue
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is written to.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message to append, receives its sequence number and time stamp.
+//
+//	Routine Description:
+//		Numbers and stamps the message and appends it to the ring of the
+//		current processor.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the message was stored, FALSE if the ring of this processor is full.
+//
+//***********************************************************************************
+BOOLEAN
+ShardEnqueue(
+	IN  PCHANNEL pChannel,
+	IN OUT  PFINGS_MESSAGE pMessage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ShardPeek
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the messages are read from.
+//
+//		[OUT]  ULONG* pulShard
+//		Receives the ring holding the message.
+//
+//	Routine Description:
+//		Finds the message with the smallest sequence number across the
+//		rings, once no lower number is still on its way to a ring. The
+//		caller holds ReadLock.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The oldest message, left in its ring, or NULL if every ring is empty.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+ShardPeek(
+	IN  PCHANNEL pChannel,
+	OUT  PULONG pulShard
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsSettled
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the messages are read from.
+//
+//		[IN]  ULONG64 ullSequence
+//		Number of the message about to be returned.
+//
+//	Routine Description:
+//		Tells whether every number below ullSequence has either reached
+//		its ring or was given up.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if no lower number is on its way.
+//
+//***********************************************************************************
+BOOLEAN
+ShardsSettled(
+	IN  PCHANNEL pChannel,
+	IN  ULONG64 ullSequence
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsHaveMessage
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel to look at.
+//
+//	Routine Description:
+//		Tells whether any ring holds a message, without taking ReadLock.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if a message was seen.
+//
+//***********************************************************************************
+BOOLEAN
+ShardsHaveMessage(
+	IN  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsMessageCount
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel to look at.
+//
+//	Routine Description:
+//		Adds up the messages in the rings from their positions, without
+//		taking ReadLock or writing to any shared line. Writers and readers
+//		keep going meanwhile, the count is a close estimate.
+//
+//	Return Value:
+//		ULONG.
+//		Number of messages in the rings.
+//
+//***********************************************************************************
+ULONG
+ShardsMessageCount(
+	IN  PCHANNEL pChannel
+);
+
+//***********************************************************************************
+//	Function:
+//		InitializeStats
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Allocates zeroed request counters for every processor and reads
+//		the clocks message stamps are converted with.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeStats(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeStats
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the request counters.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeStats(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StatsStartRequest
+//
+//	Parameters:
+//		[IN/OUT]  IRP* pIrp
+//		Request entering a dispatch routine.
+//
+//	Routine Description:
+//		Notes when the request arrived, for its latency.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsStartRequest(
+	IN OUT  PIRP pIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StatsCountRequest
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  UCHAR ucMajorFunction
+//		IRP_MJ_* the request is counted against.
+//
+//		[IN]  LONG64 llStart
+//		Performance counter when the request arrived.
+//
+//		[IN]  NTSTATUS NtStatus
+//		Status of the request.
+//
+//		[IN]  ULONG_PTR BytesIn
+//		Bytes the request took from the caller.
+//
+//		[IN]  ULONG_PTR BytesOut
+//		Bytes the request returned to the caller.
+//
+//	Routine Description:
+//		Counts a finished request against its major function. Used as is
+//		for the requests served by fast I/O, which have no IRP.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsCountRequest(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  UCHAR ucMajorFunction,
+	IN  LONG64 llStart,
+	IN  NTSTATUS NtStatus,
+	IN  ULONG_PTR BytesIn,
+	IN  ULONG_PTR BytesOut
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StatsCompleteRequest
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Request with its IoStatus set, started by StatsStartRequest.
+//
+//	Routine Description:
+//		Counts the request against its major function and completes it.
+//		Every request of the device is completed through here.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsCompleteRequest(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN OUT  PIRP pIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryStats
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_STATS request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Adds up the request counters of every processor.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryStats(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+//***********************************************************************************
+//	Function:
+//		InitializeSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Prepares the wait events of the shared ring of the channel. The
+//		ring itself is only allocated when it is first mapped.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeSharedRing(
+	IN OUT  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being deleted.
+//
+//	Routine Description:
+//		Frees the pages of the shared ring of the channel once no handle
+//		is left on it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeSharedRing(
+	IN OUT  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		UnmapSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Removes the mapping of the shared ring the handle made, if any.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+UnmapSharedRing(
+	IN OUT  PFILE_OBJECT pFileObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlMapRing
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_MAP_RING request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Maps the shared ring of the channel into the calling process and
+//		returns its address.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlMapRing(
+	IN  PCHANNEL pChannel,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlRingWait
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_RING_WAIT request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Blocks the caller until its side of the shared ring of the channel
+//		is woken.
+//
+//	Return Value:
+//		NTSTATUS.
+//		STATUS_SUCCESS once woken, STATUS_IO_TIMEOUT on timeout and
+//		STATUS_RETRY if a user APC or an alert ended the wait.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlRingWait(
+	IN  PCHANNEL pChannel,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlRingWake
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_RING_WAKE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Wakes the given side of the shared ring of the channel.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlRingWake(
+	IN  PCHANNEL pChannel,
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+//***********************************************************************************
+//	Function:
+//		InitializeChannels
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty table of channels. The default channel is
+//		created like the others, on its first open.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeChannels(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeChannels
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the channels left with the messages nobody has read. Every
+//		handle has been closed by then, which freed its channel already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeChannels(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		OpenChannel
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		File object of the create, its FileName names the channel.
+//
+//		[OUT]  CHANNEL** ppChannel
+//		Receives the channel.
+//
+//	Routine Description:
+//		Finds the channel by the hash of its name, creating it if no
+//		handle has it open, and counts the new handle on it. Names are
+//		compared without regard to case.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_OBJECT_NAME_INVALID if the name is not a valid channel name.
+//		STATUS_QUOTA_EXCEEDED if there are FINGS_CHANNEL_MAX_COUNT channels already.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+OpenChannel(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PFILE_OBJECT pFileObject,
+	OUT  PCHANNEL* ppChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CloseChannel
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel a handle was opened on by OpenChannel.
+//
+//	Routine Description:
+//		Counts the handle off the channel. The last one takes the channel
+//		out of the table and frees it, with the messages nobody has read.
+//		Every request of the handle is done by then.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CloseChannel(
+	IN  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryChannel
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_CHANNEL request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the limits and counters of the channel of the handle.
+//		Resident, it takes ReadLock to read the read counters.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryChannel(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetChannel
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_CHANNEL request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the limits of the channel of the handle. Messages
+//		already queued stay even if there are more than the new limit,
+//		and stay as they were stored when compression is turned on or off.
+//		A new TTL only applies to messages written from then on.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the priority is not one of FINGS_CHANNEL_PRIORITY_*, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetChannel(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSubscribe
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SUBSCRIBE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Gives the handle a queue of its own and adds it to the subscribers
+//		of its channel. Reads on the handle are served from that queue
+//		from then on.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the handle is subscribed already or has reads pending, the return value is STATUS_INVALID_DEVICE_STATE.
+//		If the queue length is not a power of two from 2 or too large, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSubscribe(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		Unsubscribe
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Takes the handle off the subscribers of its channel, lets go of
+//		the messages it did not read and frees its queue. Nothing is done
+//		for a handle that never subscribed. Its reads must have been
+//		cancelled already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+Unsubscribe(
+	IN  PFILE_OBJECT pFileObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlPublish
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_PUBLISH request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of subscribers the message was queued for.
+//
+//	Routine Description:
+//		Copies the message once into a block of the message slab and
+//		queues a pointer to it for every subscriber of the channel, then
+//		completes the reads the subscribers have waiting for it.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS, even
+//		if no subscriber had room for the message.
+//		If the message is not NULL terminated, the return value is STATUS_INVALID_PARAMETER.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		If the quota of the handle or of its process is used up, the return value is STATUS_DEVICE_BUSY.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlPublish(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FetchPublished
+//
+//	Parameters:
+//		[IN]  SUBSCRIPTION* pSubscription
+//		Subscription the messages are read from.
+//	   
+//		[OUT]  PCHAR pBuffer
+//		Buffer receiving the messages, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the buffer.
+// 
+//		[OUT]	UINT* pdwDataRead
+//		Number of bytes used in the buffer, 0 if there was no message.
+// 
+//	Routine Description:
+//		Takes the oldest messages out of the subscription like FetchMessages
+//		does out of the rings of a channel, and drops the subscriber's
+//		reference to each once it is copied.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If not even the oldest message fits, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+FetchPublished(
+	IN  PSUBSCRIPTION pSubscription,
+	OUT  PCHAR pBuffer,
+	IN  UINT uiLength,
+	OUT  UINT* pdwDataRead
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Notes how many workspaces are needed, one for every processor the
+//		system can have. They are only allocated by EnableCompression.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeCompression(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		EnableCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Allocates the workspaces unless a channel did so already. Two
+//		channels turning compression on at once both allocate, the one
+//		that loses the race frees its copy.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+EnableCompression(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the workspaces, if they were ever allocated.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeCompression(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CompressMessage
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is written to.
+//
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message as written, not queued yet.
+//
+//	Routine Description:
+//		Compresses the message if the channel asks for it and its length
+//		qualifies. The block goes to the workspace of the current
+//		processor first, only a block shorter than the message is copied
+//		to a message of its own, which replaces the one written.
+//
+//		Runs at PASSIVE_LEVEL. The thread may be switched out or moved to
+//		another processor meanwhile, the workspace stays its own until
+//		lBusy is cleared. A writer finding it taken keeps its message as
+//		written rather than wait.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The message to queue, the one passed in when it was not compressed.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+CompressMessage(
+	IN  PCHANNEL pChannel,
+	IN  PFINGS_MESSAGE pMessage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ExpandMessage
+//
+//	Parameters:
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message taken off a queue.
+//
+//		[OUT]  CHAR* pBuffer
+//		Receives the ulLength bytes of the message, may be a user mode
+//		buffer the caller guards.
+//
+//	Routine Description:
+//		Copies the message out, expanding it if it was kept compressed.
+//		The decoder checks every length and offset against the block and
+//		the output, so a buffer changed by its owner meanwhile only
+//		spoils the owner's copy.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_DATA_ERROR.
+//
+//***********************************************************************************
+NTSTATUS
+ExpandMessage(
+	IN  PFINGS_MESSAGE pMessage,
+	OUT  PCHAR pBuffer
+);
+
+
+
+//***********************************************************************************
+//	Function:
+//		CreateHandleContext
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being opened.
+//
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is opened on.
+//
+//	Routine Description:
+//		Allocates the zeroed state of the handle with its quota and keeps
+//		it in FsContext.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+CreateHandleContext(
+	IN OUT  PFILE_OBJECT pFileObject,
+	IN  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		DeleteHandleContext
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being closed.
+//
+//	Routine Description:
+//		Frees the state of the handle and counts it off its channel. Its
+//		reads, its blocked writes and its mapping of the shared ring are
+//		gone since the cleanup of the handle. Its quota stays while
+//		messages are charged to it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+DeleteHandleContext(
+	IN OUT  PFILE_OBJECT pFileObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		HandleCountWrite
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the messages were written on.
+//
+//		[IN]  ULONG ulMessages
+//		Number of messages accepted.
+//
+//		[IN]  ULONG_PTR Bytes
+//		Their length.
+//
+//	Routine Description:
+//		Adds accepted messages to the counters of the handle.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+HandleCountWrite(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulMessages,
+	IN  ULONG_PTR Bytes
+);
+
+
+//***********************************************************************************
+//	Function:
+//		HandleCountRead
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the read was issued on.
+//
+//		[IN]  ULONG_PTR Bytes
+//		Bytes returned by the read, nothing is counted for 0.
+//
+//	Routine Description:
+//		Adds a read that returned messages to the counters of the handle.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+HandleCountRead(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG_PTR Bytes
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryHandle
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_HANDLE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the settings and counters of the handle, the usage of its
+//		quota, and the counters of its subscription if it has one.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryHandle(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetHandle
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_HANDLE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the settings of the handle and the limits of its quota.
+//		Reads already waiting stay queued even if there are more than the
+//		new limit, and so do messages already charged to the quota.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the policy is not one of FINGS_QUOTA_*, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetHandle(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeQuotas
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty list of process quotas. Processes get no limits
+//		until IOCTL_6FINGS_SET_PROCESS_QUOTA sets some.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeQuotas(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		OpenHandleQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  HANDLE_CONTEXT* pHandle
+//		Handle being opened, receives its quota.
+//
+//	Routine Description:
+//		Gives the handle a quota without limits, tied to the quota of the
+//		calling process, which is created with the default limits if this
+//		is its first handle.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+OpenHandleQuota(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN OUT  PHANDLE_CONTEXT pHandle
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CloseHandleQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  HANDLE_CONTEXT* pHandle
+//		Handle being closed.
+//
+//	Routine Description:
+//		Drops the handle's reference to its quota. The quota stays until
+//		the messages charged to it are freed.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CloseHandleQuota(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN OUT  PHANDLE_CONTEXT pHandle
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SetQuotaLimits
+//
+//	Parameters:
+//		[IN/OUT]  QUOTA* pQuota
+//		Quota of a handle or of a process.
+//
+//		[IN]  FINGS_QUOTA* pLimits
+//		New limits.
+//
+//	Routine Description:
+//		Replaces the limits of the quota. The buckets start full, messages
+//		already charged stay even if there are more than the new limits.
+//		Messages written while no limit applied were not charged and do
+//		not count against the new ones.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SetQuotaLimits(
+	IN OUT  PQUOTA pQuota,
+	IN  CONST FINGS_QUOTA* pLimits
+);
+
+
+//***********************************************************************************
+//	Function:
+//		QueryQuota
+//
+//	Parameters:
+//		[IN]  QUOTA* pQuota
+//		Quota of a handle or of a process.
+//
+//		[OUT]  FINGS_QUOTA* pLimits
+//		Optional, receives the limits.
+//
+//		[OUT]  FINGS_QUOTA_USAGE* pUsage
+//		Receives what is charged and the counters.
+//
+//	Routine Description:
+//		Reads the limits and the usage of the quota.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+QueryQuota(
+	IN  PQUOTA pQuota,
+	OUT  PFINGS_QUOTA pLimits,
+	OUT  PFINGS_QUOTA_USAGE pUsage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ChargeQuota
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//
+//		[IN]  ULONG ulLength
+//		Length of the message including NULL character.
+//
+//		[IN]  BOOLEAN bCanWait
+//		TRUE if the caller can pend the write with BlockWrite.
+//
+//		[OUT]  QUOTA** ppQuota
+//		Receives the quota to keep in the message, referenced for it, or
+//		NULL if the message is not charged.
+//
+//	Routine Description:
+//		Charges a message to the quota of the handle and of its process
+//		before it is allocated. When neither has a limit nothing is
+//		charged, so writers of a process do not meet on its quota lock
+//		for nothing. When either is full the policy of the
+//		handle decides: the write fails, waits if it can, or makes room by
+//		dropping the oldest messages charged to the full quota.
+//
+//		A handle with writes waiting keeps every new write that can wait
+//		behind them, so its messages stay in order. The thread retrying
+//		them is let through.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the message was charged, the return value is STATUS_SUCCESS.
+//		If the write has to wait, the return value is STATUS_RETRY.
+//		Else the return value is STATUS_DEVICE_BUSY.
+//
+//***********************************************************************************
+NTSTATUS
+ChargeQuota(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulLength,
+	IN  BOOLEAN bCanWait,
+	OUT  PQUOTA* ppQuota
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ReleaseQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  QUOTA* pQuota
+//		Quota returned by ChargeQuota, may be NULL.
+//
+//		[IN]  ULONG ulLength
+//		Length of the message it was charged for.
+//
+//	Routine Description:
+//		Takes a message that is freed off the quota of its handle and of
+//		its process, and drops the message's reference to the quota.
+//		Runs at DISPATCH_LEVEL or below.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+ReleaseQuota(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PQUOTA pQuota,
+	IN  ULONG ulLength
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetProcessQuota
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_PROCESS_QUOTA request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the limits of a process, or the default limits for
+//		process ID 0. Only callers allowed to adjust memory quotas may.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the process has no handle open, the return value is STATUS_NOT_FOUND.
+//		If SeIncreaseQuotaPrivilege is not enabled, the return value is STATUS_PRIVILEGE_NOT_HELD.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetProcessQuota(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryProcessQuota
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_PROCESS_QUOTA request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the limits and usage of the process that opened the handle,
+//		of the process given in the input buffer, or the default limits.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the process has no quota, the return value is STATUS_NOT_FOUND.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryProcessQuota(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryRange
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_RANGE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned, up to the end of the last message.
+//
+//	Routine Description:
+//		Copies the messages of the handle's channel that fall in the
+//		ranges of FINGS_RANGE_QUERY to the locked output buffer without
+//		taking them out. A batch at a time is copied holding ReadLock,
+//		which keeps readers and the expiry from freeing the messages, and
+//		every batch looks for its start in the rings again.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the first message does not fit, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryRange(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeBlockedWrites
+//
+//	Parameters:
+//		[IN]  DEVICE_OBJECT* pDeviceObject
+//		Our device object.
+//
+//	Routine Description:
+//		Prepares the empty queue of blocked writes, its retry timer and
+//		the work item retrying them.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeBlockedWrites(
+	IN  PDEVICE_OBJECT pDeviceObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeBlockedWrites
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Stops the retry timer, waits for a retry already started and frees
+//		the work item. Every handle is closed by then, so no write waits.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeBlockedWrites(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		BlockWrite
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Buffered or direct write StoreMessage returned STATUS_RETRY for.
+//
+//	Routine Description:
+//		Queues the write until its quota has room, it is cancelled or
+//		its handle is cleaned up. The writes of a handle are retried in
+//		the order they were sent.
+//
+//	Return Value:
+//		STATUS_PENDING.
+//
+//***********************************************************************************
+NTSTATUS
+BlockWrite(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN OUT  PIRP pIrp
+);
+
+
+//***********************************************************************************
+//	Function:
+//		CancelBlockedWrites
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Completes every write still waiting on the handle with
+//		STATUS_CANCELLED. A write the retry holds at that moment is
+//		cancelled when it would go back to the queue.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CancelBlockedWrites(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PFILE_OBJECT pFileObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeExpiry
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty timing wheel, its timer, and the list of low
+//		priority channels. Without the low memory event messages still
+//		expire, they are just never evicted.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeExpiry(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FreeExpiry
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Stops the wheel timer, waits for a run of its DPC already queued
+//		and closes the low memory event. Called before the channels are
+//		freed, the entries left go with their messages.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeExpiry(
+	IN OUT  PDEVICE_EXTENSION pDeviceExtension
+);
+
+
+//***********************************************************************************
+//	Function:
+//		ArmExpiry
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is about to be queued in.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message not queued yet, compressed already.
+//
+//		[IN]  ULONG ulTtl
+//		Milliseconds the message may wait, not 0.
+//
+//	Routine Description:
+//		Gives the message an entry in the timing wheel, on the first tick
+//		at least ulTtl milliseconds away. The entry is freed with the
+//		message, by FreeMessage.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+ArmExpiry(
+	IN  PCHANNEL pChannel,
+	IN OUT  PFINGS_MESSAGE pMessage,
+	IN  ULONG ulTtl
+);
+
+
+//***********************************************************************************
+//	Function:
+//		DisarmExpiry
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message being freed, with an entry in the wheel.
+//
+//	Routine Description:
+//		Takes the entry of the message out of the wheel, unless it expired
+//		already, and frees it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+DisarmExpiry(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN OUT  PFINGS_MESSAGE pMessage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SetChannelPriority
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel whose limits changed.
+//
+//		[IN]  ULONG ulPriority
+//		FINGS_CHANNEL_PRIORITY_NORMAL or FINGS_CHANNEL_PRIORITY_LOW.
+//
+//	Routine Description:
+//		Adds a low priority channel to the channels evicted from while
+//		memory is low, or takes a normal one off.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SetChannelPriority(
+	IN OUT  PCHANNEL pChannel,
+	IN  ULONG ulPriority
+);
+
+
+//***********************************************************************************
+//	Function:
+//		WaitForTrim
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel being freed, its messages are gone already.
+//
+//	Routine Description:
+//		Waits for a run of the wheel DPC that found messages of the channel
+//		expired and may still be trimming its rings.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+WaitForTrim(
+	IN  PCHANNEL pChannel
+);
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeFastIo
+//
+//	Parameters:
+//		[IN/OUT]  DRIVER_OBJECT* pDriverObject
+//		Our driver object.
+//
+//	Routine Description:
+//		Hands the fast I/O routines to the I/O manager.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeFastIo(
+	IN OUT  PDRIVER_OBJECT pDriverObject
+);
+
+
+//***********************************************************************************
+//	Function:
+//		FastIoDeviceControl
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the request was issued on.
+//
+//		[IN]  BOOLEAN bWait
+//		Ignored, the routine never blocks.
+//
+//		[IN]  PVOID pInputBuffer
+//		Caller's input buffer, not probed.
+//
+//		[IN]  ULONG ulInputBufferLength
+//		Length of the input buffer.
+//
+//		[OUT]  PVOID pOutputBuffer
+//		Caller's output buffer, not probed.
+//
+//		[IN]  ULONG ulOutputBufferLength
+//		Length of the output buffer.
+//
+//		[IN]  ULONG ulIoControlCode
+//		Control code of the request.
+//
+//		[OUT]  IO_STATUS_BLOCK* pIoStatus
+//		Result of the request when the routine returns TRUE.
+//
+//		[IN]  DEVICE_OBJECT* pDeviceObject
+//		Our device object.
+//
+//	Routine Description:
+//		Serves IOCTL_6FINGS_READ_*, IOCTL_6FINGS_WRITE_* and
+//		IOCTL_6FINGS_WRITE_VECTOR for small messages, every other
+//		control code goes to DispatchIoControl.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the request was served, FALSE to send an IRP instead.
+//
+//***********************************************************************************
+BOOLEAN
+FastIoDeviceControl(
+	IN  PFILE_OBJECT pFileObject,
+	IN  BOOLEAN bWait,
+	IN  PVOID pInputBuffer,
+	IN  ULONG ulInputBufferLength,
+	OUT  PVOID pOutputBuffer,
+	IN  ULONG ulOutputBufferLength,
+	IN  ULONG ulIoControlCode,
+	OUT  PIO_STATUS_BLOCK pIoStatus,
+	IN  PDEVICE_OBJECT pDeviceObject
+);
+
 //*******************************************************************
 //
 //	Function:
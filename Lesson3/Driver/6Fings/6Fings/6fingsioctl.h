@@ -0,0 +1,628 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	6fingsioctl.h																*
+*																				*
+* Abstract:																		*
+* 	This file defines the I/O control codes and the structures					*
+* 	exchanged with the driver. It is shared by the driver and the				*
+* 	user mode programs, user mode includes <winioctl.h> first.					*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Submits many messages in one request.
+//	Input buffer:	FINGS_BATCH_HEADER.
+//	Output buffer:	Packed FINGS_BATCH_RECORD entries, locked for write access since
+//					the driver stores the status of every record in place.
+//	Returns:		Number of accepted messages.
+//
+#define IOCTL_6FINGS_SUBMIT_BATCH	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x800, METHOD_OUT_DIRECT, FILE_WRITE_DATA)
+
+//
+//	One message per request, with the transfer method picked by the caller.
+//	Writes pass the NULL terminated message in the input buffer, except
+//	IOCTL_6FINGS_WRITE_DIRECT which passes it in the output buffer so the
+//	I/O manager locks it instead of copying it. Reads fill the output
+//	buffer with as many of the oldest messages as fit, see
+//	FINGS_READ_RECORD. ReadFile and WriteFile use Direct I/O.
+//	Transfers of up to a page by these control codes are served by fast
+//	I/O without an IRP, whatever the method, except reads that have to
+//	wait for a message. ReadFile and WriteFile always build an IRP.
+//
+#define IOCTL_6FINGS_WRITE_BUFFERED	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x801, METHOD_BUFFERED, FILE_WRITE_DATA)
+#define IOCTL_6FINGS_WRITE_DIRECT	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x802, METHOD_IN_DIRECT, FILE_WRITE_DATA)
+#define IOCTL_6FINGS_WRITE_NEITHER	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x803, METHOD_NEITHER, FILE_WRITE_DATA)
+#define IOCTL_6FINGS_READ_BUFFERED	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x804, METHOD_BUFFERED, FILE_READ_DATA)
+#define IOCTL_6FINGS_READ_DIRECT	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x805, METHOD_OUT_DIRECT, FILE_READ_DATA)
+#define IOCTL_6FINGS_READ_NEITHER	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x806, METHOD_NEITHER, FILE_READ_DATA)
+
+//
+//	Maps the shared ring of the handle's channel into the calling process.
+//	Every process with a handle on the channel maps the same ring.
+//	Output buffer:	FINGS_MAP_RING_OUTPUT.
+//	The mapping lasts until the handle is closed, mapping again on the
+//	same handle returns the same address.
+//
+#define IOCTL_6FINGS_MAP_RING		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x807, METHOD_BUFFERED, FILE_READ_DATA | FILE_WRITE_DATA)
+
+//
+//	Sleeps until the other side of the shared ring wakes this side or the
+//	timeout expires, whichever comes first. Fails with STATUS_IO_TIMEOUT
+//	on timeout, and with STATUS_RETRY when a user APC or an alert ended
+//	the wait first, which is not a wake. Wakes are not lost: a wake with
+//	nobody waiting lets the next wait of that side return at once.
+//	Input buffer:	FINGS_RING_WAIT_INPUT.
+//
+#define IOCTL_6FINGS_RING_WAIT		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x808, METHOD_BUFFERED, FILE_READ_DATA | FILE_WRITE_DATA)
+
+//
+//	Wakes the given side of the shared ring.
+//	Input buffer:	FINGS_RING_WAKE_INPUT.
+//
+#define IOCTL_6FINGS_RING_WAKE		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x809, METHOD_BUFFERED, FILE_READ_DATA | FILE_WRITE_DATA)
+
+//
+//	Returns the counters of every major function since the driver was loaded.
+//	Output buffer:	FINGS_STATS.
+//
+#define IOCTL_6FINGS_QUERY_STATS	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80A, METHOD_BUFFERED, FILE_READ_DATA)
+
+//
+//	Returns the binary trace of every processor, see 6fingstrace.h.
+//	Output buffer:	FINGS_TRACE_DUMP and the records. If it is too small
+//					for the whole dump only FINGS_TRACE_DUMP is returned,
+//					with STATUS_BUFFER_OVERFLOW, ulRequiredLength says how
+//					large it has to be.
+//
+#define IOCTL_6FINGS_DUMP_TRACE		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80B, METHOD_OUT_DIRECT, FILE_READ_DATA)
+
+//
+//	Writes one message gathered from several buffers of the caller, with
+//	no copy into a single buffer first. The message is the segments one
+//	after the other, up to the first NULL character which has to be in them.
+//	Input buffer:	Array of FINGS_WRITE_SEGMENT, at most FINGS_VECTOR_MAX_SEGMENTS.
+//	Returns:		Length of the message stored, including the NULL character.
+//
+#define IOCTL_6FINGS_WRITE_VECTOR	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80C, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+//	Settings and counters of the handle the request is sent on, every
+//	handle has its own and they go away with it.
+//	Output buffer:	FINGS_HANDLE_INFO.
+//
+#define IOCTL_6FINGS_QUERY_HANDLE	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80D, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+//	Changes the settings of the handle the request is sent on.
+//	Input buffer:	FINGS_HANDLE_SETTINGS.
+//
+#define IOCTL_6FINGS_SET_HANDLE		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80E, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+//	Limits and counters of the channel the handle was opened on. Opening
+//	\\.\6FingsUsr\<name> picks the channel <name>, \\.\6FingsUsr the
+//	default channel. Every channel has its own queue, a message is only
+//	read from the channel it was written to.
+//	Output buffer:	FINGS_CHANNEL_INFO.
+//
+#define IOCTL_6FINGS_QUERY_CHANNEL	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80F, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+//	Changes the limits of the channel the handle was opened on, for
+//	every handle of the channel, until its last handle is closed.
+//	Input buffer:	FINGS_CHANNEL_LIMITS.
+//
+#define IOCTL_6FINGS_SET_CHANNEL	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x810, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+//	Subscribes the handle to the messages published on its channel. From
+//	then on reads on the handle return published messages only, oldest
+//	first, and leave the queue of the channel to the other handles. A
+//	handle subscribes once, until it is closed, and not while it has
+//	reads pending.
+//	Input buffer:	Optional FINGS_SUBSCRIBE_INPUT.
+//
+#define IOCTL_6FINGS_SUBSCRIBE		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x811, METHOD_BUFFERED, FILE_READ_DATA)
+
+//
+//	Hands one message to every handle subscribed to the channel. It is
+//	stored once, the subscribers share it until the last one has read it.
+//	A subscriber whose queue is full misses the message, see
+//	FINGS_HANDLE_INFO. With no subscriber the message is dropped.
+//	Input buffer:	The NULL terminated message.
+//	Returns:		Number of subscribers the message was queued for.
+//
+#define IOCTL_6FINGS_PUBLISH		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x812, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+//	Sets the quota of a process, shared by every handle it opened. Process
+//	ID 0 sets the quota given to processes when they open their first
+//	handle, those with handles open keep theirs. The caller needs
+//	SeIncreaseQuotaPrivilege enabled.
+//	Input buffer:	FINGS_PROCESS_QUOTA.
+//
+#define IOCTL_6FINGS_SET_PROCESS_QUOTA		CTL_CODE(FILE_DEVICE_UNKNOWN, 0x813, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+//
+//	Quota and usage of a process. Without an input buffer the process is
+//	the one that opened the handle, process ID 0 returns the default quota.
+//	Input buffer:	Optional ULONG, the process ID.
+//	Output buffer:	FINGS_PROCESS_QUOTA_INFO.
+//
+#define IOCTL_6FINGS_QUERY_PROCESS_QUOTA	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x814, METHOD_BUFFERED, FILE_READ_DATA)
+
+//
+//	Copies the messages waiting in the channel whose sequence number and
+//	time both fall in the ranges asked for, in sequence order, as many
+//	whole ones as fit. The messages stay queued. To go on, ask again from
+//	the sequence number after the last one returned, a message with a
+//	lower number is returned before it or was read, expired, published or
+//	dropped for a full queue by then. Fails with
+//	STATUS_BUFFER_TOO_SMALL if not even the first message fits.
+//	Input buffer:	FINGS_RANGE_QUERY.
+//	Output buffer:	FINGS_MESSAGE_RECORDs, see FINGS_MESSAGE_RECORD_SIZE.
+//
+#define IOCTL_6FINGS_QUERY_RANGE	CTL_CODE(FILE_DEVICE_UNKNOWN, 0x815, METHOD_OUT_DIRECT, FILE_READ_DATA)
+
+//
+//	Most records a single batch may carry.
+//
+#define FINGS_BATCH_MAX_RECORDS		4096
+
+//
+//	Most segments a vectored write may gather.
+//
+#define FINGS_VECTOR_MAX_SEGMENTS	16
+
+//
+//	Channel names are at most FINGS_CHANNEL_MAX_NAME characters, without
+//	backslashes, and compared without regard to case. At most
+//	FINGS_CHANNEL_MAX_COUNT channels have handles open at a time, counting
+//	the default one, opening another fails with STATUS_QUOTA_EXCEEDED.
+//
+#define FINGS_CHANNEL_MAX_NAME		32
+#define FINGS_CHANNEL_MAX_COUNT		64
+
+//
+//	Messages a subscriber's queue holds by default and at most, its
+//	length has to be a power of two from 2.
+//
+#define FINGS_SUBSCRIBE_DEFAULT_MESSAGES	1024
+#define FINGS_SUBSCRIBE_MAX_MESSAGES		65536
+
+//
+//	Longest message a channel compresses. Longer ones save a little more
+//	but hold a processor's workspace for longer, they are kept as written.
+//
+#define FINGS_COMPRESS_MAX_LENGTH	(16 * 1024)
+
+//
+//	Messages expire on ticks of FINGS_EXPIRY_TICK_MS milliseconds. A TTL
+//	longer than FINGS_EXPIRY_MAX_DAYS is cut to it.
+//
+#define FINGS_EXPIRY_TICK_MS		100
+#define FINGS_EXPIRY_MAX_DAYS		19
+
+//
+//	What a write over its handle's or its process's quota does, picked
+//	by FINGS_HANDLE_SETTINGS.ulFullPolicy.
+//
+//	FINGS_QUOTA_FAIL		The write fails with STATUS_DEVICE_BUSY.
+//	FINGS_QUOTA_BLOCK		The write pends until the quota has room. Only
+//							WriteFile and IOCTL_6FINGS_WRITE_BUFFERED and
+//							_DIRECT can wait, other writes fail as above.
+//	FINGS_QUOTA_DROP_OLDEST	The oldest messages of the channel are dropped
+//							while they count against the quota that is full.
+//							A write over a rate, or finding a message of
+//							someone else first, fails as above.
+//
+#define FINGS_QUOTA_FAIL			0
+#define FINGS_QUOTA_BLOCK			1
+#define FINGS_QUOTA_DROP_OLDEST		2
+
+//
+//	Which channels lose messages when the system runs low on nonpaged
+//	pool, picked by FINGS_CHANNEL_LIMITS.ulPriority.
+//
+//	FINGS_CHANNEL_PRIORITY_NORMAL	Messages wait until read or expired.
+//	FINGS_CHANNEL_PRIORITY_LOW		The oldest messages are dropped, a
+//									batch at a time, while memory is low.
+//
+#define FINGS_CHANNEL_PRIORITY_NORMAL	0
+#define FINGS_CHANNEL_PRIORITY_LOW		1
+
+//
+//	Records start on an 8 byte boundary. Size of a record carrying
+//	a message of length bytes, including the padding to the next record.
+//
+#define FINGS_BATCH_ALIGNMENT		8
+#define FINGS_BATCH_RECORD_SIZE(length)	\
+	((FIELD_OFFSET(FINGS_BATCH_RECORD, Data) + (ULONG)(length) + FINGS_BATCH_ALIGNMENT - 1) & ~(ULONG)(FINGS_BATCH_ALIGNMENT - 1))
+
+//
+//	A read returns whole messages one after the other, each record starting
+//	on an 8 byte boundary. Size of a record carrying a message of length
+//	bytes, including the padding to the next record. The length returned by
+//	the read ends with the last message, without its padding.
+//
+#define FINGS_READ_ALIGNMENT		8
+#define FINGS_READ_RECORD_SIZE(length)	\
+	((FIELD_OFFSET(FINGS_READ_RECORD, Data) + (ULONG)(length) + FINGS_READ_ALIGNMENT - 1) & ~(ULONG)(FINGS_READ_ALIGNMENT - 1))
+
+//
+//	Records of IOCTL_6FINGS_QUERY_RANGE, laid out like those of a read.
+//
+#define FINGS_MESSAGE_RECORD_SIZE(length)	\
+	((FIELD_OFFSET(FINGS_MESSAGE_RECORD, Data) + (ULONG)(length) + FINGS_READ_ALIGNMENT - 1) & ~(ULONG)(FINGS_READ_ALIGNMENT - 1))
+
+//
+//	The shared ring is one page of FINGS_SHARED_RING followed by the data
+//	area, a power of two so positions wrap with a mask. Every message is a
+//	ULONG length followed by the bytes, padded to FINGS_SHARED_RING_ALIGNMENT.
+//	A length of FINGS_SHARED_RING_WRAP tells the consumer the rest of the
+//	data area is unused and the next message starts at offset 0.
+//
+#define FINGS_SHARED_RING_DATA_OFFSET	4096
+#define FINGS_SHARED_RING_DATA_SIZE		(1024 * 1024)
+#define FINGS_SHARED_RING_SIZE			(FINGS_SHARED_RING_DATA_OFFSET + FINGS_SHARED_RING_DATA_SIZE)
+#define FINGS_SHARED_RING_ALIGNMENT		8
+#define FINGS_SHARED_RING_MAX_MESSAGE	(64 * 1024)
+#define FINGS_SHARED_RING_WRAP			0xFFFFFFFF
+#define FINGS_SHARED_RING_RECORD_SIZE(length)	\
+	((sizeof(ULONG) + (ULONG)(length) + FINGS_SHARED_RING_ALIGNMENT - 1) & ~(ULONG)(FINGS_SHARED_RING_ALIGNMENT - 1))
+
+//
+//	Counters of IOCTL_6FINGS_QUERY_STATS. There is an entry for every
+//	IRP_MJ_* code (IRP_MJ_MAXIMUM_FUNCTION + 1). Failures are counted
+//	per NTSTATUS for the codes in FINGS_STATS_STATUSES, the last slot
+//	counts every other failure. Latency bucket 0 counts requests that took
+//	no time, bucket i the ones that took 2^(i-1) to 2^i - 1 nanoseconds,
+//	the last bucket everything longer.
+//
+#define FINGS_STATS_MAJOR_COUNT		28
+#define FINGS_STATS_STATUS_COUNT	8
+#define FINGS_STATS_LATENCY_BUCKETS	32
+#define FINGS_STATS_STATUSES		{										\
+	(LONG)0xC000000D,	/* STATUS_INVALID_PARAMETER */						\
+	(LONG)0xC0000023,	/* STATUS_BUFFER_TOO_SMALL */						\
+	(LONG)0xC000009A,	/* STATUS_INSUFFICIENT_RESOURCES */					\
+	(LONG)0x80000011,	/* STATUS_DEVICE_BUSY */							\
+	(LONG)0xC0000120,	/* STATUS_CANCELLED */								\
+	(LONG)0xC0000010,	/* STATUS_INVALID_DEVICE_REQUEST */					\
+	(LONG)0xC00000BB	/* STATUS_NOT_SUPPORTED */							\
+}
+
+//
+//	Sides of the shared ring, for IOCTL_6FINGS_RING_WAIT and _WAKE.
+//
+#define FINGS_RING_CONSUMER		0
+#define FINGS_RING_PRODUCER		1
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+typedef struct _FINGS_BATCH_HEADER
+{
+	ULONG ulCount;		// Number of records in the output buffer.
+	ULONG ulReserved;
+
+} FINGS_BATCH_HEADER, *PFINGS_BATCH_HEADER;
+
+
+typedef struct _FINGS_BATCH_RECORD
+{
+	ULONG ulLength;		// Length of Data, the message has to be NULL terminated within it.
+	LONG lStatus;		// NTSTATUS of the record, written by the driver.
+	CHAR Data[ANYSIZE_ARRAY];
+
+} FINGS_BATCH_RECORD, *PFINGS_BATCH_RECORD;
+
+
+//
+//	ullAddress is a pointer of the calling process, 64 bits wide so that
+//	32 bit callers use the same layout.
+//
+typedef struct _FINGS_WRITE_SEGMENT
+{
+	ULONG64 ullAddress;
+	ULONG ulLength;
+	ULONG ulReserved;
+
+} FINGS_WRITE_SEGMENT, *PFINGS_WRITE_SEGMENT;
+
+
+typedef struct _FINGS_READ_RECORD
+{
+	ULONG ulLength;		// Length of Data, including the NULL terminator.
+	CHAR Data[ANYSIZE_ARRAY];
+
+} FINGS_READ_RECORD, *PFINGS_READ_RECORD;
+
+
+//
+//	Both ranges include their ends, a last value of 0 leaves the range
+//	open. Times are system times, in units of 100 ns since 1601.
+//
+typedef struct _FINGS_RANGE_QUERY
+{
+	ULONG64 ullFirstSequence;
+	ULONG64 ullLastSequence;
+	ULONG64 ullFirstTime;
+	ULONG64 ullLastTime;
+
+} FINGS_RANGE_QUERY, *PFINGS_RANGE_QUERY;
+
+
+//
+//	A message returned by IOCTL_6FINGS_QUERY_RANGE. Sequence numbers grow
+//	by one for every message written to the channel, starting at 1.
+//
+typedef struct _FINGS_MESSAGE_RECORD
+{
+	ULONG64 ullSequence;
+	ULONG64 ullTime;		// When the message was queued, as in FINGS_RANGE_QUERY.
+	ULONG ulProcessId;		// Process and thread that wrote the message.
+	ULONG ulThreadId;
+	ULONG ulLength;			// Length of Data, including the NULL terminator.
+	CHAR Data[ANYSIZE_ARRAY];
+
+} FINGS_MESSAGE_RECORD, *PFINGS_MESSAGE_RECORD;
+
+
+//
+//	Header of the shared ring, at the start of the mapping. llTail is only
+//	written by the producer and llHead only by the consumer, each on its
+//	own cache line. Both count bytes since the ring was created. A side
+//	about to sleep sets its lWaiting flag so the other side knows to wake it.
+//
+typedef struct _FINGS_SHARED_RING
+{
+	volatile LONG64 llTail;
+	UCHAR Reserved1[56];
+
+	volatile LONG64 llHead;
+	UCHAR Reserved2[56];
+
+	volatile LONG lWaiting[2];	// Indexed by FINGS_RING_CONSUMER / FINGS_RING_PRODUCER.
+	ULONG ulDataSize;			// FINGS_SHARED_RING_DATA_SIZE.
+	ULONG ulDataOffset;			// FINGS_SHARED_RING_DATA_OFFSET.
+
+} FINGS_SHARED_RING, *PFINGS_SHARED_RING;
+
+
+typedef struct _FINGS_MAP_RING_OUTPUT
+{
+	ULONG64 ullAddress;	// Address of the FINGS_SHARED_RING in the caller.
+	ULONG ulSize;		// FINGS_SHARED_RING_SIZE.
+	ULONG ulReserved;
+
+} FINGS_MAP_RING_OUTPUT, *PFINGS_MAP_RING_OUTPUT;
+
+
+typedef struct _FINGS_RING_WAIT_INPUT
+{
+	ULONG ulSide;		// FINGS_RING_CONSUMER or FINGS_RING_PRODUCER.
+	ULONG ulTimeout;	// Milliseconds, 0xFFFFFFFF to wait forever.
+
+} FINGS_RING_WAIT_INPUT, *PFINGS_RING_WAIT_INPUT;
+
+
+typedef struct _FINGS_RING_WAKE_INPUT
+{
+	ULONG ulSide;		// FINGS_RING_CONSUMER or FINGS_RING_PRODUCER.
+	ULONG ulReserved;
+
+} FINGS_RING_WAKE_INPUT, *PFINGS_RING_WAKE_INPUT;
+
+
+//
+//	Counters of one major function. ullBytesIn counts what IRP_MJ_WRITE
+//	and the control codes writing a message wrote, and the input buffers
+//	of the other IRP_MJ_DEVICE_CONTROL requests. ullBytesOut counts the
+//	IoStatus.Information of every other request.
+//
+typedef struct _FINGS_MAJOR_STATS
+{
+	ULONG64 ullRequests;
+	ULONG64 ullBytesIn;
+	ULONG64 ullBytesOut;
+	ULONG64 ullFailures;
+	ULONG64 ullFailuresByStatus[FINGS_STATS_STATUS_COUNT];
+	ULONG64 ullLatency[FINGS_STATS_LATENCY_BUCKETS];
+
+} FINGS_MAJOR_STATS, *PFINGS_MAJOR_STATS;
+
+
+typedef struct _FINGS_STATS
+{
+	ULONG ulMajorCount;								// FINGS_STATS_MAJOR_COUNT.
+	LONG lStatuses[FINGS_STATS_STATUS_COUNT - 1];	// FINGS_STATS_STATUSES.
+
+	ULONG64 ullSlabHits;			// Messages allocated from a lookaside list.
+	ULONG64 ullSlabMisses;			// Messages allocated from pool.
+	LONG64 llSlabBytes;				// Bytes of messages not freed yet.
+
+	FINGS_MAJOR_STATS Major[FINGS_STATS_MAJOR_COUNT];	// Indexed by IRP_MJ_*.
+
+} FINGS_STATS, *PFINGS_STATS;
+
+
+//
+//	Limits of a handle or of a process. The first two bound the messages
+//	written and not read yet, a message is charged until the last reader
+//	is done with it. The rates are token buckets holding ulBurst* tokens,
+//	one second of the rate when 0. A message takes one message token and
+//	one byte token per byte, or a full bucket if it is longer. Limits
+//	that are 0 do not apply. A message longer than ulMaxBytes is taken
+//	once nothing else of the writer is waiting. Messages written while
+//	neither the handle nor its process has a limit are not charged.
+//
+typedef struct _FINGS_QUOTA
+{
+	ULONG ulMaxMessages;
+	ULONG ulMaxBytes;
+	ULONG ulMessagesPerSecond;
+	ULONG ulBytesPerSecond;
+	ULONG ulBurstMessages;
+	ULONG ulBurstBytes;
+
+} FINGS_QUOTA, *PFINGS_QUOTA;
+
+
+//
+//	Usage of a quota. Throttled writes found a rate used up, rejected
+//	writes failed, blocked writes pended, dropped messages made room.
+//
+typedef struct _FINGS_QUOTA_USAGE
+{
+	ULONG64 ullMessages;			// Messages charged right now.
+	ULONG64 ullBytes;				// Their bytes.
+	ULONG64 ullWritesThrottled;
+	ULONG64 ullWritesRejected;
+	ULONG64 ullWritesBlocked;
+	ULONG64 ullMessagesDropped;
+
+} FINGS_QUOTA_USAGE, *PFINGS_QUOTA_USAGE;
+
+
+//
+//	ulMaxPendingReads bounds the reads waiting on the handle for a
+//	message, the next one fails with STATUS_DEVICE_BUSY. 0 is no limit.
+//	Quota applies to the writes of the handle, on top of the quota of
+//	its process, and ulFullPolicy, FINGS_QUOTA_*, to both. Messages
+//	written on the handle are dropped unread ulMessageTtl milliseconds
+//	after they were written, 0 uses the ulMessageTtl of the channel.
+//
+typedef struct _FINGS_HANDLE_SETTINGS
+{
+	ULONG ulMaxPendingReads;
+	ULONG ulFullPolicy;
+	FINGS_QUOTA Quota;
+	ULONG ulMessageTtl;
+	ULONG ulReserved;
+
+} FINGS_HANDLE_SETTINGS, *PFINGS_HANDLE_SETTINGS;
+
+
+//
+//	Counters since the handle was opened. A read counts once however
+//	many messages it returned.
+//
+typedef struct _FINGS_HANDLE_INFO
+{
+	FINGS_HANDLE_SETTINGS Settings;
+
+	ULONG64 ullMessagesWritten;
+	ULONG64 ullBytesWritten;
+	ULONG64 ullReads;				// Reads that returned messages.
+	ULONG64 ullBytesRead;
+	ULONG64 ullReadsPended;			// Reads that had to wait for a message.
+	ULONG ulPendingReads;			// Reads waiting right now.
+	ULONG ulSubscribed;				// Non zero once the handle subscribed.
+	ULONG64 ullMessagesMissed;		// Published messages lost to a full queue.
+	FINGS_QUOTA_USAGE Usage;		// Of the handle's own quota.
+
+} FINGS_HANDLE_INFO, *PFINGS_HANDLE_INFO;
+
+
+//
+//	ulMaxMessages bounds the messages waiting in the channel and
+//	ulMaxMessageLength the length of a message, NULL character included.
+//	Writes over either limit fail with STATUS_DEVICE_BUSY and
+//	STATUS_INVALID_BUFFER_SIZE. 0 is no limit.
+//
+//	Messages of at least ulCompressMinLength bytes, and at most
+//	FINGS_COMPRESS_MAX_LENGTH, are kept LZ compressed while they wait
+//	whenever that makes them shorter, and expanded again when read.
+//	0 keeps every message as written.
+//
+//	Messages still waiting ulMessageTtl milliseconds after they were
+//	written expire, for writers whose handle has no TTL of its own. They
+//	are dropped within a tick of FINGS_EXPIRY_TICK_MS, up to about
+//	FINGS_EXPIRY_MAX_DAYS later. 0 keeps them until read. Published
+//	messages do not expire. ulPriority is FINGS_CHANNEL_PRIORITY_*.
+//
+typedef struct _FINGS_CHANNEL_LIMITS
+{
+	ULONG ulMaxMessages;
+	ULONG ulMaxMessageLength;
+	ULONG ulCompressMinLength;
+	ULONG ulMessageTtl;
+	ULONG ulPriority;
+	ULONG ulReserved;
+
+} FINGS_CHANNEL_LIMITS, *PFINGS_CHANNEL_LIMITS;
+
+
+//
+//	Counters since the channel was created. It lasts while a handle is
+//	open on it, closing the last one drops the messages still waiting.
+//
+typedef struct _FINGS_CHANNEL_INFO
+{
+	FINGS_CHANNEL_LIMITS Limits;
+
+	ULONG64 ullMessagesWritten;
+	ULONG64 ullBytesWritten;
+	ULONG64 ullBytesStored;			// What the written bytes took once compressed.
+	ULONG64 ullMessagesRead;
+	ULONG64 ullBytesRead;
+	ULONG64 ullMessagesRejected;	// Writes over a limit or finding the queue full.
+	ULONG64 ullMessagesExpired;		// Dropped unread once their TTL ran out.
+	ULONG64 ullMessagesEvicted;		// Dropped unread while memory was low.
+	ULONG ulMessages;				// Messages waiting right now.
+	ULONG ulHandles;				// Handles open on the channel.
+	ULONG ulSubscribers;			// Handles subscribed to the channel.
+	ULONG ulReserved;
+	ULONG64 ullLastSequence;		// Sequence number of the last message written.
+
+} FINGS_CHANNEL_INFO, *PFINGS_CHANNEL_INFO;
+
+
+//
+//	ulMaxMessages is the length of the subscriber's queue, a power of
+//	two up to FINGS_SUBSCRIBE_MAX_MESSAGES. 0 is FINGS_SUBSCRIBE_DEFAULT_MESSAGES.
+//
+typedef struct _FINGS_SUBSCRIBE_INPUT
+{
+	ULONG ulMaxMessages;
+	ULONG ulReserved;
+
+} FINGS_SUBSCRIBE_INPUT, *PFINGS_SUBSCRIBE_INPUT;
+
+
+typedef struct _FINGS_PROCESS_QUOTA
+{
+	ULONG ulProcessId;
+	ULONG ulReserved;
+	FINGS_QUOTA Quota;
+
+} FINGS_PROCESS_QUOTA, *PFINGS_PROCESS_QUOTA;
+
+
+typedef struct _FINGS_PROCESS_QUOTA_INFO
+{
+	ULONG ulProcessId;
+	ULONG ulHandles;				// Handles the process has open.
+	FINGS_QUOTA Quota;
+	FINGS_QUOTA_USAGE Usage;
+
+} FINGS_PROCESS_QUOTA_INFO, *PFINGS_PROCESS_QUOTA_INFO;
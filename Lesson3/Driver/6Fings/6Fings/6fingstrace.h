@@ -0,0 +1,128 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	6fingstrace.h																*
+*																				*
+* Abstract:																		*
+* 	This file defines the trace formats and the layout of a trace				*
+* 	dump. It is shared by the driver and the decoder, it only needs				*
+* 	USHORT, ULONG and ULONG64 to be defined, which the decoder does				*
+* 	itself where there are no Windows headers.									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Every trace point of the driver, TRACE_FORMAT(Id, Format). A trace
+//	record only carries the position of its format in this list, the
+//	decoder expands the same list into its table of format strings.
+//	Arguments are ULONGs, formats may only use 32 bit conversions.
+//	Add new formats at the end and bump FINGS_TRACE_VERSION whenever
+//	an existing one changes meaning.
+//
+#define FINGS_TRACE_FORMATS(TRACE_FORMAT)														\
+	TRACE_FORMAT(TRACE_DRIVER_ENTRY,			"DriverEntry called")						\
+	TRACE_FORMAT(TRACE_DRIVER_UNLOAD,			"DriverUnload called")						\
+	TRACE_FORMAT(TRACE_DISPATCH_CREATE,			"DispatchCreate: 0x%08X")					\
+	TRACE_FORMAT(TRACE_DISPATCH_CLEANUP,		"DispatchCleanup: 0x%08X")					\
+	TRACE_FORMAT(TRACE_DISPATCH_CLOSE,			"DispatchClose: 0x%08X")					\
+	TRACE_FORMAT(TRACE_DISPATCH_IO_CONTROL,		"DispatchIoControl: code 0x%08X, 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_WRITE_DIRECT,	"DispatchWriteDirectIO: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_WRITE_BUFFERED,	"DispatchWriteBufferedIO: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_WRITE_NEITHER,	"DispatchWriteNeither: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_READ_DIRECT,	"DispatchReadDirectIO: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_READ_BUFFERED,	"DispatchReadBufferedIO: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_READ_NEITHER,	"DispatchReadNeither: 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_READ_PENDED,	"Read of %u bytes pended")					\
+	TRACE_FORMAT(TRACE_DISPATCH_UNSUPPORTED,	"DispatchUnSupportedFunction: major function %u")	\
+	TRACE_FORMAT(TRACE_FAST_IO_READ,			"FastIoRead: 0x%08X, %u bytes")				\
+	TRACE_FORMAT(TRACE_FAST_IO_WRITE,			"FastIoWrite: 0x%08X, %u bytes")			\
+	TRACE_FORMAT(TRACE_FAST_IO_DEVICE_CONTROL,	"FastIoDeviceControl: code 0x%08X, 0x%08X, %u bytes")	\
+	TRACE_FORMAT(TRACE_DISPATCH_WRITE_BLOCKED,	"Write of %u bytes blocked")
+
+#define FINGS_TRACE_VERSION			1
+
+//
+//	A dump starts with FINGS_TRACE_DUMP, followed by a FINGS_TRACE_CPU
+//	and the records of every processor in turn.
+//
+#define FINGS_TRACE_MAGIC			0x52543646		// "F6TR" in a hex dump
+
+//
+//	Records are packed one after the other, each only as long as its
+//	arguments. Times are interrupt times, in units of 100 ns.
+//
+#define FINGS_TRACE_MAX_ARGUMENTS	4
+#define FINGS_TRACE_RECORD_LENGTH(count)	(12 + 4 * (ULONG)(count))
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+#define FINGS_TRACE_FORMAT_ID(Id, Format)	Id,
+
+typedef enum _FINGS_TRACE_FORMAT
+{
+	FINGS_TRACE_FORMATS(FINGS_TRACE_FORMAT_ID)
+	FINGS_TRACE_FORMAT_COUNT
+
+} FINGS_TRACE_FORMAT;
+
+
+//
+//	ulRequiredLength is the size of a complete dump, the driver only
+//	returns this header when the buffer is smaller.
+//
+typedef struct _FINGS_TRACE_DUMP
+{
+	ULONG ulMagic;
+	ULONG ulVersion;
+	ULONG ulFormatCount;
+	ULONG ulCpuCount;
+	ULONG ulRequiredLength;
+	ULONG ulReserved;
+
+} FINGS_TRACE_DUMP, *PFINGS_TRACE_DUMP;
+
+
+//
+//	ulLength bytes of records follow, oldest first. ulOverwritten counts
+//	the records the processor lost to newer ones since the driver loaded.
+//
+typedef struct _FINGS_TRACE_CPU
+{
+	ULONG ulCpu;
+	ULONG ulLength;
+	ULONG ulOverwritten;
+	ULONG ulReserved;
+
+} FINGS_TRACE_CPU, *PFINGS_TRACE_CPU;
+
+
+//
+//	ulArguments falls at offset 12, a record is the first
+//	FINGS_TRACE_RECORD_LENGTH(usArgumentCount) bytes of the structure.
+//
+typedef struct _FINGS_TRACE_RECORD
+{
+	ULONG64 ullTime;
+	USHORT usFormat;
+	USHORT usArgumentCount;
+	ULONG ulArguments[FINGS_TRACE_MAX_ARGUMENTS];
+
+} FINGS_TRACE_RECORD, *PFINGS_TRACE_RECORD;
@@ -0,0 +1,535 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	blocked.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the queue of writes waiting for their quota.			*
+* 	A write whose handle is set to FINGS_QUOTA_BLOCK pends here while			*
+* 	its quota or the one of its process is used up, and a timer has				*
+* 	the writes retried in order until they fit. The cancel-safe queue			*
+* 	(IoCsq) takes care of cancellation.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	InsertContext of a write put back after it still did not fit.
+//
+#define BLOCKED_INSERT_HEAD		((PVOID)1)
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	The queue callbacks, the timer DPC and CancelBlockedWrites take the
+//	queue spinlock and stay resident.
+//
+#pragma alloc_text(INIT, InitializeBlockedWrites)
+#pragma alloc_text(PAGE, FreeBlockedWrites)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Queues the write at the back, or at the front when it is put back.
+//	A handle being cleaned up takes no more writes.
+//
+static NTSTATUS
+CsqInsertIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp,
+    IN  PVOID pInsertContext
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = CONTAINING_RECORD(pCsq, DEVICE_EXTENSION, BlockedWrites);
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    if (pHandle->bClosing)
+        return STATUS_CANCELLED;
+
+    if (pInsertContext == BLOCKED_INSERT_HEAD)
+        InsertHeadList(&pDeviceExtension->BlockedList, &pIrp->Tail.Overlay.ListEntry);
+    else
+        InsertTailList(&pDeviceExtension->BlockedList, &pIrp->Tail.Overlay.ListEntry);
+
+    return STATUS_SUCCESS;
+}
+
+
+static VOID
+CsqRemoveIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp
+)
+{
+    UNREFERENCED_PARAMETER(pCsq);
+
+    RemoveEntryList(&pIrp->Tail.Overlay.ListEntry);
+}
+
+
+//
+//	pPeekContext is NULL to take the oldest write, or the file object
+//	whose writes are wanted.
+//
+static PIRP
+CsqPeekNextIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp,
+    IN  PVOID pPeekContext
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = CONTAINING_RECORD(pCsq, DEVICE_EXTENSION, BlockedWrites);
+    PLIST_ENTRY pEntry = pIrp ? pIrp->Tail.Overlay.ListEntry.Flink : pDeviceExtension->BlockedList.Flink;
+    PIRP pNextIrp;
+
+    for (; pEntry != &pDeviceExtension->BlockedList; pEntry = pEntry->Flink)
+    {
+        pNextIrp = CONTAINING_RECORD(pEntry, IRP, Tail.Overlay.ListEntry);
+
+        if (!pPeekContext || IoGetCurrentIrpStackLocation(pNextIrp)->FileObject == pPeekContext)
+            return pNextIrp;
+    }
+
+    return NULL;
+}
+
+
+static VOID
+CsqAcquireLock(
+    IN  PIO_CSQ pCsq,
+    OUT  PKIRQL pIrql
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = CONTAINING_RECORD(pCsq, DEVICE_EXTENSION, BlockedWrites);
+
+    KeAcquireSpinLock(&pDeviceExtension->BlockedLock, pIrql);
+}
+
+
+static VOID
+CsqReleaseLock(
+    IN  PIO_CSQ pCsq,
+    IN  KIRQL Irql
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = CONTAINING_RECORD(pCsq, DEVICE_EXTENSION, BlockedWrites);
+
+    KeReleaseSpinLock(&pDeviceExtension->BlockedLock, Irql);
+}
+
+
+//
+//	Completes a write that left the queue, the handle stops counting it.
+//
+static VOID
+CompleteBlockedWrite(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PIRP pIrp,
+    IN  NTSTATUS NtStatus,
+    IN  UINT dwDataWritten
+)
+{
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    InterlockedDecrement(&pHandle->lBlockedWrites);
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = NT_SUCCESS(NtStatus) ? dwDataWritten : 0;
+
+    StatsCompleteRequest(pDeviceExtension, pIrp);
+}
+
+
+static VOID
+CsqCompleteCanceledIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = CONTAINING_RECORD(pCsq, DEVICE_EXTENSION, BlockedWrites);
+
+    CompleteBlockedWrite(pDeviceExtension, pIrp, STATUS_CANCELLED, 0);
+}
+
+
+//
+//	Arms the retry timer unless a retry is already on its way or the
+//	driver is unloading.
+//
+static VOID
+ScheduleRetry(
+    IN  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    LARGE_INTEGER liDueTime;
+
+    if (InterlockedExchange(&pDeviceExtension->lRetryScheduled, 1))
+        return;
+
+    //
+    //	Released by the work item as the last thing it does, or by
+    //	FreeBlockedWrites if it cancels the timer.
+    //
+    if (!ExAcquireRundownProtection(&pDeviceExtension->RetryRundown))
+    {
+        InterlockedExchange(&pDeviceExtension->lRetryScheduled, 0);
+        return;
+    }
+
+    liDueTime.QuadPart = -FINGS_QUOTA_RETRY_INTERVAL;
+
+    KeSetTimer(&pDeviceExtension->RetryTimer, liDueTime, &pDeviceExtension->RetryDpc);
+}
+
+
+//
+//	Stores the message of a buffered or direct write again, from the
+//	system buffer or the locked pages the dispatch routine used, in the
+//	name of the thread that sent it.
+//
+static NTSTATUS
+RetryWrite(
+    IN  PIRP pIrp,
+    OUT  UINT* pdwDataWritten
+)
+{
+    PIO_STACK_LOCATION pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
+    PCHAR pWriteDataBuffer;
+
+    *pdwDataWritten = 0;
+
+    if (pIrp->MdlAddress)
+        pWriteDataBuffer = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority | MdlMappingNoExecute);
+    else
+        pWriteDataBuffer = (PCHAR)pIrp->AssociatedIrp.SystemBuffer;
+
+    if (!pWriteDataBuffer)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    if (!IsStringTerminated(pWriteDataBuffer, GetTransferLength(pIoStackIrp), pdwDataWritten))
+        return STATUS_UNSUCCESSFUL;
+
+    return StoreMessage(pIoStackIrp->FileObject, pWriteDataBuffer, *pdwDataWritten, TRUE,
+                        pIrp->Tail.Overlay.DriverContext[1], pIrp->Tail.Overlay.DriverContext[2]);
+}
+
+
+//
+//	Work item queued by the timer. Takes every waiting write off the
+//	queue and retries them oldest first. Once a write of a handle does
+//	not fit, the later ones of the same handle are not tried in this
+//	pass, and all that are left go back to the front in their order.
+//
+static VOID
+RetryBlockedWrites(
+    IN  PDEVICE_OBJECT pDeviceObject,
+    IN  PVOID pContext
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    NTSTATUS NtStatus;
+    PHANDLE_CONTEXT pHandle;
+    LIST_ENTRY Retried;
+    LIST_ENTRY Stalled;
+    PIRP pIrp;
+    ULONG ulPass;
+    UINT dwDataWritten;
+
+    UNREFERENCED_PARAMETER(pContext);
+
+    InitializeListHead(&Retried);
+    InitializeListHead(&Stalled);
+
+    //
+    //	Only one retry runs at a time, lRetryScheduled is still set.
+    //
+    ulPass = ++pDeviceExtension->ulRetryPass;
+
+    while ((pIrp = IoCsqRemoveNextIrp(&pDeviceExtension->BlockedWrites, NULL)) != NULL)
+        InsertTailList(&Retried, &pIrp->Tail.Overlay.ListEntry);
+
+    while (!IsListEmpty(&Retried))
+    {
+        pIrp = CONTAINING_RECORD(RemoveHeadList(&Retried), IRP, Tail.Overlay.ListEntry);
+        pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+        NtStatus = STATUS_RETRY;
+        dwDataWritten = 0;
+
+        if (pHandle->ulStalledPass != ulPass)
+        {
+            pHandle->pRetryThread = KeGetCurrentThread();
+            NtStatus = RetryWrite(pIrp, &dwDataWritten);
+            pHandle->pRetryThread = NULL;
+        }
+
+        if (NtStatus == STATUS_RETRY)
+        {
+            pHandle->ulStalledPass = ulPass;
+            InsertTailList(&Stalled, &pIrp->Tail.Overlay.ListEntry);
+            continue;
+        }
+
+        if (NT_SUCCESS(NtStatus))
+        {
+            HandleCountWrite(IoGetCurrentIrpStackLocation(pIrp)->FileObject, 1, dwDataWritten);
+            CompletePendingReads(pHandle->pChannel);
+        }
+
+        CompleteBlockedWrite(pDeviceExtension, pIrp, NtStatus, dwDataWritten);
+    }
+
+    //
+    //	Newer writes were queued meanwhile, the ones left go in front of
+    //	them, the newest first so the oldest ends up at the head.
+    //
+    while (!IsListEmpty(&Stalled))
+    {
+        pIrp = CONTAINING_RECORD(RemoveTailList(&Stalled), IRP, Tail.Overlay.ListEntry);
+
+        if (!NT_SUCCESS(IoCsqInsertIrpEx(&pDeviceExtension->BlockedWrites, pIrp, NULL, BLOCKED_INSERT_HEAD)))
+            CompleteBlockedWrite(pDeviceExtension, pIrp, STATUS_CANCELLED, 0);
+    }
+
+    //
+    //	A write queued after the queue was emptied above found the retry
+    //	still scheduled, so look again once it is not.
+    //
+    InterlockedExchange(&pDeviceExtension->lRetryScheduled, 0);
+
+    if (!IsListEmpty(&pDeviceExtension->BlockedList))
+        ScheduleRetry(pDeviceExtension);
+
+    //
+    //	Past this the work item may be freed, it is not touched again.
+    //
+    ExReleaseRundownProtection(&pDeviceExtension->RetryRundown);
+}
+
+
+//
+//	The retry timer fired, the writes are retried at PASSIVE_LEVEL where
+//	the quota may drop messages and the pages can be mapped.
+//
+static VOID
+RetryTimerDpc(
+    IN  PKDPC pDpc,
+    IN  PVOID pContext,
+    IN  PVOID pArgument1,
+    IN  PVOID pArgument2
+)
+{
+    PDEVICE_OBJECT pDeviceObject = pContext;
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+
+    UNREFERENCED_PARAMETER(pDpc);
+    UNREFERENCED_PARAMETER(pArgument1);
+    UNREFERENCED_PARAMETER(pArgument2);
+
+    IoQueueWorkItem(pDeviceExtension->pRetryWorkItem, RetryBlockedWrites, DelayedWorkQueue, NULL);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeBlockedWrites
+//
+//	Parameters:
+//		[IN]  DEVICE_OBJECT* pDeviceObject
+//		Our device object.
+//
+//	Routine Description:
+//		Prepares the empty queue of blocked writes, its retry timer and
+//		the work item retrying them.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeBlockedWrites(
+    IN  PDEVICE_OBJECT pDeviceObject
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+
+    pDeviceExtension->pRetryWorkItem = IoAllocateWorkItem(pDeviceObject);
+
+    if (!pDeviceExtension->pRetryWorkItem)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    InitializeListHead(&pDeviceExtension->BlockedList);
+    KeInitializeSpinLock(&pDeviceExtension->BlockedLock);
+    KeInitializeTimer(&pDeviceExtension->RetryTimer);
+    KeInitializeDpc(&pDeviceExtension->RetryDpc, RetryTimerDpc, pDeviceObject);
+    ExInitializeRundownProtection(&pDeviceExtension->RetryRundown);
+
+    IoCsqInitializeEx(
+        &pDeviceExtension->BlockedWrites,
+        CsqInsertIrp,
+        CsqRemoveIrp,
+        CsqPeekNextIrp,
+        CsqAcquireLock,
+        CsqReleaseLock,
+        CsqCompleteCanceledIrp
+    );
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeBlockedWrites
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Stops the retry timer, waits for a retry already started and frees
+//		the work item. Every handle is closed by then, so no write waits.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeBlockedWrites(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PAGED_CODE();
+
+    //
+    //	A timer that was still set never queues the work item, its
+    //	reference is dropped here. One that fired has, and the work item
+    //	drops it when it returns.
+    //
+    if (KeCancelTimer(&pDeviceExtension->RetryTimer))
+        ExReleaseRundownProtection(&pDeviceExtension->RetryRundown);
+
+    ExWaitForRundownProtectionRelease(&pDeviceExtension->RetryRundown);
+
+    IoFreeWorkItem(pDeviceExtension->pRetryWorkItem);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		BlockWrite
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Buffered or direct write StoreMessage returned STATUS_RETRY for.
+//
+//	Routine Description:
+//		Queues the write until its quota has room, it is cancelled or
+//		its handle is cleaned up. The writes of a handle are retried in
+//		the order they were sent.
+//
+//	Return Value:
+//		STATUS_PENDING.
+//
+//***********************************************************************************
+NTSTATUS
+BlockWrite(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PIRP pIrp
+)
+{
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    //
+    //	Counted before the write is visible, so that newer writes of the
+    //	handle line up behind it.
+    //
+    InterlockedIncrement(&pHandle->lBlockedWrites);
+
+    //
+    //	The retry runs in a worker thread, remember who wrote the message.
+    //	The first driver context holds the arrival time for the statistics
+    //	and the queue uses the last one.
+    //
+    pIrp->Tail.Overlay.DriverContext[1] = PsGetCurrentProcessId();
+    pIrp->Tail.Overlay.DriverContext[2] = PsGetCurrentThreadId();
+
+    IoMarkIrpPending(pIrp);
+
+    if (!NT_SUCCESS(IoCsqInsertIrpEx(&pDeviceExtension->BlockedWrites, pIrp, NULL, NULL)))
+    {
+        CompleteBlockedWrite(pDeviceExtension, pIrp, STATUS_CANCELLED, 0);
+        return STATUS_PENDING;
+    }
+
+    ScheduleRetry(pDeviceExtension);
+
+    return STATUS_PENDING;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CancelBlockedWrites
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Completes every write still waiting on the handle with
+//		STATUS_CANCELLED. A write the retry holds at that moment is
+//		cancelled when it would go back to the queue.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CancelBlockedWrites(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PFILE_OBJECT pFileObject
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    KIRQL OldIrql;
+    PIRP pIrp;
+
+    KeAcquireSpinLock(&pDeviceExtension->BlockedLock, &OldIrql);
+    pHandle->bClosing = TRUE;
+    KeReleaseSpinLock(&pDeviceExtension->BlockedLock, OldIrql);
+
+    while ((pIrp = IoCsqRemoveNextIrp(&pDeviceExtension->BlockedWrites, pFileObject)) != NULL)
+        CompleteBlockedWrite(pDeviceExtension, pIrp, STATUS_CANCELLED, 0);
+}
@@ -0,0 +1,517 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	channel.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the channels of the device. Opening					*
+* 	\\.\6FingsUsr\<name> opens the channel <name>, created on its				*
+* 	first open, and every channel has its own message queue, limits				*
+* 	and counters. Channels are kept in a hash table keyed by name,				*
+* 	and freed with their messages when their last handle is closed.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(INIT, InitializeChannels)
+#pragma alloc_text(PAGE, FreeChannels)
+#pragma alloc_text(PAGE, OpenChannel)
+#pragma alloc_text(PAGE, CloseChannel)
+#pragma alloc_text(PAGE, IoctlSetChannel)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Turns what is left of the path after the device name, nothing or
+//	"\<name>", into the name of the channel. pusName points into the
+//	file name, nothing is copied.
+//
+static NTSTATUS
+GetChannelName(
+    IN  PCUNICODE_STRING pusFileName,
+    OUT  PUNICODE_STRING pusName
+)
+{
+    USHORT usIndex;
+
+    *pusName = *pusFileName;
+
+    if (pusName->Length >= sizeof(WCHAR) && pusName->Buffer[0] == L'\\')
+    {
+        pusName->Buffer++;
+        pusName->Length -= sizeof(WCHAR);
+    }
+
+    pusName->MaximumLength = pusName->Length;
+
+    if (pusName->Length > FINGS_CHANNEL_MAX_NAME * sizeof(WCHAR))
+        return STATUS_OBJECT_NAME_INVALID;
+
+    for (usIndex = 0; usIndex < pusName->Length / sizeof(WCHAR); usIndex++)
+    {
+        if (pusName->Buffer[usIndex] == L'\\' || pusName->Buffer[usIndex] < L' ')
+            return STATUS_OBJECT_NAME_INVALID;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+//
+//	Allocates a channel named usName with its own empty queue. The name
+//	is copied right after the structure.
+//
+static NTSTATUS
+CreateChannel(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PCUNICODE_STRING pusName,
+    IN  ULONG ulHash,
+    OUT  PCHANNEL* ppChannel
+)
+{
+    NTSTATUS NtStatus;
+    PCHANNEL pChannel;
+
+    *ppChannel = NULL;
+
+    //
+    //	Cache aligned so that llSequence really starts a line, the name
+    //	only follows after the padding at the end of the structure.
+    //
+    pChannel = ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, sizeof(CHANNEL) + pusName->Length, FINGS_POOL_TAG);
+
+    if (!pChannel)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    pChannel->ulHash = ulHash;
+    pChannel->pDeviceExtension = pDeviceExtension;
+
+    RtlInitEmptyUnicodeString(&pChannel->usName, (PWCH)(pChannel + 1), pusName->Length);
+    RtlCopyUnicodeString(&pChannel->usName, pusName);
+
+    NtStatus = InitializeShards(pChannel);
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        ExFreePoolWithTag(pChannel, FINGS_POOL_TAG);
+        return NtStatus;
+    }
+
+    KeInitializeSpinLock(&pChannel->ReadLock);
+    InitializePendingReads(pChannel);
+    InitializeListHead(&pChannel->Subscribers);
+    InitializeSharedRing(pChannel);
+
+    *ppChannel = pChannel;
+
+    return STATUS_SUCCESS;
+}
+
+
+//
+//	Frees a channel taken out of the table, with the messages nobody
+//	read. Nothing but the eviction and the expiry DPC can still reach
+//	it: it leaves the eviction list first, and freeing its messages
+//	takes them out of the timing wheel before the DPC is waited for.
+//
+static VOID
+DeleteChannel(
+    IN  PCHANNEL pChannel
+)
+{
+    PFINGS_MESSAGE pMessage;
+    ULONG ulShard;
+
+    SetChannelPriority(pChannel, FINGS_CHANNEL_PRIORITY_NORMAL);
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        while ((pMessage = RingDequeue(&pChannel->pShards[ulShard])) != NULL)
+            FreeMessage(pChannel->pDeviceExtension, pMessage);
+    }
+
+    WaitForTrim(pChannel);
+
+    FreeShards(pChannel);
+    FreeSharedRing(pChannel);
+    ExFreePoolWithTag(pChannel, FINGS_POOL_TAG);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeChannels
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty table of channels. The default channel is
+//		created like the others, on its first open.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeChannels(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    ULONG ulBucket;
+
+    for (ulBucket = 0; ulBucket < FINGS_CHANNEL_BUCKETS; ulBucket++)
+        InitializeListHead(&pDeviceExtension->ChannelBuckets[ulBucket]);
+
+    pDeviceExtension->ulChannelCount = 0;
+    ExInitializeFastMutex(&pDeviceExtension->ChannelLock);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeChannels
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the channels left with the messages nobody has read. Every
+//		handle has been closed by then, which freed its channel already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeChannels(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PLIST_ENTRY pEntry;
+    PCHANNEL pChannel;
+    ULONG ulBucket;
+
+    PAGED_CODE();
+
+    for (ulBucket = 0; ulBucket < FINGS_CHANNEL_BUCKETS; ulBucket++)
+    {
+        while (!IsListEmpty(&pDeviceExtension->ChannelBuckets[ulBucket]))
+        {
+            pEntry = RemoveHeadList(&pDeviceExtension->ChannelBuckets[ulBucket]);
+            pChannel = CONTAINING_RECORD(pEntry, CHANNEL, HashEntry);
+
+            DeleteChannel(pChannel);
+        }
+    }
+
+    pDeviceExtension->ulChannelCount = 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		OpenChannel
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		File object of the create, its FileName names the channel.
+//
+//		[OUT]  CHANNEL** ppChannel
+//		Receives the channel.
+//
+//	Routine Description:
+//		Finds the channel by the hash of its name, creating it if no
+//		handle has it open, and counts the new handle on it. Names are
+//		compared without regard to case.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_OBJECT_NAME_INVALID if the name is not a valid channel name.
+//		STATUS_QUOTA_EXCEEDED if there are FINGS_CHANNEL_MAX_COUNT channels already.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+OpenChannel(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PFILE_OBJECT pFileObject,
+    OUT  PCHANNEL* ppChannel
+)
+{
+    NTSTATUS NtStatus;
+    UNICODE_STRING usName;
+    PLIST_ENTRY pBucket, pEntry;
+    PCHANNEL pChannel = NULL;
+    ULONG ulHash;
+
+    PAGED_CODE();
+
+    *ppChannel = NULL;
+
+    //
+    //	A channel is opened by its path from the device, not relative to
+    //	another handle.
+    //
+    if (pFileObject->RelatedFileObject)
+        return STATUS_OBJECT_NAME_INVALID;
+
+    NtStatus = GetChannelName(&pFileObject->FileName, &usName);
+
+    if (NT_SUCCESS(NtStatus))
+        NtStatus = RtlHashUnicodeString(&usName, TRUE, HASH_STRING_ALGORITHM_DEFAULT, &ulHash);
+
+    if (!NT_SUCCESS(NtStatus))
+        return NtStatus;
+
+    pBucket = &pDeviceExtension->ChannelBuckets[ulHash & (FINGS_CHANNEL_BUCKETS - 1)];
+
+    ExAcquireFastMutex(&pDeviceExtension->ChannelLock);
+
+    for (pEntry = pBucket->Flink; pEntry != pBucket; pEntry = pEntry->Flink)
+    {
+        pChannel = CONTAINING_RECORD(pEntry, CHANNEL, HashEntry);
+
+        if (pChannel->ulHash == ulHash && RtlEqualUnicodeString(&pChannel->usName, &usName, TRUE))
+            break;
+
+        pChannel = NULL;
+    }
+
+    if (!pChannel)
+    {
+        if (pDeviceExtension->ulChannelCount >= FINGS_CHANNEL_MAX_COUNT)
+            NtStatus = STATUS_QUOTA_EXCEEDED;
+        else
+            NtStatus = CreateChannel(pDeviceExtension, &usName, ulHash, &pChannel);
+
+        if (NT_SUCCESS(NtStatus))
+        {
+            InsertTailList(pBucket, &pChannel->HashEntry);
+            pDeviceExtension->ulChannelCount++;
+        }
+    }
+
+    if (NT_SUCCESS(NtStatus))
+        pChannel->ulHandles++;
+
+    ExReleaseFastMutex(&pDeviceExtension->ChannelLock);
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        LOG_WARNING("Channel open failed with 0x%08X", NtStatus);
+        return NtStatus;
+    }
+
+    *ppChannel = pChannel;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CloseChannel
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel a handle was opened on by OpenChannel.
+//
+//	Routine Description:
+//		Counts the handle off the channel. The last one takes the channel
+//		out of the table and frees it, with the messages nobody has read,
+//		once the lock is released. A create finding no channel by then
+//		makes a new one. Every request of the handle is done by then.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CloseChannel(
+    IN  PCHANNEL pChannel
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    BOOLEAN bLast;
+
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&pDeviceExtension->ChannelLock);
+
+    bLast = (--pChannel->ulHandles == 0);
+
+    if (bLast)
+    {
+        RemoveEntryList(&pChannel->HashEntry);
+        pDeviceExtension->ulChannelCount--;
+    }
+
+    ExReleaseFastMutex(&pDeviceExtension->ChannelLock);
+
+    if (bLast)
+        DeleteChannel(pChannel);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryChannel
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_CHANNEL request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the limits and counters of the channel of the handle.
+//		Resident, it takes ReadLock to read the read counters.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryChannel(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pIoStackIrp->FileObject);
+    PFINGS_CHANNEL_INFO pInfo = pIrp->AssociatedIrp.SystemBuffer;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    ULONG ulShard;
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(FINGS_CHANNEL_INFO) || !pInfo)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlZeroMemory(pInfo, sizeof(FINGS_CHANNEL_INFO));
+
+    pInfo->Limits = pChannel->Limits;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        pInfo->ullMessagesWritten += pChannel->pShardCounters[ulShard].ullMessagesWritten;
+        pInfo->ullBytesWritten += pChannel->pShardCounters[ulShard].ullBytesWritten;
+        pInfo->ullBytesStored += pChannel->pShardCounters[ulShard].ullBytesStored;
+    }
+
+    KeAcquireInStackQueuedSpinLock(&pChannel->ReadLock, &LockHandle);
+
+    pInfo->ullMessagesRead = pChannel->ullMessagesRead;
+    pInfo->ullBytesRead = pChannel->ullBytesRead;
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    pInfo->ullMessagesRejected = (ULONG64)pChannel->llMessagesRejected;
+    pInfo->ullMessagesExpired = (ULONG64)pChannel->llMessagesExpired;
+    pInfo->ullMessagesEvicted = (ULONG64)pChannel->llMessagesEvicted;
+    pInfo->ulMessages = ShardsMessageCount(pChannel);
+    pInfo->ulHandles = *(volatile ULONG*)&pChannel->ulHandles;
+    pInfo->ulSubscribers = *(volatile ULONG*)&pChannel->ulSubscriberCount;
+    pInfo->ullLastSequence = (ULONG64)ReadNoFence64(&pChannel->llSequence);
+
+    *pInformation = sizeof(FINGS_CHANNEL_INFO);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetChannel
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_CHANNEL request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the limits of the channel of the handle. Messages
+//		already queued stay even if there are more than the new limit,
+//		and stay as they were stored when compression is turned on or off.
+//		A new TTL only applies to messages written from then on.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the priority is not one of FINGS_CHANNEL_PRIORITY_*, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetChannel(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pIoStackIrp->FileObject);
+    PFINGS_CHANNEL_LIMITS pLimits = pIrp->AssociatedIrp.SystemBuffer;
+    NTSTATUS NtStatus;
+
+    PAGED_CODE();
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_CHANNEL_LIMITS) || !pLimits)
+        return STATUS_INVALID_PARAMETER;
+
+    if (pLimits->ulPriority > FINGS_CHANNEL_PRIORITY_LOW)
+        return STATUS_INVALID_PARAMETER;
+
+    if (pLimits->ulCompressMinLength)
+    {
+        NtStatus = EnableCompression(pChannel->pDeviceExtension);
+
+        if (!NT_SUCCESS(NtStatus))
+            return NtStatus;
+    }
+
+    pChannel->Limits = *pLimits;
+    SetChannelPriority(pChannel, pLimits->ulPriority);
+
+    LOG_INFO(
+        "Channel limits set to %u messages of %u bytes, compressing from %u bytes, TTL %u ms, priority %u",
+        pLimits->ulMaxMessages,
+        pLimits->ulMaxMessageLength,
+        pLimits->ulCompressMinLength,
+        pLimits->ulMessageTtl,
+        pLimits->ulPriority
+    );
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	compress.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the compression of waiting messages. A					*
+* 	channel that turns it on keeps each message LZ compressed while it			*
+* 	waits, when that makes it shorter, and expands it again as it is			*
+* 	read. Every processor has its own workspace, allocated when the				*
+* 	first channel turns compression on.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(INIT, InitializeCompression)
+#pragma alloc_text(PAGE, EnableCompression)
+#pragma alloc_text(PAGE, FreeCompression)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Notes how many workspaces are needed, one for every processor the
+//		system can have. They are only allocated by EnableCompression.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeCompression(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    pDeviceExtension->ulCompressCpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    pDeviceExtension->pCompressCpus = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		EnableCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Allocates the workspaces unless a channel did so already. Two
+//		channels turning compression on at once both allocate, the one
+//		that loses the race frees its copy.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+EnableCompression(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PCOMPRESS_CPU pCompressCpus;
+
+    PAGED_CODE();
+
+    if (pDeviceExtension->pCompressCpus)
+        return STATUS_SUCCESS;
+
+    pCompressCpus = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(COMPRESS_CPU) * pDeviceExtension->ulCompressCpuCount,
+        FINGS_POOL_TAG
+    );
+
+    if (!pCompressCpus)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    if (InterlockedCompareExchangePointer((PVOID volatile*)&pDeviceExtension->pCompressCpus, pCompressCpus, NULL))
+        ExFreePoolWithTag(pCompressCpus, FINGS_POOL_TAG);
+    else
+        LOG_INFO("Compression workspaces allocated for %u processors", pDeviceExtension->ulCompressCpuCount);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeCompression
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the workspaces, if they were ever allocated.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeCompression(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PAGED_CODE();
+
+    if (pDeviceExtension->pCompressCpus)
+        ExFreePoolWithTag(pDeviceExtension->pCompressCpus, FINGS_POOL_TAG);
+
+    pDeviceExtension->pCompressCpus = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CompressMessage
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is written to.
+//
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message as written, not queued yet.
+//
+//	Routine Description:
+//		Compresses the message if the channel asks for it and its length
+//		qualifies. The block goes to the workspace of the current
+//		processor first, only a block shorter than the message is copied
+//		to a message of its own, which replaces the one written.
+//
+//		Runs at PASSIVE_LEVEL. The thread may be switched out or moved to
+//		another processor meanwhile, the workspace stays its own until
+//		lBusy is cleared. A writer finding it taken keeps its message as
+//		written rather than wait.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The message to queue, the one passed in when it was not compressed.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+CompressMessage(
+    IN  PCHANNEL pChannel,
+    IN  PFINGS_MESSAGE pMessage
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    PCOMPRESS_CPU pCompressCpus = pDeviceExtension->pCompressCpus;
+    ULONG ulMinLength = *(volatile ULONG*)&pChannel->Limits.ulCompressMinLength;
+    PFINGS_MESSAGE pCompressed = NULL;
+    PCOMPRESS_CPU pCpu;
+    SIZE_T cbStored;
+
+    if (!ulMinLength || !pCompressCpus)
+        return pMessage;
+
+    if (pMessage->ulLength < ulMinLength || pMessage->ulLength > FINGS_COMPRESS_MAX_LENGTH)
+        return pMessage;
+
+    pCpu = &pCompressCpus[KeGetCurrentProcessorNumberEx(NULL)];
+
+    if (InterlockedExchange(&pCpu->lBusy, 1))
+        return pMessage;
+
+    cbStored = LzCompress(pMessage->Data, pMessage->ulLength, pCpu->Output, pMessage->ulLength - 1, pCpu->Table);
+
+    if (cbStored)
+    {
+        pCompressed = AllocateMessage(pDeviceExtension, (UINT)cbStored);
+
+        if (pCompressed)
+            RtlCopyMemory(pCompressed->Data, pCpu->Output, cbStored);
+    }
+
+    InterlockedExchange(&pCpu->lBusy, 0);
+
+    if (!pCompressed)
+        return pMessage;
+
+    //
+    //	The quota moves with the message, it stays charged for the length written.
+    //
+    pCompressed->ulLength = pMessage->ulLength;
+    pCompressed->pQuota = pMessage->pQuota;
+    pMessage->pQuota = NULL;
+    FreeMessage(pDeviceExtension, pMessage);
+
+    return pCompressed;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ExpandMessage
+//
+//	Parameters:
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message taken off a queue.
+//
+//		[OUT]  CHAR* pBuffer
+//		Receives the ulLength bytes of the message, may be a user mode
+//		buffer the caller guards.
+//
+//	Routine Description:
+//		Copies the message out, expanding it if it was kept compressed.
+//		The decoder checks every length and offset against the block and
+//		the output, so a buffer changed by its owner meanwhile only
+//		spoils the owner's copy.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_DATA_ERROR.
+//
+//***********************************************************************************
+NTSTATUS
+ExpandMessage(
+    IN  PFINGS_MESSAGE pMessage,
+    OUT  PCHAR pBuffer
+)
+{
+    if (pMessage->ulStoredLength == pMessage->ulLength)
+    {
+        RtlCopyMemory(pBuffer, pMessage->Data, pMessage->ulLength);
+        return STATUS_SUCCESS;
+    }
+
+    if (LzDecompress(pMessage->Data, pMessage->ulStoredLength, pBuffer, pMessage->ulLength) != pMessage->ulLength)
+    {
+        LOG_ERROR("Compressed message of %u bytes is damaged", pMessage->ulLength);
+        return STATUS_DATA_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
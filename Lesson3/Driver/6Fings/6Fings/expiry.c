@@ -0,0 +1,688 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	expiry.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the expiry of messages and their eviction				*
+* 	when memory runs low. Messages with a TTL wait in a hierarchical			*
+* 	timing wheel that a periodic timer turns, the ones whose tick came			*
+* 	are dropped from the head of their ring. While the system is low on			*
+* 	nonpaged pool the oldest messages of low priority channels go too.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Messages taken out of a ring under its lock at a time, they are
+//	freed once it is released.
+//
+#define EXPIRY_BATCH			32
+
+//
+//	Ticks turned by one run of the DPC at most. After the system slept
+//	the wheel catches up over the following runs.
+//
+#define EXPIRY_MAX_TURNS		1024
+
+//
+//	What the wheel timer may be delayed by so it fires with others.
+//
+#define EXPIRY_TOLERANCE_MS		(FINGS_EXPIRY_TICK_MS / 2)
+
+#define WHEEL_MASK				(FINGS_WHEEL_SLOTS - 1)
+#define WHEEL_SPAN				(1ULL << (FINGS_WHEEL_BITS * FINGS_WHEEL_LEVELS))
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Everything but setting up and tearing down takes the wheel lock or
+//	runs in the timer DPC, and stays resident.
+//
+#pragma alloc_text(INIT, InitializeExpiry)
+#pragma alloc_text(PAGE, FreeExpiry)
+#pragma alloc_text(PAGE, WaitForTrim)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Tick of the wheel the interrupt time is in.
+//
+static ULONG64
+CurrentTick(
+    IN  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    return (KeQueryInterruptTime() - pDeviceExtension->ullWheelStart) / FINGS_EXPIRY_TICK;
+}
+
+
+//
+//	Puts the entry in the slot of its tick, on the lowest level whose
+//	turn reaches it. A tick already past goes in the slot turned next,
+//	one beyond the last level is brought back within it. The caller
+//	holds WheelLock.
+//
+static VOID
+WheelInsert(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PEXPIRY pExpiry
+)
+{
+    ULONG64 ullTick = pDeviceExtension->ullWheelTick;
+    ULONG64 ullDelta;
+    ULONG ulLevel = 0;
+
+    if (pExpiry->ullTick > ullTick)
+    {
+        ullDelta = pExpiry->ullTick - ullTick;
+
+        if (ullDelta >= WHEEL_SPAN)
+            pExpiry->ullTick = ullTick + WHEEL_SPAN - 1;
+
+        while (ulLevel < FINGS_WHEEL_LEVELS - 1 && ullDelta >= 1ULL << (FINGS_WHEEL_BITS * (ulLevel + 1)))
+            ulLevel++;
+
+        ullTick = pExpiry->ullTick;
+    }
+
+    InsertTailList(
+        &pDeviceExtension->Wheel[ulLevel][(ullTick >> (FINGS_WHEEL_BITS * ulLevel)) & WHEEL_MASK],
+        &pExpiry->WheelEntry
+    );
+}
+
+
+//
+//	Moves the entries of a slot above level 0 down to the level their
+//	tick is now close enough for. The caller holds WheelLock.
+//
+static VOID
+WheelCascade(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension,
+    IN  ULONG ulLevel,
+    IN  ULONG ulSlot
+)
+{
+    PLIST_ENTRY pSlot = &pDeviceExtension->Wheel[ulLevel][ulSlot];
+    LIST_ENTRY Entries;
+
+    if (IsListEmpty(pSlot))
+        return;
+
+    //
+    //	Taken off first, an entry may land in the same slot again.
+    //
+    Entries = *pSlot;
+    Entries.Flink->Blink = &Entries;
+    Entries.Blink->Flink = &Entries;
+    InitializeListHead(pSlot);
+
+    while (!IsListEmpty(&Entries))
+        WheelInsert(pDeviceExtension, CONTAINING_RECORD(RemoveHeadList(&Entries), EXPIRY, WheelEntry));
+}
+
+
+//
+//	Turns the wheel by the tick ullWheelTick. Its entries are marked
+//	expired and their channels queued on pTrimList. The caller holds
+//	WheelLock.
+//
+static VOID
+WheelTurn(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PLIST_ENTRY pTrimList
+)
+{
+    ULONG64 ullTick = pDeviceExtension->ullWheelTick;
+    PLIST_ENTRY pSlot = &pDeviceExtension->Wheel[0][ullTick & WHEEL_MASK];
+    PEXPIRY pExpiry;
+    PCHANNEL pChannel;
+    ULONG ulLevel;
+    ULONG ulSlot;
+
+    //
+    //	Level 0 went round, bring down the next slot of the level above,
+    //	and so on up while they went round as well.
+    //
+    for (ulLevel = 1; !(ullTick & WHEEL_MASK) && ulLevel < FINGS_WHEEL_LEVELS; ulLevel++)
+    {
+        ulSlot = (ULONG)(ullTick >> (FINGS_WHEEL_BITS * ulLevel)) & WHEEL_MASK;
+        WheelCascade(pDeviceExtension, ulLevel, ulSlot);
+
+        if (ulSlot)
+            break;
+    }
+
+    while (!IsListEmpty(pSlot))
+    {
+        pExpiry = CONTAINING_RECORD(RemoveHeadList(pSlot), EXPIRY, WheelEntry);
+        InitializeListHead(&pExpiry->WheelEntry);
+        pExpiry->bExpired = TRUE;
+        pDeviceExtension->ulWheelEntries--;
+
+        pChannel = pExpiry->pChannel;
+
+        if (!pChannel->bTrimQueued)
+        {
+            pChannel->bTrimQueued = TRUE;
+            InsertTailList(pTrimList, &pChannel->TrimEntry);
+        }
+    }
+
+    pDeviceExtension->ullWheelTick = ullTick + 1;
+}
+
+
+//
+//	Frees messages taken out of a channel and counts them in *pllCounter.
+//
+static VOID
+FreeMessageBatch(
+    IN  PCHANNEL pChannel,
+    IN  PFINGS_MESSAGE* ppMessages,
+    IN  ULONG ulCount,
+    IN OUT  volatile LONG64* pllCounter
+)
+{
+    ULONG ulIndex;
+
+    if (!ulCount)
+        return;
+
+    for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+        FreeMessage(pChannel->pDeviceExtension, ppMessages[ulIndex]);
+
+    InterlockedAdd64(pllCounter, ulCount);
+}
+
+
+//
+//	Drops the expired messages at the head of every ring of the channel.
+//	One behind a message still alive goes once it reaches the head.
+//
+static VOID
+TrimExpired(
+    IN  PCHANNEL pChannel
+)
+{
+    PFINGS_MESSAGE Messages[EXPIRY_BATCH];
+    PFINGS_MESSAGE pMessage;
+    PMESSAGE_RING pRing;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    ULONG ulShard;
+    ULONG ulCount;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        pRing = &pChannel->pShards[ulShard];
+
+        do
+        {
+            ulCount = 0;
+
+            KeAcquireInStackQueuedSpinLockAtDpcLevel(&pChannel->ReadLock, &LockHandle);
+
+            while (ulCount < EXPIRY_BATCH &&
+                (pMessage = RingPeek(pRing)) != NULL &&
+                FINGS_MESSAGE_EXPIRED(pMessage))
+            {
+                RingDequeue(pRing);
+                Messages[ulCount++] = pMessage;
+            }
+
+            KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+            FreeMessageBatch(pChannel, Messages, ulCount, &pChannel->llMessagesExpired);
+
+        } while (ulCount == EXPIRY_BATCH);
+    }
+}
+
+
+//
+//	Drops a batch of the oldest messages of every low priority channel.
+//	Runs on each tick while memory stays low.
+//
+static VOID
+EvictMessages(
+    IN  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PFINGS_MESSAGE Messages[EXPIRY_BATCH];
+    PFINGS_MESSAGE pMessage;
+    PCHANNEL pChannel;
+    PLIST_ENTRY pEntry;
+    KLOCK_QUEUE_HANDLE EvictHandle;
+    KLOCK_QUEUE_HANDLE ReadHandle;
+    ULONG ulShard;
+    ULONG ulCount;
+    ULONG ulEvicted = 0;
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&pDeviceExtension->EvictLock, &EvictHandle);
+
+    for (pEntry = pDeviceExtension->EvictableChannels.Flink;
+        pEntry != &pDeviceExtension->EvictableChannels;
+        pEntry = pEntry->Flink)
+    {
+        pChannel = CONTAINING_RECORD(pEntry, CHANNEL, EvictEntry);
+        ulCount = 0;
+
+        KeAcquireInStackQueuedSpinLockAtDpcLevel(&pChannel->ReadLock, &ReadHandle);
+
+        while (ulCount < EXPIRY_BATCH && (pMessage = ShardPeek(pChannel, &ulShard)) != NULL)
+        {
+            RingDequeue(&pChannel->pShards[ulShard]);
+            Messages[ulCount++] = pMessage;
+        }
+
+        KeReleaseInStackQueuedSpinLockFromDpcLevel(&ReadHandle);
+
+        FreeMessageBatch(pChannel, Messages, ulCount, &pChannel->llMessagesEvicted);
+        ulEvicted += ulCount;
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&EvictHandle);
+
+    if (ulEvicted)
+        LOG_WARNING("Nonpaged pool is low, evicted %u messages", ulEvicted);
+}
+
+
+//
+//	The wheel timer fired. Turns the wheel up to the current tick, drops
+//	what expired and, while memory is low, evicts.
+//
+static VOID
+WheelTimerDpc(
+    IN  PKDPC pDpc,
+    IN  PVOID pContext,
+    IN  PVOID pArgument1,
+    IN  PVOID pArgument2
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pContext;
+    LIST_ENTRY TrimList;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PCHANNEL pChannel;
+    ULONG64 ullNow;
+    ULONG ulTurns;
+
+    UNREFERENCED_PARAMETER(pDpc);
+    UNREFERENCED_PARAMETER(pArgument1);
+    UNREFERENCED_PARAMETER(pArgument2);
+
+    //
+    //	A run still going on another processor does this tick's work too.
+    //
+    if (InterlockedExchange(&pDeviceExtension->lWheelBusy, 1))
+        return;
+
+    InitializeListHead(&TrimList);
+    ullNow = CurrentTick(pDeviceExtension);
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&pDeviceExtension->WheelLock, &LockHandle);
+
+    for (ulTurns = 0; pDeviceExtension->ullWheelTick <= ullNow && ulTurns < EXPIRY_MAX_TURNS; ulTurns++)
+    {
+        //
+        //	Nothing to expire, the wheel jumps straight to now.
+        //
+        if (!pDeviceExtension->ulWheelEntries)
+        {
+            pDeviceExtension->ullWheelTick = ullNow + 1;
+            break;
+        }
+
+        WheelTurn(pDeviceExtension, &TrimList);
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    while (!IsListEmpty(&TrimList))
+    {
+        pChannel = CONTAINING_RECORD(RemoveHeadList(&TrimList), CHANNEL, TrimEntry);
+
+        TrimExpired(pChannel);
+
+        //
+        //	Past this the channel may be freed, see WaitForTrim.
+        //
+        KeMemoryBarrier();
+        pChannel->bTrimQueued = FALSE;
+    }
+
+    if (pDeviceExtension->pLowMemoryEvent && KeReadStateEvent(pDeviceExtension->pLowMemoryEvent))
+        EvictMessages(pDeviceExtension);
+
+    InterlockedExchange(&pDeviceExtension->lWheelBusy, 0);
+}
+
+
+//
+//	Sets the wheel timer going the first time it is needed, it then runs
+//	until the driver unloads.
+//
+static VOID
+StartWheel(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    LARGE_INTEGER liDueTime;
+
+    if (pDeviceExtension->lWheelStarted || InterlockedExchange(&pDeviceExtension->lWheelStarted, 1))
+        return;
+
+    liDueTime.QuadPart = -(LONG64)FINGS_EXPIRY_TICK;
+
+    KeSetCoalescableTimer(
+        &pDeviceExtension->WheelTimer,
+        liDueTime,
+        FINGS_EXPIRY_TICK_MS,
+        EXPIRY_TOLERANCE_MS,
+        &pDeviceExtension->WheelDpc
+    );
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeExpiry
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty timing wheel, its timer, and the list of low
+//		priority channels. Without the low memory event messages still
+//		expire, they are just never evicted.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeExpiry(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    UNICODE_STRING usEventName;
+    ULONG ulLevel;
+    ULONG ulSlot;
+
+    for (ulLevel = 0; ulLevel < FINGS_WHEEL_LEVELS; ulLevel++)
+    {
+        for (ulSlot = 0; ulSlot < FINGS_WHEEL_SLOTS; ulSlot++)
+            InitializeListHead(&pDeviceExtension->Wheel[ulLevel][ulSlot]);
+    }
+
+    KeInitializeSpinLock(&pDeviceExtension->WheelLock);
+    pDeviceExtension->ulWheelEntries = 0;
+    pDeviceExtension->ullWheelTick = 0;
+    pDeviceExtension->ullWheelStart = KeQueryInterruptTime();
+    pDeviceExtension->lWheelStarted = 0;
+    pDeviceExtension->lWheelBusy = 0;
+
+    KeInitializeTimer(&pDeviceExtension->WheelTimer);
+    KeInitializeDpc(&pDeviceExtension->WheelDpc, WheelTimerDpc, pDeviceExtension);
+
+    InitializeListHead(&pDeviceExtension->EvictableChannels);
+    KeInitializeSpinLock(&pDeviceExtension->EvictLock);
+
+    RtlInitUnicodeString(&usEventName, L"\\KernelObjects\\LowNonPagedPoolCondition");
+
+    pDeviceExtension->pLowMemoryEvent = IoCreateNotificationEvent(&usEventName, &pDeviceExtension->hLowMemoryEvent);
+
+    if (!pDeviceExtension->pLowMemoryEvent)
+        LOG_WARNING("No low memory event, messages will not be evicted");
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeExpiry
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Stops the wheel timer, waits for a run of its DPC already queued
+//		and closes the low memory event. Called before the channels are
+//		freed, the entries left go with their messages.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeExpiry(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PAGED_CODE();
+
+    KeCancelTimer(&pDeviceExtension->WheelTimer);
+    KeFlushQueuedDpcs();
+
+    if (pDeviceExtension->pLowMemoryEvent)
+    {
+        ZwClose(pDeviceExtension->hLowMemoryEvent);
+        pDeviceExtension->pLowMemoryEvent = NULL;
+    }
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ArmExpiry
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is about to be queued in.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message not queued yet, compressed already.
+//
+//		[IN]  ULONG ulTtl
+//		Milliseconds the message may wait, not 0.
+//
+//	Routine Description:
+//		Gives the message an entry in the timing wheel, on the first tick
+//		at least ulTtl milliseconds away. The entry is freed with the
+//		message, by FreeMessage.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+ArmExpiry(
+    IN  PCHANNEL pChannel,
+    IN OUT  PFINGS_MESSAGE pMessage,
+    IN  ULONG ulTtl
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PEXPIRY pExpiry;
+
+    pExpiry = SlabAllocate(&pDeviceExtension->MessageSlab, sizeof(EXPIRY));
+
+    if (!pExpiry)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    //
+    //	The current tick is partly gone, the message waits one more.
+    //
+    pExpiry->ullTick = CurrentTick(pDeviceExtension) + ((ULONG64)ulTtl + FINGS_EXPIRY_TICK_MS - 1) / FINGS_EXPIRY_TICK_MS + 1;
+    pExpiry->pChannel = pChannel;
+    pExpiry->bExpired = FALSE;
+
+    pMessage->pExpiry = pExpiry;
+
+    KeAcquireInStackQueuedSpinLock(&pDeviceExtension->WheelLock, &LockHandle);
+
+    WheelInsert(pDeviceExtension, pExpiry);
+    pDeviceExtension->ulWheelEntries++;
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    StartWheel(pDeviceExtension);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		DisarmExpiry
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message being freed, with an entry in the wheel.
+//
+//	Routine Description:
+//		Takes the entry of the message out of the wheel, unless it expired
+//		already, and frees it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+DisarmExpiry(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PFINGS_MESSAGE pMessage
+)
+{
+    PEXPIRY pExpiry = pMessage->pExpiry;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    KeAcquireInStackQueuedSpinLock(&pDeviceExtension->WheelLock, &LockHandle);
+
+    if (!pExpiry->bExpired)
+    {
+        RemoveEntryList(&pExpiry->WheelEntry);
+        pDeviceExtension->ulWheelEntries--;
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    pMessage->pExpiry = NULL;
+    SlabFree(&pDeviceExtension->MessageSlab, pExpiry, sizeof(EXPIRY));
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SetChannelPriority
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel whose limits changed.
+//
+//		[IN]  ULONG ulPriority
+//		FINGS_CHANNEL_PRIORITY_NORMAL or FINGS_CHANNEL_PRIORITY_LOW.
+//
+//	Routine Description:
+//		Adds a low priority channel to the channels evicted from while
+//		memory is low, or takes a normal one off.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SetChannelPriority(
+    IN OUT  PCHANNEL pChannel,
+    IN  ULONG ulPriority
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    BOOLEAN bEvictable = (ulPriority == FINGS_CHANNEL_PRIORITY_LOW);
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    KeAcquireInStackQueuedSpinLock(&pDeviceExtension->EvictLock, &LockHandle);
+
+    if (bEvictable && !pChannel->bEvictable)
+        InsertTailList(&pDeviceExtension->EvictableChannels, &pChannel->EvictEntry);
+    else if (!bEvictable && pChannel->bEvictable)
+        RemoveEntryList(&pChannel->EvictEntry);
+
+    pChannel->bEvictable = bEvictable;
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    if (bEvictable)
+        StartWheel(pDeviceExtension);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		WaitForTrim
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel being freed, its messages are gone already.
+//
+//	Routine Description:
+//		Waits for a run of the wheel DPC that found messages of the channel
+//		expired and may still be trimming its rings. Such a run queued the
+//		channel under WheelLock, before the messages were freed, so taking
+//		the lock sees bTrimQueued set. No later run can queue it again, it
+//		has no entry left in the wheel. Only a channel freed while one of
+//		its messages expires pays for the flush.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+WaitForTrim(
+    IN  PCHANNEL pChannel
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    BOOLEAN bTrimQueued;
+
+    PAGED_CODE();
+
+    KeAcquireInStackQueuedSpinLock(&pDeviceExtension->WheelLock, &LockHandle);
+    bTrimQueued = *(volatile BOOLEAN*)&pChannel->bTrimQueued;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    if (bTrimQueued)
+        KeFlushQueuedDpcs();
+}
@@ -0,0 +1,335 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	fastio.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the fast I/O routines. The I/O manager calls			*
+* 	them before it builds an IRP, with the caller's buffers as they are.		*
+* 	Small messages are stored or fetched right there, anything the				*
+* 	routines cannot finish on the spot is left to the dispatch routines		*
+* 	by returning FALSE.															*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static FAST_IO_DISPATCH g_FastIoDispatch;
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(INIT, InitializeFastIo)
+#pragma alloc_text(PAGE, FastIoDeviceControl)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Stores the message in pBuffer like the write control codes do.
+//	Returns FALSE, leaving the request to the IRP path, if the message is
+//	not small enough to be worth it or if the handle's writes may have to
+//	wait for its quota, which only an IRP can do.
+//
+static BOOLEAN
+FastWriteMessage(
+    IN  PFILE_OBJECT pFileObject,
+    IN  PVOID pBuffer,
+    IN  ULONG ulLength,
+    OUT  PIO_STATUS_BLOCK pIoStatus
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
+    UINT dwDataWritten = 0;
+
+    if (!pBuffer || !ulLength || ulLength > FINGS_FAST_IO_MAX_LENGTH)
+        return FALSE;
+
+    if (*(volatile ULONG*)&pHandle->Settings.ulFullPolicy == FINGS_QUOTA_BLOCK)
+        return FALSE;
+
+    __try
+    {
+        //
+        //	Nothing was probed for us, the buffer is whatever the caller passed.
+        //
+        if (ExGetPreviousMode() != KernelMode)
+            ProbeForRead(pBuffer, ulLength, TYPE_ALIGNMENT(char));
+
+        if (IsStringTerminated(pBuffer, ulLength, &dwDataWritten))
+            NtStatus = StoreMessage(pFileObject, pBuffer, dwDataWritten, FALSE, PsGetCurrentProcessId(), PsGetCurrentThreadId());
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        NtStatus = GetExceptionCode();
+    }
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pFileObject, 1, dwDataWritten);
+        CompletePendingReads(FINGS_FILE_CHANNEL(pFileObject));
+    }
+    else
+        dwDataWritten = 0;
+
+    pIoStatus->Status = NtStatus;
+    pIoStatus->Information = dwDataWritten;
+
+    return TRUE;
+}
+
+
+//
+//	Stores the message gathered from the segments in pInputBuffer like
+//	IoctlWriteVector does. The array is captured first, the caller could
+//	change it while the segments are walked.
+//
+static BOOLEAN
+FastWriteVector(
+    IN  PFILE_OBJECT pFileObject,
+    IN  PVOID pInputBuffer,
+    IN  ULONG ulInputLength,
+    OUT  PIO_STATUS_BLOCK pIoStatus
+)
+{
+    FINGS_WRITE_SEGMENT Segments[FINGS_VECTOR_MAX_SEGMENTS];
+    KPROCESSOR_MODE RequestorMode = ExGetPreviousMode();
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    UINT dwDataWritten = 0;
+
+    if (!pInputBuffer || !ulInputLength || ulInputLength % sizeof(FINGS_WRITE_SEGMENT) ||
+        ulInputLength > sizeof(Segments))
+        return FALSE;
+
+    __try
+    {
+        if (RequestorMode != KernelMode)
+            ProbeForRead(pInputBuffer, ulInputLength, TYPE_ALIGNMENT(ULONG));
+
+        RtlCopyMemory(Segments, pInputBuffer, ulInputLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        NtStatus = GetExceptionCode();
+    }
+
+    if (NT_SUCCESS(NtStatus))
+        NtStatus = StoreSegments(pFileObject, Segments, ulInputLength / sizeof(FINGS_WRITE_SEGMENT), RequestorMode, &dwDataWritten);
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pFileObject, 1, dwDataWritten);
+        CompletePendingReads(FINGS_FILE_CHANNEL(pFileObject));
+    }
+
+    pIoStatus->Status = NtStatus;
+    pIoStatus->Information = dwDataWritten;
+
+    return TRUE;
+}
+
+
+//
+//	Fills pBuffer like the read control codes do. Returns FALSE,
+//	leaving the request to the IRP path, if the buffer is large or if the
+//	read has to wait for a message, which only an IRP can do.
+//
+static BOOLEAN
+FastReadMessages(
+    IN  PFILE_OBJECT pFileObject,
+    OUT  PVOID pBuffer,
+    IN  ULONG ulLength,
+    OUT  PIO_STATUS_BLOCK pIoStatus
+)
+{
+    NTSTATUS NtStatus;
+    UINT dwDataRead = 0;
+
+    if (!pBuffer || !ulLength || ulLength > FINGS_FAST_IO_MAX_LENGTH)
+        return FALSE;
+
+    __try
+    {
+        if (ExGetPreviousMode() != KernelMode)
+            ProbeForWrite(pBuffer, ulLength, TYPE_ALIGNMENT(char));
+
+        NtStatus = FetchMessages(pFileObject, pBuffer, ulLength, &dwDataRead);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        NtStatus = GetExceptionCode();
+    }
+
+    //
+    //	On an overlapped handle a read of an empty device waits for the next write.
+    //
+    if (NT_SUCCESS(NtStatus) && !dwDataRead && !(pFileObject->Flags & FO_SYNCHRONOUS_IO))
+        return FALSE;
+
+    if (NT_SUCCESS(NtStatus))
+        HandleCountRead(pFileObject, dwDataRead);
+
+    pIoStatus->Status = NtStatus;
+    pIoStatus->Information = dwDataRead;
+
+    return TRUE;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeFastIo
+//
+//	Parameters:
+//		[IN/OUT]  DRIVER_OBJECT* pDriverObject
+//		Our driver object.
+//
+//	Routine Description:
+//		Hands the fast I/O routines to the I/O manager. The entries left
+//		NULL are file system operations, the I/O manager builds an IRP
+//		for them as if there was no table. FastIoRead and FastIoWrite are
+//		among them, the I/O manager only tries those on a file object with
+//		a cache map, which the device does not have.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeFastIo(
+    IN OUT  PDRIVER_OBJECT pDriverObject
+)
+{
+    RtlZeroMemory(&g_FastIoDispatch, sizeof(g_FastIoDispatch));
+
+    g_FastIoDispatch.SizeOfFastIoDispatch = sizeof(g_FastIoDispatch);
+    g_FastIoDispatch.FastIoDeviceControl = FastIoDeviceControl;
+
+    pDriverObject->FastIoDispatch = &g_FastIoDispatch;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FastIoDeviceControl
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the request was issued on.
+//
+//		[IN]  BOOLEAN bWait
+//		Ignored, the routine never blocks.
+//
+//		[IN]  PVOID pInputBuffer
+//		Caller's input buffer, not probed.
+//
+//		[IN]  ULONG ulInputBufferLength
+//		Length of the input buffer.
+//
+//		[OUT]  PVOID pOutputBuffer
+//		Caller's output buffer, not probed.
+//
+//		[IN]  ULONG ulOutputBufferLength
+//		Length of the output buffer.
+//
+//		[IN]  ULONG ulIoControlCode
+//		Control code of the request.
+//
+//		[OUT]  IO_STATUS_BLOCK* pIoStatus
+//		Result of the request when the routine returns TRUE.
+//
+//		[IN]  DEVICE_OBJECT* pDeviceObject
+//		Our device object.
+//
+//	Routine Description:
+//		Serves IOCTL_6FINGS_READ_*, IOCTL_6FINGS_WRITE_* and
+//		IOCTL_6FINGS_WRITE_VECTOR for small messages whatever their
+//		transfer method, the buffers are the same ones the method would
+//		have handed to the dispatch routine. Every other control code
+//		goes to DispatchIoControl.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the request was served, FALSE to send an IRP instead.
+//
+//***********************************************************************************
+BOOLEAN
+FastIoDeviceControl(
+    IN  PFILE_OBJECT pFileObject,
+    IN  BOOLEAN bWait,
+    IN  PVOID pInputBuffer,
+    IN  ULONG ulInputBufferLength,
+    OUT  PVOID pOutputBuffer,
+    IN  ULONG ulOutputBufferLength,
+    IN  ULONG ulIoControlCode,
+    OUT  PIO_STATUS_BLOCK pIoStatus,
+    IN  PDEVICE_OBJECT pDeviceObject
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    LONG64 llStart = KeQueryPerformanceCounter(NULL).QuadPart;
+    BOOLEAN bServed;
+
+    UNREFERENCED_PARAMETER(bWait);
+
+    PAGED_CODE();
+
+    switch (ulIoControlCode)
+    {
+    case IOCTL_6FINGS_WRITE_BUFFERED:
+    case IOCTL_6FINGS_WRITE_NEITHER:
+        bServed = FastWriteMessage(pFileObject, pInputBuffer, ulInputBufferLength, pIoStatus);
+        break;
+
+    //
+    //	METHOD_IN_DIRECT passes the message as the output buffer.
+    //
+    case IOCTL_6FINGS_WRITE_DIRECT:
+        bServed = FastWriteMessage(pFileObject, pOutputBuffer, ulOutputBufferLength, pIoStatus);
+        break;
+
+    case IOCTL_6FINGS_WRITE_VECTOR:
+        bServed = FastWriteVector(pFileObject, pInputBuffer, ulInputBufferLength, pIoStatus);
+        break;
+
+    case IOCTL_6FINGS_READ_BUFFERED:
+    case IOCTL_6FINGS_READ_DIRECT:
+    case IOCTL_6FINGS_READ_NEITHER:
+        bServed = FastReadMessages(pFileObject, pOutputBuffer, ulOutputBufferLength, pIoStatus);
+        break;
+
+    default:
+        bServed = FALSE;
+        break;
+    }
+
+    if (!bServed)
+        return FALSE;
+
+    TRACE3(TRACE_FAST_IO_DEVICE_CONTROL, ulIoControlCode, pIoStatus->Status, pIoStatus->Information);
+
+    if (FINGS_IOCTL_WRITES_MESSAGE(ulIoControlCode))
+        StatsCountRequest(pDeviceExtension, IRP_MJ_DEVICE_CONTROL, llStart, pIoStatus->Status, pIoStatus->Information, 0);
+    else
+        StatsCountRequest(pDeviceExtension, IRP_MJ_DEVICE_CONTROL, llStart, pIoStatus->Status, ulInputBufferLength, pIoStatus->Information);
+
+    return TRUE;
+}
@@ -62,11 +62,16 @@
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Create dispatch routine. All the requests are completed
-//		successfuly.
+//		Create dispatch routine. Opens the channel named by the rest of
+//		the path, or the default one, gives the new handle its context on
+//		that channel.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		NTSTATUS
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_OBJECT_NAME_INVALID if the channel name is not valid.
+//		STATUS_QUOTA_EXCEEDED if there are too many channels.
+//		Else the return value is some error status.
 //
 //***********************************************************************************
 NTSTATUS
@@ -75,10 +80,27 @@ DispatchCreate(
     IN OUT  PIRP pIrp
     )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    UNREFERENCED_PARAMETER(pIrp);
-    NTSTATUS NtStatus = STATUS_SUCCESS;
-    DbgPrint("DispatchCreate Called \r\n");
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    PFILE_OBJECT pFileObject = IoGetCurrentIrpStackLocation(pIrp)->FileObject;
+    PCHANNEL pChannel;
+    NTSTATUS NtStatus;
+    StatsStartRequest(pIrp);
+
+    NtStatus = OpenChannel(pDeviceExtension, pFileObject, &pChannel);
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        NtStatus = CreateHandleContext(pFileObject, pChannel);
+
+        if (!NT_SUCCESS(NtStatus))
+            CloseChannel(pChannel);
+    }
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = 0;
+
+    TRACE1(TRACE_DISPATCH_CREATE, NtStatus);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -96,7 +118,9 @@ DispatchCreate(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Cleanup dispatch routine. All the requests are completed
+//		Cleanup dispatch routine. Cancels the reads still pending and the
+//		writes still blocked on the handle, ends its subscription and
+//		unmaps its view of the shared ring, all the requests are completed
 //		successfuly.
 //
 //	Return Value:
@@ -109,10 +133,25 @@ DispatchCleanup(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    UNREFERENCED_PARAMETER(pIrp);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    PFILE_OBJECT pFileObject = IoGetCurrentIrpStackLocation(pIrp)->FileObject;
     NTSTATUS NtStatus = STATUS_SUCCESS;
-    DbgPrint("DispatchCleanup Called \r\n");
+    StatsStartRequest(pIrp);
+
+    //
+    //	The handle is going away, its pending reads, its blocked writes,
+    //	its subscription and its mapping of the shared ring go with it.
+    //
+    CancelPendingReads(FINGS_FILE_CHANNEL(pFileObject), pFileObject);
+    CancelBlockedWrites(pDeviceExtension, pFileObject);
+    Unsubscribe(pFileObject);
+    UnmapSharedRing(pFileObject);
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = 0;
+
+    TRACE1(TRACE_DISPATCH_CLEANUP, NtStatus);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -130,8 +169,8 @@ DispatchCleanup(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Close dispatch routine. All the requests are completed
-//		successfuly.
+//		Close dispatch routine. Frees the handle context, all the
+//		requests are completed successfuly.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -143,10 +182,17 @@ DispatchClose(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    UNREFERENCED_PARAMETER(pIrp);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
     NTSTATUS NtStatus = STATUS_SUCCESS;
-    DbgPrint("DispatchClose Called \r\n");
+    StatsStartRequest(pIrp);
+
+    DeleteHandleContext(IoGetCurrentIrpStackLocation(pIrp)->FileObject);
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = 0;
+
+    TRACE1(TRACE_DISPATCH_CLOSE, NtStatus);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -164,8 +210,8 @@ DispatchClose(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		IO Control dispatch routine. All the requests are completed
-//		successfuly.
+//		IO Control dispatch routine. Hands the request to the handler of
+//		its control code, unknown codes fail with STATUS_INVALID_DEVICE_REQUEST.
 //
 //	Return Value:
 //		NTSTATUS
@@ -179,10 +225,125 @@ DispatchIoControl(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    UNREFERENCED_PARAMETER(pIrp);
-    NTSTATUS NtStatus = STATUS_SUCCESS;
-    DbgPrint("DispatchIoControl Called \r\n");
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    NTSTATUS NtStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PIO_STACK_LOCATION pIoStackIrp = NULL;
+    ULONG_PTR Information = 0;
+
+    pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
+
+    //
+    //	Single messages, the routines complete the request themselves and
+    //	start counting it, which must only happen once.
+    //
+    if (pIoStackIrp)
+    {
+        switch (pIoStackIrp->Parameters.DeviceIoControl.IoControlCode)
+        {
+        case IOCTL_6FINGS_WRITE_BUFFERED:
+            return DispatchWriteBufferedIO(pDeviceObject, pIrp);
+
+        case IOCTL_6FINGS_WRITE_DIRECT:
+            return DispatchWriteDirectIO(pDeviceObject, pIrp);
+
+        case IOCTL_6FINGS_WRITE_NEITHER:
+            return DispatchWriteNeither(pDeviceObject, pIrp);
+
+        case IOCTL_6FINGS_READ_BUFFERED:
+            return DispatchReadBufferedIO(pDeviceObject, pIrp);
+
+        case IOCTL_6FINGS_READ_DIRECT:
+            return DispatchReadDirectIO(pDeviceObject, pIrp);
+
+        case IOCTL_6FINGS_READ_NEITHER:
+            return DispatchReadNeither(pDeviceObject, pIrp);
+
+        default:
+            break;
+        }
+    }
+
+    StatsStartRequest(pIrp);
+
+    if (pIoStackIrp)
+    {
+        switch (pIoStackIrp->Parameters.DeviceIoControl.IoControlCode)
+        {
+        case IOCTL_6FINGS_WRITE_VECTOR:
+            NtStatus = IoctlWriteVector(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_SUBMIT_BATCH:
+            NtStatus = IoctlSubmitBatch(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_MAP_RING:
+            NtStatus = IoctlMapRing(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_RING_WAIT:
+            NtStatus = IoctlRingWait(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_RING_WAKE:
+            NtStatus = IoctlRingWake(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_QUERY_STATS:
+            NtStatus = IoctlQueryStats(pDeviceExtension, pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_DUMP_TRACE:
+            NtStatus = IoctlDumpTrace(pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_QUERY_HANDLE:
+            NtStatus = IoctlQueryHandle(pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_SET_HANDLE:
+            NtStatus = IoctlSetHandle(pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_QUERY_CHANNEL:
+            NtStatus = IoctlQueryChannel(pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_SET_CHANNEL:
+            NtStatus = IoctlSetChannel(pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_SUBSCRIBE:
+            NtStatus = IoctlSubscribe(pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_PUBLISH:
+            NtStatus = IoctlPublish(pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_SET_PROCESS_QUOTA:
+            NtStatus = IoctlSetProcessQuota(pIrp, pIoStackIrp);
+            break;
+
+        case IOCTL_6FINGS_QUERY_PROCESS_QUOTA:
+            NtStatus = IoctlQueryProcessQuota(pIrp, pIoStackIrp, &Information);
+            break;
+
+        case IOCTL_6FINGS_QUERY_RANGE:
+            NtStatus = IoctlQueryRange(pIrp, pIoStackIrp, &Information);
+            break;
+
+        default:
+            break;
+        }
+
+        TRACE3(TRACE_DISPATCH_IO_CONTROL, pIoStackIrp->Parameters.DeviceIoControl.IoControlCode, NtStatus, Information);
+    }
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = Information;
+
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -200,11 +361,12 @@ DispatchIoControl(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write Direct I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write Direct I/O dispatch routine. Validated messages are appended
+//		to the device ring. A write over the quota of a handle set to
+//		FINGS_QUOTA_BLOCK pends until the quota has room.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -213,13 +375,13 @@ DispatchWriteDirectIO(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
     NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
     PCHAR pWriteDataBuffer;
     UINT dwDataWritten = 0;
 
-    DbgPrint("DispatchWriteDirectIO Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
@@ -229,18 +391,32 @@ DispatchWriteDirectIO(
 
         if (pWriteDataBuffer)
         {
-            if (IsStringTerminated(pWriteDataBuffer, pIoStackIrp->Parameters.Write.Length, &dwDataWritten))
+            if (IsStringTerminated(pWriteDataBuffer, GetTransferLength(pIoStackIrp), &dwDataWritten))
             {
-                DbgPrint(pWriteDataBuffer);
-                NtStatus = STATUS_SUCCESS;
+                NtStatus = StoreMessage(pIoStackIrp->FileObject, pWriteDataBuffer, dwDataWritten, TRUE, PsGetCurrentProcessId(), PsGetCurrentThreadId());
             }
         }
     }
 
+    if (NtStatus == STATUS_RETRY)
+    {
+        TRACE1(TRACE_DISPATCH_WRITE_BLOCKED, dwDataWritten);
+        return BlockWrite(pDeviceExtension, pIrp);
+    }
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pIoStackIrp->FileObject, 1, dwDataWritten);
+        CompletePendingReads(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject));
+    }
+    else
+        dwDataWritten = 0;
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataWritten;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_WRITE_DIRECT, NtStatus, dwDataWritten);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -258,11 +434,12 @@ DispatchWriteDirectIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write buffered I/O dispatch routine. Validated messages are appended
+//		to the device ring. A write over the quota of a handle set to
+//		FINGS_QUOTA_BLOCK pends until the quota has room.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -271,13 +448,13 @@ DispatchWriteBufferedIO(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
     NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
     PCHAR pWriteDataBuffer;
     UINT dwDataWritten = 0;
 
-    DbgPrint("DispatchWriteBufferedIO Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
@@ -287,18 +464,32 @@ DispatchWriteBufferedIO(
 
         if (pWriteDataBuffer)
         {
-            if (IsStringTerminated(pWriteDataBuffer, pIoStackIrp->Parameters.Write.Length, &dwDataWritten))
+            if (IsStringTerminated(pWriteDataBuffer, GetTransferLength(pIoStackIrp), &dwDataWritten))
             {
-                DbgPrint(pWriteDataBuffer);
-                NtStatus = STATUS_SUCCESS;
+                NtStatus = StoreMessage(pIoStackIrp->FileObject, pWriteDataBuffer, dwDataWritten, TRUE, PsGetCurrentProcessId(), PsGetCurrentThreadId());
             }
         }
     }
 
+    if (NtStatus == STATUS_RETRY)
+    {
+        TRACE1(TRACE_DISPATCH_WRITE_BLOCKED, dwDataWritten);
+        return BlockWrite(pDeviceExtension, pIrp);
+    }
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pIoStackIrp->FileObject, 1, dwDataWritten);
+        CompletePendingReads(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject));
+    }
+    else
+        dwDataWritten = 0;
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataWritten;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_WRITE_BUFFERED, NtStatus, dwDataWritten);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -316,8 +507,8 @@ DispatchWriteBufferedIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Write neither buffered nor direct I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Write neither buffered nor direct I/O dispatch routine. Validated messages
+//		are appended to the device ring.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -329,13 +520,13 @@ DispatchWriteNeither(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
     NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
     PCHAR pWriteDataBuffer;
     UINT dwDataWritten = 0;
 
-    DbgPrint("DispatchWriteNeither Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
@@ -343,21 +534,26 @@ DispatchWriteNeither(
     {
         __try 
         {
+            //
+            //	METHOD_NEITHER control codes pass the message as the input buffer.
+            //
+            if (pIoStackIrp->MajorFunction == IRP_MJ_DEVICE_CONTROL)
+                pWriteDataBuffer = pIoStackIrp->Parameters.DeviceIoControl.Type3InputBuffer;
+            else
+                pWriteDataBuffer = pIrp->UserBuffer;
+
             #pragma warning(push)
             #pragma warning(disable : 4116)
 
-            ProbeForRead(pIrp->UserBuffer, pIoStackIrp->Parameters.Write.Length, TYPE_ALIGNMENT(char));
+            ProbeForRead(pWriteDataBuffer, GetTransferLength(pIoStackIrp), TYPE_ALIGNMENT(char));
             
             #pragma warning(pop)
-            
-            pWriteDataBuffer = pIrp->UserBuffer;
 
             if (pWriteDataBuffer)
             {
-                if (IsStringTerminated(pWriteDataBuffer, pIoStackIrp->Parameters.Write.Length, &dwDataWritten))
+                if (IsStringTerminated(pWriteDataBuffer, GetTransferLength(pIoStackIrp), &dwDataWritten))
                 {
-                    DbgPrint(pWriteDataBuffer);
-                    NtStatus = STATUS_SUCCESS;
+                    NtStatus = StoreMessage(pIoStackIrp->FileObject, pWriteDataBuffer, dwDataWritten, FALSE, PsGetCurrentProcessId(), PsGetCurrentThreadId());
                 }
             }
         }
@@ -367,10 +563,19 @@ DispatchWriteNeither(
         }
     }
 
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pIoStackIrp->FileObject, 1, dwDataWritten);
+        CompletePendingReads(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject));
+    }
+    else
+        dwDataWritten = 0;
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataWritten;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_WRITE_NEITHER, NtStatus, dwDataWritten);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -388,11 +593,13 @@ DispatchWriteNeither(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read direct I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Read direct I/O dispatch routine. Returns the oldest messages
+//		written to the device, as many as fit. If there is none the read
+//		completes with no data, or pends until a write on handles opened
+//		for overlapped I/O.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -401,34 +608,44 @@ DispatchReadDirectIO(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    NTSTATUS NtStatus = STATUS_BUFFER_TOO_SMALL;
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
-    PCHAR pReturnData = "DispatchReadBufferedIO - Hello from the Kernel!";
-    UINT dwDataSize = sizeof("DispatchReadBufferedIO - Hello from the Kernel!");
     UINT dwDataRead = 0;
     PCHAR pReadDataBuffer;
 
-    DbgPrint("DispatchReadBufferedIO Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
-    if (pIoStackIrp)
+    if (pIoStackIrp && pIrp->MdlAddress)
     {
-        pReadDataBuffer = (PCHAR)pIrp->AssociatedIrp.SystemBuffer;
+        pReadDataBuffer = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority);
 
-        if (pReadDataBuffer && pIoStackIrp->Parameters.Read.Length >= dwDataSize)
+        if (pReadDataBuffer)
         {
-            RtlCopyMemory(pReadDataBuffer, pReturnData, dwDataSize);
-            dwDataRead = dwDataSize;
-            NtStatus = STATUS_SUCCESS;
+            NtStatus = FetchMessages(pIoStackIrp->FileObject, pReadDataBuffer, GetTransferLength(pIoStackIrp), &dwDataRead);
         }
     }
 
+    //
+    //	On an overlapped handle a read of an empty device waits for the next write.
+    //
+    if (NT_SUCCESS(NtStatus) && !dwDataRead && GetTransferLength(pIoStackIrp) &&
+        !(pIoStackIrp->FileObject->Flags & FO_SYNCHRONOUS_IO))
+    {
+        TRACE1(TRACE_DISPATCH_READ_PENDED, GetTransferLength(pIoStackIrp));
+        return PendRead(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp);
+    }
+
+    if (NT_SUCCESS(NtStatus))
+        HandleCountRead(pIoStackIrp->FileObject, dwDataRead);
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataRead;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_READ_DIRECT, NtStatus, dwDataRead);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -446,11 +663,13 @@ DispatchReadDirectIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read buffered I/O dispatch routine. All the requests are completed
-//		successfuly.
+//		Read buffered I/O dispatch routine. Returns the oldest messages
+//		written to the device, as many as fit. If there is none the read
+//		completes with no data, or pends until a write on handles opened
+//		for overlapped I/O.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_SUCCESS or STATUS_PENDING.
 //
 //***********************************************************************************
 NTSTATUS
@@ -459,34 +678,44 @@ DispatchReadBufferedIO(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    NTSTATUS NtStatus = STATUS_BUFFER_TOO_SMALL;
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
-    PCHAR pReturnData = "DispatchReadDirectIO - Hello from the Kernel!";
-    UINT dwDataSize = sizeof("DispatchReadDirectIO - Hello from the Kernel!");
     UINT dwDataRead = 0;
     PCHAR pReadDataBuffer;
 
-    DbgPrint("DispatchReadDirectIO Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
-    if (pIoStackIrp && pIrp->MdlAddress)
+    if (pIoStackIrp)
     {
-        pReadDataBuffer = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority);
+        pReadDataBuffer = (PCHAR)pIrp->AssociatedIrp.SystemBuffer;
 
-        if (pReadDataBuffer && pIoStackIrp->Parameters.Read.Length >= dwDataSize)
+        if (pReadDataBuffer)
         {
-            RtlCopyMemory(pReadDataBuffer, pReturnData, dwDataSize);
-            dwDataRead = dwDataSize;
-            NtStatus = STATUS_SUCCESS;
+            NtStatus = FetchMessages(pIoStackIrp->FileObject, pReadDataBuffer, GetTransferLength(pIoStackIrp), &dwDataRead);
         }
     }
 
+    //
+    //	On an overlapped handle a read of an empty device waits for the next write.
+    //
+    if (NT_SUCCESS(NtStatus) && !dwDataRead && GetTransferLength(pIoStackIrp) &&
+        !(pIoStackIrp->FileObject->Flags & FO_SYNCHRONOUS_IO))
+    {
+        TRACE1(TRACE_DISPATCH_READ_PENDED, GetTransferLength(pIoStackIrp));
+        return PendRead(FINGS_FILE_CHANNEL(pIoStackIrp->FileObject), pIrp);
+    }
+
+    if (NT_SUCCESS(NtStatus))
+        HandleCountRead(pIoStackIrp->FileObject, dwDataRead);
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataRead;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_READ_BUFFERED, NtStatus, dwDataRead);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -504,8 +733,9 @@ DispatchReadBufferedIO(
 //		The IO request packet to process.
 //
 //	Routine Description:
-//		Read neither direct nor buffered dispatch routine. All the requests are completed
-//		successfuly.
+//		Read neither direct nor buffered dispatch routine. Returns the oldest
+//		messages written to the device, as many as fit, or no data if there is none.
+//		It never pends, the user buffer is only valid in the context of the caller.
 //
 //	Return Value:
 //		STATUS_SUCCESS.
@@ -517,15 +747,13 @@ DispatchReadNeither(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    NTSTATUS NtStatus = STATUS_BUFFER_TOO_SMALL;
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
+    NTSTATUS NtStatus = STATUS_UNSUCCESSFUL;
     PIO_STACK_LOCATION pIoStackIrp = NULL;
-    PCHAR pReturnData = "DispatchReadNeither - Hello from the Kernel!";
-    UINT dwDataSize = sizeof("DispatchReadNeither - Hello from the Kernel!");
     UINT dwDataRead = 0;
     PCHAR pReadDataBuffer;
 
-    DbgPrint("DispatchReadNeither Called \r\n");
+    StatsStartRequest(pIrp);
 
     pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
 
@@ -533,15 +761,13 @@ DispatchReadNeither(
     {
         __try {
 
-            if (pIoStackIrp->Parameters.Read.Length >= dwDataSize && pIrp->UserBuffer)
+            if (pIrp->UserBuffer)
             {
 
-                ProbeForWrite(pIrp->UserBuffer, pIoStackIrp->Parameters.Read.Length, sizeof(char));
+                ProbeForWrite(pIrp->UserBuffer, GetTransferLength(pIoStackIrp), sizeof(char));
                 pReadDataBuffer = pIrp->UserBuffer;
 
-                RtlCopyMemory(pReadDataBuffer, pReturnData, dwDataSize);
-                dwDataRead = dwDataSize;
-                NtStatus = STATUS_SUCCESS;
+                NtStatus = FetchMessages(pIoStackIrp->FileObject, pReadDataBuffer, GetTransferLength(pIoStackIrp), &dwDataRead);
             }
 
         }
@@ -552,10 +778,14 @@ DispatchReadNeither(
 
     }
 
+    if (NT_SUCCESS(NtStatus))
+        HandleCountRead(pIoStackIrp->FileObject, dwDataRead);
+
     pIrp->IoStatus.Status = NtStatus;
     pIrp->IoStatus.Information = dwDataRead;
 
-    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+    TRACE2(TRACE_DISPATCH_READ_NEITHER, NtStatus, dwDataRead);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -574,10 +804,10 @@ DispatchReadNeither(
 //
 //	Routine Description:
 //		Generic dispatch routine. All the requests are completed
-//		successfuly.
+//		with STATUS_NOT_SUPPORTED.
 //
 //	Return Value:
-//		STATUS_SUCCESS.
+//		STATUS_NOT_SUPPORTED.
 //
 //***********************************************************************************
 NTSTATUS
@@ -586,10 +816,15 @@ DispatchUnSupportedFunction(
     IN OUT  PIRP pIrp
 )
 {
-    UNREFERENCED_PARAMETER(pDeviceObject);
-    UNREFERENCED_PARAMETER(pIrp);
+    PDEVICE_EXTENSION pDeviceExtension = pDeviceObject->DeviceExtension;
     NTSTATUS NtStatus = STATUS_NOT_SUPPORTED;
-    DbgPrint("DispatchUnSupportedFunction Called \r\n");
+    StatsStartRequest(pIrp);
+
+    pIrp->IoStatus.Status = NtStatus;
+    pIrp->IoStatus.Information = 0;
+
+    TRACE1(TRACE_DISPATCH_UNSUPPORTED, IoGetCurrentIrpStackLocation(pIrp)->MajorFunction);
+    StatsCompleteRequest(pDeviceExtension, pIrp);
 
     return NtStatus;
 }
@@ -626,22 +861,598 @@ IsStringTerminated(
 )
 {
     BOOLEAN bStringIsTerminated = FALSE;
-    UINT uiIndex = 0;
+    SIZE_T Index = 0;
 
     *pdwStringLength = 0;
 
-    while (uiIndex < uiLength && bStringIsTerminated == FALSE)
+    Index = FindNullCharacter(pString, uiLength);
+
+    if (Index < uiLength)
     {
-        if (pString[uiIndex] == '\0')
+        *pdwStringLength = (UINT)Index + 1; /* Include the total count we read, includes the NULL */
+        bStringIsTerminated = TRUE;
+    }
+
+    return bStringIsTerminated;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		GetTransferLength
+//
+//	Parameters:
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Stack location of a read, write or IOCTL_6FINGS_READ_* / WRITE_* request.
+// 
+//	Routine Description:
+//		Returns the length of the buffer carrying the message, which depends
+//		on the major function and, for control codes, on the transfer method.
+//		Resident, pending reads are completed with it at DISPATCH_LEVEL.
+//
+//	Return Value:
+//		ULONG.
+//		Length of the message buffer in bytes.
+//
+//***********************************************************************************
+ULONG
+GetTransferLength(
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    ULONG ulIoControlCode;
+
+    switch (pIoStackIrp->MajorFunction)
+    {
+    case IRP_MJ_WRITE:
+        return pIoStackIrp->Parameters.Write.Length;
+
+    case IRP_MJ_READ:
+        return pIoStackIrp->Parameters.Read.Length;
+
+    case IRP_MJ_DEVICE_CONTROL:
+        ulIoControlCode = pIoStackIrp->Parameters.DeviceIoControl.IoControlCode;
+
+        //
+        //	Reads fill the output buffer. Writes pass the message in the input
+        //	buffer, except METHOD_IN_DIRECT where the locked output buffer is the message.
+        //
+        if (ulIoControlCode == IOCTL_6FINGS_READ_BUFFERED ||
+            ulIoControlCode == IOCTL_6FINGS_READ_DIRECT ||
+            ulIoControlCode == IOCTL_6FINGS_READ_NEITHER ||
+            METHOD_FROM_CTL_CODE(ulIoControlCode) == METHOD_IN_DIRECT)
+            return pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength;
+
+        return pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength;
+
+    default:
+        return 0;
+    }
+}
+
+
+//***********************************************************************************
+//	Function:
+//		AllocateMessage
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  UINT uiLength
+//		Length of the message including NULL character.
+//
+//	Routine Description:
+//		Allocates a message from the message slab and sets its length.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The message, or NULL if there is not enough memory.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+AllocateMessage(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  UINT uiLength
+)
+{
+    PFINGS_MESSAGE pMessage;
+
+    pMessage = SlabAllocate(&pDeviceExtension->MessageSlab, FINGS_MESSAGE_SIZE(uiLength));
+
+    if (pMessage)
+    {
+        pMessage->pQuota = NULL;
+        pMessage->pExpiry = NULL;
+        pMessage->ulLength = uiLength;
+        pMessage->ulStoredLength = uiLength;
+    }
+
+    return pMessage;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeMessage
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  FINGS_MESSAGE* pMessage
+//		Message returned by AllocateMessage.
+//
+//	Routine Description:
+//		Gives the message back to the message slab, takes it off the quota
+//		it was charged to and out of the timing wheel. The size class is
+//		found again from ulStoredLength, which must not have changed.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeMessage(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PFINGS_MESSAGE pMessage
+)
+{
+    if (pMessage->pQuota)
+        ReleaseQuota(pDeviceExtension, pMessage->pQuota, pMessage->ulLength);
+
+    if (pMessage->pExpiry)
+        DisarmExpiry(pDeviceExtension, pMessage);
+
+    SlabFree(&pDeviceExtension->MessageSlab, pMessage, FINGS_MESSAGE_SIZE(pMessage->ulStoredLength));
+}
+
+
+//
+//	Checks a message of uiLength bytes against the limits of the channel
+//	before any memory is spent on it.
+//
+static NTSTATUS
+AdmitMessage(
+    IN  PCHANNEL pChannel,
+    IN  UINT uiLength
+)
+{
+    ULONG ulMaxMessages = *(volatile ULONG*)&pChannel->Limits.ulMaxMessages;
+    ULONG ulMaxMessageLength = *(volatile ULONG*)&pChannel->Limits.ulMaxMessageLength;
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+
+    if (ulMaxMessageLength && uiLength > ulMaxMessageLength)
+        NtStatus = STATUS_INVALID_BUFFER_SIZE;
+
+    //
+    //	Counted without a lock, writers racing each other may overshoot the limit.
+    //
+    else if (ulMaxMessages && ShardsMessageCount(pChannel) >= ulMaxMessages)
+        NtStatus = STATUS_DEVICE_BUSY;
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        InterlockedIncrement64(&pChannel->llMessagesRejected);
+        LOG_WARNING("Message of %u bytes over the limits of its channel", uiLength);
+    }
+
+    return NtStatus;
+}
+
+
+//
+//	Appends a message filled by the caller to the ring of the current
+//	processor of the handle's channel, with the TTL of the handle or else
+//	of the channel and the ids of the thread that wrote it, or frees it if
+//	NtStatus says the copy failed or the ring is full. Returns the final
+//	status of the message.
+//
+static NTSTATUS
+QueueMessage(
+    IN  PFILE_OBJECT pFileObject,
+    IN  PFINGS_MESSAGE pMessage,
+    IN  NTSTATUS NtStatus,
+    IN  HANDLE hProcessId,
+    IN  HANDLE hThreadId
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PCHANNEL pChannel = pHandle->pChannel;
+    ULONG ulTtl;
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        //
+        //	A user mode buffer can change after it was validated, terminate it again.
+        //
+        pMessage->Data[pMessage->ulLength - 1] = '\0';
+        pMessage = CompressMessage(pChannel, pMessage);
+        pMessage->ulProcessId = (ULONG)(ULONG_PTR)hProcessId;
+        pMessage->ulThreadId = (ULONG)(ULONG_PTR)hThreadId;
+
+        ulTtl = *(volatile ULONG*)&pHandle->Settings.ulMessageTtl;
+
+        if (!ulTtl)
+            ulTtl = *(volatile ULONG*)&pChannel->Limits.ulMessageTtl;
+
+        //
+        //	Armed before the message is visible, once queued a reader may free it.
+        //
+        if (ulTtl)
+            NtStatus = ArmExpiry(pChannel, pMessage, ulTtl);
+    }
+
+    if (NT_SUCCESS(NtStatus) && !ShardEnqueue(pChannel, pMessage))
+    {
+        InterlockedIncrement64(&pChannel->llMessagesRejected);
+        NtStatus = STATUS_DEVICE_BUSY;
+    }
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        LOG_VERBOSE("Stored a message of %u bytes", pMessage->ulLength);
+    }
+    else
+    {
+        LOG_WARNING("Message of %u bytes rejected with 0x%08X", pMessage->ulLength, NtStatus);
+        FreeMessage(pChannel->pDeviceExtension, pMessage);
+    }
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StoreMessage
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//	   
+//		[IN]  PCHAR pData
+//		Message validated by IsStringTerminated, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the message including NULL character.
+// 
+//		[IN]  BOOLEAN bCanWait
+//		TRUE if the caller pends the write with BlockWrite on STATUS_RETRY.
+// 
+//		[IN]  HANDLE hProcessId
+//		Process that wrote the message.
+// 
+//		[IN]  HANDLE hThreadId
+//		Thread that wrote the message.
+// 
+//	Routine Description:
+//		Charges the message to the quota of the handle, copies it into a
+//		block of the message slab and appends it to the ring of the current
+//		processor of the handle's channel. The ids are given by the caller
+//		since a blocked write is retried from a worker thread.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the ring is full, the channel at its limit or the quota used up, the return value is STATUS_DEVICE_BUSY.
+//		If the quota is used up and the write has to wait, the return value is STATUS_RETRY.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+StoreMessage(
+    IN  PFILE_OBJECT pFileObject,
+    IN  PCHAR pData,
+    IN  UINT uiLength,
+    IN  BOOLEAN bCanWait,
+    IN  HANDLE hProcessId,
+    IN  HANDLE hThreadId
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pFileObject);
+    NTSTATUS NtStatus;
+    PFINGS_MESSAGE pMessage;
+    PQUOTA pQuota;
+
+    NtStatus = AdmitMessage(pChannel, uiLength);
+
+    if (!NT_SUCCESS(NtStatus))
+        return NtStatus;
+
+    NtStatus = ChargeQuota(pFileObject, uiLength, bCanWait, &pQuota);
+
+    if (!NT_SUCCESS(NtStatus))
+        return NtStatus;
+
+    pMessage = AllocateMessage(pChannel->pDeviceExtension, uiLength);
+
+    if (!pMessage)
+    {
+        ReleaseQuota(pChannel->pDeviceExtension, pQuota, uiLength);
+        LOG_WARNING("No memory for a message of %u bytes", uiLength);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pMessage->pQuota = pQuota;
+
+    __try
+    {
+        RtlCopyMemory(pMessage->Data, pData, uiLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        NtStatus = GetExceptionCode();
+    }
+
+    return QueueMessage(pFileObject, pMessage, NtStatus, hProcessId, hThreadId);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StoreSegments
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//	   
+//		[IN]  FINGS_WRITE_SEGMENT* pSegments
+//		Segments of the message, captured by the caller.
+// 
+//		[IN]  ULONG ulCount
+//		Number of segments.
+// 
+//		[IN]  KPROCESSOR_MODE RequestorMode
+//		Mode of the caller, user mode segments are probed.
+// 
+//		[OUT]  UINT* pdwDataWritten
+//		Length of the message stored including NULL character.
+// 
+//	Routine Description:
+//		Gathers the segments up to the first NULL character straight into
+//		a block of the message slab and appends it to the ring of the
+//		current processor. Runs in the context of the caller, a write over
+//		its quota fails rather than waits.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If there is no NULL character, the return value is STATUS_INVALID_PARAMETER.
+//		If the ring is full, the channel at its limit or the quota used up, the return value is STATUS_DEVICE_BUSY.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+StoreSegments(
+    IN  PFILE_OBJECT pFileObject,
+    IN  CONST FINGS_WRITE_SEGMENT* pSegments,
+    IN  ULONG ulCount,
+    IN  KPROCESSOR_MODE RequestorMode,
+    OUT  UINT* pdwDataWritten
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pFileObject);
+    NTSTATUS NtStatus = STATUS_INVALID_PARAMETER;
+    PFINGS_MESSAGE pMessage = NULL;
+    PQUOTA pQuota = NULL;
+    PCHAR pData;
+    SIZE_T Index;
+    ULONG ulIndex;
+    ULONG ulLength;
+    UINT uiLength = 0;
+    UINT uiOffset = 0;
+
+    *pdwDataWritten = 0;
+
+    __try
+    {
+        //
+        //	First pass, probe the segments and find the NULL character ending
+        //	the message. The segments after it are not looked at.
+        //
+        for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
         {
-            *pdwStringLength = uiIndex + 1; /* Include the total count we read, includes the NULL */
-            bStringIsTerminated = TRUE;
+            if (pSegments[ulIndex].ullAddress != (ULONG_PTR)pSegments[ulIndex].ullAddress)
+                break;
+
+            pData = (PCHAR)(ULONG_PTR)pSegments[ulIndex].ullAddress;
+            ulLength = pSegments[ulIndex].ulLength;
+
+            if (RequestorMode != KernelMode)
+                ProbeForRead(pData, ulLength, TYPE_ALIGNMENT(char));
+
+            Index = FindNullCharacter(pData, ulLength);
+
+            if (Index < ulLength)
+                ulLength = (ULONG)Index + 1;
+
+            if (ulLength > MAXULONG - uiLength)
+                break;
+
+            uiLength += ulLength;
+
+            if (Index < pSegments[ulIndex].ulLength)
+            {
+                NtStatus = STATUS_SUCCESS;
+                break;
+            }
+        }
+
+        if (NT_SUCCESS(NtStatus))
+            NtStatus = AdmitMessage(pChannel, uiLength);
+
+        if (NT_SUCCESS(NtStatus))
+            NtStatus = ChargeQuota(pFileObject, uiLength, FALSE, &pQuota);
+
+        if (NT_SUCCESS(NtStatus))
+        {
+            pMessage = AllocateMessage(pChannel->pDeviceExtension, uiLength);
+
+            if (!pMessage)
+            {
+                ReleaseQuota(pChannel->pDeviceExtension, pQuota, uiLength);
+                LOG_WARNING("No memory for a message of %u bytes", uiLength);
+                NtStatus = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            else
+                pMessage->pQuota = pQuota;
         }
-        else
+
+        //
+        //	Second pass, straight from the caller's buffers into the message.
+        //
+        for (ulIndex = 0; pMessage && uiOffset < uiLength; ulIndex++)
         {
-            uiIndex++;
+            ulLength = min(pSegments[ulIndex].ulLength, uiLength - uiOffset);
+
+            RtlCopyMemory(pMessage->Data + uiOffset, (PCHAR)(ULONG_PTR)pSegments[ulIndex].ullAddress, ulLength);
+            uiOffset += ulLength;
         }
     }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        NtStatus = GetExceptionCode();
+    }
 
-    return bStringIsTerminated;
-}
\ No newline at end of file
+    if (!pMessage)
+        return NtStatus;
+
+    NtStatus = QueueMessage(pFileObject, pMessage, NtStatus, PsGetCurrentProcessId(), PsGetCurrentThreadId());
+
+    if (NT_SUCCESS(NtStatus))
+        *pdwDataWritten = uiLength;
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FetchMessages
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the messages are read on.
+//	   
+//		[OUT]  PCHAR pBuffer
+//		Buffer receiving the messages, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the buffer.
+// 
+//		[OUT]	UINT* pdwDataRead
+//		Number of bytes used in the buffer, 0 if there was no message.
+// 
+//	Routine Description:
+//		Takes the oldest messages out of the rings of the handle's channel,
+//		as many whole ones as fit, and packs them into the buffer as
+//		FINGS_READ_RECORDs. The first message that does not fit is left in
+//		its ring, expired ones are dropped on the way. A subscribed handle
+//		reads its subscription instead.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If not even the oldest message fits, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+FetchMessages(
+    IN  PFILE_OBJECT pFileObject,
+    OUT  PCHAR pBuffer,
+    IN  UINT uiLength,
+    OUT  UINT* pdwDataRead
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PCHANNEL pChannel = pHandle->pChannel;
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    PFINGS_MESSAGE pMessage;
+    PFINGS_READ_RECORD pRecord;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    ULONG ulShard;
+    UINT uiOffset = 0;
+    BOOLEAN bExpired;
+
+    if (pHandle->pSubscription)
+        return FetchPublished(pHandle->pSubscription, pBuffer, uiLength, pdwDataRead);
+
+    *pdwDataRead = 0;
+
+    while (NT_SUCCESS(NtStatus) && uiOffset < uiLength)
+    {
+        //
+        //	Only the look and the removal are done under the lock, the copy
+        //	may touch a user mode buffer and has to run at PASSIVE_LEVEL.
+        //
+        KeAcquireInStackQueuedSpinLock(&pChannel->ReadLock, &LockHandle);
+
+        pMessage = ShardPeek(pChannel, &ulShard);
+        bExpired = pMessage && FINGS_MESSAGE_EXPIRED(pMessage);
+
+        if (bExpired)
+        {
+            RingDequeue(&pChannel->pShards[ulShard]);
+        }
+        else if (pMessage)
+        {
+            if (FIELD_OFFSET(FINGS_READ_RECORD, Data) + pMessage->ulLength <= uiLength - uiOffset)
+            {
+                RingDequeue(&pChannel->pShards[ulShard]);
+
+                pChannel->ullMessagesRead++;
+                pChannel->ullBytesRead += pMessage->ulLength;
+            }
+            else
+            {
+                //
+                //	Only an error if nothing was read, else it waits for the next read.
+                //
+                if (!uiOffset)
+                    NtStatus = STATUS_BUFFER_TOO_SMALL;
+
+                pMessage = NULL;
+            }
+        }
+
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+        if (!pMessage)
+            break;
+
+        //
+        //	Its tick came before the expiry DPC got to it.
+        //
+        if (bExpired)
+        {
+            InterlockedIncrement64(&pChannel->llMessagesExpired);
+            FreeMessage(pChannel->pDeviceExtension, pMessage);
+            continue;
+        }
+
+        pRecord = (PFINGS_READ_RECORD)(pBuffer + uiOffset);
+
+        __try
+        {
+            pRecord->ulLength = pMessage->ulLength;
+            NtStatus = ExpandMessage(pMessage, pRecord->Data);
+
+            if (NT_SUCCESS(NtStatus))
+                *pdwDataRead = uiOffset + FIELD_OFFSET(FINGS_READ_RECORD, Data) + pMessage->ulLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            NtStatus = GetExceptionCode();
+        }
+
+        uiOffset += FINGS_READ_RECORD_SIZE(pMessage->ulLength);
+
+        FreeMessage(pChannel->pDeviceExtension, pMessage);
+    }
+
+    return NtStatus;
+}
@@ -0,0 +1,322 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	handle.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the state every handle to the device keeps in		*
+* 	the FsContext of its file object: its pending reads, its settings,		*
+* 	its quota and its counters.													*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, CreateHandleContext)
+#pragma alloc_text(PAGE, DeleteHandleContext)
+#pragma alloc_text(PAGE, IoctlQueryHandle)
+#pragma alloc_text(PAGE, IoctlSetHandle)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		CreateHandleContext
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being opened.
+//
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is opened on.
+//
+//	Routine Description:
+//		Allocates the zeroed state of the handle with its quota and keeps
+//		it in FsContext.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+CreateHandleContext(
+    IN OUT  PFILE_OBJECT pFileObject,
+    IN  PCHANNEL pChannel
+)
+{
+    PHANDLE_CONTEXT pHandle;
+    NTSTATUS NtStatus;
+
+    PAGED_CODE();
+
+    //
+    //	Cache aligned so that handles used from different processors never
+    //	share a line of counters.
+    //
+    pHandle = ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, sizeof(HANDLE_CONTEXT), FINGS_POOL_TAG);
+
+    if (!pHandle)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    NtStatus = OpenHandleQuota(pChannel->pDeviceExtension, pHandle);
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        ExFreePoolWithTag(pHandle, FINGS_POOL_TAG);
+        return NtStatus;
+    }
+
+    pHandle->pChannel = pChannel;
+    InitializeListHead(&pHandle->PendingList);
+    InitializeListHead(&pHandle->WaitingEntry);
+
+    pFileObject->FsContext = pHandle;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		DeleteHandleContext
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being closed.
+//
+//	Routine Description:
+//		Frees the state of the handle and counts it off its channel. Its
+//		reads, its blocked writes and its mapping of the shared ring are
+//		gone since the cleanup of the handle. Its quota stays while
+//		messages are charged to it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+DeleteHandleContext(
+    IN OUT  PFILE_OBJECT pFileObject
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+
+    PAGED_CODE();
+
+    if (!pHandle)
+        return;
+
+    //
+    //	Cleanup already cancelled the pended reads and unmapped the ring.
+    //	The messages the handle wrote keep its quota until the channel
+    //	frees them, possibly right away if this was its last handle.
+    //
+    CloseHandleQuota(pHandle->pChannel->pDeviceExtension, pHandle);
+    CloseChannel(pHandle->pChannel);
+
+    pFileObject->FsContext = NULL;
+    ExFreePoolWithTag(pHandle, FINGS_POOL_TAG);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		HandleCountWrite
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the messages were written on.
+//
+//		[IN]  ULONG ulMessages
+//		Number of messages accepted.
+//
+//		[IN]  ULONG_PTR Bytes
+//		Their length.
+//
+//	Routine Description:
+//		Adds accepted messages to the counters of the handle.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+HandleCountWrite(
+    IN  PFILE_OBJECT pFileObject,
+    IN  ULONG ulMessages,
+    IN  ULONG_PTR Bytes
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+
+    if (!ulMessages)
+        return;
+
+    InterlockedAdd64(&pHandle->llMessagesWritten, ulMessages);
+    InterlockedAdd64(&pHandle->llBytesWritten, (LONG64)Bytes);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		HandleCountRead
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the read was issued on.
+//
+//		[IN]  ULONG_PTR Bytes
+//		Bytes returned by the read, nothing is counted for 0.
+//
+//	Routine Description:
+//		Adds a read that returned messages to the counters of the handle.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+HandleCountRead(
+    IN  PFILE_OBJECT pFileObject,
+    IN  ULONG_PTR Bytes
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+
+    if (!Bytes)
+        return;
+
+    InterlockedIncrement64(&pHandle->llReads);
+    InterlockedAdd64(&pHandle->llBytesRead, (LONG64)Bytes);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryHandle
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_HANDLE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the settings and counters of the handle, the usage of its
+//		quota, and the counters of its subscription if it has one.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryHandle(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PHANDLE_CONTEXT pHandle = pIoStackIrp->FileObject->FsContext;
+    PFINGS_HANDLE_INFO pInfo = pIrp->AssociatedIrp.SystemBuffer;
+
+    PAGED_CODE();
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(FINGS_HANDLE_INFO) || !pInfo)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlZeroMemory(pInfo, sizeof(FINGS_HANDLE_INFO));
+
+    pInfo->Settings = pHandle->Settings;
+    pInfo->ullMessagesWritten = (ULONG64)pHandle->llMessagesWritten;
+    pInfo->ullBytesWritten = (ULONG64)pHandle->llBytesWritten;
+    pInfo->ullReads = (ULONG64)pHandle->llReads;
+    pInfo->ullBytesRead = (ULONG64)pHandle->llBytesRead;
+    pInfo->ullReadsPended = (ULONG64)pHandle->llReadsPended;
+    pInfo->ulPendingReads = pHandle->ulPendingReads;
+
+    QueryQuota(pHandle->pQuota, &pInfo->Settings.Quota, &pInfo->Usage);
+
+    if (pHandle->pSubscription)
+    {
+        pInfo->ulSubscribed = TRUE;
+        pInfo->ullMessagesMissed = (ULONG64)pHandle->pSubscription->llMessagesMissed;
+    }
+
+    *pInformation = sizeof(FINGS_HANDLE_INFO);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetHandle
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_HANDLE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the settings of the handle and the limits of its quota.
+//		Reads already waiting stay queued even if there are more than the
+//		new limit, and so do messages already charged to the quota.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the policy is not one of FINGS_QUOTA_*, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetHandle(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    PHANDLE_CONTEXT pHandle = pIoStackIrp->FileObject->FsContext;
+    PFINGS_HANDLE_SETTINGS pSettings = pIrp->AssociatedIrp.SystemBuffer;
+
+    PAGED_CODE();
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_HANDLE_SETTINGS) || !pSettings)
+        return STATUS_INVALID_PARAMETER;
+
+    if (pSettings->ulFullPolicy > FINGS_QUOTA_DROP_OLDEST)
+        return STATUS_INVALID_PARAMETER;
+
+    SetQuotaLimits(pHandle->pQuota, &pSettings->Quota);
+    pHandle->Settings = *pSettings;
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ioctl.c																		*
+*																				*
+* Abstract:																		*
+* 	This file contains the handlers of the I/O control codes					*
+* 	defined in 6fingsioctl.h, called from DispatchIoControl.					*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, IoctlSubmitBatch)
+#pragma alloc_text(PAGE, IoctlWriteVector)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSubmitBatch
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the request was sent on.
+//	   
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SUBMIT_BATCH request.
+// 
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+// 
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of accepted messages.
+//
+//	Routine Description:
+//		Walks the packed records once, validating and storing every message.
+//		The status of each record is written back into the record, which is
+//		why the records are locked METHOD_OUT_DIRECT. A record that is rejected
+//		does not stop the following ones, a record that does not fit in the
+//		buffer ends the walk.
+//
+//	Return Value:
+//		NTSTATUS.
+//		STATUS_SUCCESS if every record was walked, check each lStatus.
+//		STATUS_INVALID_PARAMETER if the header or a record is malformed,
+//		the records before it have been processed.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSubmitBatch(
+    IN  PCHANNEL pChannel,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    NTSTATUS RecordStatus;
+    PFINGS_BATCH_HEADER pHeader;
+    PFINGS_BATCH_RECORD pRecord;
+    PUCHAR pBatch;
+    ULONG ulBatchLength;
+    ULONG ulOffset = 0;
+    ULONG ulCount;
+    ULONG ulIndex;
+    ULONG ulLength;
+    ULONG ulAccepted = 0;
+    ULONG_PTR AcceptedBytes = 0;
+    UINT dwMessageLength;
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_BATCH_HEADER) ||
+        !pIrp->AssociatedIrp.SystemBuffer || !pIrp->MdlAddress)
+        return STATUS_INVALID_PARAMETER;
+
+    pHeader = (PFINGS_BATCH_HEADER)pIrp->AssociatedIrp.SystemBuffer;
+    ulCount = pHeader->ulCount;
+
+    if (ulCount == 0 || ulCount > FINGS_BATCH_MAX_RECORDS)
+        return STATUS_INVALID_PARAMETER;
+
+    pBatch = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority | MdlMappingNoExecute);
+
+    if (!pBatch)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    ulBatchLength = pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+    {
+        if (ulOffset > ulBatchLength || ulBatchLength - ulOffset < FIELD_OFFSET(FINGS_BATCH_RECORD, Data))
+        {
+            NtStatus = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        pRecord = (PFINGS_BATCH_RECORD)(pBatch + ulOffset);
+
+        //
+        //	The pages are shared with the caller, read the length only once.
+        //
+        ulLength = *(volatile ULONG*)&pRecord->ulLength;
+
+        if (ulLength > ulBatchLength - ulOffset - FIELD_OFFSET(FINGS_BATCH_RECORD, Data))
+        {
+            NtStatus = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (IsStringTerminated(pRecord->Data, ulLength, &dwMessageLength))
+            RecordStatus = StoreMessage(pIoStackIrp->FileObject, pRecord->Data, dwMessageLength, FALSE, PsGetCurrentProcessId(), PsGetCurrentThreadId());
+        else
+            RecordStatus = STATUS_INVALID_PARAMETER;
+
+        pRecord->lStatus = RecordStatus;
+
+        if (NT_SUCCESS(RecordStatus))
+        {
+            ulAccepted++;
+            AcceptedBytes += dwMessageLength;
+        }
+
+        ulOffset += FINGS_BATCH_RECORD_SIZE(ulLength);
+    }
+
+    //
+    //	Pending reads are served once for the whole batch, not per record.
+    //
+    if (ulAccepted)
+    {
+        HandleCountWrite(pIoStackIrp->FileObject, ulAccepted, AcceptedBytes);
+        CompletePendingReads(pChannel);
+    }
+
+    *pInformation = ulAccepted;
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlWriteVector
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the request was sent on.
+//	   
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_WRITE_VECTOR request.
+// 
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+// 
+//		[OUT]  ULONG_PTR* pInformation
+//		Length of the message stored.
+//
+//	Routine Description:
+//		Stores one message gathered from the segments in the input buffer.
+//		The I/O manager copied the array, the segments themselves are
+//		read in place since the request runs in the context of the caller.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		STATUS_INVALID_PARAMETER if the segment array is malformed.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlWriteVector(
+    IN  PCHANNEL pChannel,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    NTSTATUS NtStatus;
+    ULONG ulInputLength = pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength;
+    UINT dwDataWritten;
+
+    PAGED_CODE();
+
+    *pInformation = 0;
+
+    if (!ulInputLength || ulInputLength % sizeof(FINGS_WRITE_SEGMENT) ||
+        ulInputLength > FINGS_VECTOR_MAX_SEGMENTS * sizeof(FINGS_WRITE_SEGMENT) ||
+        !pIrp->AssociatedIrp.SystemBuffer)
+        return STATUS_INVALID_PARAMETER;
+
+    NtStatus = StoreSegments(
+        pIoStackIrp->FileObject,
+        (PFINGS_WRITE_SEGMENT)pIrp->AssociatedIrp.SystemBuffer,
+        ulInputLength / sizeof(FINGS_WRITE_SEGMENT),
+        pIrp->RequestorMode,
+        &dwDataWritten
+    );
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        HandleCountWrite(pIoStackIrp->FileObject, 1, dwDataWritten);
+        CompletePendingReads(pChannel);
+        *pInformation = dwDataWritten;
+    }
+
+    return NtStatus;
+}
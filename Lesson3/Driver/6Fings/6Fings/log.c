@@ -0,0 +1,417 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	log.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the deferred log. Every processor appends				*
+* 	records to a ring of its own at DISPATCH_LEVEL, so it is the only			*
+* 	writer of that ring and a record costs a handful of stores. The				*
+* 	worker thread is the only reader, it formats the records at low			*
+* 	priority and hands them to DbgPrint a batch at a time.						*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include <ntstrsafe.h>
+#include "log.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+#define LOG_POOL_TAG			'gLF6'
+
+//
+//	Records per processor, a power of two. Records logged while the ring
+//	is full are counted and dropped rather than waited for.
+//
+#define LOG_RECORDS_PER_CPU		256
+
+//
+//	The worker wakes up every 100 ms, in units of 100 ns.
+//
+#define LOG_FLUSH_INTERVAL		(100 * 10000)
+
+//
+//	DbgPrint truncates anything longer than 512 bytes.
+//
+#define LOG_BATCH_SIZE			512
+#define LOG_LINE_SIZE			256
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+typedef struct _LOG_RECORD
+{
+	ULONG64 ullTime;
+	PCSTR pszFormat;
+	ULONG_PTR Arguments[LOG_MAX_ARGUMENTS];
+	ULONG ulLevel;
+
+} LOG_RECORD, *PLOG_RECORD;
+
+
+#pragma warning(push)
+#pragma warning(disable : 4324)	// structure was padded due to alignment specifier
+
+//
+//	The processor moves lTail and the worker lHead, each on its own cache line.
+//
+typedef struct _LOG_CPU
+{
+	DECLSPEC_CACHEALIGN volatile LONG lTail;
+	volatile LONG lDropped;
+	DECLSPEC_CACHEALIGN volatile LONG lHead;
+	LONG lDroppedReported;
+	LOG_RECORD Records[LOG_RECORDS_PER_CPU];
+
+} LOG_CPU, *PLOG_CPU;
+
+#pragma warning(pop)
+
+
+typedef struct _LOG_STATE
+{
+	PLOG_CPU pCpus;
+	ULONG ulCpuCount;
+	HANDLE hWorker;
+	KEVENT StopEvent;
+
+} LOG_STATE, *PLOG_STATE;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The log is not tied to the device, DriverEntry logs before creating it.
+//
+static LOG_STATE g_Log;
+
+static const PCSTR g_LogLevelNames[] = { "", "ERROR", "WARNING", "INFO", "VERBOSE" };
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, LogInitialize)
+#pragma alloc_text(PAGE, LogShutdown)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Appends szLine to the batch, printing the batch first if it would not fit.
+//
+static VOID
+LogAppendLine(
+    IN OUT  PCHAR pszBatch,
+    IN OUT  PSIZE_T pcbBatch,
+    IN  PCSTR pszLine,
+    IN  SIZE_T cbLine
+)
+{
+    if (*pcbBatch + cbLine >= LOG_BATCH_SIZE)
+    {
+        DbgPrint("%s", pszBatch);
+        *pcbBatch = 0;
+    }
+
+    RtlCopyMemory(pszBatch + *pcbBatch, pszLine, cbLine);
+    *pcbBatch += cbLine;
+    pszBatch[*pcbBatch] = '\0';
+}
+
+
+//
+//	Formats and prints every record the processors have published so far.
+//
+static VOID
+LogFlush(
+    VOID
+)
+{
+    CHAR szBatch[LOG_BATCH_SIZE];
+    CHAR szLine[LOG_LINE_SIZE];
+    SIZE_T cbBatch = 0, cbRemaining;
+    PCHAR pszEnd;
+    PLOG_CPU pCpu;
+    PLOG_RECORD pRecord;
+    ULONG ulCpu;
+    LONG lHead, lTail, lDropped;
+
+    szBatch[0] = '\0';
+
+    for (ulCpu = 0; ulCpu < g_Log.ulCpuCount; ulCpu++)
+    {
+        pCpu = &g_Log.pCpus[ulCpu];
+        lTail = ReadAcquire(&pCpu->lTail);
+
+        for (lHead = pCpu->lHead; lHead != lTail; lHead++)
+        {
+            pRecord = &pCpu->Records[lHead & (LOG_RECORDS_PER_CPU - 1)];
+
+            pszEnd = szLine;
+            cbRemaining = sizeof(szLine) - 2;
+
+            RtlStringCbPrintfExA(
+                pszEnd, cbRemaining, &pszEnd, &cbRemaining, 0,
+                "6Fings: %I64u.%07I64u [%lu] %s: ",
+                pRecord->ullTime / 10000000,
+                pRecord->ullTime % 10000000,
+                ulCpu,
+                g_LogLevelNames[pRecord->ulLevel]
+            );
+
+            RtlStringCbPrintfExA(
+                pszEnd, cbRemaining, &pszEnd, &cbRemaining, 0,
+                pRecord->pszFormat,
+                pRecord->Arguments[0],
+                pRecord->Arguments[1],
+                pRecord->Arguments[2],
+                pRecord->Arguments[3]
+            );
+
+            //
+            //	Two bytes were kept back so a truncated line still ends.
+            //
+            *pszEnd++ = '\r';
+            *pszEnd++ = '\n';
+            *pszEnd = '\0';
+
+            //
+            //	The record is copied out, the processor may reuse its slot.
+            //
+            WriteRelease(&pCpu->lHead, lHead + 1);
+
+            LogAppendLine(szBatch, &cbBatch, szLine, pszEnd - szLine);
+        }
+
+        lDropped = ReadNoFence(&pCpu->lDropped);
+
+        if (lDropped != pCpu->lDroppedReported)
+        {
+            RtlStringCbPrintfExA(
+                szLine, sizeof(szLine), &pszEnd, NULL, 0,
+                "6Fings: [%lu] %ld log records dropped\r\n",
+                ulCpu,
+                lDropped - pCpu->lDroppedReported
+            );
+
+            pCpu->lDroppedReported = lDropped;
+
+            LogAppendLine(szBatch, &cbBatch, szLine, pszEnd - szLine);
+        }
+    }
+
+    if (cbBatch)
+        DbgPrint("%s", szBatch);
+}
+
+
+static VOID
+LogWorker(
+    IN  PVOID pContext
+)
+{
+    LARGE_INTEGER Interval;
+    NTSTATUS NtStatus;
+
+    UNREFERENCED_PARAMETER(pContext);
+
+    KeSetPriorityThread(KeGetCurrentThread(), LOW_PRIORITY + 1);
+
+    Interval.QuadPart = -LOG_FLUSH_INTERVAL;
+
+    //
+    //	The last flush runs after the stop event, when nothing logs anymore.
+    //
+    do
+    {
+        NtStatus = KeWaitForSingleObject(&g_Log.StopEvent, Executive, KernelMode, FALSE, &Interval);
+
+        LogFlush();
+
+    } while (NtStatus == STATUS_TIMEOUT);
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LogInitialize
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Allocates the record buffers of every processor and starts the
+//		worker thread. Log calls made before, or after a failure, are
+//		silently dropped.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+LogInitialize(
+    VOID
+)
+{
+    NTSTATUS NtStatus;
+    OBJECT_ATTRIBUTES Attributes;
+    PLOG_CPU pCpus;
+    ULONG ulCpuCount;
+
+    PAGED_CODE();
+
+    ulCpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    pCpus = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(LOG_CPU) * ulCpuCount, LOG_POOL_TAG);
+
+    if (!pCpus)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    g_Log.pCpus = pCpus;
+    g_Log.ulCpuCount = ulCpuCount;
+    KeInitializeEvent(&g_Log.StopEvent, NotificationEvent, FALSE);
+
+    InitializeObjectAttributes(&Attributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    NtStatus = PsCreateSystemThread(&g_Log.hWorker, THREAD_ALL_ACCESS, &Attributes, NULL, NULL, LogWorker, NULL);
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        g_Log.pCpus = NULL;
+        ExFreePoolWithTag(pCpus, LOG_POOL_TAG);
+    }
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LogShutdown
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Stops the worker thread once it has printed every record left in
+//		the buffers, then frees them.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+LogShutdown(
+    VOID
+)
+{
+    PAGED_CODE();
+
+    if (!g_Log.pCpus)
+        return;
+
+    KeSetEvent(&g_Log.StopEvent, IO_NO_INCREMENT, FALSE);
+
+    ZwWaitForSingleObject(g_Log.hWorker, FALSE, NULL);
+    ZwClose(g_Log.hWorker);
+
+    ExFreePoolWithTag(g_Log.pCpus, LOG_POOL_TAG);
+    g_Log.pCpus = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LogWrite
+//
+//	Parameters:
+//		[IN]  ULONG ulLevel
+//		LOG_LEVEL_* of the record.
+//
+//		[IN]  PCSTR pszFormat
+//		DbgPrint format, must stay valid until the driver unloads.
+//
+//		[IN]  ULONG_PTR Argument0 .. Argument3
+//		Arguments of the format.
+//
+//	Routine Description:
+//		Appends a record to the buffer of the current processor, or counts
+//		it as dropped if the buffer is full. Use the LOG_* macros rather
+//		than calling it. Callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+LogWrite(
+    IN  ULONG ulLevel,
+    IN  PCSTR pszFormat,
+    IN  ULONG_PTR Argument0,
+    IN  ULONG_PTR Argument1,
+    IN  ULONG_PTR Argument2,
+    IN  ULONG_PTR Argument3
+)
+{
+    PLOG_CPU pCpu;
+    PLOG_RECORD pRecord;
+    LONG lTail;
+    KIRQL OldIrql;
+
+    if (!g_Log.pCpus)
+        return;
+
+    //
+    //	Nothing else runs on the processor at DISPATCH_LEVEL, which makes
+    //	it the single writer of its ring.
+    //
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    pCpu = &g_Log.pCpus[KeGetCurrentProcessorNumberEx(NULL) % g_Log.ulCpuCount];
+    lTail = pCpu->lTail;
+
+    if ((ULONG)lTail - (ULONG)ReadAcquire(&pCpu->lHead) >= LOG_RECORDS_PER_CPU)
+    {
+        pCpu->lDropped++;
+    }
+    else
+    {
+        pRecord = &pCpu->Records[lTail & (LOG_RECORDS_PER_CPU - 1)];
+
+        pRecord->ullTime = KeQueryInterruptTime();
+        pRecord->pszFormat = pszFormat;
+        pRecord->Arguments[0] = Argument0;
+        pRecord->Arguments[1] = Argument1;
+        pRecord->Arguments[2] = Argument2;
+        pRecord->Arguments[3] = Argument3;
+        pRecord->ulLevel = ulLevel;
+
+        WriteRelease(&pCpu->lTail, lTail + 1);
+    }
+
+    KeLowerIrql(OldIrql);
+}
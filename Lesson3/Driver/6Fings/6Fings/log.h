@@ -0,0 +1,171 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	log.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the deferred log. A log call only copies its				*
+* 	format and arguments into a buffer of the current processor, a				*
+* 	low priority worker thread formats the records and prints them				*
+* 	in batches.																	*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+#define LOG_LEVEL_NONE			0
+#define LOG_LEVEL_ERROR			1
+#define LOG_LEVEL_WARNING		2
+#define LOG_LEVEL_INFO			3
+#define LOG_LEVEL_VERBOSE		4
+
+//
+//	Calls above this level are compiled out, along with their arguments.
+//	Build with /DFINGS_LOG_LEVEL=LOG_LEVEL_VERBOSE to see every request.
+//
+#ifndef FINGS_LOG_LEVEL
+#define FINGS_LOG_LEVEL			LOG_LEVEL_INFO
+#endif
+
+//
+//	A record holds at most this many arguments, further ones are dropped.
+//
+#define LOG_MAX_ARGUMENTS		4
+
+//
+//	Pads the arguments of a call with zeros up to LOG_MAX_ARGUMENTS. The first
+//	parameter swallows the leading comma so that calls without arguments work,
+//	LOG_EXPAND makes MSVC split __VA_ARGS__ into separate parameters.
+//
+#define LOG_EXPAND(x)			x
+#define LOG_ARGUMENTS(Unused, A0, A1, A2, A3, ...)	\
+	(ULONG_PTR)(A0), (ULONG_PTR)(A1), (ULONG_PTR)(A2), (ULONG_PTR)(A3)
+
+#define LOG_WRITE(Level, Format, ...)	\
+	LogWrite(Level, Format, LOG_EXPAND(LOG_ARGUMENTS(~, ##__VA_ARGS__, 0, 0, 0, 0, 0)))
+
+//
+//	Format must be a string literal and the arguments integers or pointers
+//	to string literals, they are only looked at later by the worker thread.
+//	Every argument is passed as a ULONG_PTR, conversions must not be wider.
+//
+#if FINGS_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(Format, ...)		LOG_WRITE(LOG_LEVEL_ERROR, Format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(Format, ...)		((VOID)0)
+#endif
+
+#if FINGS_LOG_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(Format, ...)	LOG_WRITE(LOG_LEVEL_WARNING, Format, ##__VA_ARGS__)
+#else
+#define LOG_WARNING(Format, ...)	((VOID)0)
+#endif
+
+#if FINGS_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(Format, ...)		LOG_WRITE(LOG_LEVEL_INFO, Format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(Format, ...)		((VOID)0)
+#endif
+
+#if FINGS_LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(Format, ...)	LOG_WRITE(LOG_LEVEL_VERBOSE, Format, ##__VA_ARGS__)
+#else
+#define LOG_VERBOSE(Format, ...)	((VOID)0)
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		LogInitialize
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Allocates the record buffers of every processor and starts the
+//		worker thread. Log calls made before, or after a failure, are
+//		silently dropped.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+LogInitialize(
+	VOID
+);
+
+
+//***********************************************************************************
+//	Function:
+//		LogShutdown
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Stops the worker thread once it has printed every record left in
+//		the buffers, then frees them.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+LogShutdown(
+	VOID
+);
+
+
+//***********************************************************************************
+//	Function:
+//		LogWrite
+//
+//	Parameters:
+//		[IN]  ULONG ulLevel
+//		LOG_LEVEL_* of the record.
+//
+//		[IN]  PCSTR pszFormat
+//		DbgPrint format, must stay valid until the driver unloads.
+//
+//		[IN]  ULONG_PTR Argument0 .. Argument3
+//		Arguments of the format.
+//
+//	Routine Description:
+//		Appends a record to the buffer of the current processor, or counts
+//		it as dropped if the buffer is full. Use the LOG_* macros rather
+//		than calling it. Callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+LogWrite(
+	IN  ULONG ulLevel,
+	IN  PCSTR pszFormat,
+	IN  ULONG_PTR Argument0,
+	IN  ULONG_PTR Argument1,
+	IN  ULONG_PTR Argument2,
+	IN  ULONG_PTR Argument3
+);
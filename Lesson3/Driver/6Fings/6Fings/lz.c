@@ -0,0 +1,421 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	lz.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements a byte oriented LZ77 codec in the spirit				*
+* 	of LZ4: greedy matching through a hash table, no entropy stage,				*
+* 	so both directions run at memory speed. Plain C, shared by the				*
+* 	driver and the user mode benchmark.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <string.h>
+#include "lz.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Largest count a nibble of the token holds, larger ones go on in
+//	length bytes.
+//
+#define LZ_NIBBLE_MAX		15
+
+//
+//	Extra bytes a count needs after its nibble.
+//
+#define LZ_LENGTH_BYTES(count)	((count) >= LZ_NIBBLE_MAX ? ((count) - LZ_NIBBLE_MAX) / 255 + 1 : 0)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Unaligned load in the byte order of the machine, only ever compared
+//	with another load or hashed, so the order does not matter.
+//
+static unsigned int
+Read32(
+    const unsigned char* pData
+)
+{
+    unsigned int Value;
+
+    memcpy(&Value, pData, sizeof(Value));
+
+    return Value;
+}
+
+
+//
+//	Same for 8 bytes, to extend matches a word at a time.
+//
+static unsigned long long
+Read64(
+    const unsigned char* pData
+)
+{
+    unsigned long long Value;
+
+    memcpy(&Value, pData, sizeof(Value));
+
+    return Value;
+}
+
+
+//
+//	Multiplicative hash of 4 bytes to an index of the workspace.
+//
+static unsigned int
+Hash32(
+    unsigned int Value
+)
+{
+    return (Value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+
+//
+//	Writes the length bytes of a count whose nibble is LZ_NIBBLE_MAX.
+//
+static unsigned char*
+PutLength(
+    unsigned char* pOut,
+    size_t Count
+)
+{
+    Count -= LZ_NIBBLE_MAX;
+
+    while (Count >= 255)
+    {
+        *pOut++ = 255;
+        Count -= 255;
+    }
+
+    *pOut++ = (unsigned char)Count;
+
+    return pOut;
+}
+
+
+//
+//	Reads the length bytes of a count whose nibble is LZ_NIBBLE_MAX.
+//	Returns 0 if they run past the block or overflow.
+//
+static int
+GetLength(
+    const unsigned char** ppIn,
+    const unsigned char* pEnd,
+    size_t* pCount
+)
+{
+    unsigned int Byte;
+
+    do
+    {
+        if (*ppIn >= pEnd || *pCount > (size_t)-1 - 255)
+            return 0;
+
+        Byte = *(*ppIn)++;
+        *pCount += Byte;
+
+    } while (Byte == 255);
+
+    return 1;
+}
+
+
+//
+//	Writes one sequence, cbMatch 0 for the last one which only carries
+//	literals. Returns NULL if it does not fit before pOutEnd.
+//
+static unsigned char*
+PutSequence(
+    unsigned char* pOut,
+    unsigned char* pOutEnd,
+    const unsigned char* pLiterals,
+    size_t cbLiterals,
+    size_t Offset,
+    size_t cbMatch
+)
+{
+    size_t MatchCode = cbMatch ? cbMatch - LZ_MIN_MATCH : 0;
+    size_t cbNeeded;
+    unsigned char* pToken;
+
+    cbNeeded = 1 + LZ_LENGTH_BYTES(cbLiterals) + cbLiterals;
+
+    if (cbMatch)
+        cbNeeded += 2 + LZ_LENGTH_BYTES(MatchCode);
+
+    if ((size_t)(pOutEnd - pOut) < cbNeeded)
+        return NULL;
+
+    pToken = pOut++;
+    *pToken = (unsigned char)((cbLiterals < LZ_NIBBLE_MAX ? cbLiterals : LZ_NIBBLE_MAX) << 4);
+
+    if (cbLiterals >= LZ_NIBBLE_MAX)
+        pOut = PutLength(pOut, cbLiterals);
+
+    memcpy(pOut, pLiterals, cbLiterals);
+    pOut += cbLiterals;
+
+    if (!cbMatch)
+        return pOut;
+
+    *pOut++ = (unsigned char)Offset;
+    *pOut++ = (unsigned char)(Offset >> 8);
+
+    *pToken |= (unsigned char)(MatchCode < LZ_NIBBLE_MAX ? MatchCode : LZ_NIBBLE_MAX);
+
+    if (MatchCode >= LZ_NIBBLE_MAX)
+        pOut = PutLength(pOut, MatchCode);
+
+    return pOut;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LzCompress
+//
+//	Parameters:
+//		[IN]  const void* pSource
+//		Data to compress.
+//
+//		[IN]  size_t cbSource
+//		Length of the data, at most 4 GB.
+//
+//		[OUT]  void* pDestination
+//		Buffer receiving the block.
+//
+//		[IN]  size_t cbDestination
+//		Length of the buffer.
+//
+//		[IN/OUT]  void* pWorkspace
+//		LZ_WORKSPACE_SIZE bytes, 4 byte aligned, owned by the caller for
+//		the duration of the call. Its contents do not matter, it need not
+//		be cleared between calls.
+//
+//	Routine Description:
+//		Compresses the data into one block, greedily taking the match the
+//		hash table remembers at every position. Never writes past
+//		cbDestination bytes.
+//
+//	Return Value:
+//		size_t.
+//		Length of the block, or 0 if it does not fit in the buffer.
+//
+//***********************************************************************************
+size_t
+LzCompress(
+    const void* pSource,
+    size_t cbSource,
+    void* pDestination,
+    size_t cbDestination,
+    void* pWorkspace
+)
+{
+    const unsigned char* pBase = (const unsigned char*)pSource;
+    const unsigned char* pEnd = pBase + cbSource;
+    const unsigned char* pIn = pBase;
+    const unsigned char* pAnchor = pBase;
+    const unsigned char* pCandidate;
+    const unsigned char* pMatchEnd;
+    unsigned char* pOut = (unsigned char*)pDestination;
+    unsigned char* pOutEnd = pOut + cbDestination;
+    unsigned int* pTable = (unsigned int*)pWorkspace;
+    unsigned int Sequence, Hash;
+    size_t Position;
+
+    while (cbSource >= LZ_MIN_MATCH && pIn <= pEnd - LZ_MIN_MATCH)
+    {
+        Sequence = Read32(pIn);
+        Hash = Hash32(Sequence);
+        Position = pTable[Hash];
+        pTable[Hash] = (unsigned int)(pIn - pBase);
+
+        //
+        //	The table may still hold positions of earlier inputs, only a
+        //	position behind this one, close enough and with the same 4 bytes
+        //	is taken. Data that does not match is skipped faster and faster.
+        //
+        if (Position >= (size_t)(pIn - pBase) ||
+            (size_t)(pIn - pBase) - Position > LZ_MAX_OFFSET ||
+            Read32(pBase + Position) != Sequence)
+        {
+            pIn += 1 + ((size_t)(pIn - pAnchor) >> 6);
+            continue;
+        }
+
+        pCandidate = pBase + Position;
+
+        while (pIn > pAnchor && pCandidate > pBase && pIn[-1] == pCandidate[-1])
+        {
+            pIn--;
+            pCandidate--;
+        }
+
+        //
+        //	A word at a time while one fits, then the bytes of the word
+        //	that differs.
+        //
+        pMatchEnd = pIn + LZ_MIN_MATCH;
+        Position = LZ_MIN_MATCH;
+
+        while ((size_t)(pEnd - pMatchEnd) >= sizeof(unsigned long long) &&
+               Read64(pMatchEnd) == Read64(pCandidate + Position))
+        {
+            pMatchEnd += sizeof(unsigned long long);
+            Position += sizeof(unsigned long long);
+        }
+
+        while (pMatchEnd < pEnd && *pMatchEnd == pCandidate[Position])
+        {
+            pMatchEnd++;
+            Position++;
+        }
+
+        pOut = PutSequence(pOut, pOutEnd, pAnchor, (size_t)(pIn - pAnchor), (size_t)(pIn - pCandidate), (size_t)(pMatchEnd - pIn));
+
+        if (!pOut)
+            return 0;
+
+        pIn = pMatchEnd;
+        pAnchor = pIn;
+
+        //
+        //	Remember a position inside the match too, repeated text often
+        //	goes on from there.
+        //
+        if (pIn - 2 <= pEnd - LZ_MIN_MATCH)
+            pTable[Hash32(Read32(pIn - 2))] = (unsigned int)(pIn - 2 - pBase);
+    }
+
+    pOut = PutSequence(pOut, pOutEnd, pAnchor, (size_t)(pEnd - pAnchor), 0, 0);
+
+    if (!pOut)
+        return 0;
+
+    return (size_t)(pOut - (unsigned char*)pDestination);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		LzDecompress
+//
+//	Parameters:
+//		[IN]  const void* pSource
+//		Block returned by LzCompress.
+//
+//		[IN]  size_t cbSource
+//		Length of the block.
+//
+//		[OUT]  void* pDestination
+//		Buffer receiving the data.
+//
+//		[IN]  size_t cbDestination
+//		Length of the buffer.
+//
+//	Routine Description:
+//		Expands the block. Every length and offset is checked, a damaged
+//		block never makes it read or write outside the two buffers.
+//
+//	Return Value:
+//		size_t.
+//		Length of the data, or (size_t)-1 if the block is damaged or the
+//		data does not fit in the buffer.
+//
+//***********************************************************************************
+size_t
+LzDecompress(
+    const void* pSource,
+    size_t cbSource,
+    void* pDestination,
+    size_t cbDestination
+)
+{
+    const unsigned char* pIn = (const unsigned char*)pSource;
+    const unsigned char* pEnd = pIn + cbSource;
+    unsigned char* pBase = (unsigned char*)pDestination;
+    unsigned char* pOut = pBase;
+    unsigned char* pOutEnd = pBase + cbDestination;
+    const unsigned char* pMatch;
+    size_t cbLiterals, cbMatch, Offset;
+    unsigned int Token;
+
+    while (pIn < pEnd)
+    {
+        Token = *pIn++;
+
+        cbLiterals = Token >> 4;
+
+        if (cbLiterals == LZ_NIBBLE_MAX && !GetLength(&pIn, pEnd, &cbLiterals))
+            return (size_t)-1;
+
+        if ((size_t)(pEnd - pIn) < cbLiterals || (size_t)(pOutEnd - pOut) < cbLiterals)
+            return (size_t)-1;
+
+        memcpy(pOut, pIn, cbLiterals);
+        pIn += cbLiterals;
+        pOut += cbLiterals;
+
+        //
+        //	The last sequence has no match.
+        //
+        if (pIn == pEnd)
+            break;
+
+        if (pEnd - pIn < 2)
+            return (size_t)-1;
+
+        Offset = (size_t)pIn[0] | ((size_t)pIn[1] << 8);
+        pIn += 2;
+
+        if (!Offset || Offset > (size_t)(pOut - pBase))
+            return (size_t)-1;
+
+        cbMatch = Token & LZ_NIBBLE_MAX;
+
+        if (cbMatch == LZ_NIBBLE_MAX && !GetLength(&pIn, pEnd, &cbMatch))
+            return (size_t)-1;
+
+        cbMatch += LZ_MIN_MATCH;
+
+        if ((size_t)(pOutEnd - pOut) < cbMatch)
+            return (size_t)-1;
+
+        //
+        //	A match closer than its length repeats the bytes it is copying.
+        //
+        pMatch = pOut - Offset;
+
+        if (Offset >= cbMatch)
+        {
+            memcpy(pOut, pMatch, cbMatch);
+            pOut += cbMatch;
+        }
+        else
+        {
+            while (cbMatch--)
+                *pOut++ = *pMatch++;
+        }
+    }
+
+    return (size_t)(pOut - pBase);
+}
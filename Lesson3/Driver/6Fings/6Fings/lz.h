@@ -0,0 +1,142 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	lz.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the LZ codec that keeps queued messages					*
+* 	compressed. It is plain C with no Windows headers, the driver				*
+* 	and the user mode benchmark build the same lz.c.							*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stddef.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	A block is a list of sequences. Each one starts with a token byte,
+//	the high nibble the number of literals, the low nibble the length of
+//	the match minus LZ_MIN_MATCH. A nibble of 15 is followed by bytes
+//	adding to it, up to and including the first one below 255. Then come
+//	the literals, and unless the block ends with them a 2 byte little
+//	endian offset back into the output, then the match length bytes.
+//
+#define LZ_MIN_MATCH		4
+#define LZ_MAX_OFFSET		65535
+
+//
+//	The compressor remembers the last position of every hash of 4 bytes
+//	in a table of 1 << LZ_HASH_BITS positions, the workspace.
+//
+#define LZ_HASH_BITS		12
+#define LZ_WORKSPACE_SIZE	((size_t)4 << LZ_HASH_BITS)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//***********************************************************************************
+//	Function:
+//		LzCompress
+//
+//	Parameters:
+//		[IN]  const void* pSource
+//		Data to compress.
+//
+//		[IN]  size_t cbSource
+//		Length of the data, at most 4 GB.
+//
+//		[OUT]  void* pDestination
+//		Buffer receiving the block.
+//
+//		[IN]  size_t cbDestination
+//		Length of the buffer.
+//
+//		[IN/OUT]  void* pWorkspace
+//		LZ_WORKSPACE_SIZE bytes, 4 byte aligned, owned by the caller for
+//		the duration of the call. Its contents do not matter, it need not
+//		be cleared between calls.
+//
+//	Routine Description:
+//		Compresses the data into one block, greedily taking the match the
+//		hash table remembers at every position. Never writes past
+//		cbDestination bytes.
+//
+//	Return Value:
+//		size_t.
+//		Length of the block, or 0 if it does not fit in the buffer.
+//
+//***********************************************************************************
+size_t
+LzCompress(
+	const void* pSource,
+	size_t cbSource,
+	void* pDestination,
+	size_t cbDestination,
+	void* pWorkspace
+);
+
+
+//***********************************************************************************
+//	Function:
+//		LzDecompress
+//
+//	Parameters:
+//		[IN]  const void* pSource
+//		Block returned by LzCompress.
+//
+//		[IN]  size_t cbSource
+//		Length of the block.
+//
+//		[OUT]  void* pDestination
+//		Buffer receiving the data.
+//
+//		[IN]  size_t cbDestination
+//		Length of the buffer.
+//
+//	Routine Description:
+//		Expands the block. Every length and offset is checked, a damaged
+//		block never makes it read or write outside the two buffers.
+//
+//	Return Value:
+//		size_t.
+//		Length of the data, or (size_t)-1 if the block is damaged or the
+//		data does not fit in the buffer.
+//
+//***********************************************************************************
+size_t
+LzDecompress(
+	const void* pSource,
+	size_t cbSource,
+	void* pDestination,
+	size_t cbDestination
+);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,462 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	pending.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the queue of reads waiting for a message				*
+* 	in a channel. Reads sent on an overlapped handle pend here while			*
+* 	the rings are empty and are completed by the next write, or by the			*
+* 	next publish for a subscribed handle. The cancel-safe queue					*
+* 	(IoCsq) takes care of cancellation.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	InsertContext of a read put back after losing its message to another reader.
+//
+#define PENDING_INSERT_HEAD		((PVOID)1)
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	The queue callbacks run with the queue spinlock held and stay resident,
+//	like CompletePendingReads which writers call.
+//
+#pragma alloc_text(PAGE, InitializePendingReads)
+#pragma alloc_text(PAGE, PendRead)
+#pragma alloc_text(PAGE, CancelPendingReads)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static NTSTATUS
+CsqInsertIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp,
+    IN  PVOID pInsertContext
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    //
+    //	A read that is put back keeps its place in front of the newer ones,
+    //	and so does its handle if that was its only read. Subscribers are
+    //	never in line, publishers look their reads up by file object.
+    //
+    if (IsListEmpty(&pHandle->PendingList) && !pHandle->pSubscription)
+    {
+        if (pInsertContext == PENDING_INSERT_HEAD)
+            InsertHeadList(&pChannel->WaitingHandles, &pHandle->WaitingEntry);
+        else
+            InsertTailList(&pChannel->WaitingHandles, &pHandle->WaitingEntry);
+    }
+
+    if (pInsertContext == PENDING_INSERT_HEAD)
+        InsertHeadList(&pHandle->PendingList, &pIrp->Tail.Overlay.ListEntry);
+    else
+        InsertTailList(&pHandle->PendingList, &pIrp->Tail.Overlay.ListEntry);
+
+    pHandle->ulPendingReads++;
+
+    return STATUS_SUCCESS;
+}
+
+
+static VOID
+CsqRemoveIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    RemoveEntryList(&pIrp->Tail.Overlay.ListEntry);
+    pHandle->ulPendingReads--;
+
+    //
+    //	A handle that still has reads waiting goes to the back of the line,
+    //	so that the next message goes to another handle. A client keeping
+    //	many reads posted does not take every message from the others.
+    //
+    if (pHandle->pSubscription)
+        return;
+
+    RemoveEntryList(&pHandle->WaitingEntry);
+
+    if (!IsListEmpty(&pHandle->PendingList))
+        InsertTailList(&pChannel->WaitingHandles, &pHandle->WaitingEntry);
+    else
+        InitializeListHead(&pHandle->WaitingEntry);
+}
+
+
+//
+//	pPeekContext is NULL to take the oldest read of the first handle in
+//	line, or the file object whose reads are wanted. Called again with
+//	pIrp when that read is being cancelled, the walk then goes on in
+//	order and never wraps around.
+//
+static PIRP
+CsqPeekNextIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp,
+    IN  PVOID pPeekContext
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+    PHANDLE_CONTEXT pHandle;
+    PLIST_ENTRY pEntry;
+
+    if (pPeekContext)
+    {
+        pHandle = ((PFILE_OBJECT)pPeekContext)->FsContext;
+        pEntry = pIrp ? pIrp->Tail.Overlay.ListEntry.Flink : pHandle->PendingList.Flink;
+
+        return pEntry != &pHandle->PendingList ? CONTAINING_RECORD(pEntry, IRP, Tail.Overlay.ListEntry) : NULL;
+    }
+
+    if (pIrp)
+    {
+        pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+        pEntry = pIrp->Tail.Overlay.ListEntry.Flink;
+
+        if (pEntry != &pHandle->PendingList)
+            return CONTAINING_RECORD(pEntry, IRP, Tail.Overlay.ListEntry);
+
+        pEntry = pHandle->WaitingEntry.Flink;
+    }
+    else
+    {
+        pEntry = pChannel->WaitingHandles.Flink;
+    }
+
+    if (pEntry == &pChannel->WaitingHandles)
+        return NULL;
+
+    //
+    //	A handle is only in line while it has reads.
+    //
+    pHandle = CONTAINING_RECORD(pEntry, HANDLE_CONTEXT, WaitingEntry);
+
+    return CONTAINING_RECORD(pHandle->PendingList.Flink, IRP, Tail.Overlay.ListEntry);
+}
+
+
+static VOID
+CsqAcquireLock(
+    IN  PIO_CSQ pCsq,
+    OUT  PKIRQL pIrql
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+
+    KeAcquireSpinLock(&pChannel->PendingLock, pIrql);
+}
+
+
+static VOID
+CsqReleaseLock(
+    IN  PIO_CSQ pCsq,
+    IN  KIRQL Irql
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+
+    KeReleaseSpinLock(&pChannel->PendingLock, Irql);
+}
+
+
+static VOID
+CsqCompleteCanceledIrp(
+    IN  PIO_CSQ pCsq,
+    IN  PIRP pIrp
+)
+{
+    PCHANNEL pChannel = CONTAINING_RECORD(pCsq, CHANNEL, PendingReads);
+
+    pIrp->IoStatus.Status = STATUS_CANCELLED;
+    pIrp->IoStatus.Information = 0;
+
+    StatsCompleteRequest(pChannel->pDeviceExtension, pIrp);
+}
+
+
+//
+//	Hands messages to pending reads until either runs out. With a
+//	subscription only the reads of its handle are served, from its queue,
+//	else the reads of the handles in line, from the rings of the channel.
+//
+static VOID
+ServicePendingReads(
+    IN  PCHANNEL pChannel,
+    IN  PSUBSCRIPTION pSubscription
+)
+{
+    NTSTATUS NtStatus;
+    PIRP pIrp;
+    PCHAR pReadDataBuffer;
+    UINT dwDataRead;
+
+    for (;;)
+    {
+        //
+        //	Pairs with the queue lock taken by PendRead so that either the
+        //	writer sees the queued read or the reader sees the message.
+        //
+        KeMemoryBarrier();
+
+        if (pSubscription ? !RingPeek(&pSubscription->Ring) : !ShardsHaveMessage(pChannel))
+            break;
+
+        pIrp = IoCsqRemoveNextIrp(&pChannel->PendingReads, pSubscription ? pSubscription->pFileObject : NULL);
+
+        if (!pIrp)
+            break;
+
+        NtStatus = STATUS_INSUFFICIENT_RESOURCES;
+        dwDataRead = 0;
+
+        if (pIrp->MdlAddress)
+            pReadDataBuffer = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority | MdlMappingNoExecute);
+        else
+            pReadDataBuffer = (PCHAR)pIrp->AssociatedIrp.SystemBuffer;
+
+        if (pReadDataBuffer)
+        {
+            NtStatus = FetchMessages(
+                IoGetCurrentIrpStackLocation(pIrp)->FileObject,
+                pReadDataBuffer,
+                GetTransferLength(IoGetCurrentIrpStackLocation(pIrp)),
+                &dwDataRead
+            );
+        }
+
+        //
+        //	Another reader took the message first, the read waits for the next one.
+        //
+        if (NT_SUCCESS(NtStatus) && !dwDataRead)
+        {
+            IoCsqInsertIrpEx(&pChannel->PendingReads, pIrp, NULL, PENDING_INSERT_HEAD);
+            continue;
+        }
+
+        if (NT_SUCCESS(NtStatus))
+            HandleCountRead(IoGetCurrentIrpStackLocation(pIrp)->FileObject, dwDataRead);
+
+        pIrp->IoStatus.Status = NtStatus;
+        pIrp->IoStatus.Information = dwDataRead;
+
+        StatsCompleteRequest(pChannel->pDeviceExtension, pIrp);
+    }
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializePendingReads
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Prepares the empty queue of pending reads.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializePendingReads(
+    IN OUT  PCHANNEL pChannel
+)
+{
+    PAGED_CODE();
+
+    InitializeListHead(&pChannel->WaitingHandles);
+    KeInitializeSpinLock(&pChannel->PendingLock);
+
+    IoCsqInitializeEx(
+        &pChannel->PendingReads,
+        CsqInsertIrp,
+        CsqRemoveIrp,
+        CsqPeekNextIrp,
+        CsqAcquireLock,
+        CsqReleaseLock,
+        CsqCompleteCanceledIrp
+    );
+}
+
+
+//***********************************************************************************
+//	Function:
+//		PendRead
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle the read was sent on.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Buffered or direct read that found the ring empty.
+//
+//	Routine Description:
+//		Queues the read on its handle until a message arrives or it is
+//		cancelled. A write may have slipped in between the read finding
+//		the ring empty and the read being queued, so the queue is serviced
+//		once more after the insertion, the subscription for a subscribed
+//		handle.
+//
+//	Return Value:
+//		STATUS_PENDING, or STATUS_DEVICE_BUSY if the handle already has
+//		as many reads waiting as its settings allow.
+//
+//***********************************************************************************
+NTSTATUS
+PendRead(
+    IN  PCHANNEL pChannel,
+    IN OUT  PIRP pIrp
+)
+{
+    PHANDLE_CONTEXT pHandle = IoGetCurrentIrpStackLocation(pIrp)->FileObject->FsContext;
+
+    PAGED_CODE();
+
+    //
+    //	Read without the lock, the limit may be overshot by reads racing it.
+    //
+    if (pHandle->Settings.ulMaxPendingReads &&
+        *(volatile ULONG*)&pHandle->ulPendingReads >= pHandle->Settings.ulMaxPendingReads)
+    {
+        pIrp->IoStatus.Status = STATUS_DEVICE_BUSY;
+        pIrp->IoStatus.Information = 0;
+
+        StatsCompleteRequest(pChannel->pDeviceExtension, pIrp);
+
+        return STATUS_DEVICE_BUSY;
+    }
+
+    InterlockedIncrement64(&pHandle->llReadsPended);
+
+    IoMarkIrpPending(pIrp);
+    IoCsqInsertIrpEx(&pChannel->PendingReads, pIrp, NULL, NULL);
+
+    ServicePendingReads(pChannel, pHandle->pSubscription);
+
+    return STATUS_PENDING;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CompletePendingReads
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel that was written to.
+//
+//	Routine Description:
+//		Hands messages from the ring to the pending reads, one handle
+//		after the other and the oldest read of each handle first, until
+//		either of them runs out. Called after every write.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CompletePendingReads(
+    IN  PCHANNEL pChannel
+)
+{
+    ServicePendingReads(pChannel, NULL);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CompleteSubscriberReads
+//
+//	Parameters:
+//		[IN]  SUBSCRIPTION* pSubscription
+//		Subscription that was published to.
+//
+//	Routine Description:
+//		Hands messages from the subscription to the pending reads of its
+//		handle, oldest read first, until either of them runs out. Called
+//		by publishers at DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CompleteSubscriberReads(
+    IN  PSUBSCRIPTION pSubscription
+)
+{
+    ServicePendingReads(pSubscription->pChannel, pSubscription);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CancelPendingReads
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel of the handle.
+//
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Completes every read still pending on the handle with STATUS_CANCELLED.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CancelPendingReads(
+    IN  PCHANNEL pChannel,
+    IN  PFILE_OBJECT pFileObject
+)
+{
+    PIRP pIrp;
+
+    PAGED_CODE();
+
+    while ((pIrp = IoCsqRemoveNextIrp(&pChannel->PendingReads, pFileObject)) != NULL)
+    {
+        pIrp->IoStatus.Status = STATUS_CANCELLED;
+        pIrp->IoStatus.Information = 0;
+
+        StatsCompleteRequest(pChannel->pDeviceExtension, pIrp);
+    }
+}
@@ -0,0 +1,424 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	pubsub.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements publishing on a channel. A published					*
+* 	message is stored once and every handle subscribed to the					*
+* 	channel queues a pointer to it, the last subscriber to read it				*
+* 	frees it. Publishers hold spin locks, so this file stays resident.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Drops lCount references to a published message, the last one frees it.
+//
+static VOID
+ReleaseMessage(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PFINGS_MESSAGE pMessage,
+    IN  LONG lCount
+)
+{
+    if (InterlockedAdd(&pMessage->lReferences, -lCount) == 0)
+        FreeMessage(pDeviceExtension, pMessage);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSubscribe
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SUBSCRIBE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Gives the handle a queue of its own and adds it to the subscribers
+//		of its channel. Reads on the handle are served from that queue
+//		from then on.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the handle is subscribed already or has reads pending, the return value is STATUS_INVALID_DEVICE_STATE.
+//		If the queue length is not a power of two from 2 or too large, the return value is STATUS_INVALID_PARAMETER.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSubscribe(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    PFILE_OBJECT pFileObject = pIoStackIrp->FileObject;
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PCHANNEL pChannel = pHandle->pChannel;
+    PFINGS_SUBSCRIBE_INPUT pInput = pIrp->AssociatedIrp.SystemBuffer;
+    PSUBSCRIPTION pSubscription;
+    ULONG ulMaxMessages = FINGS_SUBSCRIBE_DEFAULT_MESSAGES;
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    KIRQL Irql;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength >= sizeof(FINGS_SUBSCRIBE_INPUT) &&
+        pInput && pInput->ulMaxMessages)
+        ulMaxMessages = pInput->ulMaxMessages;
+
+    //
+    //	A ring of one cell would hand it to the next writer before it is read.
+    //
+    if (ulMaxMessages < 2 || ulMaxMessages > FINGS_SUBSCRIBE_MAX_MESSAGES || (ulMaxMessages & (ulMaxMessages - 1)))
+        return STATUS_INVALID_PARAMETER;
+
+    //
+    //	Cache aligned like the rings of the channel, the cells follow.
+    //
+    pSubscription = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(SUBSCRIPTION) + sizeof(RING_CELL) * ulMaxMessages,
+        FINGS_POOL_TAG
+    );
+
+    if (!pSubscription)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    pSubscription->pChannel = pChannel;
+    pSubscription->pFileObject = pFileObject;
+    KeInitializeSpinLock(&pSubscription->ReadLock);
+    RingInitialize(&pSubscription->Ring, (PRING_CELL)(pSubscription + 1), ulMaxMessages);
+
+    //
+    //	Switched under the queue lock, so that no read of the handle is
+    //	left waiting in WaitingHandles once it reads from its subscription.
+    //
+    KeAcquireSpinLock(&pChannel->PendingLock, &Irql);
+
+    if (pHandle->pSubscription || pHandle->ulPendingReads)
+        NtStatus = STATUS_INVALID_DEVICE_STATE;
+    else
+        pHandle->pSubscription = pSubscription;
+
+    KeReleaseSpinLock(&pChannel->PendingLock, Irql);
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        ExFreePoolWithTag(pSubscription, FINGS_POOL_TAG);
+        return NtStatus;
+    }
+
+    Irql = ExAcquireSpinLockExclusive(&pChannel->SubscriberLock);
+
+    InsertTailList(&pChannel->Subscribers, &pSubscription->SubscriberEntry);
+    pChannel->ulSubscriberCount++;
+
+    ExReleaseSpinLockExclusive(&pChannel->SubscriberLock, Irql);
+
+    LOG_INFO("Handle subscribed with a queue of %u messages", ulMaxMessages);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		Unsubscribe
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Takes the handle off the subscribers of its channel, lets go of
+//		the messages it did not read and frees its queue. Nothing is done
+//		for a handle that never subscribed. Its reads must have been
+//		cancelled already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+Unsubscribe(
+    IN  PFILE_OBJECT pFileObject
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PSUBSCRIPTION pSubscription = pHandle->pSubscription;
+    PCHANNEL pChannel;
+    PFINGS_MESSAGE pMessage;
+    KIRQL Irql;
+
+    if (!pSubscription)
+        return;
+
+    pChannel = pSubscription->pChannel;
+
+    Irql = ExAcquireSpinLockExclusive(&pChannel->SubscriberLock);
+
+    RemoveEntryList(&pSubscription->SubscriberEntry);
+    pChannel->ulSubscriberCount--;
+
+    ExReleaseSpinLockExclusive(&pChannel->SubscriberLock, Irql);
+
+    //
+    //	No publisher can reach the queue any more.
+    //
+    while ((pMessage = RingDequeue(&pSubscription->Ring)) != NULL)
+        ReleaseMessage(pChannel->pDeviceExtension, pMessage, 1);
+
+    pHandle->pSubscription = NULL;
+    ExFreePoolWithTag(pSubscription, FINGS_POOL_TAG);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlPublish
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_PUBLISH request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of subscribers the message was queued for.
+//
+//	Routine Description:
+//		Copies the message once into a block of the message slab and
+//		queues a pointer to it for every subscriber of the channel, then
+//		completes the reads the subscribers have waiting for it.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS, even
+//		if no subscriber had room for the message.
+//		If the message is not NULL terminated, the return value is STATUS_INVALID_PARAMETER.
+//		If the message is longer than the channel allows, the return value is STATUS_INVALID_BUFFER_SIZE.
+//		If the quota of the handle or of its process is used up, the return value is STATUS_DEVICE_BUSY.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlPublish(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pIoStackIrp->FileObject);
+    PCHAR pData = pIrp->AssociatedIrp.SystemBuffer;
+    ULONG ulMaxMessageLength = *(volatile ULONG*)&pChannel->Limits.ulMaxMessageLength;
+    NTSTATUS NtStatus;
+    PFINGS_MESSAGE pMessage;
+    PSUBSCRIPTION pSubscription;
+    PHANDLE_CONTEXT pHandle;
+    PQUOTA pQuota;
+    PLIST_ENTRY pEntry;
+    UINT uiLength;
+    ULONG ulQueued = 0;
+    LONG lMissed = 0;
+    KIRQL Irql;
+
+    *pInformation = 0;
+
+    if (!pData || !IsStringTerminated(pData, GetTransferLength(pIoStackIrp), &uiLength))
+        return STATUS_INVALID_PARAMETER;
+
+    if (ulMaxMessageLength && uiLength > ulMaxMessageLength)
+    {
+        InterlockedIncrement64(&pChannel->llMessagesRejected);
+        LOG_WARNING("Message of %u bytes over the limits of its channel", uiLength);
+        return STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    //
+    //	Publishing never waits, there is no IRP queue it could wait in.
+    //
+    NtStatus = ChargeQuota(pIoStackIrp->FileObject, uiLength, FALSE, &pQuota);
+
+    if (!NT_SUCCESS(NtStatus))
+        return NtStatus;
+
+    pMessage = AllocateMessage(pChannel->pDeviceExtension, uiLength);
+
+    if (!pMessage)
+    {
+        ReleaseQuota(pChannel->pDeviceExtension, pQuota, uiLength);
+        LOG_WARNING("No memory for a message of %u bytes", uiLength);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pMessage->pQuota = pQuota;
+    RtlCopyMemory(pMessage->Data, pData, uiLength);
+    pMessage = CompressMessage(pChannel, pMessage);
+    pMessage->ullSequence = (ULONG64)InterlockedIncrement64(&pChannel->llSequence);
+    pMessage->llStamp = KeQueryPerformanceCounter(NULL).QuadPart;
+    pMessage->ulProcessId = (ULONG)(ULONG_PTR)PsGetCurrentProcessId();
+    pMessage->ulThreadId = (ULONG)(ULONG_PTR)PsGetCurrentThreadId();
+
+    Irql = ExAcquireSpinLockShared(&pChannel->SubscriberLock);
+
+    //
+    //	Every subscriber gets a reference up front, plus one held while the
+    //	message is handed out, so a subscriber may read it at once. The
+    //	references of the subscribers that miss it are dropped at the end
+    //	in one step, with the held one.
+    //
+    pMessage->lReferences = (LONG)pChannel->ulSubscriberCount + 1;
+
+    for (pEntry = pChannel->Subscribers.Flink; pEntry != &pChannel->Subscribers; pEntry = pEntry->Flink)
+    {
+        pSubscription = CONTAINING_RECORD(pEntry, SUBSCRIPTION, SubscriberEntry);
+
+        if (!RingEnqueue(&pSubscription->Ring, pMessage))
+        {
+            InterlockedIncrement64(&pSubscription->llMessagesMissed);
+            lMissed++;
+            continue;
+        }
+
+        ulQueued++;
+
+        //
+        //	Pairs with the queue lock taken by PendRead so that either the
+        //	publisher sees the queued read or the reader sees the message.
+        //	Only the subscribers with reads waiting pay for the queue lock.
+        //
+        KeMemoryBarrier();
+
+        pHandle = pSubscription->pFileObject->FsContext;
+
+        if (*(volatile ULONG*)&pHandle->ulPendingReads)
+            CompleteSubscriberReads(pSubscription);
+    }
+
+    ExReleaseSpinLockShared(&pChannel->SubscriberLock, Irql);
+
+    ReleaseMessage(pChannel->pDeviceExtension, pMessage, lMissed + 1);
+
+    LOG_VERBOSE("Published a message of %u bytes to %u subscribers", uiLength, ulQueued);
+
+    HandleCountWrite(pIoStackIrp->FileObject, 1, uiLength);
+    *pInformation = ulQueued;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FetchPublished
+//
+//	Parameters:
+//		[IN]  SUBSCRIPTION* pSubscription
+//		Subscription the messages are read from.
+//	   
+//		[OUT]  PCHAR pBuffer
+//		Buffer receiving the messages, may be a user mode address.
+// 
+//		[IN]  UINT uiLength
+//		Length of the buffer.
+// 
+//		[OUT]	UINT* pdwDataRead
+//		Number of bytes used in the buffer, 0 if there was no message.
+// 
+//	Routine Description:
+//		Takes the oldest messages out of the subscription like FetchMessages
+//		does out of the rings of a channel, and drops the subscriber's
+//		reference to each once it is copied.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If not even the oldest message fits, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+FetchPublished(
+    IN  PSUBSCRIPTION pSubscription,
+    OUT  PCHAR pBuffer,
+    IN  UINT uiLength,
+    OUT  UINT* pdwDataRead
+)
+{
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    PFINGS_MESSAGE pMessage;
+    PFINGS_READ_RECORD pRecord;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    UINT uiOffset = 0;
+
+    *pdwDataRead = 0;
+
+    while (NT_SUCCESS(NtStatus) && uiOffset < uiLength)
+    {
+        KeAcquireInStackQueuedSpinLock(&pSubscription->ReadLock, &LockHandle);
+
+        pMessage = RingPeek(&pSubscription->Ring);
+
+        if (pMessage)
+        {
+            if (FIELD_OFFSET(FINGS_READ_RECORD, Data) + pMessage->ulLength <= uiLength - uiOffset)
+            {
+                RingDequeue(&pSubscription->Ring);
+            }
+            else
+            {
+                if (!uiOffset)
+                    NtStatus = STATUS_BUFFER_TOO_SMALL;
+
+                pMessage = NULL;
+            }
+        }
+
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+        if (!pMessage)
+            break;
+
+        pRecord = (PFINGS_READ_RECORD)(pBuffer + uiOffset);
+
+        __try
+        {
+            pRecord->ulLength = pMessage->ulLength;
+            NtStatus = ExpandMessage(pMessage, pRecord->Data);
+
+            if (NT_SUCCESS(NtStatus))
+                *pdwDataRead = uiOffset + FIELD_OFFSET(FINGS_READ_RECORD, Data) + pMessage->ulLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            NtStatus = GetExceptionCode();
+        }
+
+        uiOffset += FINGS_READ_RECORD_SIZE(pMessage->ulLength);
+
+        ReleaseMessage(pSubscription->pChannel->pDeviceExtension, pMessage, 1);
+    }
+
+    return NtStatus;
+}
@@ -0,0 +1,869 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	quota.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the quotas of the writers. Every handle has			*
+* 	one and so does every process with handles open, a message is				*
+* 	charged to both until it is freed. Each quota bounds the messages			*
+* 	and bytes charged and has token buckets for its rates.						*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <ntddk.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Everything else takes the quota spin locks and stays resident.
+//
+#pragma alloc_text(INIT, InitializeQuotas)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Tokens a bucket holds when full, 0 if the rate does not apply.
+//
+static ULONG64
+BucketSize(
+    IN  ULONG ulRate,
+    IN  ULONG ulBurst
+)
+{
+    if (!ulRate)
+        return 0;
+
+    return (ULONG64)(ulBurst ? ulBurst : ulRate) * FINGS_QUOTA_TOKEN;
+}
+
+
+//
+//	Adds what ulRate earned over ullElapsed 100 ns units to a bucket.
+//	Comparing the time first keeps the product below the bucket size.
+//
+static ULONG64
+RefillBucket(
+    IN  ULONG64 ullTokens,
+    IN  ULONG ulRate,
+    IN  ULONG ulBurst,
+    IN  ULONG64 ullElapsed
+)
+{
+    ULONG64 ullSize = BucketSize(ulRate, ulBurst);
+
+    if (!ullSize || ullElapsed >= ullSize / ulRate)
+        return ullSize;
+
+    ullTokens += ullElapsed * ulRate;
+
+    return ullTokens < ullSize ? ullTokens : ullSize;
+}
+
+
+//
+//	Whether any of the limits applies.
+//
+static BOOLEAN
+HasLimits(
+    IN  CONST FINGS_QUOTA* pLimits
+)
+{
+    return pLimits->ulMaxMessages || pLimits->ulMaxBytes ||
+           pLimits->ulMessagesPerSecond || pLimits->ulBytesPerSecond;
+}
+
+
+//
+//	Byte tokens a message of ulLength bytes takes, at most a full bucket.
+//
+static ULONG64
+ByteCost(
+    IN  PFINGS_QUOTA pLimits,
+    IN  ULONG ulLength
+)
+{
+    ULONG64 ullCost = (ULONG64)ulLength * FINGS_QUOTA_TOKEN;
+    ULONG64 ullSize = BucketSize(pLimits->ulBytesPerSecond, pLimits->ulBurstBytes);
+
+    return ullCost < ullSize ? ullCost : ullSize;
+}
+
+
+//
+//	Checks a message of ulLength bytes against the quota, refilled up to
+//	ullNow first. The caller holds its lock. Sets *pbRate when a rate is
+//	what is used up.
+//
+static BOOLEAN
+QuotaHasRoom(
+    IN OUT  PQUOTA pQuota,
+    IN  ULONG ulLength,
+    IN  ULONG64 ullNow,
+    OUT  PBOOLEAN pbRate
+)
+{
+    PFINGS_QUOTA pLimits = &pQuota->Limits;
+    ULONG64 ullElapsed = ullNow - pQuota->ullRefillTime;
+
+    pQuota->ullRefillTime = ullNow;
+    pQuota->ullMessageTokens = RefillBucket(pQuota->ullMessageTokens, pLimits->ulMessagesPerSecond, pLimits->ulBurstMessages, ullElapsed);
+    pQuota->ullByteTokens = RefillBucket(pQuota->ullByteTokens, pLimits->ulBytesPerSecond, pLimits->ulBurstBytes, ullElapsed);
+
+    *pbRate = FALSE;
+
+    if (pLimits->ulMaxMessages && pQuota->llMessages >= pLimits->ulMaxMessages)
+        return FALSE;
+
+    if (pLimits->ulMaxBytes && pQuota->llMessages && pQuota->llBytes + ulLength > pLimits->ulMaxBytes)
+        return FALSE;
+
+    *pbRate = TRUE;
+
+    if (pLimits->ulMessagesPerSecond && pQuota->ullMessageTokens < FINGS_QUOTA_TOKEN)
+        return FALSE;
+
+    if (pLimits->ulBytesPerSecond && pQuota->ullByteTokens < ByteCost(pLimits, ulLength))
+        return FALSE;
+
+    *pbRate = FALSE;
+
+    return TRUE;
+}
+
+
+//
+//	Charges a message of ulLength bytes to a quota that has room for it.
+//
+static VOID
+TakeQuota(
+    IN OUT  PQUOTA pQuota,
+    IN  ULONG ulLength
+)
+{
+    pQuota->llMessages++;
+    pQuota->llBytes += ulLength;
+
+    if (pQuota->Limits.ulMessagesPerSecond)
+        pQuota->ullMessageTokens -= FINGS_QUOTA_TOKEN;
+
+    if (pQuota->Limits.ulBytesPerSecond)
+        pQuota->ullByteTokens -= ByteCost(&pQuota->Limits, ulLength);
+}
+
+
+//
+//	Charges a message to the handle quota and its process quota, both or
+//	neither. Returns NULL once charged, else the quota that is full.
+//
+static PQUOTA
+TryChargeQuota(
+    IN  PQUOTA pQuota,
+    IN  ULONG ulLength,
+    OUT  PBOOLEAN pbRate
+)
+{
+    PQUOTA pProcess = pQuota->pProcess;
+    ULONG64 ullNow = KeQueryInterruptTime();
+    PQUOTA pFull = NULL;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&pQuota->Lock, &OldIrql);
+    KeAcquireSpinLockAtDpcLevel(&pProcess->Lock);
+
+    if (!QuotaHasRoom(pQuota, ulLength, ullNow, pbRate))
+        pFull = pQuota;
+    else if (!QuotaHasRoom(pProcess, ulLength, ullNow, pbRate))
+        pFull = pProcess;
+
+    if (!pFull)
+    {
+        TakeQuota(pQuota, ulLength);
+        TakeQuota(pProcess, ulLength);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&pProcess->Lock);
+    KeReleaseSpinLock(&pQuota->Lock, OldIrql);
+
+    return pFull;
+}
+
+
+//
+//	Drops the oldest message of the channel if it is charged to pFull,
+//	directly or through its process. Returns FALSE if it is not.
+//
+static BOOLEAN
+DropOldestMessage(
+    IN  PCHANNEL pChannel,
+    IN  PQUOTA pFull
+)
+{
+    PFINGS_MESSAGE pMessage;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    ULONG ulShard;
+
+    KeAcquireInStackQueuedSpinLock(&pChannel->ReadLock, &LockHandle);
+
+    pMessage = ShardPeek(pChannel, &ulShard);
+
+    if (pMessage && pMessage->pQuota && (pMessage->pQuota == pFull || pMessage->pQuota->pProcess == pFull))
+        RingDequeue(&pChannel->pShards[ulShard]);
+    else
+        pMessage = NULL;
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    if (!pMessage)
+        return FALSE;
+
+    InterlockedIncrement64(&pFull->llMessagesDropped);
+    FreeMessage(pChannel->pDeviceExtension, pMessage);
+
+    return TRUE;
+}
+
+
+//
+//	Drops a reference to a process quota, the last one takes it off the
+//	list of the device and frees it.
+//
+static VOID
+DereferenceProcessQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PQUOTA pProcess
+)
+{
+    BOOLEAN bFree;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&pDeviceExtension->ProcessQuotaLock, &OldIrql);
+
+    bFree = --pProcess->lReferences == 0;
+
+    if (bFree)
+        RemoveEntryList(&pProcess->ProcessEntry);
+
+    KeReleaseSpinLock(&pDeviceExtension->ProcessQuotaLock, OldIrql);
+
+    if (bFree)
+        ExFreePoolWithTag(pProcess, FINGS_POOL_TAG);
+}
+
+
+//
+//	Drops a reference to a handle quota, the last one frees it and drops
+//	its reference to the process quota.
+//
+static VOID
+DereferenceQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PQUOTA pQuota
+)
+{
+    if (InterlockedDecrement(&pQuota->lReferences))
+        return;
+
+    DereferenceProcessQuota(pDeviceExtension, pQuota->pProcess);
+    ExFreePoolWithTag(pQuota, FINGS_POOL_TAG);
+}
+
+
+//
+//	Newest quota of the process with this ID, or NULL. The caller holds
+//	ProcessQuotaLock. An exited process may still have messages waiting,
+//	a process created since with the same ID is told apart by llCreateTime
+//	unless it is 0.
+//
+static PQUOTA
+FindProcessQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  HANDLE hProcessId,
+    IN  LONG64 llCreateTime
+)
+{
+    PLIST_ENTRY pEntry;
+    PQUOTA pProcess;
+
+    for (pEntry = pDeviceExtension->ProcessQuotas.Blink; pEntry != &pDeviceExtension->ProcessQuotas; pEntry = pEntry->Blink)
+    {
+        pProcess = CONTAINING_RECORD(pEntry, QUOTA, ProcessEntry);
+
+        if (pProcess->hProcessId == hProcessId && (!llCreateTime || pProcess->llProcessCreateTime == llCreateTime))
+            return pProcess;
+    }
+
+    return NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeQuotas
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Prepares the empty list of process quotas. Processes get no limits
+//		until IOCTL_6FINGS_SET_PROCESS_QUOTA sets some.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeQuotas(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    InitializeListHead(&pDeviceExtension->ProcessQuotas);
+    KeInitializeSpinLock(&pDeviceExtension->ProcessQuotaLock);
+    RtlZeroMemory(&pDeviceExtension->DefaultQuota, sizeof(FINGS_QUOTA));
+}
+
+
+//***********************************************************************************
+//	Function:
+//		OpenHandleQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  HANDLE_CONTEXT* pHandle
+//		Handle being opened, receives its quota.
+//
+//	Routine Description:
+//		Gives the handle a quota without limits, tied to the quota of the
+//		calling process, which is created with the default limits if this
+//		is its first handle.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+OpenHandleQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PHANDLE_CONTEXT pHandle
+)
+{
+    HANDLE hProcessId = PsGetCurrentProcessId();
+    LONG64 llCreateTime = PsGetProcessCreateTimeQuadPart(PsGetCurrentProcess());
+    PQUOTA pQuota;
+    PQUOTA pProcess;
+    PQUOTA pNew;
+    KIRQL OldIrql;
+
+    pQuota = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(QUOTA), FINGS_POOL_TAG);
+    pNew = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(QUOTA), FINGS_POOL_TAG);
+
+    if (!pQuota || !pNew)
+    {
+        if (pQuota)
+            ExFreePoolWithTag(pQuota, FINGS_POOL_TAG);
+
+        if (pNew)
+            ExFreePoolWithTag(pNew, FINGS_POOL_TAG);
+
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeAcquireSpinLock(&pDeviceExtension->ProcessQuotaLock, &OldIrql);
+
+    pProcess = FindProcessQuota(pDeviceExtension, hProcessId, llCreateTime);
+
+    if (!pProcess)
+    {
+        pProcess = pNew;
+        pNew = NULL;
+
+        KeInitializeSpinLock(&pProcess->Lock);
+        pProcess->Limits = pDeviceExtension->DefaultQuota;
+        pProcess->bLimited = HasLimits(&pProcess->Limits);
+        pProcess->hProcessId = hProcessId;
+        pProcess->llProcessCreateTime = llCreateTime;
+
+        InsertTailList(&pDeviceExtension->ProcessQuotas, &pProcess->ProcessEntry);
+    }
+
+    pProcess->lReferences++;
+    pProcess->ulHandles++;
+
+    KeReleaseSpinLock(&pDeviceExtension->ProcessQuotaLock, OldIrql);
+
+    if (pNew)
+        ExFreePoolWithTag(pNew, FINGS_POOL_TAG);
+
+    KeInitializeSpinLock(&pQuota->Lock);
+    pQuota->lReferences = 1;
+    pQuota->pProcess = pProcess;
+
+    pHandle->pQuota = pQuota;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CloseHandleQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  HANDLE_CONTEXT* pHandle
+//		Handle being closed.
+//
+//	Routine Description:
+//		Drops the handle's reference to its quota. The quota stays until
+//		the messages charged to it are freed.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+CloseHandleQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PHANDLE_CONTEXT pHandle
+)
+{
+    PQUOTA pQuota = pHandle->pQuota;
+    KIRQL OldIrql;
+
+    if (!pQuota)
+        return;
+
+    KeAcquireSpinLock(&pDeviceExtension->ProcessQuotaLock, &OldIrql);
+    pQuota->pProcess->ulHandles--;
+    KeReleaseSpinLock(&pDeviceExtension->ProcessQuotaLock, OldIrql);
+
+    pHandle->pQuota = NULL;
+    DereferenceQuota(pDeviceExtension, pQuota);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SetQuotaLimits
+//
+//	Parameters:
+//		[IN/OUT]  QUOTA* pQuota
+//		Quota of a handle or of a process.
+//
+//		[IN]  FINGS_QUOTA* pLimits
+//		New limits.
+//
+//	Routine Description:
+//		Replaces the limits of the quota. The buckets start full, messages
+//		already charged stay even if there are more than the new limits.
+//		Messages written while no limit applied were not charged and do
+//		not count against the new ones.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SetQuotaLimits(
+    IN OUT  PQUOTA pQuota,
+    IN  CONST FINGS_QUOTA* pLimits
+)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&pQuota->Lock, &OldIrql);
+
+    pQuota->Limits = *pLimits;
+    pQuota->ullRefillTime = 0;
+    pQuota->bLimited = HasLimits(pLimits);
+
+    KeReleaseSpinLock(&pQuota->Lock, OldIrql);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		QueryQuota
+//
+//	Parameters:
+//		[IN]  QUOTA* pQuota
+//		Quota of a handle or of a process.
+//
+//		[OUT]  FINGS_QUOTA* pLimits
+//		Optional, receives the limits.
+//
+//		[OUT]  FINGS_QUOTA_USAGE* pUsage
+//		Receives what is charged and the counters.
+//
+//	Routine Description:
+//		Reads the limits and the usage of the quota.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+QueryQuota(
+    IN  PQUOTA pQuota,
+    OUT  PFINGS_QUOTA pLimits,
+    OUT  PFINGS_QUOTA_USAGE pUsage
+)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&pQuota->Lock, &OldIrql);
+
+    if (pLimits)
+        *pLimits = pQuota->Limits;
+
+    pUsage->ullMessages = (ULONG64)pQuota->llMessages;
+    pUsage->ullBytes = (ULONG64)pQuota->llBytes;
+
+    KeReleaseSpinLock(&pQuota->Lock, OldIrql);
+
+    pUsage->ullWritesThrottled = (ULONG64)pQuota->llWritesThrottled;
+    pUsage->ullWritesRejected = (ULONG64)pQuota->llWritesRejected;
+    pUsage->ullWritesBlocked = (ULONG64)pQuota->llWritesBlocked;
+    pUsage->ullMessagesDropped = (ULONG64)pQuota->llMessagesDropped;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ChargeQuota
+//
+//	Parameters:
+//		[IN]  FILE_OBJECT* pFileObject
+//		Handle the message is written on.
+//
+//		[IN]  ULONG ulLength
+//		Length of the message including NULL character.
+//
+//		[IN]  BOOLEAN bCanWait
+//		TRUE if the caller can pend the write with BlockWrite.
+//
+//		[OUT]  QUOTA** ppQuota
+//		Receives the quota to keep in the message, referenced for it, or
+//		NULL if the message is not charged.
+//
+//	Routine Description:
+//		Charges a message to the quota of the handle and of its process
+//		before it is allocated. When neither has a limit nothing is
+//		charged, so writers of a process do not meet on its quota lock
+//		for nothing. When either is full the policy of the
+//		handle decides: the write fails, waits if it can, or makes room by
+//		dropping the oldest messages charged to the full quota.
+//
+//		A handle with writes waiting keeps every new write that can wait
+//		behind them, so its messages stay in order. The thread retrying
+//		them is let through.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the message was charged, the return value is STATUS_SUCCESS.
+//		If the write has to wait, the return value is STATUS_RETRY.
+//		Else the return value is STATUS_DEVICE_BUSY.
+//
+//***********************************************************************************
+NTSTATUS
+ChargeQuota(
+    IN  PFILE_OBJECT pFileObject,
+    IN  ULONG ulLength,
+    IN  BOOLEAN bCanWait,
+    OUT  PQUOTA* ppQuota
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PQUOTA pQuota = pHandle->pQuota;
+    ULONG ulPolicy = *(volatile ULONG*)&pHandle->Settings.ulFullPolicy;
+    BOOLEAN bRetry = pHandle->pRetryThread == KeGetCurrentThread();
+    BOOLEAN bRate;
+    PQUOTA pFull;
+
+    *ppQuota = NULL;
+
+    if (ulPolicy != FINGS_QUOTA_BLOCK)
+        bCanWait = FALSE;
+
+    if (bCanWait && !bRetry && pHandle->lBlockedWrites)
+    {
+        InterlockedIncrement64(&pQuota->llWritesBlocked);
+        return STATUS_RETRY;
+    }
+
+    if (!pQuota->bLimited && !pQuota->pProcess->bLimited)
+        return STATUS_SUCCESS;
+
+    while ((pFull = TryChargeQuota(pQuota, ulLength, &bRate)) != NULL)
+    {
+        //
+        //	Dropping only ever frees messages charged to the full quota, so
+        //	the loop ends once there are none left at the front.
+        //
+        if (ulPolicy == FINGS_QUOTA_DROP_OLDEST && !bRate && DropOldestMessage(pHandle->pChannel, pFull))
+            continue;
+
+        //
+        //	A retried write was counted when it first had to wait.
+        //
+        if (!bRetry)
+        {
+            if (bRate)
+                InterlockedIncrement64(&pFull->llWritesThrottled);
+
+            InterlockedIncrement64(bCanWait ? &pFull->llWritesBlocked : &pFull->llWritesRejected);
+        }
+
+        return bCanWait ? STATUS_RETRY : STATUS_DEVICE_BUSY;
+    }
+
+    //
+    //	The handle holds a reference while it writes, this one cannot be the first.
+    //
+    InterlockedIncrement(&pQuota->lReferences);
+    *ppQuota = pQuota;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ReleaseQuota
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  QUOTA* pQuota
+//		Quota returned by ChargeQuota, may be NULL.
+//
+//		[IN]  ULONG ulLength
+//		Length of the message it was charged for.
+//
+//	Routine Description:
+//		Takes a message that is freed off the quota of its handle and of
+//		its process, and drops the message's reference to the quota.
+//		Runs at DISPATCH_LEVEL or below.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+ReleaseQuota(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PQUOTA pQuota,
+    IN  ULONG ulLength
+)
+{
+    PQUOTA pProcess;
+    KIRQL OldIrql;
+
+    if (!pQuota)
+        return;
+
+    pProcess = pQuota->pProcess;
+
+    KeAcquireSpinLock(&pQuota->Lock, &OldIrql);
+    KeAcquireSpinLockAtDpcLevel(&pProcess->Lock);
+
+    pQuota->llMessages--;
+    pQuota->llBytes -= ulLength;
+    pProcess->llMessages--;
+    pProcess->llBytes -= ulLength;
+
+    KeReleaseSpinLockFromDpcLevel(&pProcess->Lock);
+    KeReleaseSpinLock(&pQuota->Lock, OldIrql);
+
+    DereferenceQuota(pDeviceExtension, pQuota);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlSetProcessQuota
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_SET_PROCESS_QUOTA request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Replaces the limits of a process, or the default limits for
+//		process ID 0. Only callers allowed to adjust memory quotas may.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the process has no handle open, the return value is STATUS_NOT_FOUND.
+//		If SeIncreaseQuotaPrivilege is not enabled, the return value is STATUS_PRIVILEGE_NOT_HELD.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlSetProcessQuota(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    PDEVICE_EXTENSION pDeviceExtension = FINGS_FILE_CHANNEL(pIoStackIrp->FileObject)->pDeviceExtension;
+    PFINGS_PROCESS_QUOTA pInput = pIrp->AssociatedIrp.SystemBuffer;
+    NTSTATUS NtStatus = STATUS_NOT_FOUND;
+    HANDLE hProcessId;
+    PLIST_ENTRY pEntry;
+    PQUOTA pProcess;
+    KIRQL OldIrql;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_PROCESS_QUOTA) || !pInput)
+        return STATUS_INVALID_PARAMETER;
+
+    if (!SeSinglePrivilegeCheck(RtlConvertLongToLuid(SE_INCREASE_QUOTA_PRIVILEGE), pIrp->RequestorMode))
+        return STATUS_PRIVILEGE_NOT_HELD;
+
+    hProcessId = ULongToHandle(pInput->ulProcessId);
+
+    KeAcquireSpinLock(&pDeviceExtension->ProcessQuotaLock, &OldIrql);
+
+    if (!pInput->ulProcessId)
+    {
+        pDeviceExtension->DefaultQuota = pInput->Quota;
+        NtStatus = STATUS_SUCCESS;
+    }
+
+    for (pEntry = pDeviceExtension->ProcessQuotas.Flink; pInput->ulProcessId && pEntry != &pDeviceExtension->ProcessQuotas; pEntry = pEntry->Flink)
+    {
+        pProcess = CONTAINING_RECORD(pEntry, QUOTA, ProcessEntry);
+
+        if (pProcess->hProcessId == hProcessId && pProcess->ulHandles)
+        {
+            SetQuotaLimits(pProcess, &pInput->Quota);
+            NtStatus = STATUS_SUCCESS;
+        }
+    }
+
+    KeReleaseSpinLock(&pDeviceExtension->ProcessQuotaLock, OldIrql);
+
+    if (NT_SUCCESS(NtStatus))
+    {
+        LOG_INFO(
+            "Quota of process %u set to %u messages, %u bytes, %u messages/s, %u bytes/s",
+            pInput->ulProcessId,
+            pInput->Quota.ulMaxMessages,
+            pInput->Quota.ulMaxBytes,
+            pInput->Quota.ulMessagesPerSecond,
+            pInput->Quota.ulBytesPerSecond
+        );
+    }
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryProcessQuota
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_PROCESS_QUOTA request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Returns the limits and usage of the process that opened the handle,
+//		of the process given in the input buffer, or the default limits.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the process has no quota, the return value is STATUS_NOT_FOUND.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryProcessQuota(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PHANDLE_CONTEXT pHandle = pIoStackIrp->FileObject->FsContext;
+    PDEVICE_EXTENSION pDeviceExtension = pHandle->pChannel->pDeviceExtension;
+    PFINGS_PROCESS_QUOTA_INFO pInfo = pIrp->AssociatedIrp.SystemBuffer;
+    PQUOTA pProcess = pHandle->pQuota->pProcess;
+    BOOLEAN bDefault = FALSE;
+    ULONG ulProcessId;
+    KIRQL OldIrql;
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(FINGS_PROCESS_QUOTA_INFO) || !pInfo)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    KeAcquireSpinLock(&pDeviceExtension->ProcessQuotaLock, &OldIrql);
+
+    //
+    //	Input and output share the system buffer, read the ID before it is overwritten.
+    //
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength >= sizeof(ULONG))
+    {
+        ulProcessId = *(PULONG)pInfo;
+
+        if (!ulProcessId)
+            bDefault = TRUE;
+        else
+            pProcess = FindProcessQuota(pDeviceExtension, ULongToHandle(ulProcessId), 0);
+    }
+
+    RtlZeroMemory(pInfo, sizeof(FINGS_PROCESS_QUOTA_INFO));
+
+    if (bDefault)
+    {
+        pInfo->Quota = pDeviceExtension->DefaultQuota;
+    }
+    else if (pProcess)
+    {
+        pInfo->ulProcessId = HandleToULong(pProcess->hProcessId);
+        pInfo->ulHandles = pProcess->ulHandles;
+        QueryQuota(pProcess, &pInfo->Quota, &pInfo->Usage);
+    }
+
+    KeReleaseSpinLock(&pDeviceExtension->ProcessQuotaLock, OldIrql);
+
+    if (!bDefault && !pProcess)
+        return STATUS_NOT_FOUND;
+
+    *pInformation = sizeof(FINGS_PROCESS_QUOTA_INFO);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	range.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the queries of the messages waiting in a				*
+* 	channel by sequence number and time. Every ring of a channel is				*
+* 	in order of both, it is its own index, so a query finds where to			*
+* 	start in each ring by binary search and merges the rings from				*
+* 	there, the messages stay queued.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Messages and bytes copied under the read lock at a time, the query
+//	lets the readers in between and looks for its place again.
+//
+#define RANGE_BATCH				64
+#define RANGE_BATCH_BYTES		(64 * 1024)
+
+//
+//	Cursor of a ring with nothing more in the range.
+//
+#define RANGE_SHARD_DONE		(-1LL)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	System time of a message stamp, in units of 100 ns. Split so the
+//	counter of a driver loaded for months does not overflow.
+//
+static ULONG64
+StampToTime(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  LONG64 llStamp
+)
+{
+    LONG64 llFrequency = pDeviceExtension->llCounterFrequency;
+    LONG64 llTicks = max(llStamp - pDeviceExtension->llCounterBase, 0);
+
+    return (ULONG64)pDeviceExtension->llClockBase +
+           (ULONG64)(llTicks / llFrequency) * 10000000 +
+           (ULONG64)(llTicks % llFrequency) * 10000000 / (ULONG64)llFrequency;
+}
+
+
+//
+//	Position of the first message of the ring numbered ullSequence or
+//	later and queued at ullTime or later. The caller holds ReadLock so
+//	the head stays where it is, the producer of the ring may only be
+//	publishing the cell at the tail.
+//
+static LONG64
+SeekShard(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PMESSAGE_RING pRing,
+    IN  ULONG64 ullSequence,
+    IN  ULONG64 ullTime
+)
+{
+    PFINGS_MESSAGE pMessage;
+    LONG64 llLow, llHigh, llMiddle;
+
+    llLow = ReadNoFence64(&pRing->llHead);
+    llHigh = ReadNoFence64(&pRing->llTail);
+
+    if (llHigh > llLow && !RingPeekAt(pRing, llHigh - 1))
+        llHigh--;
+
+    while (llLow < llHigh)
+    {
+        llMiddle = llLow + (llHigh - llLow) / 2;
+        pMessage = RingPeekAt(pRing, llMiddle);
+
+        if (pMessage &&
+            (pMessage->ullSequence < ullSequence || StampToTime(pDeviceExtension, pMessage->llStamp) < ullTime))
+            llLow = llMiddle + 1;
+        else
+            llHigh = llMiddle;
+    }
+
+    return llLow;
+}
+
+
+//
+//	The message with the smallest sequence number at the cursors.
+//
+static PFINGS_MESSAGE
+RangeFirst(
+    IN  PCHANNEL pChannel,
+    IN  PLONG64 pCursors,
+    OUT  PULONG pulShard
+)
+{
+    PFINGS_MESSAGE pFirst = NULL, pMessage;
+    ULONG ulShard;
+
+    *pulShard = 0;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        if (pCursors[ulShard] == RANGE_SHARD_DONE)
+            continue;
+
+        pMessage = RingPeekAt(&pChannel->pShards[ulShard], pCursors[ulShard]);
+
+        if (pMessage && (!pFirst || pMessage->ullSequence < pFirst->ullSequence))
+        {
+            pFirst = pMessage;
+            *pulShard = ulShard;
+        }
+    }
+
+    return pFirst;
+}
+
+
+//
+//	The message with the smallest sequence number at the cursors, once
+//	no lower number can still show up, the way ShardPeek finds it at the
+//	heads of the rings.
+//
+static PFINGS_MESSAGE
+RangePeek(
+    IN  PCHANNEL pChannel,
+    IN  PLONG64 pCursors,
+    OUT  PULONG pulShard
+)
+{
+    PFINGS_MESSAGE pFirst;
+    BOOLEAN bSettled;
+
+    for (;;)
+    {
+        pFirst = RangeFirst(pChannel, pCursors, pulShard);
+
+        if (!pFirst)
+            return NULL;
+
+        KeMemoryBarrier();
+
+        bSettled = ShardsSettled(pChannel, pFirst->ullSequence);
+
+        KeMemoryBarrier();
+
+        if (bSettled && RangeFirst(pChannel, pCursors, pulShard) == pFirst)
+            return pFirst;
+
+        YieldProcessor();
+    }
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryRange
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_RANGE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned, up to the end of the last message.
+//
+//	Routine Description:
+//		Copies the messages of the handle's channel that fall in the
+//		ranges of FINGS_RANGE_QUERY to the locked output buffer without
+//		taking them out. A batch at a time is copied holding ReadLock,
+//		which keeps readers and the expiry from freeing the messages, and
+//		every batch looks for its start in the rings again. A message is
+//		only copied once every lower number is in its ring or never will
+//		be, so a query that goes on after the last number returned does
+//		not miss one still being queued.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the first message does not fit, the return value is STATUS_BUFFER_TOO_SMALL.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryRange(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PCHANNEL pChannel = FINGS_FILE_CHANNEL(pIoStackIrp->FileObject);
+    PDEVICE_EXTENSION pDeviceExtension = pChannel->pDeviceExtension;
+    PFINGS_RANGE_QUERY pQuery = pIrp->AssociatedIrp.SystemBuffer;
+    ULONG ulOutputLength = pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength;
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    PFINGS_MESSAGE pMessage;
+    PFINGS_MESSAGE_RECORD pRecord;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PLONG64 pCursors;
+    PCHAR pBuffer;
+    ULONG64 ullNext, ullLast, ullFirstTime, ullLastTime, ullTime;
+    ULONG ulShard, ulCount, ulBytes;
+    ULONG ulOffset = 0;
+    BOOLEAN bDone = FALSE;
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_RANGE_QUERY) || !pQuery)
+        return STATUS_INVALID_PARAMETER;
+
+    if (!ulOutputLength || !pIrp->MdlAddress)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    ullNext = max(pQuery->ullFirstSequence, 1);
+    ullLast = pQuery->ullLastSequence ? pQuery->ullLastSequence : MAXULONG64;
+    ullFirstTime = pQuery->ullFirstTime;
+    ullLastTime = pQuery->ullLastTime ? pQuery->ullLastTime : MAXULONG64;
+
+    if (ullNext > ullLast || ullFirstTime > ullLastTime)
+        return STATUS_SUCCESS;
+
+    pBuffer = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority | MdlMappingNoExecute);
+
+    if (!pBuffer)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    pCursors = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(LONG64) * pChannel->ulShardCount, FINGS_POOL_TAG);
+
+    if (!pCursors)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    while (!bDone)
+    {
+        ulCount = 0;
+        ulBytes = 0;
+
+        KeAcquireInStackQueuedSpinLock(&pChannel->ReadLock, &LockHandle);
+
+        for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+            pCursors[ulShard] = SeekShard(pDeviceExtension, &pChannel->pShards[ulShard], ullNext, ullFirstTime);
+
+        while (ulCount < RANGE_BATCH && ulBytes < RANGE_BATCH_BYTES)
+        {
+            pMessage = RangePeek(pChannel, pCursors, &ulShard);
+
+            if (!pMessage || pMessage->ullSequence > ullLast)
+            {
+                bDone = TRUE;
+                break;
+            }
+
+            pCursors[ulShard]++;
+            ullNext = pMessage->ullSequence + 1;
+            ulCount++;
+
+            //
+            //	The rest of the ring is later still.
+            //
+            ullTime = StampToTime(pDeviceExtension, pMessage->llStamp);
+
+            if (ullTime > ullLastTime)
+            {
+                pCursors[ulShard] = RANGE_SHARD_DONE;
+                continue;
+            }
+
+            if (FINGS_MESSAGE_EXPIRED(pMessage))
+                continue;
+
+            if (ulOffset >= ulOutputLength ||
+                FIELD_OFFSET(FINGS_MESSAGE_RECORD, Data) + pMessage->ulLength > ulOutputLength - ulOffset)
+            {
+                //
+                //	Only an error if nothing was copied, else it is where the next query starts.
+                //
+                if (!ulOffset)
+                    NtStatus = STATUS_BUFFER_TOO_SMALL;
+
+                bDone = TRUE;
+                break;
+            }
+
+            pRecord = (PFINGS_MESSAGE_RECORD)(pBuffer + ulOffset);
+            pRecord->ullSequence = pMessage->ullSequence;
+            pRecord->ullTime = ullTime;
+            pRecord->ulProcessId = pMessage->ulProcessId;
+            pRecord->ulThreadId = pMessage->ulThreadId;
+            pRecord->ulLength = pMessage->ulLength;
+
+            NtStatus = ExpandMessage(pMessage, pRecord->Data);
+
+            if (!NT_SUCCESS(NtStatus))
+            {
+                bDone = TRUE;
+                break;
+            }
+
+            *pInformation = ulOffset + FIELD_OFFSET(FINGS_MESSAGE_RECORD, Data) + pMessage->ulLength;
+            ulOffset += FINGS_MESSAGE_RECORD_SIZE(pMessage->ulLength);
+            ulBytes += pMessage->ulLength;
+        }
+
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+    }
+
+    ExFreePoolWithTag(pCursors, FINGS_POOL_TAG);
+
+    return NtStatus;
+}
@@ -0,0 +1,286 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ring.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the bounded lock-free message ring.					*
+* 	It only uses the interlocked primitives, no locks and no					*
+* 	allocations, so it can run at any IRQL <= DISPATCH_LEVEL.					*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "ring.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		RingInitialize
+//
+//	Parameters:
+//		[OUT]  MESSAGE_RING* pRing
+//		Ring to initialize.
+//	   
+//		[IN]  PRING_CELL pCells
+//		Storage for the cells, ulCapacity entries.
+// 
+//		[IN]  ULONG ulCapacity
+//		Number of cells, a power of two from 2.
+//
+//	Routine Description:
+//		Prepares an empty ring on top of caller allocated cells.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+RingInitialize(
+    OUT  PMESSAGE_RING pRing,
+    IN  PRING_CELL pCells,
+    IN  ULONG ulCapacity
+)
+{
+    ULONG ulIndex = 0;
+
+    ASSERT(ulCapacity >= 2 && !(ulCapacity & (ulCapacity - 1)));
+
+    for (ulIndex = 0; ulIndex < ulCapacity; ulIndex++)
+    {
+        pCells[ulIndex].llSequence = ulIndex;
+        pCells[ulIndex].pData = NULL;
+    }
+
+    pRing->pCells = pCells;
+    pRing->ulMask = ulCapacity - 1;
+    pRing->llHead = 0;
+    pRing->llTail = 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RingEnqueue
+//
+//	Parameters:
+//		[IN/OUT]  MESSAGE_RING* pRing
+//		Ring to append to.
+//	   
+//		[IN]  PVOID pData
+//		Pointer to store, must not be NULL.
+//
+//	Routine Description:
+//		Appends a pointer to the ring. Safe to call from any number of
+//		producers concurrently, callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the pointer was stored, FALSE if the ring is full.
+//
+//***********************************************************************************
+BOOLEAN
+RingEnqueue(
+    IN OUT  PMESSAGE_RING pRing,
+    IN  PVOID pData
+)
+{
+    PRING_CELL pCell;
+    LONG64 llPosition;
+    LONG64 llSequence;
+    LONG64 llObserved;
+
+    llPosition = ReadNoFence64(&pRing->llTail);
+
+    for (;;)
+    {
+        pCell = &pRing->pCells[llPosition & pRing->ulMask];
+        llSequence = ReadAcquire64(&pCell->llSequence);
+
+        if (llSequence == llPosition)
+        {
+            //
+            //	The cell is free for this ticket, try to claim the ticket.
+            //
+            llObserved = InterlockedCompareExchange64(&pRing->llTail, llPosition + 1, llPosition);
+
+            if (llObserved == llPosition)
+                break;
+
+            llPosition = llObserved;
+        }
+        else if (llSequence < llPosition)
+        {
+            //
+            //	The cell still holds the entry from the previous lap, the ring is full.
+            //
+            return FALSE;
+        }
+        else
+        {
+            llPosition = ReadNoFence64(&pRing->llTail);
+        }
+    }
+
+    pCell->pData = pData;
+
+    //
+    //	Publish the entry, the release makes pData visible before the sequence.
+    //
+    WriteRelease64(&pCell->llSequence, llPosition + 1);
+
+    return TRUE;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RingDequeue
+//
+//	Parameters:
+//		[IN/OUT]  MESSAGE_RING* pRing
+//		Ring to remove from.
+//
+//	Routine Description:
+//		Removes the oldest pointer from the ring. Safe to call from any
+//		number of consumers concurrently, callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		PVOID.
+//		The oldest pointer, or NULL if the ring is empty.
+//
+//***********************************************************************************
+PVOID
+RingDequeue(
+    IN OUT  PMESSAGE_RING pRing
+)
+{
+    PRING_CELL pCell;
+    PVOID pData;
+    LONG64 llPosition;
+    LONG64 llSequence;
+    LONG64 llObserved;
+
+    llPosition = ReadNoFence64(&pRing->llHead);
+
+    for (;;)
+    {
+        pCell = &pRing->pCells[llPosition & pRing->ulMask];
+        llSequence = ReadAcquire64(&pCell->llSequence);
+
+        if (llSequence == llPosition + 1)
+        {
+            llObserved = InterlockedCompareExchange64(&pRing->llHead, llPosition + 1, llPosition);
+
+            if (llObserved == llPosition)
+                break;
+
+            llPosition = llObserved;
+        }
+        else if (llSequence < llPosition + 1)
+        {
+            //
+            //	No producer has published this ticket yet, the ring is empty.
+            //
+            return NULL;
+        }
+        else
+        {
+            llPosition = ReadNoFence64(&pRing->llHead);
+        }
+    }
+
+    pData = pCell->pData;
+    pCell->pData = NULL;
+
+    //
+    //	Hand the cell back to producers for the next lap.
+    //
+    WriteRelease64(&pCell->llSequence, llPosition + (LONG64)pRing->ulMask + 1);
+
+    return pData;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RingPeek
+//
+//	Parameters:
+//		[IN]  MESSAGE_RING* pRing
+//		Ring to look at.
+//
+//	Routine Description:
+//		Returns the oldest pointer without removing it. The result is only
+//		stable if the caller serializes all consumers of the ring.
+//
+//	Return Value:
+//		PVOID.
+//		The oldest pointer, or NULL if the ring is empty.
+//
+//***********************************************************************************
+PVOID
+RingPeek(
+    IN  PMESSAGE_RING pRing
+)
+{
+    PRING_CELL pCell;
+    LONG64 llPosition;
+
+    llPosition = ReadNoFence64(&pRing->llHead);
+    pCell = &pRing->pCells[llPosition & pRing->ulMask];
+
+    if (ReadAcquire64(&pCell->llSequence) != llPosition + 1)
+        return NULL;
+
+    return pCell->pData;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RingPeekAt
+//
+//	Parameters:
+//		[IN]  MESSAGE_RING* pRing
+//		Ring to look at.
+//
+//		[IN]  LONG64 llPosition
+//		Position of the cell, from the head up to the tail.
+//
+//	Routine Description:
+//		Returns the pointer stored at a position without removing it, so
+//		the ring can be searched in place. The caller serializes all
+//		consumers of the ring, else the cell may be reused under it.
+//
+//	Return Value:
+//		PVOID.
+//		The pointer, or NULL if the cell is not published yet.
+//
+//***********************************************************************************
+PVOID
+RingPeekAt(
+    IN  PMESSAGE_RING pRing,
+    IN  LONG64 llPosition
+)
+{
+    PRING_CELL pCell = &pRing->pCells[llPosition & pRing->ulMask];
+
+    if (ReadAcquire64(&pCell->llSequence) != llPosition + 1)
+        return NULL;
+
+    return pCell->pData;
+}
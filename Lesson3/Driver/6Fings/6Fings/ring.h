@@ -0,0 +1,203 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ring.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the bounded lock-free message ring.						*
+* 	The ring only depends on the interlocked primitives so it					*
+* 	can be compiled outside of the kernel as well.								*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Number of cells in the ring, must be a power of two.
+//
+#define RING_DEFAULT_CAPACITY	4096
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Every cell carries its own sequence number. A producer owns the cell
+//	when the sequence equals its ticket, a consumer owns it when the
+//	sequence equals its ticket + 1. This is what lets many producers
+//	append without taking a lock.
+//
+typedef struct _RING_CELL
+{
+	volatile LONG64 llSequence;
+	PVOID pData;
+
+} RING_CELL, *PRING_CELL;
+
+
+#pragma warning(push)
+#pragma warning(disable : 4324)	// structure was padded due to alignment specifier
+
+//
+//	Producer and consumer positions live on separate cache lines so
+//	writers and readers do not invalidate each other.
+//
+typedef struct _MESSAGE_RING
+{
+	DECLSPEC_CACHEALIGN volatile LONG64 llTail;
+	DECLSPEC_CACHEALIGN volatile LONG64 llHead;
+	DECLSPEC_CACHEALIGN PRING_CELL pCells;
+	ULONG ulMask;
+
+} MESSAGE_RING, *PMESSAGE_RING;
+
+#pragma warning(pop)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		RingInitialize
+//
+//	Parameters:
+//		[OUT]  MESSAGE_RING* pRing
+//		Ring to initialize.
+//	   
+//		[IN]  PRING_CELL pCells
+//		Storage for the cells, ulCapacity entries.
+// 
+//		[IN]  ULONG ulCapacity
+//		Number of cells, a power of two from 2.
+//
+//	Routine Description:
+//		Prepares an empty ring on top of caller allocated cells.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+RingInitialize(
+	OUT  PMESSAGE_RING pRing,
+	IN  PRING_CELL pCells,
+	IN  ULONG ulCapacity
+);
+
+
+//***********************************************************************************
+//	Function:
+//		RingEnqueue
+//
+//	Parameters:
+//		[IN/OUT]  MESSAGE_RING* pRing
+//		Ring to append to.
+//	   
+//		[IN]  PVOID pData
+//		Pointer to store, must not be NULL.
+//
+//	Routine Description:
+//		Appends a pointer to the ring. Safe to call from any number of
+//		producers concurrently, callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the pointer was stored, FALSE if the ring is full.
+//
+//***********************************************************************************
+BOOLEAN
+RingEnqueue(
+	IN OUT  PMESSAGE_RING pRing,
+	IN  PVOID pData
+);
+
+
+//***********************************************************************************
+//	Function:
+//		RingDequeue
+//
+//	Parameters:
+//		[IN/OUT]  MESSAGE_RING* pRing
+//		Ring to remove from.
+//
+//	Routine Description:
+//		Removes the oldest pointer from the ring. Safe to call from any
+//		number of consumers concurrently, callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		PVOID.
+//		The oldest pointer, or NULL if the ring is empty.
+//
+//***********************************************************************************
+PVOID
+RingDequeue(
+	IN OUT  PMESSAGE_RING pRing
+);
+
+
+//***********************************************************************************
+//	Function:
+//		RingPeek
+//
+//	Parameters:
+//		[IN]  MESSAGE_RING* pRing
+//		Ring to look at.
+//
+//	Routine Description:
+//		Returns the oldest pointer without removing it. The result is only
+//		stable if the caller serializes all consumers of the ring.
+//
+//	Return Value:
+//		PVOID.
+//		The oldest pointer, or NULL if the ring is empty.
+//
+//***********************************************************************************
+PVOID
+RingPeek(
+	IN  PMESSAGE_RING pRing
+);
+
+
+//***********************************************************************************
+//	Function:
+//		RingPeekAt
+//
+//	Parameters:
+//		[IN]  MESSAGE_RING* pRing
+//		Ring to look at.
+//
+//		[IN]  LONG64 llPosition
+//		Position of the cell, from the head up to the tail.
+//
+//	Routine Description:
+//		Returns the pointer stored at a position without removing it, so
+//		the ring can be searched in place. The caller serializes all
+//		consumers of the ring, else the cell may be reused under it.
+//
+//	Return Value:
+//		PVOID.
+//		The pointer, or NULL if the cell is not published yet.
+//
+//***********************************************************************************
+PVOID
+RingPeekAt(
+	IN  PMESSAGE_RING pRing,
+	IN  LONG64 llPosition
+);
@@ -0,0 +1,424 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	shards.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the per processor message queues of a					*
+* 	channel. Every processor appends to its own ring so writers on				*
+* 	different processors never touch the same cache line, readers				*
+* 	merge the rings back into one stream ordered by the time of the				*
+* 	write.																		*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, InitializeShards)
+#pragma alloc_text(PAGE, FreeShards)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeShards
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Allocates an empty ring and zeroed counters for every processor the
+//		system can have, including the ones that may be added while the
+//		driver is loaded.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeShards(
+    IN OUT  PCHANNEL pChannel
+)
+{
+    PRING_CELL pCells;
+    ULONG ulShardCount, ulShard;
+
+    PAGED_CODE();
+
+    ulShardCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    //
+    //	The rings sit next to each other, cache aligned so that every
+    //	ring's positions stay on lines of their own.
+    //
+    pChannel->pShards = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(MESSAGE_RING) * ulShardCount,
+        FINGS_POOL_TAG
+    );
+
+    pCells = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(RING_CELL) * RING_DEFAULT_CAPACITY * ulShardCount,
+        FINGS_POOL_TAG
+    );
+
+    pChannel->pShardCounters = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(CHANNEL_CPU) * ulShardCount,
+        FINGS_POOL_TAG
+    );
+
+    if (!pChannel->pShards || !pCells || !pChannel->pShardCounters)
+    {
+        if (pChannel->pShards)
+            ExFreePoolWithTag(pChannel->pShards, FINGS_POOL_TAG);
+        if (pCells)
+            ExFreePoolWithTag(pCells, FINGS_POOL_TAG);
+        if (pChannel->pShardCounters)
+            ExFreePoolWithTag(pChannel->pShardCounters, FINGS_POOL_TAG);
+
+        pChannel->pShards = NULL;
+        pChannel->pShardCounters = NULL;
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (ulShard = 0; ulShard < ulShardCount; ulShard++)
+        RingInitialize(&pChannel->pShards[ulShard], pCells + (SIZE_T)ulShard * RING_DEFAULT_CAPACITY, RING_DEFAULT_CAPACITY);
+
+    pChannel->ulShardCount = ulShardCount;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeShards
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being freed.
+//
+//	Routine Description:
+//		Frees the rings and the counters. The messages nobody has read
+//		have been freed already.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeShards(
+    IN OUT  PCHANNEL pChannel
+)
+{
+    PAGED_CODE();
+
+    //
+    //	The cells of every shard come from the allocation made for the first one.
+    //
+    ExFreePoolWithTag(pChannel->pShards[0].pCells, FINGS_POOL_TAG);
+    ExFreePoolWithTag(pChannel->pShards, FINGS_POOL_TAG);
+    ExFreePoolWithTag(pChannel->pShardCounters, FINGS_POOL_TAG);
+
+    pChannel->pShards = NULL;
+    pChannel->pShardCounters = NULL;
+    pChannel->ulShardCount = 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShardEnqueue
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the message is written to.
+//
+//		[IN/OUT]  FINGS_MESSAGE* pMessage
+//		Message to append, receives its sequence number and time stamp.
+//
+//	Routine Description:
+//		Numbers and stamps the message and appends it to the ring of the
+//		current processor. All happen at DISPATCH_LEVEL so the thread
+//		cannot be switched out in between, which keeps every ring in
+//		sequence and stamp order, and so the counters of the processor need
+//		no interlocked update. A message the ring has no room for leaves a
+//		gap in the sequence numbers. While the message is on its way,
+//		llQueuing of the processor tells range queries to wait for it.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if the message was stored, FALSE if the ring of this processor is full.
+//
+//***********************************************************************************
+BOOLEAN
+ShardEnqueue(
+    IN  PCHANNEL pChannel,
+    IN OUT  PFINGS_MESSAGE pMessage
+)
+{
+    PCHANNEL_CPU pCounters;
+    BOOLEAN bStored;
+    ULONG ulShard;
+    KIRQL OldIrql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    ulShard = KeGetCurrentProcessorNumberEx(NULL) % pChannel->ulShardCount;
+
+    pCounters = &pChannel->pShardCounters[ulShard];
+
+    //
+    //	Range queries must not pass a number still on its way to the ring,
+    //	so say one is coming before taking it, and which once it is known.
+    //	The interlocked increment orders the first store before it.
+    //
+    WriteRelease64(&pCounters->llQueuing, ReadNoFence64(&pChannel->llSequence) + 1);
+    pMessage->ullSequence = (ULONG64)InterlockedIncrement64(&pChannel->llSequence);
+    WriteRelease64(&pCounters->llQueuing, (LONG64)pMessage->ullSequence);
+
+    pMessage->llStamp = KeQueryPerformanceCounter(NULL).QuadPart;
+    bStored = RingEnqueue(&pChannel->pShards[ulShard], pMessage);
+
+    WriteRelease64(&pCounters->llQueuing, 0);
+
+    if (bStored)
+    {
+        pCounters->ullMessagesWritten++;
+        pCounters->ullBytesWritten += pMessage->ulLength;
+        pCounters->ullBytesStored += pMessage->ulStoredLength;
+    }
+
+    KeLowerIrql(OldIrql);
+
+    return bStored;
+}
+
+
+//
+//	The message with the smallest sequence number at the heads of the
+//	rings, each ring being in sequence order.
+//
+static PFINGS_MESSAGE
+ShardsOldest(
+    IN  PCHANNEL pChannel,
+    OUT  PULONG pulShard
+)
+{
+    PFINGS_MESSAGE pOldest = NULL, pMessage;
+    ULONG ulShard;
+
+    *pulShard = 0;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        pMessage = RingPeek(&pChannel->pShards[ulShard]);
+
+        if (pMessage && (!pOldest || pMessage->ullSequence < pOldest->ullSequence))
+        {
+            pOldest = pMessage;
+            *pulShard = ulShard;
+        }
+    }
+
+    return pOldest;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsSettled
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the messages are read from.
+//
+//		[IN]  ULONG64 ullSequence
+//		Number of the message about to be returned.
+//
+//	Routine Description:
+//		Tells whether every number below ullSequence has either reached
+//		its ring or was given up. A writer that took a lower number may
+//		still be queuing it, its processor's llQueuing says so until it
+//		is done.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if no lower number is on its way.
+//
+//***********************************************************************************
+BOOLEAN
+ShardsSettled(
+    IN  PCHANNEL pChannel,
+    IN  ULONG64 ullSequence
+)
+{
+    LONG64 llQueuing;
+    ULONG ulShard;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        llQueuing = ReadAcquire64(&pChannel->pShardCounters[ulShard].llQueuing);
+
+        if (llQueuing && (ULONG64)llQueuing < ullSequence)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShardPeek
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the messages are read from.
+//
+//		[OUT]  ULONG* pulShard
+//		Receives the ring holding the message.
+//
+//	Routine Description:
+//		Finds the message with the smallest sequence number across the
+//		rings. The caller holds ReadLock.
+//
+//		Numbers are taken in the order the messages are written, so a
+//		thread that wrote on one processor and then on another has its
+//		messages numbered in that order. The message is only returned
+//		once no lower number is still on its way to a ring and the rings
+//		looked at again still give the same one: a writer that finished
+//		between the two looks has its message in the second. Writers
+//		queue at DISPATCH_LEVEL, the wait is a few instructions of one.
+//
+//	Return Value:
+//		PFINGS_MESSAGE.
+//		The oldest message, left in its ring, or NULL if every ring is empty.
+//
+//***********************************************************************************
+PFINGS_MESSAGE
+ShardPeek(
+    IN  PCHANNEL pChannel,
+    OUT  PULONG pulShard
+)
+{
+    PFINGS_MESSAGE pOldest;
+    BOOLEAN bSettled;
+
+    for (;;)
+    {
+        pOldest = ShardsOldest(pChannel, pulShard);
+
+        if (!pOldest)
+            return NULL;
+
+        KeMemoryBarrier();
+
+        bSettled = ShardsSettled(pChannel, pOldest->ullSequence);
+
+        KeMemoryBarrier();
+
+        if (bSettled && ShardsOldest(pChannel, pulShard) == pOldest)
+            return pOldest;
+
+        YieldProcessor();
+    }
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsHaveMessage
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel to look at.
+//
+//	Routine Description:
+//		Tells whether any ring holds a message, without taking ReadLock.
+//		The answer is only a hint, a reader may take the message first.
+//
+//	Return Value:
+//		BOOLEAN.
+//		TRUE if a message was seen.
+//
+//***********************************************************************************
+BOOLEAN
+ShardsHaveMessage(
+    IN  PCHANNEL pChannel
+)
+{
+    ULONG ulShard;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        if (RingPeek(&pChannel->pShards[ulShard]))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		ShardsMessageCount
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel to look at.
+//
+//	Routine Description:
+//		Adds up the messages in the rings from their positions, without
+//		taking ReadLock or writing to any shared line. Writers and readers
+//		keep going meanwhile, the count is a close estimate.
+//
+//	Return Value:
+//		ULONG.
+//		Number of messages in the rings.
+//
+//***********************************************************************************
+ULONG
+ShardsMessageCount(
+    IN  PCHANNEL pChannel
+)
+{
+    PMESSAGE_RING pRing;
+    LONG64 llCount = 0;
+    ULONG ulShard;
+
+    for (ulShard = 0; ulShard < pChannel->ulShardCount; ulShard++)
+    {
+        pRing = &pChannel->pShards[ulShard];
+
+        //
+        //	The tail counts appends still being made, the difference can
+        //	also dip below 0 while a reader moves the head past one.
+        //
+        llCount += max(ReadNoFence64(&pRing->llTail) - ReadNoFence64(&pRing->llHead), 0);
+    }
+
+    return (ULONG)min(llCount, MAXULONG);
+}
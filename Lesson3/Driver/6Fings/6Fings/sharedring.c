@@ -0,0 +1,481 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	sharedring.c																*
+*																				*
+* Abstract:																		*
+* 	This file implements the shared rings. Every channel has its own,			*
+* 	the driver allocates the pages and maps them into every process			*
+* 	with a handle on the channel that asks, producers and consumers			*
+* 	then exchange messages through the ring without calling the				*
+* 	driver, except to wake a side that went to sleep.							*
+* 	The ring protocol itself lives in user mode, see FINGS_SHARED_RING.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Mapping of the shared ring made for one handle, kept in the
+//	pRingMapping of its HANDLE_CONTEXT.
+//
+typedef struct _RING_MAPPING
+{
+	PVOID pUserAddress;
+	PEPROCESS pProcess;
+
+} RING_MAPPING, *PRING_MAPPING;
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, InitializeSharedRing)
+#pragma alloc_text(PAGE, FreeSharedRing)
+#pragma alloc_text(PAGE, UnmapSharedRing)
+#pragma alloc_text(PAGE, IoctlMapRing)
+#pragma alloc_text(PAGE, IoctlRingWait)
+#pragma alloc_text(PAGE, IoctlRingWake)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Allocates the pages of the ring of the channel the first time
+//	anybody maps it. Returns the MDL describing them, NULL if there is
+//	not enough memory.
+//
+static PMDL
+GetSharedRingMdl(
+    IN  PCHANNEL pChannel
+)
+{
+    PHYSICAL_ADDRESS LowAddress, HighAddress, SkipBytes;
+    PFINGS_SHARED_RING pSharedRing;
+    PMDL pMdl, pExistingMdl;
+
+    pMdl = (PMDL)ReadPointerAcquire((PVOID const volatile*)&pChannel->pSharedRingMdl);
+
+    if (pMdl)
+        return pMdl;
+
+    LowAddress.QuadPart = 0;
+    HighAddress.QuadPart = -1;
+    SkipBytes.QuadPart = 0;
+
+    //
+    //	The pages come back zeroed, which is an empty ring.
+    //
+    pMdl = MmAllocatePagesForMdlEx(LowAddress, HighAddress, SkipBytes, FINGS_SHARED_RING_SIZE, MmCached, MM_ALLOCATE_FULLY_REQUIRED);
+
+    if (!pMdl)
+        return NULL;
+
+    pSharedRing = MmGetSystemAddressForMdlSafe(pMdl, NormalPagePriority | MdlMappingNoExecute);
+
+    if (!pSharedRing)
+    {
+        MmFreePagesFromMdl(pMdl);
+        ExFreePool(pMdl);
+        return NULL;
+    }
+
+    pSharedRing->ulDataSize = FINGS_SHARED_RING_DATA_SIZE;
+    pSharedRing->ulDataOffset = FINGS_SHARED_RING_DATA_OFFSET;
+
+    //
+    //	Two first callers may race here, the loser frees its pages.
+    //
+    pExistingMdl = (PMDL)InterlockedCompareExchangePointer((PVOID volatile*)&pChannel->pSharedRingMdl, pMdl, NULL);
+
+    if (pExistingMdl)
+    {
+        MmUnmapLockedPages(pSharedRing, pMdl);
+        MmFreePagesFromMdl(pMdl);
+        ExFreePool(pMdl);
+        return pExistingMdl;
+    }
+
+    return pMdl;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being created.
+//
+//	Routine Description:
+//		Prepares the wait events of the shared ring of the channel. The
+//		ring itself is only allocated when it is first mapped.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+InitializeSharedRing(
+    IN OUT  PCHANNEL pChannel
+)
+{
+    PAGED_CODE();
+
+    pChannel->pSharedRingMdl = NULL;
+
+    KeInitializeEvent(&pChannel->SharedRingEvents[FINGS_RING_CONSUMER], SynchronizationEvent, FALSE);
+    KeInitializeEvent(&pChannel->SharedRingEvents[FINGS_RING_PRODUCER], SynchronizationEvent, FALSE);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  CHANNEL* pChannel
+//		Channel being deleted.
+//
+//	Routine Description:
+//		Frees the pages of the shared ring of the channel. Every handle on
+//		the channel has been cleaned up by then, so no process maps them
+//		any more.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeSharedRing(
+    IN OUT  PCHANNEL pChannel
+)
+{
+    PMDL pMdl = pChannel->pSharedRingMdl;
+
+    PAGED_CODE();
+
+    if (!pMdl)
+        return;
+
+    if (pMdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+        MmUnmapLockedPages(pMdl->MappedSystemVa, pMdl);
+
+    MmFreePagesFromMdl(pMdl);
+    ExFreePool(pMdl);
+
+    pChannel->pSharedRingMdl = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		UnmapSharedRing
+//
+//	Parameters:
+//		[IN/OUT]  FILE_OBJECT* pFileObject
+//		Handle being cleaned up.
+//
+//	Routine Description:
+//		Removes the mapping the handle made, if any. Cleanup normally runs
+//		in the process that mapped the ring, a handle duplicated into
+//		another process is unmapped by attaching to the mapping process.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+UnmapSharedRing(
+    IN OUT  PFILE_OBJECT pFileObject
+)
+{
+    PHANDLE_CONTEXT pHandle = pFileObject->FsContext;
+    PRING_MAPPING pMapping = pHandle->pRingMapping;
+    PMDL pMdl = pHandle->pChannel->pSharedRingMdl;
+    KAPC_STATE ApcState;
+
+    PAGED_CODE();
+
+    if (!pMapping)
+        return;
+
+    if (pMapping->pProcess == PsGetCurrentProcess())
+    {
+        MmUnmapLockedPages(pMapping->pUserAddress, pMdl);
+    }
+    else
+    {
+        KeStackAttachProcess(pMapping->pProcess, &ApcState);
+        MmUnmapLockedPages(pMapping->pUserAddress, pMdl);
+        KeUnstackDetachProcess(&ApcState);
+    }
+
+    ObDereferenceObject(pMapping->pProcess);
+    ExFreePoolWithTag(pMapping, FINGS_POOL_TAG);
+
+    pHandle->pRingMapping = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlMapRing
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_MAP_RING request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Maps the shared ring of the channel into the calling process and
+//		returns its address. The mapping belongs to the handle the request
+//		came on.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlMapRing(
+    IN  PCHANNEL pChannel,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    NTSTATUS NtStatus = STATUS_SUCCESS;
+    PFINGS_MAP_RING_OUTPUT pOutput = pIrp->AssociatedIrp.SystemBuffer;
+    PHANDLE_CONTEXT pHandle = pIoStackIrp->FileObject->FsContext;
+    PRING_MAPPING pMapping;
+    PMDL pMdl;
+
+    PAGED_CODE();
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(FINGS_MAP_RING_OUTPUT))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    //
+    //	Requests on one handle are not serialized, a handle mapping from two
+    //	threads at once gets two mappings and keeps the one stored first.
+    //
+    pMapping = pHandle->pRingMapping;
+
+    if (!pMapping)
+    {
+        pMdl = GetSharedRingMdl(pChannel);
+
+        if (!pMdl)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        pMapping = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(RING_MAPPING), FINGS_POOL_TAG);
+
+        if (!pMapping)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        //
+        //	A user mode mapping raises an exception instead of returning NULL.
+        //
+        __try
+        {
+            pMapping->pUserAddress = MmMapLockedPagesSpecifyCache(
+                pMdl,
+                UserMode,
+                MmCached,
+                NULL,
+                FALSE,
+                NormalPagePriority | MdlMappingNoExecute
+            );
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            NtStatus = GetExceptionCode();
+        }
+
+        if (!NT_SUCCESS(NtStatus))
+        {
+            ExFreePoolWithTag(pMapping, FINGS_POOL_TAG);
+            return NtStatus;
+        }
+
+        pMapping->pProcess = PsGetCurrentProcess();
+        ObReferenceObject(pMapping->pProcess);
+
+        if (InterlockedCompareExchangePointer(&pHandle->pRingMapping, pMapping, NULL) != NULL)
+        {
+            MmUnmapLockedPages(pMapping->pUserAddress, pMdl);
+            ObDereferenceObject(pMapping->pProcess);
+            ExFreePoolWithTag(pMapping, FINGS_POOL_TAG);
+
+            pMapping = pHandle->pRingMapping;
+        }
+    }
+
+    //
+    //	A handle duplicated into another process still sees the first mapping.
+    //
+    if (pMapping->pProcess != PsGetCurrentProcess())
+        return STATUS_ACCESS_DENIED;
+
+    pOutput->ullAddress = (ULONG64)(ULONG_PTR)pMapping->pUserAddress;
+    pOutput->ulSize = FINGS_SHARED_RING_SIZE;
+    pOutput->ulReserved = 0;
+
+    *pInformation = sizeof(FINGS_MAP_RING_OUTPUT);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlRingWait
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_RING_WAIT request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Blocks the calling thread until its side of the shared ring of the
+//		channel is woken or the timeout expires. The wait is alertable so
+//		the thread can still be terminated while it sleeps, a user APC or
+//		an alert ends it without a wake though.
+//
+//	Return Value:
+//		NTSTATUS.
+//		STATUS_SUCCESS once woken, STATUS_IO_TIMEOUT on timeout and
+//		STATUS_RETRY if the wait was interrupted before either.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlRingWait(
+    IN  PCHANNEL pChannel,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    NTSTATUS NtStatus;
+    PFINGS_RING_WAIT_INPUT pInput = pIrp->AssociatedIrp.SystemBuffer;
+    LARGE_INTEGER Timeout;
+    ULONG ulSide;
+
+    PAGED_CODE();
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_RING_WAIT_INPUT))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    ulSide = pInput->ulSide;
+
+    if (ulSide != FINGS_RING_CONSUMER && ulSide != FINGS_RING_PRODUCER)
+        return STATUS_INVALID_PARAMETER;
+
+    //
+    //	Relative timeout in 100ns units.
+    //
+    Timeout.QuadPart = -10000LL * pInput->ulTimeout;
+
+    NtStatus = KeWaitForSingleObject(
+        &pChannel->SharedRingEvents[ulSide],
+        UserRequest,
+        UserMode,
+        TRUE,
+        pInput->ulTimeout == MAXULONG ? NULL : &Timeout
+    );
+
+    //
+    //	Both are success codes, the caller must not take them for a wake.
+    //
+    if (NtStatus == STATUS_TIMEOUT)
+        NtStatus = STATUS_IO_TIMEOUT;
+    else if (NtStatus == STATUS_USER_APC || NtStatus == STATUS_ALERTED)
+        NtStatus = STATUS_RETRY;
+
+    return NtStatus;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlRingWake
+//
+//	Parameters:
+//		[IN]  CHANNEL* pChannel
+//		Channel the handle is open on.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_RING_WAKE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//	Routine Description:
+//		Wakes a thread waiting on the given side of the shared ring of the
+//		channel, or the next one to wait if none is waiting yet.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlRingWake(
+    IN  PCHANNEL pChannel,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp
+)
+{
+    PFINGS_RING_WAKE_INPUT pInput = pIrp->AssociatedIrp.SystemBuffer;
+    ULONG ulSide;
+
+    PAGED_CODE();
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength < sizeof(FINGS_RING_WAKE_INPUT))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    ulSide = pInput->ulSide;
+
+    if (ulSide != FINGS_RING_CONSUMER && ulSide != FINGS_RING_PRODUCER)
+        return STATUS_INVALID_PARAMETER;
+
+    KeSetEvent(&pChannel->SharedRingEvents[ulSide], IO_NO_INCREMENT, FALSE);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,364 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	slab.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the size class allocator. Every processor has			*
+* 	a lookaside list per class, the lists are interlocked singly linked		*
+* 	lists so a block is taken and given back without a lock and without		*
+* 	touching pool, which is only called when a list runs dry.					*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "slab.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static const SIZE_T g_SlabClassSizes[SLAB_CLASS_COUNT] = SLAB_CLASS_SIZES;
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, SlabInitialize)
+#pragma alloc_text(PAGE, SlabDelete)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Smallest class holding Size bytes, SLAB_CLASS_LARGE if none does.
+//
+static ULONG
+SlabClass(
+    IN  SIZE_T Size
+)
+{
+    ULONG ulClass;
+
+    for (ulClass = 0; ulClass < SLAB_CLASS_COUNT; ulClass++)
+    {
+        if (Size <= g_SlabClassSizes[ulClass])
+            break;
+    }
+
+    return ulClass;
+}
+
+
+//
+//	Called by a lookaside list that has no free block left.
+//
+static PVOID
+SlabListAllocate(
+    IN  POOL_TYPE PoolType,
+    IN  SIZE_T NumberOfBytes,
+    IN  ULONG Tag,
+    IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+
+    InterlockedIncrement64(&CONTAINING_RECORD(pLookaside, SLAB_LIST, List)->llMisses);
+
+    return ExAllocatePool2(POOL_FLAG_NON_PAGED, NumberOfBytes, Tag);
+}
+
+
+//
+//	Called by a lookaside list that already holds as many free blocks as it wants.
+//
+static VOID
+SlabListFree(
+    IN  PVOID pBuffer,
+    IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+    UNREFERENCED_PARAMETER(pLookaside);
+
+    ExFreePool(pBuffer);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SlabInitialize
+//
+//	Parameters:
+//		[OUT]  SLAB_ALLOCATOR* pSlab
+//		Allocator to initialize.
+//
+//		[IN]  ULONG ulTag
+//		Pool tag of every block.
+//
+//	Routine Description:
+//		Creates the lookaside lists of every class for every processor,
+//		including the ones that may be added while the driver is loaded.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+SlabInitialize(
+    OUT  PSLAB_ALLOCATOR pSlab,
+    IN  ULONG ulTag
+)
+{
+    NTSTATUS NtStatus;
+    ULONG ulIndex, ulListCount;
+
+    PAGED_CODE();
+
+    pSlab->ulTag = ulTag;
+    pSlab->ulCpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    pSlab->pCpus = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(SLAB_CPU) * pSlab->ulCpuCount,
+        ulTag
+    );
+
+    if (!pSlab->pCpus)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    //
+    //	Lists are numbered processor by processor, class by class.
+    //
+    ulListCount = pSlab->ulCpuCount * SLAB_CLASS_COUNT;
+
+    for (ulIndex = 0; ulIndex < ulListCount; ulIndex++)
+    {
+        NtStatus = ExInitializeLookasideListEx(
+            &pSlab->pCpus[ulIndex / SLAB_CLASS_COUNT].Lists[ulIndex % SLAB_CLASS_COUNT].List,
+            SlabListAllocate,
+            SlabListFree,
+            NonPagedPoolNx,
+            0,
+            g_SlabClassSizes[ulIndex % SLAB_CLASS_COUNT],
+            ulTag,
+            0
+        );
+
+        if (!NT_SUCCESS(NtStatus))
+        {
+            while (ulIndex--)
+                ExDeleteLookasideListEx(&pSlab->pCpus[ulIndex / SLAB_CLASS_COUNT].Lists[ulIndex % SLAB_CLASS_COUNT].List);
+
+            ExFreePoolWithTag(pSlab->pCpus, ulTag);
+
+            pSlab->pCpus = NULL;
+            pSlab->ulCpuCount = 0;
+            return NtStatus;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SlabDelete
+//
+//	Parameters:
+//		[IN/OUT]  SLAB_ALLOCATOR* pSlab
+//		Allocator to delete, every block must have been freed.
+//
+//	Routine Description:
+//		Deletes the lookaside lists, returning their free blocks to pool.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabDelete(
+    IN OUT  PSLAB_ALLOCATOR pSlab
+)
+{
+    ULONG ulCpu, ulClass;
+
+    PAGED_CODE();
+
+    for (ulCpu = 0; ulCpu < pSlab->ulCpuCount; ulCpu++)
+    {
+        for (ulClass = 0; ulClass < SLAB_CLASS_COUNT; ulClass++)
+            ExDeleteLookasideListEx(&pSlab->pCpus[ulCpu].Lists[ulClass].List);
+    }
+
+    ExFreePoolWithTag(pSlab->pCpus, pSlab->ulTag);
+
+    pSlab->pCpus = NULL;
+    pSlab->ulCpuCount = 0;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SlabAllocate
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator to use.
+//
+//		[IN]  SIZE_T Size
+//		Size of the block.
+//
+//	Routine Description:
+//		Allocates a non-paged block from the smallest class that fits.
+//		The thread may move to another processor after picking the list,
+//		which only costs locality, any processor may use any list.
+//
+//	Return Value:
+//		PVOID.
+//		The block, not zeroed, or NULL if there is not enough memory.
+//
+//***********************************************************************************
+PVOID
+SlabAllocate(
+    IN  PSLAB_ALLOCATOR pSlab,
+    IN  SIZE_T Size
+)
+{
+    PSLAB_CPU pCpu = &pSlab->pCpus[KeGetCurrentProcessorNumberEx(NULL) % pSlab->ulCpuCount];
+    ULONG ulClass = SlabClass(Size);
+    PVOID pBlock;
+
+    if (ulClass == SLAB_CLASS_LARGE)
+    {
+        pBlock = ExAllocatePool2(POOL_FLAG_NON_PAGED, Size, pSlab->ulTag);
+
+        if (pBlock)
+            InterlockedIncrement64(&pCpu->llLargeAllocations);
+    }
+    else
+    {
+        pBlock = ExAllocateFromLookasideListEx(&pCpu->Lists[ulClass].List);
+
+        if (pBlock)
+        {
+            InterlockedIncrement64(&pCpu->Lists[ulClass].llAllocations);
+            Size = g_SlabClassSizes[ulClass];
+        }
+    }
+
+    if (pBlock)
+        InterlockedAdd64(&pCpu->llBytes, (LONG64)Size);
+
+    return pBlock;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SlabFree
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator the block came from.
+//
+//		[IN]  PVOID pBlock
+//		Block to free.
+//
+//		[IN]  SIZE_T Size
+//		Size the block was allocated with.
+//
+//	Routine Description:
+//		Returns the block to the lookaside list of the current processor,
+//		or to pool for large blocks.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabFree(
+    IN  PSLAB_ALLOCATOR pSlab,
+    IN  PVOID pBlock,
+    IN  SIZE_T Size
+)
+{
+    PSLAB_CPU pCpu = &pSlab->pCpus[KeGetCurrentProcessorNumberEx(NULL) % pSlab->ulCpuCount];
+    ULONG ulClass = SlabClass(Size);
+
+    if (ulClass == SLAB_CLASS_LARGE)
+    {
+        ExFreePoolWithTag(pBlock, pSlab->ulTag);
+    }
+    else
+    {
+        ExFreeToLookasideListEx(&pCpu->Lists[ulClass].List, pBlock);
+        Size = g_SlabClassSizes[ulClass];
+    }
+
+    InterlockedAdd64(&pCpu->llBytes, -(LONG64)Size);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SlabQueryCounters
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator to look at.
+//
+//		[OUT]  SLAB_COUNTERS* pCounters
+//		Receives the totals.
+//
+//	Routine Description:
+//		Adds up the counters of every processor. The counters keep moving
+//		while they are read, the totals are a close estimate.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabQueryCounters(
+    IN  PSLAB_ALLOCATOR pSlab,
+    OUT  PSLAB_COUNTERS pCounters
+)
+{
+    PSLAB_CPU pCpu;
+    ULONG ulCpu, ulClass;
+    LONG64 llAllocations = 0, llMisses = 0;
+
+    pCounters->llBytesOutstanding = 0;
+
+    for (ulCpu = 0; ulCpu < pSlab->ulCpuCount; ulCpu++)
+    {
+        pCpu = &pSlab->pCpus[ulCpu];
+
+        for (ulClass = 0; ulClass < SLAB_CLASS_COUNT; ulClass++)
+        {
+            llAllocations += ReadNoFence64(&pCpu->Lists[ulClass].llAllocations);
+            llMisses += ReadNoFence64(&pCpu->Lists[ulClass].llMisses);
+        }
+
+        llAllocations += ReadNoFence64(&pCpu->llLargeAllocations);
+        llMisses += ReadNoFence64(&pCpu->llLargeAllocations);
+
+        pCounters->llBytesOutstanding += ReadNoFence64(&pCpu->llBytes);
+    }
+
+    pCounters->llHits = llAllocations - llMisses;
+    pCounters->llMisses = llMisses;
+}
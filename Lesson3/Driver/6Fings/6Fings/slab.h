@@ -0,0 +1,227 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	slab.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the size class allocator. Blocks up to the				*
+* 	largest class come from per processor lookaside lists, larger				*
+* 	ones straight from non-paged pool.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Block sizes of the classes, the last class is for anything larger.
+//
+#define SLAB_CLASS_SIZES		{ 64, 256, 1024, 4096 }
+#define SLAB_CLASS_COUNT		4
+#define SLAB_CLASS_LARGE		SLAB_CLASS_COUNT
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	One lookaside list with its counters. llMisses is bumped by the list's
+//	allocate callback, which only runs when the list had no free block.
+//
+typedef struct _SLAB_LIST
+{
+	LOOKASIDE_LIST_EX List;
+	volatile LONG64 llAllocations;
+	volatile LONG64 llMisses;
+
+} SLAB_LIST, *PSLAB_LIST;
+
+
+#pragma warning(push)
+#pragma warning(disable : 4324)	// structure was padded due to alignment specifier
+
+//
+//	Lists and counters of one processor, on cache lines of their own.
+//	llBytes goes down on the processor that frees a block, which need not
+//	be the one that allocated it, only the sum over processors is meaningful.
+//
+typedef struct _SLAB_CPU
+{
+	DECLSPEC_CACHEALIGN SLAB_LIST Lists[SLAB_CLASS_COUNT];
+	volatile LONG64 llLargeAllocations;
+	volatile LONG64 llBytes;
+
+} SLAB_CPU, *PSLAB_CPU;
+
+#pragma warning(pop)
+
+
+typedef struct _SLAB_ALLOCATOR
+{
+	PSLAB_CPU pCpus;
+	ULONG ulCpuCount;
+	ULONG ulTag;
+
+} SLAB_ALLOCATOR, *PSLAB_ALLOCATOR;
+
+
+//
+//	Totals over every processor and class. Large blocks count as misses.
+//
+typedef struct _SLAB_COUNTERS
+{
+	LONG64 llHits;
+	LONG64 llMisses;
+	LONG64 llBytesOutstanding;
+
+} SLAB_COUNTERS, *PSLAB_COUNTERS;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		SlabInitialize
+//
+//	Parameters:
+//		[OUT]  SLAB_ALLOCATOR* pSlab
+//		Allocator to initialize.
+//
+//		[IN]  ULONG ulTag
+//		Pool tag of every block.
+//
+//	Routine Description:
+//		Creates the lookaside lists of every class for every processor.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+SlabInitialize(
+	OUT  PSLAB_ALLOCATOR pSlab,
+	IN  ULONG ulTag
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SlabDelete
+//
+//	Parameters:
+//		[IN/OUT]  SLAB_ALLOCATOR* pSlab
+//		Allocator to delete, every block must have been freed.
+//
+//	Routine Description:
+//		Deletes the lookaside lists, returning their free blocks to pool.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabDelete(
+	IN OUT  PSLAB_ALLOCATOR pSlab
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SlabAllocate
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator to use.
+//
+//		[IN]  SIZE_T Size
+//		Size of the block.
+//
+//	Routine Description:
+//		Allocates a non-paged block from the smallest class that fits.
+//		Lock-free when the lookaside list of the current processor has a
+//		free block, callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		PVOID.
+//		The block, not zeroed, or NULL if there is not enough memory.
+//
+//***********************************************************************************
+PVOID
+SlabAllocate(
+	IN  PSLAB_ALLOCATOR pSlab,
+	IN  SIZE_T Size
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SlabFree
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator the block came from.
+//
+//		[IN]  PVOID pBlock
+//		Block to free.
+//
+//		[IN]  SIZE_T Size
+//		Size the block was allocated with.
+//
+//	Routine Description:
+//		Returns the block to the lookaside list of the current processor,
+//		or to pool for large blocks. Callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabFree(
+	IN  PSLAB_ALLOCATOR pSlab,
+	IN  PVOID pBlock,
+	IN  SIZE_T Size
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SlabQueryCounters
+//
+//	Parameters:
+//		[IN]  SLAB_ALLOCATOR* pSlab
+//		Allocator to look at.
+//
+//		[OUT]  SLAB_COUNTERS* pCounters
+//		Receives the totals.
+//
+//	Routine Description:
+//		Adds up the counters of every processor. The counters keep moving
+//		while they are read, the totals are a close estimate.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+SlabQueryCounters(
+	IN  PSLAB_ALLOCATOR pSlab,
+	OUT  PSLAB_COUNTERS pCounters
+);
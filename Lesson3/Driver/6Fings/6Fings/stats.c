@@ -0,0 +1,424 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	stats.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the request counters. Every processor counts			*
+* 	the requests it completes in a block of its own, at DISPATCH_LEVEL			*
+* 	so nothing else updates the block meanwhile and no interlocked				*
+* 	operation is needed. IOCTL_6FINGS_QUERY_STATS adds the blocks up.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static const LONG g_StatsStatuses[FINGS_STATS_STATUS_COUNT - 1] = FINGS_STATS_STATUSES;
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, InitializeStats)
+#pragma alloc_text(PAGE, FreeStats)
+#pragma alloc_text(PAGE, IoctlQueryStats)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Slot of FINGS_MAJOR_STATS.ullFailuresByStatus counting NtStatus.
+//
+static ULONG
+StatusSlot(
+    IN  NTSTATUS NtStatus
+)
+{
+    ULONG ulSlot;
+
+    for (ulSlot = 0; ulSlot < FINGS_STATS_STATUS_COUNT - 1; ulSlot++)
+    {
+        if (g_StatsStatuses[ulSlot] == NtStatus)
+            break;
+    }
+
+    return ulSlot;
+}
+
+
+//
+//	Latency bucket of a request that took llTicks of the performance counter.
+//
+static ULONG
+LatencyBucket(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  LONG64 llTicks
+)
+{
+    LONG64 llFrequency = pDeviceExtension->llCounterFrequency;
+    ULONG64 ullNanoseconds;
+    ULONG ulBucket = 0;
+
+    if (llTicks <= 0)
+        return 0;
+
+    //
+    //	Split so a read that pended for hours does not overflow.
+    //
+    ullNanoseconds = (ULONG64)(llTicks / llFrequency) * 1000000000 +
+                     (ULONG64)(llTicks % llFrequency) * 1000000000 / (ULONG64)llFrequency;
+
+    while (ullNanoseconds && ulBucket < FINGS_STATS_LATENCY_BUCKETS - 1)
+    {
+        ullNanoseconds >>= 1;
+        ulBucket++;
+    }
+
+    return ulBucket;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		InitializeStats
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Allocates zeroed counters for every processor the system can have
+//		and reads the clocks message stamps are converted with.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is STATUS_INSUFFICIENT_RESOURCES.
+//
+//***********************************************************************************
+NTSTATUS
+InitializeStats(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    LARGE_INTEGER Frequency;
+
+    PAGED_CODE();
+
+    pDeviceExtension->ulStatsCpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    pDeviceExtension->pStats = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED,
+        sizeof(STATS_CPU) * pDeviceExtension->ulStatsCpuCount,
+        FINGS_POOL_TAG
+    );
+
+    if (!pDeviceExtension->pStats)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    pDeviceExtension->llCounterBase = KeQueryPerformanceCounter(&Frequency).QuadPart;
+    pDeviceExtension->llCounterFrequency = Frequency.QuadPart;
+    KeQuerySystemTimePrecise((PLARGE_INTEGER)&pDeviceExtension->llClockBase);
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FreeStats
+//
+//	Parameters:
+//		[IN/OUT]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//	Routine Description:
+//		Frees the counters.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+FreeStats(
+    IN OUT  PDEVICE_EXTENSION pDeviceExtension
+)
+{
+    PAGED_CODE();
+
+    ExFreePoolWithTag(pDeviceExtension->pStats, FINGS_POOL_TAG);
+    pDeviceExtension->pStats = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StatsStartRequest
+//
+//	Parameters:
+//		[IN/OUT]  IRP* pIrp
+//		Request entering a dispatch routine.
+//
+//	Routine Description:
+//		Notes when the request arrived, in DriverContext[0] which stays
+//		ours until the request is completed. The queue of pending reads
+//		only uses DriverContext[3].
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsStartRequest(
+    IN OUT  PIRP pIrp
+)
+{
+    pIrp->Tail.Overlay.DriverContext[0] = (PVOID)(ULONG_PTR)KeQueryPerformanceCounter(NULL).QuadPart;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StatsCountRequest
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  UCHAR ucMajorFunction
+//		IRP_MJ_* the request is counted against.
+//
+//		[IN]  LONG64 llStart
+//		Performance counter when the request arrived.
+//
+//		[IN]  NTSTATUS NtStatus
+//		Status of the request.
+//
+//		[IN]  ULONG_PTR BytesIn
+//		Bytes the request took from the caller.
+//
+//		[IN]  ULONG_PTR BytesOut
+//		Bytes the request returned to the caller.
+//
+//	Routine Description:
+//		Counts a finished request on the current processor. Requests
+//		served by fast I/O have no IRP and are counted through here
+//		directly.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsCountRequest(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  UCHAR ucMajorFunction,
+    IN  LONG64 llStart,
+    IN  NTSTATUS NtStatus,
+    IN  ULONG_PTR BytesIn,
+    IN  ULONG_PTR BytesOut
+)
+{
+    PFINGS_MAJOR_STATS pMajor;
+    ULONG ulBucket;
+    KIRQL OldIrql;
+
+    //
+    //	The start may have been kept as wide as a pointer, the difference
+    //	is right even when the upper bits were cut off.
+    //
+    ulBucket = LatencyBucket(
+        pDeviceExtension,
+        (LONG64)((ULONG_PTR)KeQueryPerformanceCounter(NULL).QuadPart - (ULONG_PTR)llStart)
+    );
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    pMajor = &pDeviceExtension->pStats[KeGetCurrentProcessorNumberEx(NULL) % pDeviceExtension->ulStatsCpuCount].Major[ucMajorFunction];
+
+    pMajor->ullRequests++;
+    pMajor->ullLatency[ulBucket]++;
+
+    pMajor->ullBytesIn += BytesIn;
+    pMajor->ullBytesOut += BytesOut;
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        pMajor->ullFailures++;
+        pMajor->ullFailuresByStatus[StatusSlot(NtStatus)]++;
+    }
+
+    KeLowerIrql(OldIrql);
+
+    LOG_VERBOSE(
+        "Major function %u completed with 0x%08X, %Iu bytes in, %Iu bytes out",
+        ucMajorFunction,
+        NtStatus,
+        BytesIn,
+        BytesOut
+    );
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StatsCompleteRequest
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN/OUT]  IRP* pIrp
+//		Request with its IoStatus set, started by StatsStartRequest.
+//
+//	Routine Description:
+//		Counts the request against its major function on the current
+//		processor and completes it. IoStatus.Information came in for
+//		writes, by IRP_MJ_WRITE or a control code writing a message, and
+//		went out for everything else. Other control requests also took
+//		their input buffer.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+StatsCompleteRequest(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN OUT  PIRP pIrp
+)
+{
+    PIO_STACK_LOCATION pIoStackIrp = IoGetCurrentIrpStackLocation(pIrp);
+    ULONG_PTR BytesIn = 0, BytesOut = pIrp->IoStatus.Information;
+    ULONG ulIoControlCode;
+
+    if (pIoStackIrp->MajorFunction == IRP_MJ_WRITE)
+    {
+        BytesIn = BytesOut;
+        BytesOut = 0;
+    }
+    else if (pIoStackIrp->MajorFunction == IRP_MJ_DEVICE_CONTROL)
+    {
+        ulIoControlCode = pIoStackIrp->Parameters.DeviceIoControl.IoControlCode;
+
+        if (FINGS_IOCTL_WRITES_MESSAGE(ulIoControlCode))
+        {
+            BytesIn = BytesOut;
+            BytesOut = 0;
+        }
+        else
+        {
+            BytesIn = pIoStackIrp->Parameters.DeviceIoControl.InputBufferLength;
+        }
+    }
+
+    StatsCountRequest(
+        pDeviceExtension,
+        pIoStackIrp->MajorFunction,
+        (LONG64)(ULONG_PTR)pIrp->Tail.Overlay.DriverContext[0],
+        pIrp->IoStatus.Status,
+        BytesIn,
+        BytesOut
+    );
+
+    IoCompleteRequest(pIrp, IO_NO_INCREMENT);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlQueryStats
+//
+//	Parameters:
+//		[IN]  DEVICE_EXTENSION* pDeviceExtension
+//		Our device extension.
+//
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_QUERY_STATS request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned in the output buffer.
+//
+//	Routine Description:
+//		Adds up the counters of every processor into the output buffer.
+//		Processors keep counting meanwhile, the totals are a close estimate
+//		and this request is not part of them.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlQueryStats(
+    IN  PDEVICE_EXTENSION pDeviceExtension,
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    PFINGS_STATS pOutput = pIrp->AssociatedIrp.SystemBuffer;
+    PFINGS_MAJOR_STATS pTotal, pMajor;
+    SLAB_COUNTERS SlabCounters;
+    ULONG ulCpu, ulMajor, ulIndex;
+
+    PAGED_CODE();
+
+    *pInformation = 0;
+
+    if (pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(FINGS_STATS))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlZeroMemory(pOutput, sizeof(FINGS_STATS));
+
+    pOutput->ulMajorCount = FINGS_STATS_MAJOR_COUNT;
+    RtlCopyMemory(pOutput->lStatuses, g_StatsStatuses, sizeof(pOutput->lStatuses));
+
+    SlabQueryCounters(&pDeviceExtension->MessageSlab, &SlabCounters);
+    pOutput->ullSlabHits = SlabCounters.llHits;
+    pOutput->ullSlabMisses = SlabCounters.llMisses;
+    pOutput->llSlabBytes = SlabCounters.llBytesOutstanding;
+
+    for (ulCpu = 0; ulCpu < pDeviceExtension->ulStatsCpuCount; ulCpu++)
+    {
+        for (ulMajor = 0; ulMajor < FINGS_STATS_MAJOR_COUNT; ulMajor++)
+        {
+            pTotal = &pOutput->Major[ulMajor];
+            pMajor = &pDeviceExtension->pStats[ulCpu].Major[ulMajor];
+
+            pTotal->ullRequests += pMajor->ullRequests;
+            pTotal->ullBytesIn += pMajor->ullBytesIn;
+            pTotal->ullBytesOut += pMajor->ullBytesOut;
+            pTotal->ullFailures += pMajor->ullFailures;
+
+            for (ulIndex = 0; ulIndex < FINGS_STATS_STATUS_COUNT; ulIndex++)
+                pTotal->ullFailuresByStatus[ulIndex] += pMajor->ullFailuresByStatus[ulIndex];
+
+            for (ulIndex = 0; ulIndex < FINGS_STATS_LATENCY_BUCKETS; ulIndex++)
+                pTotal->ullLatency[ulIndex] += pMajor->ullLatency[ulIndex];
+        }
+    }
+
+    *pInformation = sizeof(FINGS_STATS);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,340 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	strscan.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the search for the NULL character.						*
+* 	x64 uses SSE2, and AVX2 when the processor has it and the buffer			*
+* 	is large enough, other platforms scan a machine word at a time.				*
+* 	Only saving the AVX state is different in the driver, the rest				*
+* 	is plain C and builds in user mode too.										*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#if defined(_KERNEL_MODE)
+#include <wdm.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "strscan.h"
+
+#if defined(_M_AMD64) || defined(__x86_64__)
+#define STRSCAN_X64
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Non zero if any byte of the 64 bit word is zero. Only the lowest set
+//	bit is reliable, which is all we need to locate the first NULL.
+//
+#define WORD_HAS_ZERO_BYTE(w)	(((w) - 0x0101010101010101ULL) & ~(w) & 0x8080808080808080ULL)
+
+//
+//	GCC only emits AVX2 instructions in functions asking for them, the
+//	rest of the file has to run on any x64 processor.
+//
+#if defined(__GNUC__)
+#define STRSCAN_AVX2_FUNCTION	__attribute__((target("avx2")))
+#else
+#define STRSCAN_AVX2_FUNCTION
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+#if defined(STRSCAN_X64)
+#if defined(_KERNEL_MODE)
+typedef XSTATE_SAVE STRSCAN_AVX_STATE;
+#else
+typedef int STRSCAN_AVX_STATE;
+#endif
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Index of the lowest set bit, Value is not zero.
+//
+static unsigned int
+LowestSetBit(
+    uint64_t Value
+)
+{
+#if defined(_MSC_VER)
+    unsigned long ulBit;
+
+    _BitScanForward64(&ulBit, Value);
+
+    return ulBit;
+#else
+    return (unsigned int)__builtin_ctzll(Value);
+#endif
+}
+
+
+#if defined(STRSCAN_X64)
+
+//
+//	Makes the AVX registers ours for the AVX2 loop, if the processor has
+//	AVX2. The driver may have interrupted a thread using them and has to
+//	save their state first, a user mode thread owns its registers.
+//
+static int
+AcquireAvx2(
+    STRSCAN_AVX_STATE* pState
+)
+{
+#if defined(_KERNEL_MODE)
+    return ExIsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE) &&
+           NT_SUCCESS(KeSaveExtendedProcessorState(XSTATE_MASK_AVX, pState));
+#elif defined(_WIN32)
+    (void)pState;
+    return IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE);
+#else
+    (void)pState;
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+//
+//	Gives back what AcquireAvx2 took.
+//
+static void
+ReleaseAvx2(
+    STRSCAN_AVX_STATE* pState
+)
+{
+#if defined(_KERNEL_MODE)
+    KeRestoreExtendedProcessorState(pState);
+#else
+    (void)pState;
+#endif
+}
+
+
+//***********************************************************************************
+//	Function:
+//		FindNullCharacterAvx2
+//
+//	Parameters:
+//		[IN]  const char* pString
+//		Buffer to search, 32 byte aligned.
+//
+//		[IN]  size_t Length
+//		Number of bytes to search, a multiple of 128.
+//
+//	Routine Description:
+//		AVX2 loop, 128 bytes per iteration. The caller owns the extended
+//		processor state.
+//
+//	Return Value:
+//		size_t.
+//		Index of the first NULL character, or Length if there is none.
+//
+//***********************************************************************************
+static STRSCAN_AVX2_FUNCTION
+size_t
+FindNullCharacterAvx2(
+    const char* pString,
+    size_t Length
+)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i v0, v1, v2, v3;
+    uint64_t ullMask;
+    size_t Index = 0;
+
+    for (Index = 0; Index < Length; Index += 128)
+    {
+        v0 = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(pString + Index)), Zero);
+        v1 = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(pString + Index + 32)), Zero);
+        v2 = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(pString + Index + 64)), Zero);
+        v3 = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(pString + Index + 96)), Zero);
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(v0, v1), _mm256_or_si256(v2, v3))))
+        {
+            ullMask = (uint32_t)_mm256_movemask_epi8(v0) |
+                      ((uint64_t)(uint32_t)_mm256_movemask_epi8(v1) << 32);
+
+            if (!ullMask)
+            {
+                ullMask = (uint32_t)_mm256_movemask_epi8(v2) |
+                          ((uint64_t)(uint32_t)_mm256_movemask_epi8(v3) << 32);
+                Index += 64;
+            }
+
+            _mm256_zeroupper();
+
+            return Index + LowestSetBit(ullMask);
+        }
+    }
+
+    _mm256_zeroupper();
+
+    return Length;
+}
+
+#endif
+
+
+//***********************************************************************************
+//	Function:
+//		FindNullCharacter
+//
+//	Parameters:
+//		[IN]  const char* pString
+//		Buffer to search.
+//
+//		[IN]  size_t Length
+//		Number of bytes in the buffer.
+//
+//	Routine Description:
+//		Finds the first NULL character in the buffer. Never reads outside
+//		of [pString, pString + Length). The buffer is scanned a word, an
+//		SSE2 vector or, for large buffers on processors supporting it, an
+//		AVX2 vector at a time.
+//		A fault reading the buffer goes to the caller's exception handler,
+//		with the extended processor state already restored.
+//
+//	Return Value:
+//		size_t.
+//		Index of the first NULL character, or Length if there is none.
+//
+//***********************************************************************************
+size_t
+FindNullCharacter(
+    const char* pString,
+    size_t Length
+)
+{
+    size_t Index = 0;
+
+    //
+    //	Walk byte by byte up to the first aligned address, after that every
+    //	load is aligned and can never cross into a page we were not given.
+    //
+    while (Index < Length && ((uintptr_t)(pString + Index) & 31) != 0)
+    {
+        if (pString[Index] == '\0')
+            return Index;
+
+        Index++;
+    }
+
+#if defined(STRSCAN_X64)
+    {
+        __m128i Zero = _mm_setzero_si128();
+        __m128i v0, v1, v2, v3;
+        STRSCAN_AVX_STATE AvxState;
+        uint32_t ulMask;
+        size_t Chunk;
+        size_t Found;
+
+        Chunk = (Length - Index) & ~(size_t)127;
+
+        if (Chunk >= STRSCAN_AVX2_THRESHOLD && AcquireAvx2(&AvxState))
+        {
+#if defined(_KERNEL_MODE)
+            //
+            //	The buffer may be a user mode address the caller probes under
+            //	its own __try, the state must be given back before its handler
+            //	runs if the scan faults.
+            //
+            __try
+            {
+                Found = FindNullCharacterAvx2(pString + Index, Chunk);
+            }
+            __finally
+            {
+                ReleaseAvx2(&AvxState);
+            }
+#else
+            Found = FindNullCharacterAvx2(pString + Index, Chunk);
+
+            ReleaseAvx2(&AvxState);
+#endif
+
+            if (Found != Chunk)
+                return Index + Found;
+
+            Index += Chunk;
+        }
+
+        while (Length - Index >= 64)
+        {
+            v0 = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(pString + Index)), Zero);
+            v1 = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(pString + Index + 16)), Zero);
+            v2 = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(pString + Index + 32)), Zero);
+            v3 = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(pString + Index + 48)), Zero);
+
+            ulMask = (uint32_t)_mm_movemask_epi8(v0) |
+                     ((uint32_t)_mm_movemask_epi8(v1) << 16);
+
+            if (ulMask)
+                return Index + LowestSetBit(ulMask);
+
+            ulMask = (uint32_t)_mm_movemask_epi8(v2) |
+                     ((uint32_t)_mm_movemask_epi8(v3) << 16);
+
+            if (ulMask)
+                return Index + 32 + LowestSetBit(ulMask);
+
+            Index += 64;
+        }
+    }
+#else
+    {
+        uint64_t ullWord;
+        uint64_t ullZero;
+
+        while (Length - Index >= sizeof(uint64_t))
+        {
+            memcpy(&ullWord, pString + Index, sizeof(ullWord));
+            ullZero = WORD_HAS_ZERO_BYTE(ullWord);
+
+            if (ullZero)
+                return Index + (LowestSetBit(ullZero) >> 3);
+
+            Index += sizeof(uint64_t);
+        }
+    }
+#endif
+
+    while (Index < Length)
+    {
+        if (pString[Index] == '\0')
+            return Index;
+
+        Index++;
+    }
+
+    return Length;
+}
@@ -0,0 +1,83 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	strscan.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the routine searching a buffer for the NULL				*
+* 	character, used to validate every message written to the device.			*
+* 	It is plain C with no Windows headers, the driver and the user				*
+* 	mode benchmark build the same strscan.c.									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stddef.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Below this size saving the AVX state costs more than the AVX loop saves.
+//
+#define STRSCAN_AVX2_THRESHOLD	(16 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//***********************************************************************************
+//	Function:
+//		FindNullCharacter
+//
+//	Parameters:
+//		[IN]  const char* pString
+//		Buffer to search.
+//	   
+//		[IN]  size_t Length
+//		Number of bytes in the buffer.
+//
+//	Routine Description:
+//		Finds the first NULL character in the buffer. Never reads outside
+//		of [pString, pString + Length). The buffer is scanned a word, an
+//		SSE2 vector or, for large buffers on processors supporting it, an
+//		AVX2 vector at a time.
+//		A fault reading the buffer goes to the caller's exception handler,
+//		with the extended processor state already restored.
+//
+//	Return Value:
+//		size_t.
+//		Index of the first NULL character, or Length if there is none.
+//
+//***********************************************************************************
+size_t
+FindNullCharacter(
+	const char* pString,
+	size_t Length
+);
+
+
+#ifdef __cplusplus
+}
+#endif
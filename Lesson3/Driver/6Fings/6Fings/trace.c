@@ -0,0 +1,433 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	trace.c																		*
+*																				*
+* Abstract:																		*
+* 	This file implements the binary trace. Every processor keeps its			*
+* 	records in a circular buffer of its own and only touches it at				*
+* 	DISPATCH_LEVEL, so a trace point is a few stores into memory no				*
+* 	other processor writes. The dump reads each buffer from a DPC				*
+* 	queued to the processor owning it, which cannot run while a trace			*
+* 	point is half written.														*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+#include "trace.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+#define TRACE_POOL_TAG			'rTF6'
+
+//
+//	Bytes of records per processor, a power of two. At 12 to 28 bytes a
+//	record this keeps the last few thousand trace points of each processor.
+//
+#define TRACE_BUFFER_SIZE		(64 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+#pragma warning(push)
+#pragma warning(disable : 4324)	// structure was padded due to alignment specifier
+
+//
+//	ulUsed bytes of records start at ulHead, a record may wrap around
+//	the end of Data.
+//
+typedef struct _TRACE_CPU
+{
+	DECLSPEC_CACHEALIGN ULONG ulHead;
+	ULONG ulUsed;
+	ULONG ulOverwritten;
+	UCHAR Data[TRACE_BUFFER_SIZE];
+
+} TRACE_CPU, *PTRACE_CPU;
+
+#pragma warning(pop)
+
+
+typedef struct _TRACE_STATE
+{
+	PTRACE_CPU pCpus;
+	ULONG ulCpuCount;
+
+} TRACE_STATE, *PTRACE_STATE;
+
+
+//
+//	One processor's part of a dump, filled by TraceSnapshotDpc.
+//
+typedef struct _TRACE_SNAPSHOT
+{
+	ULONG ulCpu;
+	PUCHAR pOutput;
+	ULONG ulLength;
+	KEVENT Done;
+
+} TRACE_SNAPSHOT, *PTRACE_SNAPSHOT;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Like the log, the trace outlives the device so DriverEntry can trace.
+//
+static TRACE_STATE g_Trace;
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma alloc_text(PAGE, TraceInitialize)
+#pragma alloc_text(PAGE, TraceShutdown)
+#pragma alloc_text(PAGE, IoctlDumpTrace)
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static VOID
+TraceCopyIn(
+    IN OUT  PTRACE_CPU pCpu,
+    IN  ULONG ulOffset,
+    IN  const VOID* pSource,
+    IN  ULONG ulLength
+)
+{
+    ULONG ulFirst = TRACE_BUFFER_SIZE - ulOffset;
+
+    if (ulFirst > ulLength)
+        ulFirst = ulLength;
+
+    RtlCopyMemory(&pCpu->Data[ulOffset], pSource, ulFirst);
+    RtlCopyMemory(pCpu->Data, (const UCHAR*)pSource + ulFirst, ulLength - ulFirst);
+}
+
+
+static VOID
+TraceCopyOut(
+    IN  PTRACE_CPU pCpu,
+    IN  ULONG ulOffset,
+    OUT  PVOID pTarget,
+    IN  ULONG ulLength
+)
+{
+    ULONG ulFirst = TRACE_BUFFER_SIZE - ulOffset;
+
+    if (ulFirst > ulLength)
+        ulFirst = ulLength;
+
+    RtlCopyMemory(pTarget, &pCpu->Data[ulOffset], ulFirst);
+    RtlCopyMemory((PUCHAR)pTarget + ulFirst, pCpu->Data, ulLength - ulFirst);
+}
+
+
+//
+//	Writes the FINGS_TRACE_CPU and the records of the processor to pOutput,
+//	oldest record first. Returns the number of bytes written.
+//
+static ULONG
+TraceSnapshot(
+    IN  ULONG ulCpu,
+    OUT  PUCHAR pOutput
+)
+{
+    PTRACE_CPU pCpu = &g_Trace.pCpus[ulCpu];
+    PFINGS_TRACE_CPU pHeader = (PFINGS_TRACE_CPU)pOutput;
+
+    pHeader->ulCpu = ulCpu;
+    pHeader->ulLength = pCpu->ulUsed;
+    pHeader->ulOverwritten = pCpu->ulOverwritten;
+    pHeader->ulReserved = 0;
+
+    TraceCopyOut(pCpu, pCpu->ulHead, pHeader + 1, pCpu->ulUsed);
+
+    return sizeof(FINGS_TRACE_CPU) + pCpu->ulUsed;
+}
+
+
+static VOID
+TraceSnapshotDpc(
+    IN  PKDPC pDpc,
+    IN  PVOID pContext,
+    IN  PVOID pArgument1,
+    IN  PVOID pArgument2
+)
+{
+    PTRACE_SNAPSHOT pSnapshot = pContext;
+
+    UNREFERENCED_PARAMETER(pDpc);
+    UNREFERENCED_PARAMETER(pArgument1);
+    UNREFERENCED_PARAMETER(pArgument2);
+
+    pSnapshot->ulLength = TraceSnapshot(pSnapshot->ulCpu, pSnapshot->pOutput);
+
+    KeSetEvent(&pSnapshot->Done, IO_NO_INCREMENT, FALSE);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		TraceInitialize
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Allocates the trace buffer of every processor. Trace points hit
+//		before, or after a failure, are silently dropped.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+TraceInitialize(
+    VOID
+)
+{
+    ULONG ulCpuCount;
+
+    PAGED_CODE();
+
+    ulCpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    g_Trace.pCpus = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(TRACE_CPU) * ulCpuCount, TRACE_POOL_TAG);
+
+    if (!g_Trace.pCpus)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    g_Trace.ulCpuCount = ulCpuCount;
+
+    return STATUS_SUCCESS;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		TraceShutdown
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Frees the trace buffers, nothing may trace anymore.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+TraceShutdown(
+    VOID
+)
+{
+    PAGED_CODE();
+
+    if (!g_Trace.pCpus)
+        return;
+
+    ExFreePoolWithTag(g_Trace.pCpus, TRACE_POOL_TAG);
+    g_Trace.pCpus = NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		TraceWrite
+//
+//	Parameters:
+//		[IN]  USHORT usFormat
+//		TRACE_* format ID.
+//
+//		[IN]  USHORT usArgumentCount
+//		Number of arguments used, at most FINGS_TRACE_MAX_ARGUMENTS.
+//
+//		[IN]  ULONG ulArgument0 .. ulArgument3
+//		Arguments of the format.
+//
+//	Routine Description:
+//		Appends a record to the buffer of the current processor, making
+//		room by overwriting its oldest records. Use the TRACE* macros
+//		rather than calling it. Callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+TraceWrite(
+    IN  USHORT usFormat,
+    IN  USHORT usArgumentCount,
+    IN  ULONG ulArgument0,
+    IN  ULONG ulArgument1,
+    IN  ULONG ulArgument2,
+    IN  ULONG ulArgument3
+)
+{
+    FINGS_TRACE_RECORD Record, Oldest;
+    ULONG ulLength = FINGS_TRACE_RECORD_LENGTH(usArgumentCount);
+    ULONG ulOldestLength;
+    PTRACE_CPU pCpu;
+    KIRQL OldIrql;
+
+    if (!g_Trace.pCpus)
+        return;
+
+    Record.ullTime = KeQueryInterruptTime();
+    Record.usFormat = usFormat;
+    Record.usArgumentCount = usArgumentCount;
+    Record.ulArguments[0] = ulArgument0;
+    Record.ulArguments[1] = ulArgument1;
+    Record.ulArguments[2] = ulArgument2;
+    Record.ulArguments[3] = ulArgument3;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    pCpu = &g_Trace.pCpus[KeGetCurrentProcessorNumberEx(NULL) % g_Trace.ulCpuCount];
+
+    //
+    //	The buffer is a flight recorder, the newest records are the ones kept.
+    //
+    while (TRACE_BUFFER_SIZE - pCpu->ulUsed < ulLength)
+    {
+        TraceCopyOut(pCpu, pCpu->ulHead, &Oldest, FINGS_TRACE_RECORD_LENGTH(0));
+        ulOldestLength = FINGS_TRACE_RECORD_LENGTH(Oldest.usArgumentCount);
+
+        pCpu->ulHead = (pCpu->ulHead + ulOldestLength) & (TRACE_BUFFER_SIZE - 1);
+        pCpu->ulUsed -= ulOldestLength;
+        pCpu->ulOverwritten++;
+    }
+
+    TraceCopyIn(pCpu, (pCpu->ulHead + pCpu->ulUsed) & (TRACE_BUFFER_SIZE - 1), &Record, ulLength);
+    pCpu->ulUsed += ulLength;
+
+    KeLowerIrql(OldIrql);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlDumpTrace
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_DUMP_TRACE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned.
+//
+//	Routine Description:
+//		Copies the trace buffers to the output buffer, each one from a
+//		DPC on its own processor so that no trace point on the hot path
+//		needs a lock. The buffers are left as they are.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the buffer only holds FINGS_TRACE_DUMP, the return value is
+//		STATUS_BUFFER_OVERFLOW and only the header is returned.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlDumpTrace(
+    IN  PIRP pIrp,
+    IN  PIO_STACK_LOCATION pIoStackIrp,
+    OUT  ULONG_PTR* pInformation
+)
+{
+    ULONG ulOutputLength = pIoStackIrp->Parameters.DeviceIoControl.OutputBufferLength;
+    PFINGS_TRACE_DUMP pDump;
+    TRACE_SNAPSHOT Snapshot;
+    PROCESSOR_NUMBER ProcessorNumber;
+    KDPC Dpc;
+    ULONG ulCpu, ulActiveCount, ulOffset;
+
+    PAGED_CODE();
+
+    *pInformation = 0;
+
+    if (!g_Trace.pCpus)
+        return STATUS_DEVICE_NOT_READY;
+
+    if (ulOutputLength < sizeof(FINGS_TRACE_DUMP) || !pIrp->MdlAddress)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    //
+    //	The DPCs write straight into the locked output buffer.
+    //
+    pDump = MmGetSystemAddressForMdlSafe(pIrp->MdlAddress, NormalPagePriority | MdlMappingNoExecute);
+
+    if (!pDump)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    pDump->ulMagic = FINGS_TRACE_MAGIC;
+    pDump->ulVersion = FINGS_TRACE_VERSION;
+    pDump->ulFormatCount = FINGS_TRACE_FORMAT_COUNT;
+    pDump->ulCpuCount = g_Trace.ulCpuCount;
+    pDump->ulRequiredLength = sizeof(FINGS_TRACE_DUMP) + g_Trace.ulCpuCount * (sizeof(FINGS_TRACE_CPU) + TRACE_BUFFER_SIZE);
+    pDump->ulReserved = 0;
+
+    if (ulOutputLength < pDump->ulRequiredLength)
+    {
+        *pInformation = sizeof(FINGS_TRACE_DUMP);
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    ulOffset = sizeof(FINGS_TRACE_DUMP);
+    ulActiveCount = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    for (ulCpu = 0; ulCpu < g_Trace.ulCpuCount; ulCpu++)
+    {
+        Snapshot.ulCpu = ulCpu;
+        Snapshot.pOutput = (PUCHAR)pDump + ulOffset;
+
+        if (ulCpu < ulActiveCount && NT_SUCCESS(KeGetProcessorNumberFromIndex(ulCpu, &ProcessorNumber)))
+        {
+            KeInitializeEvent(&Snapshot.Done, NotificationEvent, FALSE);
+            KeInitializeDpc(&Dpc, TraceSnapshotDpc, &Snapshot);
+            KeSetTargetProcessorDpcEx(&Dpc, &ProcessorNumber);
+
+            KeInsertQueueDpc(&Dpc, NULL, NULL);
+            KeWaitForSingleObject(&Snapshot.Done, Executive, KernelMode, FALSE, NULL);
+        }
+        else
+        {
+            //
+            //	No trace point ever ran on a processor that is not active.
+            //
+            Snapshot.ulLength = TraceSnapshot(ulCpu, Snapshot.pOutput);
+        }
+
+        ulOffset += Snapshot.ulLength;
+    }
+
+    *pInformation = ulOffset;
+
+    return STATUS_SUCCESS;
+}
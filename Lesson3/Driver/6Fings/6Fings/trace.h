@@ -0,0 +1,174 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	trace.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the binary trace. A trace point stores its				*
+* 	format ID, the time and its raw arguments in a buffer of the				*
+* 	current processor, nothing is formatted in the driver. The					*
+* 	buffers are dumped with IOCTL_6FINGS_DUMP_TRACE and decoded by				*
+* 	"Msg6Fings trace-decode" using the formats in 6fingstrace.h.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include "6fingstrace.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Build with /DFINGS_TRACE_ENABLED=0 to compile every trace point out.
+//
+#ifndef FINGS_TRACE_ENABLED
+#define FINGS_TRACE_ENABLED		1
+#endif
+
+//
+//	Id is a TRACE_* name from FINGS_TRACE_FORMATS, the arguments are
+//	truncated to ULONG.
+//
+#if FINGS_TRACE_ENABLED
+#define TRACE0(Id)					TraceWrite(Id, 0, 0, 0, 0, 0)
+#define TRACE1(Id, A0)				TraceWrite(Id, 1, (ULONG)(A0), 0, 0, 0)
+#define TRACE2(Id, A0, A1)			TraceWrite(Id, 2, (ULONG)(A0), (ULONG)(A1), 0, 0)
+#define TRACE3(Id, A0, A1, A2)		TraceWrite(Id, 3, (ULONG)(A0), (ULONG)(A1), (ULONG)(A2), 0)
+#else
+#define TRACE0(Id)					((VOID)0)
+#define TRACE1(Id, A0)				((VOID)0)
+#define TRACE2(Id, A0, A1)			((VOID)0)
+#define TRACE3(Id, A0, A1, A2)		((VOID)0)
+#endif
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+
+//***********************************************************************************
+//	Function:
+//		TraceInitialize
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Allocates the trace buffer of every processor. Trace points hit
+//		before, or after a failure, are silently dropped.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+TraceInitialize(
+	VOID
+);
+
+
+//***********************************************************************************
+//	Function:
+//		TraceShutdown
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Frees the trace buffers, nothing may trace anymore.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+TraceShutdown(
+	VOID
+);
+
+
+//***********************************************************************************
+//	Function:
+//		TraceWrite
+//
+//	Parameters:
+//		[IN]  USHORT usFormat
+//		TRACE_* format ID.
+//
+//		[IN]  USHORT usArgumentCount
+//		Number of arguments used, at most FINGS_TRACE_MAX_ARGUMENTS.
+//
+//		[IN]  ULONG ulArgument0 .. ulArgument3
+//		Arguments of the format.
+//
+//	Routine Description:
+//		Appends a record to the buffer of the current processor, making
+//		room by overwriting its oldest records. Use the TRACE* macros
+//		rather than calling it. Callable at IRQL <= DISPATCH_LEVEL.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+VOID
+TraceWrite(
+	IN  USHORT usFormat,
+	IN  USHORT usArgumentCount,
+	IN  ULONG ulArgument0,
+	IN  ULONG ulArgument1,
+	IN  ULONG ulArgument2,
+	IN  ULONG ulArgument3
+);
+
+
+//***********************************************************************************
+//	Function:
+//		IoctlDumpTrace
+//
+//	Parameters:
+//		[IN]  IRP* pIrp
+//		IOCTL_6FINGS_DUMP_TRACE request.
+//
+//		[IN]  IO_STACK_LOCATION* pIoStackIrp
+//		Current stack location of the request.
+//
+//		[OUT]  ULONG_PTR* pInformation
+//		Number of bytes returned.
+//
+//	Routine Description:
+//		Copies the trace buffers to the output buffer, each one from a
+//		DPC on its own processor so that no trace point on the hot path
+//		needs a lock. The buffers are left as they are.
+//
+//	Return Value:
+//		NTSTATUS.
+//		If the function succeeds, the return value is STATUS_SUCCESS.
+//		If the buffer only holds FINGS_TRACE_DUMP, the return value is
+//		STATUS_BUFFER_OVERFLOW and only the header is returned.
+//		Else the return value is some error status.
+//
+//***********************************************************************************
+NTSTATUS
+IoctlDumpTrace(
+	IN  PIRP pIrp,
+	IN  PIO_STACK_LOCATION pIoStackIrp,
+	OUT  ULONG_PTR* pInformation
+);
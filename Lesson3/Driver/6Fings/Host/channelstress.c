@@ -0,0 +1,528 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	channelstress.c																*
+*																				*
+* Abstract:																		*
+* 	This file implements the stress test of the channel shards and the			*
+* 	quotas on Linux, with the driver's own shards.c and quota.c. Writer			*
+* 	threads of two processes move between processors while they charge			*
+* 	their quotas and queue messages, readers take them out the way the			*
+* 	read routines do. Every message has to come out in the order its			*
+* 	writer queued it, at most once, or once if nothing is dropped, and			*
+* 	no quota may go over its limits. Build it from this directory:				*
+*																				*
+* 	gcc -O2 -pthread -fshort-wchar -Wno-multichar -I. -I../6Fings				*
+* 		channelstress.c wdmhost.c ../6Fings/ring.c ../6Fings/shards.c			*
+* 		../6Fings/quota.c -o 6fings-channelstress								*
+*																				*
+* 	and add -DWDM_HOST_PREEMPT=64 on a machine with few processors.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <ntddk.h>
+#include "6fings.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define CHANNELSTRESS_PROCESSORS	4
+#define CHANNELSTRESS_PROCESSES		2
+#define CHANNELSTRESS_WRITERS		6
+#define CHANNELSTRESS_READERS		2
+
+//
+//	Messages every writer queues, and how many it queues on a processor
+//	before it moves to the next one.
+//
+#define CHANNELSTRESS_MESSAGES		100000
+#define CHANNELSTRESS_MIGRATE_EVERY	64
+
+//
+//	Seconds a pass may go without a message queued or read before it
+//	is failed.
+//
+#define CHANNELSTRESS_STALL_TIMEOUT	10
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	One run of the test, ulFullPolicy is what the writers do when a
+//	quota is full.
+//
+typedef struct _CHANNELSTRESS_PASS
+{
+	PCSTR pszName;
+	ULONG ulFullPolicy;
+
+} CHANNELSTRESS_PASS;
+
+//
+//	A writer and the handle it writes on. ulNextRead is the lowest
+//	index a reader may still get from it, guarded by the ReadLock of
+//	the channel. llWritten is only touched by the writer.
+//
+typedef struct _CHANNELSTRESS_WRITER
+{
+	HANDLE_CONTEXT Handle;
+	FILE_OBJECT FileObject;
+	ULONG ulIndex;
+	ULONG ulNextRead;
+	LONG64 llWritten;
+
+} CHANNELSTRESS_WRITER, *PCHANNELSTRESS_WRITER;
+
+//
+//	State the threads of a pass share. llProgress counts the messages
+//	queued and read, llAbort tells every thread to stop when it stalls.
+//
+typedef struct _CHANNELSTRESS_CONTEXT
+{
+	DEVICE_EXTENSION DeviceExtension;
+	CHANNEL Channel;
+	CHANNELSTRESS_WRITER Writers[CHANNELSTRESS_WRITERS];
+
+	DECLSPEC_CACHEALIGN volatile LONG64 llProgress;
+	volatile LONG64 llWritersDone;
+	volatile LONG64 llRead;
+	volatile LONG64 llRejected;
+	volatile LONG64 llErrors;
+	volatile LONG64 llAbort;
+
+} CHANNELSTRESS_CONTEXT;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static CHANNELSTRESS_CONTEXT g_Context;
+
+static const CHANNELSTRESS_PASS g_Passes[] =
+{
+	{ "fail",			FINGS_QUOTA_FAIL },
+	{ "drop-oldest",	FINGS_QUOTA_DROP_OLDEST },
+};
+
+//
+//	Every process may have 512 messages and 64 KB charged, every other
+//	handle 64 messages and 8 KB of them.
+//
+static const FINGS_QUOTA g_ProcessLimits = { 512, 64 * 1024, 0, 0, 0, 0 };
+static const FINGS_QUOTA g_HandleLimits = { 64, 8 * 1024, 0, 0, 0, 0 };
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Stands in for the one of functions.c, which would bring the slab and
+//	the timing wheel with it.
+//
+VOID
+FreeMessage(
+	IN  PDEVICE_EXTENSION pDeviceExtension,
+	IN  PFINGS_MESSAGE pMessage
+)
+{
+	if (pMessage->pQuota)
+		ReleaseQuota(pDeviceExtension, pMessage->pQuota, pMessage->ulLength);
+
+	ExFreePoolWithTag(pMessage, FINGS_POOL_TAG);
+}
+
+
+//
+//	quota.c logs the limits it is given, nothing the test looks at.
+//
+VOID
+LogWrite(
+	IN  ULONG ulLevel,
+	IN  PCSTR pszFormat,
+	IN  ULONG_PTR Argument0,
+	IN  ULONG_PTR Argument1,
+	IN  ULONG_PTR Argument2,
+	IN  ULONG_PTR Argument3
+)
+{
+	UNREFERENCED_PARAMETER(ulLevel);
+	UNREFERENCED_PARAMETER(pszFormat);
+	UNREFERENCED_PARAMETER(Argument0);
+	UNREFERENCED_PARAMETER(Argument1);
+	UNREFERENCED_PARAMETER(Argument2);
+	UNREFERENCED_PARAMETER(Argument3);
+}
+
+
+//
+//	Seconds from a fixed point, for the rates.
+//
+static double
+Now(
+	VOID
+)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+
+	return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+
+//
+//	A quota a message is still charged to must count it and be within
+//	its limits. One message may go over the byte limit on its own.
+//
+static VOID
+CheckChargedQuota(
+	IN  PQUOTA pQuota
+)
+{
+	FINGS_QUOTA Limits;
+	FINGS_QUOTA_USAGE Usage;
+
+	QueryQuota(pQuota, &Limits, &Usage);
+
+	if (!Usage.ullMessages ||
+		(Limits.ulMaxMessages && Usage.ullMessages > Limits.ulMaxMessages) ||
+		(Limits.ulMaxBytes && Usage.ullBytes > Limits.ulMaxBytes && Usage.ullMessages > 1))
+	{
+		InterlockedIncrement64(&g_Context.llErrors);
+	}
+}
+
+
+//
+//	Charges and queues the writer's messages in order, moving to the next
+//	processor every CHANNELSTRESS_MIGRATE_EVERY of them. A write the quota
+//	or the ring turned down is tried again.
+//
+static PVOID
+WriterThread(
+	PVOID pParameter
+)
+{
+	PCHANNELSTRESS_WRITER pWriter = pParameter;
+	PFINGS_MESSAGE pMessage;
+	NTSTATUS NtStatus;
+	PQUOTA pQuota;
+	ULONG ulIndex = 0;
+	ULONG ulLength;
+
+	HostSetProcess(1 + pWriter->ulIndex % CHANNELSTRESS_PROCESSES);
+
+	while (ulIndex < CHANNELSTRESS_MESSAGES && !ReadNoFence64(&g_Context.llAbort))
+	{
+		HostSetProcessor((pWriter->ulIndex + ulIndex / CHANNELSTRESS_MIGRATE_EVERY) % CHANNELSTRESS_PROCESSORS);
+
+		ulLength = 16 + (ulIndex * 37 + pWriter->ulIndex * 11) % 241;
+
+		NtStatus = ChargeQuota(&pWriter->FileObject, ulLength, FALSE, &pQuota);
+
+		if (NtStatus == STATUS_DEVICE_BUSY)
+		{
+			InterlockedIncrement64(&g_Context.llRejected);
+			sched_yield();
+			continue;
+		}
+
+		pMessage = ExAllocatePool2(POOL_FLAG_NON_PAGED, FINGS_MESSAGE_SIZE(sizeof(ULONG)), FINGS_POOL_TAG);
+
+		if (!NT_SUCCESS(NtStatus) || !pMessage)
+		{
+			ReleaseQuota(&g_Context.DeviceExtension, pQuota, ulLength);
+			InterlockedIncrement64(&g_Context.llErrors);
+			break;
+		}
+
+		pMessage->ulThreadId = pWriter->ulIndex;
+		pMessage->pQuota = pQuota;
+		pMessage->ulLength = ulLength;
+		pMessage->ulStoredLength = sizeof(ULONG);
+		RtlCopyMemory(pMessage->Data, &ulIndex, sizeof(ULONG));
+
+		if (!ShardEnqueue(&g_Context.Channel, pMessage))
+		{
+			FreeMessage(&g_Context.DeviceExtension, pMessage);
+			sched_yield();
+			continue;
+		}
+
+		pWriter->llWritten++;
+		ulIndex++;
+
+		InterlockedIncrement64(&g_Context.llProgress);
+	}
+
+	InterlockedIncrement64(&g_Context.llWritersDone);
+
+	return NULL;
+}
+
+
+//
+//	Takes the oldest message out like the read routines do, until every
+//	writer is done and the rings are empty.
+//
+static PVOID
+ReaderThread(
+	PVOID pParameter
+)
+{
+	PCHANNEL pChannel = &g_Context.Channel;
+	PCHANNELSTRESS_WRITER pWriter;
+	KLOCK_QUEUE_HANDLE LockHandle;
+	PFINGS_MESSAGE pMessage;
+	ULONG ulShard;
+	ULONG ulIndex;
+
+	HostSetProcessor((ULONG)(ULONG_PTR)pParameter % CHANNELSTRESS_PROCESSORS);
+
+	while (!ReadNoFence64(&g_Context.llAbort))
+	{
+		KeAcquireInStackQueuedSpinLock(&pChannel->ReadLock, &LockHandle);
+
+		pMessage = ShardPeek(pChannel, &ulShard);
+
+		if (pMessage)
+		{
+			if (RingDequeue(&pChannel->pShards[ulShard]) != pMessage)
+				InterlockedIncrement64(&g_Context.llErrors);
+
+			pWriter = &g_Context.Writers[pMessage->ulThreadId];
+			RtlCopyMemory(&ulIndex, pMessage->Data, sizeof(ULONG));
+
+			if (ulIndex < pWriter->ulNextRead)
+				InterlockedIncrement64(&g_Context.llErrors);
+
+			pWriter->ulNextRead = ulIndex + 1;
+		}
+
+		KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+		if (!pMessage)
+		{
+			//
+			//	Once every writer is done nothing can be on its way to a ring.
+			//
+			if (ReadNoFence64(&g_Context.llWritersDone) == CHANNELSTRESS_WRITERS && !ShardsHaveMessage(pChannel))
+				break;
+
+			sched_yield();
+			continue;
+		}
+
+		CheckChargedQuota(pMessage->pQuota);
+		CheckChargedQuota(pMessage->pQuota->pProcess);
+
+		FreeMessage(&g_Context.DeviceExtension, pMessage);
+
+		InterlockedIncrement64(&g_Context.llRead);
+		InterlockedIncrement64(&g_Context.llProgress);
+	}
+
+	return NULL;
+}
+
+
+//
+//	Adds the messages the quota dropped, it must have nothing charged left.
+//
+static LONG64
+CheckIdleQuota(
+	IN  PQUOTA pQuota
+)
+{
+	FINGS_QUOTA_USAGE Usage;
+
+	QueryQuota(pQuota, NULL, &Usage);
+
+	if (Usage.ullMessages || Usage.ullBytes)
+		g_Context.llErrors++;
+
+	return (LONG64)Usage.ullMessagesDropped;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunPass
+//
+//	Parameters:
+//		[IN]  const CHANNELSTRESS_PASS* pPass
+//		Policy the writers run with.
+//
+//	Routine Description:
+//		Sets up a channel and the writers' handles like the create routine
+//		does, runs the writers and readers to the end or until they stall,
+//		then checks that every message queued was read or dropped, that
+//		the quotas are back to nothing charged and that closing the handles
+//		and the channel freed everything.
+//
+//	Return Value:
+//		int.
+//		Non zero if the pass succeeded.
+//
+//***********************************************************************************
+static int
+RunPass(
+	IN  const CHANNELSTRESS_PASS* pPass
+)
+{
+	PDEVICE_EXTENSION pDeviceExtension = &g_Context.DeviceExtension;
+	pthread_t hThreads[CHANNELSTRESS_WRITERS + CHANNELSTRESS_READERS];
+	PCHANNELSTRESS_WRITER pWriter;
+	LONG64 llProgress, llLastProgress = -1;
+	LONG64 llWritten = 0, llDropped = 0;
+	ULONG ulThread;
+	double Start, LastProgress;
+
+	RtlZeroMemory(&g_Context, sizeof(g_Context));
+
+	HostSetProcessorCount(CHANNELSTRESS_PROCESSORS);
+	InitializeQuotas(pDeviceExtension);
+	pDeviceExtension->DefaultQuota = g_ProcessLimits;
+
+	g_Context.Channel.pDeviceExtension = pDeviceExtension;
+	KeInitializeSpinLock(&g_Context.Channel.ReadLock);
+
+	if (!NT_SUCCESS(InitializeShards(&g_Context.Channel)))
+	{
+		fprintf(stderr, "%s: InitializeShards failed\n", pPass->pszName);
+		return 0;
+	}
+
+	for (ulThread = 0; ulThread < CHANNELSTRESS_WRITERS; ulThread++)
+	{
+		pWriter = &g_Context.Writers[ulThread];
+		pWriter->ulIndex = ulThread;
+		pWriter->Handle.pChannel = &g_Context.Channel;
+		pWriter->Handle.Settings.ulFullPolicy = pPass->ulFullPolicy;
+		pWriter->FileObject.FsContext = &pWriter->Handle;
+
+		HostSetProcess(1 + ulThread % CHANNELSTRESS_PROCESSES);
+
+		if (!NT_SUCCESS(OpenHandleQuota(pDeviceExtension, &pWriter->Handle)))
+		{
+			fprintf(stderr, "%s: OpenHandleQuota failed\n", pPass->pszName);
+			return 0;
+		}
+
+		if (ulThread & 1)
+			SetQuotaLimits(pWriter->Handle.pQuota, &g_HandleLimits);
+	}
+
+	HostSetProcess(1);
+
+	Start = Now();
+
+	for (ulThread = 0; ulThread < CHANNELSTRESS_WRITERS; ulThread++)
+		pthread_create(&hThreads[ulThread], NULL, WriterThread, &g_Context.Writers[ulThread]);
+
+	for (ulThread = 0; ulThread < CHANNELSTRESS_READERS; ulThread++)
+		pthread_create(&hThreads[CHANNELSTRESS_WRITERS + ulThread], NULL, ReaderThread, (PVOID)(ULONG_PTR)ulThread);
+
+	LastProgress = Start;
+
+	while (ReadNoFence64(&g_Context.llWritersDone) < CHANNELSTRESS_WRITERS || ShardsHaveMessage(&g_Context.Channel))
+	{
+		llProgress = ReadNoFence64(&g_Context.llProgress);
+
+		if (llProgress != llLastProgress)
+		{
+			llLastProgress = llProgress;
+			LastProgress = Now();
+		}
+		else if (Now() - LastProgress > CHANNELSTRESS_STALL_TIMEOUT)
+		{
+			fprintf(stderr, "%s: stalled after %lld messages read\n", pPass->pszName, (long long)g_Context.llRead);
+			WriteRelease64(&g_Context.llAbort, 1);
+			g_Context.llErrors++;
+			break;
+		}
+
+		usleep(10000);
+	}
+
+	for (ulThread = 0; ulThread < CHANNELSTRESS_WRITERS + CHANNELSTRESS_READERS; ulThread++)
+		pthread_join(hThreads[ulThread], NULL);
+
+	//
+	//	A drop is counted on the quota that was full, the handle's or the
+	//	process'. The first writers of every process reach the latter.
+	//
+	for (ulThread = 0; ulThread < CHANNELSTRESS_WRITERS; ulThread++)
+	{
+		pWriter = &g_Context.Writers[ulThread];
+		llWritten += pWriter->llWritten;
+		llDropped += CheckIdleQuota(pWriter->Handle.pQuota);
+
+		if (ulThread < CHANNELSTRESS_PROCESSES)
+			llDropped += CheckIdleQuota(pWriter->Handle.pQuota->pProcess);
+	}
+
+	if (g_Context.llRead + llDropped != llWritten || (pPass->ulFullPolicy != FINGS_QUOTA_DROP_OLDEST && llDropped))
+		g_Context.llErrors++;
+
+	printf(
+		"%-12s %u writers, %u readers: %6.2f M messages/s, %lld read, %lld rejected, %lld dropped, %lld errors\n",
+		pPass->pszName,
+		CHANNELSTRESS_WRITERS,
+		CHANNELSTRESS_READERS,
+		(double)llWritten / (Now() - Start) / 1e6,
+		(long long)g_Context.llRead,
+		(long long)g_Context.llRejected,
+		(long long)llDropped,
+		(long long)g_Context.llErrors
+	);
+	fflush(stdout);
+
+	for (ulThread = 0; ulThread < CHANNELSTRESS_WRITERS; ulThread++)
+		CloseHandleQuota(pDeviceExtension, &g_Context.Writers[ulThread].Handle);
+
+	FreeShards(&g_Context.Channel);
+
+	if (!IsListEmpty(&pDeviceExtension->ProcessQuotas) || HostPoolAllocations())
+	{
+		fprintf(stderr, "%s: %lld allocations left\n", pPass->pszName, (long long)HostPoolAllocations());
+		return 0;
+	}
+
+	return g_Context.llErrors == 0;
+}
+
+
+int
+main(
+	VOID
+)
+{
+	int iFailed = 0;
+	size_t Pass;
+
+	for (Pass = 0; Pass < sizeof(g_Passes) / sizeof(g_Passes[0]); Pass++)
+		iFailed |= !RunPass(&g_Passes[Pass]);
+
+	printf(iFailed ? "FAILED\n" : "OK\n");
+
+	return iFailed;
+}
@@ -0,0 +1,962 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	dispatchtest.c																*
+*																				*
+* Abstract:																		*
+* 	This file implements the test of the whole driver on Linux. The				*
+* 	driver is loaded into the process with wdmhost.c and iohost.c and			*
+* 	every request goes through its dispatch table and fast I/O routine			*
+* 	as it would on Windows: reads and writes of every method, pended			*
+* 	reads completed by writes, cancelled or cleaned up, writes blocked			*
+* 	on a quota, the shared ring, the counters, and threads of two				*
+* 	processes moving between processors. Build it from this directory:			*
+*																				*
+* 	gcc -O2 -pthread -fshort-wchar -Wno-unknown-pragmas -Wno-multichar			*
+* 		-I. -I../6Fings dispatchtest.c wdmhost.c iohost.c ../6Fings/[0-9a-z]*.c	*
+* 		-o 6fings-dispatchtest													*
+*																				*
+* 	and add -DWDM_HOST_PREEMPT=64 on a machine with few processors.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ntddk.h>
+#include "6fingsioctl.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define DISPATCHTEST_DEVICE			L"\\\\.\\6FingsUsr"
+
+#define DISPATCHTEST_PROCESSORS		4
+#define DISPATCHTEST_PROCESSES		2
+#define DISPATCHTEST_WRITERS		4
+#define DISPATCHTEST_READERS		2
+
+//
+//	Messages every writer of the concurrent test writes, and how many it
+//	writes on a processor before it moves to the next one.
+//
+#define DISPATCHTEST_MESSAGES		20000
+#define DISPATCHTEST_MIGRATE_EVERY	64
+
+//
+//	WriteFile, the three write control codes and IOCTL_6FINGS_WRITE_VECTOR,
+//	then ReadFile and the three read control codes.
+//
+#define DISPATCHTEST_WRITE_METHODS	5
+#define DISPATCHTEST_READ_METHODS	4
+
+//
+//	Milliseconds a request expected to complete may take, and how long
+//	one expected to stay pending is watched.
+//
+#define DISPATCHTEST_COMPLETE_TIMEOUT	10000
+#define DISPATCHTEST_PENDING_TIMEOUT	50
+
+//
+//	Seconds the concurrent test may go without a message read.
+//
+#define DISPATCHTEST_STALL_TIMEOUT	10
+
+#define DISPATCHTEST_BUFFER_SIZE	(64 * 1024)
+
+//
+//	Longer than the fast I/O routine takes, the message goes by IRP.
+//
+#define DISPATCHTEST_LONG_MESSAGE	(2 * PAGE_SIZE)
+
+#define DISPATCHTEST_CHECK(Condition)	Check((Condition) != 0, #Condition, __LINE__)
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static volatile LONG64 g_llErrors;
+
+//
+//	Of the concurrent test. The readers take the ReadLock around a read
+//	so that g_ulNextRead, the next index expected of every writer, sees
+//	the messages in the order the driver returned them.
+//
+static pthread_mutex_t g_ReadLock = PTHREAD_MUTEX_INITIALIZER;
+static ULONG g_ulNextRead[DISPATCHTEST_WRITERS];
+static volatile LONG64 g_llRead;
+static volatile LONG64 g_llAbort;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+DRIVER_INITIALIZE DriverEntry;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Counts and reports a check that failed, returns whether it held.
+//
+static BOOLEAN
+Check(
+	IN  BOOLEAN bCondition,
+	IN  PCSTR pszCondition,
+	IN  int iLine
+)
+{
+	if (bCondition)
+		return TRUE;
+
+	fprintf(stderr, "dispatchtest.c(%d): %s\n", iLine, pszCondition);
+	InterlockedIncrement64(&g_llErrors);
+
+	return FALSE;
+}
+
+
+//
+//	Seconds from a fixed point.
+//
+static double
+Now(
+	VOID
+)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+
+	return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+
+//
+//	Opens the channel, the default one for NULL. The test cannot go on
+//	without the handle.
+//
+static PFILE_OBJECT
+OpenChannelFile(
+	IN OPTIONAL  PCSTR pszChannel,
+	IN  BOOLEAN bOverlapped
+)
+{
+	WCHAR szPath[RTL_NUMBER_OF(DISPATCHTEST_DEVICE) + 1 + FINGS_CHANNEL_MAX_NAME];
+	PFILE_OBJECT pFileObject = NULL;
+	NTSTATUS NtStatus;
+	ULONG ulLength;
+
+	RtlCopyMemory(szPath, DISPATCHTEST_DEVICE, sizeof(DISPATCHTEST_DEVICE));
+	ulLength = RTL_NUMBER_OF(DISPATCHTEST_DEVICE) - 1;
+
+	if (pszChannel)
+	{
+		szPath[ulLength++] = L'\\';
+
+		while (*pszChannel && ulLength < RTL_NUMBER_OF(szPath) - 1)
+			szPath[ulLength++] = (WCHAR)*pszChannel++;
+
+		szPath[ulLength] = L'\0';
+	}
+
+	NtStatus = HostCreateFile(szPath, bOverlapped, &pFileObject);
+
+	if (!NT_SUCCESS(NtStatus))
+	{
+		fprintf(stderr, "Opening channel %s failed with 0x%08X\n", pszChannel ? pszChannel : "(default)", NtStatus);
+		exit(1);
+	}
+
+	return pFileObject;
+}
+
+
+//
+//	Sends a control code and waits for it if it pended.
+//
+static NTSTATUS
+Control(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulIoControlCode,
+	IN OPTIONAL  PVOID pInputBuffer,
+	IN  ULONG ulInputBufferLength,
+	OUT OPTIONAL  PVOID pOutputBuffer,
+	IN  ULONG ulOutputBufferLength,
+	OUT OPTIONAL  PULONG_PTR pInformation
+)
+{
+	NTSTATUS NtStatus;
+	HOST_IO Io;
+
+	NtStatus = HostDeviceIoControl(
+		pFileObject,
+		ulIoControlCode,
+		pInputBuffer,
+		ulInputBufferLength,
+		pOutputBuffer,
+		ulOutputBufferLength,
+		&Io
+	);
+
+	if (NtStatus == STATUS_PENDING)
+		NtStatus = HostWaitIo(&Io, MAXULONG);
+
+	if (pInformation)
+		*pInformation = NT_SUCCESS(NtStatus) ? Io.IoStatus.Information : 0;
+
+	return NtStatus;
+}
+
+
+//
+//	Writes the message, NULL character included, by one of the
+//	DISPATCHTEST_WRITE_METHODS. The vector splits it in two segments.
+//
+static NTSTATUS
+WriteMessage(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulMethod,
+	IN  PCSTR pszMessage
+)
+{
+	ULONG ulLength = (ULONG)strlen(pszMessage) + 1;
+	FINGS_WRITE_SEGMENT Segments[2];
+	NTSTATUS NtStatus;
+	HOST_IO Io;
+
+	switch (ulMethod % DISPATCHTEST_WRITE_METHODS)
+	{
+	case 0:
+		NtStatus = HostWriteFile(pFileObject, pszMessage, ulLength, &Io);
+
+		if (NtStatus == STATUS_PENDING)
+			NtStatus = HostWaitIo(&Io, MAXULONG);
+
+		return NtStatus;
+
+	case 1:
+		return Control(pFileObject, IOCTL_6FINGS_WRITE_BUFFERED, (PVOID)pszMessage, ulLength, NULL, 0, NULL);
+
+	case 2:
+		return Control(pFileObject, IOCTL_6FINGS_WRITE_DIRECT, NULL, 0, (PVOID)pszMessage, ulLength, NULL);
+
+	case 3:
+		return Control(pFileObject, IOCTL_6FINGS_WRITE_NEITHER, (PVOID)pszMessage, ulLength, NULL, 0, NULL);
+
+	default:
+		Segments[0].ullAddress = (ULONG64)(ULONG_PTR)pszMessage;
+		Segments[0].ulLength = ulLength / 2;
+		Segments[0].ulReserved = 0;
+		Segments[1].ullAddress = (ULONG64)(ULONG_PTR)(pszMessage + ulLength / 2);
+		Segments[1].ulLength = ulLength - ulLength / 2;
+		Segments[1].ulReserved = 0;
+
+		return Control(pFileObject, IOCTL_6FINGS_WRITE_VECTOR, Segments, sizeof(Segments), NULL, 0, NULL);
+	}
+}
+
+
+//
+//	Reads by one of the DISPATCHTEST_READ_METHODS, waiting if it pended.
+//
+static NTSTATUS
+ReadMessages(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulMethod,
+	OUT  PVOID pBuffer,
+	IN  ULONG ulLength,
+	OUT  PULONG_PTR pInformation
+)
+{
+	NTSTATUS NtStatus;
+	HOST_IO Io;
+
+	switch (ulMethod % DISPATCHTEST_READ_METHODS)
+	{
+	case 0:
+		NtStatus = HostReadFile(pFileObject, pBuffer, ulLength, &Io);
+
+		if (NtStatus == STATUS_PENDING)
+			NtStatus = HostWaitIo(&Io, MAXULONG);
+
+		*pInformation = NT_SUCCESS(NtStatus) ? Io.IoStatus.Information : 0;
+
+		return NtStatus;
+
+	case 1:
+		return Control(pFileObject, IOCTL_6FINGS_READ_BUFFERED, NULL, 0, pBuffer, ulLength, pInformation);
+
+	case 2:
+		return Control(pFileObject, IOCTL_6FINGS_READ_DIRECT, NULL, 0, pBuffer, ulLength, pInformation);
+
+	default:
+		return Control(pFileObject, IOCTL_6FINGS_READ_NEITHER, NULL, 0, pBuffer, ulLength, pInformation);
+	}
+}
+
+
+//
+//	Walks the records a read returned, the next message or NULL once
+//	Information is used up. A record running past it is an error.
+//
+static PCSTR
+NextRecord(
+	IN  const VOID* pBuffer,
+	IN  ULONG_PTR Information,
+	IN OUT  PULONG_PTR pOffset
+)
+{
+	const FINGS_READ_RECORD* pRecord;
+
+	if (*pOffset >= Information)
+		return NULL;
+
+	pRecord = (const FINGS_READ_RECORD*)((const CHAR*)pBuffer + *pOffset);
+
+	if (!DISPATCHTEST_CHECK(
+			Information - *pOffset >= FIELD_OFFSET(FINGS_READ_RECORD, Data) + (ULONG_PTR)pRecord->ulLength &&
+			pRecord->ulLength &&
+			pRecord->Data[pRecord->ulLength - 1] == '\0'))
+	{
+		return NULL;
+	}
+
+	*pOffset += FINGS_READ_RECORD_SIZE(pRecord->ulLength);
+
+	return pRecord->Data;
+}
+
+
+//
+//	Reads once and expects exactly the one message back.
+//
+static VOID
+ExpectMessage(
+	IN  PFILE_OBJECT pFileObject,
+	IN  PCSTR pszMessage
+)
+{
+	static LONG64 llBuffer[256];
+	ULONG_PTR Information = 0;
+	ULONG_PTR Offset = 0;
+	PCSTR pszRead;
+
+	if (!DISPATCHTEST_CHECK(NT_SUCCESS(ReadMessages(pFileObject, 1, llBuffer, sizeof(llBuffer), &Information))))
+		return;
+
+	pszRead = NextRecord(llBuffer, Information, &Offset);
+
+	DISPATCHTEST_CHECK(pszRead && !strcmp(pszRead, pszMessage) && !NextRecord(llBuffer, Information, &Offset));
+}
+
+
+//
+//	Every write method on one handle, short messages for fast I/O and
+//	long ones for the IRP path, read back in order by every read method.
+//	A short buffer takes what fits, an empty channel reads nothing.
+//
+static VOID
+TestTransfers(
+	VOID
+)
+{
+	static const PCSTR pszShort[] = { "first", "second", "third", "fourth", "fifth" };
+	PCSTR pszExpected[RTL_NUMBER_OF(pszShort) + 2];
+	FINGS_HANDLE_INFO HandleInfo;
+	ULONG_PTR Information, Offset;
+	PFILE_OBJECT pFileObject;
+	ULONG ulExpected = 0, ulReads = 0;
+	PLONG64 pBuffer;
+	PCHAR pszLong;
+	PCSTR pszRead;
+	ULONG ulIndex;
+
+	pFileObject = OpenChannelFile(NULL, FALSE);
+	pBuffer = malloc(DISPATCHTEST_BUFFER_SIZE);
+	pszLong = malloc(DISPATCHTEST_LONG_MESSAGE + 1);
+
+	memset(pszLong, 'L', DISPATCHTEST_LONG_MESSAGE);
+	pszLong[DISPATCHTEST_LONG_MESSAGE] = '\0';
+
+	for (ulIndex = 0; ulIndex < RTL_NUMBER_OF(pszShort); ulIndex++)
+	{
+		DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pFileObject, ulIndex, pszShort[ulIndex])));
+		pszExpected[ulIndex] = pszShort[ulIndex];
+	}
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pFileObject, 0, pszLong)));
+	DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pFileObject, 1, pszLong)));
+	pszExpected[ulIndex++] = pszLong;
+	pszExpected[ulIndex++] = pszLong;
+
+	while (ulExpected < RTL_NUMBER_OF(pszExpected))
+	{
+		if (!DISPATCHTEST_CHECK(NT_SUCCESS(ReadMessages(
+				pFileObject,
+				ulReads,
+				pBuffer,
+				ulExpected < RTL_NUMBER_OF(pszShort) ? 64 : DISPATCHTEST_BUFFER_SIZE,
+				&Information))) ||
+			!DISPATCHTEST_CHECK(Information))
+		{
+			break;
+		}
+
+		ulReads++;
+		Offset = 0;
+
+		while ((pszRead = NextRecord(pBuffer, Information, &Offset)) != NULL)
+		{
+			if (!DISPATCHTEST_CHECK(ulExpected < RTL_NUMBER_OF(pszExpected) && !strcmp(pszRead, pszExpected[ulExpected])))
+				break;
+
+			ulExpected++;
+		}
+	}
+
+	DISPATCHTEST_CHECK(ReadMessages(pFileObject, 2, pBuffer, DISPATCHTEST_BUFFER_SIZE, &Information) == STATUS_SUCCESS && !Information);
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_QUERY_HANDLE, NULL, 0, &HandleInfo, sizeof(HandleInfo), &Information)));
+	DISPATCHTEST_CHECK(Information == sizeof(HandleInfo));
+	DISPATCHTEST_CHECK(HandleInfo.ullMessagesWritten == RTL_NUMBER_OF(pszExpected));
+	DISPATCHTEST_CHECK(HandleInfo.ullReads == ulReads && !HandleInfo.ulPendingReads);
+
+	HostCloseFile(pFileObject);
+
+	free(pszLong);
+	free(pBuffer);
+}
+
+
+//
+//	Handles of the same name share a channel, names are not case
+//	sensitive and are bounded, a link the driver did not create is
+//	not found.
+//
+static VOID
+TestChannels(
+	VOID
+)
+{
+	PFILE_OBJECT pAlpha, pAlphaUpper, pBeta, pFileObject;
+	FINGS_CHANNEL_INFO ChannelInfo;
+	ULONG_PTR Information;
+	LONG64 llBuffer[16];
+
+	pAlpha = OpenChannelFile("alpha", FALSE);
+	pAlphaUpper = OpenChannelFile("ALPHA", FALSE);
+	pBeta = OpenChannelFile("beta", FALSE);
+
+	DISPATCHTEST_CHECK(HostCreateFile(DISPATCHTEST_DEVICE L"\\0123456789abcdef0123456789abcdef0", FALSE, &pFileObject) == STATUS_OBJECT_NAME_INVALID);
+	DISPATCHTEST_CHECK(HostCreateFile(L"\\\\.\\7FingsUsr", FALSE, &pFileObject) == STATUS_OBJECT_NAME_NOT_FOUND);
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pAlpha, 1, "alpha")));
+	DISPATCHTEST_CHECK(ReadMessages(pBeta, 1, llBuffer, sizeof(llBuffer), &Information) == STATUS_SUCCESS && !Information);
+	ExpectMessage(pAlphaUpper, "alpha");
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pAlpha, IOCTL_6FINGS_QUERY_CHANNEL, NULL, 0, &ChannelInfo, sizeof(ChannelInfo), &Information)));
+	DISPATCHTEST_CHECK(Information == sizeof(ChannelInfo));
+	DISPATCHTEST_CHECK(ChannelInfo.ulHandles == 2 && !ChannelInfo.ulMessages);
+	DISPATCHTEST_CHECK(ChannelInfo.ullMessagesWritten == 1 && ChannelInfo.ullMessagesRead == 1);
+
+	HostCloseFile(pBeta);
+	HostCloseFile(pAlphaUpper);
+	HostCloseFile(pAlpha);
+}
+
+
+//
+//	A channel lasts while it has handles open. The last one closed frees
+//	it with its messages, its limits and its place on the eviction list,
+//	messages expired or still waiting to, so that every name can be used
+//	again and far more than FINGS_CHANNEL_MAX_COUNT of them over time.
+//
+static VOID
+TestChannelLifetime(
+	VOID
+)
+{
+	FINGS_CHANNEL_LIMITS Limits;
+	FINGS_CHANNEL_INFO ChannelInfo;
+	PFILE_OBJECT pFileObject;
+	CHAR szName[FINGS_CHANNEL_MAX_NAME + 1];
+	ULONG ulIndex;
+
+	RtlZeroMemory(&Limits, sizeof(Limits));
+	Limits.ulMessageTtl = 1;
+	Limits.ulPriority = FINGS_CHANNEL_PRIORITY_LOW;
+
+	for (ulIndex = 0; ulIndex < 4 * FINGS_CHANNEL_MAX_COUNT; ulIndex++)
+	{
+		snprintf(szName, sizeof(szName), "lifetime%u", ulIndex % (2 * FINGS_CHANNEL_MAX_COUNT));
+
+		pFileObject = OpenChannelFile(szName, FALSE);
+
+		DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_QUERY_CHANNEL, NULL, 0, &ChannelInfo, sizeof(ChannelInfo), NULL)));
+		DISPATCHTEST_CHECK(ChannelInfo.ulHandles == 1 && !ChannelInfo.ullMessagesWritten && !ChannelInfo.Limits.ulMessageTtl);
+
+		if (ulIndex % 2)
+			DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_SET_CHANNEL, &Limits, sizeof(Limits), NULL, 0, NULL)));
+
+		DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pFileObject, ulIndex, "left unread")));
+
+		//
+		//	Now and then the message expires before the channel goes.
+		//
+		if (ulIndex % 16 == 1)
+		{
+			usleep(3 * FINGS_EXPIRY_TICK_MS * 1000);
+
+			DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_QUERY_CHANNEL, NULL, 0, &ChannelInfo, sizeof(ChannelInfo), NULL)));
+			DISPATCHTEST_CHECK(ChannelInfo.ullMessagesExpired == 1 && !ChannelInfo.ulMessages);
+		}
+
+		HostCloseFile(pFileObject);
+	}
+}
+
+
+//
+//	A read of an overlapped handle finding nothing pends until a write,
+//	a cancel or the handle being closed completes it.
+//
+static VOID
+TestPendedReads(
+	VOID
+)
+{
+	PFILE_OBJECT pReader, pWriter;
+	ULONG_PTR Offset = 0;
+	LONG64 llBuffer[256];
+	NTSTATUS NtStatus;
+	PCSTR pszRead;
+	HOST_IO Io;
+
+	pReader = OpenChannelFile("pended", TRUE);
+	pWriter = OpenChannelFile("pended", FALSE);
+
+	NtStatus = HostReadFile(pReader, llBuffer, sizeof(llBuffer), &Io);
+
+	DISPATCHTEST_CHECK(NtStatus == STATUS_PENDING);
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, DISPATCHTEST_PENDING_TIMEOUT) == STATUS_TIMEOUT);
+	DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pWriter, 2, "wake")));
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, DISPATCHTEST_COMPLETE_TIMEOUT) == STATUS_SUCCESS);
+
+	pszRead = NextRecord(llBuffer, Io.IoStatus.Information, &Offset);
+	DISPATCHTEST_CHECK(pszRead && !strcmp(pszRead, "wake"));
+
+	NtStatus = HostDeviceIoControl(pReader, IOCTL_6FINGS_READ_BUFFERED, NULL, 0, llBuffer, sizeof(llBuffer), &Io);
+
+	DISPATCHTEST_CHECK(NtStatus == STATUS_PENDING);
+	HostCancelIo(pReader);
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, DISPATCHTEST_COMPLETE_TIMEOUT) == STATUS_CANCELLED);
+
+	NtStatus = HostDeviceIoControl(pReader, IOCTL_6FINGS_READ_DIRECT, NULL, 0, llBuffer, sizeof(llBuffer), &Io);
+
+	DISPATCHTEST_CHECK(NtStatus == STATUS_PENDING);
+	HostCloseFile(pReader);
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, 0) == STATUS_CANCELLED);
+
+	HostCloseFile(pWriter);
+}
+
+
+//
+//	A handle blocking on a full quota pends the write until a read makes
+//	room for it.
+//
+static VOID
+TestBlockedWrite(
+	VOID
+)
+{
+	FINGS_HANDLE_SETTINGS Settings;
+	PFILE_OBJECT pReader, pWriter;
+	NTSTATUS NtStatus;
+	HOST_IO Io;
+
+	pWriter = OpenChannelFile("blocked", TRUE);
+	pReader = OpenChannelFile("blocked", FALSE);
+
+	RtlZeroMemory(&Settings, sizeof(Settings));
+	Settings.ulFullPolicy = FINGS_QUOTA_BLOCK;
+	Settings.Quota.ulMaxMessages = 1;
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pWriter, IOCTL_6FINGS_SET_HANDLE, &Settings, sizeof(Settings), NULL, 0, NULL)));
+	DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pWriter, 0, "one")));
+
+	NtStatus = HostWriteFile(pWriter, "two", sizeof("two"), &Io);
+
+	DISPATCHTEST_CHECK(NtStatus == STATUS_PENDING);
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, DISPATCHTEST_PENDING_TIMEOUT) == STATUS_TIMEOUT);
+
+	ExpectMessage(pReader, "one");
+
+	DISPATCHTEST_CHECK(HostWaitIo(&Io, DISPATCHTEST_COMPLETE_TIMEOUT) == STATUS_SUCCESS);
+
+	ExpectMessage(pReader, "two");
+
+	HostCloseFile(pReader);
+	HostCloseFile(pWriter);
+}
+
+
+//
+//	The ring is mapped with its header set up, a wake is not lost when
+//	it comes before the wait and a wait with nothing to wake it times out.
+//	Another channel has a ring of its own, which its wakes stay on.
+//
+static VOID
+TestSharedRing(
+	VOID
+)
+{
+	FINGS_MAP_RING_OUTPUT Output, OtherOutput;
+	FINGS_RING_WAIT_INPUT Wait;
+	FINGS_RING_WAKE_INPUT Wake;
+	PFINGS_SHARED_RING pRing;
+	PFILE_OBJECT pFileObject, pOtherFile;
+	ULONG_PTR Information;
+
+	pFileObject = OpenChannelFile(NULL, FALSE);
+
+	if (!DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_MAP_RING, NULL, 0, &Output, sizeof(Output), &Information))))
+	{
+		HostCloseFile(pFileObject);
+		return;
+	}
+
+	DISPATCHTEST_CHECK(Information == sizeof(Output) && Output.ulSize == FINGS_SHARED_RING_SIZE);
+
+	pRing = (PFINGS_SHARED_RING)(ULONG_PTR)Output.ullAddress;
+
+	DISPATCHTEST_CHECK(pRing->ulDataSize == FINGS_SHARED_RING_DATA_SIZE && pRing->ulDataOffset == FINGS_SHARED_RING_DATA_OFFSET);
+
+	Wake.ulSide = FINGS_RING_CONSUMER;
+	Wake.ulReserved = 0;
+	Wait.ulSide = FINGS_RING_CONSUMER;
+	Wait.ulTimeout = DISPATCHTEST_COMPLETE_TIMEOUT;
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_RING_WAKE, &Wake, sizeof(Wake), NULL, 0, NULL)));
+	DISPATCHTEST_CHECK(Control(pFileObject, IOCTL_6FINGS_RING_WAIT, &Wait, sizeof(Wait), NULL, 0, NULL) == STATUS_SUCCESS);
+
+	Wait.ulTimeout = 10;
+
+	DISPATCHTEST_CHECK(Control(pFileObject, IOCTL_6FINGS_RING_WAIT, &Wait, sizeof(Wait), NULL, 0, NULL) == STATUS_IO_TIMEOUT);
+
+	pOtherFile = OpenChannelFile("ring", FALSE);
+
+	if (DISPATCHTEST_CHECK(NT_SUCCESS(Control(pOtherFile, IOCTL_6FINGS_MAP_RING, NULL, 0, &OtherOutput, sizeof(OtherOutput), NULL))))
+		DISPATCHTEST_CHECK(OtherOutput.ullAddress != Output.ullAddress);
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pOtherFile, IOCTL_6FINGS_RING_WAKE, &Wake, sizeof(Wake), NULL, 0, NULL)));
+	DISPATCHTEST_CHECK(Control(pFileObject, IOCTL_6FINGS_RING_WAIT, &Wait, sizeof(Wait), NULL, 0, NULL) == STATUS_IO_TIMEOUT);
+	DISPATCHTEST_CHECK(Control(pOtherFile, IOCTL_6FINGS_RING_WAIT, &Wait, sizeof(Wait), NULL, 0, NULL) == STATUS_SUCCESS);
+
+	HostCloseFile(pOtherFile);
+	HostCloseFile(pFileObject);
+}
+
+
+//
+//	Writes its messages, "<writer> <index>", by every method in turn and
+//	moves to the next processor every DISPATCHTEST_MIGRATE_EVERY of them.
+//	A write finding the channel full is tried again.
+//
+static PVOID
+WriterThread(
+	PVOID pParameter
+)
+{
+	ULONG ulWriter = (ULONG)(ULONG_PTR)pParameter;
+	PFILE_OBJECT pFileObject;
+	CHAR szMessage[32];
+	NTSTATUS NtStatus;
+	ULONG ulIndex = 0;
+
+	HostSetProcess(1 + ulWriter % DISPATCHTEST_PROCESSES);
+
+	pFileObject = OpenChannelFile("concurrent", FALSE);
+
+	while (ulIndex < DISPATCHTEST_MESSAGES && !ReadNoFence64(&g_llAbort))
+	{
+		HostSetProcessor((ulWriter + ulIndex / DISPATCHTEST_MIGRATE_EVERY) % DISPATCHTEST_PROCESSORS);
+
+		snprintf(szMessage, sizeof(szMessage), "%u %u", ulWriter, ulIndex);
+
+		NtStatus = WriteMessage(pFileObject, ulIndex, szMessage);
+
+		if (NtStatus == STATUS_DEVICE_BUSY)
+		{
+			sched_yield();
+			continue;
+		}
+
+		if (!DISPATCHTEST_CHECK(NT_SUCCESS(NtStatus)))
+			break;
+
+		ulIndex++;
+	}
+
+	HostCloseFile(pFileObject);
+
+	return NULL;
+}
+
+
+//
+//	Reads by every method in turn until every message was read, each
+//	writer's must come in the order it wrote them.
+//
+static PVOID
+ReaderThread(
+	PVOID pParameter
+)
+{
+	PFILE_OBJECT pFileObject = pParameter;
+	ULONG_PTR Information, Offset;
+	ULONG ulWriter, ulIndex;
+	ULONG ulMethod = 0;
+	LONG64 llLastRead = 0;
+	double LastProgress = Now();
+	PLONG64 pBuffer;
+	PCSTR pszRead;
+
+	pBuffer = malloc(DISPATCHTEST_BUFFER_SIZE);
+
+	while (ReadNoFence64(&g_llRead) < DISPATCHTEST_WRITERS * DISPATCHTEST_MESSAGES && !ReadNoFence64(&g_llAbort))
+	{
+		pthread_mutex_lock(&g_ReadLock);
+
+		if (DISPATCHTEST_CHECK(NT_SUCCESS(ReadMessages(pFileObject, ulMethod, pBuffer, 256 << (ulMethod % 8), &Information))))
+		{
+			Offset = 0;
+
+			while ((pszRead = NextRecord(pBuffer, Information, &Offset)) != NULL)
+			{
+				if (!DISPATCHTEST_CHECK(sscanf(pszRead, "%u %u", &ulWriter, &ulIndex) == 2 &&
+										ulWriter < DISPATCHTEST_WRITERS &&
+										ulIndex == g_ulNextRead[ulWriter]))
+				{
+					InterlockedExchange64(&g_llAbort, 1);
+					break;
+				}
+
+				g_ulNextRead[ulWriter]++;
+				InterlockedIncrement64(&g_llRead);
+			}
+		}
+		else
+		{
+			InterlockedExchange64(&g_llAbort, 1);
+		}
+
+		pthread_mutex_unlock(&g_ReadLock);
+
+		ulMethod++;
+
+		if (ReadNoFence64(&g_llRead) != llLastRead)
+		{
+			llLastRead = ReadNoFence64(&g_llRead);
+			LastProgress = Now();
+		}
+		else if (Now() - LastProgress > DISPATCHTEST_STALL_TIMEOUT)
+		{
+			DISPATCHTEST_CHECK(!"concurrent test stalled");
+			InterlockedExchange64(&g_llAbort, 1);
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	free(pBuffer);
+
+	return NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		TestConcurrent
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Writers of two processes and readers share a channel while they
+//		move between processors. The readers' handles are opened first,
+//		the channel has to outlive the writers' handles. Every message
+//		has to be read once, in the order its writer wrote it, and the
+//		channel has to have counted them all.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+static VOID
+TestConcurrent(
+	VOID
+)
+{
+	pthread_t hThreads[DISPATCHTEST_WRITERS + DISPATCHTEST_READERS];
+	PFILE_OBJECT pReaders[DISPATCHTEST_READERS];
+	FINGS_CHANNEL_INFO ChannelInfo;
+	ULONG ulThread;
+	double Start;
+
+	for (ulThread = 0; ulThread < DISPATCHTEST_READERS; ulThread++)
+		pReaders[ulThread] = OpenChannelFile("concurrent", FALSE);
+
+	Start = Now();
+
+	for (ulThread = 0; ulThread < DISPATCHTEST_WRITERS; ulThread++)
+		pthread_create(&hThreads[ulThread], NULL, WriterThread, (PVOID)(ULONG_PTR)ulThread);
+
+	for (ulThread = 0; ulThread < DISPATCHTEST_READERS; ulThread++)
+		pthread_create(&hThreads[DISPATCHTEST_WRITERS + ulThread], NULL, ReaderThread, pReaders[ulThread]);
+
+	for (ulThread = 0; ulThread < RTL_NUMBER_OF(hThreads); ulThread++)
+		pthread_join(hThreads[ulThread], NULL);
+
+	printf(
+		"concurrent: %lld messages in %.2f s\n",
+		(long long)g_llRead,
+		Now() - Start
+	);
+
+	for (ulThread = 0; ulThread < DISPATCHTEST_WRITERS; ulThread++)
+		DISPATCHTEST_CHECK(g_ulNextRead[ulThread] == DISPATCHTEST_MESSAGES);
+
+	DISPATCHTEST_CHECK(NT_SUCCESS(Control(pReaders[0], IOCTL_6FINGS_QUERY_CHANNEL, NULL, 0, &ChannelInfo, sizeof(ChannelInfo), NULL)));
+	DISPATCHTEST_CHECK(ChannelInfo.ullMessagesWritten == DISPATCHTEST_WRITERS * DISPATCHTEST_MESSAGES);
+	DISPATCHTEST_CHECK(ChannelInfo.ullMessagesRead == DISPATCHTEST_WRITERS * DISPATCHTEST_MESSAGES);
+	DISPATCHTEST_CHECK(ChannelInfo.ulHandles == DISPATCHTEST_READERS && !ChannelInfo.ulMessages);
+
+	for (ulThread = 0; ulThread < DISPATCHTEST_READERS; ulThread++)
+		HostCloseFile(pReaders[ulThread]);
+}
+
+
+//
+//	Every request the tests sent was counted once, against one latency
+//	bucket, and every handle opened but this one was cleaned up and closed.
+//	Messages written by control codes are counted as coming in.
+//
+static VOID
+TestStats(
+	VOID
+)
+{
+	FINGS_MAJOR_STATS Control0;
+	PFILE_OBJECT pFileObject;
+	PFINGS_MAJOR_STATS pMajor;
+	ULONG64 ullLatency;
+	PFINGS_STATS pStats;
+	ULONG ulMajor;
+	ULONG ulBucket;
+	ULONG ulMethod;
+
+	pFileObject = OpenChannelFile(NULL, FALSE);
+	pStats = malloc(sizeof(FINGS_STATS));
+
+	if (DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_QUERY_STATS, NULL, 0, pStats, sizeof(FINGS_STATS), NULL))))
+	{
+		DISPATCHTEST_CHECK(pStats->ulMajorCount == FINGS_STATS_MAJOR_COUNT);
+
+		for (ulMajor = 0; ulMajor < FINGS_STATS_MAJOR_COUNT; ulMajor++)
+		{
+			pMajor = &pStats->Major[ulMajor];
+			ullLatency = 0;
+
+			for (ulBucket = 0; ulBucket < FINGS_STATS_LATENCY_BUCKETS; ulBucket++)
+				ullLatency += pMajor->ullLatency[ulBucket];
+
+			DISPATCHTEST_CHECK(ullLatency == pMajor->ullRequests && pMajor->ullFailures <= pMajor->ullRequests);
+		}
+
+		DISPATCHTEST_CHECK(pStats->Major[IRP_MJ_CREATE].ullRequests - pStats->Major[IRP_MJ_CREATE].ullFailures == pStats->Major[IRP_MJ_CLEANUP].ullRequests + 1);
+		DISPATCHTEST_CHECK(pStats->Major[IRP_MJ_CLEANUP].ullRequests == pStats->Major[IRP_MJ_CLOSE].ullRequests);
+		DISPATCHTEST_CHECK(pStats->Major[IRP_MJ_WRITE].ullBytesIn && pStats->Major[IRP_MJ_READ].ullBytesOut);
+
+		//
+		//	The query above is counted with the writes, its output only.
+		//
+		Control0 = pStats->Major[IRP_MJ_DEVICE_CONTROL];
+
+		for (ulMethod = 1; ulMethod < DISPATCHTEST_WRITE_METHODS; ulMethod++)
+			DISPATCHTEST_CHECK(NT_SUCCESS(WriteMessage(pFileObject, ulMethod, "stats")));
+
+		if (DISPATCHTEST_CHECK(NT_SUCCESS(Control(pFileObject, IOCTL_6FINGS_QUERY_STATS, NULL, 0, pStats, sizeof(FINGS_STATS), NULL))))
+		{
+			pMajor = &pStats->Major[IRP_MJ_DEVICE_CONTROL];
+
+			DISPATCHTEST_CHECK(pMajor->ullRequests - Control0.ullRequests == DISPATCHTEST_WRITE_METHODS);
+			DISPATCHTEST_CHECK(pMajor->ullBytesIn - Control0.ullBytesIn == (DISPATCHTEST_WRITE_METHODS - 1) * sizeof("stats"));
+			DISPATCHTEST_CHECK(pMajor->ullBytesOut - Control0.ullBytesOut == sizeof(FINGS_STATS));
+		}
+	}
+
+	HostCloseFile(pFileObject);
+
+	free(pStats);
+}
+
+
+int
+main(
+	VOID
+)
+{
+	NTSTATUS NtStatus;
+
+	HostSetProcessorCount(DISPATCHTEST_PROCESSORS);
+
+	NtStatus = HostLoadDriver(DriverEntry);
+
+	if (!NT_SUCCESS(NtStatus))
+	{
+		fprintf(stderr, "DriverEntry failed with 0x%08X\n", NtStatus);
+		printf("FAILED\n");
+		return 1;
+	}
+
+	TestTransfers();
+	TestChannels();
+	TestChannelLifetime();
+	TestPendedReads();
+	TestBlockedWrite();
+	TestSharedRing();
+	TestConcurrent();
+	TestStats();
+
+	HostUnloadDriver();
+
+	if (HostPoolAllocations())
+	{
+		fprintf(stderr, "%lld pool allocations were not freed\n", (long long)HostPoolAllocations());
+		g_llErrors++;
+	}
+
+	printf(g_llErrors ? "FAILED\n" : "OK\n");
+
+	return g_llErrors != 0;
+}
@@ -0,0 +1,1369 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	iohost.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the I/O manager wdm.h declares, for a driver			*
+* 	loaded into the test process. Clients open the device through its			*
+* 	symbolic link and send it the IRPs Win32 would, buffers are passed			*
+* 	the way the device and control codes ask for. Pended IRPs can be			*
+* 	cancelled, a cancel safe queue works as in the kernel, and closing			*
+* 	a file sends the cleanup, waits for its IRPs and then the close.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	For mremap.
+//
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <ntddk.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Longest device or symbolic link name, and longest file name after
+//	the symbolic link, in characters.
+//
+#define HOST_NAME_LENGTH	64
+#define HOST_PATH_LENGTH	260
+
+//
+//	What CreateFile paths start with, and the directory the symbolic
+//	links they name are in.
+//
+#define HOST_DEVICE_PREFIX		L"\\\\.\\"
+#define HOST_DOS_DEVICES		L"\\DosDevices\\"
+
+#define HOST_STRING_LENGTH(s)	(sizeof(s) / sizeof(WCHAR) - 1)
+
+//
+//	The extension of a device object starts on the cache line after its
+//	HOST_DEVICE.
+//
+#define HOST_ALIGN_UP(Size)			(((Size) + SYSTEM_CACHE_ALIGNMENT_SIZE - 1) & ~(SIZE_T)(SYSTEM_CACHE_ALIGNMENT_SIZE - 1))
+#define HOST_EXTENSION_OFFSET		HOST_ALIGN_UP(sizeof(HOST_DEVICE))
+
+//
+//	What DriverContext[3] of a queued IRP points to, its Type tells.
+//
+#define IO_TYPE_CSQ_IRP_CONTEXT	1
+#define IO_TYPE_CSQ_EX			3
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	A device object and its name.
+//
+typedef struct _HOST_DEVICE
+{
+	DEVICE_OBJECT DeviceObject;
+	UNICODE_STRING usName;
+	WCHAR szName[HOST_NAME_LENGTH];
+
+} HOST_DEVICE, *PHOST_DEVICE;
+
+typedef struct _HOST_SYMBOLIC_LINK
+{
+	LIST_ENTRY Entry;
+	PDEVICE_OBJECT pDeviceObject;
+	UNICODE_STRING usName;
+	WCHAR szName[HOST_NAME_LENGTH];
+
+} HOST_SYMBOLIC_LINK, *PHOST_SYMBOLIC_LINK;
+
+//
+//	An open file. IrpList holds the IRPs sent on it that are not
+//	completed yet, IdleEvent is signaled while it is empty. Both are
+//	guarded by Lock.
+//
+typedef struct _HOST_FILE
+{
+	FILE_OBJECT FileObject;
+	KSPIN_LOCK Lock;
+	LIST_ENTRY IrpList;
+	KEVENT IdleEvent;
+	WCHAR szFileName[HOST_PATH_LENGTH];
+
+} HOST_FILE, *PHOST_FILE;
+
+//
+//	An IRP with its one stack location and the MDL of its direct I/O
+//	buffer. A buffered request copies up to ulCopyLength bytes of its
+//	system buffer to pCopyBuffer when it completes.
+//
+typedef struct _HOST_IRP
+{
+	IRP Irp;
+	IO_STACK_LOCATION StackLocation;
+	MDL Mdl;
+	LIST_ENTRY FileEntry;
+	PHOST_FILE pFile;
+	PVOID pCopyBuffer;
+	ULONG ulCopyLength;
+
+} HOST_IRP, *PHOST_IRP;
+
+typedef struct _IO_WORKITEM
+{
+	PDEVICE_OBJECT pDeviceObject;
+
+} IO_WORKITEM;
+
+//
+//	What a work item thread runs. It is a copy, the work item may be
+//	queued again as soon as its routine started.
+//
+typedef struct _HOST_WORK
+{
+	PDEVICE_OBJECT pDeviceObject;
+	PIO_WORKITEM_ROUTINE pWorkerRoutine;
+	PVOID pContext;
+
+} HOST_WORK, *PHOST_WORK;
+
+//
+//	The loaded driver. Lock guards the device objects and the symbolic
+//	links, CancelLock is the cancel spin lock.
+//
+typedef struct _HOST_IO_MANAGER
+{
+	DRIVER_OBJECT DriverObject;
+	NTSTATUS DriverStatus;
+	KSPIN_LOCK Lock;
+	KSPIN_LOCK CancelLock;
+	LIST_ENTRY SymbolicLinks;
+	volatile LONG lOpenFiles;
+
+} HOST_IO_MANAGER;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static HOST_IO_MANAGER g_Io = { .SymbolicLinks = { &g_Io.SymbolicLinks, &g_Io.SymbolicLinks } };
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	DriverEntry and DriverUnload run in a system thread, as they do on
+//	Windows.
+//
+static VOID
+LoadDriverThread(
+	IN  PVOID pContext
+)
+{
+	UNICODE_STRING usRegistryPath;
+
+	UNREFERENCED_PARAMETER(pContext);
+
+	RtlInitUnicodeString(&usRegistryPath, L"\\Registry\\Machine\\System\\CurrentControlSet\\Services\\Host");
+
+	g_Io.DriverStatus = g_Io.DriverObject.DriverInit(&g_Io.DriverObject, &usRegistryPath);
+}
+
+
+static VOID
+UnloadDriverThread(
+	IN  PVOID pContext
+)
+{
+	UNREFERENCED_PARAMETER(pContext);
+
+	g_Io.DriverObject.DriverUnload(&g_Io.DriverObject);
+}
+
+
+//
+//	Runs pStartRoutine in a system thread and waits for it to return.
+//
+static NTSTATUS
+RunSystemThread(
+	IN  PKSTART_ROUTINE pStartRoutine
+)
+{
+	NTSTATUS NtStatus;
+	HANDLE hThread;
+
+	NtStatus = PsCreateSystemThread(&hThread, THREAD_ALL_ACCESS, NULL, NULL, NULL, pStartRoutine, NULL);
+
+	if (!NT_SUCCESS(NtStatus))
+		return NtStatus;
+
+	ZwWaitForSingleObject(hThread, FALSE, NULL);
+	ZwClose(hThread);
+
+	return STATUS_SUCCESS;
+}
+
+
+static VOID
+WorkItemThread(
+	IN  PVOID pContext
+)
+{
+	PHOST_WORK pWork = pContext;
+
+	pWork->pWorkerRoutine(pWork->pDeviceObject, pWork->pContext);
+
+	free(pWork);
+}
+
+
+//
+//	The device named pusName, or NULL. g_Io.Lock is held.
+//
+static PDEVICE_OBJECT
+FindDevice(
+	IN  PCUNICODE_STRING pusName
+)
+{
+	PDEVICE_OBJECT pDeviceObject;
+
+	for (pDeviceObject = g_Io.DriverObject.DeviceObject; pDeviceObject; pDeviceObject = pDeviceObject->NextDevice)
+	{
+		if (RtlEqualUnicodeString(&CONTAINING_RECORD(pDeviceObject, HOST_DEVICE, DeviceObject)->usName, pusName, TRUE))
+			return pDeviceObject;
+	}
+
+	return NULL;
+}
+
+
+//
+//	The symbolic link named pusName, or NULL. g_Io.Lock is held.
+//
+static PHOST_SYMBOLIC_LINK
+FindSymbolicLink(
+	IN  PCUNICODE_STRING pusName
+)
+{
+	PLIST_ENTRY pEntry;
+
+	for (pEntry = g_Io.SymbolicLinks.Flink; pEntry != &g_Io.SymbolicLinks; pEntry = pEntry->Flink)
+	{
+		if (RtlEqualUnicodeString(&CONTAINING_RECORD(pEntry, HOST_SYMBOLIC_LINK, Entry)->usName, pusName, TRUE))
+			return CONTAINING_RECORD(pEntry, HOST_SYMBOLIC_LINK, Entry);
+	}
+
+	return NULL;
+}
+
+
+//
+//	Splits a CreateFile path into the name of its symbolic link and the
+//	file name that follows, which keeps its leading backslash.
+//
+static NTSTATUS
+ParsePath(
+	IN  PCWSTR pszPath,
+	OUT  PUNICODE_STRING pusLinkName,
+	OUT  PCWSTR* ppszFileName
+)
+{
+	const SIZE_T PrefixLength = HOST_STRING_LENGTH(HOST_DEVICE_PREFIX);
+	const SIZE_T DirectoryLength = HOST_STRING_LENGTH(HOST_DOS_DEVICES);
+	SIZE_T Length;
+
+	for (Length = 0; Length < PrefixLength; Length++)
+	{
+		if (pszPath[Length] != HOST_DEVICE_PREFIX[Length])
+			return STATUS_OBJECT_NAME_INVALID;
+	}
+
+	pszPath += PrefixLength;
+
+	for (Length = 0; pszPath[Length] && pszPath[Length] != L'\\'; Length++)
+		;
+
+	if (!Length || (DirectoryLength + Length) * sizeof(WCHAR) > pusLinkName->MaximumLength)
+		return STATUS_OBJECT_NAME_INVALID;
+
+	RtlCopyMemory(pusLinkName->Buffer, HOST_DOS_DEVICES, DirectoryLength * sizeof(WCHAR));
+	RtlCopyMemory(pusLinkName->Buffer + DirectoryLength, pszPath, Length * sizeof(WCHAR));
+	pusLinkName->Length = (USHORT)((DirectoryLength + Length) * sizeof(WCHAR));
+
+	*ppszFileName = pszPath + Length;
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	A new IRP for pFile, reporting its completion to pIo.
+//
+static PHOST_IRP
+AllocateIrp(
+	IN  PHOST_FILE pFile,
+	IN  UCHAR MajorFunction,
+	OUT  PHOST_IO pIo
+)
+{
+	PHOST_IRP pHostIrp = calloc(1, sizeof(HOST_IRP));
+
+	if (!pHostIrp)
+		return NULL;
+
+	pHostIrp->pFile = pFile;
+	pHostIrp->Irp.RequestorMode = ExGetPreviousMode();
+	pHostIrp->Irp.UserIosb = &pIo->IoStatus;
+	pHostIrp->Irp.UserEvent = &pIo->Event;
+	pHostIrp->Irp.Tail.Overlay.Thread = (PETHREAD)KeGetCurrentThread();
+	pHostIrp->Irp.Tail.Overlay.CurrentStackLocation = &pHostIrp->StackLocation;
+	pHostIrp->Irp.Tail.Overlay.OriginalFileObject = &pFile->FileObject;
+
+	pHostIrp->StackLocation.MajorFunction = MajorFunction;
+	pHostIrp->StackLocation.DeviceObject = pFile->FileObject.DeviceObject;
+	pHostIrp->StackLocation.FileObject = &pFile->FileObject;
+
+	pIo->IoStatus.Status = STATUS_PENDING;
+	pIo->IoStatus.Information = 0;
+	KeInitializeEvent(&pIo->Event, NotificationEvent, FALSE);
+
+	return pHostIrp;
+}
+
+
+//
+//	Describes a caller's buffer with the MDL of the IRP, the pages are
+//	always resident and mapped.
+//
+static VOID
+BuildMdl(
+	IN OUT  PHOST_IRP pHostIrp,
+	IN  PVOID pBuffer,
+	IN  ULONG ulLength
+)
+{
+	PMDL pMdl = &pHostIrp->Mdl;
+
+	pMdl->MdlFlags = MDL_MAPPED_TO_SYSTEM_VA;
+	pMdl->MappedSystemVa = pBuffer;
+	pMdl->StartVa = (PVOID)((ULONG_PTR)pBuffer & ~(ULONG_PTR)(PAGE_SIZE - 1));
+	pMdl->ByteOffset = (ULONG)((ULONG_PTR)pBuffer & (PAGE_SIZE - 1));
+	pMdl->ByteCount = ulLength;
+
+	pHostIrp->Irp.MdlAddress = pMdl;
+}
+
+
+//
+//	Copies ulLength bytes of the caller's pBuffer to a new system buffer,
+//	and back to pCopyBuffer on completion if it is given.
+//
+static BOOLEAN
+BuildSystemBuffer(
+	IN OUT  PHOST_IRP pHostIrp,
+	IN OPTIONAL  const VOID* pBuffer,
+	IN  ULONG ulLength,
+	IN OPTIONAL  PVOID pCopyBuffer,
+	IN  ULONG ulCopyLength
+)
+{
+	PVOID pSystemBuffer = malloc(max(ulLength, ulCopyLength));
+
+	if (!pSystemBuffer)
+		return FALSE;
+
+	if (pBuffer)
+		RtlCopyMemory(pSystemBuffer, pBuffer, ulLength);
+
+	pHostIrp->Irp.AssociatedIrp.SystemBuffer = pSystemBuffer;
+	pHostIrp->pCopyBuffer = pCopyBuffer;
+	pHostIrp->ulCopyLength = ulCopyLength;
+
+	return TRUE;
+}
+
+
+//
+//	Sends the IRP to the driver. Unless bWait, an IRP the driver pended
+//	returns STATUS_PENDING and completes later.
+//
+static NTSTATUS
+CallDriver(
+	IN  PHOST_IRP pHostIrp,
+	IN  BOOLEAN bWait
+)
+{
+	PHOST_FILE pFile = pHostIrp->pFile;
+	PKEVENT pUserEvent = pHostIrp->Irp.UserEvent;
+	PIO_STATUS_BLOCK pUserIosb = pHostIrp->Irp.UserIosb;
+	PDEVICE_OBJECT pDeviceObject = pFile->FileObject.DeviceObject;
+	NTSTATUS NtStatus;
+	KIRQL OldIrql;
+
+	ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	KeAcquireSpinLock(&pFile->Lock, &OldIrql);
+
+	InsertTailList(&pFile->IrpList, &pHostIrp->FileEntry);
+	KeClearEvent(&pFile->IdleEvent);
+
+	KeReleaseSpinLock(&pFile->Lock, OldIrql);
+
+	NtStatus = pDeviceObject->DriverObject->MajorFunction[pHostIrp->StackLocation.MajorFunction](pDeviceObject, &pHostIrp->Irp);
+
+	ASSERT(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+	//
+	//	The IRP may be gone already, only the caller's event and status
+	//	block are left to look at.
+	//
+	if (NtStatus != STATUS_PENDING)
+	{
+		ASSERT(KeReadStateEvent(pUserEvent));
+		return NtStatus;
+	}
+
+	if (!bWait)
+		return NtStatus;
+
+	KeWaitForSingleObject(pUserEvent, Executive, UserMode, FALSE, NULL);
+
+	return pUserIosb->Status;
+}
+
+
+//
+//	Sends a request without buffers and waits for it.
+//
+static NTSTATUS
+SendRequest(
+	IN  PHOST_FILE pFile,
+	IN  UCHAR MajorFunction
+)
+{
+	PHOST_IRP pHostIrp;
+	HOST_IO Io;
+
+	pHostIrp = AllocateIrp(pFile, MajorFunction, &Io);
+
+	if (!pHostIrp)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	return CallDriver(pHostIrp, TRUE);
+}
+
+
+//
+//	Reads or writes pBuffer the way the device asks for.
+//
+static NTSTATUS
+Transfer(
+	IN  PFILE_OBJECT pFileObject,
+	IN  UCHAR MajorFunction,
+	IN  PVOID pBuffer,
+	IN  ULONG ulLength,
+	OUT  PHOST_IO pIo
+)
+{
+	PHOST_FILE pFile = CONTAINING_RECORD(pFileObject, HOST_FILE, FileObject);
+	ULONG ulFlags = pFileObject->DeviceObject->Flags;
+	PHOST_IRP pHostIrp;
+
+	pHostIrp = AllocateIrp(pFile, MajorFunction, pIo);
+
+	if (!pHostIrp)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	pHostIrp->StackLocation.Parameters.Read.Length = ulLength;
+	pHostIrp->Irp.UserBuffer = pBuffer;
+
+	if ((ulFlags & DO_BUFFERED_IO) && ulLength)
+	{
+		if (!BuildSystemBuffer(
+				pHostIrp,
+				MajorFunction == IRP_MJ_WRITE ? pBuffer : NULL,
+				ulLength,
+				MajorFunction == IRP_MJ_READ ? pBuffer : NULL,
+				MajorFunction == IRP_MJ_READ ? ulLength : 0))
+		{
+			free(pHostIrp);
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+	}
+	else if ((ulFlags & DO_DIRECT_IO) && ulLength)
+	{
+		BuildMdl(pHostIrp, pBuffer, ulLength);
+	}
+
+	return CallDriver(pHostIrp, (pFileObject->Flags & FO_SYNCHRONOUS_IO) != 0);
+}
+
+
+//
+//	DriverContext[3] of an IRP in a cancel safe queue is its context if
+//	it was inserted with one, else the queue.
+//
+static PIO_CSQ
+GetIrpCsq(
+	IN OUT  PIRP pIrp
+)
+{
+	PIO_CSQ_IRP_CONTEXT pContext = pIrp->Tail.Overlay.DriverContext[3];
+
+	if (pContext->Type == IO_TYPE_CSQ_IRP_CONTEXT)
+		return pContext->Csq;
+
+	return (PIO_CSQ)pContext;
+}
+
+
+//
+//	The IRP has left its cancel safe queue.
+//
+static VOID
+ClearIrpCsq(
+	IN OUT  PIRP pIrp
+)
+{
+	PIO_CSQ_IRP_CONTEXT pContext = pIrp->Tail.Overlay.DriverContext[3];
+
+	if (pContext->Type == IO_TYPE_CSQ_IRP_CONTEXT)
+		pContext->Irp = NULL;
+
+	pIrp->Tail.Overlay.DriverContext[3] = NULL;
+}
+
+
+//
+//	Cancel routine of the IRPs in a cancel safe queue.
+//
+static VOID
+CsqCancelRoutine(
+	IN OUT  PDEVICE_OBJECT pDeviceObject,
+	IN OUT  PIRP pIrp
+)
+{
+	PIO_CSQ pCsq;
+	KIRQL Irql;
+
+	UNREFERENCED_PARAMETER(pDeviceObject);
+
+	KeReleaseSpinLock(&g_Io.CancelLock, pIrp->CancelIrql);
+
+	pCsq = GetIrpCsq(pIrp);
+
+	pCsq->CsqAcquireLock(pCsq, &Irql);
+
+	pCsq->CsqRemoveIrp(pCsq, pIrp);
+	ClearIrpCsq(pIrp);
+
+	pCsq->CsqReleaseLock(pCsq, Irql);
+
+	pCsq->CsqCompleteCanceledIrp(pCsq, pIrp);
+}
+
+
+NTSTATUS
+IoCreateDevice(
+	IN  PDRIVER_OBJECT pDriverObject,
+	IN  ULONG ulDeviceExtensionSize,
+	IN OPTIONAL  PUNICODE_STRING pDeviceName,
+	IN  ULONG ulDeviceType,
+	IN  ULONG ulDeviceCharacteristics,
+	IN  BOOLEAN bExclusive,
+	OUT  PDEVICE_OBJECT* ppDeviceObject
+)
+{
+	SIZE_T Size = HOST_EXTENSION_OFFSET + HOST_ALIGN_UP((SIZE_T)ulDeviceExtensionSize);
+	PHOST_DEVICE pDevice;
+	KIRQL OldIrql;
+
+	UNREFERENCED_PARAMETER(bExclusive);
+
+	if (pDeviceName && pDeviceName->Length >= sizeof(pDevice->szName))
+		return STATUS_OBJECT_NAME_INVALID;
+
+	pDevice = aligned_alloc(SYSTEM_CACHE_ALIGNMENT_SIZE, Size);
+
+	if (!pDevice)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	RtlZeroMemory(pDevice, Size);
+
+	pDevice->DeviceObject.DriverObject = pDriverObject;
+	pDevice->DeviceObject.Flags = DO_DEVICE_INITIALIZING;
+	pDevice->DeviceObject.Characteristics = ulDeviceCharacteristics;
+	pDevice->DeviceObject.DeviceType = ulDeviceType;
+	pDevice->DeviceObject.DeviceExtension = (PCHAR)pDevice + HOST_EXTENSION_OFFSET;
+
+	RtlInitEmptyUnicodeString(&pDevice->usName, pDevice->szName, sizeof(pDevice->szName));
+	RtlCopyUnicodeString(&pDevice->usName, pDeviceName);
+
+	KeAcquireSpinLock(&g_Io.Lock, &OldIrql);
+
+	pDevice->DeviceObject.NextDevice = pDriverObject->DeviceObject;
+	pDriverObject->DeviceObject = &pDevice->DeviceObject;
+
+	KeReleaseSpinLock(&g_Io.Lock, OldIrql);
+
+	*ppDeviceObject = &pDevice->DeviceObject;
+
+	return STATUS_SUCCESS;
+}
+
+
+VOID
+IoDeleteDevice(
+	IN  PDEVICE_OBJECT pDeviceObject
+)
+{
+	PDEVICE_OBJECT* ppNext;
+	KIRQL OldIrql;
+
+	KeAcquireSpinLock(&g_Io.Lock, &OldIrql);
+
+	for (ppNext = &pDeviceObject->DriverObject->DeviceObject; *ppNext != pDeviceObject; ppNext = &(*ppNext)->NextDevice)
+		ASSERT(*ppNext);
+
+	*ppNext = pDeviceObject->NextDevice;
+
+	KeReleaseSpinLock(&g_Io.Lock, OldIrql);
+
+	free(CONTAINING_RECORD(pDeviceObject, HOST_DEVICE, DeviceObject));
+}
+
+
+NTSTATUS
+IoCreateSymbolicLink(
+	IN  PUNICODE_STRING pSymbolicLinkName,
+	IN  PUNICODE_STRING pDeviceName
+)
+{
+	PHOST_SYMBOLIC_LINK pLink;
+	PDEVICE_OBJECT pDeviceObject;
+	KIRQL OldIrql;
+
+	if (pSymbolicLinkName->Length >= sizeof(pLink->szName))
+		return STATUS_OBJECT_NAME_INVALID;
+
+	pLink = calloc(1, sizeof(HOST_SYMBOLIC_LINK));
+
+	if (!pLink)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	RtlInitEmptyUnicodeString(&pLink->usName, pLink->szName, sizeof(pLink->szName));
+	RtlCopyUnicodeString(&pLink->usName, pSymbolicLinkName);
+
+	KeAcquireSpinLock(&g_Io.Lock, &OldIrql);
+
+	pDeviceObject = FindDevice(pDeviceName);
+
+	if (pDeviceObject && !FindSymbolicLink(pSymbolicLinkName))
+	{
+		pLink->pDeviceObject = pDeviceObject;
+		InsertTailList(&g_Io.SymbolicLinks, &pLink->Entry);
+		pLink = NULL;
+	}
+
+	KeReleaseSpinLock(&g_Io.Lock, OldIrql);
+
+	if (pLink)
+	{
+		free(pLink);
+		return pDeviceObject ? STATUS_OBJECT_NAME_COLLISION : STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+IoDeleteSymbolicLink(
+	IN  PUNICODE_STRING pSymbolicLinkName
+)
+{
+	PHOST_SYMBOLIC_LINK pLink;
+	KIRQL OldIrql;
+
+	KeAcquireSpinLock(&g_Io.Lock, &OldIrql);
+
+	pLink = FindSymbolicLink(pSymbolicLinkName);
+
+	if (pLink)
+		RemoveEntryList(&pLink->Entry);
+
+	KeReleaseSpinLock(&g_Io.Lock, OldIrql);
+
+	if (!pLink)
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+
+	free(pLink);
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	The caller's event is set last but one, the IRP only leaves the list
+//	of its file after that so that a closing file waits for the caller
+//	to be told.
+//
+VOID
+IoCompleteRequest(
+	IN  PIRP pIrp,
+	IN  CHAR PriorityBoost
+)
+{
+	PHOST_IRP pHostIrp = CONTAINING_RECORD(pIrp, HOST_IRP, Irp);
+	PHOST_FILE pFile = pHostIrp->pFile;
+	KIRQL OldIrql;
+
+	UNREFERENCED_PARAMETER(PriorityBoost);
+
+	ASSERT(pIrp->IoStatus.Status != STATUS_PENDING && !pIrp->CancelRoutine);
+
+	if (pHostIrp->pCopyBuffer && !NT_ERROR(pIrp->IoStatus.Status))
+		RtlCopyMemory(pHostIrp->pCopyBuffer, pIrp->AssociatedIrp.SystemBuffer, min(pIrp->IoStatus.Information, pHostIrp->ulCopyLength));
+
+	*pIrp->UserIosb = pIrp->IoStatus;
+	KeSetEvent(pIrp->UserEvent, IO_NO_INCREMENT, FALSE);
+
+	KeAcquireSpinLock(&pFile->Lock, &OldIrql);
+
+	RemoveEntryList(&pHostIrp->FileEntry);
+
+	if (IsListEmpty(&pFile->IrpList))
+		KeSetEvent(&pFile->IdleEvent, IO_NO_INCREMENT, FALSE);
+
+	KeReleaseSpinLock(&pFile->Lock, OldIrql);
+
+	free(pIrp->AssociatedIrp.SystemBuffer);
+	free(pHostIrp);
+}
+
+
+PIO_WORKITEM
+IoAllocateWorkItem(
+	IN  PDEVICE_OBJECT pDeviceObject
+)
+{
+	PIO_WORKITEM pIoWorkItem = malloc(sizeof(IO_WORKITEM));
+
+	if (pIoWorkItem)
+		pIoWorkItem->pDeviceObject = pDeviceObject;
+
+	return pIoWorkItem;
+}
+
+
+VOID
+IoFreeWorkItem(
+	IN  PIO_WORKITEM pIoWorkItem
+)
+{
+	free(pIoWorkItem);
+}
+
+
+//
+//	Every work item gets a system thread of its own, the queue type does
+//	not matter.
+//
+VOID
+IoQueueWorkItem(
+	IN OUT  PIO_WORKITEM pIoWorkItem,
+	IN  PIO_WORKITEM_ROUTINE pWorkerRoutine,
+	IN  WORK_QUEUE_TYPE QueueType,
+	IN OPTIONAL  PVOID pContext
+)
+{
+	PHOST_WORK pWork = malloc(sizeof(HOST_WORK));
+	HANDLE hThread;
+
+	UNREFERENCED_PARAMETER(QueueType);
+
+	if (!pWork)
+		abort();
+
+	pWork->pDeviceObject = pIoWorkItem->pDeviceObject;
+	pWork->pWorkerRoutine = pWorkerRoutine;
+	pWork->pContext = pContext;
+
+	if (!NT_SUCCESS(PsCreateSystemThread(&hThread, THREAD_ALL_ACCESS, NULL, NULL, NULL, WorkItemThread, pWork)))
+		abort();
+
+	ZwClose(hThread);
+}
+
+
+NTSTATUS
+IoCsqInitializeEx(
+	OUT  PIO_CSQ pCsq,
+	IN  PIO_CSQ_INSERT_IRP_EX pCsqInsertIrp,
+	IN  PIO_CSQ_REMOVE_IRP pCsqRemoveIrp,
+	IN  PIO_CSQ_PEEK_NEXT_IRP pCsqPeekNextIrp,
+	IN  PIO_CSQ_ACQUIRE_LOCK pCsqAcquireLock,
+	IN  PIO_CSQ_RELEASE_LOCK pCsqReleaseLock,
+	IN  PIO_CSQ_COMPLETE_CANCELED_IRP pCsqCompleteCanceledIrp
+)
+{
+	pCsq->Type = IO_TYPE_CSQ_EX;
+	pCsq->CsqInsertIrp = pCsqInsertIrp;
+	pCsq->CsqRemoveIrp = pCsqRemoveIrp;
+	pCsq->CsqPeekNextIrp = pCsqPeekNextIrp;
+	pCsq->CsqAcquireLock = pCsqAcquireLock;
+	pCsq->CsqReleaseLock = pCsqReleaseLock;
+	pCsq->CsqCompleteCanceledIrp = pCsqCompleteCanceledIrp;
+	pCsq->ReservePointer = NULL;
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	An IRP cancelled before its cancel routine was set is completed here
+//	and the insert still succeeds, as in the kernel.
+//
+NTSTATUS
+IoCsqInsertIrpEx(
+	IN OUT  PIO_CSQ pCsq,
+	IN OUT  PIRP pIrp,
+	OUT OPTIONAL  PIO_CSQ_IRP_CONTEXT pContext,
+	IN OPTIONAL  PVOID pInsertContext
+)
+{
+	NTSTATUS NtStatus;
+	KIRQL Irql;
+
+	pCsq->CsqAcquireLock(pCsq, &Irql);
+
+	NtStatus = pCsq->CsqInsertIrp(pCsq, pIrp, pInsertContext);
+
+	if (!NT_SUCCESS(NtStatus))
+	{
+		pCsq->CsqReleaseLock(pCsq, Irql);
+		return NtStatus;
+	}
+
+	if (pContext)
+	{
+		pContext->Type = IO_TYPE_CSQ_IRP_CONTEXT;
+		pContext->Irp = pIrp;
+		pContext->Csq = pCsq;
+		pIrp->Tail.Overlay.DriverContext[3] = pContext;
+	}
+	else
+	{
+		pIrp->Tail.Overlay.DriverContext[3] = pCsq;
+	}
+
+	IoMarkIrpPending(pIrp);
+	IoSetCancelRoutine(pIrp, CsqCancelRoutine);
+
+	if (pIrp->Cancel && IoSetCancelRoutine(pIrp, NULL))
+	{
+		pCsq->CsqRemoveIrp(pCsq, pIrp);
+		ClearIrpCsq(pIrp);
+
+		pCsq->CsqReleaseLock(pCsq, Irql);
+
+		pCsq->CsqCompleteCanceledIrp(pCsq, pIrp);
+
+		return NtStatus;
+	}
+
+	pCsq->CsqReleaseLock(pCsq, Irql);
+
+	return NtStatus;
+}
+
+
+//
+//	IRPs whose cancel routine already runs are left to it.
+//
+PIRP
+IoCsqRemoveNextIrp(
+	IN OUT  PIO_CSQ pCsq,
+	IN OPTIONAL  PVOID pPeekContext
+)
+{
+	PIRP pIrp;
+	KIRQL Irql;
+
+	pCsq->CsqAcquireLock(pCsq, &Irql);
+
+	for (pIrp = pCsq->CsqPeekNextIrp(pCsq, NULL, pPeekContext); pIrp; pIrp = pCsq->CsqPeekNextIrp(pCsq, pIrp, pPeekContext))
+	{
+		if (IoSetCancelRoutine(pIrp, NULL))
+		{
+			pCsq->CsqRemoveIrp(pCsq, pIrp);
+			ClearIrpCsq(pIrp);
+			break;
+		}
+	}
+
+	pCsq->CsqReleaseLock(pCsq, Irql);
+
+	return pIrp;
+}
+
+
+//
+//	The pages are a shared anonymous mapping, which MmMapLockedPagesSpecifyCache
+//	maps again wherever asked. The MDL comes from the pool, the caller
+//	frees it with ExFreePool.
+//
+PMDL
+MmAllocatePagesForMdlEx(
+	IN  PHYSICAL_ADDRESS LowAddress,
+	IN  PHYSICAL_ADDRESS HighAddress,
+	IN  PHYSICAL_ADDRESS SkipBytes,
+	IN  SIZE_T TotalBytes,
+	IN  MEMORY_CACHING_TYPE CacheType,
+	IN  ULONG ulFlags
+)
+{
+	PMDL pMdl;
+	PVOID pPages;
+
+	UNREFERENCED_PARAMETER(LowAddress);
+	UNREFERENCED_PARAMETER(HighAddress);
+	UNREFERENCED_PARAMETER(SkipBytes);
+	UNREFERENCED_PARAMETER(CacheType);
+	UNREFERENCED_PARAMETER(ulFlags);
+
+	if (!TotalBytes || TotalBytes > MAXULONG)
+		return NULL;
+
+	pMdl = ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(MDL), 'ldMH');
+
+	if (!pMdl)
+		return NULL;
+
+	pPages = mmap(NULL, TotalBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (pPages == MAP_FAILED)
+	{
+		ExFreePool(pMdl);
+		return NULL;
+	}
+
+	pMdl->StartVa = pPages;
+	pMdl->ByteCount = (ULONG)TotalBytes;
+
+	return pMdl;
+}
+
+
+VOID
+MmFreePagesFromMdl(
+	IN OUT  PMDL pMdl
+)
+{
+	ASSERT(!(pMdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA));
+
+	munmap(pMdl->StartVa, pMdl->ByteCount);
+
+	pMdl->StartVa = NULL;
+	pMdl->ByteCount = 0;
+}
+
+
+//
+//	Every process is the test process, a user mode mapping differs from
+//	a kernel mode one only in not being the MDL's system address.
+//
+PVOID
+MmMapLockedPagesSpecifyCache(
+	IN OUT  PMDL pMdl,
+	IN  KPROCESSOR_MODE AccessMode,
+	IN  MEMORY_CACHING_TYPE CacheType,
+	IN OPTIONAL  PVOID pRequestedAddress,
+	IN  ULONG ulBugCheckOnFailure,
+	IN  ULONG ulPriority
+)
+{
+	PVOID pAddress;
+
+	UNREFERENCED_PARAMETER(CacheType);
+	UNREFERENCED_PARAMETER(ulBugCheckOnFailure);
+	UNREFERENCED_PARAMETER(ulPriority);
+
+	ASSERT(!pRequestedAddress);
+
+	pAddress = mremap(pMdl->StartVa, 0, pMdl->ByteCount, MREMAP_MAYMOVE);
+
+	if (pAddress == MAP_FAILED)
+		return NULL;
+
+	if (AccessMode == KernelMode)
+	{
+		pMdl->MappedSystemVa = pAddress;
+		pMdl->MdlFlags |= MDL_MAPPED_TO_SYSTEM_VA;
+	}
+
+	return pAddress;
+}
+
+
+VOID
+MmUnmapLockedPages(
+	IN  PVOID pBaseAddress,
+	IN OUT  PMDL pMdl
+)
+{
+	if ((pMdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA) && pMdl->MappedSystemVa == pBaseAddress)
+	{
+		pMdl->MdlFlags &= ~MDL_MAPPED_TO_SYSTEM_VA;
+		pMdl->MappedSystemVa = NULL;
+	}
+
+	munmap(pBaseAddress, pMdl->ByteCount);
+}
+
+
+//
+//	The devices DriverEntry created are initialized once it returns.
+//
+NTSTATUS
+HostLoadDriver(
+	IN  PDRIVER_INITIALIZE pDriverEntry
+)
+{
+	PDEVICE_OBJECT pDeviceObject;
+	NTSTATUS NtStatus;
+
+	ASSERT(!g_Io.DriverObject.DriverInit);
+
+	RtlZeroMemory(&g_Io.DriverObject, sizeof(DRIVER_OBJECT));
+	RtlInitUnicodeString(&g_Io.DriverObject.DriverName, L"\\Driver\\Host");
+	g_Io.DriverObject.DriverInit = pDriverEntry;
+
+	NtStatus = RunSystemThread(LoadDriverThread);
+
+	if (NT_SUCCESS(NtStatus))
+		NtStatus = g_Io.DriverStatus;
+
+	if (!NT_SUCCESS(NtStatus))
+	{
+		g_Io.DriverObject.DriverInit = NULL;
+		return NtStatus;
+	}
+
+	for (pDeviceObject = g_Io.DriverObject.DeviceObject; pDeviceObject; pDeviceObject = pDeviceObject->NextDevice)
+		pDeviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	Every file has to be closed first. The driver must have deleted its
+//	devices and symbolic links by the time DriverUnload returns.
+//
+VOID
+HostUnloadDriver(
+	VOID
+)
+{
+	ASSERT(g_Io.DriverObject.DriverInit && !ReadNoFence(&g_Io.lOpenFiles));
+
+	if (g_Io.DriverObject.DriverUnload && !NT_SUCCESS(RunSystemThread(UnloadDriverThread)))
+		abort();
+
+	ASSERT(!g_Io.DriverObject.DeviceObject && IsListEmpty(&g_Io.SymbolicLinks));
+
+	g_Io.DriverObject.DriverInit = NULL;
+}
+
+
+NTSTATUS
+HostCreateFile(
+	IN  PCWSTR pszPath,
+	IN  BOOLEAN bOverlapped,
+	OUT  PFILE_OBJECT* ppFileObject
+)
+{
+	WCHAR szLinkName[HOST_NAME_LENGTH];
+	UNICODE_STRING usLinkName;
+	PHOST_SYMBOLIC_LINK pLink;
+	PDEVICE_OBJECT pDeviceObject = NULL;
+	PCWSTR pszFileName;
+	PHOST_FILE pFile;
+	NTSTATUS NtStatus;
+	USHORT usLength;
+	KIRQL OldIrql;
+
+	RtlInitEmptyUnicodeString(&usLinkName, szLinkName, sizeof(szLinkName));
+
+	NtStatus = ParsePath(pszPath, &usLinkName, &pszFileName);
+
+	if (!NT_SUCCESS(NtStatus))
+		return NtStatus;
+
+	for (usLength = 0; pszFileName[usLength]; usLength++)
+	{
+		if (usLength == HOST_PATH_LENGTH - 1)
+			return STATUS_OBJECT_NAME_INVALID;
+	}
+
+	KeAcquireSpinLock(&g_Io.Lock, &OldIrql);
+
+	pLink = FindSymbolicLink(&usLinkName);
+
+	if (pLink)
+		pDeviceObject = pLink->pDeviceObject;
+
+	KeReleaseSpinLock(&g_Io.Lock, OldIrql);
+
+	if (!pDeviceObject)
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+
+	pFile = calloc(1, sizeof(HOST_FILE));
+
+	if (!pFile)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	RtlCopyMemory(pFile->szFileName, pszFileName, usLength * sizeof(WCHAR));
+
+	pFile->FileObject.DeviceObject = pDeviceObject;
+	pFile->FileObject.Flags = bOverlapped ? 0 : FO_SYNCHRONOUS_IO;
+	pFile->FileObject.FileName.Buffer = pFile->szFileName;
+	pFile->FileObject.FileName.Length = usLength * sizeof(WCHAR);
+	pFile->FileObject.FileName.MaximumLength = sizeof(pFile->szFileName);
+
+	KeInitializeSpinLock(&pFile->Lock);
+	InitializeListHead(&pFile->IrpList);
+	KeInitializeEvent(&pFile->IdleEvent, NotificationEvent, TRUE);
+
+	NtStatus = SendRequest(pFile, IRP_MJ_CREATE);
+
+	if (!NT_SUCCESS(NtStatus))
+	{
+		free(pFile);
+		return NtStatus;
+	}
+
+	InterlockedIncrement(&g_Io.lOpenFiles);
+
+	*ppFileObject = &pFile->FileObject;
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	Like closing the last handle to the file, the cleanup goes first
+//	and the close once no IRP is left on the file.
+//
+VOID
+HostCloseFile(
+	IN  PFILE_OBJECT pFileObject
+)
+{
+	PHOST_FILE pFile = CONTAINING_RECORD(pFileObject, HOST_FILE, FileObject);
+	KIRQL OldIrql;
+
+	SendRequest(pFile, IRP_MJ_CLEANUP);
+
+	KeWaitForSingleObject(&pFile->IdleEvent, Executive, KernelMode, FALSE, NULL);
+
+	//
+	//	The last IRP signaled IdleEvent holding the lock, which it may not
+	//	have released yet.
+	//
+	KeAcquireSpinLock(&pFile->Lock, &OldIrql);
+	KeReleaseSpinLock(&pFile->Lock, OldIrql);
+
+	SendRequest(pFile, IRP_MJ_CLOSE);
+
+	InterlockedDecrement(&g_Io.lOpenFiles);
+
+	free(pFile);
+}
+
+
+NTSTATUS
+HostReadFile(
+	IN  PFILE_OBJECT pFileObject,
+	OUT  PVOID pBuffer,
+	IN  ULONG ulLength,
+	OUT  PHOST_IO pIo
+)
+{
+	return Transfer(pFileObject, IRP_MJ_READ, pBuffer, ulLength, pIo);
+}
+
+
+NTSTATUS
+HostWriteFile(
+	IN  PFILE_OBJECT pFileObject,
+	IN  const VOID* pBuffer,
+	IN  ULONG ulLength,
+	OUT  PHOST_IO pIo
+)
+{
+	return Transfer(pFileObject, IRP_MJ_WRITE, (PVOID)pBuffer, ulLength, pIo);
+}
+
+
+//
+//	The driver's fast I/O routine gets the first go at the request, as
+//	it does on Windows.
+//
+NTSTATUS
+HostDeviceIoControl(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulIoControlCode,
+	IN OPTIONAL  PVOID pInputBuffer,
+	IN  ULONG ulInputBufferLength,
+	OUT OPTIONAL  PVOID pOutputBuffer,
+	IN  ULONG ulOutputBufferLength,
+	OUT  PHOST_IO pIo
+)
+{
+	PHOST_FILE pFile = CONTAINING_RECORD(pFileObject, HOST_FILE, FileObject);
+	PDEVICE_OBJECT pDeviceObject = pFileObject->DeviceObject;
+	PFAST_IO_DISPATCH pFastIoDispatch = pDeviceObject->DriverObject->FastIoDispatch;
+	BOOLEAN bWait = (pFileObject->Flags & FO_SYNCHRONOUS_IO) != 0;
+	PHOST_IRP pHostIrp;
+	BOOLEAN bBuilt = TRUE;
+
+	pIo->IoStatus.Status = STATUS_PENDING;
+	pIo->IoStatus.Information = 0;
+	KeInitializeEvent(&pIo->Event, NotificationEvent, FALSE);
+
+	if (pFastIoDispatch && pFastIoDispatch->FastIoDeviceControl &&
+		pFastIoDispatch->FastIoDeviceControl(
+			pFileObject,
+			bWait,
+			pInputBuffer,
+			ulInputBufferLength,
+			pOutputBuffer,
+			ulOutputBufferLength,
+			ulIoControlCode,
+			&pIo->IoStatus,
+			pDeviceObject))
+	{
+		KeSetEvent(&pIo->Event, IO_NO_INCREMENT, FALSE);
+		return pIo->IoStatus.Status;
+	}
+
+	pHostIrp = AllocateIrp(pFile, IRP_MJ_DEVICE_CONTROL, pIo);
+
+	if (!pHostIrp)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	pHostIrp->StackLocation.Parameters.DeviceIoControl.IoControlCode = ulIoControlCode;
+	pHostIrp->StackLocation.Parameters.DeviceIoControl.InputBufferLength = ulInputBufferLength;
+	pHostIrp->StackLocation.Parameters.DeviceIoControl.OutputBufferLength = ulOutputBufferLength;
+	pHostIrp->Irp.UserBuffer = pOutputBuffer;
+
+	switch (METHOD_FROM_CTL_CODE(ulIoControlCode))
+	{
+	case METHOD_BUFFERED:
+		if (ulInputBufferLength || ulOutputBufferLength)
+			bBuilt = BuildSystemBuffer(pHostIrp, pInputBuffer, ulInputBufferLength, pOutputBuffer, ulOutputBufferLength);
+		break;
+
+	case METHOD_IN_DIRECT:
+	case METHOD_OUT_DIRECT:
+		if (ulInputBufferLength)
+			bBuilt = BuildSystemBuffer(pHostIrp, pInputBuffer, ulInputBufferLength, NULL, 0);
+
+		if (ulOutputBufferLength)
+			BuildMdl(pHostIrp, pOutputBuffer, ulOutputBufferLength);
+		break;
+
+	default:
+		pHostIrp->StackLocation.Parameters.DeviceIoControl.Type3InputBuffer = pInputBuffer;
+		break;
+	}
+
+	if (!bBuilt)
+	{
+		free(pHostIrp);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	return CallDriver(pHostIrp, bWait);
+}
+
+
+NTSTATUS
+HostWaitIo(
+	IN  PHOST_IO pIo,
+	IN  ULONG ulMilliseconds
+)
+{
+	LARGE_INTEGER Timeout;
+
+	Timeout.QuadPart = -(LONGLONG)ulMilliseconds * 10000;
+
+	if (KeWaitForSingleObject(&pIo->Event, Executive, UserMode, FALSE, ulMilliseconds == MAXULONG ? NULL : &Timeout) == STATUS_TIMEOUT)
+		return STATUS_TIMEOUT;
+
+	return pIo->IoStatus.Status;
+}
+
+
+//
+//	Cancels every IRP on the file, like CancelIoEx without an OVERLAPPED.
+//	The file's list is walked again after each cancel routine, which may
+//	have completed any of the IRPs.
+//
+VOID
+HostCancelIo(
+	IN  PFILE_OBJECT pFileObject
+)
+{
+	PHOST_FILE pFile = CONTAINING_RECORD(pFileObject, HOST_FILE, FileObject);
+	PDRIVER_CANCEL pCancelRoutine;
+	PLIST_ENTRY pEntry;
+	PIRP pIrp = NULL;
+	KIRQL CancelIrql;
+
+	do
+	{
+		pCancelRoutine = NULL;
+
+		KeAcquireSpinLock(&g_Io.CancelLock, &CancelIrql);
+		KeAcquireSpinLockAtDpcLevel(&pFile->Lock);
+
+		for (pEntry = pFile->IrpList.Flink; pEntry != &pFile->IrpList && !pCancelRoutine; pEntry = pEntry->Flink)
+		{
+			pIrp = &CONTAINING_RECORD(pEntry, HOST_IRP, FileEntry)->Irp;
+			pIrp->Cancel = TRUE;
+			pCancelRoutine = IoSetCancelRoutine(pIrp, NULL);
+		}
+
+		KeReleaseSpinLockFromDpcLevel(&pFile->Lock);
+
+		if (pCancelRoutine)
+		{
+			pIrp->CancelIrql = CancelIrql;
+			pCancelRoutine(pFileObject->DeviceObject, pIrp);
+		}
+		else
+		{
+			KeReleaseSpinLock(&g_Io.CancelLock, CancelIrql);
+		}
+
+	} while (pCancelRoutine);
+}
@@ -0,0 +1,39 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ntddk.h																		*
+*																				*
+* Abstract:																		*
+* 	This file stands in for the WDK's ntddk.h on Linux, with the few			*
+* 	routines only it declares. See wdm.h.										*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Implemented by wdmhost.c.
+//
+LONGLONG
+PsGetProcessCreateTimeQuadPart(
+	IN  PEPROCESS pProcess
+);
@@ -0,0 +1,53 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ntstrsafe.h																	*
+*																				*
+* Abstract:																		*
+* 	This file stands in for the WDK's ntstrsafe.h on Linux, with the			*
+* 	one routine the driver uses. See wdm.h.										*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <wdm.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef char* NTSTRSAFE_PSTR;
+typedef const char* NTSTRSAFE_PCSTR;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Implemented by wdmhost.c. The format is the kernel's, Windows' %I64,
+//	%I and %l sizes are understood. No flags are supported.
+//
+NTSTATUS
+RtlStringCbPrintfExA(
+	OUT  NTSTRSAFE_PSTR pszDest,
+	IN  size_t cbDest,
+	OUT OPTIONAL  NTSTRSAFE_PSTR* ppszDestEnd,
+	OUT OPTIONAL  size_t* pcbRemaining,
+	IN  ULONG dwFlags,
+	IN  NTSTRSAFE_PCSTR pszFormat,
+	...
+);
@@ -0,0 +1,436 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	ringstress.c																*
+*																				*
+* Abstract:																		*
+* 	This file implements the stress test of the message ring on					*
+* 	Linux. Producer and consumer threads share a ring and the					*
+* 	consumers check that every message comes out once, and in the				*
+* 	order each producer put it in. Build it from this directory:				*
+*																				*
+* 	gcc -O2 -pthread -fshort-wchar -I. -I../6Fings ringstress.c					*
+* 		../6Fings/ring.c -o 6fings-ringstress									*
+*																				*
+* 	and add -DWDM_HOST_PREEMPT=64 on a machine with few processors.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <wdm.h>
+#include "ring.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Cells of the ring the single threaded checks run on.
+//
+#define RINGSTRESS_SMALL_CAPACITY	8
+
+//
+//	Most threads a pass starts on either side.
+//
+#define RINGSTRESS_MAX_THREADS		8
+
+//
+//	Seconds a pass may go without a message taken or a producer done
+//	before it is failed, a broken ring tends to stop rather than lie.
+//
+#define RINGSTRESS_STALL_TIMEOUT	10
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	What goes through the ring. llTaken counts the consumers that got
+//	the item, it has to end up 1.
+//
+typedef struct _RINGSTRESS_ITEM
+{
+	ULONG ulProducer;
+	ULONG ulIndex;
+	volatile LONG64 llTaken;
+
+} RINGSTRESS_ITEM, *PRINGSTRESS_ITEM;
+
+//
+//	One run of the test, ulMessages is per producer.
+//
+typedef struct _RINGSTRESS_PASS
+{
+	PCSTR pszName;
+	ULONG ulCapacity;
+	ULONG ulProducers;
+	ULONG ulConsumers;
+	ULONG ulMessages;
+
+} RINGSTRESS_PASS;
+
+//
+//	State the threads of a pass share. llAbort tells every thread to
+//	stop when the pass has stalled.
+//
+typedef struct _RINGSTRESS_CONTEXT
+{
+	MESSAGE_RING Ring;
+	const RINGSTRESS_PASS* pPass;
+	PRINGSTRESS_ITEM pItems;
+	DECLSPEC_CACHEALIGN volatile LONG64 llConsumed;
+	volatile LONG64 llProducersDone;
+	volatile LONG64 llErrors;
+	volatile LONG64 llAbort;
+
+} RINGSTRESS_CONTEXT, *PRINGSTRESS_CONTEXT;
+
+//
+//	Argument of a thread, which side it is on is up to its routine.
+//
+typedef struct _RINGSTRESS_THREAD
+{
+	PRINGSTRESS_CONTEXT pContext;
+	ULONG ulIndex;
+
+} RINGSTRESS_THREAD;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The small rings are full or empty most of the time, which is where
+//	producers and consumers meet on the same cells.
+//
+static const RINGSTRESS_PASS g_Passes[] =
+{
+	{ "pair",		2,		1,	1,	1000000 },
+	{ "tiny",		2,		4,	4,	100000 },
+	{ "small",		64,		4,	4,	500000 },
+	{ "fan-in",		4096,	8,	1,	250000 },
+	{ "fan-out",	4096,	1,	8,	2000000 },
+	{ "default",	RING_DEFAULT_CAPACITY,	8,	8,	250000 },
+};
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Seconds from a fixed point, for the rates.
+//
+static double
+Now(
+	VOID
+)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+
+	return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		CheckSequential
+//
+//	Parameters:
+//		None.
+//
+//	Routine Description:
+//		Checks from a single thread that an empty ring gives nothing, a
+//		full one takes nothing more, peeking does not remove and entries
+//		come out in order, over several laps of the cells.
+//
+//	Return Value:
+//		int.
+//		Non zero if every check passed.
+//
+//***********************************************************************************
+static int
+CheckSequential(
+	VOID
+)
+{
+	RING_CELL Cells[RINGSTRESS_SMALL_CAPACITY];
+	RINGSTRESS_ITEM Items[RINGSTRESS_SMALL_CAPACITY];
+	MESSAGE_RING Ring;
+	ULONG ulLap, ulIndex;
+
+	RingInitialize(&Ring, Cells, RINGSTRESS_SMALL_CAPACITY);
+
+	for (ulLap = 0; ulLap < 3; ulLap++)
+	{
+		if (RingDequeue(&Ring) || RingPeek(&Ring))
+			return 0;
+
+		for (ulIndex = 0; ulIndex < RINGSTRESS_SMALL_CAPACITY; ulIndex++)
+		{
+			if (!RingEnqueue(&Ring, &Items[ulIndex]))
+				return 0;
+		}
+
+		if (RingEnqueue(&Ring, &Items[0]))
+			return 0;
+
+		for (ulIndex = 0; ulIndex < RINGSTRESS_SMALL_CAPACITY; ulIndex++)
+		{
+			if (RingPeekAt(&Ring, Ring.llHead + ulIndex) != &Items[ulIndex])
+				return 0;
+		}
+
+		if (RingPeekAt(&Ring, Ring.llTail))
+			return 0;
+
+		for (ulIndex = 0; ulIndex < RINGSTRESS_SMALL_CAPACITY; ulIndex++)
+		{
+			if (RingPeek(&Ring) != &Items[ulIndex] || RingDequeue(&Ring) != &Items[ulIndex])
+				return 0;
+		}
+
+		//
+		//	Leave part of a lap behind so the next one starts mid ring.
+		//
+		for (ulIndex = 0; ulIndex <= ulLap; ulIndex++)
+		{
+			if (!RingEnqueue(&Ring, &Items[ulIndex]) || RingDequeue(&Ring) != &Items[ulIndex])
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+//
+//	Appends the producer's items in order, waiting while the ring is full.
+//
+static PVOID
+ProducerThread(
+	PVOID pParameter
+)
+{
+	RINGSTRESS_THREAD* pThread = pParameter;
+	PRINGSTRESS_CONTEXT pContext = pThread->pContext;
+	ULONG ulMessages = pContext->pPass->ulMessages;
+	PRINGSTRESS_ITEM pItems = pContext->pItems + (SIZE_T)pThread->ulIndex * ulMessages;
+	ULONG ulIndex;
+
+	for (ulIndex = 0; ulIndex < ulMessages; ulIndex++)
+	{
+		while (!RingEnqueue(&pContext->Ring, &pItems[ulIndex]))
+		{
+			if (ReadNoFence64(&pContext->llAbort))
+				return NULL;
+
+			sched_yield();
+		}
+	}
+
+	InterlockedIncrement64(&pContext->llProducersDone);
+
+	return NULL;
+}
+
+
+//
+//	Takes items until every one was taken. What a consumer gets from one
+//	producer has to be in the order it was appended, the ring hands out
+//	positions in order on both sides.
+//
+static PVOID
+ConsumerThread(
+	PVOID pParameter
+)
+{
+	RINGSTRESS_THREAD* pThread = pParameter;
+	PRINGSTRESS_CONTEXT pContext = pThread->pContext;
+	const RINGSTRESS_PASS* pPass = pContext->pPass;
+	LONG64 llTotal = (LONG64)pPass->ulProducers * pPass->ulMessages;
+	ULONG ulNext[RINGSTRESS_MAX_THREADS] = { 0 };
+	PRINGSTRESS_ITEM pItem;
+
+	while (ReadNoFence64(&pContext->llConsumed) < llTotal && !ReadNoFence64(&pContext->llAbort))
+	{
+		pItem = RingDequeue(&pContext->Ring);
+
+		if (!pItem)
+		{
+			sched_yield();
+			continue;
+		}
+
+		if (pItem->ulIndex < ulNext[pItem->ulProducer] || InterlockedIncrement64(&pItem->llTaken) != 1)
+			InterlockedIncrement64(&pContext->llErrors);
+
+		ulNext[pItem->ulProducer] = pItem->ulIndex + 1;
+
+		InterlockedIncrement64(&pContext->llConsumed);
+	}
+
+	return NULL;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		RunPass
+//
+//	Parameters:
+//		[IN]  const RINGSTRESS_PASS* pPass
+//		Ring size and threads to run with.
+//
+//	Routine Description:
+//		Runs the producers and consumers of a pass to the end, or until
+//		they stall, then checks that every item was taken once and the
+//		ring is empty again.
+//
+//	Return Value:
+//		int.
+//		Non zero if the pass succeeded.
+//
+//***********************************************************************************
+static int
+RunPass(
+	IN  const RINGSTRESS_PASS* pPass
+)
+{
+	RINGSTRESS_CONTEXT Context = { 0 };
+	RINGSTRESS_THREAD Threads[2 * RINGSTRESS_MAX_THREADS];
+	pthread_t hThreads[2 * RINGSTRESS_MAX_THREADS];
+	SIZE_T Total = (SIZE_T)pPass->ulProducers * pPass->ulMessages;
+	ULONG ulThreads = pPass->ulProducers + pPass->ulConsumers;
+	LONG64 llProgress, llLastProgress = -1;
+	PRING_CELL pCells;
+	SIZE_T Index;
+	ULONG ulThread;
+	double Start, LastProgress;
+	int iResult;
+
+	pCells = calloc(pPass->ulCapacity, sizeof(RING_CELL));
+	Context.pItems = calloc(Total, sizeof(RINGSTRESS_ITEM));
+
+	if (!pCells || !Context.pItems)
+	{
+		fprintf(stderr, "%s: out of memory\n", pPass->pszName);
+		free(pCells);
+		free(Context.pItems);
+		return 0;
+	}
+
+	for (Index = 0; Index < Total; Index++)
+	{
+		Context.pItems[Index].ulProducer = (ULONG)(Index / pPass->ulMessages);
+		Context.pItems[Index].ulIndex = (ULONG)(Index % pPass->ulMessages);
+	}
+
+	RingInitialize(&Context.Ring, pCells, pPass->ulCapacity);
+	Context.pPass = pPass;
+
+	Start = Now();
+
+	for (ulThread = 0; ulThread < ulThreads; ulThread++)
+	{
+		Threads[ulThread].pContext = &Context;
+		Threads[ulThread].ulIndex = ulThread < pPass->ulProducers ? ulThread : ulThread - pPass->ulProducers;
+
+		pthread_create(&hThreads[ulThread], NULL, ulThread < pPass->ulProducers ? ProducerThread : ConsumerThread, &Threads[ulThread]);
+	}
+
+	LastProgress = Start;
+
+	while (ReadNoFence64(&Context.llConsumed) < (LONG64)Total ||
+		   ReadNoFence64(&Context.llProducersDone) < pPass->ulProducers)
+	{
+		llProgress = ReadNoFence64(&Context.llConsumed) + ReadNoFence64(&Context.llProducersDone);
+
+		if (llProgress != llLastProgress)
+		{
+			llLastProgress = llProgress;
+			LastProgress = Now();
+		}
+		else if (Now() - LastProgress > RINGSTRESS_STALL_TIMEOUT)
+		{
+			fprintf(stderr, "%s: stalled after %lld messages\n", pPass->pszName, (long long)Context.llConsumed);
+			WriteRelease64(&Context.llAbort, 1);
+			Context.llErrors++;
+			break;
+		}
+
+		usleep(10000);
+	}
+
+	for (ulThread = 0; ulThread < ulThreads; ulThread++)
+		pthread_join(hThreads[ulThread], NULL);
+
+	for (Index = 0; Index < Total; Index++)
+	{
+		if (Context.pItems[Index].llTaken != 1)
+			Context.llErrors++;
+	}
+
+	if (RingDequeue(&Context.Ring))
+		Context.llErrors++;
+
+	printf(
+		"%-8s %5u cells, %u producers, %u consumers: %8.2f M messages/s, %lld errors\n",
+		pPass->pszName,
+		pPass->ulCapacity,
+		pPass->ulProducers,
+		pPass->ulConsumers,
+		(double)Total / (Now() - Start) / 1e6,
+		(long long)Context.llErrors
+	);
+	fflush(stdout);
+
+	iResult = Context.llErrors == 0;
+
+	free(pCells);
+	free(Context.pItems);
+
+	return iResult;
+}
+
+
+int
+main(
+	VOID
+)
+{
+	int iFailed = 0;
+	size_t Pass;
+
+	if (!CheckSequential())
+	{
+		fprintf(stderr, "single threaded checks failed\n");
+		return 1;
+	}
+
+	for (Pass = 0; Pass < sizeof(g_Passes) / sizeof(g_Passes[0]); Pass++)
+		iFailed |= !RunPass(&g_Passes[Pass]);
+
+	printf(iFailed ? "FAILED\n" : "OK\n");
+
+	return iFailed;
+}
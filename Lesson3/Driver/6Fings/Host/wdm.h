@@ -0,0 +1,1861 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	wdm.h																		*
+*																				*
+* Abstract:																		*
+* 	This file stands in for the WDK's wdm.h on Linux, so the driver				*
+* 	builds with GCC unmodified and runs in a user mode process. It				*
+* 	declares the types, constants and kernel routines the driver uses,			*
+* 	maps the interlocked primitives to the GCC atomic builtins with the			*
+* 	same ordering as on x64, and keeps the few routines the WDK inlines			*
+* 	inline here as well. wdmhost.c implements the kernel, iohost.c the			*
+* 	I/O manager.																*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	P R A G M A S.
+/////////////////////////////////////////////////////////////////////
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <assert.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Annotations, they only document the parameters.
+//
+#define IN
+#define OUT
+#define OPTIONAL
+
+//
+//	WCHAR and L"" strings are 16 bits in the driver.
+//
+#if __SIZEOF_WCHAR_T__ != 2
+#error Build with -fshort-wchar.
+#endif
+
+#define VOID	void
+#define CONST	const
+
+#define TRUE	1
+#define FALSE	0
+
+//
+//	Checked in every build, the stress tests are what asserts are for.
+//
+#define ASSERT(e)	assert(e)
+
+#define UNREFERENCED_PARAMETER(p)	((VOID)(p))
+
+//
+//	Nothing is paged out in a user mode process.
+//
+#define PAGED_CODE()	((VOID)0)
+
+//
+//	Nothing raises an exception here either, so the handlers never run.
+//	ProbeForRead and ProbeForWrite assert instead, the tests only pass
+//	buffers they own.
+//
+#define __try		if (1)
+#define __except(e)	else if (0)
+#define __finally	if (1)
+
+#define GetExceptionCode()	STATUS_SUCCESS
+
+#define EXCEPTION_EXECUTE_HANDLER	1
+
+//
+//	Build with -DWDM_HOST_PREEMPT=n to give the processor away after one
+//	load in n on average. A race needs a thread to be preempted between a
+//	load and what it does with the value, which almost never happens on
+//	its own with few processors.
+//
+#if defined(WDM_HOST_PREEMPT)
+#define HOST_PREEMPT_POINT()	HostPreemptPoint()
+#else
+#define HOST_PREEMPT_POINT()	((VOID)0)
+#endif
+
+#define SYSTEM_CACHE_ALIGNMENT_SIZE	64
+#define DECLSPEC_CACHEALIGN			__attribute__((aligned(SYSTEM_CACHE_ALIGNMENT_SIZE)))
+
+#define ANYSIZE_ARRAY	1
+#define PAGE_SIZE		4096
+
+#define FIELD_OFFSET(Type, Field)	((LONG)offsetof(Type, Field))
+#define TYPE_ALIGNMENT(Type)		((LONG)_Alignof(Type))
+#define RTL_NUMBER_OF(Array)		(sizeof(Array) / sizeof((Array)[0]))
+#define CONTAINING_RECORD(Address, Type, Field)	\
+	((Type*)((PCHAR)(Address) - offsetof(Type, Field)))
+
+#define RtlCopyMemory(Destination, Source, Length)	memcpy((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length)			memset((Destination), 0, (Length))
+
+#define RtlInitEmptyUnicodeString(UnicodeString, pBuffer, BufferSize)	\
+	((UnicodeString)->Length = 0,										\
+	 (UnicodeString)->MaximumLength = (USHORT)(BufferSize),				\
+	 (UnicodeString)->Buffer = (pBuffer))
+
+#define MmGetSystemAddressForMdlSafe(pMdl, Priority)						\
+	(((pMdl)->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA) ? (pMdl)->MappedSystemVa :	\
+	 MmMapLockedPagesSpecifyCache((pMdl), KernelMode, MmCached, NULL, FALSE, (Priority)))
+
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#define min(a, b)	(((a) < (b)) ? (a) : (b))
+
+#define MAXUSHORT	0xFFFF
+#define MAXULONG	0xFFFFFFFF
+#define MAXULONG64	0xFFFFFFFFFFFFFFFFULL
+
+#define HandleToULong(h)	((ULONG)(ULONG_PTR)(h))
+#define ULongToHandle(ul)	((HANDLE)(ULONG_PTR)(ul))
+
+#define NT_SUCCESS(Status)	((NTSTATUS)(Status) >= 0)
+#define NT_ERROR(Status)	((ULONG)(Status) >> 30 == 3)
+
+#define STATUS_SUCCESS					((NTSTATUS)0x00000000L)
+#define STATUS_USER_APC					((NTSTATUS)0x000000C0L)
+#define STATUS_ALERTED					((NTSTATUS)0x00000101L)
+#define STATUS_TIMEOUT					((NTSTATUS)0x00000102L)
+#define STATUS_PENDING					((NTSTATUS)0x00000103L)
+#define STATUS_BUFFER_OVERFLOW			((NTSTATUS)0x80000005L)
+#define STATUS_DEVICE_BUSY				((NTSTATUS)0x80000011L)
+#define STATUS_UNSUCCESSFUL				((NTSTATUS)0xC0000001L)
+#define STATUS_ACCESS_VIOLATION			((NTSTATUS)0xC0000005L)
+#define STATUS_INVALID_PARAMETER		((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST	((NTSTATUS)0xC0000010L)
+#define STATUS_ACCESS_DENIED			((NTSTATUS)0xC0000022L)
+#define STATUS_BUFFER_TOO_SMALL			((NTSTATUS)0xC0000023L)
+#define STATUS_OBJECT_NAME_INVALID		((NTSTATUS)0xC0000033L)
+#define STATUS_OBJECT_NAME_NOT_FOUND	((NTSTATUS)0xC0000034L)
+#define STATUS_OBJECT_NAME_COLLISION	((NTSTATUS)0xC0000035L)
+#define STATUS_DATA_ERROR				((NTSTATUS)0xC000003EL)
+#define STATUS_QUOTA_EXCEEDED			((NTSTATUS)0xC0000044L)
+#define STATUS_PRIVILEGE_NOT_HELD		((NTSTATUS)0xC0000061L)
+#define STATUS_INSUFFICIENT_RESOURCES	((NTSTATUS)0xC000009AL)
+#define STATUS_DEVICE_NOT_READY			((NTSTATUS)0xC00000A3L)
+#define STATUS_IO_TIMEOUT				((NTSTATUS)0xC00000B5L)
+#define STATUS_NOT_SUPPORTED			((NTSTATUS)0xC00000BBL)
+#define STATUS_CANCELLED				((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE		((NTSTATUS)0xC0000184L)
+#define STATUS_INVALID_BUFFER_SIZE		((NTSTATUS)0xC0000206L)
+#define STATUS_RETRY					((NTSTATUS)0xC000022DL)
+#define STATUS_NOT_FOUND				((NTSTATUS)0xC0000225L)
+
+#define PASSIVE_LEVEL	0
+#define APC_LEVEL		1
+#define DISPATCH_LEVEL	2
+
+#define POOL_FLAG_UNINITIALIZED		0x0000000000000002ULL
+#define POOL_FLAG_CACHE_ALIGNED		0x0000000000000004ULL
+#define POOL_FLAG_NON_PAGED			0x0000000000000040ULL
+#define POOL_FLAG_PAGED				0x0000000000000100ULL
+
+#define ALL_PROCESSOR_GROUPS	0xFFFF
+
+#define KernelMode	0
+#define UserMode	1
+
+#define SE_INCREASE_QUOTA_PRIVILEGE	5L
+
+#define LOW_PRIORITY			0
+#define LOW_REALTIME_PRIORITY	16
+
+#define THREAD_ALL_ACCESS	0x001FFFFF
+#define OBJ_KERNEL_HANDLE	0x00000200
+
+#define IO_NO_INCREMENT	0
+
+#define IRP_MJ_CREATE			0x00
+#define IRP_MJ_CLOSE			0x02
+#define IRP_MJ_READ				0x03
+#define IRP_MJ_WRITE			0x04
+#define IRP_MJ_DEVICE_CONTROL	0x0E
+#define IRP_MJ_CLEANUP			0x12
+#define IRP_MJ_MAXIMUM_FUNCTION	0x1B
+
+#define SL_PENDING_RETURNED	0x01
+
+#define DO_BUFFERED_IO			0x00000004
+#define DO_DIRECT_IO			0x00000010
+#define DO_DEVICE_INITIALIZING	0x00000080
+
+#define FO_SYNCHRONOUS_IO	0x00000002
+
+#define MDL_MAPPED_TO_SYSTEM_VA		0x0001
+#define MM_ALLOCATE_FULLY_REQUIRED	0x00000004
+#define MdlMappingNoExecute			0x40000000
+
+#define HASH_STRING_ALGORITHM_DEFAULT	0
+#define HASH_STRING_ALGORITHM_X65599	1
+
+#define FILE_DEVICE_UNKNOWN		0x00000022
+#define FILE_DEVICE_SECURE_OPEN	0x00000100
+
+#define METHOD_BUFFERED		0
+#define METHOD_IN_DIRECT	1
+#define METHOD_OUT_DIRECT	2
+#define METHOD_NEITHER		3
+
+#define FILE_ANY_ACCESS		0
+#define FILE_READ_DATA		0x0001
+#define FILE_WRITE_DATA		0x0002
+
+#define CTL_CODE(DeviceType, Function, Method, Access)	\
+	(((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+#define METHOD_FROM_CTL_CODE(ControlCode)	((ULONG)((ControlCode) & 3))
+
+#define InitializeObjectAttributes(p, n, a, r, s)	\
+	((p)->Length = sizeof(OBJECT_ATTRIBUTES),		\
+	 (p)->RootDirectory = (r),						\
+	 (p)->Attributes = (a),							\
+	 (p)->ObjectName = (n),							\
+	 (p)->SecurityDescriptor = (s),					\
+	 (p)->SecurityQualityOfService = NULL)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	LONG is 32 bits on Windows whatever the host's long is.
+//
+typedef void* PVOID;
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef UCHAR BOOLEAN, *PBOOLEAN;
+typedef int16_t SHORT;
+typedef uint16_t USHORT, *PUSHORT;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int64_t LONG64, LONGLONG, *PLONG64;
+typedef uint64_t ULONG64, ULONGLONG, *PULONG64;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR, SIZE_T, *PULONG_PTR, *PSIZE_T;
+typedef const char* PCSTR;
+typedef LONG NTSTATUS;
+typedef uint16_t WCHAR, *PWCH, *PWSTR;
+typedef const WCHAR* PCWSTR;
+typedef PVOID HANDLE, *PHANDLE;
+typedef ULONG ACCESS_MASK;
+typedef LONG KPRIORITY;
+typedef UCHAR KIRQL, *PKIRQL;
+typedef CHAR KPROCESSOR_MODE;
+typedef ULONG_PTR KSPIN_LOCK, *PKSPIN_LOCK;
+typedef LONG EX_SPIN_LOCK, *PEX_SPIN_LOCK;
+typedef ULONG64 POOL_FLAGS;
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef LARGE_INTEGER PHYSICAL_ADDRESS;
+
+typedef struct _LUID
+{
+	ULONG LowPart;
+	LONG HighPart;
+
+} LUID, *PLUID;
+
+typedef struct _LIST_ENTRY
+{
+	struct _LIST_ENTRY* Flink;
+	struct _LIST_ENTRY* Blink;
+
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _UNICODE_STRING
+{
+	USHORT Length;
+	USHORT MaximumLength;
+	PWSTR Buffer;
+
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING* PCUNICODE_STRING;
+
+typedef struct _SINGLE_LIST_ENTRY
+{
+	struct _SINGLE_LIST_ENTRY* Next;
+
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+typedef struct _PROCESSOR_NUMBER
+{
+	USHORT Group;
+	UCHAR Number;
+	UCHAR Reserved;
+
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+//
+//	Same fields as the kernel's, Lock is the spin lock taken.
+//
+typedef struct _KLOCK_QUEUE_HANDLE
+{
+	struct
+	{
+		PVOID Next;
+		PKSPIN_LOCK Lock;
+	} LockQueue;
+	KIRQL OldIrql;
+
+} KLOCK_QUEUE_HANDLE, *PKLOCK_QUEUE_HANDLE;
+
+typedef struct _IO_STATUS_BLOCK
+{
+	union
+	{
+		NTSTATUS Status;
+		PVOID Pointer;
+	};
+	ULONG_PTR Information;
+
+} IO_STATUS_BLOCK, *PIO_STATUS_BLOCK;
+
+//
+//	Enumerations, with the values the WDK gives them.
+//
+typedef enum _POOL_TYPE
+{
+	NonPagedPool = 0,
+	PagedPool = 1,
+	NonPagedPoolNx = 512
+
+} POOL_TYPE;
+
+typedef enum _EVENT_TYPE
+{
+	NotificationEvent,
+	SynchronizationEvent
+
+} EVENT_TYPE;
+
+typedef enum _KWAIT_REASON
+{
+	Executive = 0,
+	UserRequest = 6
+
+} KWAIT_REASON;
+
+typedef enum _WORK_QUEUE_TYPE
+{
+	CriticalWorkQueue,
+	DelayedWorkQueue
+
+} WORK_QUEUE_TYPE;
+
+typedef enum _MEMORY_CACHING_TYPE
+{
+	MmNonCached,
+	MmCached
+
+} MEMORY_CACHING_TYPE;
+
+typedef enum _MM_PAGE_PRIORITY
+{
+	LowPagePriority = 0,
+	NormalPagePriority = 16,
+	HighPagePriority = 32
+
+} MM_PAGE_PRIORITY;
+
+//
+//	Objects only ever handled through pointers, or referenced before
+//	their definition. A thread object is the host thread's state, a
+//	process object stands for its process ID.
+//
+typedef struct _KTHREAD* PKTHREAD, *PETHREAD;
+typedef struct _EPROCESS* PEPROCESS;
+typedef struct _IO_WORKITEM* PIO_WORKITEM;
+typedef struct _IRP* PIRP;
+typedef struct _DEVICE_OBJECT* PDEVICE_OBJECT;
+typedef struct _DRIVER_OBJECT* PDRIVER_OBJECT;
+typedef struct _KDPC* PKDPC;
+typedef struct _LOOKASIDE_LIST_EX* PLOOKASIDE_LIST_EX;
+
+//
+//	Header of the objects a thread waits for, SignalState is guarded by
+//	the dispatcher lock of wdmhost.c.
+//
+typedef struct _DISPATCHER_HEADER
+{
+	LONG Type;
+	volatile LONG SignalState;
+
+} DISPATCHER_HEADER;
+
+typedef struct _KEVENT
+{
+	DISPATCHER_HEADER Header;
+
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+typedef VOID
+KDEFERRED_ROUTINE(
+	IN  PKDPC pDpc,
+	IN OPTIONAL  PVOID pDeferredContext,
+	IN OPTIONAL  PVOID pSystemArgument1,
+	IN OPTIONAL  PVOID pSystemArgument2
+);
+
+typedef KDEFERRED_ROUTINE* PKDEFERRED_ROUTINE;
+
+//
+//	Number is the processor the DPC targets, MAXULONG if it runs where
+//	it is queued. DpcListEntry is in the DPC queue while Inserted is set,
+//	Processor is then where it runs.
+//
+typedef struct _KDPC
+{
+	LIST_ENTRY DpcListEntry;
+	PKDEFERRED_ROUTINE DeferredRoutine;
+	PVOID DeferredContext;
+	PVOID SystemArgument1;
+	PVOID SystemArgument2;
+	ULONG Number;
+	ULONG Processor;
+	BOOLEAN Inserted;
+
+} KDPC, *PRKDPC;
+
+//
+//	DueTime is in interrupt time and Period in milliseconds. The timer is
+//	in the timer list while Inserted is set.
+//
+typedef struct _KTIMER
+{
+	DISPATCHER_HEADER Header;
+	ULONGLONG DueTime;
+	LONG Period;
+	PKDPC Dpc;
+	LIST_ENTRY TimerListEntry;
+	BOOLEAN Inserted;
+
+} KTIMER, *PKTIMER;
+
+//
+//	Count is 1 when the mutex is free, the threads that find it taken
+//	wait for Event.
+//
+typedef struct _FAST_MUTEX
+{
+	volatile LONG Count;
+	PKTHREAD Owner;
+	KEVENT Event;
+	KIRQL OldIrql;
+
+} FAST_MUTEX, *PFAST_MUTEX;
+
+//
+//	Count is twice the references held, plus 1 once the rundown started.
+//
+typedef struct _EX_RUNDOWN_REF
+{
+	volatile ULONG_PTR Count;
+
+} EX_RUNDOWN_REF, *PEX_RUNDOWN_REF;
+
+typedef PVOID
+ALLOCATE_FUNCTION_EX(
+	IN  POOL_TYPE PoolType,
+	IN  SIZE_T NumberOfBytes,
+	IN  ULONG ulTag,
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+);
+
+typedef ALLOCATE_FUNCTION_EX* PALLOCATE_FUNCTION_EX;
+
+typedef VOID
+FREE_FUNCTION_EX(
+	IN  PVOID pBuffer,
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+);
+
+typedef FREE_FUNCTION_EX* PFREE_FUNCTION_EX;
+
+//
+//	ListHead keeps up to Depth freed entries of Size bytes, Count of them.
+//
+typedef struct _LOOKASIDE_LIST_EX
+{
+	KSPIN_LOCK Lock;
+	SINGLE_LIST_ENTRY ListHead;
+	USHORT Depth;
+	USHORT Count;
+	POOL_TYPE Type;
+	ULONG Tag;
+	SIZE_T Size;
+	PALLOCATE_FUNCTION_EX Allocate;
+	PFREE_FUNCTION_EX Free;
+
+} LOOKASIDE_LIST_EX;
+
+//
+//	Memory is never paged out, an MDL describes a buffer that is always
+//	mapped, at MappedSystemVa.
+//
+typedef struct _MDL
+{
+	struct _MDL* Next;
+	SHORT Size;
+	SHORT MdlFlags;
+	PEPROCESS Process;
+	PVOID MappedSystemVa;
+	PVOID StartVa;
+	ULONG ByteCount;
+	ULONG ByteOffset;
+
+} MDL, *PMDL;
+
+//
+//	Process the thread was attached to before KeStackAttachProcess.
+//
+typedef struct _KAPC_STATE
+{
+	PEPROCESS Process;
+
+} KAPC_STATE, *PKAPC_STATE, *PRKAPC_STATE;
+
+typedef struct _OBJECT_ATTRIBUTES
+{
+	ULONG Length;
+	HANDLE RootDirectory;
+	PUNICODE_STRING ObjectName;
+	ULONG Attributes;
+	PVOID SecurityDescriptor;
+	PVOID SecurityQualityOfService;
+
+} OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+
+typedef VOID
+KSTART_ROUTINE(
+	IN  PVOID pStartContext
+);
+
+typedef KSTART_ROUTINE* PKSTART_ROUTINE;
+
+typedef VOID
+IO_WORKITEM_ROUTINE(
+	IN  PDEVICE_OBJECT pDeviceObject,
+	IN OPTIONAL  PVOID pContext
+);
+
+typedef IO_WORKITEM_ROUTINE* PIO_WORKITEM_ROUTINE;
+
+typedef VOID
+DRIVER_CANCEL(
+	IN OUT  PDEVICE_OBJECT pDeviceObject,
+	IN OUT  PIRP pIrp
+);
+
+typedef DRIVER_CANCEL* PDRIVER_CANCEL;
+
+typedef NTSTATUS
+DRIVER_DISPATCH(
+	IN  PDEVICE_OBJECT pDeviceObject,
+	IN OUT  PIRP pIrp
+);
+
+typedef DRIVER_DISPATCH* PDRIVER_DISPATCH;
+
+typedef VOID
+DRIVER_UNLOAD(
+	IN  PDRIVER_OBJECT pDriverObject
+);
+
+typedef DRIVER_UNLOAD* PDRIVER_UNLOAD;
+
+typedef NTSTATUS
+DRIVER_INITIALIZE(
+	IN  PDRIVER_OBJECT pDriverObject,
+	IN  PUNICODE_STRING pRegistryPath
+);
+
+typedef DRIVER_INITIALIZE* PDRIVER_INITIALIZE;
+
+//
+//	The fields of the I/O manager's structures the driver uses, the
+//	host's I/O manager fills them like the kernel's does.
+//
+typedef struct _FILE_OBJECT
+{
+	PDEVICE_OBJECT DeviceObject;
+	PVOID FsContext;
+	PVOID FsContext2;
+	struct _FILE_OBJECT* RelatedFileObject;
+	ULONG Flags;
+	UNICODE_STRING FileName;
+
+} FILE_OBJECT, *PFILE_OBJECT;
+
+typedef struct _IO_STACK_LOCATION
+{
+	UCHAR MajorFunction;
+	UCHAR MinorFunction;
+	UCHAR Flags;
+	UCHAR Control;
+	union
+	{
+		struct
+		{
+			PVOID SecurityContext;
+			ULONG Options;
+			USHORT FileAttributes;
+			USHORT ShareAccess;
+			ULONG EaLength;
+		} Create;
+		struct
+		{
+			ULONG Length;
+			ULONG Key;
+			LARGE_INTEGER ByteOffset;
+		} Read;
+		struct
+		{
+			ULONG Length;
+			ULONG Key;
+			LARGE_INTEGER ByteOffset;
+		} Write;
+		struct
+		{
+			ULONG OutputBufferLength;
+			ULONG InputBufferLength;
+			ULONG IoControlCode;
+			PVOID Type3InputBuffer;
+		} DeviceIoControl;
+	} Parameters;
+	PDEVICE_OBJECT DeviceObject;
+	PFILE_OBJECT FileObject;
+
+} IO_STACK_LOCATION, *PIO_STACK_LOCATION;
+
+//
+//	An IRP has a single stack location, CurrentStackLocation. UserIosb
+//	and UserEvent are where the I/O manager reports the completion.
+//
+typedef struct _IRP
+{
+	PMDL MdlAddress;
+	ULONG Flags;
+	union
+	{
+		struct _IRP* MasterIrp;
+		PVOID SystemBuffer;
+	} AssociatedIrp;
+	IO_STATUS_BLOCK IoStatus;
+	KPROCESSOR_MODE RequestorMode;
+	BOOLEAN PendingReturned;
+	volatile BOOLEAN Cancel;
+	KIRQL CancelIrql;
+	PDRIVER_CANCEL volatile CancelRoutine;
+	PIO_STATUS_BLOCK UserIosb;
+	PKEVENT UserEvent;
+	PVOID UserBuffer;
+	union
+	{
+		struct
+		{
+			LIST_ENTRY ListEntry;
+			PVOID DriverContext[4];
+			PETHREAD Thread;
+			PIO_STACK_LOCATION CurrentStackLocation;
+			PFILE_OBJECT OriginalFileObject;
+		} Overlay;
+	} Tail;
+
+} IRP;
+
+typedef BOOLEAN
+FAST_IO_DEVICE_CONTROL(
+	IN  PFILE_OBJECT pFileObject,
+	IN  BOOLEAN bWait,
+	IN OPTIONAL  PVOID pInputBuffer,
+	IN  ULONG ulInputBufferLength,
+	OUT OPTIONAL  PVOID pOutputBuffer,
+	IN  ULONG ulOutputBufferLength,
+	IN  ULONG ulIoControlCode,
+	OUT  PIO_STATUS_BLOCK pIoStatus,
+	IN  PDEVICE_OBJECT pDeviceObject
+);
+
+typedef FAST_IO_DEVICE_CONTROL* PFAST_IO_DEVICE_CONTROL;
+
+//
+//	The routines ahead of FastIoDeviceControl are never called here.
+//
+typedef struct _FAST_IO_DISPATCH
+{
+	ULONG SizeOfFastIoDispatch;
+	PVOID FastIoCheckIfPossible;
+	PVOID FastIoRead;
+	PVOID FastIoWrite;
+	PVOID FastIoQueryBasicInfo;
+	PVOID FastIoQueryStandardInfo;
+	PVOID FastIoLock;
+	PVOID FastIoUnlockSingle;
+	PVOID FastIoUnlockAll;
+	PVOID FastIoUnlockAllByKey;
+	PFAST_IO_DEVICE_CONTROL FastIoDeviceControl;
+
+} FAST_IO_DISPATCH, *PFAST_IO_DISPATCH;
+
+typedef struct _DRIVER_OBJECT
+{
+	PDEVICE_OBJECT DeviceObject;
+	ULONG Flags;
+	UNICODE_STRING DriverName;
+	PFAST_IO_DISPATCH FastIoDispatch;
+	PDRIVER_INITIALIZE DriverInit;
+	PDRIVER_UNLOAD DriverUnload;
+	PDRIVER_DISPATCH MajorFunction[IRP_MJ_MAXIMUM_FUNCTION + 1];
+
+} DRIVER_OBJECT;
+
+typedef struct _DEVICE_OBJECT
+{
+	PDRIVER_OBJECT DriverObject;
+	PDEVICE_OBJECT NextDevice;
+	ULONG Flags;
+	ULONG Characteristics;
+	ULONG DeviceType;
+	PVOID DeviceExtension;
+
+} DEVICE_OBJECT;
+
+//
+//	Cancel safe queue, only IoCsqInitializeEx sets one up here.
+//
+typedef struct _IO_CSQ IO_CSQ, *PIO_CSQ;
+
+typedef struct _IO_CSQ_IRP_CONTEXT
+{
+	ULONG Type;
+	PIRP Irp;
+	PIO_CSQ Csq;
+
+} IO_CSQ_IRP_CONTEXT, *PIO_CSQ_IRP_CONTEXT;
+
+typedef NTSTATUS
+IO_CSQ_INSERT_IRP_EX(
+	IN  PIO_CSQ pCsq,
+	IN  PIRP pIrp,
+	IN  PVOID pInsertContext
+);
+
+typedef IO_CSQ_INSERT_IRP_EX* PIO_CSQ_INSERT_IRP_EX;
+
+typedef VOID
+IO_CSQ_REMOVE_IRP(
+	IN  PIO_CSQ pCsq,
+	IN  PIRP pIrp
+);
+
+typedef IO_CSQ_REMOVE_IRP* PIO_CSQ_REMOVE_IRP;
+
+typedef PIRP
+IO_CSQ_PEEK_NEXT_IRP(
+	IN  PIO_CSQ pCsq,
+	IN  PIRP pIrp,
+	IN  PVOID pPeekContext
+);
+
+typedef IO_CSQ_PEEK_NEXT_IRP* PIO_CSQ_PEEK_NEXT_IRP;
+
+typedef VOID
+IO_CSQ_ACQUIRE_LOCK(
+	IN  PIO_CSQ pCsq,
+	OUT  PKIRQL pIrql
+);
+
+typedef IO_CSQ_ACQUIRE_LOCK* PIO_CSQ_ACQUIRE_LOCK;
+
+typedef VOID
+IO_CSQ_RELEASE_LOCK(
+	IN  PIO_CSQ pCsq,
+	IN  KIRQL Irql
+);
+
+typedef IO_CSQ_RELEASE_LOCK* PIO_CSQ_RELEASE_LOCK;
+
+typedef VOID
+IO_CSQ_COMPLETE_CANCELED_IRP(
+	IN  PIO_CSQ pCsq,
+	IN  PIRP pIrp
+);
+
+typedef IO_CSQ_COMPLETE_CANCELED_IRP* PIO_CSQ_COMPLETE_CANCELED_IRP;
+
+struct _IO_CSQ
+{
+	ULONG Type;
+	PIO_CSQ_INSERT_IRP_EX CsqInsertIrp;
+	PIO_CSQ_REMOVE_IRP CsqRemoveIrp;
+	PIO_CSQ_PEEK_NEXT_IRP CsqPeekNextIrp;
+	PIO_CSQ_ACQUIRE_LOCK CsqAcquireLock;
+	PIO_CSQ_RELEASE_LOCK CsqReleaseLock;
+	PIO_CSQ_COMPLETE_CANCELED_IRP CsqCompleteCanceledIrp;
+	PVOID ReservePointer;
+};
+
+//
+//	Request of the host's client, see HostReadFile.
+//
+typedef struct _HOST_IO
+{
+	IO_STATUS_BLOCK IoStatus;
+	KEVENT Event;
+
+} HOST_IO, *PHOST_IO;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+#if defined(WDM_HOST_PREEMPT)
+
+//
+//	Yields at random, the state is per thread so threads do not share a line.
+//
+static inline VOID
+HostPreemptPoint(
+	VOID
+)
+{
+	static __thread ULONG64 ullState;
+
+	if (!ullState)
+		ullState = (ULONG64)(ULONG_PTR)&ullState | 1;
+
+	ullState ^= ullState << 13;
+	ullState ^= ullState >> 7;
+	ullState ^= ullState << 17;
+
+	if (ullState % WDM_HOST_PREEMPT == 0)
+		sched_yield();
+}
+
+#endif
+
+
+//
+//	The interlocked operations are full barriers, like the x64 locked
+//	instructions they compile to in the driver.
+//
+static inline LONG
+InterlockedIncrement(
+	IN OUT  volatile LONG* plAddend
+)
+{
+	return __atomic_add_fetch(plAddend, 1, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG
+InterlockedDecrement(
+	IN OUT  volatile LONG* plAddend
+)
+{
+	return __atomic_sub_fetch(plAddend, 1, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG
+InterlockedAdd(
+	IN OUT  volatile LONG* plAddend,
+	IN  LONG lValue
+)
+{
+	return __atomic_add_fetch(plAddend, lValue, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG
+InterlockedExchange(
+	IN OUT  volatile LONG* plTarget,
+	IN  LONG lValue
+)
+{
+	return __atomic_exchange_n(plTarget, lValue, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG64
+InterlockedIncrement64(
+	IN OUT  volatile LONG64* pllAddend
+)
+{
+	return __atomic_add_fetch(pllAddend, 1, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG64
+InterlockedExchange64(
+	IN OUT  volatile LONG64* pllTarget,
+	IN  LONG64 llValue
+)
+{
+	return __atomic_exchange_n(pllTarget, llValue, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG64
+InterlockedAdd64(
+	IN OUT  volatile LONG64* pllAddend,
+	IN  LONG64 llValue
+)
+{
+	return __atomic_add_fetch(pllAddend, llValue, __ATOMIC_SEQ_CST);
+}
+
+
+static inline LONG64
+InterlockedCompareExchange64(
+	IN OUT  volatile LONG64* pllDestination,
+	IN  LONG64 llExchange,
+	IN  LONG64 llComparand
+)
+{
+	__atomic_compare_exchange_n(pllDestination, &llComparand, llExchange, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return llComparand;
+}
+
+
+static inline PVOID
+InterlockedCompareExchangePointer(
+	IN OUT  PVOID volatile* ppDestination,
+	IN  PVOID pExchange,
+	IN  PVOID pComparand
+)
+{
+	__atomic_compare_exchange_n(ppDestination, &pComparand, pExchange, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return pComparand;
+}
+
+
+//
+//	Plain loads and stores are acquire and release on x64, other hosts
+//	need the orderings spelled out.
+//
+static inline LONG
+ReadAcquire(
+	IN  const volatile LONG* plSource
+)
+{
+	LONG lValue = __atomic_load_n(plSource, __ATOMIC_ACQUIRE);
+
+	HOST_PREEMPT_POINT();
+
+	return lValue;
+}
+
+
+static inline LONG
+ReadNoFence(
+	IN  const volatile LONG* plSource
+)
+{
+	LONG lValue = __atomic_load_n(plSource, __ATOMIC_RELAXED);
+
+	HOST_PREEMPT_POINT();
+
+	return lValue;
+}
+
+
+static inline VOID
+WriteRelease(
+	OUT  volatile LONG* plDestination,
+	IN  LONG lValue
+)
+{
+	__atomic_store_n(plDestination, lValue, __ATOMIC_RELEASE);
+}
+
+
+static inline PVOID
+ReadPointerAcquire(
+	IN  PVOID const volatile* ppSource
+)
+{
+	PVOID pValue = __atomic_load_n(ppSource, __ATOMIC_ACQUIRE);
+
+	HOST_PREEMPT_POINT();
+
+	return pValue;
+}
+
+
+static inline LONG64
+ReadAcquire64(
+	IN  const volatile LONG64* pllSource
+)
+{
+	LONG64 llValue = __atomic_load_n(pllSource, __ATOMIC_ACQUIRE);
+
+	HOST_PREEMPT_POINT();
+
+	return llValue;
+}
+
+
+static inline LONG64
+ReadNoFence64(
+	IN  const volatile LONG64* pllSource
+)
+{
+	LONG64 llValue = __atomic_load_n(pllSource, __ATOMIC_RELAXED);
+
+	HOST_PREEMPT_POINT();
+
+	return llValue;
+}
+
+
+static inline VOID
+WriteRelease64(
+	OUT  volatile LONG64* pllDestination,
+	IN  LONG64 llValue
+)
+{
+	__atomic_store_n(pllDestination, llValue, __ATOMIC_RELEASE);
+}
+
+
+static inline VOID
+KeMemoryBarrier(
+	VOID
+)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+static inline VOID
+YieldProcessor(
+	VOID
+)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+
+//
+//	The list routines are inline in the WDK as well.
+//
+static inline VOID
+InitializeListHead(
+	OUT  PLIST_ENTRY pListHead
+)
+{
+	pListHead->Flink = pListHead->Blink = pListHead;
+}
+
+
+static inline BOOLEAN
+IsListEmpty(
+	IN  const LIST_ENTRY* pListHead
+)
+{
+	return pListHead->Flink == pListHead;
+}
+
+
+static inline VOID
+InsertTailList(
+	IN OUT  PLIST_ENTRY pListHead,
+	IN OUT  PLIST_ENTRY pEntry
+)
+{
+	PLIST_ENTRY pBlink = pListHead->Blink;
+
+	pEntry->Flink = pListHead;
+	pEntry->Blink = pBlink;
+	pBlink->Flink = pEntry;
+	pListHead->Blink = pEntry;
+}
+
+
+static inline VOID
+InsertHeadList(
+	IN OUT  PLIST_ENTRY pListHead,
+	IN OUT  PLIST_ENTRY pEntry
+)
+{
+	PLIST_ENTRY pFlink = pListHead->Flink;
+
+	pEntry->Flink = pFlink;
+	pEntry->Blink = pListHead;
+	pFlink->Blink = pEntry;
+	pListHead->Flink = pEntry;
+}
+
+
+static inline BOOLEAN
+RemoveEntryList(
+	IN  PLIST_ENTRY pEntry
+)
+{
+	PLIST_ENTRY pFlink = pEntry->Flink;
+	PLIST_ENTRY pBlink = pEntry->Blink;
+
+	pBlink->Flink = pFlink;
+	pFlink->Blink = pBlink;
+
+	return pFlink == pBlink;
+}
+
+
+static inline PLIST_ENTRY
+RemoveHeadList(
+	IN OUT  PLIST_ENTRY pListHead
+)
+{
+	PLIST_ENTRY pEntry = pListHead->Flink;
+
+	RemoveEntryList(pEntry);
+
+	return pEntry;
+}
+
+
+static inline PLIST_ENTRY
+RemoveTailList(
+	IN OUT  PLIST_ENTRY pListHead
+)
+{
+	PLIST_ENTRY pEntry = pListHead->Blink;
+
+	RemoveEntryList(pEntry);
+
+	return pEntry;
+}
+
+
+static inline VOID
+KeInitializeSpinLock(
+	OUT  PKSPIN_LOCK pSpinLock
+)
+{
+	*pSpinLock = 0;
+}
+
+
+static inline PIO_STACK_LOCATION
+IoGetCurrentIrpStackLocation(
+	IN  PIRP pIrp
+)
+{
+	return pIrp->Tail.Overlay.CurrentStackLocation;
+}
+
+
+static inline PDRIVER_CANCEL
+IoSetCancelRoutine(
+	IN OUT  PIRP pIrp,
+	IN OPTIONAL  PDRIVER_CANCEL pCancelRoutine
+)
+{
+	return __atomic_exchange_n(&pIrp->CancelRoutine, pCancelRoutine, __ATOMIC_SEQ_CST);
+}
+
+
+static inline VOID
+IoMarkIrpPending(
+	IN OUT  PIRP pIrp
+)
+{
+	IoGetCurrentIrpStackLocation(pIrp)->Control |= SL_PENDING_RETURNED;
+}
+
+
+static inline LUID
+RtlConvertLongToLuid(
+	IN  LONG lValue
+)
+{
+	LUID Luid;
+
+	Luid.LowPart = (ULONG)lValue;
+	Luid.HighPart = lValue < 0 ? -1 : 0;
+
+	return Luid;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Kernel routines, implemented by wdmhost.c. A thread raised to
+//	DISPATCH_LEVEL owns the processor it was given by HostSetProcessor
+//	until it lowers again, as if nothing else could run there.
+//
+KIRQL
+KeGetCurrentIrql(
+	VOID
+);
+
+VOID
+KeRaiseIrql(
+	IN  KIRQL NewIrql,
+	OUT  PKIRQL pOldIrql
+);
+
+VOID
+KeLowerIrql(
+	IN  KIRQL NewIrql
+);
+
+VOID
+KeAcquireSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKIRQL pOldIrql
+);
+
+VOID
+KeReleaseSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	IN  KIRQL NewIrql
+);
+
+VOID
+KeAcquireSpinLockAtDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock
+);
+
+VOID
+KeReleaseSpinLockFromDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock
+);
+
+VOID
+KeAcquireInStackQueuedSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKLOCK_QUEUE_HANDLE pLockHandle
+);
+
+VOID
+KeReleaseInStackQueuedSpinLock(
+	IN  PKLOCK_QUEUE_HANDLE pLockHandle
+);
+
+VOID
+KeAcquireInStackQueuedSpinLockAtDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKLOCK_QUEUE_HANDLE pLockHandle
+);
+
+VOID
+KeReleaseInStackQueuedSpinLockFromDpcLevel(
+	IN  PKLOCK_QUEUE_HANDLE pLockHandle
+);
+
+ULONG
+KeGetCurrentProcessorNumberEx(
+	OUT OPTIONAL  PPROCESSOR_NUMBER pProcNumber
+);
+
+ULONG
+KeQueryMaximumProcessorCountEx(
+	IN  USHORT usGroupNumber
+);
+
+ULONG
+KeQueryActiveProcessorCountEx(
+	IN  USHORT usGroupNumber
+);
+
+NTSTATUS
+KeGetProcessorNumberFromIndex(
+	IN  ULONG ulProcIndex,
+	OUT  PPROCESSOR_NUMBER pProcNumber
+);
+
+LARGE_INTEGER
+KeQueryPerformanceCounter(
+	OUT OPTIONAL  PLARGE_INTEGER pPerformanceFrequency
+);
+
+ULONGLONG
+KeQueryInterruptTime(
+	VOID
+);
+
+PKTHREAD
+KeGetCurrentThread(
+	VOID
+);
+
+VOID
+KeQuerySystemTimePrecise(
+	OUT  PLARGE_INTEGER pCurrentTime
+);
+
+KPRIORITY
+KeSetPriorityThread(
+	IN OUT  PKTHREAD pThread,
+	IN  KPRIORITY Priority
+);
+
+VOID
+KeStackAttachProcess(
+	IN OUT  PEPROCESS pProcess,
+	OUT  PRKAPC_STATE pApcState
+);
+
+VOID
+KeUnstackDetachProcess(
+	IN  PRKAPC_STATE pApcState
+);
+
+VOID
+KeInitializeEvent(
+	OUT  PRKEVENT pEvent,
+	IN  EVENT_TYPE Type,
+	IN  BOOLEAN bState
+);
+
+LONG
+KeSetEvent(
+	IN OUT  PRKEVENT pEvent,
+	IN  KPRIORITY Increment,
+	IN  BOOLEAN bWait
+);
+
+VOID
+KeClearEvent(
+	IN OUT  PRKEVENT pEvent
+);
+
+LONG
+KeReadStateEvent(
+	IN  PRKEVENT pEvent
+);
+
+NTSTATUS
+KeWaitForSingleObject(
+	IN  PVOID pObject,
+	IN  KWAIT_REASON WaitReason,
+	IN  KPROCESSOR_MODE WaitMode,
+	IN  BOOLEAN bAlertable,
+	IN OPTIONAL  PLARGE_INTEGER pTimeout
+);
+
+VOID
+KeInitializeTimer(
+	OUT  PKTIMER pTimer
+);
+
+BOOLEAN
+KeSetTimer(
+	IN OUT  PKTIMER pTimer,
+	IN  LARGE_INTEGER DueTime,
+	IN OPTIONAL  PKDPC pDpc
+);
+
+BOOLEAN
+KeSetCoalescableTimer(
+	IN OUT  PKTIMER pTimer,
+	IN  LARGE_INTEGER DueTime,
+	IN  ULONG ulPeriod,
+	IN  ULONG ulTolerableDelay,
+	IN OPTIONAL  PKDPC pDpc
+);
+
+BOOLEAN
+KeCancelTimer(
+	IN OUT  PKTIMER pTimer
+);
+
+VOID
+KeInitializeDpc(
+	OUT  PRKDPC pDpc,
+	IN  PKDEFERRED_ROUTINE pDeferredRoutine,
+	IN OPTIONAL  PVOID pDeferredContext
+);
+
+NTSTATUS
+KeSetTargetProcessorDpcEx(
+	IN OUT  PKDPC pDpc,
+	IN  PPROCESSOR_NUMBER pProcNumber
+);
+
+BOOLEAN
+KeInsertQueueDpc(
+	IN OUT  PRKDPC pDpc,
+	IN OPTIONAL  PVOID pSystemArgument1,
+	IN OPTIONAL  PVOID pSystemArgument2
+);
+
+VOID
+KeFlushQueuedDpcs(
+	VOID
+);
+
+PVOID
+ExAllocatePool2(
+	IN  POOL_FLAGS Flags,
+	IN  SIZE_T NumberOfBytes,
+	IN  ULONG ulTag
+);
+
+VOID
+ExFreePoolWithTag(
+	IN  PVOID pBuffer,
+	IN  ULONG ulTag
+);
+
+VOID
+ExFreePool(
+	IN  PVOID pBuffer
+);
+
+KPROCESSOR_MODE
+ExGetPreviousMode(
+	VOID
+);
+
+VOID
+ExInitializeFastMutex(
+	OUT  PFAST_MUTEX pFastMutex
+);
+
+VOID
+ExAcquireFastMutex(
+	IN OUT  PFAST_MUTEX pFastMutex
+);
+
+VOID
+ExReleaseFastMutex(
+	IN OUT  PFAST_MUTEX pFastMutex
+);
+
+VOID
+ExInitializeRundownProtection(
+	OUT  PEX_RUNDOWN_REF pRunRef
+);
+
+BOOLEAN
+ExAcquireRundownProtection(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+);
+
+VOID
+ExReleaseRundownProtection(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+);
+
+VOID
+ExWaitForRundownProtectionRelease(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+);
+
+KIRQL
+ExAcquireSpinLockShared(
+	IN OUT  PEX_SPIN_LOCK pSpinLock
+);
+
+VOID
+ExReleaseSpinLockShared(
+	IN OUT  PEX_SPIN_LOCK pSpinLock,
+	IN  KIRQL OldIrql
+);
+
+KIRQL
+ExAcquireSpinLockExclusive(
+	IN OUT  PEX_SPIN_LOCK pSpinLock
+);
+
+VOID
+ExReleaseSpinLockExclusive(
+	IN OUT  PEX_SPIN_LOCK pSpinLock,
+	IN  KIRQL OldIrql
+);
+
+NTSTATUS
+ExInitializeLookasideListEx(
+	OUT  PLOOKASIDE_LIST_EX pLookaside,
+	IN OPTIONAL  PALLOCATE_FUNCTION_EX pAllocate,
+	IN OPTIONAL  PFREE_FUNCTION_EX pFree,
+	IN  POOL_TYPE PoolType,
+	IN  ULONG ulFlags,
+	IN  SIZE_T Size,
+	IN  ULONG ulTag,
+	IN  USHORT usDepth
+);
+
+VOID
+ExDeleteLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+);
+
+PVOID
+ExAllocateFromLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+);
+
+VOID
+ExFreeToLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside,
+	IN  PVOID pEntry
+);
+
+VOID
+ProbeForRead(
+	IN  const volatile VOID* pAddress,
+	IN  SIZE_T Length,
+	IN  ULONG ulAlignment
+);
+
+VOID
+ProbeForWrite(
+	IN OUT  volatile VOID* pAddress,
+	IN  SIZE_T Length,
+	IN  ULONG ulAlignment
+);
+
+HANDLE
+PsGetCurrentProcessId(
+	VOID
+);
+
+PEPROCESS
+PsGetCurrentProcess(
+	VOID
+);
+
+HANDLE
+PsGetCurrentThreadId(
+	VOID
+);
+
+NTSTATUS
+PsCreateSystemThread(
+	OUT  PHANDLE pThreadHandle,
+	IN  ULONG ulDesiredAccess,
+	IN OPTIONAL  POBJECT_ATTRIBUTES pObjectAttributes,
+	IN OPTIONAL  HANDLE hProcess,
+	OUT OPTIONAL  PVOID pClientId,
+	IN  PKSTART_ROUTINE pStartRoutine,
+	IN OPTIONAL  PVOID pStartContext
+);
+
+NTSTATUS
+PsTerminateSystemThread(
+	IN  NTSTATUS ExitStatus
+);
+
+VOID
+ObReferenceObject(
+	IN  PVOID pObject
+);
+
+VOID
+ObDereferenceObject(
+	IN  PVOID pObject
+);
+
+NTSTATUS
+ZwClose(
+	IN  HANDLE Handle
+);
+
+NTSTATUS
+ZwWaitForSingleObject(
+	IN  HANDLE Handle,
+	IN  BOOLEAN bAlertable,
+	IN OPTIONAL  PLARGE_INTEGER pTimeout
+);
+
+PKEVENT
+IoCreateNotificationEvent(
+	IN  PUNICODE_STRING pEventName,
+	OUT  PHANDLE pEventHandle
+);
+
+BOOLEAN
+SeSinglePrivilegeCheck(
+	IN  LUID PrivilegeValue,
+	IN  KPROCESSOR_MODE PreviousMode
+);
+
+VOID
+RtlInitUnicodeString(
+	OUT  PUNICODE_STRING pDestinationString,
+	IN OPTIONAL  PCWSTR pszSourceString
+);
+
+VOID
+RtlCopyUnicodeString(
+	IN OUT  PUNICODE_STRING pDestinationString,
+	IN OPTIONAL  PCUNICODE_STRING pSourceString
+);
+
+BOOLEAN
+RtlEqualUnicodeString(
+	IN  PCUNICODE_STRING pString1,
+	IN  PCUNICODE_STRING pString2,
+	IN  BOOLEAN bCaseInSensitive
+);
+
+NTSTATUS
+RtlHashUnicodeString(
+	IN  PCUNICODE_STRING pString,
+	IN  BOOLEAN bCaseInSensitive,
+	IN  ULONG ulHashAlgorithm,
+	OUT  PULONG pulHashValue
+);
+
+ULONG
+DbgPrint(
+	IN  PCSTR pszFormat,
+	...
+);
+
+//
+//	I/O and memory manager routines, implemented by iohost.c.
+//
+NTSTATUS
+IoCreateDevice(
+	IN  PDRIVER_OBJECT pDriverObject,
+	IN  ULONG ulDeviceExtensionSize,
+	IN OPTIONAL  PUNICODE_STRING pDeviceName,
+	IN  ULONG ulDeviceType,
+	IN  ULONG ulDeviceCharacteristics,
+	IN  BOOLEAN bExclusive,
+	OUT  PDEVICE_OBJECT* ppDeviceObject
+);
+
+VOID
+IoDeleteDevice(
+	IN  PDEVICE_OBJECT pDeviceObject
+);
+
+NTSTATUS
+IoCreateSymbolicLink(
+	IN  PUNICODE_STRING pSymbolicLinkName,
+	IN  PUNICODE_STRING pDeviceName
+);
+
+NTSTATUS
+IoDeleteSymbolicLink(
+	IN  PUNICODE_STRING pSymbolicLinkName
+);
+
+VOID
+IoCompleteRequest(
+	IN  PIRP pIrp,
+	IN  CHAR PriorityBoost
+);
+
+PIO_WORKITEM
+IoAllocateWorkItem(
+	IN  PDEVICE_OBJECT pDeviceObject
+);
+
+VOID
+IoFreeWorkItem(
+	IN  PIO_WORKITEM pIoWorkItem
+);
+
+VOID
+IoQueueWorkItem(
+	IN OUT  PIO_WORKITEM pIoWorkItem,
+	IN  PIO_WORKITEM_ROUTINE pWorkerRoutine,
+	IN  WORK_QUEUE_TYPE QueueType,
+	IN OPTIONAL  PVOID pContext
+);
+
+NTSTATUS
+IoCsqInitializeEx(
+	OUT  PIO_CSQ pCsq,
+	IN  PIO_CSQ_INSERT_IRP_EX pCsqInsertIrp,
+	IN  PIO_CSQ_REMOVE_IRP pCsqRemoveIrp,
+	IN  PIO_CSQ_PEEK_NEXT_IRP pCsqPeekNextIrp,
+	IN  PIO_CSQ_ACQUIRE_LOCK pCsqAcquireLock,
+	IN  PIO_CSQ_RELEASE_LOCK pCsqReleaseLock,
+	IN  PIO_CSQ_COMPLETE_CANCELED_IRP pCsqCompleteCanceledIrp
+);
+
+NTSTATUS
+IoCsqInsertIrpEx(
+	IN OUT  PIO_CSQ pCsq,
+	IN OUT  PIRP pIrp,
+	OUT OPTIONAL  PIO_CSQ_IRP_CONTEXT pContext,
+	IN OPTIONAL  PVOID pInsertContext
+);
+
+PIRP
+IoCsqRemoveNextIrp(
+	IN OUT  PIO_CSQ pCsq,
+	IN OPTIONAL  PVOID pPeekContext
+);
+
+PMDL
+MmAllocatePagesForMdlEx(
+	IN  PHYSICAL_ADDRESS LowAddress,
+	IN  PHYSICAL_ADDRESS HighAddress,
+	IN  PHYSICAL_ADDRESS SkipBytes,
+	IN  SIZE_T TotalBytes,
+	IN  MEMORY_CACHING_TYPE CacheType,
+	IN  ULONG ulFlags
+);
+
+VOID
+MmFreePagesFromMdl(
+	IN OUT  PMDL pMdl
+);
+
+PVOID
+MmMapLockedPagesSpecifyCache(
+	IN OUT  PMDL pMdl,
+	IN  KPROCESSOR_MODE AccessMode,
+	IN  MEMORY_CACHING_TYPE CacheType,
+	IN OPTIONAL  PVOID pRequestedAddress,
+	IN  ULONG ulBugCheckOnFailure,
+	IN  ULONG ulPriority
+);
+
+VOID
+MmUnmapLockedPages(
+	IN  PVOID pBaseAddress,
+	IN OUT  PMDL pMdl
+);
+
+//
+//	What the host sets up in place of the kernel. The machine has one
+//	processor until HostSetProcessorCount, a new thread runs on processor
+//	0 of process 1 until it says otherwise.
+//
+VOID
+HostSetProcessorCount(
+	IN  ULONG ulCount
+);
+
+VOID
+HostSetProcessor(
+	IN  ULONG ulProcessor
+);
+
+VOID
+HostSetProcess(
+	IN  ULONG ulProcessId
+);
+
+LONG64
+HostPoolAllocations(
+	VOID
+);
+
+//
+//	DbgPrint output is dropped unless asked for.
+//
+VOID
+HostSetDebugPrint(
+	IN  BOOLEAN bEnable
+);
+
+//
+//	What a client does through Win32, implemented by iohost.c. Paths are
+//	CreateFile's, \\.\<symbolic link>[\<file name>]. The requests of a
+//	file opened without bOverlapped return once complete, an overlapped
+//	file returns STATUS_PENDING for those the driver pended and HostWaitIo
+//	waits for them. pIo is the OVERLAPPED, IoStatus is set on completion.
+//
+NTSTATUS
+HostLoadDriver(
+	IN  PDRIVER_INITIALIZE pDriverEntry
+);
+
+VOID
+HostUnloadDriver(
+	VOID
+);
+
+NTSTATUS
+HostCreateFile(
+	IN  PCWSTR pszPath,
+	IN  BOOLEAN bOverlapped,
+	OUT  PFILE_OBJECT* ppFileObject
+);
+
+VOID
+HostCloseFile(
+	IN  PFILE_OBJECT pFileObject
+);
+
+NTSTATUS
+HostReadFile(
+	IN  PFILE_OBJECT pFileObject,
+	OUT  PVOID pBuffer,
+	IN  ULONG ulLength,
+	OUT  PHOST_IO pIo
+);
+
+NTSTATUS
+HostWriteFile(
+	IN  PFILE_OBJECT pFileObject,
+	IN  const VOID* pBuffer,
+	IN  ULONG ulLength,
+	OUT  PHOST_IO pIo
+);
+
+NTSTATUS
+HostDeviceIoControl(
+	IN  PFILE_OBJECT pFileObject,
+	IN  ULONG ulIoControlCode,
+	IN OPTIONAL  PVOID pInputBuffer,
+	IN  ULONG ulInputBufferLength,
+	OUT OPTIONAL  PVOID pOutputBuffer,
+	IN  ULONG ulOutputBufferLength,
+	OUT  PHOST_IO pIo
+);
+
+NTSTATUS
+HostWaitIo(
+	IN  PHOST_IO pIo,
+	IN  ULONG ulMilliseconds
+);
+
+VOID
+HostCancelIo(
+	IN  PFILE_OBJECT pFileObject
+);
+
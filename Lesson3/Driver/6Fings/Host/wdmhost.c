@@ -0,0 +1,1960 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	wdmhost.c																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the kernel routines wdm.h declares, on top				*
+* 	of a Linux process. Threads stand for the processors they were				*
+* 	given, IRQL is kept per thread and raising it to DISPATCH_LEVEL				*
+* 	takes the processor so that no other thread runs there until it				*
+* 	is lowered, which is what per processor data relies on. One clock			*
+* 	thread expires the timers and runs the DPCs, each on its processor.			*
+* 	Waits, events and thread objects share a single dispatcher lock.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ntddk.h>
+#include <ntstrsafe.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Most processors HostSetProcessorCount takes.
+//
+#define HOST_MAX_PROCESSORS	64
+
+//
+//	Process of the system threads, as on Windows.
+//
+#define HOST_SYSTEM_PROCESS_ID	4
+
+//
+//	Freed entries a lookaside list keeps.
+//
+#define HOST_LOOKASIDE_DEPTH	32
+
+//
+//	Longest format RtlStringCbPrintfExA and DbgPrint translate.
+//
+#define HOST_FORMAT_SIZE	512
+
+//
+//	Bit of an EX_SPIN_LOCK held exclusive, the rest counts the sharers.
+//
+#define HOST_EX_SPIN_LOCK_EXCLUSIVE	0x80000000
+
+//
+//	100 ns intervals from 1 January 1601, the start of system time, to
+//	1 January 1970.
+//
+#define HOST_SYSTEM_TIME_EPOCH	116444736000000000LL
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Object a handle refers to, a system thread or a named event. Header
+//	is signaled when a thread exits, an event object is Header itself.
+//	The object is freed with its last reference.
+//
+typedef struct _HOST_OBJECT
+{
+	DISPATCHER_HEADER Header;
+	LONG lReferences;
+	PKSTART_ROUTINE pStartRoutine;
+	PVOID pStartContext;
+	LIST_ENTRY NamedEventEntry;
+	UNICODE_STRING usName;
+
+} HOST_OBJECT, *PHOST_OBJECT;
+
+//
+//	State of the emulated machine. ProcessorLocks[n] is held by the
+//	thread running at DISPATCH_LEVEL on processor n. DispatcherLock
+//	guards the signal states, the timer and DPC lists and the named
+//	events, DispatcherCondition is broadcast whenever one changes.
+//	bDpcActive is set while the clock thread runs a DPC.
+//
+typedef struct _HOST_STATE
+{
+	ULONG ulProcessorCount;
+	KSPIN_LOCK ProcessorLocks[HOST_MAX_PROCESSORS];
+	volatile LONG64 llPoolAllocations;
+	volatile LONG lLastThreadId;
+	BOOLEAN bDebugPrint;
+	pthread_mutex_t DispatcherLock;
+	pthread_cond_t DispatcherCondition;
+	LIST_ENTRY TimerList;
+	LIST_ENTRY DpcList;
+	BOOLEAN bDpcActive;
+	LIST_ENTRY NamedEvents;
+
+} HOST_STATE;
+
+//
+//	State of a thread, its address stands for the thread object. The
+//	thread ID is given on first use. pObject is the object of a system
+//	thread.
+//
+typedef struct _HOST_THREAD
+{
+	KIRQL Irql;
+	ULONG ulProcessor;
+	ULONG ulProcessId;
+	ULONG ulThreadId;
+	KPROCESSOR_MODE PreviousMode;
+	KPRIORITY Priority;
+	PHOST_OBJECT pObject;
+
+} HOST_THREAD;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+static HOST_STATE g_Host = { .ulProcessorCount = 1, .DispatcherLock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t g_DispatcherOnce = PTHREAD_ONCE_INIT;
+
+static __thread HOST_THREAD g_Thread = { PASSIVE_LEVEL, 0, 1, 0, UserMode, 8, NULL };
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Unlike in the kernel the holder of a lock can be preempted, waiters
+//	give the processor away rather than spin on it.
+//
+static VOID
+AcquireLock(
+	IN OUT  PKSPIN_LOCK pLock
+)
+{
+	while (__atomic_exchange_n(pLock, 1, __ATOMIC_ACQUIRE))
+	{
+		while (__atomic_load_n(pLock, __ATOMIC_RELAXED))
+			sched_yield();
+	}
+}
+
+
+static VOID
+ReleaseLock(
+	IN OUT  PKSPIN_LOCK pLock
+)
+{
+	ASSERT(*pLock);
+
+	__atomic_store_n(pLock, 0, __ATOMIC_RELEASE);
+}
+
+
+//
+//	Nanoseconds of the monotonic clock.
+//
+static ULONG64
+MonotonicTime(
+	VOID
+)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+
+	return (ULONG64)Time.tv_sec * 1000000000ULL + (ULONG64)Time.tv_nsec;
+}
+
+
+//
+//	System time, 100 ns intervals from 1601.
+//
+static LONGLONG
+SystemTime(
+	VOID
+)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_REALTIME, &Time);
+
+	return HOST_SYSTEM_TIME_EPOCH + (LONGLONG)Time.tv_sec * 10000000LL + Time.tv_nsec / 100;
+}
+
+
+//
+//	Interrupt time a timeout or due time ends at. Negative values are
+//	relative, positive ones are in system time.
+//
+static ULONG64
+TimeoutToInterruptTime(
+	IN  LONGLONG llTimeout
+)
+{
+	ULONG64 ullNow = MonotonicTime() / 100;
+
+	if (llTimeout <= 0)
+		return ullNow + (ULONG64)-llTimeout;
+
+	llTimeout -= SystemTime();
+
+	return ullNow + (llTimeout > 0 ? (ULONG64)llTimeout : 0);
+}
+
+
+//
+//	Waits on the dispatcher condition until ullInterruptTime at most,
+//	the dispatcher lock is held.
+//
+static VOID
+WaitForDispatcher(
+	IN  ULONG64 ullInterruptTime
+)
+{
+	struct timespec Time;
+
+	if (ullInterruptTime == MAXULONG64)
+	{
+		pthread_cond_wait(&g_Host.DispatcherCondition, &g_Host.DispatcherLock);
+		return;
+	}
+
+	Time.tv_sec = (time_t)(ullInterruptTime / 10000000);
+	Time.tv_nsec = (long)(ullInterruptTime % 10000000) * 100;
+
+	pthread_cond_timedwait(&g_Host.DispatcherCondition, &g_Host.DispatcherLock, &Time);
+}
+
+
+//
+//	Queues the DPC to run on its target processor or ulProcessor, the
+//	dispatcher lock is held. FALSE if it was queued already.
+//
+static BOOLEAN
+QueueDpc(
+	IN OUT  PKDPC pDpc,
+	IN  PVOID pSystemArgument1,
+	IN  PVOID pSystemArgument2,
+	IN  ULONG ulProcessor
+)
+{
+	if (pDpc->Inserted)
+		return FALSE;
+
+	pDpc->SystemArgument1 = pSystemArgument1;
+	pDpc->SystemArgument2 = pSystemArgument2;
+	pDpc->Processor = pDpc->Number != MAXULONG ? pDpc->Number : ulProcessor;
+	pDpc->Inserted = TRUE;
+
+	InsertTailList(&g_Host.DpcList, &pDpc->DpcListEntry);
+	pthread_cond_broadcast(&g_Host.DispatcherCondition);
+
+	return TRUE;
+}
+
+
+//
+//	Signals the timers that are due and queues their DPCs on processor 0,
+//	the dispatcher lock is held. Returns when the next timer is due.
+//
+static ULONG64
+ExpireTimers(
+	VOID
+)
+{
+	ULONG64 ullNow = MonotonicTime() / 100;
+	ULONG64 ullNext = MAXULONG64;
+	PLIST_ENTRY pEntry, pNext;
+	PKTIMER pTimer;
+
+	for (pEntry = g_Host.TimerList.Flink; pEntry != &g_Host.TimerList; pEntry = pNext)
+	{
+		pNext = pEntry->Flink;
+		pTimer = CONTAINING_RECORD(pEntry, KTIMER, TimerListEntry);
+
+		if (pTimer->DueTime > ullNow)
+		{
+			ullNext = min(ullNext, pTimer->DueTime);
+			continue;
+		}
+
+		RemoveEntryList(&pTimer->TimerListEntry);
+		pTimer->Inserted = FALSE;
+		pTimer->Header.SignalState = 1;
+
+		//
+		//	A periodic timer is due again a period after it was due, unless
+		//	that already passed too. At the head it is not met again here.
+		//
+		if (pTimer->Period)
+		{
+			pTimer->DueTime += (ULONG64)pTimer->Period * 10000;
+
+			if (pTimer->DueTime <= ullNow)
+				pTimer->DueTime = ullNow + (ULONG64)pTimer->Period * 10000;
+
+			pTimer->Inserted = TRUE;
+			InsertHeadList(&g_Host.TimerList, &pTimer->TimerListEntry);
+			ullNext = min(ullNext, pTimer->DueTime);
+		}
+
+		if (pTimer->Dpc)
+			QueueDpc(pTimer->Dpc, NULL, NULL, 0);
+
+		pthread_cond_broadcast(&g_Host.DispatcherCondition);
+	}
+
+	return ullNext;
+}
+
+
+//
+//	Expires the timers and runs the queued DPCs one at a time, each at
+//	DISPATCH_LEVEL on its processor.
+//
+static PVOID
+ClockThread(
+	IN  PVOID pParameter
+)
+{
+	ULONG64 ullNext;
+	PKDPC pDpc;
+	KDPC Dpc;
+	KIRQL OldIrql;
+
+	UNREFERENCED_PARAMETER(pParameter);
+
+	g_Thread.ulProcessId = HOST_SYSTEM_PROCESS_ID;
+	g_Thread.PreviousMode = KernelMode;
+
+	pthread_mutex_lock(&g_Host.DispatcherLock);
+
+	for (;;)
+	{
+		ullNext = ExpireTimers();
+
+		if (IsListEmpty(&g_Host.DpcList))
+		{
+			WaitForDispatcher(ullNext);
+			continue;
+		}
+
+		pDpc = CONTAINING_RECORD(RemoveHeadList(&g_Host.DpcList), KDPC, DpcListEntry);
+		pDpc->Inserted = FALSE;
+
+		//
+		//	Out of the queue the DPC can be queued again, or be gone once
+		//	its routine signaled whoever waits for it.
+		//
+		Dpc = *pDpc;
+		g_Host.bDpcActive = TRUE;
+
+		pthread_mutex_unlock(&g_Host.DispatcherLock);
+
+		g_Thread.ulProcessor = Dpc.Processor;
+
+		KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+		Dpc.DeferredRoutine(pDpc, Dpc.DeferredContext, Dpc.SystemArgument1, Dpc.SystemArgument2);
+		KeLowerIrql(OldIrql);
+
+		pthread_mutex_lock(&g_Host.DispatcherLock);
+
+		g_Host.bDpcActive = FALSE;
+		pthread_cond_broadcast(&g_Host.DispatcherCondition);
+	}
+
+	return NULL;
+}
+
+
+//
+//	Creates a named notification event with one reference, the
+//	dispatcher lock is held. NULL if there is not enough memory.
+//
+static PHOST_OBJECT
+CreateNamedEvent(
+	IN  PCUNICODE_STRING pusName,
+	IN  BOOLEAN bState
+)
+{
+	PHOST_OBJECT pObject;
+
+	pObject = calloc(1, sizeof(HOST_OBJECT) + pusName->Length);
+
+	if (!pObject)
+		return NULL;
+
+	pObject->Header.Type = NotificationEvent;
+	pObject->Header.SignalState = bState;
+	pObject->lReferences = 1;
+
+	pObject->usName.Buffer = (PWSTR)(pObject + 1);
+	pObject->usName.Length = pusName->Length;
+	pObject->usName.MaximumLength = pusName->Length;
+	RtlCopyMemory(pObject->usName.Buffer, pusName->Buffer, pusName->Length);
+
+	InsertTailList(&g_Host.NamedEvents, &pObject->NamedEventEntry);
+
+	return pObject;
+}
+
+
+//
+//	Sets up the dispatcher on first use. The memory condition events the
+//	kernel keeps always exist, memory is never low here.
+//
+static VOID
+InitializeDispatcher(
+	VOID
+)
+{
+	static const PCWSTR ConditionNames[] =
+	{
+		L"\\KernelObjects\\LowMemoryCondition",
+		L"\\KernelObjects\\HighMemoryCondition",
+		L"\\KernelObjects\\LowNonPagedPoolCondition",
+		L"\\KernelObjects\\HighNonPagedPoolCondition"
+	};
+	pthread_condattr_t Attributes;
+	pthread_t Thread;
+	UNICODE_STRING usName;
+	ULONG ulIndex;
+
+	pthread_condattr_init(&Attributes);
+	pthread_condattr_setclock(&Attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&g_Host.DispatcherCondition, &Attributes);
+	pthread_condattr_destroy(&Attributes);
+
+	InitializeListHead(&g_Host.TimerList);
+	InitializeListHead(&g_Host.DpcList);
+	InitializeListHead(&g_Host.NamedEvents);
+
+	for (ulIndex = 0; ulIndex < sizeof(ConditionNames) / sizeof(ConditionNames[0]); ulIndex++)
+	{
+		RtlInitUnicodeString(&usName, ConditionNames[ulIndex]);
+
+		if (!CreateNamedEvent(&usName, FALSE))
+			abort();
+	}
+
+	if (pthread_create(&Thread, NULL, ClockThread, NULL))
+		abort();
+
+	pthread_detach(Thread);
+}
+
+
+static VOID
+LockDispatcher(
+	VOID
+)
+{
+	pthread_once(&g_DispatcherOnce, InitializeDispatcher);
+	pthread_mutex_lock(&g_Host.DispatcherLock);
+}
+
+
+static VOID
+UnlockDispatcher(
+	VOID
+)
+{
+	pthread_mutex_unlock(&g_Host.DispatcherLock);
+}
+
+
+//
+//	Waits until the object is signaled or ullInterruptTime passes, the
+//	dispatcher lock is held. A synchronization event is reset for the
+//	one waiter it lets through.
+//
+static NTSTATUS
+WaitForObject(
+	IN OUT  DISPATCHER_HEADER* pHeader,
+	IN  ULONG64 ullInterruptTime
+)
+{
+	for (;;)
+	{
+		if (pHeader->SignalState > 0)
+		{
+			if (pHeader->Type == SynchronizationEvent)
+				pHeader->SignalState = 0;
+
+			return STATUS_SUCCESS;
+		}
+
+		if (ullInterruptTime != MAXULONG64 && MonotonicTime() / 100 >= ullInterruptTime)
+			return STATUS_TIMEOUT;
+
+		WaitForDispatcher(ullInterruptTime);
+	}
+}
+
+
+//
+//	Drops a reference to the object of a handle, freeing it with the last.
+//
+static VOID
+DereferenceObject(
+	IN OUT  PHOST_OBJECT pObject
+)
+{
+	BOOLEAN bDelete;
+
+	LockDispatcher();
+
+	bDelete = --pObject->lReferences == 0;
+
+	if (bDelete && pObject->usName.Buffer)
+		RemoveEntryList(&pObject->NamedEventEntry);
+
+	UnlockDispatcher();
+
+	if (bDelete)
+		free(pObject);
+}
+
+
+//
+//	Starts a system thread in the system process, which ends it once its
+//	routine returns if the routine did not.
+//
+static PVOID
+SystemThreadStart(
+	IN  PVOID pParameter
+)
+{
+	PHOST_OBJECT pObject = pParameter;
+
+	g_Thread.ulProcessId = HOST_SYSTEM_PROCESS_ID;
+	g_Thread.PreviousMode = KernelMode;
+	g_Thread.pObject = pObject;
+
+	pObject->pStartRoutine(pObject->pStartContext);
+
+	PsTerminateSystemThread(STATUS_SUCCESS);
+
+	return NULL;
+}
+
+
+//
+//	Lookaside allocator of a list given none.
+//
+static PVOID
+LookasideAllocate(
+	IN  POOL_TYPE PoolType,
+	IN  SIZE_T NumberOfBytes,
+	IN  ULONG ulTag,
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+	UNREFERENCED_PARAMETER(PoolType);
+	UNREFERENCED_PARAMETER(pLookaside);
+
+	return ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED, NumberOfBytes, ulTag);
+}
+
+
+static VOID
+LookasideFree(
+	IN  PVOID pBuffer,
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+	ExFreePoolWithTag(pBuffer, pLookaside->Tag);
+}
+
+
+//
+//	Only ASCII letters have a case here.
+//
+static WCHAR
+UpcaseChar(
+	IN  WCHAR Char
+)
+{
+	return Char >= L'a' && Char <= L'z' ? (WCHAR)(Char - L'a' + L'A') : Char;
+}
+
+
+//
+//	Rewrites a kernel format for the C library. %I64 becomes %ll, %I
+//	becomes %z and %l is dropped since LONG is 32 bits.
+//
+static VOID
+TranslateFormat(
+	IN  PCSTR pszFormat,
+	OUT  CHAR szTranslated[HOST_FORMAT_SIZE]
+)
+{
+	SIZE_T Length = 0;
+
+	while (*pszFormat)
+	{
+		ASSERT(Length + 4 < HOST_FORMAT_SIZE);
+
+		if (*pszFormat != '%')
+		{
+			szTranslated[Length++] = *pszFormat++;
+			continue;
+		}
+
+		szTranslated[Length++] = *pszFormat++;
+
+		while (*pszFormat && strchr("-+ #0123456789.*", *pszFormat))
+			szTranslated[Length++] = *pszFormat++;
+
+		if (!strncmp(pszFormat, "I64", 3) || !strncmp(pszFormat, "ll", 2))
+		{
+			szTranslated[Length++] = 'l';
+			szTranslated[Length++] = 'l';
+			pszFormat += *pszFormat == 'I' ? 3 : 2;
+		}
+		else if (!strncmp(pszFormat, "I32", 3))
+			pszFormat += 3;
+		else if (*pszFormat == 'I')
+		{
+			szTranslated[Length++] = 'z';
+			pszFormat++;
+		}
+		else if (*pszFormat == 'l')
+			pszFormat++;
+
+		if (*pszFormat)
+			szTranslated[Length++] = *pszFormat++;
+	}
+
+	szTranslated[Length] = '\0';
+}
+
+
+KIRQL
+KeGetCurrentIrql(
+	VOID
+)
+{
+	return g_Thread.Irql;
+}
+
+
+VOID
+KeRaiseIrql(
+	IN  KIRQL NewIrql,
+	OUT  PKIRQL pOldIrql
+)
+{
+	ASSERT(NewIrql >= g_Thread.Irql);
+
+	if (g_Thread.Irql < DISPATCH_LEVEL && NewIrql >= DISPATCH_LEVEL)
+		AcquireLock(&g_Host.ProcessorLocks[g_Thread.ulProcessor]);
+
+	*pOldIrql = g_Thread.Irql;
+	g_Thread.Irql = NewIrql;
+}
+
+
+VOID
+KeLowerIrql(
+	IN  KIRQL NewIrql
+)
+{
+	ASSERT(NewIrql <= g_Thread.Irql);
+
+	if (g_Thread.Irql >= DISPATCH_LEVEL && NewIrql < DISPATCH_LEVEL)
+		ReleaseLock(&g_Host.ProcessorLocks[g_Thread.ulProcessor]);
+
+	g_Thread.Irql = NewIrql;
+}
+
+
+VOID
+KeAcquireSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKIRQL pOldIrql
+)
+{
+	KeRaiseIrql(DISPATCH_LEVEL, pOldIrql);
+	AcquireLock(pSpinLock);
+}
+
+
+VOID
+KeReleaseSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	IN  KIRQL NewIrql
+)
+{
+	ReleaseLock(pSpinLock);
+	KeLowerIrql(NewIrql);
+}
+
+
+VOID
+KeAcquireSpinLockAtDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock
+)
+{
+	ASSERT(g_Thread.Irql >= DISPATCH_LEVEL);
+
+	AcquireLock(pSpinLock);
+}
+
+
+VOID
+KeReleaseSpinLockFromDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock
+)
+{
+	ReleaseLock(pSpinLock);
+}
+
+
+VOID
+KeAcquireInStackQueuedSpinLock(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKLOCK_QUEUE_HANDLE pLockHandle
+)
+{
+	pLockHandle->LockQueue.Next = NULL;
+	pLockHandle->LockQueue.Lock = pSpinLock;
+
+	KeAcquireSpinLock(pSpinLock, &pLockHandle->OldIrql);
+}
+
+
+VOID
+KeReleaseInStackQueuedSpinLock(
+	IN  PKLOCK_QUEUE_HANDLE pLockHandle
+)
+{
+	KeReleaseSpinLock(pLockHandle->LockQueue.Lock, pLockHandle->OldIrql);
+}
+
+
+VOID
+KeAcquireInStackQueuedSpinLockAtDpcLevel(
+	IN OUT  PKSPIN_LOCK pSpinLock,
+	OUT  PKLOCK_QUEUE_HANDLE pLockHandle
+)
+{
+	pLockHandle->LockQueue.Next = NULL;
+	pLockHandle->LockQueue.Lock = pSpinLock;
+	pLockHandle->OldIrql = DISPATCH_LEVEL;
+
+	KeAcquireSpinLockAtDpcLevel(pSpinLock);
+}
+
+
+VOID
+KeReleaseInStackQueuedSpinLockFromDpcLevel(
+	IN  PKLOCK_QUEUE_HANDLE pLockHandle
+)
+{
+	KeReleaseSpinLockFromDpcLevel(pLockHandle->LockQueue.Lock);
+}
+
+
+ULONG
+KeGetCurrentProcessorNumberEx(
+	OUT OPTIONAL  PPROCESSOR_NUMBER pProcNumber
+)
+{
+	if (pProcNumber)
+	{
+		pProcNumber->Group = 0;
+		pProcNumber->Number = (UCHAR)g_Thread.ulProcessor;
+		pProcNumber->Reserved = 0;
+	}
+
+	return g_Thread.ulProcessor;
+}
+
+
+ULONG
+KeQueryMaximumProcessorCountEx(
+	IN  USHORT usGroupNumber
+)
+{
+	UNREFERENCED_PARAMETER(usGroupNumber);
+
+	return g_Host.ulProcessorCount;
+}
+
+
+ULONG
+KeQueryActiveProcessorCountEx(
+	IN  USHORT usGroupNumber
+)
+{
+	UNREFERENCED_PARAMETER(usGroupNumber);
+
+	return g_Host.ulProcessorCount;
+}
+
+
+NTSTATUS
+KeGetProcessorNumberFromIndex(
+	IN  ULONG ulProcIndex,
+	OUT  PPROCESSOR_NUMBER pProcNumber
+)
+{
+	if (ulProcIndex >= g_Host.ulProcessorCount)
+		return STATUS_INVALID_PARAMETER;
+
+	pProcNumber->Group = 0;
+	pProcNumber->Number = (UCHAR)ulProcIndex;
+	pProcNumber->Reserved = 0;
+
+	return STATUS_SUCCESS;
+}
+
+
+//
+//	The counter runs in nanoseconds.
+//
+LARGE_INTEGER
+KeQueryPerformanceCounter(
+	OUT OPTIONAL  PLARGE_INTEGER pPerformanceFrequency
+)
+{
+	LARGE_INTEGER Counter;
+
+	if (pPerformanceFrequency)
+		pPerformanceFrequency->QuadPart = 1000000000LL;
+
+	Counter.QuadPart = (LONGLONG)MonotonicTime();
+
+	return Counter;
+}
+
+
+ULONGLONG
+KeQueryInterruptTime(
+	VOID
+)
+{
+	return MonotonicTime() / 100;
+}
+
+
+PKTHREAD
+KeGetCurrentThread(
+	VOID
+)
+{
+	return (PKTHREAD)&g_Thread;
+}
+
+
+VOID
+KeQuerySystemTimePrecise(
+	OUT  PLARGE_INTEGER pCurrentTime
+)
+{
+	pCurrentTime->QuadPart = SystemTime();
+}
+
+
+//
+//	The priority is only remembered, Linux schedules the thread.
+//
+KPRIORITY
+KeSetPriorityThread(
+	IN OUT  PKTHREAD pThread,
+	IN  KPRIORITY Priority
+)
+{
+	HOST_THREAD* pHostThread = (HOST_THREAD*)pThread;
+	KPRIORITY OldPriority = pHostThread->Priority;
+
+	pHostThread->Priority = Priority;
+
+	return OldPriority;
+}
+
+
+VOID
+KeStackAttachProcess(
+	IN OUT  PEPROCESS pProcess,
+	OUT  PRKAPC_STATE pApcState
+)
+{
+	pApcState->Process = PsGetCurrentProcess();
+	g_Thread.ulProcessId = HandleToULong(pProcess);
+}
+
+
+VOID
+KeUnstackDetachProcess(
+	IN  PRKAPC_STATE pApcState
+)
+{
+	g_Thread.ulProcessId = HandleToULong(pApcState->Process);
+}
+
+
+VOID
+KeInitializeEvent(
+	OUT  PRKEVENT pEvent,
+	IN  EVENT_TYPE Type,
+	IN  BOOLEAN bState
+)
+{
+	pEvent->Header.Type = Type;
+	pEvent->Header.SignalState = bState;
+}
+
+
+LONG
+KeSetEvent(
+	IN OUT  PRKEVENT pEvent,
+	IN  KPRIORITY Increment,
+	IN  BOOLEAN bWait
+)
+{
+	LONG lPreviousState;
+
+	UNREFERENCED_PARAMETER(Increment);
+	UNREFERENCED_PARAMETER(bWait);
+
+	LockDispatcher();
+
+	lPreviousState = pEvent->Header.SignalState;
+	pEvent->Header.SignalState = 1;
+	pthread_cond_broadcast(&g_Host.DispatcherCondition);
+
+	UnlockDispatcher();
+
+	return lPreviousState;
+}
+
+
+VOID
+KeClearEvent(
+	IN OUT  PRKEVENT pEvent
+)
+{
+	LockDispatcher();
+	pEvent->Header.SignalState = 0;
+	UnlockDispatcher();
+}
+
+
+LONG
+KeReadStateEvent(
+	IN  PRKEVENT pEvent
+)
+{
+	return __atomic_load_n(&pEvent->Header.SignalState, __ATOMIC_ACQUIRE);
+}
+
+
+//
+//	Nothing alerts a thread or delivers it an APC here, an alertable wait
+//	only ends like any other.
+//
+NTSTATUS
+KeWaitForSingleObject(
+	IN  PVOID pObject,
+	IN  KWAIT_REASON WaitReason,
+	IN  KPROCESSOR_MODE WaitMode,
+	IN  BOOLEAN bAlertable,
+	IN OPTIONAL  PLARGE_INTEGER pTimeout
+)
+{
+	NTSTATUS NtStatus;
+
+	UNREFERENCED_PARAMETER(WaitReason);
+	UNREFERENCED_PARAMETER(WaitMode);
+	UNREFERENCED_PARAMETER(bAlertable);
+
+	ASSERT(g_Thread.Irql < DISPATCH_LEVEL || (pTimeout && !pTimeout->QuadPart));
+
+	LockDispatcher();
+
+	NtStatus = WaitForObject((DISPATCHER_HEADER*)pObject, pTimeout ? TimeoutToInterruptTime(pTimeout->QuadPart) : MAXULONG64);
+
+	UnlockDispatcher();
+
+	return NtStatus;
+}
+
+
+VOID
+KeInitializeTimer(
+	OUT  PKTIMER pTimer
+)
+{
+	RtlZeroMemory(pTimer, sizeof(KTIMER));
+
+	pTimer->Header.Type = NotificationEvent;
+}
+
+
+BOOLEAN
+KeSetTimer(
+	IN OUT  PKTIMER pTimer,
+	IN  LARGE_INTEGER DueTime,
+	IN OPTIONAL  PKDPC pDpc
+)
+{
+	return KeSetCoalescableTimer(pTimer, DueTime, 0, 0, pDpc);
+}
+
+
+//
+//	The timer is never late on purpose, the tolerable delay is ignored.
+//
+BOOLEAN
+KeSetCoalescableTimer(
+	IN OUT  PKTIMER pTimer,
+	IN  LARGE_INTEGER DueTime,
+	IN  ULONG ulPeriod,
+	IN  ULONG ulTolerableDelay,
+	IN OPTIONAL  PKDPC pDpc
+)
+{
+	BOOLEAN bInserted;
+
+	UNREFERENCED_PARAMETER(ulTolerableDelay);
+
+	LockDispatcher();
+
+	bInserted = pTimer->Inserted;
+
+	if (bInserted)
+		RemoveEntryList(&pTimer->TimerListEntry);
+
+	pTimer->Header.SignalState = 0;
+	pTimer->DueTime = TimeoutToInterruptTime(DueTime.QuadPart);
+	pTimer->Period = (LONG)ulPeriod;
+	pTimer->Dpc = pDpc;
+	pTimer->Inserted = TRUE;
+
+	InsertTailList(&g_Host.TimerList, &pTimer->TimerListEntry);
+	pthread_cond_broadcast(&g_Host.DispatcherCondition);
+
+	UnlockDispatcher();
+
+	return bInserted;
+}
+
+
+BOOLEAN
+KeCancelTimer(
+	IN OUT  PKTIMER pTimer
+)
+{
+	BOOLEAN bInserted;
+
+	LockDispatcher();
+
+	bInserted = pTimer->Inserted;
+
+	if (bInserted)
+	{
+		RemoveEntryList(&pTimer->TimerListEntry);
+		pTimer->Inserted = FALSE;
+	}
+
+	UnlockDispatcher();
+
+	return bInserted;
+}
+
+
+VOID
+KeInitializeDpc(
+	OUT  PRKDPC pDpc,
+	IN  PKDEFERRED_ROUTINE pDeferredRoutine,
+	IN OPTIONAL  PVOID pDeferredContext
+)
+{
+	RtlZeroMemory(pDpc, sizeof(KDPC));
+
+	pDpc->DeferredRoutine = pDeferredRoutine;
+	pDpc->DeferredContext = pDeferredContext;
+	pDpc->Number = MAXULONG;
+}
+
+
+NTSTATUS
+KeSetTargetProcessorDpcEx(
+	IN OUT  PKDPC pDpc,
+	IN  PPROCESSOR_NUMBER pProcNumber
+)
+{
+	if (pProcNumber->Group || pProcNumber->Number >= g_Host.ulProcessorCount)
+		return STATUS_INVALID_PARAMETER;
+
+	pDpc->Number = pProcNumber->Number;
+
+	return STATUS_SUCCESS;
+}
+
+
+BOOLEAN
+KeInsertQueueDpc(
+	IN OUT  PRKDPC pDpc,
+	IN OPTIONAL  PVOID pSystemArgument1,
+	IN OPTIONAL  PVOID pSystemArgument2
+)
+{
+	BOOLEAN bQueued;
+
+	LockDispatcher();
+
+	bQueued = QueueDpc(pDpc, pSystemArgument1, pSystemArgument2, g_Thread.ulProcessor);
+
+	UnlockDispatcher();
+
+	return bQueued;
+}
+
+
+VOID
+KeFlushQueuedDpcs(
+	VOID
+)
+{
+	ASSERT(g_Thread.Irql == PASSIVE_LEVEL);
+
+	LockDispatcher();
+
+	while (!IsListEmpty(&g_Host.DpcList) || g_Host.bDpcActive)
+		WaitForDispatcher(MAXULONG64);
+
+	UnlockDispatcher();
+}
+
+
+//
+//	Every allocation is cache aligned, which is all the flags can ask for.
+//
+PVOID
+ExAllocatePool2(
+	IN  POOL_FLAGS Flags,
+	IN  SIZE_T NumberOfBytes,
+	IN  ULONG ulTag
+)
+{
+	PVOID pBuffer;
+
+	UNREFERENCED_PARAMETER(ulTag);
+
+	if (posix_memalign(&pBuffer, SYSTEM_CACHE_ALIGNMENT_SIZE, NumberOfBytes ? NumberOfBytes : 1))
+		return NULL;
+
+	if (!(Flags & POOL_FLAG_UNINITIALIZED))
+		RtlZeroMemory(pBuffer, NumberOfBytes);
+
+	InterlockedIncrement64(&g_Host.llPoolAllocations);
+
+	return pBuffer;
+}
+
+
+VOID
+ExFreePoolWithTag(
+	IN  PVOID pBuffer,
+	IN  ULONG ulTag
+)
+{
+	UNREFERENCED_PARAMETER(ulTag);
+
+	ASSERT(pBuffer);
+
+	InterlockedAdd64(&g_Host.llPoolAllocations, -1);
+	free(pBuffer);
+}
+
+
+VOID
+ExFreePool(
+	IN  PVOID pBuffer
+)
+{
+	ExFreePoolWithTag(pBuffer, 0);
+}
+
+
+//
+//	Threads of the client processes make user mode requests, system
+//	threads kernel mode ones.
+//
+KPROCESSOR_MODE
+ExGetPreviousMode(
+	VOID
+)
+{
+	return g_Thread.PreviousMode;
+}
+
+
+VOID
+ExInitializeFastMutex(
+	OUT  PFAST_MUTEX pFastMutex
+)
+{
+	pFastMutex->Count = 1;
+	pFastMutex->Owner = NULL;
+	pFastMutex->OldIrql = PASSIVE_LEVEL;
+
+	KeInitializeEvent(&pFastMutex->Event, SynchronizationEvent, FALSE);
+}
+
+
+VOID
+ExAcquireFastMutex(
+	IN OUT  PFAST_MUTEX pFastMutex
+)
+{
+	KIRQL OldIrql;
+
+	KeRaiseIrql(APC_LEVEL, &OldIrql);
+
+	if (InterlockedDecrement(&pFastMutex->Count) != 0)
+		KeWaitForSingleObject(&pFastMutex->Event, Executive, KernelMode, FALSE, NULL);
+
+	pFastMutex->Owner = KeGetCurrentThread();
+	pFastMutex->OldIrql = OldIrql;
+}
+
+
+VOID
+ExReleaseFastMutex(
+	IN OUT  PFAST_MUTEX pFastMutex
+)
+{
+	KIRQL OldIrql = pFastMutex->OldIrql;
+
+	ASSERT(pFastMutex->Owner == KeGetCurrentThread());
+
+	pFastMutex->Owner = NULL;
+
+	if (InterlockedIncrement(&pFastMutex->Count) != 1)
+		KeSetEvent(&pFastMutex->Event, 0, FALSE);
+
+	KeLowerIrql(OldIrql);
+}
+
+
+VOID
+ExInitializeRundownProtection(
+	OUT  PEX_RUNDOWN_REF pRunRef
+)
+{
+	pRunRef->Count = 0;
+}
+
+
+BOOLEAN
+ExAcquireRundownProtection(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+)
+{
+	ULONG_PTR Count = __atomic_load_n(&pRunRef->Count, __ATOMIC_RELAXED);
+
+	do
+	{
+		if (Count & 1)
+			return FALSE;
+
+	} while (!__atomic_compare_exchange_n(&pRunRef->Count, &Count, Count + 2, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	return TRUE;
+}
+
+
+VOID
+ExReleaseRundownProtection(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+)
+{
+	if (__atomic_sub_fetch(&pRunRef->Count, 2, __ATOMIC_RELEASE) == 1)
+	{
+		LockDispatcher();
+		pthread_cond_broadcast(&g_Host.DispatcherCondition);
+		UnlockDispatcher();
+	}
+}
+
+
+VOID
+ExWaitForRundownProtectionRelease(
+	IN OUT  PEX_RUNDOWN_REF pRunRef
+)
+{
+	__atomic_or_fetch(&pRunRef->Count, 1, __ATOMIC_SEQ_CST);
+
+	LockDispatcher();
+
+	while (__atomic_load_n(&pRunRef->Count, __ATOMIC_ACQUIRE) != 1)
+		WaitForDispatcher(MAXULONG64);
+
+	UnlockDispatcher();
+}
+
+
+KIRQL
+ExAcquireSpinLockShared(
+	IN OUT  PEX_SPIN_LOCK pSpinLock
+)
+{
+	KIRQL OldIrql;
+	LONG lValue;
+
+	KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+	for (;;)
+	{
+		lValue = __atomic_load_n(pSpinLock, __ATOMIC_RELAXED);
+
+		if (!(lValue & HOST_EX_SPIN_LOCK_EXCLUSIVE) &&
+			__atomic_compare_exchange_n(pSpinLock, &lValue, lValue + 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return OldIrql;
+
+		sched_yield();
+	}
+}
+
+
+VOID
+ExReleaseSpinLockShared(
+	IN OUT  PEX_SPIN_LOCK pSpinLock,
+	IN  KIRQL OldIrql
+)
+{
+	ASSERT(*pSpinLock > 0);
+
+	__atomic_sub_fetch(pSpinLock, 1, __ATOMIC_RELEASE);
+	KeLowerIrql(OldIrql);
+}
+
+
+KIRQL
+ExAcquireSpinLockExclusive(
+	IN OUT  PEX_SPIN_LOCK pSpinLock
+)
+{
+	KIRQL OldIrql;
+	LONG lValue;
+
+	KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+	for (;;)
+	{
+		lValue = 0;
+
+		if (__atomic_compare_exchange_n(pSpinLock, &lValue, (LONG)HOST_EX_SPIN_LOCK_EXCLUSIVE, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return OldIrql;
+
+		sched_yield();
+	}
+}
+
+
+VOID
+ExReleaseSpinLockExclusive(
+	IN OUT  PEX_SPIN_LOCK pSpinLock,
+	IN  KIRQL OldIrql
+)
+{
+	ASSERT(*pSpinLock == (LONG)HOST_EX_SPIN_LOCK_EXCLUSIVE);
+
+	__atomic_store_n(pSpinLock, 0, __ATOMIC_RELEASE);
+	KeLowerIrql(OldIrql);
+}
+
+
+//
+//	The list keeps up to HOST_LOOKASIDE_DEPTH entries whatever the kernel
+//	would have tuned it to.
+//
+NTSTATUS
+ExInitializeLookasideListEx(
+	OUT  PLOOKASIDE_LIST_EX pLookaside,
+	IN OPTIONAL  PALLOCATE_FUNCTION_EX pAllocate,
+	IN OPTIONAL  PFREE_FUNCTION_EX pFree,
+	IN  POOL_TYPE PoolType,
+	IN  ULONG ulFlags,
+	IN  SIZE_T Size,
+	IN  ULONG ulTag,
+	IN  USHORT usDepth
+)
+{
+	UNREFERENCED_PARAMETER(ulFlags);
+	UNREFERENCED_PARAMETER(usDepth);
+
+	ASSERT(Size >= sizeof(SINGLE_LIST_ENTRY));
+
+	KeInitializeSpinLock(&pLookaside->Lock);
+	pLookaside->ListHead.Next = NULL;
+	pLookaside->Depth = HOST_LOOKASIDE_DEPTH;
+	pLookaside->Count = 0;
+	pLookaside->Type = PoolType;
+	pLookaside->Tag = ulTag;
+	pLookaside->Size = Size;
+	pLookaside->Allocate = pAllocate ? pAllocate : LookasideAllocate;
+	pLookaside->Free = pFree ? pFree : LookasideFree;
+
+	return STATUS_SUCCESS;
+}
+
+
+VOID
+ExDeleteLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+	PSINGLE_LIST_ENTRY pEntry;
+
+	while ((pEntry = pLookaside->ListHead.Next) != NULL)
+	{
+		pLookaside->ListHead.Next = pEntry->Next;
+		pLookaside->Free(pEntry, pLookaside);
+	}
+
+	pLookaside->Count = 0;
+}
+
+
+PVOID
+ExAllocateFromLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside
+)
+{
+	PSINGLE_LIST_ENTRY pEntry;
+	KIRQL OldIrql;
+
+	KeAcquireSpinLock(&pLookaside->Lock, &OldIrql);
+
+	pEntry = pLookaside->ListHead.Next;
+
+	if (pEntry)
+	{
+		pLookaside->ListHead.Next = pEntry->Next;
+		pLookaside->Count--;
+	}
+
+	KeReleaseSpinLock(&pLookaside->Lock, OldIrql);
+
+	if (!pEntry)
+		return pLookaside->Allocate(pLookaside->Type, pLookaside->Size, pLookaside->Tag, pLookaside);
+
+	return pEntry;
+}
+
+
+VOID
+ExFreeToLookasideListEx(
+	IN OUT  PLOOKASIDE_LIST_EX pLookaside,
+	IN  PVOID pEntry
+)
+{
+	PSINGLE_LIST_ENTRY pListEntry = pEntry;
+	KIRQL OldIrql;
+
+	KeAcquireSpinLock(&pLookaside->Lock, &OldIrql);
+
+	if (pLookaside->Count < pLookaside->Depth)
+	{
+		pListEntry->Next = pLookaside->ListHead.Next;
+		pLookaside->ListHead.Next = pListEntry;
+		pLookaside->Count++;
+		pListEntry = NULL;
+	}
+
+	KeReleaseSpinLock(&pLookaside->Lock, OldIrql);
+
+	if (pListEntry)
+		pLookaside->Free(pListEntry, pLookaside);
+}
+
+
+//
+//	Nothing can raise here, a bad buffer is a bug of the test.
+//
+VOID
+ProbeForRead(
+	IN  const volatile VOID* pAddress,
+	IN  SIZE_T Length,
+	IN  ULONG ulAlignment
+)
+{
+	ASSERT(!Length || (pAddress && !((ULONG_PTR)pAddress & (ulAlignment - 1))));
+}
+
+
+VOID
+ProbeForWrite(
+	IN OUT  volatile VOID* pAddress,
+	IN  SIZE_T Length,
+	IN  ULONG ulAlignment
+)
+{
+	ASSERT(!Length || (pAddress && !((ULONG_PTR)pAddress & (ulAlignment - 1))));
+}
+
+
+HANDLE
+PsGetCurrentProcessId(
+	VOID
+)
+{
+	return ULongToHandle(g_Thread.ulProcessId);
+}
+
+
+//
+//	The process ID stands for the process object, it is never dereferenced.
+//
+PEPROCESS
+PsGetCurrentProcess(
+	VOID
+)
+{
+	return (PEPROCESS)ULongToHandle(g_Thread.ulProcessId);
+}
+
+
+//
+//	Process IDs are not reused here, every process was created at the
+//	same time. 0 would match any process.
+//
+LONGLONG
+PsGetProcessCreateTimeQuadPart(
+	IN  PEPROCESS pProcess
+)
+{
+	UNREFERENCED_PARAMETER(pProcess);
+
+	return 1;
+}
+
+
+HANDLE
+PsGetCurrentThreadId(
+	VOID
+)
+{
+	if (!g_Thread.ulThreadId)
+		g_Thread.ulThreadId = (ULONG)InterlockedAdd(&g_Host.lLastThreadId, 4);
+
+	return ULongToHandle(g_Thread.ulThreadId);
+}
+
+
+//
+//	The thread object has a reference for the handle and one for the
+//	thread, dropped when it exits.
+//
+NTSTATUS
+PsCreateSystemThread(
+	OUT  PHANDLE pThreadHandle,
+	IN  ULONG ulDesiredAccess,
+	IN OPTIONAL  POBJECT_ATTRIBUTES pObjectAttributes,
+	IN OPTIONAL  HANDLE hProcess,
+	OUT OPTIONAL  PVOID pClientId,
+	IN  PKSTART_ROUTINE pStartRoutine,
+	IN OPTIONAL  PVOID pStartContext
+)
+{
+	PHOST_OBJECT pObject;
+	pthread_t Thread;
+
+	UNREFERENCED_PARAMETER(ulDesiredAccess);
+	UNREFERENCED_PARAMETER(pObjectAttributes);
+	UNREFERENCED_PARAMETER(hProcess);
+
+	ASSERT(!pClientId);
+
+	pthread_once(&g_DispatcherOnce, InitializeDispatcher);
+
+	pObject = calloc(1, sizeof(HOST_OBJECT));
+
+	if (!pObject)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	pObject->Header.Type = NotificationEvent;
+	pObject->lReferences = 2;
+	pObject->pStartRoutine = pStartRoutine;
+	pObject->pStartContext = pStartContext;
+
+	if (pthread_create(&Thread, NULL, SystemThreadStart, pObject))
+	{
+		free(pObject);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	pthread_detach(Thread);
+
+	*pThreadHandle = pObject;
+
+	return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+PsTerminateSystemThread(
+	IN  NTSTATUS ExitStatus
+)
+{
+	PHOST_OBJECT pObject = g_Thread.pObject;
+
+	UNREFERENCED_PARAMETER(ExitStatus);
+
+	ASSERT(pObject && g_Thread.Irql == PASSIVE_LEVEL);
+
+	LockDispatcher();
+
+	pObject->Header.SignalState = 1;
+	pthread_cond_broadcast(&g_Host.DispatcherCondition);
+
+	UnlockDispatcher();
+
+	DereferenceObject(pObject);
+	pthread_exit(NULL);
+}
+
+
+//
+//	The objects the driver references are processes, which never go away.
+//
+VOID
+ObReferenceObject(
+	IN  PVOID pObject
+)
+{
+	UNREFERENCED_PARAMETER(pObject);
+}
+
+
+VOID
+ObDereferenceObject(
+	IN  PVOID pObject
+)
+{
+	UNREFERENCED_PARAMETER(pObject);
+}
+
+
+NTSTATUS
+ZwClose(
+	IN  HANDLE Handle
+)
+{
+	DereferenceObject((PHOST_OBJECT)Handle);
+
+	return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+ZwWaitForSingleObject(
+	IN  HANDLE Handle,
+	IN  BOOLEAN bAlertable,
+	IN OPTIONAL  PLARGE_INTEGER pTimeout
+)
+{
+	return KeWaitForSingleObject(&((PHOST_OBJECT)Handle)->Header, Executive, KernelMode, bAlertable, pTimeout);
+}
+
+
+//
+//	An event that does not exist yet is created signaled.
+//
+PKEVENT
+IoCreateNotificationEvent(
+	IN  PUNICODE_STRING pEventName,
+	OUT  PHANDLE pEventHandle
+)
+{
+	PHOST_OBJECT pObject = NULL;
+	PLIST_ENTRY pEntry;
+
+	LockDispatcher();
+
+	for (pEntry = g_Host.NamedEvents.Flink; pEntry != &g_Host.NamedEvents; pEntry = pEntry->Flink)
+	{
+		if (RtlEqualUnicodeString(&CONTAINING_RECORD(pEntry, HOST_OBJECT, NamedEventEntry)->usName, pEventName, TRUE))
+		{
+			pObject = CONTAINING_RECORD(pEntry, HOST_OBJECT, NamedEventEntry);
+			pObject->lReferences++;
+			break;
+		}
+	}
+
+	if (!pObject)
+		pObject = CreateNamedEvent(pEventName, TRUE);
+
+	UnlockDispatcher();
+
+	if (!pObject)
+		return NULL;
+
+	*pEventHandle = pObject;
+
+	return (PKEVENT)&pObject->Header;
+}
+
+
+//
+//	The host runs as if it held every privilege.
+//
+BOOLEAN
+SeSinglePrivilegeCheck(
+	IN  LUID PrivilegeValue,
+	IN  KPROCESSOR_MODE PreviousMode
+)
+{
+	UNREFERENCED_PARAMETER(PrivilegeValue);
+	UNREFERENCED_PARAMETER(PreviousMode);
+
+	return TRUE;
+}
+
+
+VOID
+RtlInitUnicodeString(
+	OUT  PUNICODE_STRING pDestinationString,
+	IN OPTIONAL  PCWSTR pszSourceString
+)
+{
+	SIZE_T Length = 0;
+
+	while (pszSourceString && pszSourceString[Length])
+		Length++;
+
+	pDestinationString->Buffer = (PWSTR)pszSourceString;
+	pDestinationString->Length = (USHORT)(Length * sizeof(WCHAR));
+	pDestinationString->MaximumLength = pszSourceString ? (USHORT)((Length + 1) * sizeof(WCHAR)) : 0;
+}
+
+
+VOID
+RtlCopyUnicodeString(
+	IN OUT  PUNICODE_STRING pDestinationString,
+	IN OPTIONAL  PCUNICODE_STRING pSourceString
+)
+{
+	USHORT usLength;
+
+	if (!pSourceString)
+	{
+		pDestinationString->Length = 0;
+		return;
+	}
+
+	usLength = min(pDestinationString->MaximumLength, pSourceString->Length);
+
+	RtlCopyMemory(pDestinationString->Buffer, pSourceString->Buffer, usLength);
+	pDestinationString->Length = usLength;
+
+	if (usLength + sizeof(WCHAR) <= pDestinationString->MaximumLength)
+		pDestinationString->Buffer[usLength / sizeof(WCHAR)] = L'\0';
+}
+
+
+BOOLEAN
+RtlEqualUnicodeString(
+	IN  PCUNICODE_STRING pString1,
+	IN  PCUNICODE_STRING pString2,
+	IN  BOOLEAN bCaseInSensitive
+)
+{
+	USHORT usIndex;
+
+	if (pString1->Length != pString2->Length)
+		return FALSE;
+
+	for (usIndex = 0; usIndex < pString1->Length / sizeof(WCHAR); usIndex++)
+	{
+		if (bCaseInSensitive ?
+			UpcaseChar(pString1->Buffer[usIndex]) != UpcaseChar(pString2->Buffer[usIndex]) :
+			pString1->Buffer[usIndex] != pString2->Buffer[usIndex])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+//
+//	The default algorithm is X65599, as on Windows.
+//
+NTSTATUS
+RtlHashUnicodeString(
+	IN  PCUNICODE_STRING pString,
+	IN  BOOLEAN bCaseInSensitive,
+	IN  ULONG ulHashAlgorithm,
+	OUT  PULONG pulHashValue
+)
+{
+	USHORT usIndex;
+	ULONG ulHash = 0;
+
+	if (!pString || !pulHashValue ||
+		(ulHashAlgorithm != HASH_STRING_ALGORITHM_DEFAULT && ulHashAlgorithm != HASH_STRING_ALGORITHM_X65599))
+		return STATUS_INVALID_PARAMETER;
+
+	for (usIndex = 0; usIndex < pString->Length / sizeof(WCHAR); usIndex++)
+		ulHash = ulHash * 65599 + (bCaseInSensitive ? UpcaseChar(pString->Buffer[usIndex]) : pString->Buffer[usIndex]);
+
+	*pulHashValue = ulHash;
+
+	return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+RtlStringCbPrintfExA(
+	OUT  NTSTRSAFE_PSTR pszDest,
+	IN  size_t cbDest,
+	OUT OPTIONAL  NTSTRSAFE_PSTR* ppszDestEnd,
+	OUT OPTIONAL  size_t* pcbRemaining,
+	IN  ULONG dwFlags,
+	IN  NTSTRSAFE_PCSTR pszFormat,
+	...
+)
+{
+	CHAR szFormat[HOST_FORMAT_SIZE];
+	NTSTATUS NtStatus = STATUS_SUCCESS;
+	va_list Arguments;
+	int iLength;
+
+	ASSERT(!dwFlags);
+
+	if (!cbDest || cbDest > 0x7FFFFFFF)
+		return STATUS_INVALID_PARAMETER;
+
+	TranslateFormat(pszFormat, szFormat);
+
+	va_start(Arguments, pszFormat);
+	iLength = vsnprintf(pszDest, cbDest, szFormat, Arguments);
+	va_end(Arguments);
+
+	if (iLength < 0)
+	{
+		*pszDest = '\0';
+		iLength = 0;
+		NtStatus = STATUS_INVALID_PARAMETER;
+	}
+	else if ((size_t)iLength >= cbDest)
+	{
+		iLength = (int)cbDest - 1;
+		NtStatus = STATUS_BUFFER_OVERFLOW;
+	}
+
+	if (ppszDestEnd)
+		*ppszDestEnd = pszDest + iLength;
+
+	if (pcbRemaining)
+		*pcbRemaining = cbDest - (size_t)iLength;
+
+	return NtStatus;
+}
+
+
+//
+//	Prints to stderr, once HostSetDebugPrint asked for it.
+//
+ULONG
+DbgPrint(
+	IN  PCSTR pszFormat,
+	...
+)
+{
+	CHAR szFormat[HOST_FORMAT_SIZE];
+	va_list Arguments;
+
+	if (!g_Host.bDebugPrint)
+		return STATUS_SUCCESS;
+
+	TranslateFormat(pszFormat, szFormat);
+
+	va_start(Arguments, pszFormat);
+	vfprintf(stderr, szFormat, Arguments);
+	va_end(Arguments);
+
+	return STATUS_SUCCESS;
+}
+
+
+VOID
+HostSetProcessorCount(
+	IN  ULONG ulCount
+)
+{
+	ASSERT(ulCount >= 1 && ulCount <= HOST_MAX_PROCESSORS);
+
+	g_Host.ulProcessorCount = ulCount;
+}
+
+
+//
+//	Like a thread being moved to another processor, it cannot happen
+//	while it runs at DISPATCH_LEVEL.
+//
+VOID
+HostSetProcessor(
+	IN  ULONG ulProcessor
+)
+{
+	ASSERT(g_Thread.Irql < DISPATCH_LEVEL && ulProcessor < g_Host.ulProcessorCount);
+
+	g_Thread.ulProcessor = ulProcessor;
+}
+
+
+VOID
+HostSetProcess(
+	IN  ULONG ulProcessId
+)
+{
+	ASSERT(ulProcessId);
+
+	g_Thread.ulProcessId = ulProcessId;
+}
+
+
+LONG64
+HostPoolAllocations(
+	VOID
+)
+{
+	return ReadNoFence64(&g_Host.llPoolAllocations);
+}
+
+
+VOID
+HostSetDebugPrint(
+	IN  BOOLEAN bEnable
+)
+{
+	g_Host.bDebugPrint = bEnable;
+}
@@ -4,8 +4,10 @@
 * 	6FingsSrvc.c																*
 *																				*
 * Abstract:																		*
-* 	This file is the main file to create, start and stop service.				*
-* 	Service loads/unloads the driver.											*
+* 	This file is the main file of the 6Fings service. The service loads			*
+* 	the driver, drains the device with the consumer until it is stopped			*
+* 	and unloads the driver again. Run from a console it does the same			*
+* 	until Ctrl+C, and it installs and removes itself.							*
 *																				*
 * Revision History:																*
 * 	Date:	13 December 2024													*
@@ -21,79 +23,624 @@
 #include <windows.h>
 #include <tchar.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "consumer.h"
+#include "spool.h"
+#include "spoolbench.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define SERVICE_NAME			_T("6FingsSrvc")
+#define DRIVER_SERVICE_NAME		_T("6Fings")
+
+//
+//	How often the console prints the counters of the consumer.
+//
+#define CONSOLE_REPORT_MS		5000
+
+//
+//	What the service tells the service control manager a start or stop
+//	may take.
+//
+#define SERVICE_WAIT_HINT_MS	10000
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	The options given on the command line, the service gets the same
+//	ones from its binary path.
+//
+static CONSUMER_CONFIG g_Config;
+
+static SERVICE_STATUS_HANDLE g_hServiceStatus;
+static SERVICE_STATUS g_ServiceStatus;
+
+//
+//	Set by the service control handler or Ctrl+C to stop the consumer.
+//
+static HANDLE g_hStopEvent;
 
 
 /////////////////////////////////////////////////////////////////////
 //	F U N C T I O N  D E F I N I T I O N S.
 /////////////////////////////////////////////////////////////////////
-int main()
+
+
+static void
+PrintUsage(void)
+{
+	printf("Usage: 6FingsSrvc [install | remove] [-w workers] [-r reads per worker] [-b read length]\n");
+	printf("                  [-s null | console | file:<path> | spool:<directory>]...\n");
+	printf("       6FingsSrvc replay <directory> [sequence number]\n");
+	printf("       6FingsSrvc spool-bench [-d directory] [-n messages] [-l length] [-t threads] [-b batch] [-g segment MB] [-w]\n");
+	printf("Without install or remove it runs as the service, or until Ctrl+C from a console.\n");
+	printf("Replay prints what a spool sink kept, from the oldest message or the one given.\n");
+}
+
+
+//
+//	Fills g_Config from the options. The sinks are looked up, their
+//	option kept in pSinkContexts until OpenSinks, the null sink is
+//	used when there is none.
+//
+static bool
+ParseOptions(
+	int argc,
+	char* argv[]
+)
+{
+	static char szSinks[CONSUMER_MAX_SINKS][MAX_PATH];
+	const SINK* pSink;
+	const char* pszValue;
+	char* pszColon;
+	int iIndex;
+
+	ZeroMemory(&g_Config, sizeof(g_Config));
+	g_Config.pszDevice = "\\\\.\\6FingsUsr";
+
+	for (iIndex = 0; iIndex < argc; iIndex++)
+	{
+		if (argv[iIndex][0] != '-' || !argv[iIndex][1] || argv[iIndex][2] || iIndex + 1 == argc)
+			return false;
+
+		pszValue = argv[++iIndex];
+
+		switch (argv[iIndex - 1][1])
+		{
+		case 'w':
+			g_Config.ulWorkers = strtoul(pszValue, NULL, 10);
+			if (g_Config.ulWorkers > CONSUMER_MAX_WORKERS)
+				return false;
+			break;
+
+		case 'r':
+			g_Config.ulReadsPerWorker = strtoul(pszValue, NULL, 10);
+			break;
+
+		case 'b':
+			g_Config.ulReadLength = strtoul(pszValue, NULL, 10);
+			break;
+
+		case 's':
+			if (g_Config.ulSinkCount == CONSUMER_MAX_SINKS)
+				return false;
+
+			snprintf(szSinks[g_Config.ulSinkCount], MAX_PATH, "%s", pszValue);
+
+			pszColon = strchr(szSinks[g_Config.ulSinkCount], ':');
+			if (pszColon)
+				*pszColon = '\0';
+
+			pSink = FindSink(szSinks[g_Config.ulSinkCount]);
+			if (!pSink)
+				return false;
+
+			g_Config.pSinks[g_Config.ulSinkCount] = pSink;
+			g_Config.pSinkContexts[g_Config.ulSinkCount] = (void*)(pszColon ? pszColon + 1 : NULL);
+			g_Config.ulSinkCount++;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	if (!g_Config.ulSinkCount)
+	{
+		g_Config.pSinks[0] = &g_NullSink;
+		g_Config.ulSinkCount = 1;
+	}
+
+	return true;
+}
+
+
+//
+//	Opens every sink, the option kept in pSinkContexts by ParseOptions is
+//	replaced by what Open returned. Closes the ones opened on failure.
+//
+static bool
+OpenSinks(void)
+{
+	ULONG ulIndex;
+	void* pSink;
+
+	for (ulIndex = 0; ulIndex < g_Config.ulSinkCount; ulIndex++)
+	{
+		pSink = g_Config.pSinks[ulIndex]->Open((const char*)g_Config.pSinkContexts[ulIndex]);
+
+		if (!pSink)
+		{
+			while (ulIndex--)
+				g_Config.pSinks[ulIndex]->Close(g_Config.pSinkContexts[ulIndex]);
+
+			return false;
+		}
+
+		g_Config.pSinkContexts[ulIndex] = pSink;
+	}
+
+	return true;
+}
+
+
+static void
+CloseSinks(void)
+{
+	ULONG ulIndex;
+
+	for (ulIndex = 0; ulIndex < g_Config.ulSinkCount; ulIndex++)
+		g_Config.pSinks[ulIndex]->Close(g_Config.pSinkContexts[ulIndex]);
+}
+
+
+//
+//	Creates the service of the driver, or opens it if it is there
+//	already, and starts it. Returns NULL if it could not be started.
+//
+static SC_HANDLE
+LoadDriver(
+	SC_HANDLE hSCManager
+)
 {
-	SC_HANDLE hSCManager;
 	SC_HANDLE hService;
+
+	printf("Load Driver\n");
+
+	hService = CreateService(
+		hSCManager,
+		DRIVER_SERVICE_NAME,
+		_T("6Fings Service"),
+		SERVICE_START | DELETE | SERVICE_STOP,
+		SERVICE_KERNEL_DRIVER,
+		SERVICE_DEMAND_START,
+		SERVICE_ERROR_IGNORE,
+		_T("C:\\Windows\\System32\\drivers\\6Fings.sys"),
+		NULL,
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	if (!hService)
+	{
+		hService = OpenService(
+			hSCManager,
+			DRIVER_SERVICE_NAME,
+			SERVICE_START | DELETE | SERVICE_STOP
+		);
+	}
+
+	if (hService && !StartService(hService, 0, NULL) && GetLastError() != ERROR_SERVICE_ALREADY_RUNNING)
+	{
+		printf("StartService Failed! (%lu)\n", GetLastError());
+		CloseServiceHandle(hService);
+		hService = NULL;
+	}
+
+	return hService;
+}
+
+
+static void
+UnloadDriver(
+	SC_HANDLE hService
+)
+{
 	SERVICE_STATUS ss;
 
+	printf("Unload Driver\n");
+
+	ControlService(
+		hService,
+		SERVICE_CONTROL_STOP,
+		&ss
+	);
+
+	DeleteService(hService);
+	CloseServiceHandle(hService);
+}
+
+
+static void
+ReportServiceStatus(
+	DWORD dwState,
+	DWORD dwExitCode
+)
+{
+	if (!g_hServiceStatus)
+		return;
+
+	g_ServiceStatus.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+	g_ServiceStatus.dwCurrentState = dwState;
+	g_ServiceStatus.dwWin32ExitCode = dwExitCode;
+	g_ServiceStatus.dwControlsAccepted = dwState == SERVICE_RUNNING ? SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN : 0;
+	g_ServiceStatus.dwWaitHint = dwState == SERVICE_RUNNING || dwState == SERVICE_STOPPED ? 0 : SERVICE_WAIT_HINT_MS;
+	g_ServiceStatus.dwCheckPoint = g_ServiceStatus.dwWaitHint ? g_ServiceStatus.dwCheckPoint + 1 : 0;
+
+	SetServiceStatus(g_hServiceStatus, &g_ServiceStatus);
+}
+
+
+static void
+PrintCounters(
+	CONSUMER* pConsumer
+)
+{
+	CONSUMER_COUNTERS Counters;
+
+	QueryConsumer(pConsumer, &Counters);
+
+	printf("%lu workers, %lu reads in flight: %llu reads returned %llu messages (%llu bytes), %llu failed.\n",
+		Counters.ulWorkers, Counters.ulReadsInFlight, Counters.ullReads, Counters.ullMessages, Counters.ullBytes, Counters.ullReadsFailed);
+}
+
+
+//
+//	Loads the driver and consumes the device until g_hStopEvent is set.
+//	Returns the exit code of the service.
+//
+static DWORD
+RunConsumer(
+	bool bConsole
+)
+{
+	SC_HANDLE hSCManager;
+	SC_HANDLE hDriver;
+	CONSUMER* pConsumer;
+	DWORD dwError = ERROR_SUCCESS;
+
 	hSCManager = OpenSCManager(
 		NULL,
 		NULL,
 		SC_MANAGER_CREATE_SERVICE
 	);
 
-	printf("Load Driver\n");
+	if (!hSCManager)
+		return GetLastError();
 
-	if (hSCManager)
+	hDriver = LoadDriver(hSCManager);
+
+	if (!hDriver)
 	{
-		printf("Create Service\n");
+		dwError = GetLastError();
+		CloseServiceHandle(hSCManager);
+		return dwError;
+	}
 
-		hService = CreateService(
-			hSCManager,
-			_T("6Fings"),
-			_T("6Fings Service"),
-			SERVICE_START | DELETE | SERVICE_STOP,
-			SERVICE_KERNEL_DRIVER,
-			SERVICE_DEMAND_START,
-			SERVICE_ERROR_IGNORE,
-			_T("C:\\Windows\\System32\\drivers\\6Fings.sys"),
-			NULL,
-			NULL,
-			NULL,
-			NULL,
-			NULL
-		);
+	if (!OpenSinks())
+	{
+		dwError = ERROR_INVALID_PARAMETER;
+	}
+	else
+	{
+		pConsumer = StartConsumer(&g_Config);
 
-		if (!hService)
+		if (!pConsumer)
 		{
-			hService = OpenService(
-				hSCManager,
-				_T("6Fings"),
-				SERVICE_START | DELETE | SERVICE_STOP
-			);
+			dwError = GetLastError();
+			printf("Cannot consume %s (%lu)\n", g_Config.pszDevice, dwError);
 		}
-
-		if (hService)
+		else
 		{
-			printf("Start Service\n");
-
-			StartService(
-				hService,
-				0,
-				NULL
-			);
+			ReportServiceStatus(SERVICE_RUNNING, ERROR_SUCCESS);
 
-			printf("Press Enter to Stop Service/Driver");
+			if (bConsole)
+			{
+				printf("Consuming %s, press Ctrl+C to stop\n", g_Config.pszDevice);
 
-			getchar();
+				while (WaitForSingleObject(g_hStopEvent, CONSOLE_REPORT_MS) == WAIT_TIMEOUT)
+					PrintCounters(pConsumer);
+			}
+			else
+			{
+				WaitForSingleObject(g_hStopEvent, INFINITE);
+			}
 
-			ControlService(
-				hService,
-				SERVICE_CONTROL_STOP,
-				&ss
-			);
+			ReportServiceStatus(SERVICE_STOP_PENDING, ERROR_SUCCESS);
 
-			CloseServiceHandle(hService);
+			if (bConsole)
+				PrintCounters(pConsumer);
 
-			DeleteService(hService);
+			StopConsumer(pConsumer);
 		}
+
+		CloseSinks();
+	}
+
+	UnloadDriver(hDriver);
+	CloseServiceHandle(hSCManager);
+
+	return dwError;
+}
+
+
+static DWORD WINAPI
+ServiceControlHandler(
+	DWORD dwControl,
+	DWORD dwEventType,
+	LPVOID pEventData,
+	LPVOID pContext
+)
+{
+	UNREFERENCED_PARAMETER(dwEventType);
+	UNREFERENCED_PARAMETER(pEventData);
+	UNREFERENCED_PARAMETER(pContext);
+
+	switch (dwControl)
+	{
+	case SERVICE_CONTROL_STOP:
+	case SERVICE_CONTROL_SHUTDOWN:
+		ReportServiceStatus(SERVICE_STOP_PENDING, ERROR_SUCCESS);
+		SetEvent(g_hStopEvent);
+		return NO_ERROR;
+
+	case SERVICE_CONTROL_INTERROGATE:
+		return NO_ERROR;
+	}
+
+	return ERROR_CALL_NOT_IMPLEMENTED;
+}
+
+
+static void WINAPI
+ServiceMain(
+	DWORD dwArgc,
+	LPTSTR* pszArgv
+)
+{
+	UNREFERENCED_PARAMETER(dwArgc);
+	UNREFERENCED_PARAMETER(pszArgv);
+
+	g_hServiceStatus = RegisterServiceCtrlHandlerEx(SERVICE_NAME, ServiceControlHandler, NULL);
+
+	if (!g_hServiceStatus)
+		return;
+
+	ReportServiceStatus(SERVICE_START_PENDING, ERROR_SUCCESS);
+	ReportServiceStatus(SERVICE_STOPPED, RunConsumer(false));
+}
+
+
+static BOOL WINAPI
+ConsoleCtrlHandler(
+	DWORD dwCtrlType
+)
+{
+	UNREFERENCED_PARAMETER(dwCtrlType);
+
+	SetEvent(g_hStopEvent);
+
+	return TRUE;
+}
+
+
+//
+//	Registers this program as a service started on demand, passing it
+//	the options that follow "install".
+//
+static int
+InstallService(
+	int argc,
+	char* argv[]
+)
+{
+	char szCommand[4 * MAX_PATH];
+	char szPath[MAX_PATH];
+	SC_HANDLE hSCManager;
+	SC_HANDLE hService;
+	size_t cbUsed;
+	int iIndex;
+
+	if (!GetModuleFileNameA(NULL, szPath, MAX_PATH))
+		return 1;
+
+	cbUsed = (size_t)snprintf(szCommand, sizeof(szCommand), "\"%s\"", szPath);
+
+	for (iIndex = 0; iIndex < argc && cbUsed < sizeof(szCommand); iIndex++)
+		cbUsed += (size_t)snprintf(szCommand + cbUsed, sizeof(szCommand) - cbUsed, " \"%s\"", argv[iIndex]);
+
+	if (cbUsed >= sizeof(szCommand))
+	{
+		printf("The options are too long\n");
+		return 1;
+	}
+
+	hSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CREATE_SERVICE);
+
+	if (!hSCManager)
+	{
+		printf("OpenSCManager Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	hService = CreateServiceA(
+		hSCManager,
+		"6FingsSrvc",
+		"6Fings Consumer",
+		SERVICE_QUERY_STATUS,
+		SERVICE_WIN32_OWN_PROCESS,
+		SERVICE_DEMAND_START,
+		SERVICE_ERROR_NORMAL,
+		szCommand,
+		NULL,
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	if (!hService)
+	{
+		printf("CreateService Failed! (%lu)\n", GetLastError());
+		CloseServiceHandle(hSCManager);
+		return 1;
+	}
+
+	printf("Installed %s\n", szCommand);
+
+	CloseServiceHandle(hService);
+	CloseServiceHandle(hSCManager);
+
+	return 0;
+}
+
+
+static int
+RemoveService(void)
+{
+	SC_HANDLE hSCManager;
+	SC_HANDLE hService;
+	SERVICE_STATUS ss;
+	BOOL bRet;
+
+	hSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+
+	if (!hSCManager)
+	{
+		printf("OpenSCManager Failed! (%lu)\n", GetLastError());
+		return 1;
+	}
+
+	hService = OpenService(hSCManager, SERVICE_NAME, SERVICE_STOP | DELETE);
+
+	if (!hService)
+	{
+		printf("OpenService Failed! (%lu)\n", GetLastError());
 		CloseServiceHandle(hSCManager);
+		return 1;
+	}
+
+	ControlService(hService, SERVICE_CONTROL_STOP, &ss);
+	bRet = DeleteService(hService);
+
+	if (!bRet)
+		printf("DeleteService Failed! (%lu)\n", GetLastError());
+
+	CloseServiceHandle(hService);
+	CloseServiceHandle(hSCManager);
+
+	return bRet ? 0 : 1;
+}
+
+
+//
+//	Prints the messages of the spool from ullSequence on, each after its
+//	sequence number.
+//
+static int
+ReplaySpool(
+	const char* pszDirectory,
+	ULONGLONG ullSequence
+)
+{
+	SPOOL_READER* pReader;
+	SPOOL_MESSAGE Message;
+
+	pReader = SpoolOpenReader(pszDirectory, ullSequence);
+
+	if (!pReader)
+	{
+		printf("There is no spool in %s\n", pszDirectory);
+		return 1;
+	}
+
+	while (SpoolRead(pReader, &Message))
+		printf("%llu %.*s\n", (unsigned long long)Message.ullSequence, (int)Message.ulLength, (const char*)Message.pData);
+
+	SpoolCloseReader(pReader);
+
+	return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	SERVICE_TABLE_ENTRY ServiceTable[] =
+	{
+		{ (LPTSTR)SERVICE_NAME, ServiceMain },
+		{ NULL, NULL },
+	};
+
+	if (argc > 1 && _stricmp(argv[1], "install") == 0)
+	{
+		if (!ParseOptions(argc - 2, argv + 2))
+		{
+			PrintUsage();
+			return 1;
+		}
+
+		return InstallService(argc - 2, argv + 2);
 	}
+
+	if (argc > 1 && _stricmp(argv[1], "remove") == 0)
+		return RemoveService();
+
+	if (argc > 1 && _stricmp(argv[1], "replay") == 0)
+	{
+		if (argc != 3 && argc != 4)
+		{
+			PrintUsage();
+			return 1;
+		}
+
+		return ReplaySpool(argv[2], argc == 4 ? strtoull(argv[3], NULL, 10) : 0);
+	}
+
+	if (argc > 1 && _stricmp(argv[1], "spool-bench") == 0)
+		return RunSpoolBenchmark(argc - 2, argv + 2);
+
+	if (!ParseOptions(argc - 1, argv + 1))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	g_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!g_hStopEvent)
+		return 1;
+
+	//
+	//	Started from a console rather than by the service control manager,
+	//	consume until Ctrl+C.
+	//
+	if (!StartServiceCtrlDispatcher(ServiceTable))
+	{
+		if (GetLastError() != ERROR_FAILED_SERVICE_CONTROLLER_CONNECT)
+			return 1;
+
+		SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+		return (int)RunConsumer(true);
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
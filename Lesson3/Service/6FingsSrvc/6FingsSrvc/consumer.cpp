@@ -0,0 +1,481 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	consumer.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the consumer draining the device through an			*
+* 	I/O completion port. Reads are not tied to a worker, whichever one			*
+* 	dequeues a completion hands its messages to the sinks and issues			*
+* 	the read again, so the pool grows with the processors and no single			*
+* 	thread sees every message.													*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <Windows.h>
+#include <winioctl.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "6fingsioctl.h"
+#include "consumer.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Completion keys. Reads complete with CONSUMER_KEY_READ, the consumer
+//	posts CONSUMER_KEY_ISSUE to have a worker issue a read the first time
+//	and CONSUMER_KEY_STOP to have one exit.
+//
+#define CONSUMER_KEY_READ			0
+#define CONSUMER_KEY_ISSUE			1
+#define CONSUMER_KEY_STOP			2
+
+//
+//	A read that failed is issued again after this long, so a device in
+//	trouble does not keep the workers spinning.
+//
+#define CONSUMER_RETRY_DELAY_MS		100
+
+//
+//	How often StopConsumer cancels again while reads are still in flight.
+//
+#define CONSUMER_CANCEL_INTERVAL_MS	100
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	One read kept in flight. Only the worker that completed it touches it
+//	until it is issued again, the counters included, QueryConsumer reads
+//	them without a lock. pMessages has room for every record that fits
+//	in pBuffer.
+//
+typedef struct _CONSUMER_READ
+{
+	OVERLAPPED Overlapped;
+	CONSUMER* pConsumer;
+	char* pBuffer;
+	SINK_MESSAGE* pMessages;
+
+	volatile ULONG64 ullReads;
+	volatile ULONG64 ullMessages;
+	volatile ULONG64 ullBytes;
+	volatile ULONG64 ullReadsFailed;
+
+} CONSUMER_READ;
+
+
+//
+//	lReadsInFlight counts the reads issued and not retired, the last one
+//	retired after lStopping was set signals hIdleEvent.
+//
+struct _CONSUMER
+{
+	CONSUMER_CONFIG Config;
+	HANDLE hDevice;
+	HANDLE hPort;
+	HANDLE hIdleEvent;
+	volatile LONG lStopping;
+	volatile LONG lReadsInFlight;
+
+	std::vector<CONSUMER_READ> Reads;
+	std::vector<char> Buffers;
+	std::vector<SINK_MESSAGE> Messages;
+	std::vector<std::thread> Workers;
+};
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	Splits what a read returned into its records and hands them to every
+//	sink in one call each.
+//
+static void
+DeliverRecords(
+	CONSUMER_READ* pRead,
+	DWORD dwBytes
+)
+{
+	const CONSUMER_CONFIG* pConfig = &pRead->pConsumer->Config;
+	const FINGS_READ_RECORD* pRecord;
+	DWORD dwOffset = 0;
+	ULONG ulCount = 0;
+	ULONG ulIndex;
+
+	while (dwBytes - dwOffset >= FIELD_OFFSET(FINGS_READ_RECORD, Data))
+	{
+		pRecord = (const FINGS_READ_RECORD*)(pRead->pBuffer + dwOffset);
+
+		if (!pRecord->ulLength || pRecord->ulLength > dwBytes - dwOffset - FIELD_OFFSET(FINGS_READ_RECORD, Data))
+			break;
+
+		pRead->pMessages[ulCount].pData = pRecord->Data;
+		pRead->pMessages[ulCount].ulLength = pRecord->ulLength - 1;
+		pRead->ullBytes += pRecord->ulLength;
+		ulCount++;
+
+		dwOffset += FINGS_READ_RECORD_SIZE(pRecord->ulLength);
+	}
+
+	pRead->ullReads++;
+	pRead->ullMessages += ulCount;
+
+	if (!ulCount)
+		return;
+
+	for (ulIndex = 0; ulIndex < pConfig->ulSinkCount; ulIndex++)
+		pConfig->pSinks[ulIndex]->Write(pConfig->pSinkContexts[ulIndex], pRead->pMessages, ulCount);
+}
+
+
+//
+//	Counts a read that failed and gives the device time before the read
+//	is issued again. A cancelled read is not a failure.
+//
+static void
+FailRead(
+	CONSUMER_READ* pRead,
+	DWORD dwError
+)
+{
+	if (dwError == ERROR_OPERATION_ABORTED)
+		return;
+
+	pRead->ullReadsFailed++;
+
+	if (!pRead->pConsumer->lStopping)
+		Sleep(CONSUMER_RETRY_DELAY_MS);
+}
+
+
+//
+//	Issues the read until it pends, or retires it once the consumer is
+//	stopping. Reads the driver completes at once are handled right here,
+//	the port skips them, so a busy device is drained without a trip
+//	through the port per read.
+//
+static void
+IssueRead(
+	CONSUMER_READ* pRead
+)
+{
+	CONSUMER* pConsumer = pRead->pConsumer;
+	DWORD dwBytes;
+	DWORD dwError;
+
+	for (;;)
+	{
+		if (pConsumer->lStopping)
+		{
+			if (!InterlockedDecrement(&pConsumer->lReadsInFlight))
+				SetEvent(pConsumer->hIdleEvent);
+
+			return;
+		}
+
+		ZeroMemory(&pRead->Overlapped, sizeof(pRead->Overlapped));
+
+		if (ReadFile(pConsumer->hDevice, pRead->pBuffer, pConsumer->Config.ulReadLength, &dwBytes, &pRead->Overlapped))
+		{
+			DeliverRecords(pRead, dwBytes);
+			continue;
+		}
+
+		dwError = GetLastError();
+
+		if (dwError == ERROR_IO_PENDING)
+			return;
+
+		FailRead(pRead, dwError);
+	}
+}
+
+
+static void
+ConsumerWorker(
+	CONSUMER* pConsumer
+)
+{
+	LPOVERLAPPED pOverlapped;
+	CONSUMER_READ* pRead;
+	ULONG_PTR ulKey;
+	DWORD dwBytes;
+	BOOL bRet;
+
+	for (;;)
+	{
+		bRet = GetQueuedCompletionStatus(pConsumer->hPort, &dwBytes, &ulKey, &pOverlapped, INFINITE);
+
+		if (!pOverlapped)
+		{
+			if (ulKey == CONSUMER_KEY_STOP || !bRet)
+				break;
+
+			continue;
+		}
+
+		pRead = CONTAINING_RECORD(pOverlapped, CONSUMER_READ, Overlapped);
+
+		if (ulKey == CONSUMER_KEY_READ)
+		{
+			if (bRet)
+				DeliverRecords(pRead, dwBytes);
+			else
+				FailRead(pRead, GetLastError());
+		}
+
+		IssueRead(pRead);
+	}
+}
+
+
+//
+//	Closes what StartConsumer opened. The workers are gone by then.
+//
+static void
+DeleteConsumer(
+	CONSUMER* pConsumer
+)
+{
+	if (pConsumer->hPort)
+		CloseHandle(pConsumer->hPort);
+
+	if (pConsumer->hDevice != INVALID_HANDLE_VALUE)
+		CloseHandle(pConsumer->hDevice);
+
+	if (pConsumer->hIdleEvent)
+		CloseHandle(pConsumer->hIdleEvent);
+
+	delete pConsumer;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StartConsumer
+//
+//	Parameters:
+//		[IN]  const CONSUMER_CONFIG* pConfig
+//		Device, pool and sinks to use, copied.
+//
+//	Routine Description:
+//		Opens the device for overlapped I/O, binds it to a new completion
+//		port, starts the workers and issues every read.
+//
+//	Return Value:
+//		CONSUMER*.
+//		The running consumer, NULL with the last error set on failure.
+//
+//***********************************************************************************
+CONSUMER*
+StartConsumer(
+	const CONSUMER_CONFIG* pConfig
+)
+{
+	CONSUMER* pConsumer = new CONSUMER();
+	SYSTEM_INFO SystemInfo;
+	CONSUMER_READ* pRead;
+	ULONG ulMessagesPerRead;
+	ULONG ulReadCount;
+	ULONG ulIndex;
+	DWORD dwError;
+
+	pConsumer->Config = *pConfig;
+	pConsumer->hDevice = INVALID_HANDLE_VALUE;
+
+	if (!pConsumer->Config.ulWorkers)
+	{
+		GetSystemInfo(&SystemInfo);
+		pConsumer->Config.ulWorkers = SystemInfo.dwNumberOfProcessors;
+	}
+
+	if (pConsumer->Config.ulWorkers > CONSUMER_MAX_WORKERS)
+		pConsumer->Config.ulWorkers = CONSUMER_MAX_WORKERS;
+
+	if (!pConsumer->Config.ulReadsPerWorker)
+		pConsumer->Config.ulReadsPerWorker = CONSUMER_DEFAULT_READS;
+
+	if (!pConsumer->Config.ulReadLength)
+		pConsumer->Config.ulReadLength = CONSUMER_DEFAULT_READ_LENGTH;
+
+	if (pConsumer->Config.ulReadLength < FINGS_READ_RECORD_SIZE(1))
+	{
+		DeleteConsumer(pConsumer);
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return NULL;
+	}
+
+	pConsumer->hIdleEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	pConsumer->hDevice = CreateFileA(
+		pConfig->pszDevice,
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL,
+		OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED,
+		NULL
+	);
+
+	if (!pConsumer->hIdleEvent || pConsumer->hDevice == INVALID_HANDLE_VALUE)
+	{
+		dwError = GetLastError();
+		DeleteConsumer(pConsumer);
+		SetLastError(dwError);
+		return NULL;
+	}
+
+	//
+	//	A read the driver completes right away is handled by the thread that
+	//	issued it, and nobody waits on the handle itself.
+	//
+	SetFileCompletionNotificationModes(
+		pConsumer->hDevice,
+		FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE
+	);
+
+	pConsumer->hPort = CreateIoCompletionPort(pConsumer->hDevice, NULL, CONSUMER_KEY_READ, pConsumer->Config.ulWorkers);
+
+	if (!pConsumer->hPort)
+	{
+		dwError = GetLastError();
+		DeleteConsumer(pConsumer);
+		SetLastError(dwError);
+		return NULL;
+	}
+
+	ulReadCount = pConsumer->Config.ulWorkers * pConsumer->Config.ulReadsPerWorker;
+	ulMessagesPerRead = pConsumer->Config.ulReadLength / FINGS_READ_RECORD_SIZE(1) + 1;
+
+	pConsumer->Reads.resize(ulReadCount);
+	pConsumer->Buffers.resize((size_t)ulReadCount * pConsumer->Config.ulReadLength);
+	pConsumer->Messages.resize((size_t)ulReadCount * ulMessagesPerRead);
+
+	for (ulIndex = 0; ulIndex < ulReadCount; ulIndex++)
+	{
+		pRead = &pConsumer->Reads[ulIndex];
+		pRead->pConsumer = pConsumer;
+		pRead->pBuffer = &pConsumer->Buffers[(size_t)ulIndex * pConsumer->Config.ulReadLength];
+		pRead->pMessages = &pConsumer->Messages[(size_t)ulIndex * ulMessagesPerRead];
+	}
+
+	for (ulIndex = 0; ulIndex < pConsumer->Config.ulWorkers; ulIndex++)
+		pConsumer->Workers.push_back(std::thread(ConsumerWorker, pConsumer));
+
+	//
+	//	The workers issue the reads, a read completing at once keeps its
+	//	thread draining the device and this one has to return.
+	//
+	pConsumer->lReadsInFlight = (LONG)ulReadCount;
+
+	for (ulIndex = 0; ulIndex < ulReadCount; ulIndex++)
+		PostQueuedCompletionStatus(pConsumer->hPort, 0, CONSUMER_KEY_ISSUE, &pConsumer->Reads[ulIndex].Overlapped);
+
+	return pConsumer;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		QueryConsumer
+//
+//	Parameters:
+//		[IN]  CONSUMER* pConsumer
+//		Consumer returned by StartConsumer.
+//
+//		[OUT]  CONSUMER_COUNTERS* pCounters
+//		Receives the counters, summed over the reads.
+//
+//	Routine Description:
+//		Takes a snapshot of the counters while the workers run.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+QueryConsumer(
+	CONSUMER* pConsumer,
+	CONSUMER_COUNTERS* pCounters
+)
+{
+	ZeroMemory(pCounters, sizeof(*pCounters));
+
+	for (const CONSUMER_READ& Read : pConsumer->Reads)
+	{
+		pCounters->ullReads += Read.ullReads;
+		pCounters->ullMessages += Read.ullMessages;
+		pCounters->ullBytes += Read.ullBytes;
+		pCounters->ullReadsFailed += Read.ullReadsFailed;
+	}
+
+	pCounters->ulWorkers = pConsumer->Config.ulWorkers;
+	pCounters->ulReadsInFlight = (ULONG)pConsumer->lReadsInFlight;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		StopConsumer
+//
+//	Parameters:
+//		[IN]  CONSUMER* pConsumer
+//		Consumer returned by StartConsumer.
+//
+//	Routine Description:
+//		Cancels the reads in flight, waits for the workers to finish with
+//		them and exit, flushes the sinks and frees the consumer. The sinks
+//		are left open for the caller to close.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+StopConsumer(
+	CONSUMER* pConsumer
+)
+{
+	ULONG ulIndex;
+
+	InterlockedExchange(&pConsumer->lStopping, 1);
+
+	//
+	//	A worker may issue a read again after the first cancel, having
+	//	looked at lStopping just before, so cancel until they are all back.
+	//
+	do
+	{
+		CancelIoEx(pConsumer->hDevice, NULL);
+
+	} while (WaitForSingleObject(pConsumer->hIdleEvent, CONSUMER_CANCEL_INTERVAL_MS) == WAIT_TIMEOUT);
+
+	for (ulIndex = 0; ulIndex < pConsumer->Workers.size(); ulIndex++)
+		PostQueuedCompletionStatus(pConsumer->hPort, 0, CONSUMER_KEY_STOP, NULL);
+
+	for (std::thread& Worker : pConsumer->Workers)
+		Worker.join();
+
+	for (ulIndex = 0; ulIndex < pConsumer->Config.ulSinkCount; ulIndex++)
+		pConsumer->Config.pSinks[ulIndex]->Flush(pConsumer->Config.pSinkContexts[ulIndex]);
+
+	DeleteConsumer(pConsumer);
+}
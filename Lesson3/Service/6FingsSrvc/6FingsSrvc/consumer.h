@@ -0,0 +1,156 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	consumer.h																	*
+*																				*
+* Abstract:																		*
+* 	This file declares the consumer draining the device. It keeps				*
+* 	overlapped reads in flight on an I/O completion port serviced by a			*
+* 	pool of workers, one per processor by default, and hands what each			*
+* 	read returned to the sinks.													*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Include <Windows.h> first.
+//
+#include "sink.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define CONSUMER_MAX_WORKERS			256
+#define CONSUMER_MAX_SINKS				8
+#define CONSUMER_DEFAULT_READS			4
+#define CONSUMER_DEFAULT_READ_LENGTH	(64 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	ulWorkers threads wait on the port, 0 is one per processor. Each of
+//	them adds ulReadsPerWorker reads of ulReadLength bytes to the ones in
+//	flight. Every message goes to each of the ulSinkCount sinks, opened
+//	by the caller, pSinkContexts holding what their Open returned. A read
+//	has to fit the longest message written to the device, the driver
+//	fails shorter ones and the message stays in front of the others.
+//
+typedef struct _CONSUMER_CONFIG
+{
+	const char* pszDevice;
+	ULONG ulWorkers;
+	ULONG ulReadsPerWorker;
+	ULONG ulReadLength;
+
+	const SINK* pSinks[CONSUMER_MAX_SINKS];
+	void* pSinkContexts[CONSUMER_MAX_SINKS];
+	ULONG ulSinkCount;
+
+} CONSUMER_CONFIG;
+
+
+//
+//	Counters since the consumer started. Failed reads are the ones that
+//	completed with an error other than being cancelled on stop.
+//
+typedef struct _CONSUMER_COUNTERS
+{
+	ULONG64 ullReads;
+	ULONG64 ullMessages;
+	ULONG64 ullBytes;
+	ULONG64 ullReadsFailed;
+	ULONG ulWorkers;
+	ULONG ulReadsInFlight;
+
+} CONSUMER_COUNTERS;
+
+
+typedef struct _CONSUMER CONSUMER;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		StartConsumer
+//
+//	Parameters:
+//		[IN]  const CONSUMER_CONFIG* pConfig
+//		Device, pool and sinks to use, copied.
+//
+//	Routine Description:
+//		Opens the device for overlapped I/O, binds it to a new completion
+//		port, starts the workers and issues every read.
+//
+//	Return Value:
+//		CONSUMER*.
+//		The running consumer, NULL with the last error set on failure.
+//
+//***********************************************************************************
+CONSUMER*
+StartConsumer(
+	const CONSUMER_CONFIG* pConfig
+);
+
+
+//***********************************************************************************
+//	Function:
+//		QueryConsumer
+//
+//	Parameters:
+//		[IN]  CONSUMER* pConsumer
+//		Consumer returned by StartConsumer.
+//
+//		[OUT]  CONSUMER_COUNTERS* pCounters
+//		Receives the counters, summed over the reads.
+//
+//	Routine Description:
+//		Takes a snapshot of the counters while the workers run.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+QueryConsumer(
+	CONSUMER* pConsumer,
+	CONSUMER_COUNTERS* pCounters
+);
+
+
+//***********************************************************************************
+//	Function:
+//		StopConsumer
+//
+//	Parameters:
+//		[IN]  CONSUMER* pConsumer
+//		Consumer returned by StartConsumer.
+//
+//	Routine Description:
+//		Cancels the reads in flight, waits for the workers to finish with
+//		them and exit, flushes the sinks and frees the consumer. The sinks
+//		are left open for the caller to close.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+StopConsumer(
+	CONSUMER* pConsumer
+);
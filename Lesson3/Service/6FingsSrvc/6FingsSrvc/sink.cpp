@@ -0,0 +1,384 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	sink.cpp																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the sinks the consumer hands messages to.				*
+* 	Sinks build each batch in a buffer of the calling worker and pass			*
+* 	it on in one call, so workers only meet in the stream or the file.			*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <Windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "sink.h"
+#include "spool.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef struct _FILE_SINK
+{
+	HANDLE hFile;
+
+} FILE_SINK;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	The messages of a batch one per line, in the calling thread's buffer.
+//
+static const std::string&
+FormatBatch(
+	const SINK_MESSAGE* pMessages,
+	ULONG ulCount
+)
+{
+	static thread_local std::string Batch;
+	ULONG ulIndex;
+
+	Batch.clear();
+
+	for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+	{
+		Batch.append(pMessages[ulIndex].pData, pMessages[ulIndex].ulLength);
+		Batch.push_back('\n');
+	}
+
+	return Batch;
+}
+
+
+static void*
+NullOpen(
+	const char* pszOptions
+)
+{
+	static int iNull;
+
+	UNREFERENCED_PARAMETER(pszOptions);
+
+	return &iNull;
+}
+
+
+static void
+NullWrite(
+	void* pSink,
+	const SINK_MESSAGE* pMessages,
+	ULONG ulCount
+)
+{
+	UNREFERENCED_PARAMETER(pSink);
+	UNREFERENCED_PARAMETER(pMessages);
+	UNREFERENCED_PARAMETER(ulCount);
+}
+
+
+static void
+NullFlush(
+	void* pSink
+)
+{
+	UNREFERENCED_PARAMETER(pSink);
+}
+
+
+static void
+NullClose(
+	void* pSink
+)
+{
+	UNREFERENCED_PARAMETER(pSink);
+}
+
+
+static void*
+ConsoleOpen(
+	const char* pszOptions
+)
+{
+	UNREFERENCED_PARAMETER(pszOptions);
+
+	return stdout;
+}
+
+
+//
+//	One fwrite per batch, the CRT keeps the lines of a batch together.
+//
+static void
+ConsoleWrite(
+	void* pSink,
+	const SINK_MESSAGE* pMessages,
+	ULONG ulCount
+)
+{
+	const std::string& Batch = FormatBatch(pMessages, ulCount);
+
+	fwrite(Batch.data(), 1, Batch.size(), (FILE*)pSink);
+}
+
+
+static void
+ConsoleFlush(
+	void* pSink
+)
+{
+	fflush((FILE*)pSink);
+}
+
+
+static void
+ConsoleClose(
+	void* pSink
+)
+{
+	fflush((FILE*)pSink);
+}
+
+
+static void*
+FileOpen(
+	const char* pszOptions
+)
+{
+	FILE_SINK* pFileSink;
+	HANDLE hFile;
+
+	if (!pszOptions || !*pszOptions)
+	{
+		printf("The file sink needs a file name, file:<path>\n");
+		return NULL;
+	}
+
+	//
+	//	Opened for appending only, every write lands at the end of the
+	//	file as a whole, whichever worker makes it.
+	//
+	hFile = CreateFileA(
+		pszOptions,
+		FILE_APPEND_DATA,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL
+	);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printf("Cannot open %s (%lu)\n", pszOptions, GetLastError());
+		return NULL;
+	}
+
+	pFileSink = new FILE_SINK;
+	pFileSink->hFile = hFile;
+
+	return pFileSink;
+}
+
+
+static void
+FileWrite(
+	void* pSink,
+	const SINK_MESSAGE* pMessages,
+	ULONG ulCount
+)
+{
+	FILE_SINK* pFileSink = (FILE_SINK*)pSink;
+	const std::string& Batch = FormatBatch(pMessages, ulCount);
+	DWORD dwWritten;
+
+	WriteFile(pFileSink->hFile, Batch.data(), (DWORD)Batch.size(), &dwWritten, NULL);
+}
+
+
+static void
+FileFlush(
+	void* pSink
+)
+{
+	FlushFileBuffers(((FILE_SINK*)pSink)->hFile);
+}
+
+
+static void
+FileClose(
+	void* pSink
+)
+{
+	FILE_SINK* pFileSink = (FILE_SINK*)pSink;
+
+	CloseHandle(pFileSink->hFile);
+	delete pFileSink;
+}
+
+
+static void*
+SpoolSinkOpen(
+	const char* pszOptions
+)
+{
+	SPOOL_CONFIG Config;
+	SPOOL* pSpool;
+
+	if (!pszOptions || !*pszOptions)
+	{
+		printf("The spool sink needs a directory, spool:<directory>\n");
+		return NULL;
+	}
+
+	CreateDirectoryA(pszOptions, NULL);
+
+	memset(&Config, 0, sizeof(Config));
+	Config.pszDirectory = pszOptions;
+
+	pSpool = SpoolOpen(&Config);
+
+	if (!pSpool)
+		printf("Cannot open the spool in %s\n", pszOptions);
+
+	return pSpool;
+}
+
+
+//
+//	The batch is appended in one go without waiting for the commit, the
+//	spool's flusher commits every worker's batches together.
+//
+static void
+SpoolSinkWrite(
+	void* pSink,
+	const SINK_MESSAGE* pMessages,
+	ULONG ulCount
+)
+{
+	static thread_local std::vector<SPOOL_MESSAGE> Batch;
+	ULONG ulIndex;
+
+	Batch.resize(ulCount);
+
+	for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+	{
+		Batch[ulIndex].pData = pMessages[ulIndex].pData;
+		Batch[ulIndex].ulLength = pMessages[ulIndex].ulLength;
+	}
+
+	SpoolAppend((SPOOL*)pSink, Batch.data(), ulCount, false);
+}
+
+
+//
+//	Closing commits what is left.
+//
+static void
+SpoolSinkFlush(
+	void* pSink
+)
+{
+	UNREFERENCED_PARAMETER(pSink);
+}
+
+
+static void
+SpoolSinkClose(
+	void* pSink
+)
+{
+	SpoolClose((SPOOL*)pSink);
+}
+
+
+const SINK g_NullSink =
+{
+	"null",
+	NullOpen,
+	NullWrite,
+	NullFlush,
+	NullClose,
+};
+
+const SINK g_ConsoleSink =
+{
+	"console",
+	ConsoleOpen,
+	ConsoleWrite,
+	ConsoleFlush,
+	ConsoleClose,
+};
+
+const SINK g_FileSink =
+{
+	"file",
+	FileOpen,
+	FileWrite,
+	FileFlush,
+	FileClose,
+};
+
+const SINK g_SpoolSink =
+{
+	"spool",
+	SpoolSinkOpen,
+	SpoolSinkWrite,
+	SpoolSinkFlush,
+	SpoolSinkClose,
+};
+
+
+//***********************************************************************************
+//	Function:
+//		FindSink
+//
+//	Parameters:
+//		[IN]  const char* pszName
+//		Name of the sink.
+//
+//	Routine Description:
+//		Looks a sink up by name, ignoring case.
+//
+//	Return Value:
+//		const SINK*.
+//		The sink, NULL if there is none by that name.
+//
+//***********************************************************************************
+const SINK*
+FindSink(
+	const char* pszName
+)
+{
+	static const SINK* Sinks[] =
+	{
+		&g_NullSink,
+		&g_ConsoleSink,
+		&g_FileSink,
+		&g_SpoolSink,
+	};
+	unsigned int uiIndex;
+
+	for (uiIndex = 0; uiIndex < sizeof(Sinks) / sizeof(Sinks[0]); uiIndex++)
+	{
+		if (_stricmp(pszName, Sinks[uiIndex]->pszName) == 0)
+			return Sinks[uiIndex];
+	}
+
+	return NULL;
+}
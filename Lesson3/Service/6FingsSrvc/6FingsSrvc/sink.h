@@ -0,0 +1,119 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	sink.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the sinks the consumer hands messages to. A sink			*
+* 	is a table of entry points, like a TRANSPORT of the client, so new			*
+* 	ones plug in by adding a table to FindSink.									*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Include <Windows.h> first.
+//
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	A message read from the device, ulLength bytes without the NULL
+//	character that follows them. Only valid during the call to Write.
+//
+typedef struct _SINK_MESSAGE
+{
+	const char* pData;
+	ULONG ulLength;
+
+} SINK_MESSAGE;
+
+
+//
+//	Entry points of a sink. Open is called once when the service starts.
+//	Write is called by every worker of the consumer at the same time, with
+//	the messages of one read in the order the driver returned them, and
+//	has to be safe for that without serializing the workers for long.
+//	Flush and Close are only called once the workers stopped.
+//
+typedef struct _SINK
+{
+	const char* pszName;
+
+	//
+	//	pszOptions is sink specific, NULL selects the defaults.
+	//	Returns NULL on failure.
+	//
+	void* (*Open)(const char* pszOptions);
+
+	void (*Write)(void* pSink, const SINK_MESSAGE* pMessages, ULONG ulCount);
+
+	void (*Flush)(void* pSink);
+
+	void (*Close)(void* pSink);
+
+} SINK;
+
+
+/////////////////////////////////////////////////////////////////////
+//	G L O B A L S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Drops the messages, the consumer still counts them.
+//
+extern const SINK g_NullSink;
+
+//
+//	Prints the messages on stdout, one per line.
+//
+extern const SINK g_ConsoleSink;
+
+//
+//	Appends the messages to the file named by the option, one per line.
+//
+extern const SINK g_FileSink;
+
+//
+//	Appends the messages to the spool in the directory named by the
+//	option, for 6FingsSrvc replay to read back.
+//
+extern const SINK g_SpoolSink;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		FindSink
+//
+//	Parameters:
+//		[IN]  const char* pszName
+//		Name of the sink.
+//
+//	Routine Description:
+//		Looks a sink up by name, ignoring case.
+//
+//	Return Value:
+//		const SINK*.
+//		The sink, NULL if there is none by that name.
+//
+//***********************************************************************************
+const SINK*
+FindSink(
+	const char* pszName
+);
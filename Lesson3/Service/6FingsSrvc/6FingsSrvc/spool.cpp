@@ -0,0 +1,1250 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	spool.cpp																	*
+*																				*
+* Abstract:																		*
+* 	This file implements the spool. Each segment file starts with a				*
+* 	header, records follow it one after the other, 8 byte aligned, and			*
+* 	the first record header still zero marks the end. A record is				*
+* 	published by storing its checksum last, so a reader mapping the				*
+* 	segment, in this process or another, never sees half of one.				*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spool.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define SPOOL_SEGMENT_MAGIC		0x4C505336		// "6SPL" in a hex dump
+#define SPOOL_SEGMENT_VERSION	1
+
+#define SPOOL_MIN_SEGMENT_SIZE	(1024 * 1024)
+
+//
+//	Segments and their indexes are named after the sequence number of
+//	their first message, zero padded so they also sort by name.
+//
+#define SPOOL_SEGMENT_FORMAT	"%s/%020llu.seg"
+#define SPOOL_INDEX_FORMAT		"%s/%020llu.idx"
+#define SPOOL_NAME_LENGTH		24
+
+#define SPOOL_RECORD_SIZE(length)	((sizeof(SPOOL_RECORD) + (uint64_t)(length) + 7) & ~(uint64_t)7)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	ullEndOffset stays 0 until the segment is full and the writer moved
+//	on, then it is where its records end.
+//
+typedef struct _SPOOL_SEGMENT_HEADER
+{
+	uint32_t ulMagic;
+	uint32_t ulVersion;
+	uint64_t ullSegmentSize;
+	uint64_t ullFirstSequence;
+	uint64_t ullEndOffset;
+	uint8_t Reserved[32];
+
+} SPOOL_SEGMENT_HEADER;
+
+
+//
+//	ulChecksum covers the sequence number, the length and the data and
+//	is never 0, the data follows the structure.
+//
+typedef struct _SPOOL_RECORD
+{
+	uint32_t ulLength;
+	uint32_t ulChecksum;
+	uint64_t ullSequence;
+
+} SPOOL_RECORD;
+
+
+//
+//	An index file is an array of these, sorted.
+//
+typedef struct _SPOOL_INDEX_ENTRY
+{
+	uint64_t ullSequence;
+	uint64_t ullOffset;
+
+} SPOOL_INDEX_ENTRY;
+
+
+typedef struct _SPOOL_MAPPING
+{
+	uint8_t* pBase;
+	uint64_t ullSize;
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#else
+	int iFile;
+#endif
+
+} SPOOL_MAPPING;
+
+
+struct _SPOOL
+{
+	std::string Directory;
+	uint64_t ullSegmentSize;
+	uint32_t ulMaxSegments;
+	uint32_t ulCommitMs;
+	uint32_t ulCommitBytes;
+
+	//
+	//	Lock guards everything below. Appenders copy their messages in
+	//	under it, the flusher only drops it while it flushes.
+	//
+	std::mutex Lock;
+	std::condition_variable CommitNeeded;
+	std::condition_variable Committed;
+	std::thread Flusher;
+
+	//
+	//	First sequence numbers of the segments kept, oldest first, the
+	//	last one is the segment mapped.
+	//
+	std::vector<uint64_t> Segments;
+	SPOOL_MAPPING Mapping;
+	FILE* pIndex;
+	uint64_t ullIndexedOffset;
+
+	uint64_t ullOffset;
+	uint64_t ullFlushedOffset;
+	uint64_t ullNextSequence;
+	uint64_t ullCommittedSequence;
+	uint32_t ulPendingBytes;
+	uint32_t ulWaiters;
+	uint32_t ulCommitFailures;
+	bool bFlushing;
+	bool bRolling;
+	bool bStopping;
+};
+
+
+struct _SPOOL_READER
+{
+	std::string Directory;
+	SPOOL_MAPPING Mapping;
+	uint64_t ullOffset;
+	uint64_t ullNextSequence;
+};
+
+
+static_assert(sizeof(SPOOL_SEGMENT_HEADER) == 64, "the records start at offset 64");
+static_assert(sizeof(SPOOL_RECORD) == 16, "records are 8 byte aligned");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "checksums are accessed atomically in place");
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "end offsets are accessed atomically in place");
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+//
+//	FNV-1a of the record, 0 is kept for "not written yet".
+//
+static uint32_t
+RecordChecksum(
+	uint64_t ullSequence,
+	uint32_t ulLength,
+	const void* pData
+)
+{
+	const uint8_t* pByte;
+	uint32_t ulHash = 2166136261u;
+	uint32_t ulIndex;
+
+	for (ulIndex = 0; ulIndex < 8; ulIndex++)
+		ulHash = (ulHash ^ (uint8_t)(ullSequence >> (8 * ulIndex))) * 16777619u;
+
+	for (ulIndex = 0; ulIndex < 4; ulIndex++)
+		ulHash = (ulHash ^ (uint8_t)(ulLength >> (8 * ulIndex))) * 16777619u;
+
+	pByte = (const uint8_t*)pData;
+
+	for (ulIndex = 0; ulIndex < ulLength; ulIndex++)
+		ulHash = (ulHash ^ pByte[ulIndex]) * 16777619u;
+
+	return ulHash ? ulHash : 1;
+}
+
+
+static std::atomic<uint32_t>*
+RecordChecksumField(
+	uint8_t* pRecord
+)
+{
+	return (std::atomic<uint32_t>*)&((SPOOL_RECORD*)pRecord)->ulChecksum;
+}
+
+
+static std::atomic<uint64_t>*
+EndOffsetField(
+	uint8_t* pBase
+)
+{
+	return (std::atomic<uint64_t>*)&((SPOOL_SEGMENT_HEADER*)pBase)->ullEndOffset;
+}
+
+
+static std::string
+SegmentPath(
+	const std::string& Directory,
+	const char* pszFormat,
+	uint64_t ullFirstSequence
+)
+{
+	char szPath[1024];
+
+	snprintf(szPath, sizeof(szPath), pszFormat, Directory.c_str(), (unsigned long long)ullFirstSequence);
+
+	return szPath;
+}
+
+
+//
+//	Maps the file as long as it is. For a writer a file still too short
+//	for a header is new, it is created or grown to ullSize bytes.
+//
+static bool
+MapFile(
+	const std::string& Path,
+	uint64_t ullSize,
+	bool bWrite,
+	SPOOL_MAPPING* pMapping
+)
+{
+#ifdef _WIN32
+	LARGE_INTEGER FileSize;
+
+	pMapping->pBase = NULL;
+	pMapping->hMapping = NULL;
+
+	//
+	//	Shared for deleting too, so retention can remove a segment a
+	//	reader still has open.
+	//
+	pMapping->hFile = CreateFileA(
+		Path.c_str(),
+		bWrite ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL,
+		bWrite ? OPEN_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL
+	);
+
+	if (pMapping->hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (!GetFileSizeEx(pMapping->hFile, &FileSize))
+		goto Fail;
+
+	if (bWrite && FileSize.QuadPart < (LONGLONG)sizeof(SPOOL_SEGMENT_HEADER))
+	{
+		FileSize.QuadPart = (LONGLONG)ullSize;
+
+		if (!SetFilePointerEx(pMapping->hFile, FileSize, NULL, FILE_BEGIN) || !SetEndOfFile(pMapping->hFile))
+			goto Fail;
+	}
+
+	if (FileSize.QuadPart < (LONGLONG)sizeof(SPOOL_SEGMENT_HEADER))
+		goto Fail;
+
+	pMapping->ullSize = (uint64_t)FileSize.QuadPart;
+
+	pMapping->hMapping = CreateFileMappingA(pMapping->hFile, NULL, bWrite ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+
+	if (!pMapping->hMapping)
+		goto Fail;
+
+	pMapping->pBase = (uint8_t*)MapViewOfFile(pMapping->hMapping, bWrite ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+
+	if (!pMapping->pBase)
+		goto Fail;
+
+	return true;
+
+Fail:
+	if (pMapping->hMapping)
+		CloseHandle(pMapping->hMapping);
+
+	CloseHandle(pMapping->hFile);
+
+	return false;
+#else
+	struct stat Stat;
+	void* pBase;
+
+	pMapping->pBase = NULL;
+	pMapping->iFile = open(Path.c_str(), bWrite ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+
+	if (pMapping->iFile < 0)
+		return false;
+
+	if (fstat(pMapping->iFile, &Stat) != 0)
+		goto Fail;
+
+	if (bWrite && Stat.st_size < (off_t)sizeof(SPOOL_SEGMENT_HEADER))
+	{
+		if (ftruncate(pMapping->iFile, (off_t)ullSize) != 0)
+			goto Fail;
+
+		Stat.st_size = (off_t)ullSize;
+	}
+
+	if (Stat.st_size < (off_t)sizeof(SPOOL_SEGMENT_HEADER))
+		goto Fail;
+
+	pMapping->ullSize = (uint64_t)Stat.st_size;
+
+	pBase = mmap(NULL, (size_t)pMapping->ullSize, bWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, pMapping->iFile, 0);
+
+	if (pBase == MAP_FAILED)
+		goto Fail;
+
+	pMapping->pBase = (uint8_t*)pBase;
+
+	return true;
+
+Fail:
+	close(pMapping->iFile);
+
+	return false;
+#endif
+}
+
+
+static void
+UnmapFile(
+	SPOOL_MAPPING* pMapping
+)
+{
+	if (!pMapping->pBase)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(pMapping->pBase);
+	CloseHandle(pMapping->hMapping);
+	CloseHandle(pMapping->hFile);
+#else
+	munmap(pMapping->pBase, (size_t)pMapping->ullSize);
+	close(pMapping->iFile);
+#endif
+
+	pMapping->pBase = NULL;
+}
+
+
+//
+//	Writes bytes ullBegin to ullEnd of the mapping through to the disk.
+//
+static bool
+FlushMapping(
+	const SPOOL_MAPPING* pMapping,
+	uint64_t ullBegin,
+	uint64_t ullEnd
+)
+{
+	if (ullBegin >= ullEnd)
+		return true;
+
+#ifdef _WIN32
+	//
+	//	FlushViewOfFile only starts writing the pages, FlushFileBuffers
+	//	waits for them and the disk's cache.
+	//
+	if (!FlushViewOfFile(pMapping->pBase + ullBegin, (SIZE_T)(ullEnd - ullBegin)))
+		return false;
+
+	return FlushFileBuffers(pMapping->hFile) != FALSE;
+#else
+	uint64_t ullPage = (uint64_t)sysconf(_SC_PAGESIZE);
+
+	ullBegin &= ~(ullPage - 1);
+
+	return msync(pMapping->pBase + ullBegin, (size_t)(ullEnd - ullBegin), MS_SYNC) == 0;
+#endif
+}
+
+
+static bool
+RemoveFile(
+	const std::string& Path
+)
+{
+#ifdef _WIN32
+	return DeleteFileA(Path.c_str()) || GetLastError() == ERROR_FILE_NOT_FOUND;
+#else
+	return unlink(Path.c_str()) == 0 || errno == ENOENT;
+#endif
+}
+
+
+static FILE*
+OpenIndex(
+	const std::string& Path,
+	const char* pszMode
+)
+{
+	FILE* pIndex;
+
+#ifdef _WIN32
+	if (fopen_s(&pIndex, Path.c_str(), pszMode))
+		pIndex = NULL;
+#else
+	pIndex = fopen(Path.c_str(), pszMode);
+#endif
+
+	return pIndex;
+}
+
+
+//
+//	First sequence numbers of the segments in the directory, sorted.
+//
+static void
+ListSegments(
+	const std::string& Directory,
+	std::vector<uint64_t>& Segments
+)
+{
+	const char* pszName;
+
+	Segments.clear();
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA FindData;
+	HANDLE hFind;
+
+	hFind = FindFirstFileA((Directory + "\\*.seg").c_str(), &FindData);
+
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		pszName = FindData.cFileName;
+#else
+	struct dirent* pEntry;
+	DIR* pDirectory;
+
+	pDirectory = opendir(Directory.c_str());
+
+	if (!pDirectory)
+		return;
+
+	while ((pEntry = readdir(pDirectory)) != NULL)
+	{
+		pszName = pEntry->d_name;
+#endif
+		if (strlen(pszName) == SPOOL_NAME_LENGTH && strcmp(pszName + SPOOL_NAME_LENGTH - 4, ".seg") == 0)
+			Segments.push_back(strtoull(pszName, NULL, 10));
+#ifdef _WIN32
+	} while (FindNextFileA(hFind, &FindData));
+
+	FindClose(hFind);
+#else
+	}
+
+	closedir(pDirectory);
+#endif
+
+	std::sort(Segments.begin(), Segments.end());
+}
+
+
+static bool
+ValidHeader(
+	const SPOOL_MAPPING* pMapping
+)
+{
+	const SPOOL_SEGMENT_HEADER* pHeader = (const SPOOL_SEGMENT_HEADER*)pMapping->pBase;
+
+	return pHeader->ulMagic == SPOOL_SEGMENT_MAGIC &&
+		pHeader->ulVersion == SPOOL_SEGMENT_VERSION &&
+		pHeader->ullSegmentSize <= pMapping->ullSize;
+}
+
+
+//
+//	Returns the record at ullOffset if there is a whole one, and the
+//	offset of the record after it.
+//
+static bool
+ReadRecord(
+	const SPOOL_MAPPING* pMapping,
+	uint64_t ullOffset,
+	SPOOL_MESSAGE* pMessage,
+	uint64_t* pullNextOffset
+)
+{
+	SPOOL_RECORD* pRecord;
+	uint32_t ulChecksum;
+
+	if (ullOffset + sizeof(SPOOL_RECORD) > pMapping->ullSize)
+		return false;
+
+	pRecord = (SPOOL_RECORD*)(pMapping->pBase + ullOffset);
+	ulChecksum = RecordChecksumField((uint8_t*)pRecord)->load(std::memory_order_acquire);
+
+	if (!ulChecksum || pRecord->ulLength > pMapping->ullSize - ullOffset - sizeof(SPOOL_RECORD))
+		return false;
+
+	if (ulChecksum != RecordChecksum(pRecord->ullSequence, pRecord->ulLength, pRecord + 1))
+		return false;
+
+	pMessage->pData = pRecord + 1;
+	pMessage->ulLength = pRecord->ulLength;
+	pMessage->ullSequence = pRecord->ullSequence;
+	*pullNextOffset = ullOffset + SPOOL_RECORD_SIZE(pRecord->ulLength);
+
+	return true;
+}
+
+
+static void
+AddIndexEntry(
+	SPOOL* pSpool,
+	uint64_t ullSequence,
+	uint64_t ullOffset
+)
+{
+	SPOOL_INDEX_ENTRY Entry;
+
+	if (!pSpool->pIndex)
+		return;
+
+	if (pSpool->ullIndexedOffset && ullOffset - pSpool->ullIndexedOffset < SPOOL_INDEX_INTERVAL)
+		return;
+
+	Entry.ullSequence = ullSequence;
+	Entry.ullOffset = ullOffset;
+
+	//
+	//	Flushed to the file right away for readers in other processes.
+	//	The index is only a hint, after a crash it is rebuilt from the
+	//	segment.
+	//
+	fwrite(&Entry, sizeof(Entry), 1, pSpool->pIndex);
+	fflush(pSpool->pIndex);
+
+	pSpool->ullIndexedOffset = ullOffset;
+}
+
+
+static void
+CloseSegment(
+	SPOOL* pSpool
+)
+{
+	if (pSpool->pIndex)
+	{
+		fclose(pSpool->pIndex);
+		pSpool->pIndex = NULL;
+	}
+
+	UnmapFile(&pSpool->Mapping);
+}
+
+
+//
+//	Maps the segment starting at ullFirstSequence, creating it if need
+//	be. An existing one is scanned for the end of its records, a torn
+//	record at the end is wiped and its index rebuilt.
+//
+static bool
+OpenSegment(
+	SPOOL* pSpool,
+	uint64_t ullFirstSequence
+)
+{
+	SPOOL_SEGMENT_HEADER* pHeader;
+	SPOOL_MESSAGE Message;
+	uint64_t ullOffset, ullNextOffset, ullSequence;
+
+	if (!MapFile(SegmentPath(pSpool->Directory, SPOOL_SEGMENT_FORMAT, ullFirstSequence), pSpool->ullSegmentSize, true, &pSpool->Mapping))
+		return false;
+
+	pHeader = (SPOOL_SEGMENT_HEADER*)pSpool->Mapping.pBase;
+
+	//
+	//	A new file is all zeros, garbage after the header of one torn
+	//	while it was created is wiped below like a torn record.
+	//
+	if (!ValidHeader(&pSpool->Mapping) || pHeader->ullFirstSequence != ullFirstSequence)
+	{
+		memset(pHeader, 0, sizeof(SPOOL_SEGMENT_HEADER));
+
+		pHeader->ulMagic = SPOOL_SEGMENT_MAGIC;
+		pHeader->ulVersion = SPOOL_SEGMENT_VERSION;
+		pHeader->ullSegmentSize = pSpool->Mapping.ullSize;
+		pHeader->ullFirstSequence = ullFirstSequence;
+	}
+
+	pSpool->pIndex = OpenIndex(SegmentPath(pSpool->Directory, SPOOL_INDEX_FORMAT, ullFirstSequence), "wb");
+	pSpool->ullIndexedOffset = 0;
+
+	ullOffset = sizeof(SPOOL_SEGMENT_HEADER);
+	ullSequence = ullFirstSequence;
+
+	while (ReadRecord(&pSpool->Mapping, ullOffset, &Message, &ullNextOffset) && Message.ullSequence == ullSequence)
+	{
+		AddIndexEntry(pSpool, ullSequence, ullOffset);
+
+		ullOffset = ullNextOffset;
+		ullSequence++;
+	}
+
+	if (ullOffset + sizeof(SPOOL_RECORD) <= pSpool->Mapping.ullSize &&
+		RecordChecksumField(pSpool->Mapping.pBase + ullOffset)->load(std::memory_order_relaxed))
+	{
+		memset(pSpool->Mapping.pBase + ullOffset, 0, (size_t)(pSpool->Mapping.ullSize - ullOffset));
+	}
+
+	pSpool->ullOffset = ullOffset;
+	pSpool->ullFlushedOffset = 0;
+	pSpool->ullNextSequence = ullSequence;
+	pSpool->ullCommittedSequence = ullSequence - 1;
+
+	return true;
+}
+
+
+//
+//	Deletes the oldest segments past the retention. One that cannot be
+//	deleted yet is tried again at the next rollover.
+//
+static void
+ApplyRetention(
+	SPOOL* pSpool
+)
+{
+	while (pSpool->Segments.size() > pSpool->ulMaxSegments)
+	{
+		if (!RemoveFile(SegmentPath(pSpool->Directory, SPOOL_SEGMENT_FORMAT, pSpool->Segments.front())))
+			break;
+
+		RemoveFile(SegmentPath(pSpool->Directory, SPOOL_INDEX_FORMAT, pSpool->Segments.front()));
+		pSpool->Segments.erase(pSpool->Segments.begin());
+	}
+}
+
+
+//
+//	Commits the appended messages. Called with the lock held, which is
+//	dropped while the mapping is flushed, appenders keep going meanwhile
+//	and are committed by the next flush. Only one flush runs at a time.
+//
+static void
+CommitMessages(
+	SPOOL* pSpool,
+	std::unique_lock<std::mutex>& Lock
+)
+{
+	uint64_t ullBegin, ullEnd, ullSequence;
+	bool bCommitted;
+
+	pSpool->Committed.wait(Lock, [pSpool] { return !pSpool->bFlushing; });
+
+	if (!pSpool->Mapping.pBase || pSpool->ullCommittedSequence + 1 == pSpool->ullNextSequence)
+		return;
+
+	ullBegin = pSpool->ullFlushedOffset;
+	ullEnd = pSpool->ullOffset;
+	ullSequence = pSpool->ullNextSequence - 1;
+
+	pSpool->bFlushing = true;
+	pSpool->ulPendingBytes = 0;
+
+	Lock.unlock();
+	bCommitted = FlushMapping(&pSpool->Mapping, ullBegin, ullEnd);
+	Lock.lock();
+
+	pSpool->bFlushing = false;
+
+	if (bCommitted)
+	{
+		pSpool->ullFlushedOffset = ullEnd;
+		pSpool->ullCommittedSequence = ullSequence;
+	}
+	else
+	{
+		pSpool->ulCommitFailures++;
+	}
+
+	pSpool->Committed.notify_all();
+}
+
+
+//
+//	Seals the full segment and moves on to a new one. Appenders wait
+//	meanwhile, the lock is dropped while the segment is committed.
+//
+static bool
+RollSegment(
+	SPOOL* pSpool,
+	std::unique_lock<std::mutex>& Lock
+)
+{
+	bool bRolled;
+
+	if (pSpool->Mapping.pBase)
+	{
+		//
+		//	The end offset is only stored once the records before it are
+		//	on the disk, then the header is flushed on its own. The lock
+		//	is held from the commit on, no flush can start meanwhile.
+		//
+		pSpool->bRolling = true;
+		CommitMessages(pSpool, Lock);
+		pSpool->bRolling = false;
+
+		pSpool->Committed.notify_all();
+
+		if (pSpool->ullCommittedSequence + 1 != pSpool->ullNextSequence)
+			return false;
+
+		EndOffsetField(pSpool->Mapping.pBase)->store(pSpool->ullOffset, std::memory_order_release);
+		FlushMapping(&pSpool->Mapping, 0, sizeof(SPOOL_SEGMENT_HEADER));
+
+		CloseSegment(pSpool);
+	}
+
+	if (pSpool->Segments.empty() || pSpool->Segments.back() != pSpool->ullNextSequence)
+		pSpool->Segments.push_back(pSpool->ullNextSequence);
+
+	bRolled = OpenSegment(pSpool, pSpool->ullNextSequence);
+
+	if (bRolled)
+		ApplyRetention(pSpool);
+
+	return bRolled;
+}
+
+
+static void
+SpoolFlusher(
+	SPOOL* pSpool
+)
+{
+	std::unique_lock<std::mutex> Lock(pSpool->Lock);
+
+	while (!pSpool->bStopping)
+	{
+		pSpool->CommitNeeded.wait_for(Lock, std::chrono::milliseconds(pSpool->ulCommitMs), [pSpool]
+		{
+			return pSpool->bStopping ||
+				(pSpool->ullCommittedSequence + 1 != pSpool->ullNextSequence &&
+				(pSpool->ulWaiters || pSpool->ulPendingBytes >= pSpool->ulCommitBytes));
+		});
+
+		CommitMessages(pSpool, Lock);
+	}
+
+	CommitMessages(pSpool, Lock);
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolOpen
+//
+//	Parameters:
+//		[IN]  const SPOOL_CONFIG* pConfig
+//		Directory and limits of the spool, copied.
+//
+//	Routine Description:
+//		Opens the spool in the directory, which must exist, and starts its
+//		flusher. The newest segment is scanned and appending resumes after
+//		its last whole message, a message torn by a crash is overwritten.
+//
+//	Return Value:
+//		SPOOL*.
+//		The spool, NULL if a segment could not be opened or mapped.
+//
+//***********************************************************************************
+SPOOL*
+SpoolOpen(
+	const SPOOL_CONFIG* pConfig
+)
+{
+	SPOOL* pSpool;
+	SPOOL_SEGMENT_HEADER* pHeader;
+
+	if (!pConfig->pszDirectory || (pConfig->ullSegmentSize && pConfig->ullSegmentSize < SPOOL_MIN_SEGMENT_SIZE))
+		return NULL;
+
+	pSpool = new SPOOL;
+	pSpool->Directory = pConfig->pszDirectory;
+	pSpool->ullSegmentSize = pConfig->ullSegmentSize ? pConfig->ullSegmentSize : SPOOL_DEFAULT_SEGMENT_SIZE;
+	pSpool->ulMaxSegments = pConfig->ulMaxSegments ? pConfig->ulMaxSegments : SPOOL_DEFAULT_MAX_SEGMENTS;
+	pSpool->ulCommitMs = pConfig->ulCommitMs ? pConfig->ulCommitMs : SPOOL_DEFAULT_COMMIT_MS;
+	pSpool->ulCommitBytes = pConfig->ulCommitBytes ? pConfig->ulCommitBytes : SPOOL_DEFAULT_COMMIT_BYTES;
+	pSpool->Mapping.pBase = NULL;
+	pSpool->pIndex = NULL;
+	pSpool->ullNextSequence = 1;
+	pSpool->ulPendingBytes = 0;
+	pSpool->ulWaiters = 0;
+	pSpool->ulCommitFailures = 0;
+	pSpool->bFlushing = false;
+	pSpool->bRolling = false;
+	pSpool->bStopping = false;
+
+	ListSegments(pSpool->Directory, pSpool->Segments);
+
+	//
+	//	Appending goes on in the newest segment, unless it was full.
+	//
+	if (!pSpool->Segments.empty())
+	{
+		if (!OpenSegment(pSpool, pSpool->Segments.back()))
+		{
+			delete pSpool;
+			return NULL;
+		}
+
+		pHeader = (SPOOL_SEGMENT_HEADER*)pSpool->Mapping.pBase;
+
+		if (pHeader->ullEndOffset)
+			CloseSegment(pSpool);
+	}
+
+	if (!pSpool->Mapping.pBase)
+	{
+		std::unique_lock<std::mutex> Lock(pSpool->Lock);
+
+		if (!RollSegment(pSpool, Lock))
+		{
+			Lock.unlock();
+			delete pSpool;
+			return NULL;
+		}
+	}
+
+	pSpool->Flusher = std::thread(SpoolFlusher, pSpool);
+
+	return pSpool;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolAppend
+//
+//	Parameters:
+//		[IN]  SPOOL* pSpool
+//		Spool returned by SpoolOpen.
+//
+//		[IN/OUT]  SPOOL_MESSAGE* pMessages
+//		Messages to append, their ullSequence is set.
+//
+//		[IN]  uint32_t ulCount
+//		Number of messages.
+//
+//		[IN]  bool bWait
+//		true to return only once the messages are committed.
+//
+//	Routine Description:
+//		Appends the messages one after the other with consecutive sequence
+//		numbers, safe to call from any number of threads. Writers waiting
+//		for a commit share the flush the flusher makes for all of them.
+//
+//	Return Value:
+//		bool.
+//		false if a message is longer than a segment holds or the next
+//		segment could not be created, the messages before it are appended.
+//
+//***********************************************************************************
+bool
+SpoolAppend(
+	SPOOL* pSpool,
+	SPOOL_MESSAGE* pMessages,
+	uint32_t ulCount,
+	bool bWait
+)
+{
+	std::unique_lock<std::mutex> Lock(pSpool->Lock);
+	uint64_t ullRecordSize, ullLastSequence;
+	uint32_t ulIndex, ulCommitFailures;
+	uint8_t* pRecord;
+	bool bAppended = true;
+
+	for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+	{
+		if (pSpool->bRolling)
+			pSpool->Committed.wait(Lock, [pSpool] { return !pSpool->bRolling; });
+
+		ullRecordSize = SPOOL_RECORD_SIZE(pMessages[ulIndex].ulLength);
+
+		if (ullRecordSize > pSpool->ullSegmentSize - sizeof(SPOOL_SEGMENT_HEADER))
+		{
+			bAppended = false;
+			break;
+		}
+
+		//
+		//	Also retries a segment that could not be created before.
+		//
+		if (!pSpool->Mapping.pBase || pSpool->ullOffset + ullRecordSize > pSpool->Mapping.ullSize)
+		{
+			//
+			//	The new segment may still be too short if it was created
+			//	with a smaller segment size before.
+			//
+			if (!RollSegment(pSpool, Lock) || pSpool->ullOffset + ullRecordSize > pSpool->Mapping.ullSize)
+			{
+				bAppended = false;
+				break;
+			}
+		}
+
+		pRecord = pSpool->Mapping.pBase + pSpool->ullOffset;
+
+		memcpy(pRecord + sizeof(SPOOL_RECORD), pMessages[ulIndex].pData, pMessages[ulIndex].ulLength);
+		((SPOOL_RECORD*)pRecord)->ulLength = pMessages[ulIndex].ulLength;
+		((SPOOL_RECORD*)pRecord)->ullSequence = pSpool->ullNextSequence;
+
+		RecordChecksumField(pRecord)->store(
+			RecordChecksum(pSpool->ullNextSequence, pMessages[ulIndex].ulLength, pMessages[ulIndex].pData),
+			std::memory_order_release);
+
+		AddIndexEntry(pSpool, pSpool->ullNextSequence, pSpool->ullOffset);
+
+		pMessages[ulIndex].ullSequence = pSpool->ullNextSequence++;
+		pSpool->ullOffset += ullRecordSize;
+		pSpool->ulPendingBytes += (uint32_t)ullRecordSize;
+	}
+
+	if (!bWait || !ulIndex)
+	{
+		if (pSpool->ulPendingBytes >= pSpool->ulCommitBytes)
+			pSpool->CommitNeeded.notify_one();
+
+		return bAppended;
+	}
+
+	//
+	//	Waiters wake the flusher, whoever appends while it flushes waits
+	//	for the flush after.
+	//
+	ullLastSequence = pMessages[ulIndex - 1].ullSequence;
+	ulCommitFailures = pSpool->ulCommitFailures;
+
+	pSpool->ulWaiters++;
+	pSpool->CommitNeeded.notify_one();
+
+	pSpool->Committed.wait(Lock, [pSpool, ullLastSequence, ulCommitFailures]
+	{
+		return pSpool->ullCommittedSequence >= ullLastSequence || pSpool->ulCommitFailures != ulCommitFailures;
+	});
+
+	pSpool->ulWaiters--;
+
+	return bAppended && pSpool->ullCommittedSequence >= ullLastSequence;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolClose
+//
+//	Parameters:
+//		[IN]  SPOOL* pSpool
+//		Spool returned by SpoolOpen.
+//
+//	Routine Description:
+//		Stops the flusher, commits what is left and closes the spool.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+SpoolClose(
+	SPOOL* pSpool
+)
+{
+	{
+		std::lock_guard<std::mutex> Lock(pSpool->Lock);
+
+		pSpool->bStopping = true;
+		pSpool->CommitNeeded.notify_one();
+	}
+
+	pSpool->Flusher.join();
+
+	CloseSegment(pSpool);
+	delete pSpool;
+}
+
+
+//
+//	Maps the segment for the reader, it only counts once its header was
+//	written.
+//
+static bool
+MapReaderSegment(
+	SPOOL_READER* pReader,
+	uint64_t ullFirstSequence
+)
+{
+	SPOOL_MAPPING Mapping;
+
+	if (!MapFile(SegmentPath(pReader->Directory, SPOOL_SEGMENT_FORMAT, ullFirstSequence), 0, false, &Mapping))
+		return false;
+
+	if (!ValidHeader(&Mapping) || ((SPOOL_SEGMENT_HEADER*)Mapping.pBase)->ullFirstSequence != ullFirstSequence)
+	{
+		UnmapFile(&Mapping);
+		return false;
+	}
+
+	UnmapFile(&pReader->Mapping);
+
+	pReader->Mapping = Mapping;
+	pReader->ullOffset = sizeof(SPOOL_SEGMENT_HEADER);
+	pReader->ullNextSequence = ullFirstSequence;
+
+	return true;
+}
+
+
+//
+//	Offset of the last indexed message of the segment at or before
+//	ullSequence, the start of the records without an index.
+//
+static uint64_t
+LookUpOffset(
+	SPOOL_READER* pReader,
+	uint64_t ullFirstSequence,
+	uint64_t ullSequence,
+	uint64_t* pullIndexedSequence
+)
+{
+	std::vector<SPOOL_INDEX_ENTRY> Entries;
+	SPOOL_INDEX_ENTRY Entry;
+	FILE* pIndex;
+	size_t Found;
+
+	*pullIndexedSequence = ullFirstSequence;
+
+	pIndex = OpenIndex(SegmentPath(pReader->Directory, SPOOL_INDEX_FORMAT, ullFirstSequence), "rb");
+
+	if (!pIndex)
+		return sizeof(SPOOL_SEGMENT_HEADER);
+
+	while (fread(&Entry, sizeof(Entry), 1, pIndex) == 1)
+		Entries.push_back(Entry);
+
+	fclose(pIndex);
+
+	Found = std::upper_bound(Entries.begin(), Entries.end(), ullSequence,
+		[](uint64_t ullValue, const SPOOL_INDEX_ENTRY& Entry) { return ullValue < Entry.ullSequence; }) - Entries.begin();
+
+	if (!Found || Entries[Found - 1].ullOffset >= pReader->Mapping.ullSize)
+		return sizeof(SPOOL_SEGMENT_HEADER);
+
+	*pullIndexedSequence = Entries[Found - 1].ullSequence;
+
+	return Entries[Found - 1].ullOffset;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolOpenReader
+//
+//	Parameters:
+//		[IN]  const char* pszDirectory
+//		Directory of the spool.
+//
+//		[IN]  uint64_t ullSequence
+//		Sequence number to start from.
+//
+//	Routine Description:
+//		Finds the segment holding the message, looks its offset up in the
+//		sparse index of the segment and scans from there. Starting before
+//		the oldest message kept starts with it. The spool may be appended
+//		to meanwhile, by this process or another.
+//
+//	Return Value:
+//		SPOOL_READER*.
+//		The reader, NULL if the spool has no segment.
+//
+//***********************************************************************************
+SPOOL_READER*
+SpoolOpenReader(
+	const char* pszDirectory,
+	uint64_t ullSequence
+)
+{
+	std::vector<uint64_t> Segments;
+	SPOOL_READER* pReader;
+	SPOOL_MESSAGE Message;
+	uint64_t ullFirstSequence, ullIndexedSequence, ullOffset, ullNextOffset;
+	size_t Found;
+
+	ListSegments(pszDirectory, Segments);
+
+	if (Segments.empty())
+		return NULL;
+
+	Found = std::upper_bound(Segments.begin(), Segments.end(), ullSequence) - Segments.begin();
+	ullFirstSequence = Segments[Found ? Found - 1 : 0];
+
+	pReader = new SPOOL_READER;
+	pReader->Directory = pszDirectory;
+	pReader->Mapping.pBase = NULL;
+
+	if (!MapReaderSegment(pReader, ullFirstSequence))
+	{
+		delete pReader;
+		return NULL;
+	}
+
+	//
+	//	An index entry that does not lead to the message it names is
+	//	stale, the segment is then scanned from its start.
+	//
+	ullOffset = LookUpOffset(pReader, ullFirstSequence, ullSequence, &ullIndexedSequence);
+
+	if (!ReadRecord(&pReader->Mapping, ullOffset, &Message, &ullNextOffset) || Message.ullSequence != ullIndexedSequence)
+	{
+		ullOffset = sizeof(SPOOL_SEGMENT_HEADER);
+		ullIndexedSequence = ullFirstSequence;
+	}
+
+	pReader->ullOffset = ullOffset;
+	pReader->ullNextSequence = ullIndexedSequence;
+
+	while (pReader->ullNextSequence < ullSequence && SpoolRead(pReader, &Message))
+		;
+
+	return pReader;
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolRead
+//
+//	Parameters:
+//		[IN]  SPOOL_READER* pReader
+//		Reader returned by SpoolOpenReader.
+//
+//		[OUT]  SPOOL_MESSAGE* pMessage
+//		Receives the next message.
+//
+//	Routine Description:
+//		Returns the next message, moving on to the next segment at the end
+//		of one. Once it caught up with the writer, calling it again later
+//		returns what was appended since.
+//
+//	Return Value:
+//		bool.
+//		false if there is no message after the last one returned yet.
+//
+//***********************************************************************************
+bool
+SpoolRead(
+	SPOOL_READER* pReader,
+	SPOOL_MESSAGE* pMessage
+)
+{
+	std::vector<uint64_t> Segments;
+	uint64_t ullNextOffset, ullEndOffset;
+	size_t Found;
+
+	for (;;)
+	{
+		if (ReadRecord(&pReader->Mapping, pReader->ullOffset, pMessage, &ullNextOffset))
+		{
+			pReader->ullOffset = ullNextOffset;
+			pReader->ullNextSequence = pMessage->ullSequence + 1;
+
+			return true;
+		}
+
+		//
+		//	Past the records of a sealed segment the next one follows,
+		//	or the oldest after it if retention took it meanwhile.
+		//
+		ullEndOffset = EndOffsetField(pReader->Mapping.pBase)->load(std::memory_order_acquire);
+
+		if (!ullEndOffset || pReader->ullOffset < ullEndOffset)
+			return false;
+
+		ListSegments(pReader->Directory, Segments);
+
+		Found = std::lower_bound(Segments.begin(), Segments.end(), pReader->ullNextSequence) - Segments.begin();
+
+		if (Found == Segments.size() || !MapReaderSegment(pReader, Segments[Found]))
+			return false;
+	}
+}
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolCloseReader
+//
+//	Parameters:
+//		[IN]  SPOOL_READER* pReader
+//		Reader returned by SpoolOpenReader.
+//
+//	Routine Description:
+//		Unmaps the segment the reader was in and frees it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+SpoolCloseReader(
+	SPOOL_READER* pReader
+)
+{
+	UnmapFile(&pReader->Mapping);
+	delete pReader;
+}
@@ -0,0 +1,246 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	spool.h																		*
+*																				*
+* Abstract:																		*
+* 	This file declares the spool, the store the service keeps what it			*
+* 	drained in. Messages are appended to fixed size segment files,				*
+* 	mapped into memory, each with a sparse index from sequence number			*
+* 	to offset. A flusher commits them in groups, full segments roll				*
+* 	over and the oldest are deleted past the retention. It only					*
+* 	depends on the C++ standard library and the system's file mapping,			*
+* 	on Linux it builds on its own with its benchmark:							*
+*																				*
+* 	g++ -O2 -pthread -DSPOOLBENCH_MAIN spool.cpp spoolbench.cpp					*
+* 		-o 6fings-spoolbench													*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define SPOOL_DEFAULT_SEGMENT_SIZE		(64 * 1024 * 1024)
+#define SPOOL_DEFAULT_MAX_SEGMENTS		16
+#define SPOOL_DEFAULT_COMMIT_MS			50
+#define SPOOL_DEFAULT_COMMIT_BYTES		(4 * 1024 * 1024)
+
+//
+//	The sparse index has an entry at least every SPOOL_INDEX_INTERVAL
+//	bytes of a segment, a lookup scans no more than that.
+//
+#define SPOOL_INDEX_INTERVAL			(64 * 1024)
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+
+//
+//	Segments are ullSegmentSize bytes, the spool keeps the newest
+//	ulMaxSegments of them. The flusher commits what was appended every
+//	ulCommitMs milliseconds, or as soon as ulCommitBytes are waiting.
+//	0 picks the SPOOL_DEFAULT_* value.
+//
+typedef struct _SPOOL_CONFIG
+{
+	const char* pszDirectory;
+	uint64_t ullSegmentSize;
+	uint32_t ulMaxSegments;
+	uint32_t ulCommitMs;
+	uint32_t ulCommitBytes;
+
+} SPOOL_CONFIG;
+
+
+//
+//	A message to append, or one read back. pData of a message read
+//	points into the segment and stays valid until the next read.
+//
+typedef struct _SPOOL_MESSAGE
+{
+	const void* pData;
+	uint32_t ulLength;
+	uint64_t ullSequence;
+
+} SPOOL_MESSAGE;
+
+
+typedef struct _SPOOL SPOOL;
+typedef struct _SPOOL_READER SPOOL_READER;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		SpoolOpen
+//
+//	Parameters:
+//		[IN]  const SPOOL_CONFIG* pConfig
+//		Directory and limits of the spool, copied.
+//
+//	Routine Description:
+//		Opens the spool in the directory, which must exist, and starts its
+//		flusher. The newest segment is scanned and appending resumes after
+//		its last whole message, a message torn by a crash is overwritten.
+//
+//	Return Value:
+//		SPOOL*.
+//		The spool, NULL if a segment could not be opened or mapped.
+//
+//***********************************************************************************
+SPOOL*
+SpoolOpen(
+	const SPOOL_CONFIG* pConfig
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolAppend
+//
+//	Parameters:
+//		[IN]  SPOOL* pSpool
+//		Spool returned by SpoolOpen.
+//
+//		[IN/OUT]  SPOOL_MESSAGE* pMessages
+//		Messages to append, their ullSequence is set.
+//
+//		[IN]  uint32_t ulCount
+//		Number of messages.
+//
+//		[IN]  bool bWait
+//		true to return only once the messages are committed.
+//
+//	Routine Description:
+//		Appends the messages one after the other with consecutive sequence
+//		numbers, safe to call from any number of threads. Writers waiting
+//		for a commit share the flush the flusher makes for all of them.
+//
+//	Return Value:
+//		bool.
+//		false if a message is longer than a segment holds or the next
+//		segment could not be created, the messages before it are appended.
+//
+//***********************************************************************************
+bool
+SpoolAppend(
+	SPOOL* pSpool,
+	SPOOL_MESSAGE* pMessages,
+	uint32_t ulCount,
+	bool bWait
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolClose
+//
+//	Parameters:
+//		[IN]  SPOOL* pSpool
+//		Spool returned by SpoolOpen.
+//
+//	Routine Description:
+//		Stops the flusher, commits what is left and closes the spool.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+SpoolClose(
+	SPOOL* pSpool
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolOpenReader
+//
+//	Parameters:
+//		[IN]  const char* pszDirectory
+//		Directory of the spool.
+//
+//		[IN]  uint64_t ullSequence
+//		Sequence number to start from.
+//
+//	Routine Description:
+//		Finds the segment holding the message, looks its offset up in the
+//		sparse index of the segment and scans from there. Starting before
+//		the oldest message kept starts with it. The spool may be appended
+//		to meanwhile, by this process or another.
+//
+//	Return Value:
+//		SPOOL_READER*.
+//		The reader, NULL if the spool has no segment.
+//
+//***********************************************************************************
+SPOOL_READER*
+SpoolOpenReader(
+	const char* pszDirectory,
+	uint64_t ullSequence
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolRead
+//
+//	Parameters:
+//		[IN]  SPOOL_READER* pReader
+//		Reader returned by SpoolOpenReader.
+//
+//		[OUT]  SPOOL_MESSAGE* pMessage
+//		Receives the next message.
+//
+//	Routine Description:
+//		Returns the next message, moving on to the next segment at the end
+//		of one. Once it caught up with the writer, calling it again later
+//		returns what was appended since.
+//
+//	Return Value:
+//		bool.
+//		false if there is no message after the last one returned yet.
+//
+//***********************************************************************************
+bool
+SpoolRead(
+	SPOOL_READER* pReader,
+	SPOOL_MESSAGE* pMessage
+);
+
+
+//***********************************************************************************
+//	Function:
+//		SpoolCloseReader
+//
+//	Parameters:
+//		[IN]  SPOOL_READER* pReader
+//		Reader returned by SpoolOpenReader.
+//
+//	Routine Description:
+//		Unmaps the segment the reader was in and frees it.
+//
+//	Return Value:
+//		None.
+//
+//***********************************************************************************
+void
+SpoolCloseReader(
+	SPOOL_READER* pReader
+);
@@ -0,0 +1,379 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	spoolbench.cpp																*
+*																				*
+* Abstract:																		*
+* 	This file implements the benchmark of the spool.							*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+
+
+/////////////////////////////////////////////////////////////////////
+//	H E A D E R S.
+/////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "spool.h"
+#include "spoolbench.h"
+
+
+/////////////////////////////////////////////////////////////////////
+//	M A C R O S.
+/////////////////////////////////////////////////////////////////////
+#define SPOOLBENCH_MAX_THREADS		64
+#define SPOOLBENCH_MAX_BATCH		4096
+
+//
+//	A message starts with the thread that appended it and its number
+//	within the thread, the rest is filled from that.
+//
+#define SPOOLBENCH_MIN_LENGTH		8
+
+
+/////////////////////////////////////////////////////////////////////
+//	T Y P E D E F S.
+/////////////////////////////////////////////////////////////////////
+typedef struct _SPOOLBENCH_CONFIG
+{
+	const char* pszDirectory;
+	uint64_t ullMessages;
+	uint32_t ulLength;
+	uint32_t ulThreads;
+	uint32_t ulBatch;
+	uint64_t ullSegmentSize;
+	bool bWait;
+
+} SPOOLBENCH_CONFIG;
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  D E F I N I T I O N S.
+/////////////////////////////////////////////////////////////////////
+
+
+static bool
+ParseSpoolOptions(
+	int argc,
+	char* argv[],
+	SPOOLBENCH_CONFIG* pConfig
+)
+{
+	const char* pszValue;
+	int iIndex;
+
+	pConfig->pszDirectory = "6fings-spool";
+	pConfig->ullMessages = 1000000;
+	pConfig->ulLength = 256;
+	pConfig->ulThreads = 1;
+	pConfig->ulBatch = 64;
+	pConfig->ullSegmentSize = 0;
+	pConfig->bWait = false;
+
+	for (iIndex = 0; iIndex < argc; iIndex++)
+	{
+		if (argv[iIndex][0] != '-' || !argv[iIndex][1] || argv[iIndex][2])
+			return false;
+
+		if (argv[iIndex][1] == 'w')
+		{
+			pConfig->bWait = true;
+			continue;
+		}
+
+		if (iIndex + 1 == argc)
+			return false;
+
+		pszValue = argv[++iIndex];
+
+		switch (argv[iIndex - 1][1])
+		{
+		case 'd':
+			pConfig->pszDirectory = pszValue;
+			break;
+
+		case 'n':
+			pConfig->ullMessages = strtoull(pszValue, NULL, 10);
+			if (!pConfig->ullMessages)
+				return false;
+			break;
+
+		case 'l':
+			pConfig->ulLength = (uint32_t)strtoul(pszValue, NULL, 10);
+			if (pConfig->ulLength < SPOOLBENCH_MIN_LENGTH)
+				return false;
+			break;
+
+		case 't':
+			pConfig->ulThreads = (uint32_t)atoi(pszValue);
+			if (pConfig->ulThreads < 1 || pConfig->ulThreads > SPOOLBENCH_MAX_THREADS)
+				return false;
+			break;
+
+		case 'b':
+			pConfig->ulBatch = (uint32_t)atoi(pszValue);
+			if (pConfig->ulBatch < 1 || pConfig->ulBatch > SPOOLBENCH_MAX_BATCH)
+				return false;
+			break;
+
+		case 'g':
+			pConfig->ullSegmentSize = strtoull(pszValue, NULL, 10) * 1024 * 1024;
+			if (!pConfig->ullSegmentSize)
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+//
+//	Message ullNumber of thread ulThread, ulLength bytes.
+//
+static void
+FillMessage(
+	uint8_t* pMessage,
+	uint32_t ulLength,
+	uint32_t ulThread,
+	uint64_t ullNumber
+)
+{
+	uint64_t ullTag = ((uint64_t)ulThread << 48) | ullNumber;
+	uint32_t ulIndex;
+
+	memcpy(pMessage, &ullTag, sizeof(ullTag));
+
+	for (ulIndex = SPOOLBENCH_MIN_LENGTH; ulIndex < ulLength; ulIndex++)
+		pMessage[ulIndex] = (uint8_t)(ullTag * 31 + ulIndex);
+}
+
+
+//
+//	Appends the messages numbered ullFirst to ullLast of the thread, and
+//	keeps the lowest sequence number it got.
+//
+static bool
+AppendMessages(
+	SPOOL* pSpool,
+	const SPOOLBENCH_CONFIG* pConfig,
+	uint32_t ulThread,
+	uint64_t ullFirst,
+	uint64_t ullLast,
+	std::atomic<uint64_t>* pFirstSequence
+)
+{
+	std::vector<uint8_t> Data((size_t)pConfig->ulBatch * pConfig->ulLength);
+	std::vector<SPOOL_MESSAGE> Messages(pConfig->ulBatch);
+	uint64_t ullNumber, ullSequence;
+	uint32_t ulCount, ulIndex;
+
+	for (ullNumber = ullFirst; ullNumber < ullLast; ullNumber += ulCount)
+	{
+		ulCount = (uint32_t)(ullLast - ullNumber < pConfig->ulBatch ? ullLast - ullNumber : pConfig->ulBatch);
+
+		for (ulIndex = 0; ulIndex < ulCount; ulIndex++)
+		{
+			FillMessage(&Data[(size_t)ulIndex * pConfig->ulLength], pConfig->ulLength, ulThread, ullNumber + ulIndex);
+
+			Messages[ulIndex].pData = &Data[(size_t)ulIndex * pConfig->ulLength];
+			Messages[ulIndex].ulLength = pConfig->ulLength;
+		}
+
+		if (!SpoolAppend(pSpool, Messages.data(), ulCount, pConfig->bWait))
+			return false;
+
+		if (ullNumber == ullFirst)
+		{
+			ullSequence = pFirstSequence->load();
+
+			while (Messages[0].ullSequence < ullSequence &&
+				!pFirstSequence->compare_exchange_weak(ullSequence, Messages[0].ullSequence))
+				;
+		}
+	}
+
+	return true;
+}
+
+
+int
+RunSpoolBenchmark(
+	int argc,
+	char* argv[]
+)
+{
+	SPOOLBENCH_CONFIG Config;
+	SPOOL_CONFIG SpoolConfig;
+	SPOOL* pSpool;
+	SPOOL_READER* pReader;
+	SPOOL_MESSAGE Message;
+	std::vector<std::thread> Threads;
+	std::vector<uint64_t> NextNumbers;
+	std::vector<uint8_t> Expected;
+	std::atomic<uint64_t> FirstSequence(UINT64_MAX);
+	std::atomic<uint32_t> Failures(0);
+	std::chrono::steady_clock::time_point Start;
+	double dAppendSeconds, dReadSeconds;
+	uint64_t ullRead, ullTag, ullPrevious;
+	uint32_t ulThread;
+
+	if (!ParseSpoolOptions(argc, argv, &Config))
+	{
+		fprintf(stderr, "Usage: spool-bench [-d directory] [-n messages] [-l length] [-t threads] [-b batch] [-g segment MB] [-w]\n");
+		return 1;
+	}
+
+#ifdef _WIN32
+	CreateDirectoryA(Config.pszDirectory, NULL);
+#else
+	mkdir(Config.pszDirectory, 0755);
+#endif
+
+	memset(&SpoolConfig, 0, sizeof(SpoolConfig));
+	SpoolConfig.pszDirectory = Config.pszDirectory;
+	SpoolConfig.ullSegmentSize = Config.ullSegmentSize ? Config.ullSegmentSize : SPOOL_DEFAULT_SEGMENT_SIZE;
+
+	//
+	//	Enough segments are kept for the run to be read back, the ones
+	//	appended to before may go.
+	//
+	SpoolConfig.ulMaxSegments = (uint32_t)(Config.ullMessages * (Config.ulLength + 16) / SpoolConfig.ullSegmentSize + 2);
+
+	if (SpoolConfig.ulMaxSegments < SPOOL_DEFAULT_MAX_SEGMENTS)
+		SpoolConfig.ulMaxSegments = SPOOL_DEFAULT_MAX_SEGMENTS;
+
+	pSpool = SpoolOpen(&SpoolConfig);
+
+	if (!pSpool)
+	{
+		fprintf(stderr, "Cannot open the spool in %s\n", Config.pszDirectory);
+		return 1;
+	}
+
+	//
+	//	Every thread appends its share of the messages.
+	//
+	Start = std::chrono::steady_clock::now();
+
+	for (ulThread = 0; ulThread < Config.ulThreads; ulThread++)
+	{
+		Threads.emplace_back([&, ulThread]
+		{
+			if (!AppendMessages(pSpool, &Config, ulThread,
+				Config.ullMessages * ulThread / Config.ulThreads,
+				Config.ullMessages * (ulThread + 1) / Config.ulThreads,
+				&FirstSequence))
+			{
+				Failures++;
+			}
+		});
+	}
+
+	for (std::thread& Thread : Threads)
+		Thread.join();
+
+	dAppendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+	SpoolClose(pSpool);
+
+	if (Failures)
+	{
+		fprintf(stderr, "Appending failed\n");
+		return 1;
+	}
+
+	printf("Appended %llu messages of %u bytes from %u threads, %u per append%s\n",
+		(unsigned long long)Config.ullMessages, Config.ulLength, Config.ulThreads, Config.ulBatch,
+		Config.bWait ? ", each committed" : "");
+	printf("  %.0f messages/s, %.1f MB/s\n",
+		(double)Config.ullMessages / dAppendSeconds,
+		(double)Config.ullMessages * Config.ulLength / dAppendSeconds / (1024 * 1024));
+
+	//
+	//	Read back from the first message appended. A thread's messages
+	//	keep their order, whatever the other threads appended between.
+	//
+	pReader = SpoolOpenReader(Config.pszDirectory, FirstSequence);
+
+	if (!pReader)
+	{
+		fprintf(stderr, "Cannot open a reader on %s\n", Config.pszDirectory);
+		return 1;
+	}
+
+	NextNumbers.resize(Config.ulThreads);
+	Expected.resize(Config.ulLength);
+
+	for (ulThread = 0; ulThread < Config.ulThreads; ulThread++)
+		NextNumbers[ulThread] = Config.ullMessages * ulThread / Config.ulThreads;
+
+	ullRead = 0;
+	ullPrevious = FirstSequence - 1;
+	Start = std::chrono::steady_clock::now();
+
+	while (SpoolRead(pReader, &Message))
+	{
+		memcpy(&ullTag, Message.pData, sizeof(ullTag));
+		ulThread = (uint32_t)(ullTag >> 48);
+
+		if (Message.ullSequence != ullPrevious + 1 || Message.ulLength != Config.ulLength || ulThread >= Config.ulThreads)
+			break;
+
+		FillMessage(Expected.data(), Config.ulLength, ulThread, NextNumbers[ulThread]++);
+
+		if (memcmp(Expected.data(), Message.pData, Config.ulLength))
+			break;
+
+		ullPrevious = Message.ullSequence;
+		ullRead++;
+	}
+
+	dReadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+	SpoolCloseReader(pReader);
+
+	if (ullRead != Config.ullMessages)
+	{
+		fprintf(stderr, "Message %llu did not come back, %llu of %llu read\n",
+			(unsigned long long)(ullPrevious + 1), (unsigned long long)ullRead, (unsigned long long)Config.ullMessages);
+		return 1;
+	}
+
+	printf("Read back %llu messages from sequence number %llu\n",
+		(unsigned long long)ullRead, (unsigned long long)FirstSequence.load());
+	printf("  %.0f messages/s, %.1f MB/s\n",
+		(double)ullRead / dReadSeconds,
+		(double)ullRead * Config.ulLength / dReadSeconds / (1024 * 1024));
+
+	return 0;
+}
+
+
+#ifdef SPOOLBENCH_MAIN
+int
+main(
+	int argc,
+	char* argv[]
+)
+{
+	return RunSpoolBenchmark(argc - 1, argv + 1);
+}
+#endif
@@ -0,0 +1,53 @@
+/********************************************************************************
+*																				*
+* File Name:																	*
+* 	spoolbench.h																*
+*																				*
+* Abstract:																		*
+* 	This file declares the benchmark of the spool, it builds with				*
+* 	spool.cpp as described in spool.h.											*
+*																				*
+* Revision History:																*
+* 	Date:	17 October 2026														*
+* 	Desc:	Created																*
+*																				*
+********************************************************************************/
+#pragma once
+
+
+/////////////////////////////////////////////////////////////////////
+//	F U N C T I O N  P R O T O T Y P E S.
+/////////////////////////////////////////////////////////////////////
+
+//***********************************************************************************
+//	Function:
+//		RunSpoolBenchmark
+//
+//	Parameters:
+//		[IN]  int argc
+//		Number of arguments.
+//
+//		[IN]  char* argv[]
+//		Arguments, without the program name or the "spool-bench" command:
+//		-d directory, -n messages, -l message length, -t threads,
+//		-b messages per append, -g segment size in MB and -w to wait for
+//		every append to be committed.
+//
+//	Routine Description:
+//		Appends the messages to a spool in the directory from every thread
+//		at once and reads them back from the first one appended, checking
+//		their sequence numbers follow each other and their contents. Prints
+//		the rate of both. The directory is created if need be, segments
+//		already in it are kept and appended to.
+//
+//	Return Value:
+//		int.
+//		0 on success, 1 if the spool could not be opened or a message did
+//		not come back.
+//
+//***********************************************************************************
+int
+RunSpoolBenchmark(
+	int argc,
+	char* argv[]
+);